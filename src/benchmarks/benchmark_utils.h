@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Helpers shared by the benchmarks
+ */
+
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "ouster/types.h"
+
+namespace ouster {
+namespace bench {
+
+/** Lidar profiles benchmarked, indexed by the benchmark argument. */
+const std::vector<sensor::UDPProfileLidar> profiles = {
+    sensor::PROFILE_LIDAR_LEGACY, sensor::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL,
+    sensor::PROFILE_RNG19_RFL8_SIG16_NIR16, sensor::PROFILE_RNG15_RFL8_NIR8};
+
+/** Add one argument per lidar profile to a benchmark. */
+inline void all_profiles(benchmark::internal::Benchmark* b) {
+    for (size_t i = 0; i < profiles.size(); i++)
+        b->Arg(static_cast<int64_t>(i));
+}
+
+/** Default metadata of a sensor with the lidar profile of the argument. */
+inline sensor::sensor_info profile_info(const benchmark::State& state,
+                                        sensor::lidar_mode mode =
+                                            sensor::MODE_1024x10) {
+    auto info = sensor::default_sensor_info(mode);
+    info.format.udp_profile_lidar = profiles.at(state.range(0));
+    return info;
+}
+
+/**
+ * Make the lidar packets of a frame: channel data is random, and all columns
+ * are valid and numbered in order.
+ */
+inline std::vector<std::vector<uint8_t>> make_frame(
+    const sensor::sensor_info& info, uint16_t frame_id, unsigned seed = 0) {
+    const auto& pf = sensor::get_format(info);
+    const bool legacy =
+        pf.udp_profile_lidar == sensor::PROFILE_LIDAR_LEGACY;
+    const int w = info.format.columns_per_frame;
+
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<std::vector<uint8_t>> packets;
+    for (int m_id = 0; m_id < w; m_id += pf.columns_per_packet) {
+        std::vector<uint8_t> buf(pf.lidar_packet_size);
+        for (auto& b : buf) b = static_cast<uint8_t>(byte(gen));
+        if (!legacy) std::memcpy(buf.data() + 2, &frame_id, sizeof(frame_id));
+        const size_t status_offset =
+            pf.nth_col(1, buf.data()) - pf.nth_col(0, buf.data()) - 4;
+
+        for (int icol = 0; icol < pf.columns_per_packet; icol++) {
+            auto col_buf = const_cast<uint8_t*>(pf.nth_col(icol, buf.data()));
+            const uint64_t ts = 1000 + m_id + icol;
+            const uint16_t col_m_id = static_cast<uint16_t>(m_id + icol);
+            std::memcpy(col_buf, &ts, sizeof(ts));
+            std::memcpy(col_buf + 8, &col_m_id, sizeof(col_m_id));
+            if (legacy) {
+                const uint32_t status = 0xffffffff;
+                std::memcpy(col_buf + 10, &frame_id, sizeof(frame_id));
+                std::memcpy(col_buf + status_offset, &status, sizeof(status));
+            } else {
+                const uint16_t status = 0x01;
+                std::memcpy(col_buf + 10, &status, sizeof(status));
+            }
+        }
+        packets.push_back(std::move(buf));
+    }
+    return packets;
+}
+
+}  // namespace bench
+}  // namespace ouster
@@ -0,0 +1,234 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Throughput of parsing, batching and processing scans
+ *
+ * Run with --benchmark_out=<file> --benchmark_out_format=json for results to
+ * compare between builds, or build the run_benchmarks target.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark_utils.h"
+#include "ouster/image_processing.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+
+namespace {
+
+// counters shared by benchmarks processing the pixels of whole scans
+void set_scan_counters(benchmark::State& state, const LidarScan& ls) {
+    state.SetItemsProcessed(state.iterations() * ls.w * ls.h);
+    state.SetLabel(std::to_string(ls.w) + "x" + std::to_string(ls.h));
+}
+
+}  // namespace
+
+/*
+ * Parsing every field of every column of a packet
+ */
+static void BM_col_field(benchmark::State& state) {
+    const auto info = bench::profile_info(state);
+    const auto& pf = get_format(info);
+    const auto packet = bench::make_frame(info, 1).front();
+    std::vector<uint32_t> dst(pf.pixels_per_column);
+
+    for (auto _ : state) {
+        for (int icol = 0; icol < pf.columns_per_packet; icol++) {
+            const auto col_buf = pf.nth_col(icol, packet.data());
+            for (const auto& ft : pf) {
+                pf.col_field(col_buf, ft.first, dst.data());
+                benchmark::DoNotOptimize(dst.data());
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * pf.lidar_packet_size);
+    state.SetLabel(to_string(pf.udp_profile_lidar));
+}
+BENCHMARK(BM_col_field)->Apply(bench::all_profiles);
+
+/*
+ * Batching the packets of whole frames into a scan
+ */
+static void BM_ScanBatcher(benchmark::State& state) {
+    const auto info = bench::profile_info(state);
+    const auto& pf = get_format(info);
+    // alternate frames so that every frame completes a scan
+    const std::vector<std::vector<std::vector<uint8_t>>> frames = {
+        bench::make_frame(info, 1, 1), bench::make_frame(info, 2, 2)};
+
+    ScanBatcher batcher(info);
+    LidarScan ls(info.format.columns_per_frame, info.format.pixels_per_column,
+                 pf.udp_profile_lidar);
+    size_t i = 0, n_packets = 0;
+
+    for (auto _ : state) {
+        for (const auto& p : frames[i++ % frames.size()])
+            benchmark::DoNotOptimize(batcher(p.data(), ls));
+        n_packets += frames[0].size();
+    }
+    state.SetItemsProcessed(n_packets);
+    state.SetBytesProcessed(n_packets * pf.lidar_packet_size);
+    state.SetLabel(to_string(pf.udp_profile_lidar));
+}
+BENCHMARK(BM_ScanBatcher)->Apply(bench::all_profiles);
+
+static void BM_make_xyz_lut(benchmark::State& state) {
+    const auto mode = static_cast<lidar_mode>(state.range(0));
+    const auto info = default_sensor_info(mode);
+
+    for (auto _ : state) benchmark::DoNotOptimize(make_xyz_lut(info));
+    state.SetItemsProcessed(state.iterations() *
+                            info.format.columns_per_frame *
+                            info.format.pixels_per_column);
+    state.SetLabel(to_string(mode));
+}
+BENCHMARK(BM_make_xyz_lut)->Arg(MODE_1024x10)->Arg(MODE_2048x10);
+
+/*
+ * Randomly filled scans of the default sensor, used by the benchmarks below
+ */
+class ScanFixture : public benchmark::Fixture {
+   public:
+    sensor_info info;
+    LidarScan ls;
+
+    void SetUp(const benchmark::State& state) override {
+        info = default_sensor_info(static_cast<lidar_mode>(state.range(0)));
+        const auto frame = bench::make_frame(info, 1);
+        ScanBatcher batcher(info);
+        ls = LidarScan(info.format.columns_per_frame,
+                       info.format.pixels_per_column,
+                       info.format.udp_profile_lidar);
+        for (const auto& p : frame) batcher(p.data(), ls);
+        // the first packet of the next frame completes the scan
+        batcher(bench::make_frame(info, 2).front().data(), ls);
+    }
+
+    void TearDown(const benchmark::State&) override { ls = LidarScan(); }
+};
+
+BENCHMARK_DEFINE_F(ScanFixture, cartesian)(benchmark::State& state) {
+    const auto lut = make_xyz_lut(info);
+    for (auto _ : state) benchmark::DoNotOptimize(cartesian(ls, lut));
+    set_scan_counters(state, ls);
+}
+BENCHMARK_REGISTER_F(ScanFixture, cartesian)
+    ->Arg(MODE_1024x10)
+    ->Arg(MODE_2048x10);
+
+BENCHMARK_DEFINE_F(ScanFixture, cartesian_into_float)
+(benchmark::State& state) {
+    const auto lut = make_xyz_lutf(info);
+    std::vector<float> points(3 * ls.w * ls.h);
+    for (auto _ : state) {
+        cartesian_into(ls, lut, points.data());
+        benchmark::ClobberMemory();
+    }
+    set_scan_counters(state, ls);
+}
+BENCHMARK_REGISTER_F(ScanFixture, cartesian_into_float)
+    ->Arg(MODE_1024x10)
+    ->Arg(MODE_2048x10);
+
+BENCHMARK_DEFINE_F(ScanFixture, destagger)(benchmark::State& state) {
+    const img_t<uint32_t> range = ls.field(RANGE);
+    const auto& shift = info.format.pixel_shift_by_row;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(destagger<uint32_t>(range, shift));
+    set_scan_counters(state, ls);
+}
+BENCHMARK_REGISTER_F(ScanFixture, destagger)
+    ->Arg(MODE_1024x10)
+    ->Arg(MODE_2048x10);
+
+BENCHMARK_DEFINE_F(ScanFixture, Destaggerer)(benchmark::State& state) {
+    const img_t<uint32_t> range = ls.field(RANGE);
+    img_t<uint32_t> dest(range.rows(), range.cols());
+    const Destaggerer destagger(info);
+    for (auto _ : state) {
+        destagger(range, dest);
+        benchmark::ClobberMemory();
+    }
+    set_scan_counters(state, ls);
+}
+BENCHMARK_REGISTER_F(ScanFixture, Destaggerer)
+    ->Arg(MODE_1024x10)
+    ->Arg(MODE_2048x10);
+
+BENCHMARK_DEFINE_F(ScanFixture, AutoExposure)(benchmark::State& state) {
+    const img_t<float> signal = ls.field(SIGNAL).cast<float>();
+    img_t<float> image(signal.rows(), signal.cols());
+    viz::AutoExposure ae;
+    for (auto _ : state) {
+        image = signal;
+        ae(image);
+        benchmark::ClobberMemory();
+    }
+    set_scan_counters(state, ls);
+}
+BENCHMARK_REGISTER_F(ScanFixture, AutoExposure)
+    ->Arg(MODE_1024x10)
+    ->Arg(MODE_2048x10);
+
+BENCHMARK_DEFINE_F(ScanFixture, BeamUniformityCorrector)
+(benchmark::State& state) {
+    const img_t<float> near_ir = ls.field(NEAR_IR).cast<float>();
+    img_t<float> image(near_ir.rows(), near_ir.cols());
+    viz::BeamUniformityCorrector buc;
+    for (auto _ : state) {
+        image = near_ir;
+        buc(image);
+        benchmark::ClobberMemory();
+    }
+    set_scan_counters(state, ls);
+}
+BENCHMARK_REGISTER_F(ScanFixture, BeamUniformityCorrector)
+    ->Arg(MODE_1024x10)
+    ->Arg(MODE_2048x10);
+
+BENCHMARK_DEFINE_F(ScanFixture, LidarScan_copy)(benchmark::State& state) {
+    for (auto _ : state) {
+        LidarScan copy{ls};
+        benchmark::DoNotOptimize(copy);
+    }
+    set_scan_counters(state, ls);
+}
+BENCHMARK_REGISTER_F(ScanFixture, LidarScan_copy)
+    ->Arg(MODE_1024x10)
+    ->Arg(MODE_2048x10);
+
+BENCHMARK_DEFINE_F(ScanFixture, LidarScan_assign)(benchmark::State& state) {
+    LidarScan copy{ls};
+    for (auto _ : state) {
+        copy = ls;
+        benchmark::DoNotOptimize(copy);
+    }
+    set_scan_counters(state, ls);
+}
+BENCHMARK_REGISTER_F(ScanFixture, LidarScan_assign)
+    ->Arg(MODE_1024x10)
+    ->Arg(MODE_2048x10);
+
+BENCHMARK_DEFINE_F(ScanFixture, LidarScan_move)(benchmark::State& state) {
+    for (auto _ : state) {
+        LidarScan moved{std::move(ls)};
+        ls = std::move(moved);
+        benchmark::DoNotOptimize(ls);
+    }
+    set_scan_counters(state, ls);
+}
+BENCHMARK_REGISTER_F(ScanFixture, LidarScan_move)
+    ->Arg(MODE_1024x10)
+    ->Arg(MODE_2048x10);
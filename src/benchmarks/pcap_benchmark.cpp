@@ -0,0 +1,102 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Throughput of batching the packets recorded in tests/pcaps
+ *
+ * Packets are read into memory before timing, so that only batching is
+ * measured. Takes the same arguments as other benchmarks.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "benchmark_utils.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/os_pcap.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+
+namespace {
+
+const std::vector<std::string> recordings = {
+    "OS-0-128-U1_v2.3.0_1024x10", "OS-0-32-U1_v2.2.0_1024x10",
+    "OS-1-32-G_v2.1.1_1024x10", "OS-2-128-U1_v2.3.0_1024x10",
+    "OS-2-32-U0_v2.0.0_1024x10"};
+
+// the lidar packets of a recording
+std::vector<std::vector<uint8_t>> read_lidar_packets(
+    const std::string& file, const sensor_info& info) {
+    const auto& pf = get_format(info);
+    auto handle = sensor_utils::replay_initialize(file);
+    if (!handle) throw std::runtime_error("Failed to open " + file);
+
+    std::vector<std::vector<uint8_t>> packets;
+    sensor_utils::packet_view view;
+    while (sensor_utils::next_packet(*handle, view)) {
+        if (view.payload_size != pf.lidar_packet_size) continue;
+        if (info.udp_port_lidar && view.dst_port != info.udp_port_lidar)
+            continue;
+        packets.emplace_back(view.payload, view.payload + view.payload_size);
+    }
+    sensor_utils::replay_uninitialize(*handle);
+    return packets;
+}
+
+void BM_ScanBatcher_pcap(benchmark::State& state, const sensor_info& info,
+                         const std::vector<std::vector<uint8_t>>& packets) {
+    const auto& pf = get_format(info);
+    ScanBatcher batcher(info);
+    LidarScan ls(info.format.columns_per_frame, info.format.pixels_per_column,
+                 pf.udp_profile_lidar);
+    size_t n_scans = 0;
+
+    for (auto _ : state) {
+        for (const auto& p : packets) n_scans += batcher(p.data(), ls);
+        benchmark::DoNotOptimize(ls);
+    }
+    state.SetItemsProcessed(state.iterations() * packets.size());
+    state.SetBytesProcessed(state.iterations() * packets.size() *
+                            pf.lidar_packet_size);
+    state.counters["scans"] =
+        benchmark::Counter(n_scans, benchmark::Counter::kIsRate);
+    state.SetLabel(to_string(pf.udp_profile_lidar));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    // kept alive until benchmarks have run
+    std::vector<sensor_info> infos;
+    std::vector<std::vector<std::vector<uint8_t>>> packets;
+    infos.reserve(recordings.size());
+    packets.reserve(recordings.size());
+
+    for (const auto& name : recordings) {
+        const std::string base = std::string{PCAP_DIR} + "/" + name;
+        try {
+            infos.push_back(metadata_from_json(base + ".json"));
+            packets.push_back(read_lidar_packets(base + ".pcap", infos.back()));
+        } catch (const std::exception& e) {
+            std::cerr << "Skipping " << name << ": " << e.what() << std::endl;
+            if (infos.size() > packets.size()) infos.pop_back();
+            continue;
+        }
+        benchmark::RegisterBenchmark(("BM_ScanBatcher_pcap/" + name).c_str(),
+                                     BM_ScanBatcher_pcap, infos.back(),
+                                     packets.back());
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
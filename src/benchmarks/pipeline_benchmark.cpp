@@ -0,0 +1,376 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief End to end throughput and latency of replaying recorded packets
+ * through batching, projection and packing of point clouds
+ *
+ * Packets of a recording are read into memory, then replayed to each
+ * simulated sensor on its own thread, paced at a multiple of real time. Each
+ * sensor batches its packets into scans, projects completed scans to points
+ * and packs them into a message buffer laid out like a ROS point cloud.
+ * Reports frames per second, latency from the packet completing a scan to its
+ * packed cloud, allocations per frame and cpu use, as text and optionally JSON.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ouster/impl/lidar_scan_impl.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/os_pcap.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+using clock_type = std::chrono::steady_clock;
+
+/*
+ * Count allocations on all threads, to report allocations per frame
+ */
+namespace {
+std::atomic<uint64_t> n_allocs{0};
+}  // namespace
+
+void* operator new(size_t size) {
+    n_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct Options {
+    std::string pcap;
+    std::string meta;
+    double rate{1.0};  // multiple of real time, 0 for as fast as possible
+    int sensors{1};
+    int loops{1};
+    std::string json;
+};
+
+void usage() {
+    std::cerr
+        << "Usage: pipeline_benchmark [options]\n\n"
+           "  --pcap <file>     recording to replay, default "
+           "OS-2-128-U1_v2.3.0_1024x10\n"
+           "                    from tests/pcaps\n"
+           "  --meta <file>     metadata of the recording, default "
+           "<pcap without .pcap>.json\n"
+           "  --rate <x>        multiple of real time, 0 for as fast as "
+           "possible (default 1)\n"
+           "  --sensors <n>     number of sensors replaying the recording "
+           "(default 1)\n"
+           "  --loops <n>       times to replay the recording (default 1)\n"
+           "  --json <file>     also write results as JSON\n";
+}
+
+Options parse_options(int argc, char* argv[]) {
+    Options opts;
+    opts.pcap = std::string{PCAP_DIR} + "/OS-2-128-U1_v2.3.0_1024x10.pcap";
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            usage();
+            std::exit(EXIT_SUCCESS);
+        }
+        if (i + 1 >= argc) throw std::invalid_argument("Missing value: " + arg);
+        const std::string value = argv[++i];
+        if (arg == "--pcap")
+            opts.pcap = value;
+        else if (arg == "--meta")
+            opts.meta = value;
+        else if (arg == "--rate")
+            opts.rate = std::stod(value);
+        else if (arg == "--sensors")
+            opts.sensors = std::stoi(value);
+        else if (arg == "--loops")
+            opts.loops = std::stoi(value);
+        else if (arg == "--json")
+            opts.json = value;
+        else
+            throw std::invalid_argument("Unknown option: " + arg);
+    }
+    if (opts.meta.empty()) {
+        const auto ext = opts.pcap.rfind(".pcap");
+        opts.meta = opts.pcap.substr(0, ext) + ".json";
+    }
+    if (opts.rate < 0 || opts.sensors < 1 || opts.loops < 1)
+        throw std::invalid_argument("Invalid rate, sensors or loops");
+    return opts;
+}
+
+// the lidar packets of a recording, with capture times
+struct Recording {
+    std::vector<std::vector<uint8_t>> packets;
+    std::vector<std::chrono::microseconds> times;  // since the first packet
+    std::chrono::microseconds duration{0};
+};
+
+Recording read_recording(const std::string& file, const sensor_info& info) {
+    const auto& pf = get_format(info);
+    auto handle = sensor_utils::replay_initialize(file);
+    if (!handle) throw std::runtime_error("Failed to open " + file);
+
+    Recording rec;
+    sensor_utils::packet_view view;
+    std::chrono::microseconds first{-1};
+    while (sensor_utils::next_packet(*handle, view)) {
+        if (view.payload_size != pf.lidar_packet_size) continue;
+        if (info.udp_port_lidar && view.dst_port != info.udp_port_lidar)
+            continue;
+        if (first.count() < 0) first = view.timestamp;
+        rec.packets.emplace_back(view.payload,
+                                 view.payload + view.payload_size);
+        rec.times.push_back(view.timestamp - first);
+    }
+    sensor_utils::replay_uninitialize(*handle);
+    if (rec.packets.empty())
+        throw std::runtime_error("No lidar packets in " + file);
+
+    // leave a packet's worth of time between loops
+    const auto n = rec.times.size();
+    rec.duration = rec.times.back() +
+                   (n > 1 ? rec.times.back() / static_cast<int>(n - 1)
+                          : std::chrono::microseconds{0});
+    return rec;
+}
+
+// a point as packed into messages, like the default ROS point type
+struct PackedPoint {
+    float x, y, z, pad;
+    float intensity;
+    uint32_t t;
+    uint16_t reflectivity;
+    uint8_t ring;
+    uint16_t ambient;
+    uint32_t range;
+};
+
+// copy a field of any type to a preallocated image
+struct read_field {
+    template <typename T>
+    void operator()(Eigen::Ref<const img_t<T>> field,
+                    img_t<uint32_t>& dest) const {
+        dest = field.template cast<uint32_t>();
+    }
+};
+
+struct SensorResult {
+    size_t frames{0};
+    std::vector<double> latencies_ms;
+    std::chrono::nanoseconds busy{0};  // batching, projection and packing
+};
+
+// sensors set up before replay starts, so that setup isn't measured
+struct StartLine {
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    clock_type::time_point start;
+};
+
+/*
+ * Replay the recording to one sensor, from its own thread
+ */
+void run_sensor(const Recording& rec, const sensor_info& info,
+                const Options& opts, StartLine& line, SensorResult& result) {
+    const auto& pf = get_format(info);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    const auto lut = make_xyz_lutf(info);
+
+    // preallocated once, as a publishing pipeline would
+    ScanBatcher batcher(info);
+    LidarScan ls(w, h, pf.udp_profile_lidar);
+    std::vector<float> xyz(3 * w * h);
+    std::vector<PackedPoint> msg(w * h);
+    img_t<uint32_t> signal = img_t<uint32_t>::Zero(h, w);
+    img_t<uint32_t> reflectivity = signal, near_ir = signal;
+    auto read = [&](const LidarScan& scan, ChanField f, img_t<uint32_t>& dest) {
+        if (scan.field_type(f)) impl::visit_field(scan, f, read_field{}, dest);
+    };
+    result.latencies_ms.reserve(rec.packets.size() * opts.loops /
+                                (w / pf.columns_per_packet) + 1);
+
+    line.ready++;
+    while (!line.go.load(std::memory_order_acquire)) std::this_thread::yield();
+    const auto start = line.start;
+
+    for (int loop = 0; loop < opts.loops; loop++) {
+        for (size_t i = 0; i < rec.packets.size(); i++) {
+            if (opts.rate > 0) {
+                const auto at = rec.times[i] + loop * rec.duration;
+                std::this_thread::sleep_until(
+                    start + std::chrono::duration_cast<clock_type::duration>(
+                                at / opts.rate));
+            }
+
+            const auto t0 = clock_type::now();
+            if (batcher(rec.packets[i].data(), ls)) {
+                cartesian_into(ls, lut, xyz.data());
+                read(ls, SIGNAL, signal);
+                read(ls, REFLECTIVITY, reflectivity);
+                read(ls, NEAR_IR, near_ir);
+                const auto range = ls.field<uint32_t>(RANGE);
+                const auto ts = ls.timestamp();
+                for (size_t u = 0; u < h; u++) {
+                    for (size_t v = 0; v < w; v++) {
+                        const size_t k = u * w + v;
+                        auto& p = msg[k];
+                        p.x = xyz[3 * k];
+                        p.y = xyz[3 * k + 1];
+                        p.z = xyz[3 * k + 2];
+                        p.intensity = static_cast<float>(signal(u, v));
+                        p.t = static_cast<uint32_t>(ts[v] - ts[0]);
+                        p.reflectivity =
+                            static_cast<uint16_t>(reflectivity(u, v));
+                        p.ring = static_cast<uint8_t>(u);
+                        p.ambient = static_cast<uint16_t>(near_ir(u, v));
+                        p.range = range(u, v);
+                    }
+                }
+                const auto t1 = clock_type::now();
+                result.latencies_ms.push_back(
+                    std::chrono::duration<double, std::milli>(t1 - t0)
+                        .count());
+                result.frames++;
+                result.busy += t1 - t0;
+            } else {
+                result.busy += clock_type::now() - t0;
+            }
+        }
+    }
+}
+
+double percentile(std::vector<double>& v, double p) {
+    if (v.empty()) return 0;
+    const size_t k = std::min(v.size() - 1,
+                              static_cast<size_t>(p / 100.0 * v.size()));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    sensor_info info;
+    Recording rec;
+    try {
+        opts = parse_options(argc, argv);
+        info = metadata_from_json(opts.meta);
+        rec = read_recording(opts.pcap, info);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n\n";
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    std::ostringstream pace;
+    if (opts.rate > 0)
+        pace << opts.rate << "x real time";
+    else
+        pace << "full speed";
+    std::cerr << "Replaying " << rec.packets.size() << " packets of "
+              << opts.pcap << " to " << opts.sensors << " sensor(s), "
+              << opts.loops << " time(s), at " << pace.str() << std::endl;
+
+    std::vector<SensorResult> results(opts.sensors);
+    std::vector<std::thread> threads;
+    StartLine line;
+    for (int s = 0; s < opts.sensors; s++)
+        threads.emplace_back(run_sensor, std::cref(rec), std::cref(info),
+                             std::cref(opts), std::ref(line),
+                             std::ref(results[s]));
+    while (line.ready < opts.sensors) std::this_thread::yield();
+
+    const uint64_t allocs_before = n_allocs.load();
+    const std::clock_t cpu_before = std::clock();
+    const auto start = line.start = clock_type::now();
+    line.go.store(true, std::memory_order_release);
+    for (auto& t : threads) t.join();
+    const double wall =
+        std::chrono::duration<double>(clock_type::now() - start).count();
+    const double cpu =
+        static_cast<double>(std::clock() - cpu_before) / CLOCKS_PER_SEC;
+    const uint64_t allocs = n_allocs.load() - allocs_before;
+
+    size_t frames = 0;
+    double busy = 0;
+    std::vector<double> latencies;
+    for (auto& r : results) {
+        frames += r.frames;
+        busy += std::chrono::duration<double>(r.busy).count();
+        latencies.insert(latencies.end(), r.latencies_ms.begin(),
+                         r.latencies_ms.end());
+    }
+
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    const double fps = frames / wall;
+    const double p50 = percentile(latencies, 50);
+    const double p99 = percentile(latencies, 99);
+    const double max = latencies.empty()
+                           ? 0
+                           : *std::max_element(latencies.begin(),
+                                               latencies.end());
+    const double allocs_per_frame = frames ? double(allocs) / frames : 0;
+    const double cores_used = cpu / wall;
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "frames:                " << frames << "\n"
+              << "frames/s:              " << fps << "\n"
+              << "latency p50 (ms):      " << p50 << "\n"
+              << "latency p99 (ms):      " << p99 << "\n"
+              << "latency max (ms):      " << max << "\n"
+              << "allocations per frame: " << allocs_per_frame << "\n"
+              << "busy per frame (ms):   " << (frames ? busy / frames * 1e3 : 0)
+              << "\n"
+              << "cpu cores used:        " << cores_used << " of " << cores
+              << "\n"
+              << "cpu per core (%):      " << cores_used / cores * 100 << "\n";
+
+    if (!opts.json.empty()) {
+        std::ofstream out(opts.json);
+        out << std::setprecision(6) << "{\n"
+            << "  \"pcap\": \"" << opts.pcap << "\",\n"
+            << "  \"rate\": " << opts.rate << ",\n"
+            << "  \"sensors\": " << opts.sensors << ",\n"
+            << "  \"loops\": " << opts.loops << ",\n"
+            << "  \"frames\": " << frames << ",\n"
+            << "  \"wall_s\": " << wall << ",\n"
+            << "  \"frames_per_second\": " << fps << ",\n"
+            << "  \"latency_p50_ms\": " << p50 << ",\n"
+            << "  \"latency_p99_ms\": " << p99 << ",\n"
+            << "  \"latency_max_ms\": " << max << ",\n"
+            << "  \"allocations_per_frame\": " << allocs_per_frame << ",\n"
+            << "  \"busy_per_frame_ms\": "
+            << (frames ? busy / frames * 1e3 : 0) << ",\n"
+            << "  \"cpu_cores_used\": " << cores_used << ",\n"
+            << "  \"cpu_cores\": " << cores << "\n"
+            << "}\n";
+        if (!out) {
+            std::cerr << "Failed to write " << opts.json << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -16,6 +16,8 @@ class OusterSDKConan(ConanFile):
     options = {
         "build_viz": [True, False],
         "build_pcap": [True, False],
+        "build_scan_file": [True, False],
+        "build_arrow": [True, False],
         "shared": [True, False],
         "fPIC": [True, False],
         "ensure_cpp17": [True, False],
@@ -24,6 +26,8 @@ class OusterSDKConan(ConanFile):
     default_options = {
         "build_viz": False,
         "build_pcap": False,
+        "build_scan_file": False,
+        "build_arrow": False,
         "shared": False,
         "fPIC": True,
         "ensure_cpp17": False,
@@ -36,6 +40,8 @@ class OusterSDKConan(ConanFile):
         "conan/*",
         "ouster_client/*",
         "ouster_pcap/*",
+        "ouster_scan_file/*",
+        "ouster_arrow/*",
         "ouster_viz/*",
         "tests/*",
         "CMakeLists.txt",
@@ -63,6 +69,9 @@ class OusterSDKConan(ConanFile):
         if self.options.build_pcap:
             self.requires("libtins/4.3")
 
+        if self.options.build_scan_file:
+            self.requires("zlib/1.2.12")
+
         # override due to conflict b/w libtins and libcurl
         self.requires("openssl/1.1.1q")
 
@@ -81,6 +90,8 @@ class OusterSDKConan(ConanFile):
         cmake = CMake(self)
         cmake.definitions["BUILD_VIZ"] = self.options.build_viz
         cmake.definitions["BUILD_PCAP"] = self.options.build_pcap
+        cmake.definitions["BUILD_SCAN_FILE"] = self.options.build_scan_file
+        cmake.definitions["BUILD_ARROW"] = self.options.build_arrow
         cmake.definitions["USE_EIGEN_MAX_ALIGN_BYTES_32"] = self.options.eigen_max_align_bytes
         # alt way, but we use CMAKE_TOOLCHAIN_FILE in other pipeline so avoid overwrite
         # cmake.definitions["CMAKE_TOOLCHAIN_FILE"] = os.path.join(self.build_folder, "conan_paths.cmake")
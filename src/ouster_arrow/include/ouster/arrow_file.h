@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Export sequences of lidar scans to Apache Arrow files
+ *
+ * Scans are written in the Arrow IPC file format, also known as Feather V2,
+ * which is read by pyarrow, pandas.read_feather(), polars, DuckDB and the
+ * other implementations of Arrow without a conversion step. Each row of the
+ * table is a scan, and consecutive scans are grouped in record batches:
+ *
+ *   column           | type
+ *   -----------------|--------------------------------------
+ *   frame_id         | int32
+ *   timestamp        | fixed_size_list<uint64>[w]
+ *   measurement_id   | fixed_size_list<uint16>[w]
+ *   status           | fixed_size_list<uint32>[w]
+ *   rx_timestamp     | fixed_size_list<uint64>[w]
+ *   RANGE, ...       | fixed_size_list<uint8 to uint64>[h * w]
+ *   xyz (optional)   | fixed_size_list<float>[h * w * 3]
+ *
+ * Field columns hold the planes of the scan in row-major order, so a plane is
+ * stored with a single copy, and the points of the xyz column are interleaved
+ * like those of cartesian_into(). The sensor metadata is stored in the schema
+ * metadata under the key "ouster:sensor_info".
+ *
+ * Values are stored in host byte order, which is little-endian on all
+ * supported platforms and the byte order Arrow expects.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace sensor_utils {
+
+/** Options for writing Arrow files. */
+struct arrow_file_options {
+    /// Number of scans per record batch
+    size_t batch_frames{8};
+    /// Fields to write as columns, in order, or empty for all fields of the
+    /// scans
+    std::vector<sensor::ChanField> fields{};
+    /// Add a column of the Cartesian points of the RANGE field
+    bool xyz{false};
+    /// Number of threads projecting points, including the calling thread
+    int n_threads{1};
+};
+
+/**
+ * Write a sequence of lidar scans to an Arrow file.
+ *
+ * All scans must have the dimensions and fields of the scan layout given to
+ * the constructor. Record batches are built as scans are added and written to
+ * the file by a background thread, so projecting points and copying planes
+ * overlaps with writing the previous batch.
+ */
+class ArrowFileWriter {
+   public:
+    /**
+     * Create an Arrow file for scans with the default fields of the lidar
+     * profile of the sensor.
+     *
+     * @throw std::invalid_argument if the options are invalid.
+     * @throw std::runtime_error if the file can't be created.
+     *
+     * @param[in] file The path of the file to create.
+     * @param[in] info The sensor metadata of the scans.
+     * @param[in] options The columns and batching options.
+     */
+    ArrowFileWriter(const std::string& file, const sensor::sensor_info& info,
+                    const arrow_file_options& options = {});
+
+    /**
+     * Create an Arrow file for scans with custom fields.
+     *
+     * @throw std::invalid_argument if the options are invalid or select fields
+     * that aren't in the prototype.
+     * @throw std::runtime_error if the file can't be created.
+     *
+     * @param[in] file The path of the file to create.
+     * @param[in] info The sensor metadata of the scans.
+     * @param[in] prototype A scan with the dimensions and fields to expect.
+     * @param[in] options The columns and batching options.
+     */
+    ArrowFileWriter(const std::string& file, const sensor::sensor_info& info,
+                    const LidarScan& prototype,
+                    const arrow_file_options& options = {});
+
+    /** Write buffered scans and the footer, ignoring errors. */
+    ~ArrowFileWriter();
+
+    ArrowFileWriter(const ArrowFileWriter&) = delete;
+    ArrowFileWriter& operator=(const ArrowFileWriter&) = delete;
+
+    /**
+     * Add a scan to the file.
+     *
+     * Staggered and destaggered scans are projected with the matching lookup
+     * tables.
+     *
+     * @throw std::invalid_argument if the scan doesn't match the layout.
+     * @throw std::runtime_error if writing to the file failed.
+     *
+     * @param[in] scan The scan to write.
+     */
+    void write(const LidarScan& scan);
+
+    /**
+     * Write buffered scans and the footer, and close the file.
+     *
+     * @throw std::runtime_error if writing to the file failed.
+     */
+    void close();
+
+    /**
+     * Get the number of scans added so far.
+     *
+     * @return The number of rows.
+     */
+    size_t frame_count() const;
+
+   private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace sensor_utils
+}  // namespace ouster
@@ -0,0 +1,637 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/arrow_file.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include "ouster/impl/lidar_scan_impl.h"
+
+namespace ouster {
+namespace sensor_utils {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+namespace {
+
+/*
+ * Constants of the Arrow IPC format, from Schema.fbs, Message.fbs and
+ * File.fbs of the Arrow specification
+ */
+constexpr char FILE_MAGIC[8] = {'A', 'R', 'R', 'O', 'W', '1', 0, 0};
+constexpr uint32_t CONTINUATION = 0xffffffff;
+constexpr int16_t METADATA_V5 = 4;
+constexpr uint8_t HEADER_SCHEMA = 1;
+constexpr uint8_t HEADER_RECORD_BATCH = 3;
+constexpr uint8_t TYPE_INT = 2;
+constexpr uint8_t TYPE_FLOATING_POINT = 3;
+constexpr uint8_t TYPE_FIXED_SIZE_LIST = 16;
+constexpr int16_t PRECISION_SINGLE = 1;
+constexpr char METADATA_KEY[] = "ouster:sensor_info";
+
+struct field_node {
+    int64_t length;
+    int64_t null_count;
+};
+
+struct buffer_span {
+    int64_t offset;
+    int64_t length;
+};
+
+struct block {
+    int64_t offset;
+    int32_t metadata_length;
+    int32_t reserved;
+    int64_t body_length;
+};
+
+static_assert(sizeof(field_node) == 16, "unexpected FieldNode size");
+static_assert(sizeof(buffer_span) == 16, "unexpected Buffer size");
+static_assert(sizeof(block) == 24, "unexpected Block size");
+
+size_t pad8(size_t n) { return (n + 7) & ~size_t{7}; }
+
+size_t field_type_size(ChanFieldType t) {
+    switch (t) {
+        case ChanFieldType::UINT8:
+            return 1;
+        case ChanFieldType::UINT16:
+            return 2;
+        case ChanFieldType::UINT32:
+            return 4;
+        case ChanFieldType::UINT64:
+            return 8;
+        default:
+            throw std::invalid_argument("Invalid field type for Arrow file");
+    }
+}
+
+/*
+ * A field of a flatbuffer table: an inline scalar, or an offset to an object
+ * appended by ref
+ */
+struct slot {
+    uint16_t id;
+    size_t size;
+    uint64_t value;
+    std::function<size_t()> ref;
+};
+
+template <typename T>
+slot scalar(uint16_t id, T v) {
+    slot s{id, sizeof(T), 0, {}};
+    std::memcpy(&s.value, &v, sizeof(T));
+    return s;
+}
+
+slot ref(uint16_t id, std::function<size_t()> f) {
+    return {id, sizeof(uint32_t), 0, std::move(f)};
+}
+
+/*
+ * A flatbuffer written front to back, for the few tables of Arrow metadata.
+ * Objects are appended after the offsets referring to them, which are patched
+ * once the objects are written, so offsets are positive as the format
+ * requires. Positions are relative to the start of the buffer, which is
+ * 8-byte aligned in the file.
+ */
+class flatbuf {
+   public:
+    // leaves room for the offset to the root table
+    flatbuf() { put<uint32_t>(0); }
+
+    size_t table(std::vector<slot> slots) {
+        // wider values first, so that each is aligned once the first is
+        std::stable_sort(
+            slots.begin(), slots.end(),
+            [](const slot& a, const slot& b) { return a.size > b.size; });
+        size_t n_ids = 0;
+        std::vector<size_t> at(slots.size());
+        size_t inline_size = sizeof(int32_t);
+        for (size_t i = 0; i < slots.size(); i++) {
+            at[i] = inline_size;
+            inline_size += slots[i].size;
+            n_ids = std::max<size_t>(n_ids, slots[i].id + 1);
+        }
+
+        std::vector<uint16_t> offsets(n_ids, 0);
+        for (size_t i = 0; i < slots.size(); i++)
+            offsets[slots[i].id] = static_cast<uint16_t>(at[i]);
+        const size_t vtable = put<uint16_t>(
+            static_cast<uint16_t>(sizeof(uint16_t) * (2 + n_ids)));
+        put<uint16_t>(static_cast<uint16_t>(inline_size));
+        for (auto o : offsets) put<uint16_t>(o);
+
+        // 8-byte values follow the 4-byte offset to the vtable
+        const bool wide = !slots.empty() && slots.front().size == 8;
+        align(wide ? 8 : 4, wide ? 4 : 0);
+        const size_t table = put<int32_t>(static_cast<int32_t>(
+            buf_.size() - vtable));
+        buf_.resize(table + inline_size, 0);
+        for (size_t i = 0; i < slots.size(); i++)
+            std::memcpy(&buf_[table + at[i]], &slots[i].value, slots[i].size);
+        for (size_t i = 0; i < slots.size(); i++)
+            if (slots[i].ref) patch(table + at[i], slots[i].ref());
+        return table;
+    }
+
+    size_t string(const std::string& s) {
+        const size_t at = put<uint32_t>(static_cast<uint32_t>(s.size()));
+        buf_.insert(buf_.end(), s.begin(), s.end());
+        buf_.push_back(0);
+        return at;
+    }
+
+    size_t tables(size_t n, const std::function<size_t(size_t)>& f) {
+        const size_t at = put<uint32_t>(static_cast<uint32_t>(n));
+        buf_.resize(at + sizeof(uint32_t) * (n + 1), 0);
+        for (size_t i = 0; i < n; i++)
+            patch(at + sizeof(uint32_t) * (i + 1), f(i));
+        return at;
+    }
+
+    // vector of structs with 8-byte members
+    template <typename T>
+    size_t structs(const std::vector<T>& v) {
+        align(8, 4);
+        const size_t at = put<uint32_t>(static_cast<uint32_t>(v.size()));
+        const size_t size = v.size() * sizeof(T);
+        buf_.resize(at + sizeof(uint32_t) + size);
+        if (size > 0) std::memcpy(&buf_[at + sizeof(uint32_t)], v.data(), size);
+        return at;
+    }
+
+    std::vector<uint8_t> finish(size_t root) {
+        patch(0, root);
+        align(8);
+        return std::move(buf_);
+    }
+
+   private:
+    void align(size_t a, size_t rem = 0) {
+        while (buf_.size() % a != rem) buf_.push_back(0);
+    }
+
+    template <typename T>
+    size_t put(T v) {
+        align(sizeof(T));
+        const size_t at = buf_.size();
+        buf_.resize(at + sizeof(T));
+        std::memcpy(&buf_[at], &v, sizeof(T));
+        return at;
+    }
+
+    void patch(size_t at, size_t target) {
+        const uint32_t o = static_cast<uint32_t>(target - at);
+        std::memcpy(&buf_[at], &o, sizeof(o));
+    }
+
+    std::vector<uint8_t> buf_;
+};
+
+// a column of the table, with a list of values per scan if list_size > 0
+struct column {
+    std::string name;
+    uint8_t type;
+    int bit_width;
+    bool is_signed;
+    size_t list_size;
+
+    size_t frame_bytes() const {
+        return std::max<size_t>(list_size, 1) * bit_width / 8;
+    }
+};
+
+column uint_column(const std::string& name, size_t bytes, size_t n) {
+    return {name, TYPE_INT, static_cast<int>(8 * bytes), false, n};
+}
+
+size_t write_field(flatbuf& fb, const column& c) {
+    auto name = [&] { return fb.string(c.name); };
+    if (c.list_size == 0) {
+        auto type = [&] {
+            if (c.type == TYPE_FLOATING_POINT)
+                return fb.table({scalar<int16_t>(0, PRECISION_SINGLE)});
+            return fb.table({scalar<int32_t>(0, c.bit_width),
+                             scalar<uint8_t>(1, c.is_signed)});
+        };
+        auto children = [&] { return fb.tables(0, {}); };
+        return fb.table({ref(0, name), scalar<uint8_t>(1, 0),
+                         scalar<uint8_t>(2, c.type), ref(3, type),
+                         ref(5, children)});
+    }
+
+    // values of lists are named "item", as by other Arrow writers
+    auto type = [&] {
+        return fb.table(
+            {scalar<int32_t>(0, static_cast<int32_t>(c.list_size))});
+    };
+    auto children = [&] {
+        return fb.tables(1, [&](size_t) {
+            column item = c;
+            item.name = "item";
+            item.list_size = 0;
+            return write_field(fb, item);
+        });
+    };
+    return fb.table({ref(0, name), scalar<uint8_t>(1, 0),
+                     scalar<uint8_t>(2, TYPE_FIXED_SIZE_LIST), ref(3, type),
+                     ref(5, children)});
+}
+
+size_t write_schema(flatbuf& fb, const std::vector<column>& columns,
+                    const std::string& metadata) {
+    auto fields = [&] {
+        return fb.tables(columns.size(), [&](size_t i) {
+            return write_field(fb, columns[i]);
+        });
+    };
+    auto custom_metadata = [&] {
+        return fb.tables(1, [&](size_t) {
+            return fb.table({ref(0, [&] { return fb.string(METADATA_KEY); }),
+                             ref(1, [&] { return fb.string(metadata); })});
+        });
+    };
+    return fb.table(
+        {scalar<int16_t>(0, 0), ref(1, fields), ref(2, custom_metadata)});
+}
+
+// an encapsulated message: continuation, size and padded flatbuffer
+std::vector<uint8_t> write_message(
+    uint8_t header_type, const std::function<size_t(flatbuf&)>& header,
+    size_t body_length) {
+    flatbuf fb;
+    const size_t root = fb.table(
+        {scalar<int16_t>(0, METADATA_V5), scalar<uint8_t>(1, header_type),
+         ref(2, [&] { return header(fb); }),
+         scalar<int64_t>(3, static_cast<int64_t>(body_length))});
+    const auto meta = fb.finish(root);
+
+    std::vector<uint8_t> out(2 * sizeof(uint32_t) + meta.size());
+    const uint32_t size = static_cast<uint32_t>(meta.size());
+    std::memcpy(out.data(), &CONTINUATION, sizeof(CONTINUATION));
+    std::memcpy(out.data() + sizeof(uint32_t), &size, sizeof(size));
+    std::memcpy(out.data() + 2 * sizeof(uint32_t), meta.data(), meta.size());
+    return out;
+}
+
+/*
+ * Offsets of the values of each column in the body of a batch of n scans,
+ * returning the size of the body
+ */
+size_t body_layout(const std::vector<column>& columns, size_t n,
+                   std::vector<size_t>& offsets) {
+    offsets.clear();
+    size_t size = 0;
+    for (const auto& c : columns) {
+        offsets.push_back(size);
+        size += pad8(n * c.frame_bytes());
+    }
+    return size;
+}
+
+/*
+ * Run f(rows_begin, rows_end) over bands of rows in [0, n_rows), using the
+ * calling thread for the first band
+ */
+template <typename F>
+void for_row_bands(size_t n_rows, int n_threads, F&& f) {
+    const size_t n_bands =
+        std::max<size_t>(1, std::min<size_t>(std::max(n_threads, 1), n_rows));
+    const size_t band = (n_rows + n_bands - 1) / n_bands;
+    std::vector<std::thread> workers;
+    for (size_t b = 1; b < n_bands; b++) {
+        const size_t begin = std::min(b * band, n_rows);
+        const size_t end = std::min(begin + band, n_rows);
+        if (begin < end) workers.emplace_back(f, begin, end);
+    }
+    f(size_t{0}, std::min(band, n_rows));
+    for (auto& w : workers) w.join();
+}
+
+struct field_data {
+    template <typename T>
+    void operator()(Eigen::Ref<const img_t<T>> field,
+                    const void*& data) const {
+        data = field.data();
+    }
+};
+
+}  // namespace
+
+struct ArrowFileWriter::Impl {
+    const arrow_file_options options;
+    const size_t w;
+    const size_t h;
+    const std::vector<std::pair<ChanField, ChanFieldType>> field_types;
+    const std::string metadata;
+
+    std::vector<ChanField> fields;
+    std::vector<column> columns;
+    std::shared_ptr<const XYZLutf> lut;
+    std::shared_ptr<const XYZLutf> lut_destaggered;
+
+    std::FILE* file{nullptr};
+    uint64_t offset{0};
+    std::vector<block> blocks;
+    size_t n_frames{0};
+
+    // the batch being filled, laid out for a full batch
+    std::vector<size_t> offsets;
+    size_t body_size{0};
+    std::vector<uint8_t> body;
+    size_t batch_size{0};
+
+    // the batch being written by the writer thread
+    std::thread thread;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<uint8_t> pending_meta;
+    std::vector<uint8_t> pending_body;
+    size_t pending_size{0};
+    bool pending{false};
+    bool stop{false};
+    bool failed{false};
+
+    Impl(const std::string& path, const sensor::sensor_info& info,
+         const LidarScan& prototype, const arrow_file_options& opts)
+        : options(opts),
+          w(prototype.w),
+          h(prototype.h),
+          field_types(prototype.begin(), prototype.end()),
+          metadata(sensor::to_string(info)) {
+        if (options.batch_frames == 0)
+            throw std::invalid_argument("Arrow record batches must hold scans");
+
+        fields = options.fields;
+        if (fields.empty())
+            for (const auto& ft : field_types) fields.push_back(ft.first);
+        if (options.xyz) {
+            if (prototype.field_type(ChanField::RANGE) != ChanFieldType::UINT32)
+                throw std::invalid_argument(
+                    "Arrow xyz column needs a RANGE field");
+            lut = shared_xyz_lutf(info);
+            lut_destaggered = shared_xyz_lutf(info, true);
+            if (lut->direction.rows() != static_cast<std::ptrdiff_t>(w * h))
+                throw std::invalid_argument(
+                    "Arrow xyz column needs scans of the sensor resolution");
+        }
+
+        columns.push_back({"frame_id", TYPE_INT, 32, true, 0});
+        columns.push_back(uint_column("timestamp", 8, w));
+        columns.push_back(uint_column("measurement_id", 2, w));
+        columns.push_back(uint_column("status", 4, w));
+        columns.push_back(uint_column("rx_timestamp", 8, w));
+        for (auto f : fields) {
+            const auto t = prototype.field_type(f);
+            if (t == ChanFieldType::VOID)
+                throw std::invalid_argument(
+                    std::string{"Arrow column not in the scan layout: "} +
+                    sensor::to_string(f));
+            columns.push_back(
+                uint_column(sensor::to_string(f), field_type_size(t), w * h));
+        }
+        if (options.xyz)
+            columns.push_back(
+                {"xyz", TYPE_FLOATING_POINT, 32, false, 3 * w * h});
+
+        body_size = body_layout(columns, options.batch_frames, offsets);
+        body.resize(body_size);
+
+        file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            throw std::runtime_error("Failed to create Arrow file: " + path);
+
+        try {
+            put(FILE_MAGIC, sizeof(FILE_MAGIC));
+            auto schema_header = [&](flatbuf& fb) {
+                return write_schema(fb, columns, metadata);
+            };
+            const auto schema = write_message(HEADER_SCHEMA, schema_header, 0);
+            put(schema.data(), schema.size());
+        } catch (...) {
+            std::fclose(file);
+            file = nullptr;
+            throw;
+        }
+
+        thread = std::thread([this]() { run(); });
+    }
+
+    ~Impl() {
+        stop_writer();
+        if (file) std::fclose(file);
+    }
+
+    void put(const void* data, size_t size) {
+        if (size > 0 && std::fwrite(data, size, 1, file) != 1)
+            throw std::runtime_error("Failed to write Arrow file");
+        offset += size;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock{mtx};
+        while (true) {
+            cv.wait(lock, [this] { return pending || stop; });
+            if (!pending) return;
+            lock.unlock();
+            const bool ok =
+                std::fwrite(pending_meta.data(), pending_meta.size(), 1,
+                            file) == 1 &&
+                std::fwrite(pending_body.data(), pending_size, 1, file) == 1;
+            lock.lock();
+            failed = failed || !ok;
+            pending = false;
+            cv.notify_all();
+        }
+    }
+
+    void stop_writer() {
+        if (!thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock{mtx};
+            stop = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    void write(const LidarScan& scan) {
+        if (!file) throw std::runtime_error("Arrow file is closed");
+        if (static_cast<size_t>(scan.w) != w ||
+            static_cast<size_t>(scan.h) != h ||
+            !std::equal(scan.begin(), scan.end(), field_types.begin(),
+                        field_types.end()))
+            throw std::invalid_argument(
+                "Scan doesn't match the layout of the Arrow file");
+
+        const size_t k = batch_size;
+        auto dst = [&](size_t c) {
+            return body.data() + offsets[c] + k * columns[c].frame_bytes();
+        };
+        std::memcpy(dst(0), &scan.frame_id, sizeof(int32_t));
+        std::memcpy(dst(1), scan.timestamp().data(), w * sizeof(uint64_t));
+        std::memcpy(dst(2), scan.measurement_id().data(),
+                    w * sizeof(uint16_t));
+        std::memcpy(dst(3), scan.status().data(), w * sizeof(uint32_t));
+        std::memcpy(dst(4), scan.rx_timestamp().data(), w * sizeof(uint64_t));
+        for (size_t i = 0; i < fields.size(); i++) {
+            const void* data = nullptr;
+            impl::visit_field(scan, fields[i], field_data{}, data);
+            std::memcpy(dst(5 + i), data, columns[5 + i].frame_bytes());
+        }
+        if (options.xyz) {
+            const auto& l = scan.destaggered ? *lut_destaggered : *lut;
+            float* out = reinterpret_cast<float*>(dst(columns.size() - 1));
+            for_row_bands(h, options.n_threads, [&](size_t begin, size_t end) {
+                cartesian_into(scan, {ChanField::RANGE}, l,
+                               std::vector<float*>{out}, 3, begin, end);
+            });
+        }
+
+        batch_size++;
+        n_frames++;
+        if (batch_size >= options.batch_frames) flush();
+    }
+
+    void flush() {
+        if (batch_size == 0) return;
+        const size_t n = batch_size;
+
+        // move the columns of a short batch together
+        size_t size = body_size;
+        if (n < options.batch_frames) {
+            std::vector<size_t> packed;
+            size = body_layout(columns, n, packed);
+            for (size_t c = 0; c < columns.size(); c++) {
+                const size_t bytes = n * columns[c].frame_bytes();
+                std::memmove(body.data() + packed[c], body.data() + offsets[c],
+                             bytes);
+                std::memset(body.data() + packed[c] + bytes, 0,
+                            pad8(bytes) - bytes);
+            }
+        }
+
+        std::vector<field_node> nodes;
+        std::vector<buffer_span> buffers;
+        int64_t pos = 0;
+        for (const auto& c : columns) {
+            const int64_t bytes = static_cast<int64_t>(n * c.frame_bytes());
+            nodes.push_back({static_cast<int64_t>(n), 0});
+            buffers.push_back({pos, 0});
+            if (c.list_size > 0) {
+                nodes.push_back({static_cast<int64_t>(n * c.list_size), 0});
+                buffers.push_back({pos, 0});
+            }
+            buffers.push_back({pos, bytes});
+            pos += static_cast<int64_t>(pad8(bytes));
+        }
+
+        auto meta = write_message(
+            HEADER_RECORD_BATCH,
+            [&](flatbuf& fb) {
+                return fb.table(
+                    {scalar<int64_t>(0, static_cast<int64_t>(n)),
+                     ref(1, [&] { return fb.structs(nodes); }),
+                     ref(2, [&] { return fb.structs(buffers); })});
+            },
+            size);
+        blocks.push_back({static_cast<int64_t>(offset),
+                          static_cast<int32_t>(meta.size()), 0,
+                          static_cast<int64_t>(size)});
+        offset += meta.size() + size;
+
+        {
+            std::unique_lock<std::mutex> lock{mtx};
+            cv.wait(lock, [this] { return !pending; });
+            if (failed) throw std::runtime_error("Failed to write Arrow file");
+            std::swap(pending_meta, meta);
+            std::swap(pending_body, body);
+            pending_size = size;
+            pending = true;
+        }
+        cv.notify_all();
+
+        // reuse the buffer of the last batch written
+        if (body.size() != body_size) body.assign(body_size, 0);
+        batch_size = 0;
+    }
+
+    void close() {
+        if (!file) return;
+        try {
+            flush();
+            stop_writer();
+            if (failed) throw std::runtime_error("Failed to write Arrow file");
+
+            const uint32_t eos[2] = {CONTINUATION, 0};
+            put(eos, sizeof(eos));
+
+            flatbuf fb;
+            const std::vector<block> dictionaries;
+            const size_t root = fb.table(
+                {scalar<int16_t>(0, METADATA_V5),
+                 ref(1, [&] { return write_schema(fb, columns, metadata); }),
+                 ref(2, [&] { return fb.structs(dictionaries); }),
+                 ref(3, [&] { return fb.structs(blocks); })});
+            const auto footer = fb.finish(root);
+            const uint32_t footer_size = static_cast<uint32_t>(footer.size());
+            put(footer.data(), footer.size());
+            put(&footer_size, sizeof(footer_size));
+            put(FILE_MAGIC, 6);
+        } catch (...) {
+            stop_writer();
+            std::fclose(file);
+            file = nullptr;
+            throw;
+        }
+
+        const int res = std::fclose(file);
+        file = nullptr;
+        if (res != 0) throw std::runtime_error("Failed to write Arrow file");
+    }
+};
+
+ArrowFileWriter::ArrowFileWriter(const std::string& file,
+                                 const sensor::sensor_info& info,
+                                 const arrow_file_options& options)
+    : ArrowFileWriter(file, info,
+                      LidarScan(info.format.columns_per_frame,
+                                info.format.pixels_per_column,
+                                info.format.udp_profile_lidar),
+                      options) {}
+
+ArrowFileWriter::ArrowFileWriter(const std::string& file,
+                                 const sensor::sensor_info& info,
+                                 const LidarScan& prototype,
+                                 const arrow_file_options& options)
+    : impl_(new Impl(file, info, prototype, options)) {}
+
+ArrowFileWriter::~ArrowFileWriter() {
+    try {
+        impl_->close();
+    } catch (...) {
+    }
+}
+
+void ArrowFileWriter::write(const LidarScan& scan) { impl_->write(scan); }
+
+void ArrowFileWriter::close() { impl_->close(); }
+
+size_t ArrowFileWriter::frame_count() const { return impl_->n_frames; }
+
+}  // namespace sensor_utils
+}  // namespace ouster
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
 #include <cstdint>
 #include <memory>
@@ -37,21 +38,41 @@ class BufferedUDPSource {
     uint32_t lidar_port_;
     uint32_t imu_port_;
 
-    // protect read/write_ind_ and stop_
+    // only the consumer writes read_ind_ and only the producer writes
+    // write_ind_, so neither side needs a lock on the fast path
+    std::atomic<size_t> read_ind_{0}, write_ind_{0};
+
+    // only used to block when the buffer is full or empty; the waiting flags
+    // let the other side skip notifying when nobody is blocked
     std::mutex cv_mtx_;
     std::condition_variable cv_;
-    size_t read_ind_{0}, write_ind_{0};
+    std::atomic<bool> consumer_waiting_{false}, producer_waiting_{false};
 
     // flag for other threads to signal producer to shut down
-    bool stop_{false};
+    std::atomic<bool> stop_{false};
 
     // internal packet buffer
     size_t capacity_{0};
     using entry = std::pair<client_state, std::unique_ptr<uint8_t[]>>;
     std::vector<entry> bufs_;
+    std::vector<uint64_t> rx_ts_;
+
+    // receive timestamp of the last consumed packet
+    uint64_t last_rx_ts_{0};
+
+    // signaled for consumers polling from an event loop, see notify_fd().
+    // The write end is the same fd for an eventfd, or the other end of a pipe
+    int notify_fd_{-1}, notify_write_fd_{-1};
+    std::atomic<bool> notify_enabled_{false};
 
     explicit BufferedUDPSource(size_t buf_size);
 
+    // wake up the other side, if it is blocked on cv_
+    void notify_if_waiting(const std::atomic<bool>& waiting);
+
+    // signal notify_fd_ if enabled
+    void notify_fd_signal();
+
    public:
     /* Extra bit flag compatible with client_state to signal buffer overflow. */
     static constexpr int CLIENT_OVERFLOW = 0x10;
@@ -79,6 +100,9 @@ class BufferedUDPSource {
                                      int lidar_port, int imu_port,
                                      int timeout_sec, size_t buf_size);
 
+    /** Close the notification fd, if any. */
+    ~BufferedUDPSource();
+
     /**
      * Fetch metadata from the sensor.
      *
@@ -88,6 +112,17 @@ class BufferedUDPSource {
      */
     std::string get_metadata(int timeout_sec = 60, bool legacy_format = true);
 
+    /**
+     * Receive lidar data through a memory-mapped packet ring. Must be called
+     * before produce(). See sensor::use_packet_ring().
+     *
+     * @param[in] interface network interface to capture on, or "" for all.
+     * @param[in] ring_size total size of the ring in bytes.
+     * @return true if the ring was set up.
+     */
+    bool use_packet_ring(const std::string& interface = "",
+                         size_t ring_size = 16 << 20);
+
     /**
      * Signal the producer to exit.
      *
@@ -136,6 +171,88 @@ class BufferedUDPSource {
      */
     client_state consume(uint8_t* buf, size_t buf_sz, float timeout_sec);
 
+    /**
+     * Read the packets available in the buffer at once, up to max_packets.
+     *
+     * Blocks like consume() until at least one packet is available, then
+     * copies the packets already buffered to consecutive rows of stride
+     * bytes, without waiting for more. Reading stops after a packet with a
+     * state other than LIDAR_DATA or IMU_DATA, e.g. CLIENT_ERROR. Should
+     * only be called by the consumer thread.
+     *
+     * @param[out] buf max_packets rows of stride bytes, packets longer than
+     * stride are truncated.
+     * @param[in] stride the size of the rows of buf.
+     * @param[in] max_packets the most packets to read.
+     * @param[in] timeout_sec maximum time to wait for the first packet.
+     * @param[out] n the number of packets read.
+     * @param[out] states the client status of each packet read, with space
+     * for max_packets.
+     * @param[out] rx_ts the receive timestamp of each packet read, or zero
+     * for imu packets, with space for max_packets.
+     * @return the status of the last packet read, or TIMEOUT or EXIT if none
+     * were.
+     */
+    client_state consume_batch(uint8_t* buf, size_t stride,
+                               size_t max_packets, float timeout_sec,
+                               size_t& n, client_state* states,
+                               uint64_t* rx_ts);
+
+    /**
+     * Get a file descriptor that becomes readable when packets arrive, for
+     * integration with event loops.
+     *
+     * The descriptor is signaled when the producer adds packets to a buffer
+     * the consumer has caught up with, and on shutdown(). Consumers should
+     * clear_notify() and then read all buffered packets, e.g. with
+     * consume_batch() and a zero timeout, before waiting on it again. Stays
+     * open until the client is destroyed.
+     *
+     * @throw std::runtime_error if the descriptor can't be created, or on
+     * Windows, where this isn't supported.
+     *
+     * @return the descriptor, an eventfd on Linux or a pipe elsewhere.
+     */
+    int notify_fd();
+
+    /** Reset the descriptor returned by notify_fd() to not readable. */
+    void clear_notify();
+
+    /**
+     * Get the receive timestamp of the last packet read by consume() or
+     * consume_batch().
+     *
+     * Should only be called by the consumer thread.
+     *
+     * @return nanoseconds since the unix epoch, or zero for imu packets.
+     */
+    uint64_t last_rx_timestamp();
+
+    /**
+     * Borrow the next available packet in the buffer without copying.
+     *
+     * Blocks like consume() if the queue is empty. On success, `buf` points
+     * into the internal buffer and stays valid until the consumer calls
+     * advance() or flush(). Every successful peek() must be followed by
+     * advance() before the next peek() returns new data. Should only be called
+     * by the consumer thread.
+     *
+     * @param[out] buf set to the packet data, or nullptr on timeout or exit.
+     * @param[in] timeout_sec maximum time to wait for data.
+     * @param[out] rx_ts if not null, set to the receive timestamp of the
+     * packet. See last_rx_timestamp().
+     * @return client status, see sensor::poll_client().
+     */
+    client_state peek(const uint8_t*& buf, float timeout_sec,
+                      uint64_t* rx_ts = nullptr);
+
+    /**
+     * Release the packet returned by the last successful peek().
+     *
+     * Should only be called by the consumer thread.
+     */
+    void advance();
+
     /**
      * Write data from the network into the circular buffer.
      *
@@ -9,8 +9,10 @@
 #pragma once
 
 #include <cstdint>
+#include <future>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "ouster/types.h"
 #include "ouster/version.h"
@@ -59,6 +61,9 @@ std::shared_ptr<client> init_client(const std::string& hostname = "",
  * @param[in] lidar_port port on which the sensor will send lidar data.
  * @param[in] imu_port port on which the sensor will send imu data.
  * @param[in] timeout_sec how long to wait for the sensor to initialize.
+ * @param[in] metadata_cache directory caching metadata, see MetadataCache, or
+ * "" to always fetch it from the sensor. Metadata is only fetched the first
+ * time a sensor runs with a given firmware and config.
  *
  * @return pointer owning the resources associated with the connection.
  */
@@ -67,7 +72,54 @@ std::shared_ptr<client> init_client(const std::string& hostname,
                                     lidar_mode mode = MODE_UNSPEC,
                                     timestamp_mode ts_mode = TIME_FROM_UNSPEC,
                                     int lidar_port = 0, int imu_port = 0,
-                                    int timeout_sec = 60);
+                                    int timeout_sec = 60,
+                                    const std::string& metadata_cache = "");
+
+/**
+ * Connect to and configure the sensor on a thread of its own, see
+ * init_client().
+ *
+ * Bringing up several sensors concurrently takes about as long as bringing up
+ * the slowest one, instead of the sum of their initialization times.
+ *
+ * @param[in] hostname hostname or ip of the sensor.
+ * @param[in] udp_dest_host hostname or ip where the sensor should send data
+ * or "" for automatic detection of destination.
+ * @param[in] mode The lidar mode to use.
+ * @param[in] ts_mode The timestamp mode to use.
+ * @param[in] lidar_port port on which the sensor will send lidar data.
+ * @param[in] imu_port port on which the sensor will send imu data.
+ * @param[in] timeout_sec how long to wait for the sensor to initialize.
+ * @param[in] metadata_cache directory caching metadata, or "".
+ *
+ * @return a future of the client, null if initialization failed.
+ */
+std::future<std::shared_ptr<client>> init_client_async(
+    const std::string& hostname, const std::string& udp_dest_host,
+    lidar_mode mode = MODE_UNSPEC, timestamp_mode ts_mode = TIME_FROM_UNSPEC,
+    int lidar_port = 0, int imu_port = 0, int timeout_sec = 60,
+    const std::string& metadata_cache = "");
+
+/**
+ * Connect to and configure several sensors concurrently, each sending data
+ * to ports picked by the OS, see get_lidar_port() and get_imu_port().
+ *
+ * @param[in] hostnames hostnames or ips of the sensors.
+ * @param[in] udp_dest_host hostname or ip where the sensors should send data
+ * or "" for automatic detection of destination.
+ * @param[in] mode The lidar mode to use.
+ * @param[in] ts_mode The timestamp mode to use.
+ * @param[in] timeout_sec how long to wait for each sensor to initialize.
+ * @param[in] metadata_cache directory caching metadata, or "".
+ *
+ * @return the clients in the order of hostnames, null for sensors which
+ * failed to initialize.
+ */
+std::vector<std::shared_ptr<client>> init_clients(
+    const std::vector<std::string>& hostnames,
+    const std::string& udp_dest_host = "", lidar_mode mode = MODE_UNSPEC,
+    timestamp_mode ts_mode = TIME_FROM_UNSPEC, int timeout_sec = 60,
+    const std::string& metadata_cache = "");
 /** @}*/
 
 /**
@@ -98,6 +150,99 @@ client_state poll_client(const client& cli, int timeout_sec = 1);
 bool read_lidar_packet(const client& cli, uint8_t* buf,
                        const packet_format& pf);
 
+/**
+ * Read lidar data from the sensor along with the time it was received. Will
+ * not block.
+ *
+ * The receive timestamp is taken by the kernel when the packet arrives where
+ * supported (SO_TIMESTAMPNS on Linux), and read from the system clock after
+ * the packet is read otherwise.
+ *
+ * @param[in] cli client returned by init_client associated with the connection.
+ * @param[out] buf buffer to which to write lidar data. Must be at least
+ * lidar_packet_bytes + 1 bytes.
+ * @param[out] rx_ts receive timestamp in nanoseconds since the unix epoch.
+ * @param[in] pf The packet format.
+ *
+ * @return true if a lidar packet was successfully read.
+ */
+bool read_lidar_packet(const client& cli, uint8_t* buf, uint64_t& rx_ts,
+                       const packet_format& pf);
+
+/**
+ * Read all queued lidar packets from the sensor, up to max_n. Will not block.
+ *
+ * On Linux this drains the socket with recvmmsg(), so a single call costs one
+ * syscall per batch instead of one per packet. Elsewhere it falls back to a
+ * loop over single reads. Packets with an unexpected size are dropped and the
+ * remaining packets are compacted to the front of bufs.
+ *
+ * @param[in] cli client returned by init_client associated with the connection.
+ * @param[out] bufs array of max_n buffers to which to write lidar data. Each
+ * must be at least lidar_packet_bytes + 1 bytes.
+ * @param[in] max_n maximum number of packets to read.
+ * @param[in] pf The packet format.
+ * @param[out] rx_ts optional array of max_n receive timestamps, filled in
+ * alongside bufs. See read_lidar_packet().
+ *
+ * @return the number of valid packets written to the front of bufs, or
+ * -1 if reading from the socket failed.
+ */
+int read_lidar_packets(const client& cli, uint8_t* const* bufs, int max_n,
+                       const packet_format& pf, uint64_t* rx_ts = nullptr);
+
+/**
+ * Receive lidar data through a memory-mapped AF_PACKET ring instead of the
+ * UDP socket, avoiding a syscall per packet when draining many packets.
+ *
+ * Only supported on Linux and requires CAP_NET_RAW. The lidar port stays
+ * bound, but datagrams are no longer queued on the UDP socket. IPv4 fragments
+ * are reassembled in user space. On failure, the client keeps using the UDP
+ * socket.
+ *
+ * @param[in] cli client returned by init_client associated with the connection.
+ * @param[in] interface network interface to capture on, or "" for all.
+ * @param[in] ring_size total size of the ring in bytes.
+ *
+ * @return true if the ring was set up.
+ */
+bool use_packet_ring(client& cli, const std::string& interface = "",
+                     size_t ring_size = 16 << 20);
+
+/**
+ * Join a multicast group on the lidar and imu sockets of a client, to receive
+ * data from a sensor configured with a multicast udp_dest.
+ *
+ * Any number of clients, in this or other processes, can listen on the same
+ * ports and group, and each receives every packet without a process
+ * republishing them. The configuring init_client() joins the group itself
+ * when udp_dest_host is a multicast address; other listeners create their
+ * client with the init_client() that doesn't configure the sensor and join
+ * explicitly.
+ *
+ * @param[in] cli client returned by init_client associated with the connection.
+ * @param[in] group IPv4 or IPv6 multicast address.
+ * @param[in] interface name of the network interface to join on, or "" to let
+ * the system pick one from the routing table. Names aren't supported on
+ * Windows.
+ *
+ * @return true if both sockets joined the group.
+ */
+bool join_multicast(client& cli, const std::string& group,
+                    const std::string& interface = "");
+
+/**
+ * Get the number of lidar packets dropped by the kernel before they could be
+ * read, because the socket buffer or packet ring was full. Only supported on
+ * Linux; poll it periodically to tell whether packets are read fast enough.
+ *
+ * @param[in] cli client returned by init_client associated with the connection.
+ *
+ * @return the drops since the lidar socket or ring was opened, or -1 if
+ * unsupported.
+ */
+int64_t get_lidar_drops(const client& cli);
+
 /**
  * Read imu data from the sensor. Will not block.
  *
@@ -0,0 +1,176 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Filters over the structured images of LidarScan fields
+ *
+ * Neighbouring pixels of a scan are neighbouring points of the scene, so
+ * speckle, edge and threshold filters can run on range images instead of
+ * unorganized point clouds. Filters take the pixel shifts of the sensor to
+ * find the neighbours of staggered images; pass no shifts for images that
+ * are already destaggered. Columns wrap around, as in a full revolution, and
+ * rows at the top and bottom are repeated.
+ *
+ * Masks are images of bits. Each filter sets the given bit of the pixels it
+ * selects and leaves other bits alone, so several filters can share a mask.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace filters {
+
+/**
+ * Apply a median filter to an image.
+ *
+ * @throw std::invalid_argument if size isn't 3 or 5, the images have
+ * different dimensions or there are pixel shifts for a different number of
+ * rows.
+ *
+ * @tparam T the datatype of the image.
+ *
+ * @param[in] img the image to filter.
+ * @param[out] dest the filtered image, which must not overlap img.
+ * @param[in] size the width and height of the window.
+ * @param[in] pixel_shift_by_row offsets of a staggered image, or empty.
+ * @param[in] n_threads the number of threads to split rows between,
+ * including the calling thread.
+ */
+template <typename T>
+void median(const Eigen::Ref<const img_t<T>>& img, Eigen::Ref<img_t<T>> dest,
+            int size, const std::vector<int>& pixel_shift_by_row = {},
+            int n_threads = 1);
+
+/**
+ * Apply a median filter to a field of a scan in place.
+ *
+ * @throw std::invalid_argument as above.
+ * @throw std::out_of_range if the scan doesn't have the field.
+ *
+ * @param[in,out] scan the scan to filter.
+ * @param[in] f the field to filter.
+ * @param[in] size the width and height of the window.
+ * @param[in] pixel_shift_by_row offsets of the sensor, ignored if the scan
+ * is destaggered.
+ * @param[in] n_threads the number of threads to split rows between.
+ */
+void median(LidarScan& scan, sensor::ChanField f, int size,
+            const std::vector<int>& pixel_shift_by_row, int n_threads = 1);
+
+/**
+ * Mark pixels that are zero or NaN.
+ *
+ * @throw std::invalid_argument if the mask has different dimensions.
+ *
+ * @tparam T the datatype of the image.
+ *
+ * @param[in] img the image to check.
+ * @param[in,out] mask the mask to set bits in.
+ * @param[in] bit the bits to set.
+ */
+template <typename T>
+void invalid_mask(const Eigen::Ref<const img_t<T>>& img,
+                  Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit = 1);
+
+/**
+ * Mark pixels of a field of a scan that are zero or NaN.
+ *
+ * @throw std::invalid_argument if the mask has different dimensions.
+ * @throw std::out_of_range if the scan doesn't have the field.
+ *
+ * @param[in] scan the scan to check.
+ * @param[in] f the field to check.
+ * @param[in,out] mask the mask to set bits in.
+ * @param[in] bit the bits to set.
+ */
+void invalid_mask(const LidarScan& scan, sensor::ChanField f,
+                  Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit = 1);
+
+/**
+ * Mark pixels outside of a range of values, e.g. returns closer than a
+ * minimum range or with an intensity below a threshold.
+ *
+ * @throw std::invalid_argument if the mask has different dimensions.
+ *
+ * @tparam T the datatype of the image.
+ *
+ * @param[in] img the image to check.
+ * @param[in] lo the lowest value kept.
+ * @param[in] hi the highest value kept.
+ * @param[in,out] mask the mask to set bits in.
+ * @param[in] bit the bits to set.
+ */
+template <typename T>
+void threshold_mask(const Eigen::Ref<const img_t<T>>& img, T lo, T hi,
+                    Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit = 1);
+
+/**
+ * Mark pixels of a field of a scan outside of a range of values.
+ *
+ * @throw std::invalid_argument if the mask has different dimensions.
+ * @throw std::out_of_range if the scan doesn't have the field.
+ *
+ * @param[in] scan the scan to check.
+ * @param[in] f the field to check.
+ * @param[in] lo the lowest value kept.
+ * @param[in] hi the highest value kept.
+ * @param[in,out] mask the mask to set bits in.
+ * @param[in] bit the bits to set.
+ */
+void threshold_mask(const LidarScan& scan, sensor::ChanField f, double lo,
+                    double hi, Eigen::Ref<img_t<uint8_t>> mask,
+                    uint8_t bit = 1);
+
+/**
+ * Mark jump edges, the mixed pixels veiling the background behind the
+ * silhouettes of objects.
+ *
+ * A pixel is marked when the line to one of its four neighbours is within
+ * min_angle_deg of its line of sight and the neighbour is closer. Pixels
+ * without a return are never marked.
+ *
+ * @throw std::invalid_argument if the images and lookup tables have
+ * different dimensions or there are pixel shifts for a different number of
+ * rows.
+ *
+ * @param[in] range the range image.
+ * @param[in] lut lookup tables generated by make_xyz_lut for the layout of
+ * the range image.
+ * @param[in] min_angle_deg the smallest angle, in degrees, between the line
+ * of sight and the surface at a pixel.
+ * @param[in,out] mask the mask to set bits in.
+ * @param[in] bit the bits to set.
+ * @param[in] pixel_shift_by_row offsets of a staggered image, or empty.
+ * @param[in] n_threads the number of threads to split rows between,
+ * including the calling thread.
+ */
+void edge_mask(const Eigen::Ref<const img_t<uint32_t>>& range,
+               const XYZLut& lut, double min_angle_deg,
+               Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit = 1,
+               const std::vector<int>& pixel_shift_by_row = {},
+               int n_threads = 1);
+
+/**
+ * Zero the pixels of fields of a scan selected by a mask.
+ *
+ * @throw std::invalid_argument if the mask has different dimensions.
+ * @throw std::out_of_range if the scan doesn't have one of the fields.
+ *
+ * @param[in,out] scan the scan to modify.
+ * @param[in] fields the fields to zero pixels of.
+ * @param[in] mask the mask.
+ * @param[in] bits the bits of the mask selecting pixels.
+ */
+void apply_mask(LidarScan& scan, const std::vector<sensor::ChanField>& fields,
+                const Eigen::Ref<const img_t<uint8_t>>& mask,
+                uint8_t bits = 0xff);
+
+}  // namespace filters
+}  // namespace ouster
@@ -0,0 +1,213 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Fuse the scans of several sensors into one point cloud per time
+ * window
+ *
+ * A ScanFuser projects the scans of each sensor straight into a common frame,
+ * with the lidar to sensor transform and the extrinsics of the sensor folded
+ * into its lookup table. Columns are assigned to windows of fixed duration by
+ * their timestamps, so the sensors must share a time base, e.g. by PTP, and
+ * the points of all sensors measured in a window are written to a single
+ * preallocated buffer.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace fusion {
+
+/** A point of a fused cloud, laid out without padding. */
+struct FusedPoint {
+    float x;                ///< x in the common frame, in meters
+    float y;                ///< y in the common frame, in meters
+    float z;                ///< z in the common frame, in meters
+    uint32_t t;             ///< time from the start of the window, in ns
+    uint32_t range;         ///< range, in mm
+    uint16_t signal;        ///< signal, saturated, or zero if not measured
+    uint16_t reflectivity;  ///< reflectivity, or zero if not measured
+    uint16_t ring;          ///< beam of the point
+    uint16_t sensor;        ///< index of the sensor in the fuser
+};
+
+/** A sensor to fuse. */
+struct FusedSensor {
+    sensor::sensor_info info;  ///< sensor metadata
+
+    /**
+     * Transform from the sensor frame to the common frame, with the
+     * translation in meters.
+     */
+    mat4d extrinsic{mat4d::Identity()};
+};
+
+/** Options of a ScanFuser. */
+struct FuserConfig {
+    /** Duration of windows, in ns. */
+    uint64_t window_ns{100000000};
+
+    /** Windows start at multiples of window_ns plus the offset, in ns. */
+    uint64_t window_offset_ns{0};
+
+    /**
+     * How far, in ns, a sensor may lag behind the most recent data of any
+     * sensor before windows are completed without waiting for it. Sensors
+     * that haven't added any data lag behind from the first data of any
+     * sensor. Data of windows that were completed is dropped.
+     */
+    uint64_t max_delay_ns{100000000};
+
+    /**
+     * Number of windows filled in at once. When data for a later window
+     * arrives, the earliest windows are completed early to make room.
+     */
+    size_t max_windows{4};
+};
+
+/** The points of all sensors measured in a window. */
+struct FusedCloud {
+    uint64_t ts{0};  ///< start of the window, in ns
+    size_t size{0};  ///< number of points
+
+    /** The points, of which the first size are filled in. */
+    std::vector<FusedPoint> points{};
+
+    /** Number of columns each sensor contributed to the window. */
+    std::vector<uint32_t> columns{};
+};
+
+/** Counters of a ScanFuser. */
+struct FuserStats {
+    uint64_t scans{0};           ///< scans added
+    uint64_t clouds{0};          ///< clouds handed to the handler
+    uint64_t late_columns{0};    ///< columns of completed windows, dropped
+    uint64_t dropped_points{0};  ///< points beyond the capacity of a cloud
+};
+
+/**
+ * Fuses the scans of several sensors into clouds of their points in fixed
+ * time windows.
+ *
+ * Each point of a scan is projected once, into the cloud of the window its
+ * column was measured in, skipping pixels without a return and columns not
+ * marked valid. A window is complete once every sensor has added data past
+ * its end, or has fallen behind by more than the maximum delay; complete
+ * windows with any points are handed to the handler in order. Only the first
+ * return is fused.
+ *
+ * Not thread safe: scans of all sensors should be added from one thread, or
+ * under a lock.
+ */
+class ScanFuser {
+   public:
+    /**
+     * Called with each complete cloud. The cloud is reused for later windows
+     * once the handler returns.
+     */
+    using Handler = std::function<void(const FusedCloud& cloud)>;
+
+    /**
+     * Allocate the clouds of the windows and the lookup tables of the
+     * sensors.
+     *
+     * Clouds hold enough points for every pixel of each sensor measured in a
+     * window, going by the rotation rate of its lidar mode.
+     *
+     * @throw std::invalid_argument if there are no sensors, more than there
+     * are sensor indices, the window duration is zero or there are no
+     * windows.
+     *
+     * @param[in] sensors the sensors to fuse, indexed in order.
+     * @param[in] config the windows to fuse scans in.
+     * @param[in] handler callback for complete clouds.
+     */
+    ScanFuser(const std::vector<FusedSensor>& sensors,
+              const FuserConfig& config, Handler handler);
+
+    /**
+     * Project a scan into the clouds of the windows it was measured in,
+     * handing windows that are complete afterwards to the handler.
+     *
+     * Scans of a sensor are expected in the order of their timestamps.
+     *
+     * @throw std::out_of_range if there is no such sensor or the scan has no
+     * range field.
+     * @throw std::invalid_argument if the scan doesn't match the dimensions
+     * of the sensor, is destaggered or its range field isn't of type
+     * uint32_t.
+     *
+     * @param[in] sensor index of the sensor.
+     * @param[in] scan a staggered scan of the sensor.
+     */
+    void add(size_t sensor, const LidarScan& scan);
+
+    /**
+     * Hand all open windows with any points to the handler, e.g. at the end
+     * of a recording.
+     */
+    void flush();
+
+    /**
+     * Get the number of points clouds can hold.
+     *
+     * @return the capacity of clouds.
+     */
+    size_t capacity() const;
+
+    /**
+     * Get the counters of the fuser.
+     *
+     * @return a snapshot of the counters.
+     */
+    FuserStats stats() const;
+
+   private:
+    struct Sensor {
+        size_t w, h;
+        XYZLutf lut;
+        uint64_t watermark;  // latest column timestamp added
+    };
+
+    // consecutive columns of a scan measured in the same window
+    struct Run {
+        size_t begin, end;
+        FusedCloud* cloud;
+    };
+
+    FusedCloud& cloud(int64_t window);
+    void open(int64_t first, int64_t last);
+    void emit();
+    void complete(bool flush);
+
+    FuserConfig config_;
+    Handler handler_;
+    std::vector<Sensor> sensors_;
+    size_t capacity_{0};
+    FuserStats stats_{};
+
+    // windows [begin_, end_) are open, window k in clouds_[k % size]
+    std::vector<FusedCloud> clouds_;
+    int64_t begin_{0};
+    int64_t end_{0};
+    bool started_{false};
+    uint64_t first_ts_{0};  // of the first column added
+
+    // working memory, reused between scans
+    std::vector<int64_t> col_window_;
+    std::vector<uint32_t> col_t_;
+    std::vector<Run> runs_;
+    std::vector<uint16_t> signal_, reflectivity_;
+};
+
+}  // namespace fusion
+}  // namespace ouster
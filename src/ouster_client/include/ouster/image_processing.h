@@ -9,6 +9,8 @@
 #pragma once
 
 #include <Eigen/Core>
+#include <cstdint>
+#include <vector>
 
 #include "ouster/types.h"
 
@@ -28,6 +30,13 @@ class AutoExposure {
     bool initialized = false;
     int counter = 0;
 
+    std::vector<uint32_t> keys;  // sampled nonzero pixels, reused every update
+    std::vector<uint32_t> hist;
+
+    template <typename T>
+    bool update_scaling(const T* data, size_t n, bool update_state,
+                        double& scale, double& offset);
+
     template <typename T>
     void update(Eigen::Ref<img_t<T>> image, bool update_state);
 
@@ -72,6 +81,21 @@ class AutoExposure {
      * @param[in] update_state Update lo/hi percentiles if true.
      */
     void operator()(Eigen::Ref<img_t<double>> image, bool update_state = true);
+
+    /**
+     * Update the state from an image like operator(), but return the scaling
+     * instead of applying it, e.g. to scale the image when drawing it.
+     *
+     * @param[in] image the image, left unmodified.
+     * @param[out] scale factor of the scaling.
+     * @param[out] offset offset of the scaling: values x of the image scale to
+     * x * scale + offset, clamped between 0 and 1.
+     * @param[in] update_state Update lo/hi percentiles if true.
+     * @return false, leaving scale and offset unmodified, if no image had
+     * enough nonzero values to scale yet.
+     */
+    bool scaling(const Eigen::Ref<const img_t<uint32_t>>& image, double& scale,
+                 double& offset, bool update_state = true);
 };
 
 /**
@@ -81,13 +105,47 @@ class AutoExposure {
  */
 class BeamUniformityCorrector {
    private:
+    const int update_every;
+    const int column_stride;
+    const int n_threads;
+
     int counter = 0;
+    int phase = 0;
     Eigen::ArrayXd dark_count;
 
+    // scratch buffers reused by every update
+    std::vector<uint8_t> col_mask;
+    std::vector<size_t> cols;
+    std::vector<double> diffs;
+    Eigen::ArrayXd row_medians;
+
     template <typename T>
     void update(Eigen::Ref<img_t<T>> image, bool update_state);
 
+    template <typename T>
+    Eigen::ArrayXd compute_dark_count(const Eigen::Ref<img_t<T>>& image);
+
    public:
+    /** Default constructor, updating every few frames from all columns. */
+    BeamUniformityCorrector();
+
+    /**
+     * Constructor for updating incrementally from a subset of columns.
+     *
+     * Each update estimates dark counts from every column_stride-th column,
+     * starting from a different column every time, so that all columns
+     * contribute over column_stride updates.
+     *
+     * @throw std::invalid_argument if any parameter is less than one.
+     *
+     * @param[in] update_every update every this number of frames.
+     * @param[in] column_stride use every this number of columns per update.
+     * @param[in] n_threads the number of threads to split rows between,
+     * including the calling thread.
+     */
+    BeamUniformityCorrector(int update_every, int column_stride,
+                            int n_threads = 1);
+
     /**
      * Applies dark count correction to an image, modifying it in-place to have
      * reduced horizontal line artifacts.
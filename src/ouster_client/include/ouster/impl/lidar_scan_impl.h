@@ -8,6 +8,7 @@
 #include <Eigen/Core>
 #include <cstdint>
 #include <stdexcept>
+#include <type_traits>
 
 #include "ouster/lidar_scan.h"
 #include "ouster/types.h"
@@ -40,198 +41,6 @@ struct FieldTag<uint64_t> {
     static constexpr ChanFieldType tag = ChanFieldType::UINT64;
 };
 
-/*
- * Tagged union for LidarScan fields
- */
-struct FieldSlot {
-    ChanFieldType tag;
-    union {
-        img_t<uint8_t> f8;
-        img_t<uint16_t> f16;
-        img_t<uint32_t> f32;
-        img_t<uint64_t> f64;
-    };
-
-    FieldSlot(ChanFieldType t, size_t w, size_t h) : tag{t} {
-        switch (t) {
-            case ChanFieldType::VOID:
-                break;
-            case ChanFieldType::UINT8:
-                new (&f8) img_t<uint8_t>{h, w};
-                f8.setZero();
-                break;
-            case ChanFieldType::UINT16:
-                new (&f16) img_t<uint16_t>{h, w};
-                f16.setZero();
-                break;
-            case ChanFieldType::UINT32:
-                new (&f32) img_t<uint32_t>{h, w};
-                f32.setZero();
-                break;
-            case ChanFieldType::UINT64:
-                new (&f64) img_t<uint64_t>{h, w};
-                f64.setZero();
-                break;
-        }
-    }
-
-    FieldSlot() : FieldSlot{ChanFieldType::VOID, 0, 0} {};
-
-    ~FieldSlot() { clear(); }
-
-    FieldSlot(const FieldSlot& other) {
-        switch (other.tag) {
-            case ChanFieldType::VOID:
-                break;
-            case ChanFieldType::UINT8:
-                new (&f8) img_t<uint8_t>{other.f8};
-                break;
-            case ChanFieldType::UINT16:
-                new (&f16) img_t<uint16_t>{other.f16};
-                break;
-            case ChanFieldType::UINT32:
-                new (&f32) img_t<uint32_t>{other.f32};
-                break;
-            case ChanFieldType::UINT64:
-                new (&f64) img_t<uint64_t>{other.f64};
-                break;
-        }
-        tag = other.tag;
-    }
-
-    FieldSlot(FieldSlot&& other) { set_from(other); }
-
-    FieldSlot& operator=(FieldSlot other) {
-        clear();
-        set_from(other);
-        return *this;
-    }
-
-    template <typename T>
-    Eigen::Ref<img_t<T>> get() {
-        if (tag == FieldTag<T>::tag)
-            return get_unsafe<T>();
-        else
-            throw std::invalid_argument("Accessed field at wrong type");
-    }
-
-    template <typename T>
-    Eigen::Ref<const img_t<T>> get() const {
-        if (tag == FieldTag<T>::tag)
-            return get_unsafe<T>();
-        else
-            throw std::invalid_argument("Accessed field at wrong type");
-    }
-
-    friend bool operator==(const FieldSlot& l, const FieldSlot& r) {
-        if (l.tag != r.tag) return false;
-        switch (l.tag) {
-            case ChanFieldType::VOID:
-                return true;
-            case ChanFieldType::UINT8:
-                return (l.f8 == r.f8).all();
-            case ChanFieldType::UINT16:
-                return (l.f16 == r.f16).all();
-            case ChanFieldType::UINT32:
-                return (l.f32 == r.f32).all();
-            case ChanFieldType::UINT64:
-                return (l.f64 == r.f64).all();
-            default:
-                assert(false);
-        }
-        // unreachable, appease older gcc
-        return false;
-    }
-
-   private:
-    void set_from(FieldSlot& other) {
-        switch (other.tag) {
-            case ChanFieldType::VOID:
-                break;
-            case ChanFieldType::UINT8:
-                new (&f8) img_t<uint8_t>{std::move(other.f8)};
-                break;
-            case ChanFieldType::UINT16:
-                new (&f16) img_t<uint16_t>{std::move(other.f16)};
-                break;
-            case ChanFieldType::UINT32:
-                new (&f32) img_t<uint32_t>{std::move(other.f32)};
-                break;
-            case ChanFieldType::UINT64:
-                new (&f64) img_t<uint64_t>{std::move(other.f64)};
-                break;
-        }
-        tag = other.tag;
-        other.clear();
-    }
-
-    void clear() {
-        switch (tag) {
-            case ChanFieldType::VOID:
-                break;
-            case ChanFieldType::UINT8:
-                f8.~img_t<uint8_t>();
-                break;
-            case ChanFieldType::UINT16:
-                f16.~img_t<uint16_t>();
-                break;
-            case ChanFieldType::UINT32:
-                f32.~img_t<uint32_t>();
-                break;
-            case ChanFieldType::UINT64:
-                f64.~img_t<uint64_t>();
-                break;
-        }
-        tag = ChanFieldType::VOID;
-    }
-
-    template <typename T>
-    Eigen::Ref<img_t<T>> get_unsafe();
-
-    template <typename T>
-    Eigen::Ref<const img_t<T>> get_unsafe() const;
-};
-
-template <>
-inline Eigen::Ref<img_t<uint8_t>> FieldSlot::get_unsafe() {
-    return f8;
-}
-
-template <>
-inline Eigen::Ref<img_t<uint16_t>> FieldSlot::get_unsafe() {
-    return f16;
-}
-
-template <>
-inline Eigen::Ref<img_t<uint32_t>> FieldSlot::get_unsafe() {
-    return f32;
-}
-
-template <>
-inline Eigen::Ref<img_t<uint64_t>> FieldSlot::get_unsafe() {
-    return f64;
-}
-
-template <>
-inline Eigen::Ref<const img_t<uint8_t>> FieldSlot::get_unsafe() const {
-    return f8;
-}
-
-template <>
-inline Eigen::Ref<const img_t<uint16_t>> FieldSlot::get_unsafe() const {
-    return f16;
-}
-
-template <>
-inline Eigen::Ref<const img_t<uint32_t>> FieldSlot::get_unsafe() const {
-    return f32;
-}
-
-template <>
-inline Eigen::Ref<const img_t<uint64_t>> FieldSlot::get_unsafe() const {
-    return f64;
-}
-
 /*
  * Call a generic operation op<T>(f, Args..) with the type parameter T having
  * the correct (dynamic) field type for the LidarScan channel field f
@@ -306,4 +115,19 @@ inline img_t<T> destagger(const Eigen::Ref<const img_t<T>>& img,
     return destaggered;
 }
 
+template <typename T>
+void Destaggerer::operator()(
+    const Eigen::Ref<const img_t<typename std::common_type<T>::type>>& img,
+    Eigen::Ref<img_t<T>> dest) const {
+    if (static_cast<size_t>(img.rows()) != h() ||
+        static_cast<size_t>(img.cols()) != w() || dest.rows() != img.rows() ||
+        dest.cols() != img.cols())
+        throw std::invalid_argument{"unexpected image dimensions"};
+
+    copy_rows(reinterpret_cast<const uint8_t*>(img.data()),
+              img.outerStride() * sizeof(T),
+              reinterpret_cast<uint8_t*>(dest.data()),
+              dest.outerStride() * sizeof(T), sizeof(T), 0, h());
+}
+
 }  // namespace ouster
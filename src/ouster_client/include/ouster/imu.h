@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Batch IMU packets into per-scan time series and preintegrate them
+ *
+ * An ImuBatcher holds the samples of IMU packets as they arrive and hands
+ * out the samples covering each LidarScan as one contiguous series, so that
+ * consumers such as deskewing or odometry handle a compact buffer per frame
+ * rather than a message per sample.
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+
+/**
+ * IMU samples stored as a structure of arrays, one row per sample, sorted by
+ * gyro timestamp.
+ */
+struct ImuSeries {
+    /** Timestamps, in ns. */
+    using Timestamps = Eigen::Array<uint64_t, Eigen::Dynamic, 1>;
+
+    /** Vectors with components x, y and z arranged contiguously in columns. */
+    using Vectors = Eigen::Array<float, Eigen::Dynamic, 3>;
+
+    Timestamps sys_ts;       ///< timestamps of the packets
+    Timestamps accel_ts;     ///< timestamps of the accelerometer readings
+    Timestamps gyro_ts;      ///< timestamps of the gyro readings
+    Vectors acceleration;    ///< linear acceleration, in g
+    Vectors angular_velocity;  ///< angular velocity, in deg/s
+
+    /**
+     * Get the number of samples.
+     *
+     * @return the number of rows of the series.
+     */
+    size_t size() const { return static_cast<size_t>(gyro_ts.size()); }
+};
+
+/**
+ * Accumulates IMU packets and hands out the samples covering each scan.
+ *
+ * The series of a scan runs from the last sample at or before its first
+ * valid column to the first sample at or after its last valid column, so
+ * that the motion at every column can be interpolated. Samples are kept
+ * until no later scan needs them.
+ */
+class ImuBatcher {
+   public:
+    /**
+     * Prepare to batch the IMU packets of a sensor.
+     *
+     * @throw std::invalid_argument if max_samples is less than two.
+     *
+     * @param[in] info sensor metadata.
+     * @param[in] max_samples the most samples held, the oldest are dropped
+     * beyond that, e.g. when scans stop being batched.
+     */
+    explicit ImuBatcher(const sensor::sensor_info& info,
+                        size_t max_samples = 1000);
+
+    /**
+     * Add the sample of an IMU packet.
+     *
+     * Samples are expected in the order of their gyro timestamps; samples no
+     * later than the latest added are dropped.
+     *
+     * @param[in] imu_buf the imu packet buffer.
+     * @return false if the sample was dropped.
+     */
+    bool operator()(const uint8_t* imu_buf);
+
+    /**
+     * Get the samples covering a scan, if they have arrived.
+     *
+     * @param[in] scan the scan, staggered or not.
+     * @param[out] series the samples covering the scan, left unmodified if
+     * the function returns false.
+     * @return false if the scan has no valid columns, or if there is no
+     * sample yet at or after its last valid column, in which case the call
+     * can be repeated after adding more packets.
+     */
+    bool operator()(const LidarScan& scan, ImuSeries& series);
+
+    /**
+     * Get the number of samples held.
+     *
+     * @return the number of samples.
+     */
+    size_t size() const;
+
+    /**
+     * Get the number of samples dropped, out of order or beyond max_samples.
+     *
+     * @return the number of samples dropped so far.
+     */
+    uint64_t dropped() const;
+
+   private:
+    struct Sample {
+        uint64_t sys_ts, accel_ts, gyro_ts;
+        float acceleration[3];
+        float angular_velocity[3];
+    };
+
+    sensor::packet_format pf_;
+    size_t max_samples_;
+    std::deque<Sample> samples_;
+    uint64_t dropped_{0};
+};
+
+/**
+ * Motion of the IMU at each column of a scan relative to a reference time,
+ * stored as a structure of arrays with a row per column.
+ *
+ * Rotations are of the IMU frame at the column relative to the IMU frame at
+ * the reference time. Velocity and position deltas are preintegrated
+ * measurements: with R the orientation, v the velocity and p the position of
+ * the IMU at the reference time in a world frame with gravity g, the IMU at
+ * the column, dt later, has orientation R * rotation, velocity v + g * dt + R
+ * * velocity and position p + v * dt + g * dt^2 / 2 + R * position.
+ */
+struct ImuDeltas {
+    /** Unit quaternions with components x, y, z and w in columns. */
+    Eigen::Array<double, Eigen::Dynamic, 4> rotation;
+    /** Velocity deltas in the reference IMU frame, in m/s. */
+    Eigen::Array<double, Eigen::Dynamic, 3> velocity;
+    /** Position deltas in the reference IMU frame, in m. */
+    Eigen::Array<double, Eigen::Dynamic, 3> position;
+};
+
+/**
+ * Preintegrate IMU samples at each column of a scan.
+ *
+ * Angular velocity and acceleration are interpolated linearly between
+ * samples, held before the first and after the last, and both are integrated
+ * at the gyro timestamps. Columns not marked valid in the scan status get the
+ * identity rotation and zero deltas.
+ *
+ * @throw std::invalid_argument if there are no samples or they are not sorted
+ * by gyro timestamp.
+ *
+ * @param[in] scan a LidarScan.
+ * @param[in] imu IMU samples covering the scan, e.g. from an ImuBatcher.
+ * @param[in] ref_ts the reference time, in ns.
+ * @param[out] deltas the motion at each column of the scan.
+ */
+void preintegrate(const LidarScan& scan, const ImuSeries& imu,
+                  uint64_t ref_ts, ImuDeltas& deltas);
+
+}  // namespace ouster
@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Receive and batch lidar data from many sensors on a few threads
+ *
+ * An Engine owns a set of sensor sessions, each identified by the address the
+ * sensor sends from and the local port it sends lidar data to. Packets are
+ * received on a fixed number of threads regardless of the number of sensors,
+ * demultiplexed by source address and batched into scans which are handed to
+ * per-sensor callbacks.
+ *
+ * Only lidar data is handled; the sensors are not configured.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace ingest {
+
+/**
+ * Called on a receive thread with each completed scan.
+ *
+ * Calls for one sensor are never concurrent, but calls for different sensors
+ * may be. The scan is returned to the pool of its sensor once the handle is
+ * released, so handlers should hand it off instead of blocking.
+ */
+using ScanHandler =
+    std::function<void(int sensor_id, LidarScanPool::Handle scan)>;
+
+/** Counters for a single sensor session. */
+struct SensorStats {
+    uint64_t packets;      ///< lidar packets received
+    uint64_t bad_packets;  ///< packets of the wrong size for the sensor
+    uint64_t scans;        ///< completed scans handed to the handler
+};
+
+/** Options controlling the receive threads of an Engine. */
+struct EngineConfig {
+    /** Number of receive threads. */
+    int n_threads{1};
+
+    /**
+     * Pin receive thread i to cpu first_cpu + i, and ask the kernel to steer
+     * packets handled on that cpu to the sockets of the same thread with
+     * SO_INCOMING_CPU. Only supported on Linux.
+     */
+    bool pin_threads{false};
+
+    /** First cpu to pin receive threads to. */
+    int first_cpu{0};
+
+    /** Number of scans preallocated per sensor. */
+    size_t pool_size{4};
+};
+
+/**
+ * Multi-sensor lidar data receiver.
+ *
+ * On Linux every receive thread opens its own socket for each port with
+ * SO_REUSEPORT, and the kernel spreads sensors across threads by hashing the
+ * source address. Elsewhere each port is handled by a single thread.
+ */
+class Engine {
+   public:
+    /**
+     * Create an engine, without starting any threads.
+     *
+     * @param[in] config receive thread options.
+     */
+    explicit Engine(const EngineConfig& config = {});
+
+    /** Stops the receive threads and closes all sockets. */
+    ~Engine();
+
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    /**
+     * Add a sensor session. Must be called before start().
+     *
+     * Packets on a port that don't come from a known sensor are handed to the
+     * session registered with an empty src_ip on that port, if any, and are
+     * dropped otherwise.
+     *
+     * @throw std::invalid_argument if a sensor with the same key exists, the
+     * address can't be resolved or the engine is running.
+     * @throw std::runtime_error if the port can't be bound.
+     *
+     * @param[in] src_ip hostname or ip the sensor sends from, or "" for any.
+     * @param[in] port local port the sensor sends lidar data to. If zero, an
+     * ephemeral port is bound; see get_port().
+     * @param[in] info sensor metadata used to batch packets.
+     * @param[in] handler callback for completed scans.
+     *
+     * @return id of the new sensor session.
+     */
+    int add_sensor(const std::string& src_ip, int port,
+                   const sensor::sensor_info& info, ScanHandler handler);
+
+    /**
+     * Get the local lidar port of a sensor session.
+     *
+     * @param[in] sensor_id id returned by add_sensor().
+     *
+     * @return the bound port number.
+     */
+    int get_port(int sensor_id) const;
+
+    /**
+     * Get the packet counters of a sensor session.
+     *
+     * @param[in] sensor_id id returned by add_sensor().
+     *
+     * @return a snapshot of the counters.
+     */
+    SensorStats get_stats(int sensor_id) const;
+
+    /**
+     * Get the number of packets that didn't match any sensor session.
+     *
+     * @return the number of dropped packets.
+     */
+    uint64_t unknown_packets() const;
+
+    /**
+     * Start the receive threads.
+     *
+     * @throw std::runtime_error if sockets can't be opened.
+     */
+    void start();
+
+    /** Stop and join the receive threads. Not an error if not running. */
+    void stop();
+
+   private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace ingest
+}  // namespace ouster
@@ -9,9 +9,15 @@
 #pragma once
 
 #include <Eigen/Core>
+#include <array>
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
 #include <map>
+#include <memory>
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
@@ -23,15 +29,53 @@ namespace ouster {
 
 // forward declarations
 namespace impl {
-struct FieldSlot;
+
+/** Where a channel field of a LidarScan is stored in its arena. */
+struct FieldSlot {
+    uint32_t offset{0};  ///< offset of the field in the arena, in bytes
+    sensor::ChanFieldType tag{sensor::ChanFieldType::VOID};  ///< field type
+};
+
+struct ScanBatcherKernel;
+struct ScanPoolState;
 }
 
+class ScanBatcher;
+
+/**
+ * Counters of a scan collected by ScanBatcher while parsing its packets, so
+ * that frame health checks don't need a pass over the scan.
+ *
+ * Columns are counted once, when the first valid measurement block for them
+ * arrives. The summary is only valid for a scan completed by a ScanBatcher,
+ * until the scan is modified through one of its non-const accessors. Writes
+ * through views taken before the scan was batched aren't noticed.
+ */
+struct ScanSummary {
+    bool valid{false};  ///< whether the counters describe the scan
+    sensor::ColumnWindow window{0, 0};  ///< column window of the batcher
+    uint32_t cols_received{0};          ///< valid columns
+    uint32_t window_cols_received{0};   ///< valid columns within the window
+    uint32_t cols_missing{0};           ///< columns zeroed as missing
+    uint64_t first_timestamp{0};  ///< earliest timestamp of a valid column
+    uint64_t last_timestamp{0};   ///< latest timestamp of a valid column
+    uint64_t zero_range{0};   ///< pixels of valid columns without RANGE
+    uint64_t zero_range2{0};  ///< pixels of valid columns without RANGE2, if
+                              ///< the scan has the field
+};
+
 /**
  * Data structure for efficient operations on aggregated lidar data.
  *
  * Stores each field (range, intensity, etc.) contiguously as a H x W block of
- * 4-byte unsigned integers, where H is the number of beams and W is the
- * horizontal resolution (e.g. 512, 1024, 2048).
+ * unsigned integers, where H is the number of beams and W is the horizontal
+ * resolution (e.g. 512, 1024, 2048).
+ *
+ * Fields and the column headers live in a single arena, allocated at
+ * construction or supplied by the caller, e.g. in shared memory. Each block is
+ * aligned to arena_alignment bytes. Fields are looked up in constant time, and
+ * copying between scans of the same dimensions and fields is a single memcpy
+ * without allocating.
  *
  * Note: this is the "staggered" representation where each column corresponds
  * to a single measurement in time. Use the destagger() function to create an
@@ -77,17 +121,52 @@ class LidarScan {
         uint32_t status;
     };
 
+    /** Alignment of the blocks of the arena, in bytes. */
+    static constexpr size_t arena_alignment = 64;
+
    private:
-    Header<uint64_t> timestamp_;
-    Header<uint16_t> measurement_id_;
-    Header<uint32_t> status_;
-    std::map<sensor::ChanField, impl::FieldSlot> fields_;
+    // owned_ is empty when the arena was supplied by the caller
+    std::unique_ptr<uint8_t[]> owned_;
+    uint8_t* arena_{nullptr};
+    size_t arena_size_{0};
+
+    // offsets of the column headers in the arena
+    uint32_t timestamp_{0};
+    uint32_t measurement_id_{0};
+    uint32_t status_{0};
+    uint32_t rx_timestamp_{0};
+
+    // indexed by channel field, VOID for fields not in the scan
+    std::array<impl::FieldSlot, sensor::CHAN_FIELD_MAX> fields_{};
     std::vector<std::pair<sensor::ChanField, sensor::ChanFieldType>>
         field_types_;
 
     LidarScan(size_t w, size_t h,
               std::vector<std::pair<sensor::ChanField, sensor::ChanFieldType>>
-                  field_types);
+                  field_types,
+              uint8_t* arena = nullptr, size_t arena_size = 0,
+              bool zero = true);
+
+    static size_t layout(
+        size_t w, size_t h,
+        const std::vector<std::pair<sensor::ChanField, sensor::ChanFieldType>>&
+            field_types,
+        LidarScan* ls);
+
+    static std::vector<std::pair<sensor::ChanField, sensor::ChanFieldType>>
+    profile_fields(sensor::UDPProfileLidar profile);
+
+    void allocate();
+
+    const impl::FieldSlot& slot(sensor::ChanField f) const;
+
+    bool same_layout(const LidarScan& other) const;
+
+    // filled in by ScanBatcher, invalidated by non-const accessors
+    ScanSummary summary_{};
+    // set by ScanBatcher when batching with BATCH_LAZY_ZERO
+    bool stale_columns_{false};
+    friend class ScanBatcher;
 
    public:
     /**
@@ -124,6 +203,15 @@ class LidarScan {
      */
     int32_t frame_id{-1};
 
+    /**
+     * Whether channel fields are stored destaggered, as batched with
+     * BATCH_DESTAGGER. Headers are always stored by measurement id.
+     *
+     * @warning Members variables: use with caution, some of these will become
+     * private.
+     */
+    bool destaggered{false};
+
     using FieldIter =
         decltype(field_types_)::const_iterator;  ///< An STL Iterator of the
                                                  ///< field types
@@ -165,6 +253,87 @@ class LidarScan {
     LidarScan(size_t w, size_t h, Iterator begin, Iterator end)
         : LidarScan(w, h, {begin, end}){};
 
+    /**
+     * Initialize a scan with the default fields for a particular udp profile,
+     * stored in memory supplied by the caller.
+     *
+     * The arena must outlive the scan. It's zeroed unless the scan views data
+     * already laid out by a scan of the same dimensions and fields, e.g. one
+     * published by another process, in which case it may be read-only as long
+     * as the scan is only accessed as const. Copies of the scan own
+     * their arena, as do scans assigned from scans of different dimensions or
+     * fields; assigning from a scan of the same dimensions and fields copies
+     * into the supplied arena.
+     *
+     * @throw std::invalid_argument if the arena is too small or isn't aligned
+     * to 8 bytes.
+     *
+     * @param[in] w horizontal resoulution, i.e. the number of measurements per
+     * scan.
+     * @param[in] h vertical resolution, i.e. the number of channels.
+     * @param[in] profile udp profile.
+     * @param[in] arena memory to store the scan in, see arena_size().
+     * @param[in] size size of the arena in bytes.
+     * @param[in] zero whether to zero the arena, false to view its contents.
+     */
+    LidarScan(size_t w, size_t h, sensor::UDPProfileLidar profile,
+              uint8_t* arena, size_t size, bool zero = true);
+
+    /**
+     * Initialize a scan with a custom set of fields, stored in memory supplied
+     * by the caller. The arena is handled as by the constructor taking a
+     * profile and an arena.
+     *
+     * @throw std::invalid_argument if the arena is too small or isn't aligned
+     * to 8 bytes.
+     *
+     * @tparam Iterator A standard template iterator for the custom fields.
+     *
+     * @param[in] w horizontal resoulution, i.e. the number of measurements per
+     * scan.
+     * @param[in] h vertical resolution, i.e. the number of channels.
+     * @param[in] begin begin iterator of pairs of channel fields and types.
+     * @param[in] end end iterator of pairs of channel fields and types.
+     * @param[in] arena memory to store the scan in, see arena_size().
+     * @param[in] size size of the arena in bytes.
+     * @param[in] zero whether to zero the arena, false to view its contents.
+     */
+    template <typename Iterator>
+    LidarScan(size_t w, size_t h, Iterator begin, Iterator end, uint8_t* arena,
+              size_t size, bool zero = true)
+        : LidarScan(w, h, {begin, end}, arena, size, zero){};
+
+    /**
+     * Get the size of the arena of a scan with the default fields for a
+     * particular udp profile.
+     *
+     * @param[in] w horizontal resoulution.
+     * @param[in] h vertical resolution.
+     * @param[in] profile udp profile.
+     *
+     * @return the size of the arena in bytes.
+     */
+    static size_t arena_size(size_t w, size_t h,
+                             sensor::UDPProfileLidar profile);
+
+    /**
+     * Get the size of the arena of a scan with a custom set of fields.
+     *
+     * @tparam Iterator A standard template iterator for the custom fields.
+     *
+     * @param[in] w horizontal resoulution.
+     * @param[in] h vertical resolution.
+     * @param[in] begin begin iterator of pairs of channel fields and types.
+     * @param[in] end end iterator of pairs of channel fields and types.
+     *
+     * @return the size of the arena in bytes.
+     */
+    template <typename Iterator>
+    static size_t arena_size(size_t w, size_t h, Iterator begin,
+                             Iterator end) {
+        return layout(w, h, {begin, end}, nullptr);
+    }
+
     /**
      * Initialize a lidar scan from another lidar scan.
      *
@@ -281,13 +450,76 @@ class LidarScan {
     /** @copydoc status() */
     Eigen::Ref<const Header<uint32_t>> status() const;
 
+    /**
+     * Access the host receive timestamp headers.
+     *
+     * Holds the time in nanoseconds since the unix epoch at which the packet
+     * containing each measurement was received by the host, or zero if
+     * unknown. See sensor::read_lidar_packet().
+     *
+     * @return a view of receive timestamps as a w-element vector.
+     */
+    Eigen::Ref<Header<uint64_t>> rx_timestamp();
+
+    /** @copydoc rx_timestamp() */
+    Eigen::Ref<const Header<uint64_t>> rx_timestamp() const;
+
+    /**
+     * Access the arena holding the fields and column headers of the scan.
+     *
+     * Scans of the same dimensions and fields have the same layout, so the
+     * arena can be copied or serialized as a whole.
+     *
+     * @return the arena, or nullptr for an empty scan.
+     */
+    uint8_t* arena();
+
+    /** @copydoc arena() */
+    const uint8_t* arena() const;
+
+    /**
+     * Get the size of the arena of the scan.
+     *
+     * @return the size in bytes.
+     */
+    size_t arena_size() const;
+
+    /**
+     * Whether the scan owns its arena, or stores its data in memory supplied
+     * by the caller.
+     *
+     * @return false if the arena was supplied by the caller.
+     */
+    bool owns_arena() const;
+
     /**
      * Assess completeness of scan.
+     *
+     * Constant time for scans with a valid summary when all columns arrived
+     * or the window is that of the batcher, see summary(); otherwise checks
+     * the status of each column in the window.
+     *
      * @param[in] window The column window to use for validity assessment
      * @return whether all columns within given column window were valid
      */
     bool complete(sensor::ColumnWindow window) const;
 
+    /**
+     * Get the counters collected while batching the scan.
+     *
+     * @return the summary, with valid set if it describes the scan.
+     */
+    const ScanSummary& summary() const;
+
+    /**
+     * Whether the channel fields of columns missing from the scan may hold
+     * data left over from previous scans, as batched with BATCH_LAZY_ZERO.
+     *
+     * @return true if field data should only be used for columns marked
+     * valid in status().
+     */
+    bool stale_columns() const;
+
     friend bool operator==(const LidarScan& a, const LidarScan& b);
 };
 
@@ -338,6 +570,18 @@ struct XYZLut {
     LidarScan::Points offset;     ///< Lookup table of beam offsets
 };
 
+/**
+ * Lookup table of beam directions and offsets in single precision, taking half
+ * the memory of XYZLut. Laid out like XYZLut.
+ */
+struct XYZLutf {
+    /** XYZ coordinates with dimensions arranged contiguously in columns. */
+    using Points = Eigen::Array<float, Eigen::Dynamic, 3>;
+
+    Points direction;  ///< Lookup table of beam directions
+    Points offset;     ///< Lookup table of beam offsets
+};
+
 /**
  * Generate a set of lookup tables useful for computing Cartesian coordinates
  * from ranges.
@@ -383,6 +627,86 @@ inline XYZLut make_xyz_lut(const sensor::sensor_info& sensor) {
         sensor.beam_altitude_angles);
 }
 
+/**
+ * Generate lookup tables for scans with the given layout.
+ *
+ * @param[in] sensor metadata returned from the client.
+ * @param[in] destaggered if true, generate tables for scans with destaggered
+ * fields, see LidarScan::destaggered.
+ *
+ * @return xyz direction and offset vectors for each point in the lidar scan.
+ */
+XYZLut make_xyz_lut(const sensor::sensor_info& sensor, bool destaggered);
+
+/**
+ * Convert lookup tables to single precision.
+ *
+ * @param[in] lut lookup tables generated by make_xyz_lut.
+ *
+ * @return the lookup tables in single precision.
+ */
+inline XYZLutf make_xyz_lutf(const XYZLut& lut) {
+    return {lut.direction.cast<float>(), lut.offset.cast<float>()};
+}
+
+/**
+ * Convenient overload that uses parameters from the supplied sensor_info.
+ *
+ * @param[in] sensor metadata returned from the client.
+ *
+ * @return single precision xyz direction and offset vectors for each point in
+ * the lidar scan.
+ */
+inline XYZLutf make_xyz_lutf(const sensor::sensor_info& sensor) {
+    return make_xyz_lutf(make_xyz_lut(sensor));
+}
+
+/**
+ * Convenient overload for scans with the given layout.
+ *
+ * @param[in] sensor metadata returned from the client.
+ * @param[in] destaggered if true, generate tables for scans with destaggered
+ * fields, see LidarScan::destaggered.
+ *
+ * @return single precision xyz direction and offset vectors for each point in
+ * the lidar scan.
+ */
+inline XYZLutf make_xyz_lutf(const sensor::sensor_info& sensor,
+                             bool destaggered) {
+    return make_xyz_lutf(make_xyz_lut(sensor, destaggered));
+}
+
+/**
+ * Get lookup tables shared by every user of the same sensor in the process.
+ *
+ * Tables are generated on first use and kept for as long as someone holds on
+ * to them. Metadata with the same dimensions, beam intrinsics and transform
+ * map to the same tables, so that many consumers of a sensor keep a single
+ * copy in memory.
+ *
+ * @param[in] sensor metadata returned from the client.
+ * @param[in] destaggered if true, get tables for scans with destaggered
+ * fields, see LidarScan::destaggered.
+ *
+ * @return xyz direction and offset vectors for each point in the lidar scan.
+ */
+std::shared_ptr<const XYZLut> shared_xyz_lut(const sensor::sensor_info& sensor,
+                                             bool destaggered = false);
+
+/**
+ * Get single precision lookup tables shared by every user of the same
+ * sensor in the process, as above.
+ *
+ * @param[in] sensor metadata returned from the client.
+ * @param[in] destaggered if true, get tables for scans with destaggered
+ * fields, see LidarScan::destaggered.
+ *
+ * @return single precision xyz direction and offset vectors for each point in
+ * the lidar scan.
+ */
+std::shared_ptr<const XYZLutf> shared_xyz_lutf(
+    const sensor::sensor_info& sensor, bool destaggered = false);
+
 /** \defgroup ouster_client_lidar_scan_cartesian Ouster Client lidar_scan.h
  * XYZLut related items.
  * @{
@@ -390,6 +714,8 @@ inline XYZLut make_xyz_lut(const sensor::sensor_info& sensor) {
 /**
  * Convert LidarScan to Cartesian points.
  *
+ * Points in columns that are not marked valid in the scan status are zero.
+ *
  * @param[in] scan a LidarScan.
  * @param[in] lut lookup tables generated by make_xyz_lut.
  *
@@ -410,6 +736,309 @@ LidarScan::Points cartesian(const LidarScan& scan, const XYZLut& lut);
  */
 LidarScan::Points cartesian(const Eigen::Ref<const img_t<uint32_t>>& range,
                             const XYZLut& lut);
+
+/**
+ * Convert a staggered range image to Cartesian points in preallocated memory.
+ *
+ * Computes the same points as cartesian() in a single pass, without
+ * temporaries. The coordinates of the ith pixel, where i = row * w + col, are
+ * written to out[i * stride] to out[i * stride + 2], leaving other elements as
+ * is. A stride of 3 produces interleaved xyz points and a stride of 4 xyzw
+ * points, and larger strides fill points with extra fields in place.
+ *
+ * Lookup tables in single precision only produce single precision points.
+ *
+ * @throw std::invalid_argument if the image doesn't match the lookup tables or
+ * the stride is less than 3.
+ *
+ * @tparam L the lookup table type, XYZLut or XYZLutf.
+ * @tparam T the coordinate type, float or double.
+ *
+ * @param[in] range a range image in the same format as the RANGE field of a
+ * LidarScan.
+ * @param[in] lut lookup tables generated by make_xyz_lut or make_xyz_lutf.
+ * @param[out] out the points, w * h * stride elements.
+ * @param[in] stride the distance between points in elements.
+ */
+template <typename L, typename T>
+void cartesian_into(const Eigen::Ref<const img_t<uint32_t>>& range,
+                    const L& lut, T* out, std::ptrdiff_t stride = 3);
+
+/**
+ * Convert LidarScan to Cartesian points in preallocated memory.
+ *
+ * Like cartesian(), points in columns that are not marked valid in the scan
+ * status are zero.
+ *
+ * @throw std::invalid_argument if the scan doesn't match the lookup tables or
+ * the stride is less than 3.
+ *
+ * @tparam L the lookup table type, XYZLut or XYZLutf.
+ * @tparam T the coordinate type, float or double.
+ *
+ * @param[in] scan a LidarScan.
+ * @param[in] lut lookup tables generated by make_xyz_lut or make_xyz_lutf.
+ * @param[out] out the points, w * h * stride elements.
+ * @param[in] stride the distance between points in elements.
+ */
+template <typename L, typename T>
+void cartesian_into(const LidarScan& scan, const L& lut, T* out,
+                    std::ptrdiff_t stride = 3);
+
+/**
+ * Convert several range fields of a LidarScan, e.g. RANGE and RANGE2 of a
+ * dual return profile, to Cartesian points in preallocated memory.
+ *
+ * Produces the same points as calling cartesian_into() for each field, but
+ * reads the lookup tables from memory once for all fields. Projecting a few
+ * rows at a time lets callers fill in other fields of the points while they
+ * are still in cache.
+ *
+ * @throw std::invalid_argument if the scan doesn't match the lookup tables,
+ * the stride is less than 3, there isn't an output for each field, a field
+ * isn't of type uint32_t or the rows are out of the scan.
+ * @throw std::out_of_range if a field is not in the scan.
+ *
+ * @tparam L the lookup table type, XYZLut or XYZLutf.
+ * @tparam T the coordinate type, float or double.
+ *
+ * @param[in] scan a LidarScan.
+ * @param[in] ranges the uint32_t range fields to project.
+ * @param[in] lut lookup tables generated by make_xyz_lut or make_xyz_lutf.
+ * @param[out] out the points of each field, w * h * stride elements each.
+ * @param[in] stride the distance between points in elements.
+ * @param[in] rows_begin the first row to project.
+ * @param[in] rows_end the row after the last to project, or -1 for all rows.
+ */
+template <typename L, typename T>
+void cartesian_into(const LidarScan& scan,
+                    const std::vector<sensor::ChanField>& ranges, const L& lut,
+                    const std::vector<T*>& out, std::ptrdiff_t stride = 3,
+                    std::ptrdiff_t rows_begin = 0,
+                    std::ptrdiff_t rows_end = -1);
+
+/**
+ * Pixels of a scan to project, for consumers that only need a sector of the
+ * field of view or fewer beams.
+ *
+ * Points of a region are laid out like those of a scan, with the point of
+ * rows[j] and cols[k] at i = j * cols.size() + k.
+ */
+struct ScanRegion {
+    std::vector<int> rows;  ///< rows of the scan to project, in order
+    std::vector<int> cols;  ///< columns of the scan to project, in order
+};
+
+/**
+ * Make a region of every col_step columns of a window and every row_step
+ * rows.
+ *
+ * @throw std::invalid_argument if the window is out of the scan or a step is
+ * less than one.
+ *
+ * @param[in] w the number of columns of the scan.
+ * @param[in] h the number of rows of the scan.
+ * @param[in] window the first and last columns, wrapping around the end of
+ * the scan if the first is after the last, as in sensor::data_format.
+ * @param[in] col_step the distance between projected columns.
+ * @param[in] row_step the distance between projected rows.
+ *
+ * @return the region.
+ */
+ScanRegion make_scan_region(size_t w, size_t h, sensor::ColumnWindow window,
+                            int col_step = 1, int row_step = 1);
+
+/**
+ * Make a region of every col_step columns in the column window of a sensor
+ * and every row_step rows.
+ *
+ * @throw std::invalid_argument as above.
+ *
+ * @param[in] sensor metadata returned from the client.
+ * @param[in] col_step the distance between projected columns.
+ * @param[in] row_step the distance between projected rows.
+ *
+ * @return the region.
+ */
+ScanRegion make_scan_region(const sensor::sensor_info& sensor,
+                            int col_step = 1, int row_step = 1);
+
+/**
+ * Slice lookup tables to the pixels of a region.
+ *
+ * @throw std::invalid_argument if the region is out of the tables.
+ *
+ * @tparam L the lookup table type, XYZLut or XYZLutf.
+ *
+ * @param[in] lut lookup tables of a whole scan.
+ * @param[in] w the number of columns of the scan.
+ * @param[in] region the pixels to keep.
+ *
+ * @return lookup tables of the region, laid out like its points.
+ */
+template <typename L>
+L slice_xyz_lut(const L& lut, size_t w, const ScanRegion& region);
+
+/**
+ * Convert a region of a LidarScan to Cartesian points.
+ *
+ * Produces the points of cartesian() at the pixels of the region, only
+ * reading the range of those pixels.
+ *
+ * @throw std::invalid_argument if the region is out of the scan or doesn't
+ * match the lookup tables.
+ *
+ * @param[in] scan a LidarScan.
+ * @param[in] region the pixels to project.
+ * @param[in] region_lut lookup tables sliced to the region by
+ * slice_xyz_lut().
+ *
+ * @return Cartesian points where ith row is a 3D point which corresponds
+ *         to ith pixel of the region.
+ */
+LidarScan::Points cartesian(const LidarScan& scan, const ScanRegion& region,
+                            const XYZLut& region_lut);
+
+/**
+ * Convert several range fields of a region of a LidarScan to Cartesian points
+ * in preallocated memory.
+ *
+ * Like the overload for whole scans, but with region.rows.size() *
+ * region.cols.size() points per field and rows_begin and rows_end indexing
+ * region.rows.
+ *
+ * @throw std::invalid_argument if the region is out of the scan or doesn't
+ * match the lookup tables, or as the overload for whole scans.
+ * @throw std::out_of_range if a field is not in the scan.
+ *
+ * @tparam L the lookup table type, XYZLut or XYZLutf.
+ * @tparam T the coordinate type, float or double.
+ *
+ * @param[in] scan a LidarScan.
+ * @param[in] region the pixels to project.
+ * @param[in] ranges the uint32_t range fields to project.
+ * @param[in] region_lut lookup tables sliced to the region by
+ * slice_xyz_lut().
+ * @param[out] out the points of each field, stride elements per point.
+ * @param[in] stride the distance between points in elements.
+ * @param[in] rows_begin the first row of the region to project.
+ * @param[in] rows_end the row after the last to project, or -1 for all rows.
+ */
+template <typename L, typename T>
+void cartesian_into(const LidarScan& scan, const ScanRegion& region,
+                    const std::vector<sensor::ChanField>& ranges,
+                    const L& region_lut, const std::vector<T*>& out,
+                    std::ptrdiff_t stride = 3, std::ptrdiff_t rows_begin = 0,
+                    std::ptrdiff_t rows_end = -1);
+/** @}*/
+
+/** \defgroup ouster_client_lidar_scan_deskew Ouster Client lidar_scan.h
+ * Motion compensation.
+ *
+ * Each column of a scan is measured at its own timestamp, so a moving sensor
+ * smears the scene over the course of a frame. A pose per column, mapping
+ * points measured at the column to a common reference frame, lets the
+ * projection undo the motion in the same pass that computes the points.
+ * @{
+ */
+
+/** Angular velocity measured by the IMU. */
+struct ImuSample {
+    uint64_t ts;                      ///< gyro timestamp, in ns
+    Eigen::Vector3d angular_velocity;  ///< in deg/s, in the IMU frame
+};
+
+/**
+ * Read the angular velocity from an IMU packet.
+ *
+ * @param[in] pf the packet format of the sensor.
+ * @param[in] imu_buf the imu packet buffer.
+ *
+ * @return the gyro timestamp and angular velocity of the packet.
+ */
+ImuSample imu_sample(const sensor::packet_format& pf, const uint8_t* imu_buf);
+
+/**
+ * Evaluate a pose for each column of a scan.
+ *
+ * Columns not marked valid in the scan status get the identity.
+ *
+ * @param[in] scan a LidarScan.
+ * @param[in] pose_at the transform from the sensor frame at a column
+ * timestamp, in ns, to the reference frame.
+ *
+ * @return a pose for each column of the scan.
+ */
+std::vector<mat4d> column_poses(const LidarScan& scan,
+                                const std::function<mat4d(uint64_t)>& pose_at);
+
+/**
+ * Estimate a pose for each column of a scan by integrating the gyro.
+ *
+ * Poses only compensate for rotation, with the reference frame being the
+ * sensor frame at ref_ts: integrating the accelerometer twice drifts too much
+ * to compensate for translation, which callers with odometry can supply
+ * through column_poses(). Angular velocity is interpolated linearly between
+ * samples and held before the first and after the last. Columns not marked
+ * valid in the scan status get the identity.
+ *
+ * @throw std::invalid_argument if there are no samples or they are not sorted
+ * by timestamp.
+ *
+ * @param[in] scan a LidarScan.
+ * @param[in] imu IMU samples covering the scan, sorted by timestamp.
+ * @param[in] imu_to_sensor_transform the imu_to_sensor_transform of the
+ * sensor metadata.
+ * @param[in] ref_ts the timestamp, in ns, of the reference frame.
+ *
+ * @return a pose for each column of the scan.
+ */
+std::vector<mat4d> imu_column_poses(const LidarScan& scan,
+                                    const std::vector<ImuSample>& imu,
+                                    const mat4d& imu_to_sensor_transform,
+                                    uint64_t ref_ts);
+
+/**
+ * Convert LidarScan to motion compensated Cartesian points in preallocated
+ * memory.
+ *
+ * Produces the points of cartesian_into(), each transformed by the pose of
+ * its column, in a single pass. Pixels without a return and columns not
+ * marked valid in the scan status are zero.
+ *
+ * @throw std::invalid_argument if the scan doesn't match the lookup tables,
+ * there isn't a pose for each column, the stride is less than 3 or the scan
+ * is destaggered.
+ *
+ * @tparam L the lookup table type, XYZLut or XYZLutf.
+ * @tparam T the coordinate type, float or double.
+ *
+ * @param[in] scan a staggered LidarScan.
+ * @param[in] lut lookup tables generated by make_xyz_lut or make_xyz_lutf,
+ * without destaggering.
+ * @param[in] poses a pose for each column, e.g. from imu_column_poses().
+ * @param[out] out the points, w * h * stride elements.
+ * @param[in] stride the distance between points in elements.
+ */
+template <typename L, typename T>
+void deskewed_cartesian_into(const LidarScan& scan, const L& lut,
+                             const std::vector<mat4d>& poses, T* out,
+                             std::ptrdiff_t stride = 3);
+
+/**
+ * Convert LidarScan to motion compensated Cartesian points.
+ *
+ * @throw std::invalid_argument as deskewed_cartesian_into().
+ *
+ * @param[in] scan a staggered LidarScan.
+ * @param[in] lut lookup tables generated by make_xyz_lut.
+ * @param[in] poses a pose for each column, e.g. from imu_column_poses().
+ *
+ * @return Cartesian points where ith row is a 3D point which corresponds
+ *         to ith pixel in LidarScan where i = row * w + col.
+ */
+LidarScan::Points deskewed_cartesian(const LidarScan& scan, const XYZLut& lut,
+                                     const std::vector<mat4d>& poses);
 /** @}*/
 
 /** \defgroup ouster_client_destagger Ouster Client lidar_scan.h
@@ -454,19 +1083,292 @@ inline img_t<T> stagger(const Eigen::Ref<const img_t<T>>& img,
                         const std::vector<int>& pixel_shift_by_row) {
     return destagger(img, pixel_shift_by_row, true);
 }
+
+/**
+ * Destagger images into preallocated memory, with the row shifts of a sensor
+ * computed once.
+ *
+ * Each row is copied in two contiguous segments, so that pixels of any type,
+ * including several channels per pixel, are destaggered at the speed of a
+ * memory copy.
+ */
+class Destaggerer {
+   public:
+    /** Destagger nothing, for use as a placeholder. */
+    Destaggerer() = default;
+
+    /**
+     * Prepare to destagger images with the given shifts.
+     *
+     * @throw std::invalid_argument if w is zero.
+     *
+     * @param[in] pixel_shift_by_row offsets, usually queried from the sensor.
+     * @param[in] w the width of the images.
+     * @param[in] inverse perform the inverse operation, staggering images.
+     */
+    Destaggerer(const std::vector<int>& pixel_shift_by_row, size_t w,
+                bool inverse = false);
+
+    /**
+     * Prepare to destagger the images of a sensor.
+     *
+     * @param[in] info sensor metadata.
+     * @param[in] inverse perform the inverse operation, staggering images.
+     */
+    explicit Destaggerer(const sensor::sensor_info& info,
+                         bool inverse = false);
+
+    /**
+     * Destagger an image into another of the same dimensions.
+     *
+     * @throw std::invalid_argument if the images don't have the expected
+     * dimensions.
+     *
+     * @tparam T the datatype of the image.
+     *
+     * @param[in] img the image to destagger.
+     * @param[out] dest the destaggered image, which must not overlap img.
+     */
+    template <typename T>
+    void operator()(
+        const Eigen::Ref<const img_t<typename std::common_type<T>::type>>& img,
+        Eigen::Ref<img_t<T>> dest) const;
+
+    /** Destagger an image into a preallocated img_t, as above. */
+    template <typename T>
+    void operator()(
+        const Eigen::Ref<const img_t<typename std::common_type<T>::type>>& img,
+        img_t<T>& dest) const {
+        (*this)(img, Eigen::Ref<img_t<T>>(dest));
+    }
+
+    /**
+     * Destagger several fields of a scan into the same fields of another.
+     *
+     * @throw std::invalid_argument if the scans don't have the expected
+     * dimensions or a field has different types in the two scans.
+     * @throw std::out_of_range if a field is missing from either scan.
+     *
+     * @param[in] scan the scan to destagger.
+     * @param[in] fields the fields to destagger.
+     * @param[out] dest the scan to write the destaggered fields to, which must
+     * not be scan.
+     * @param[in] n_threads the number of threads to split rows between,
+     * including the calling thread.
+     */
+    void operator()(const LidarScan& scan,
+                    const std::vector<sensor::ChanField>& fields,
+                    LidarScan& dest, int n_threads = 1) const;
+
+    /**
+     * Destagger a contiguous, row-major image of pixels of any size.
+     *
+     * @param[in] img the image to destagger, h * w pixels.
+     * @param[out] dest the destaggered image, which must not overlap img.
+     * @param[in] pixel_size the size of pixels in bytes.
+     */
+    void operator()(const void* img, void* dest, size_t pixel_size) const;
+
+    /** The height of the images. */
+    size_t h() const { return offsets_.size(); }
+
+    /** The width of the images. */
+    size_t w() const { return w_; }
+
+    /**
+     * Get the column a pixel of the first column of a row is moved to.
+     *
+     * @param[in] u the row.
+     *
+     * @return the shift of the row, in [0, w).
+     */
+    size_t offset(size_t u) const { return offsets_.at(u); }
+
+   private:
+    void copy_rows(const uint8_t* img, std::ptrdiff_t img_stride,
+                   uint8_t* dest, std::ptrdiff_t dest_stride,
+                   size_t pixel_size, size_t rows_begin,
+                   size_t rows_end) const;
+
+    size_t w_{0};
+    std::vector<size_t> offsets_{};
+};
 /** @}*/
+/**
+ * A pool of preallocated lidar scans of the same dimensions and fields.
+ *
+ * Scans are handed out as owning handles and go back to the pool when the
+ * handle is destroyed, so that scans can be passed between threads without
+ * copying or allocating new scans for every frame. Handles may outlive the
+ * pool. Thread-safe.
+ */
+class LidarScanPool {
+   public:
+    /** Returns a scan to the pool it was acquired from. */
+    struct Releaser {
+        std::shared_ptr<impl::ScanPoolState> pool;  ///< owning pool
+        void operator()(LidarScan* ls) const;       ///< release a scan
+    };
+
+    /** Owning handle to a pooled scan. */
+    using Handle = std::unique_ptr<LidarScan, Releaser>;
+
+    /**
+     * Create a pool of scans with the same dimensions and fields as prototype.
+     *
+     * @param[in] prototype scan to copy when allocating pooled scans.
+     * @param[in] size number of scans to preallocate.
+     */
+    LidarScanPool(const LidarScan& prototype, size_t size);
+
+    /**
+     * Create a pool of scans with fields for the given lidar profile.
+     *
+     * @param[in] w horizontal resolution, i.e. the number of measurements per
+     * scan.
+     * @param[in] h vertical resolution, i.e. the number of channels.
+     * @param[in] profile lidar profile.
+     * @param[in] size number of scans to preallocate.
+     */
+    LidarScanPool(size_t w, size_t h, sensor::UDPProfileLidar profile,
+                  size_t size);
+
+    /**
+     * Take a scan from the pool.
+     *
+     * If all scans are in use, a new one is allocated and added to the pool
+     * once released. The contents of the returned scan are not reset.
+     *
+     * @return a handle to the scan.
+     */
+    Handle acquire();
+
+    /**
+     * Get the number of scans currently available without allocation.
+     *
+     * @return the number of scans in the pool.
+     */
+    size_t available() const;
+
+   private:
+    std::shared_ptr<impl::ScanPoolState> state_;
+};
+
+/**
+ * Flags for ScanBatcher
+ */
+enum batcher_flags : uint8_t {
+    /**
+     * Don't zero the channel fields of columns missing from a scan. Missing
+     * columns are still marked invalid in LidarScan::status(), but their field
+     * data is left over from previous scans, and LidarScan::stale_columns()
+     * is set. Consumers such as cartesian() then check the status of each
+     * column.
+     */
+    BATCH_LAZY_ZERO = (1 << 0),
+    /** Don't populate the deprecated LidarScan::headers. */
+    BATCH_NO_BLOCK_HEADERS = (1 << 1),
+    /**
+     * Write channel fields destaggered, as they would be after destagger(),
+     * and set LidarScan::destaggered. Requires sensor metadata for the row
+     * shifts. Fields of missing columns are always zeroed, since they no
+     * longer line up with LidarScan::status().
+     */
+    BATCH_DESTAGGER = (1 << 2)
+};
+
+/**
+ * Counters of the packets added to a ScanBatcher since it was created.
+ */
+struct BatcherStats {
+    uint64_t packets{0};            ///< packets parsed into scans
+    uint64_t reordered_packets{0};  ///< late packets of a previous frame,
+                                    ///< dropped
+    uint64_t zeroed_cols{0};        ///< columns missing from scans
+    uint64_t scans{0};              ///< completed scans
+    uint64_t late_packets{0};  ///< packets of a previous frame batched within
+                               ///< the reorder window
+    uint64_t expired_scans{0};  ///< scans released before all columns of the
+                                ///< column window arrived
+};
+
+/**
+ * How long a ScanBatcher waits for reordered packets, see ScanBatcher.
+ */
+struct ReorderWindow {
+    /** The most scans batched at once, including the latest. */
+    size_t scans{2};
+    /**
+     * How long to wait for the missing packets of a scan once a packet of a
+     * later frame has arrived, in ns of the receive timestamps passed to the
+     * batcher.
+     */
+    uint64_t max_delay{5000000};
+};
+
 /**
  * Parse lidar packets into a LidarScan.
  *
  * Make a function that batches a single scan (revolution) of data to a
  * LidarScan.
+ *
+ * By default, a scan is completed as soon as a packet of the next frame
+ * arrives, and packets of earlier frames arriving after that are dropped.
+ * Given a ReorderWindow, the batcher instead fills several scans from a
+ * LidarScanPool at once. Scans are released in frame order as soon as all
+ * columns of the column window have arrived, when the window's delay has
+ * passed since a packet of a later frame arrived, or to make room for a new
+ * frame.
+ *
+ * Completed scans carry a ScanSummary counted while parsing, relative to the
+ * column window of the metadata, or the whole scan without metadata.
  */
 class ScanBatcher {
+    // a scan batched within the reorder window
+    struct InFlight {
+        LidarScanPool::Handle scan;
+        std::vector<uint8_t> seen;  // whether each column has arrived
+        std::ptrdiff_t n_seen;
+        uint64_t due;               // release time if incomplete
+    };
+
     std::ptrdiff_t w;
     std::ptrdiff_t h;
     uint16_t next_m_id;
     std::vector<uint8_t> cache;
     bool cached_packet = false;
+    uint64_t cache_rx_ts = 0;
+    std::vector<int> col_m_ids;
+    const impl::ScanBatcherKernel* kernel;
+    uint8_t flags;
+    LidarScanPool::Handle pooled;
+    Destaggerer destagger;
+    std::vector<uint64_t> staging;
+    std::vector<int> staging_ids;
+    BatcherStats counters;
+
+    // scan summary state
+    sensor::ColumnWindow column_window;
+    std::vector<uint8_t> seen_cols;  // columns of the scan being batched
+    std::vector<int> new_cols;       // columns first seen in a packet
+
+    // reorder window state
+    bool reorder{false};
+    ReorderWindow window;
+    std::ptrdiff_t window_cols;
+    std::deque<InFlight> in_flight;
+    std::deque<LidarScanPool::Handle> ready;
+    bool released_any{false};
+    uint16_t last_released{0};
+
+    void zero_cols(LidarScan& ls, std::ptrdiff_t start, std::ptrdiff_t end);
+    void parse(const uint8_t* packet_buf, LidarScan& ls, uint64_t rx_ts,
+               InFlight* slot);
+    void start_scan(LidarScan& ls);
+    void finish_scan(LidarScan& ls);
+    void release_front();
+    LidarScanPool::Handle reorder_packet(const uint8_t* packet_buf,
+                                         LidarScanPool& pool, uint64_t rx_ts);
 
    public:
     sensor::packet_format pf;  ///< The packet format object used for decoding
@@ -477,25 +1379,98 @@ class ScanBatcher {
      * @param[in] w number of columns in the lidar scan. One of 512, 1024, or
      * 2048.
      * @param[in] pf expected format of the incoming packets used for parsing.
+     * @param[in] flags batcher_flags controlling how scans are populated.
+     *
+     * @throw std::invalid_argument if flags include BATCH_DESTAGGER.
      */
-    ScanBatcher(size_t w, const sensor::packet_format& pf);
+    ScanBatcher(size_t w, const sensor::packet_format& pf, uint8_t flags = 0);
 
     /**
      * Create a batcher given information about the scan and packet format.
      *
      * @param[in] info sensor metadata returned from the client.
+     * @param[in] flags batcher_flags controlling how scans are populated.
+     *
+     * @throw std::invalid_argument if flags include BATCH_DESTAGGER and the
+     * metadata doesn't have a pixel shift for each row.
      */
-    ScanBatcher(const sensor::sensor_info& info);
+    ScanBatcher(const sensor::sensor_info& info, uint8_t flags = 0);
+
+    /**
+     * Create a batcher tolerating reordered packets across frames.
+     *
+     * Scans are batched from a pool only; adding packets to a single scan
+     * throws.
+     *
+     * @param[in] info sensor metadata returned from the client, the column
+     * window of which determines when scans are complete.
+     * @param[in] window how long to wait for reordered packets.
+     * @param[in] flags batcher_flags controlling how scans are populated.
+     *
+     * @throw std::invalid_argument if the window holds no scans, or for the
+     * same reasons as the constructor without a window.
+     */
+    ScanBatcher(const sensor::sensor_info& info, const ReorderWindow& window,
+                uint8_t flags = 0);
 
     /**
      * Add a packet to the scan.
      *
      * @param[in] packet_buf the lidar packet.
      * @param[in] ls lidar scan to populate.
+     * @param[in] rx_ts host receive timestamp of the packet, stored in
+     * LidarScan::rx_timestamp() for each of its valid columns.
      *
      * @return true when the provided lidar scan is ready to use.
+     *
+     * @throw std::invalid_argument if the batcher has a reorder window.
+     */
+    bool operator()(const uint8_t* packet_buf, LidarScan& ls,
+                    uint64_t rx_ts = 0);
+
+    /**
+     * Add a packet to a scan taken from a pool.
+     *
+     * Packets are batched into a scan acquired from the pool. Once it is
+     * complete, the scan is handed off to the caller and batching continues
+     * with a recycled scan, so the returned scan stays valid for as long as
+     * the caller holds on to it.
+     *
+     * @param[in] packet_buf the lidar packet.
+     * @param[in] pool pool of scans to batch into. Should be the same on
+     * every call.
+     * @param[in] rx_ts host receive timestamp of the packet.
+     *
+     * @return the completed scan, or an empty handle if no scan is ready.
+     * With a reorder window, more scans may be ready at once; get them with
+     * release().
+     */
+    LidarScanPool::Handle operator()(const uint8_t* packet_buf,
+                                     LidarScanPool& pool, uint64_t rx_ts = 0);
+
+    /**
+     * Get the next scan ready at a given time, with a reorder window.
+     *
+     * Call after adding a packet until no scan is returned, and periodically
+     * when no packets arrive. Without a reorder window, no scan is ever
+     * returned.
+     *
+     * @param[in] now the current time, on the clock of the receive
+     * timestamps. The default releases the oldest scan being batched
+     * regardless, e.g. at the end of a stream.
+     *
+     * @return the scan, or an empty handle if no scan is ready.
+     */
+    LidarScanPool::Handle release(
+        uint64_t now = std::numeric_limits<uint64_t>::max());
+
+    /**
+     * Get the packet counters of the batcher. Cheap enough to check after
+     * every scan; counts per scan are the differences between snapshots.
+     *
+     * @return the counters since the batcher was created.
      */
-    bool operator()(const uint8_t* packet_buf, LidarScan& ls);
+    const BatcherStats& stats() const { return counters; }
 };
 
 }  // namespace ouster
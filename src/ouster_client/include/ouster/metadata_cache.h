@@ -0,0 +1,146 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Compact binary sensor metadata, and an on disk cache of it
+ *
+ * Parsing the metadata json takes about a millisecond, fetching it from a
+ * sensor several http round trips, and computing the lookup table of
+ * make_xyz_lut() tens of milliseconds for high resolution sensors. The cache
+ * keeps all three ready to load, so that restarting a driver or replaying a
+ * recording doesn't have to redo them.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace sensor {
+
+/**
+ * Serialize sensor metadata in a compact, versioned binary format, in host
+ * byte order.
+ *
+ * @param[in] info sensor metadata.
+ *
+ * @return the serialized metadata.
+ */
+std::vector<uint8_t> to_binary(const sensor_info& info);
+
+/**
+ * Parse sensor metadata serialized by to_binary().
+ *
+ * @throw std::runtime_error if the data is truncated or was serialized by an
+ * incompatible version.
+ *
+ * @param[in] buf the serialized metadata.
+ * @param[in] size size of the buffer in bytes.
+ *
+ * @return the sensor metadata.
+ */
+sensor_info sensor_info_from_binary(const uint8_t* buf, size_t size);
+
+/**
+ * Sensor metadata cached in a directory, one file per entry.
+ *
+ * Entries of sensors are keyed by serial number, firmware and lidar mode (see
+ * key()), and carry a hash of what they were derived from, typically the
+ * sensor config, to tell whether they are stale. Writing entries is atomic,
+ * so a cache may be shared by processes.
+ */
+class MetadataCache {
+   public:
+    /** A cache entry. */
+    struct Entry {
+        std::string hash;      ///< hash of what the metadata was derived from
+        std::string metadata;  ///< metadata json, as from get_metadata()
+        sensor_info info;      ///< the parsed metadata
+        optional<XYZLut> lut;  ///< lookup table of the metadata, if cached
+    };
+
+    /**
+     * Use a directory as cache, creating it if necessary when storing.
+     *
+     * @param[in] dir path of the directory.
+     */
+    explicit MetadataCache(const std::string& dir);
+
+    /**
+     * Get the cache key of a sensor.
+     *
+     * @param[in] sn serial number of the sensor.
+     * @param[in] fw_rev firmware revision of the sensor.
+     * @param[in] mode lidar mode of the sensor, as a string.
+     *
+     * @return the key, which is a valid file name.
+     */
+    static std::string key(const std::string& sn, const std::string& fw_rev,
+                           const std::string& mode);
+
+    /**
+     * Hash data, e.g. a sensor config, to tell whether an entry is stale.
+     *
+     * @param[in] data the data to hash.
+     *
+     * @return the hash as a hex string.
+     */
+    static std::string hash(const std::string& data);
+
+    /**
+     * Load an entry.
+     *
+     * @param[in] key the key of the entry.
+     *
+     * @return the entry, or nothing if it's missing, corrupt or was stored by
+     * an incompatible version.
+     */
+    optional<Entry> load(const std::string& key) const;
+
+    /**
+     * Store an entry, replacing any entry of the same key.
+     *
+     * @throw std::runtime_error if the entry can't be written.
+     *
+     * @param[in] key the key of the entry.
+     * @param[in] entry the entry.
+     */
+    void store(const std::string& key, const Entry& entry) const;
+
+    /**
+     * Read a metadata json file through the cache.
+     *
+     * Files are keyed by a hash of their contents; on a miss the file is
+     * parsed and cached, without failing if the cache isn't writable.
+     *
+     * @throw std::runtime_error if the file can't be read or parsed.
+     *
+     * @param[in] json_file path of the metadata json file.
+     * @param[in] with_lut whether the entry should hold the lookup table.
+     *
+     * @return the entry of the file.
+     */
+    Entry load_json(const std::string& json_file, bool with_lut = false) const;
+
+    /**
+     * Get the directory of the cache.
+     *
+     * @return the path of the directory.
+     */
+    const std::string& dir() const;
+
+   private:
+    std::string path(const std::string& key) const;
+
+    std::string dir_;
+};
+
+}  // namespace sensor
+}  // namespace ouster
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Hand the packets of one client to several consumers in a process
+ *
+ * A PacketFanout reads the lidar and imu sockets of a client on a thread of
+ * its own and calls every registered handler with each packet, by reference
+ * to a single receive buffer, so that consumers in the same process share one
+ * receive instead of forwarding copies to each other. To share a stream
+ * between processes, have the sensor send to a multicast group instead, see
+ * join_multicast().
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "ouster/client.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace sensor {
+
+/**
+ * Called on the receive thread of a PacketFanout with each packet.
+ *
+ * The state is LIDAR_DATA or IMU_DATA. The packet is only valid for the
+ * duration of the call, and is shared with the other handlers, which are
+ * called in the order they were added, so handlers should copy what they
+ * need and return quickly rather than block. The receive timestamp is zero
+ * for imu packets.
+ */
+using PacketHandler =
+    std::function<void(client_state state, const uint8_t* buf, uint64_t rx_ts)>;
+
+/** Counters of the packets handed to the handlers of a PacketFanout. */
+struct FanoutStats {
+    uint64_t lidar_packets;  ///< lidar packets received
+    uint64_t imu_packets;    ///< imu packets received
+};
+
+/**
+ * Receives the data of a client on one thread for several handlers.
+ *
+ * Handlers are added before the fanout is started, after which the client
+ * must only be read by the fanout.
+ */
+class PacketFanout {
+   public:
+    /**
+     * Prepare to receive the data of a client, without starting a thread.
+     *
+     * @throw std::invalid_argument if the client is null.
+     *
+     * @param[in] cli client returned by init_client.
+     * @param[in] pf the packet format of the sensor.
+     */
+    PacketFanout(std::shared_ptr<client> cli, const packet_format& pf);
+
+    /** Stops the receive thread. */
+    ~PacketFanout();
+
+    PacketFanout(const PacketFanout&) = delete;
+    PacketFanout& operator=(const PacketFanout&) = delete;
+
+    /**
+     * Add a handler. Must be called before start().
+     *
+     * @throw std::invalid_argument if the handler is empty or the fanout is
+     * running.
+     *
+     * @param[in] handler callback for each packet.
+     *
+     * @return the number of handlers added so far.
+     */
+    size_t add_handler(PacketHandler handler);
+
+    /** Start the receive thread. Not an error if already running. */
+    void start();
+
+    /** Stop and join the receive thread. Not an error if not running. */
+    void stop();
+
+    /**
+     * Get the packet counters.
+     *
+     * @return a snapshot of the counters.
+     */
+    FanoutStats stats() const;
+
+   private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace sensor
+}  // namespace ouster
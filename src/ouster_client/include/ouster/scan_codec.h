@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Lossless compression of LidarScan fields
+ *
+ * Fields are compressed as destaggered images, where neighbouring pixels are
+ * strongly correlated. Each row is predicted from its left neighbours, the
+ * previous row or both, choosing whichever predicts the row best, and the
+ * prediction residuals are Rice coded in blocks of 32 pixels. Column headers
+ * and the frame id are stored as is.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+
+/**
+ * Encode and decode the fields of scans of a sensor.
+ *
+ * Encoded scans hold their dimensions and field types and can be decoded by
+ * any codec configured with the same pixel shifts.
+ */
+class ScanCodec {
+   public:
+    /**
+     * Configure a codec with the pixel shifts of a sensor.
+     *
+     * @param[in] info The sensor metadata.
+     */
+    explicit ScanCodec(const sensor::sensor_info& info);
+
+    /**
+     * Configure a codec with pixel shifts, as passed to destagger().
+     *
+     * @param[in] pixel_shift_by_row The shift of each row of scans.
+     */
+    explicit ScanCodec(std::vector<int> pixel_shift_by_row);
+
+    /**
+     * Encode fields and column headers of a scan.
+     *
+     * @throw std::invalid_argument if the scan doesn't have h rows or lacks
+     * one of the fields.
+     *
+     * @param[in] scan The scan to encode.
+     * @param[in] fields The fields to encode, in order.
+     * @param[out] out The encoded scan, replacing previous contents.
+     */
+    void encode(const LidarScan& scan,
+                const std::vector<sensor::ChanField>& fields,
+                std::vector<uint8_t>& out) const;
+
+    /** @copydoc encode() */
+    std::vector<uint8_t> encode(
+        const LidarScan& scan,
+        const std::vector<sensor::ChanField>& fields) const;
+
+    /**
+     * Decode a scan. Fields of the scan that weren't encoded are left as is.
+     * If the scan doesn't have the encoded dimensions or one of the encoded
+     * fields with the same type, it's replaced by a scan with only the
+     * encoded fields.
+     *
+     * @throw std::invalid_argument if the data isn't a valid encoded scan for
+     * the pixel shifts of the codec.
+     *
+     * @param[in] data The encoded scan.
+     * @param[in] size The size of the encoded scan in bytes.
+     * @param[out] scan The decoded scan.
+     */
+    void decode(const uint8_t* data, size_t size, LidarScan& scan) const;
+
+   private:
+    std::vector<int> pixel_shift_by_row_;
+};
+
+}  // namespace ouster
@@ -0,0 +1,211 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Publish lidar scans to other processes on the same host through
+ * shared memory
+ *
+ * A publisher owns a named shared memory segment holding the sensor metadata
+ * and a ring of slots, each laid out as the arena of a LidarScan (see
+ * LidarScan::arena()). Publishing copies a scan into the next slot once,
+ * however many processes subscribe. Subscribers view slots in place, without
+ * copying, and never block the publisher: a slot is guarded by a sequence
+ * number which the publisher bumps before and after writing it, so readers
+ * can tell whether what they read was overwritten in the meantime.
+ *
+ * Only supported on POSIX systems.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+
+namespace impl {
+struct ShmSegment;
+}  // namespace impl
+
+/**
+ * Publishes scans of a sensor in a shared memory segment.
+ *
+ * The segment is created, or replaced if left over from a previous publisher,
+ * on construction and removed on destruction. Not thread safe: scans must be
+ * published from one thread at a time.
+ */
+class ScanShmPublisher {
+   public:
+    /**
+     * Create a segment for scans with the default fields of the lidar profile
+     * of the sensor.
+     *
+     * @throw std::runtime_error if the segment can't be created.
+     *
+     * @param[in] name name of the segment, for subscribers to open.
+     * @param[in] info sensor metadata, published to subscribers.
+     * @param[in] n_slots number of scans kept, which bounds how long
+     * subscribers may hold on to a view.
+     */
+    ScanShmPublisher(const std::string& name, const sensor::sensor_info& info,
+                     size_t n_slots = 8);
+
+    /**
+     * Create a segment for scans with the dimensions and fields of a
+     * prototype.
+     *
+     * @throw std::runtime_error if the segment can't be created.
+     *
+     * @param[in] name name of the segment, for subscribers to open.
+     * @param[in] info sensor metadata, published to subscribers.
+     * @param[in] prototype scan with the dimensions and fields to publish.
+     * @param[in] n_slots number of scans kept.
+     */
+    ScanShmPublisher(const std::string& name, const sensor::sensor_info& info,
+                     const LidarScan& prototype, size_t n_slots = 8);
+
+    /** Remove the segment, telling subscribers that publishing stopped. */
+    ~ScanShmPublisher();
+
+    ScanShmPublisher(const ScanShmPublisher&) = delete;
+    ScanShmPublisher& operator=(const ScanShmPublisher&) = delete;
+
+    /**
+     * Copy a scan into the next slot and wake up waiting subscribers.
+     *
+     * @throw std::invalid_argument if the scan has other dimensions or fields
+     * than the segment.
+     *
+     * @param[in] scan the scan to publish.
+     *
+     * @return the sequence number of the scan, starting at 1.
+     */
+    uint64_t publish(const LidarScan& scan);
+
+    /**
+     * Get the number of scans published so far.
+     *
+     * @return the sequence number of the last published scan.
+     */
+    uint64_t published() const;
+
+    /**
+     * Get the number of scans kept in the segment.
+     *
+     * @return the number of slots.
+     */
+    size_t n_slots() const;
+
+   private:
+    void create(const std::string& name, const sensor::sensor_info& info,
+                const LidarScan& prototype, size_t n_slots);
+
+    std::unique_ptr<impl::ShmSegment> shm_;
+    LidarScan prototype_;
+};
+
+/**
+ * Reads the scans of a shared memory segment created by a ScanShmPublisher.
+ *
+ * Scans are returned in the order they were published. A slow subscriber
+ * skips ahead when the scans it hasn't read yet are about to be overwritten,
+ * counting them as dropped. Not thread safe.
+ */
+class ScanShmSubscriber {
+   public:
+    /**
+     * Open a segment.
+     *
+     * @throw std::runtime_error if there is no such segment, or it wasn't
+     * created by a compatible publisher.
+     *
+     * @param[in] name name of the segment.
+     */
+    explicit ScanShmSubscriber(const std::string& name);
+
+    ~ScanShmSubscriber();
+
+    ScanShmSubscriber(const ScanShmSubscriber&) = delete;
+    ScanShmSubscriber& operator=(const ScanShmSubscriber&) = delete;
+
+    /**
+     * Get the metadata of the sensor, as published.
+     *
+     * @return sensor metadata.
+     */
+    const sensor::sensor_info& info() const;
+
+    /**
+     * Wait for the next scan and view it in place.
+     *
+     * The view is read-only and only stays intact until the publisher wraps
+     * around the ring and overwrites its slot; check valid() after using it.
+     * The deprecated LidarScan::headers aren't published.
+     *
+     * @param[in] timeout_sec how long to wait for a scan.
+     *
+     * @return the scan, or nullptr on timeout or once the publisher is gone.
+     */
+    const LidarScan* next(float timeout_sec = 1.0);
+
+    /**
+     * Wait for the next scan and copy it.
+     *
+     * Unlike next(), the copy is checked and retried, so it's never torn.
+     * Assigning to a scan of the same dimensions and fields doesn't allocate.
+     *
+     * @param[out] scan the scan to copy into.
+     * @param[in] timeout_sec how long to wait for a scan.
+     *
+     * @return false on timeout or once the publisher is gone.
+     */
+    bool read(LidarScan& scan, float timeout_sec = 1.0);
+
+    /**
+     * Check that the scan last returned by next() hasn't been overwritten.
+     *
+     * @return whether the view was intact up to this call.
+     */
+    bool valid() const;
+
+    /**
+     * Get the sequence number of the scan last returned.
+     *
+     * @return the sequence number, or 0 if none was returned yet.
+     */
+    uint64_t seq() const;
+
+    /**
+     * Get the number of scans skipped because they were overwritten before
+     * being read.
+     *
+     * @return the number of dropped scans.
+     */
+    uint64_t dropped() const;
+
+    /**
+     * Whether the publisher removed the segment.
+     *
+     * @return true once no more scans will be published.
+     */
+    bool closed() const;
+
+   private:
+    // wait until a scan newer than seq_ is published
+    bool wait(float timeout_sec);
+
+    std::unique_ptr<impl::ShmSegment> shm_;
+    sensor::sensor_info info_;
+    std::vector<LidarScan> views_;
+    uint64_t seq_{0};
+    uint64_t dropped_{0};
+};
+
+}  // namespace ouster
@@ -0,0 +1,184 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Stream compressed scans over TCP to remote consumers
+ *
+ * A ScanStreamServer encodes selected fields of each scan with a ScanCodec,
+ * optionally cropped to a region of the scan and with ranges quantized, and
+ * sends them to every connected ScanStreamClient, which decodes them back
+ * into LidarScans. Every encoded frame stands on its own, so clients joining
+ * or falling behind resume with the next frame.
+ *
+ * A stream starts with a header carrying the sensor metadata, the region and
+ * the range quantization, followed by one message per frame. Messages are
+ * prefixed with their size and, like encoded scans, in host byte order.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+
+/** What a ScanStreamServer sends of each scan. */
+struct StreamConfig {
+    /** The fields to send. */
+    std::vector<sensor::ChanField> fields{sensor::ChanField::RANGE,
+                                          sensor::ChanField::REFLECTIVITY};
+
+    /**
+     * The pixels to send, e.g. from make_scan_region() to decimate scans or
+     * keep a sector only. Empty to send whole scans.
+     */
+    ScanRegion region{};
+
+    /**
+     * Ranges are rounded to multiples of this step, in mm, making them much
+     * cheaper to encode. One keeps ranges exact.
+     */
+    uint32_t range_step{1};
+
+    /** Frames queued for a client before new frames are dropped for it. */
+    size_t max_pending{2};
+};
+
+/** Counters of a ScanStreamServer. */
+struct StreamStats {
+    uint64_t frames;          ///< frames encoded
+    uint64_t bytes;           ///< bytes of frames queued, summed over clients
+    uint64_t dropped_frames;  ///< frames dropped for clients falling behind
+    size_t clients;           ///< clients currently connected
+};
+
+/**
+ * Sends the scans of a sensor to any number of TCP clients.
+ *
+ * Scans are encoded on the thread calling send(); connections are accepted
+ * and written to on a thread of the server, without blocking send().
+ */
+class ScanStreamServer {
+   public:
+    /**
+     * Listen for clients and start the server thread.
+     *
+     * @throw std::invalid_argument if the region is out of the scans, there
+     * are no fields, or the range step or max pending frames are zero.
+     * @throw std::runtime_error if the port can't be bound.
+     *
+     * @param[in] info sensor metadata, sent to clients.
+     * @param[in] port TCP port to listen on, or zero for a port picked by the
+     * OS; see port().
+     * @param[in] config what to send of each scan.
+     */
+    ScanStreamServer(const sensor::sensor_info& info, int port = 0,
+                     const StreamConfig& config = {});
+
+    /** Stop the server thread and close all connections. */
+    ~ScanStreamServer();
+
+    ScanStreamServer(const ScanStreamServer&) = delete;
+    ScanStreamServer& operator=(const ScanStreamServer&) = delete;
+
+    /**
+     * Get the port the server listens on.
+     *
+     * @return the bound port number.
+     */
+    int port() const;
+
+    /**
+     * Encode a scan and queue it for all connected clients.
+     *
+     * @throw std::invalid_argument if the scan doesn't match the dimensions
+     * of the sensor or lacks one of the fields.
+     *
+     * @param[in] scan a staggered scan of the sensor.
+     *
+     * @return the number of clients the frame was queued for.
+     */
+    size_t send(const LidarScan& scan);
+
+    /**
+     * Get the counters of the server.
+     *
+     * @return a snapshot of the counters.
+     */
+    StreamStats stats() const;
+
+   private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+/**
+ * Receives and decodes the scans sent by a ScanStreamServer.
+ *
+ * Decoded scans have the dimensions of the region sent, with the pixel of
+ * row region().rows[j] and column region().cols[k] of the sensor's scan at
+ * (j, k), and only the fields sent.
+ */
+class ScanStreamClient {
+   public:
+    /**
+     * Connect to a server and read the stream header.
+     *
+     * @throw std::runtime_error if the server can't be reached, or doesn't
+     * send a valid header within the timeout.
+     *
+     * @param[in] host hostname or ip of the server.
+     * @param[in] port TCP port of the server.
+     * @param[in] timeout_sec how long to wait for the header.
+     */
+    ScanStreamClient(const std::string& host, int port,
+                     float timeout_sec = 5.0f);
+
+    /** Close the connection. */
+    ~ScanStreamClient();
+
+    ScanStreamClient(const ScanStreamClient&) = delete;
+    ScanStreamClient& operator=(const ScanStreamClient&) = delete;
+
+    /**
+     * Get the metadata of the sensor the scans come from.
+     *
+     * @return the metadata sent by the server.
+     */
+    const sensor::sensor_info& metadata() const;
+
+    /**
+     * Get the pixels of the sensor's scans that are sent.
+     *
+     * @return the region of each scan.
+     */
+    const ScanRegion& region() const;
+
+    /**
+     * Read the next scan.
+     *
+     * @throw std::runtime_error if the connection was closed or the data is
+     * invalid.
+     *
+     * @param[out] scan the decoded scan, reallocated only if its dimensions
+     * or fields don't match the stream.
+     * @param[in] timeout_sec how long to wait for a frame, forever if
+     * negative.
+     *
+     * @return false if no frame arrived within the timeout.
+     */
+    bool read(LidarScan& scan, float timeout_sec = 1.0f);
+
+   private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace ouster
@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Ground removal and clustering on the structured images of LidarScan
+ *
+ * Pixels of a column of a destaggered range image share an azimuth and are
+ * ordered by elevation, so ground can be followed up each column from the
+ * lowest beam, and objects found as connected components of neighbouring
+ * pixels, without building a point cloud or a search tree. As with filters,
+ * staggered images are handled given the pixel shifts of the sensor, and
+ * columns wrap around.
+ *
+ * Points are computed from ranges with the lookup tables of make_xyz_lut()
+ * in the layout of the images, and positions and heights are in the units
+ * and frame of the tables: meters in the sensor frame for tables made from
+ * sensor metadata. Work is split between threads by blocks of columns.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace segmentation {
+
+/** How ground is followed up the columns of a range image. */
+struct GroundParams {
+    /**
+     * Ground starts at the lowest return of a column with a height at most
+     * this, e.g. a little above minus the mounting height of the sensor.
+     */
+    double max_start_z{-0.3};
+
+    /** The steepest slope between consecutive ground points of a column. */
+    double max_slope_deg{10.0};
+};
+
+/** How pixels are joined into clusters. */
+struct ClusterParams {
+    /**
+     * Neighbouring returns are joined when the angle at the farther one,
+     * between its line of sight and the line to the nearer one, is at least
+     * this: surfaces seen edge-on or gaps in depth split clusters, whatever
+     * the range.
+     */
+    double min_angle_deg{10.0};
+
+    /** Clusters with fewer pixels are left unlabeled. */
+    size_t min_points{10};
+};
+
+/**
+ * Mark ground pixels of a range image.
+ *
+ * Each column is walked up from the lowest beam. The first return no higher
+ * than GroundParams::max_start_z is ground, and so is every later return
+ * farther out than the last ground point and within the maximum slope of it.
+ * Pixels without a return are never marked.
+ *
+ * @throw std::invalid_argument if the images and lookup tables have
+ * different dimensions or there are pixel shifts for a different number of
+ * rows.
+ *
+ * @param[in] range the range image.
+ * @param[in] lut lookup tables generated by make_xyz_lut for the layout of
+ * the range image.
+ * @param[in] params how ground is followed.
+ * @param[in,out] mask the mask to set bits in, as with filters.
+ * @param[in] bit the bits to set.
+ * @param[in] pixel_shift_by_row offsets of a staggered image, or empty.
+ * @param[in] n_threads the number of threads to split columns between,
+ * including the calling thread.
+ */
+void ground_mask(const Eigen::Ref<const img_t<uint32_t>>& range,
+                 const XYZLut& lut, const GroundParams& params,
+                 Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit = 1,
+                 const std::vector<int>& pixel_shift_by_row = {},
+                 int n_threads = 1);
+
+/**
+ * Label connected components of a range image.
+ *
+ * Pixels are joined to their neighbours in the same row and, at the same
+ * azimuth, in the rows above and below, as set by ClusterParams. Clusters are
+ * labeled from 1, largest first, with ties broken by their first pixel.
+ * Pixels without a return, excluded by the mask or in small clusters are 0.
+ *
+ * @throw std::invalid_argument if the images and lookup tables have
+ * different dimensions or there are pixel shifts for a different number of
+ * rows.
+ *
+ * @param[in] range the range image.
+ * @param[in] lut lookup tables generated by make_xyz_lut for the layout of
+ * the range image.
+ * @param[in] params how pixels are joined.
+ * @param[out] labels the cluster of each pixel.
+ * @param[in] mask pixels to leave out, e.g. from ground_mask().
+ * @param[in] bits the bits of the mask selecting pixels to leave out.
+ * @param[in] pixel_shift_by_row offsets of a staggered image, or empty.
+ * @param[in] n_threads the number of threads to split columns between,
+ * including the calling thread.
+ *
+ * @return the number of clusters.
+ */
+size_t cluster(const Eigen::Ref<const img_t<uint32_t>>& range,
+               const XYZLut& lut, const ClusterParams& params,
+               Eigen::Ref<img_t<uint32_t>> labels,
+               const Eigen::Ref<const img_t<uint8_t>>& mask,
+               uint8_t bits = 0xff,
+               const std::vector<int>& pixel_shift_by_row = {},
+               int n_threads = 1);
+
+/**
+ * Remove the ground of a scan and cluster the rest, writing the results to
+ * custom fields of the scan.
+ *
+ * The ground field is set to 1 for ground pixels and 0 elsewhere. Clusters
+ * with labels too large for the type of the label field are written as 0.
+ *
+ * @throw std::invalid_argument if the fields aren't custom fields, or for the
+ * same reasons as above.
+ * @throw std::out_of_range if the scan doesn't have the RANGE field or one of
+ * the custom fields.
+ *
+ * @param[in,out] scan the scan to segment, staggered or destaggered.
+ * @param[in] lut lookup tables generated by make_xyz_lut for the layout of
+ * the scan.
+ * @param[in] ground how ground is followed.
+ * @param[in] clusters how pixels are joined.
+ * @param[in] ground_field the custom field to write ground to.
+ * @param[in] label_field the custom field to write cluster labels to.
+ * @param[in] pixel_shift_by_row offsets of the sensor, ignored if the scan
+ * is destaggered.
+ * @param[in] n_threads the number of threads to split columns between.
+ *
+ * @return the number of clusters.
+ */
+size_t segment(LidarScan& scan, const XYZLut& lut, const GroundParams& ground,
+               const ClusterParams& clusters, sensor::ChanField ground_field,
+               sensor::ChanField label_field,
+               const std::vector<int>& pixel_shift_by_row,
+               int n_threads = 1);
+
+}  // namespace segmentation
+}  // namespace ouster
@@ -0,0 +1,252 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Optional tracing of the hot paths of the SDK
+ *
+ * Hot paths are instrumented with OUSTER_TRACE_SCOPE() spans and
+ * OUSTER_TRACE_COUNTER() values, which compile to nothing unless the SDK is
+ * built with OUSTER_TRACING. When built with tracing, spans and counters are
+ * handed to the sink installed with trace::set_sink(), if any, and skipped
+ * with a single atomic load otherwise.
+ *
+ * RingSink keeps recent events and per-name statistics in memory and
+ * ChromeTraceSink writes the Chrome trace event format, which chrome://tracing
+ * and Perfetto open. Other profilers, e.g. Tracy, can be fed by implementing
+ * Sink.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ouster {
+namespace trace {
+
+/**
+ * Receives the spans and counters of instrumented code.
+ *
+ * Called concurrently from the threads running instrumented code, so
+ * implementations must be thread safe and should be quick. Names are string
+ * literals and outlive the sink.
+ */
+class Sink {
+   public:
+    virtual ~Sink() = default;
+
+    /**
+     * Report a span of time spent in a scope.
+     *
+     * @param[in] name the name of the scope.
+     * @param[in] start_ns start of the span, see now_ns().
+     * @param[in] end_ns end of the span.
+     * @param[in] thread the thread, see thread_id().
+     */
+    virtual void span(const char* name, uint64_t start_ns, uint64_t end_ns,
+                      uint32_t thread) = 0;
+
+    /**
+     * Report the value of a counter.
+     *
+     * @param[in] name the name of the counter.
+     * @param[in] value the value.
+     * @param[in] ts_ns when the value was reported, see now_ns().
+     * @param[in] thread the thread, see thread_id().
+     */
+    virtual void counter(const char* name, int64_t value, uint64_t ts_ns,
+                         uint32_t thread) = 0;
+};
+
+namespace impl {
+extern std::atomic<Sink*> current_sink;
+}  // namespace impl
+
+/**
+ * Install the sink receiving spans and counters.
+ *
+ * The sink isn't owned and must stay alive while instrumented code can run
+ * after it's replaced: spans started before replacing it are reported to it
+ * when they end.
+ *
+ * @param[in] sink the sink, or nullptr to stop tracing.
+ */
+void set_sink(Sink* sink);
+
+/**
+ * Get the sink receiving spans and counters.
+ *
+ * @return the sink, or nullptr if none is installed.
+ */
+inline Sink* sink() {
+    return impl::current_sink.load(std::memory_order_acquire);
+}
+
+/**
+ * Get the time used for events.
+ *
+ * @return nanoseconds of a monotonic clock.
+ */
+uint64_t now_ns();
+
+/**
+ * Get a small number identifying the calling thread in events.
+ *
+ * @return the number, assigned in the order threads first ask.
+ */
+uint32_t thread_id();
+
+/**
+ * Report the value of a counter to the sink, if any.
+ *
+ * @param[in] name the name of the counter, a string literal.
+ * @param[in] value the value.
+ */
+inline void count(const char* name, int64_t value) {
+    if (auto s = sink()) s->counter(name, value, now_ns(), thread_id());
+}
+
+/** Reports the time from its construction to its destruction as a span. */
+class Scope {
+    const char* name_;
+    Sink* sink_;
+    uint64_t start_ns_{0};
+
+   public:
+    /**
+     * Start a span, if a sink is installed.
+     *
+     * @param[in] name the name of the span, a string literal.
+     */
+    explicit Scope(const char* name) : name_{name}, sink_{sink()} {
+        if (sink_) start_ns_ = now_ns();
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope() {
+        if (sink_) sink_->span(name_, start_ns_, now_ns(), thread_id());
+    }
+};
+
+/**
+ * Keeps the last events in memory, and statistics of all events since the
+ * last clear().
+ */
+class RingSink : public Sink {
+   public:
+    /** An event, as reported to the sink. */
+    struct Event {
+        const char* name;  ///< the name of the span or counter
+        uint64_t start_ns;  ///< start of the span, or time of the value
+        uint64_t end_ns;    ///< end of the span, or time of the value
+        int64_t value;      ///< value of the counter, 0 for spans
+        uint32_t thread;    ///< the reporting thread
+        bool is_counter;    ///< whether the event is a counter value
+    };
+
+    /** Statistics of the events of a name. */
+    struct Stats {
+        uint64_t count{0};     ///< the number of events
+        uint64_t total_ns{0};  ///< total duration of spans
+        uint64_t max_ns{0};    ///< longest span
+        int64_t last_value{0};  ///< last value of counters
+    };
+
+    /**
+     * @param[in] capacity the number of events kept.
+     */
+    explicit RingSink(size_t capacity = 65536);
+
+    void span(const char* name, uint64_t start_ns, uint64_t end_ns,
+              uint32_t thread) override;
+
+    void counter(const char* name, int64_t value, uint64_t ts_ns,
+                 uint32_t thread) override;
+
+    /**
+     * Get the events kept.
+     *
+     * @return up to capacity events, oldest first.
+     */
+    std::vector<Event> events() const;
+
+    /**
+     * Get the statistics of all events since the last clear().
+     *
+     * @return statistics by name.
+     */
+    std::map<std::string, Stats> stats() const;
+
+    /** Drop events and statistics. */
+    void clear();
+
+   private:
+    void add(const Event& e);
+
+    mutable std::mutex mtx_;
+    std::vector<Event> ring_;
+    size_t capacity_;
+    size_t next_{0};
+    std::unordered_map<const char*, Stats> stats_;
+};
+
+/**
+ * Writes events to a file in the Chrome trace event format, as they're
+ * reported. The file is complete once the sink is destroyed.
+ */
+class ChromeTraceSink : public Sink {
+   public:
+    /**
+     * Open the file to write.
+     *
+     * @throw std::runtime_error if the file can't be opened.
+     *
+     * @param[in] path the file.
+     */
+    explicit ChromeTraceSink(const std::string& path);
+
+    /** Finish and close the file. */
+    ~ChromeTraceSink() override;
+
+    void span(const char* name, uint64_t start_ns, uint64_t end_ns,
+              uint32_t thread) override;
+
+    void counter(const char* name, int64_t value, uint64_t ts_ns,
+                 uint32_t thread) override;
+
+   private:
+    std::mutex mtx_;
+    std::ofstream out_;
+    bool first_{true};
+};
+
+}  // namespace trace
+}  // namespace ouster
+
+#define OUSTER_TRACE_CONCAT_(a, b) a##b
+#define OUSTER_TRACE_CONCAT(a, b) OUSTER_TRACE_CONCAT_(a, b)
+
+#ifdef OUSTER_TRACING
+/** Report the rest of the enclosing scope as a span named name. */
+#define OUSTER_TRACE_SCOPE(name)                                   \
+    ::ouster::trace::Scope OUSTER_TRACE_CONCAT(ouster_trace_scope_, \
+                                               __LINE__) {         \
+        name                                                       \
+    }
+/** Report the value of the counter named name. */
+#define OUSTER_TRACE_COUNTER(name, value) \
+    ::ouster::trace::count(name, static_cast<int64_t>(value))
+#else
+#define OUSTER_TRACE_SCOPE(name) static_cast<void>(0)
+#define OUSTER_TRACE_COUNTER(name, value) static_cast<void>(0)
+#endif
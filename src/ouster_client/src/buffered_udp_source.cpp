@@ -5,21 +5,37 @@
 
 #include "ouster/buffered_udp_source.h"
 
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstring>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
+#include <vector>
 
 #include "ouster/client.h"
+#include "ouster/trace.h"
 #include "ouster/types.h"
 
 /*
- * Locks are not held during the actual buffer reads and writes: thread safety
- * w.r.t the producer relies on the invariants that only the consumer modifies
- * the read index and only the producer modifies the write index, always while
- * holding cv_mtx_ to make sure that cv notifications are not lost between
- * checking the empty/full condition and entering the waiting state.
+ * The read and write indices are atomics: only the consumer modifies the read
+ * index and only the producer modifies the write index, so the common case of
+ * a non-empty, non-full buffer never takes a lock. cv_mtx_ and cv_ are only
+ * used to block when the buffer is empty (consumer) or full (producer). Before
+ * blocking, each side sets its waiting flag and re-checks the indices; after
+ * publishing an index update, the other side notifies only if the flag is set.
+ * All of these use sequentially consistent atomics, which guarantees that at
+ * least one side observes the other and no wakeup is lost.
  */
 namespace ouster {
 namespace sensor {
@@ -30,6 +46,9 @@ using fsec = std::chrono::duration<float>;
 // 64 big enough for any UDP packet
 constexpr size_t packet_size = 65536;
 
+// max lidar packets drained from the socket per wakeup of the producer
+constexpr size_t max_batch = 64;
+
 /*
  * Initialize the internal circular buffer.
  *
@@ -37,7 +56,7 @@ constexpr size_t packet_size = 65536;
  * max number of buffered packets (which is one less).
  */
 BufferedUDPSource::BufferedUDPSource(size_t buf_size)
-    : capacity_{buf_size + 1} {
+    : capacity_{buf_size + 1}, rx_ts_(capacity_, 0) {
     std::generate_n(std::back_inserter(bufs_), capacity_, [&] {
         return std::make_pair(
             client_state::CLIENT_ERROR,
@@ -68,6 +87,14 @@ BufferedUDPSource::BufferedUDPSource(const std::string& hostname,
     imu_port_ = sensor::get_imu_port(*cli_);
 }
 
+BufferedUDPSource::~BufferedUDPSource() {
+#ifndef _WIN32
+    if (notify_write_fd_ >= 0 && notify_write_fd_ != notify_fd_)
+        close(notify_write_fd_);
+    if (notify_fd_ >= 0) close(notify_fd_);
+#endif
+}
+
 std::string BufferedUDPSource::get_metadata(int timeout_sec,
                                             bool legacy_format) {
     std::unique_lock<std::mutex> lock(cli_mtx_, std::try_to_lock);
@@ -78,6 +105,75 @@ std::string BufferedUDPSource::get_metadata(int timeout_sec,
     return sensor::get_metadata(*cli_, timeout_sec, legacy_format);
 }
 
+bool BufferedUDPSource::use_packet_ring(const std::string& interface,
+                                        size_t ring_size) {
+    std::unique_lock<std::mutex> lock(cli_mtx_, std::try_to_lock);
+    if (!lock.owns_lock())
+        throw std::invalid_argument(
+            "Another thread is already using the client");
+    if (!cli_) throw std::invalid_argument("Client has already been shut down");
+    return sensor::use_packet_ring(*cli_, interface, ring_size);
+}
+
+void BufferedUDPSource::notify_if_waiting(const std::atomic<bool>& waiting) {
+    if (!waiting) return;
+    // taking the lock orders the notification after the waiter has either
+    // re-checked its predicate or actually started waiting
+    { std::lock_guard<std::mutex> lock{cv_mtx_}; }
+    cv_.notify_all();
+}
+
+void BufferedUDPSource::notify_fd_signal() {
+    if (!notify_enabled_) return;
+#if defined(__linux__)
+    const uint64_t one = 1;
+    (void)!write(notify_write_fd_, &one, sizeof(one));
+#elif !defined(_WIN32)
+    // a full pipe is readable already
+    const uint8_t one = 1;
+    (void)!write(notify_write_fd_, &one, sizeof(one));
+#endif
+}
+
+int BufferedUDPSource::notify_fd() {
+    std::lock_guard<std::mutex> lock{cv_mtx_};
+    if (notify_enabled_) return notify_fd_;
+#if defined(__linux__)
+    notify_fd_ = notify_write_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#elif !defined(_WIN32)
+    int fds[2];
+    if (pipe(fds) == 0) {
+        for (int fd : fds) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        notify_fd_ = fds[0];
+        notify_write_fd_ = fds[1];
+    }
+#else
+    throw std::runtime_error("Notification fds are not supported on Windows");
+#endif
+    if (notify_fd_ < 0)
+        throw std::runtime_error("Failed to create notification fd");
+    notify_enabled_ = true;
+
+    // packets may be waiting already
+    if (read_ind_ != write_ind_ || stop_) notify_fd_signal();
+    return notify_fd_;
+}
+
+void BufferedUDPSource::clear_notify() {
+    if (!notify_enabled_) return;
+#if defined(__linux__)
+    uint64_t count;
+    (void)!read(notify_fd_, &count, sizeof(count));
+#elif !defined(_WIN32)
+    uint8_t drain[64];
+    while (read(notify_fd_, drain, sizeof(drain)) > 0) {
+    }
+#endif
+}
+
 /*
  * Invariant: nothing can access cli_ when stop_ is true. Producer will
  * release _cli_mtx_ only when it exits the loop.
@@ -89,6 +185,7 @@ void BufferedUDPSource::shutdown() {
         stop_ = true;
     }
     cv_.notify_all();
+    notify_fd_signal();
 
     // close UDP sockets when any producer has exited
     std::lock_guard<std::mutex> cli_lock{cli_mtx_};
@@ -100,48 +197,96 @@ void BufferedUDPSource::shutdown() {
  * maintain the invariant that only the reader modifies the read index.
  */
 void BufferedUDPSource::flush(size_t n_packets) {
-    {
-        std::unique_lock<std::mutex> lock{cv_mtx_};
-        auto sz = (capacity_ + write_ind_ - read_ind_) % capacity_;
-        auto n = (n_packets == 0) ? sz : std::min(sz, n_packets);
-        read_ind_ = (capacity_ + read_ind_ + n) % capacity_;
-    }
-    cv_.notify_one();
+    size_t r = read_ind_;
+    auto sz = (capacity_ + write_ind_ - r) % capacity_;
+    auto n = (n_packets == 0) ? sz : std::min(sz, n_packets);
+    read_ind_ = (r + n) % capacity_;
+    notify_if_waiting(producer_waiting_);
 }
 
 size_t BufferedUDPSource::size() {
-    std::unique_lock<std::mutex> lock{cv_mtx_};
-    return (capacity_ + write_ind_ - read_ind_) % capacity_;
+    size_t r = read_ind_;
+    return (capacity_ + write_ind_ - r) % capacity_;
 }
 
 size_t BufferedUDPSource::capacity() { return (capacity_ - 1); }
 
-client_state BufferedUDPSource::consume(uint8_t* buf, size_t buf_sz,
-                                        float timeout_sec) {
+client_state BufferedUDPSource::peek(const uint8_t*& buf, float timeout_sec,
+                                     uint64_t* rx_ts) {
+    buf = nullptr;
+    const size_t r = read_ind_;
+
     // wait for producer to wake us up if the queue is empty
-    {
+    if (r == write_ind_) {
         std::unique_lock<std::mutex> lock{cv_mtx_};
-        bool timeout = !cv_.wait_for(lock, fsec{timeout_sec}, [this] {
-            return stop_ || write_ind_ != read_ind_;
+        consumer_waiting_ = true;
+        bool timeout = !cv_.wait_for(lock, fsec{timeout_sec}, [&] {
+            return stop_ || write_ind_ != r;
         });
-        if (timeout)
-            return client_state::TIMEOUT;
-        else if (stop_)
-            return client_state::EXIT;
+        consumer_waiting_ = false;
+        if (timeout) return client_state::TIMEOUT;
     }
+    if (stop_) return client_state::EXIT;
 
-    // read data into buffer
-    auto sz = std::min<size_t>(buf_sz, packet_size);
-    auto& e = bufs_[read_ind_];
-    std::memcpy(buf, e.second.get(), sz);
+    auto& e = bufs_[r];
+    buf = e.second.get();
+    if (rx_ts) *rx_ts = rx_ts_[r];
+    return e.first;
+}
 
-    // advance read ind and unblock producer, if necessary
-    {
-        std::unique_lock<std::mutex> lock{cv_mtx_};
-        read_ind_ = (read_ind_ + 1) % capacity_;
+void BufferedUDPSource::advance() {
+    read_ind_ = (read_ind_ + 1) % capacity_;
+    notify_if_waiting(producer_waiting_);
+}
+
+client_state BufferedUDPSource::consume(uint8_t* buf, size_t buf_sz,
+                                        float timeout_sec) {
+    OUSTER_TRACE_SCOPE("BufferedUDPSource.consume");
+    const uint8_t* data = nullptr;
+    auto st = peek(data, timeout_sec, &last_rx_ts_);
+    if (!data) return st;
+
+    // read data into buffer and release the slot to the producer
+    std::memcpy(buf, data, std::min<size_t>(buf_sz, packet_size));
+    advance();
+    return st;
+}
+
+client_state BufferedUDPSource::consume_batch(uint8_t* buf, size_t stride,
+                                              size_t max_packets,
+                                              float timeout_sec, size_t& n,
+                                              client_state* states,
+                                              uint64_t* rx_ts) {
+    OUSTER_TRACE_SCOPE("BufferedUDPSource.consume_batch");
+    n = 0;
+    if (max_packets == 0) return client_state::TIMEOUT;
+
+    // wait for the first packet only
+    const uint8_t* data = nullptr;
+    auto st = peek(data, timeout_sec, &last_rx_ts_);
+    if (!data) return st;
+
+    const auto data_mask =
+        client_state(client_state::LIDAR_DATA | client_state::IMU_DATA);
+    const size_t len = std::min(stride, packet_size);
+    size_t r = read_ind_;
+    const size_t available = (capacity_ + write_ind_ - r) % capacity_;
+    const size_t count = std::min(available, max_packets);
+    while (n < count) {
+        st = bufs_[r].first;
+        std::memcpy(buf + n * stride, bufs_[r].second.get(), len);
+        states[n] = st;
+        rx_ts[n] = rx_ts_[r];
+        n++;
+        r = (r + 1) % capacity_;
+        if (!(st & data_mask)) break;
     }
-    cv_.notify_one();
-    return e.first;
+    last_rx_ts_ = rx_ts[n - 1];
+
+    // release all slots at once
+    read_ind_ = r;
+    notify_if_waiting(producer_waiting_);
+    return st;
 }
 
 /*
@@ -155,48 +300,73 @@ void BufferedUDPSource::produce(const packet_format& pf) {
         client_state(client_state::CLIENT_ERROR | client_state::EXIT);
     auto st = client_state(0);
 
+    // scratch space for handing free buffer slots to read_lidar_packets()
+    std::vector<uint8_t*> batch;
+    batch.reserve(std::min(capacity_, max_batch));
+
     while (!(st & exit_mask)) {
+        const size_t w = write_ind_;
+
         // Wait for consumer to wake us up if the queue is full
         bool overflow = false;
-        {
+        if ((w + 1) % capacity_ == read_ind_) {
+            overflow = true;
             std::unique_lock<std::mutex> lock{cv_mtx_};
-            while (!stop_ && (write_ind_ + 1) % capacity_ == read_ind_) {
-                overflow = true;
-                cv_.wait(lock);
-            }
-            if (stop_) return;
+            producer_waiting_ = true;
+            cv_.wait(lock,
+                     [&] { return stop_ || (w + 1) % capacity_ != read_ind_; });
+            producer_waiting_ = false;
         }
+        if (stop_) return;
+        const size_t n_free = (capacity_ + read_ind_ - w - 1) % capacity_;
 
         // Write data and status to circular buffer. EXIT and ERROR status
         // are just passed through with stale data.
         st = poll_client(*cli_);
         if (st == client_state::TIMEOUT) continue;
 
-        auto& e = bufs_[write_ind_];
+        // spans reading and publishing packets, not waiting for them
+        OUSTER_TRACE_SCOPE("BufferedUDPSource.produce");
+        size_t n_written = 1;
         if (st & LIDAR_DATA) {
-            if (!read_lidar_packet(*cli_, e.second.get(), pf)) continue;
+            // drain as many queued lidar packets as fit in the free slots up to
+            // the end of the buffer vector with a single batched read
+            auto n_batch = std::min({n_free, capacity_ - w, max_batch});
+            batch.clear();
+            for (size_t i = 0; i < n_batch; i++)
+                batch.push_back(bufs_[w + i].second.get());
+
+            int n = read_lidar_packets(*cli_, batch.data(), (int)n_batch, pf,
+                                       rx_ts_.data() + w);
+            if (n <= 0) continue;
+            n_written = n;
+            OUSTER_TRACE_COUNTER("BufferedUDPSource.batch", n);
         } else if (st & IMU_DATA) {
-            if (!read_imu_packet(*cli_, e.second.get(), pf)) continue;
+            if (!read_imu_packet(*cli_, bufs_[w].second.get(), pf)) continue;
+            rx_ts_[w] = 0;
         }
-        if (overflow) st = client_state(st | CLIENT_OVERFLOW);
-        e.first = st;
 
-        // Advance write ind and wake up consumer, if blocked
-        {
-            std::unique_lock<std::mutex> lock{cv_mtx_};
-            write_ind_ = (write_ind_ + 1) % capacity_;
-        }
-        cv_.notify_one();
+        for (size_t i = 0; i < n_written; i++) bufs_[w + i].first = st;
+        if (overflow) bufs_[w].first = client_state(st | CLIENT_OVERFLOW);
+
+        // Publish the new packets and wake up consumer, if blocked. Consumers
+        // polling notify_fd_ drain the buffer before waiting, so it only needs
+        // a signal if they had caught up to the packets published before
+        write_ind_ = (w + n_written) % capacity_;
+        notify_if_waiting(consumer_waiting_);
+        if (notify_enabled_ && read_ind_ == w) notify_fd_signal();
+        OUSTER_TRACE_COUNTER("BufferedUDPSource.queued",
+                             (capacity_ + write_ind_ - read_ind_) % capacity_);
     }
 }
 
+uint64_t BufferedUDPSource::last_rx_timestamp() { return last_rx_ts_; }
+
 int BufferedUDPSource::get_lidar_port() {
-    std::lock_guard<std::mutex> lock{cv_mtx_};
     return stop_ ? 0 : lidar_port_;
 }
 
 int BufferedUDPSource::get_imu_port() {
-    std::lock_guard<std::mutex> lock{cv_mtx_};
     return stop_ ? 0 : imu_port_;
 }
 
@@ -8,12 +8,14 @@
 #include <json/json.h>
 
 #include <algorithm>
+#include <array>
 #include <cctype>
 #include <cerrno>
 #include <chrono>
 #include <cstdio>
 #include <cstring>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <sstream>
@@ -24,11 +26,15 @@
 #include <vector>
 
 #include "netcompat.h"
+#include "ouster/metadata_cache.h"
+#include "ouster/trace.h"
 #include "ouster/types.h"
+#include "packet_ring.h"
 #include "sensor_http.h"
 
 using namespace std::chrono_literals;
 namespace chrono = std::chrono;
+using ouster::sensor::MetadataCache;
 using ouster::sensor::util::SensorHttp;
 
 namespace ouster {
@@ -39,6 +45,8 @@ struct client {
     SOCKET imu_fd;
     std::string hostname;
     Json::Value meta;
+    // replaces reads from lidar_fd when set, see use_packet_ring()
+    std::unique_ptr<impl::PacketRing> lidar_ring;
     ~client() {
         impl::socket_close(lidar_fd);
         impl::socket_close(imu_fd);
@@ -48,7 +56,7 @@ struct client {
 // defined in types.cpp
 Json::Value to_json(const sensor_config& config);
 
-namespace {
+namespace impl {
 
 // default udp receive buffer size on windows is very low -- use 256K
 const int RCVBUF_SIZE = 256 * 1024;
@@ -157,15 +165,124 @@ SOCKET udp_data_socket(int port) {
     return SOCKET_ERROR;
 }
 
+/*
+ * Join a multicast group on a socket bound to any address. Groups are joined
+ * at the level of their own address family, which Linux also accepts for IPv4
+ * groups on dual-stack sockets.
+ */
+bool socket_join_multicast(SOCKET sock_fd, const struct sockaddr* group,
+                           socklen_t group_len, unsigned if_index) {
+    struct group_req req;
+    memset(&req, 0, sizeof req);
+    req.gr_interface = if_index;
+    memcpy(&req.gr_group, group, group_len);
+
+    const int level =
+        group->sa_family == AF_INET6 ? IPPROTO_IPV6 : IPPROTO_IP;
+    if (setsockopt(sock_fd, level, MCAST_JOIN_GROUP, (char*)&req,
+                   sizeof req)) {
+        std::cerr << "udp setsockopt(MCAST_JOIN_GROUP): "
+                  << impl::socket_get_error() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace impl
+
+namespace {
+
+// waits between polls of the sensor status, doubling from min to max
+constexpr chrono::milliseconds min_poll_interval{50};
+constexpr chrono::milliseconds max_poll_interval{1000};
+
+// resolve a numeric multicast address
+bool parse_multicast(const std::string& group, struct sockaddr_storage& ss,
+                     socklen_t& len) {
+    struct addrinfo hints, *info;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST;
+    if (group.empty() || getaddrinfo(group.c_str(), NULL, &hints, &info) != 0)
+        return false;
+
+    bool multicast = false;
+    if (info->ai_family == AF_INET) {
+        const auto* sin = (const struct sockaddr_in*)info->ai_addr;
+        multicast = (ntohl(sin->sin_addr.s_addr) >> 28) == 0xe;
+    } else if (info->ai_family == AF_INET6) {
+        const auto* sin6 = (const struct sockaddr_in6*)info->ai_addr;
+        multicast = sin6->sin6_addr.s6_addr[0] == 0xff;
+    }
+    if (multicast) {
+        len = (socklen_t)info->ai_addrlen;
+        memcpy(&ss, info->ai_addr, info->ai_addrlen);
+    }
+    freeaddrinfo(info);
+    return multicast;
+}
+
+bool is_multicast(const std::string& host) {
+    struct sockaddr_storage ss;
+    socklen_t len = 0;
+    return parse_multicast(host, ss, len);
+}
+
+Json::Value parse_json(const std::string& s) {
+    Json::CharReaderBuilder builder;
+    auto reader = std::unique_ptr<Json::CharReader>{builder.newCharReader()};
+    Json::Value root;
+    if (!reader->parse(s.c_str(), s.c_str() + s.size(), &root, nullptr))
+        throw std::runtime_error("Error while parsing sensor response.");
+    return root;
+}
+
+/*
+ * Metadata of the same sensor, firmware and config is cached, the sensor info
+ * and config params being the only parts which change between runs. The
+ * destination of data doesn't affect the rest of the metadata, so it's left
+ * out of the hash to allow hits when the OS picks the ports.
+ */
+struct CachedMetadata {
+    MetadataCache cache;
+    std::string key;
+    std::string hash;
+    Json::Value config;
+};
+
+CachedMetadata cached_metadata(const std::string& cache_dir,
+                               SensorHttp& sensor_http,
+                               const Json::Value& info) {
+    CachedMetadata cm{MetadataCache{cache_dir}, {}, {}, {}};
+    cm.config = parse_json(sensor_http.get_config_params(true));
+    Json::Value hashed = cm.config;
+    for (const char* k : {"udp_dest", "udp_ip", "udp_port_lidar",
+                          "udp_port_imu"})
+        hashed.removeMember(k);
+    cm.hash = MetadataCache::hash(Json::FastWriter().write(hashed));
+    cm.key = MetadataCache::key(info["prod_sn"].asString(),
+                                info["build_rev"].asString(),
+                                cm.config["lidar_mode"].asString());
+    return cm;
+}
+
 bool collect_metadata(client& cli, SensorHttp& sensor_http,
-                      chrono::seconds timeout) {
+                      chrono::seconds timeout,
+                      const std::string& cache_dir = "") {
     auto timeout_time = chrono::steady_clock::now() + timeout;
+    auto interval = min_poll_interval;
+    Json::Value info;
     std::string status;
 
     do {
-        if (chrono::steady_clock::now() >= timeout_time) return false;
-        std::this_thread::sleep_for(1s);
-        status = sensor_http.sensor_info()["status"].asString();
+        const auto now = chrono::steady_clock::now();
+        if (now >= timeout_time) return false;
+        std::this_thread::sleep_for(std::min<chrono::steady_clock::duration>(
+            interval, timeout_time - now));
+        interval = std::min(interval * 2, max_poll_interval);
+        info = sensor_http.sensor_info();
+        status = info["status"].asString();
     } while (status == "INITIALIZING");
 
     // not all metadata available when sensor isn't RUNNING
@@ -176,7 +293,30 @@ bool collect_metadata(client& cli, SensorHttp& sensor_http,
             "WARMUP, or ERROR state");
     }
 
-    cli.meta = sensor_http.metadata();
+    if (cache_dir.empty()) {
+        cli.meta = sensor_http.metadata();
+    } else {
+        auto cm = cached_metadata(cache_dir, sensor_http, info);
+        auto entry = cm.cache.load(cm.key);
+        if (entry && entry->hash == cm.hash) {
+            cli.meta = parse_json(entry->metadata);
+            cli.meta["sensor_info"] = info;
+            cli.meta["config_params"] = cm.config;
+        } else {
+            cli.meta = sensor_http.metadata();
+            try {
+                MetadataCache::Entry fresh;
+                fresh.hash = cm.hash;
+                fresh.metadata = Json::FastWriter().write(cli.meta);
+                fresh.info = parse_metadata(fresh.metadata);
+                cm.cache.store(cm.key, fresh);
+            } catch (const std::runtime_error& e) {
+                // the cache is an optimization only
+                std::cerr << "Failed to cache metadata: " << e.what()
+                          << std::endl;
+            }
+        }
+    }
 
     // merge extra info into metadata
     cli.meta["client_version"] = client_version();
@@ -257,12 +397,15 @@ std::shared_ptr<client> init_client(const std::string& hostname, int lidar_port,
                                     int imu_port) {
     auto cli = std::make_shared<client>();
     cli->hostname = hostname;
-    cli->lidar_fd = udp_data_socket(lidar_port);
-    cli->imu_fd = udp_data_socket(imu_port);
+    cli->lidar_fd = impl::udp_data_socket(lidar_port);
+    cli->imu_fd = impl::udp_data_socket(imu_port);
 
     if (!impl::socket_valid(cli->lidar_fd) || !impl::socket_valid(cli->imu_fd))
         return std::shared_ptr<client>();
 
+    // best effort: fall back to reading the clock in userspace
+    impl::socket_set_rx_timestamps(cli->lidar_fd);
+
     return cli;
 }
 
@@ -270,13 +413,14 @@ std::shared_ptr<client> init_client(const std::string& hostname,
                                     const std::string& udp_dest_host,
                                     lidar_mode mode, timestamp_mode ts_mode,
                                     int lidar_port, int imu_port,
-                                    int timeout_sec) {
+                                    int timeout_sec,
+                                    const std::string& metadata_cache) {
     auto cli = init_client(hostname, lidar_port, imu_port);
     if (!cli) return std::shared_ptr<client>();
 
     // update requested ports to actual bound ports
-    lidar_port = get_sock_port(cli->lidar_fd);
-    imu_port = get_sock_port(cli->imu_fd);
+    lidar_port = impl::get_sock_port(cli->lidar_fd);
+    imu_port = impl::get_sock_port(cli->imu_fd);
     if (!impl::socket_valid(lidar_port) || !impl::socket_valid(imu_port))
         return std::shared_ptr<client>();
 
@@ -308,35 +452,73 @@ std::shared_ptr<client> init_client(const std::string& hostname,
                                           std::to_string(ts_mode));
         }
 
+        // listen on the group before the sensor starts sending to it
+        if (is_multicast(udp_dest_host) && !join_multicast(*cli, udp_dest_host))
+            return std::shared_ptr<client>();
+
         // wake up from STANDBY, if necessary
         sensor_http->set_config_param("operating_mode", "NORMAL");
         sensor_http->reinitialize();
         // will block until no longer INITIALIZING
-        success &=
-            collect_metadata(*cli, *sensor_http, chrono::seconds{timeout_sec});
+        success &= collect_metadata(*cli, *sensor_http,
+                                    chrono::seconds{timeout_sec},
+                                    metadata_cache);
         // check for sensor error states
         auto status = cli->meta["sensor_info"]["status"].asString();
         success &= (status != "ERROR" && status != "UNCONFIGURED");
     } catch (const std::runtime_error& e) {
         // log error message
-        std::cerr << "init_client error: " << e.what() << std::endl;
+        std::cerr << "init_client error for " << hostname << ": " << e.what()
+                  << std::endl;
         return std::shared_ptr<client>();
     }
 
     return success ? cli : std::shared_ptr<client>();
 }
 
-client_state poll_client(const client& c, const int timeout_sec) {
+std::future<std::shared_ptr<client>> init_client_async(
+    const std::string& hostname, const std::string& udp_dest_host,
+    lidar_mode mode, timestamp_mode ts_mode, int lidar_port, int imu_port,
+    int timeout_sec, const std::string& metadata_cache) {
+    return std::async(std::launch::async, [=]() {
+        return init_client(hostname, udp_dest_host, mode, ts_mode, lidar_port,
+                           imu_port, timeout_sec, metadata_cache);
+    });
+}
+
+std::vector<std::shared_ptr<client>> init_clients(
+    const std::vector<std::string>& hostnames,
+    const std::string& udp_dest_host, lidar_mode mode, timestamp_mode ts_mode,
+    int timeout_sec, const std::string& metadata_cache) {
+    std::vector<std::future<std::shared_ptr<client>>> pending;
+    for (const auto& hostname : hostnames)
+        pending.push_back(init_client_async(hostname, udp_dest_host, mode,
+                                            ts_mode, 0, 0, timeout_sec,
+                                            metadata_cache));
+
+    std::vector<std::shared_ptr<client>> clients;
+    for (auto& p : pending) clients.push_back(p.get());
+    return clients;
+}
+
+namespace impl {
+
+client_state poll_client_us(const client& c, int64_t timeout_us) {
+    OUSTER_TRACE_SCOPE("poll_client");
+    // the ring fd only signals newly filled blocks, not partially read ones
+    if (c.lidar_ring && c.lidar_ring->pending()) return LIDAR_DATA;
+    const SOCKET lidar_fd = c.lidar_ring ? c.lidar_ring->fd() : c.lidar_fd;
+
     fd_set rfds;
     FD_ZERO(&rfds);
-    FD_SET(c.lidar_fd, &rfds);
+    FD_SET(lidar_fd, &rfds);
     FD_SET(c.imu_fd, &rfds);
 
     timeval tv;
-    tv.tv_sec = timeout_sec;
-    tv.tv_usec = 0;
+    tv.tv_sec = static_cast<long>(timeout_us / 1000000);
+    tv.tv_usec = static_cast<long>(timeout_us % 1000000);
 
-    SOCKET max_fd = std::max(c.lidar_fd, c.imu_fd);
+    SOCKET max_fd = std::max(lidar_fd, c.imu_fd);
 
     SOCKET retval = select((int)max_fd + 1, &rfds, NULL, NULL, &tv);
 
@@ -348,16 +530,26 @@ client_state poll_client(const client& c, const int timeout_sec) {
         std::cerr << "select: " << impl::socket_get_error() << std::endl;
         res = client_state(res | CLIENT_ERROR);
     } else if (retval) {
-        if (FD_ISSET(c.lidar_fd, &rfds)) res = client_state(res | LIDAR_DATA);
+        if (FD_ISSET(lidar_fd, &rfds)) res = client_state(res | LIDAR_DATA);
         if (FD_ISSET(c.imu_fd, &rfds)) res = client_state(res | IMU_DATA);
     }
 
     return res;
 }
 
-static bool recv_fixed(SOCKET fd, void* buf, int64_t len) {
-    int64_t bytes_read = recv(fd, (char*)buf, len + 1, 0);
+}  // namespace impl
+
+client_state poll_client(const client& c, const int timeout_sec) {
+    return impl::poll_client_us(c, timeout_sec * int64_t{1000000});
+}
+
+namespace {
+
+// upper bound on the number of datagrams requested per recvmmsg() call
+constexpr int MAX_RECV_BATCH = 64;
 
+// check the result of a single datagram read against the expected size
+bool check_recv_len(int64_t bytes_read, int64_t len) {
     if (bytes_read == len) {
         return true;
     } else if (bytes_read == -1) {
@@ -369,18 +561,207 @@ static bool recv_fixed(SOCKET fd, void* buf, int64_t len) {
     return false;
 }
 
+bool recv_fixed(SOCKET fd, void* buf, int64_t len) {
+    return check_recv_len(recv(fd, (char*)buf, len + 1, 0), len);
+}
+
+bool recv_fixed(SOCKET fd, void* buf, int64_t len, uint64_t& rx_ts) {
+#ifdef _WIN32
+    bool res = recv_fixed(fd, buf, len);
+    rx_ts = impl::socket_rx_timestamp_now();
+    return res;
+#else
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = len + 1;
+    alignas(struct cmsghdr) char
+        control[impl::socket_rx_timestamp_control_size];
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    bool res = check_recv_len(recvmsg(fd, &msg, 0), len);
+    rx_ts = impl::socket_msg_rx_timestamp(msg);
+    return res;
+#endif
+}
+
+/*
+ * Read up to max_n datagrams of exactly len bytes into bufs, and their receive
+ * timestamps into rx_ts if not null. Datagrams of the wrong size are dropped
+ * and the following ones are moved down so the valid packets always occupy
+ * the front of bufs. Relies on fd being non-blocking.
+ */
+int recv_fixed_batch(SOCKET fd, uint8_t* const* bufs, int max_n, int64_t len,
+                     uint64_t* rx_ts) {
+    int n_good = 0;
+    int n_read = 0;
+
+#ifdef __linux__
+    using control_t =
+        std::array<char, impl::socket_rx_timestamp_control_size>;
+    std::array<struct mmsghdr, MAX_RECV_BATCH> msgs;
+    std::array<struct iovec, MAX_RECV_BATCH> iovs;
+    alignas(struct cmsghdr) std::array<control_t, MAX_RECV_BATCH> controls;
+
+    while (n_read < max_n) {
+        const int n_req = std::min(max_n - n_read, MAX_RECV_BATCH);
+        for (int i = 0; i < n_req; i++) {
+            iovs[i].iov_base = bufs[n_read + i];
+            iovs[i].iov_len = len + 1;
+            std::memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if (rx_ts) {
+                msgs[i].msg_hdr.msg_control = controls[i].data();
+                msgs[i].msg_hdr.msg_controllen = controls[i].size();
+            }
+        }
+
+        int ret = recvmmsg(fd, msgs.data(), n_req, MSG_DONTWAIT, nullptr);
+        if (ret < 0) {
+            if (impl::socket_would_block()) break;
+            std::cerr << "recvmmsg: " << impl::socket_get_error()
+                      << std::endl;
+            return n_good > 0 ? n_good : SOCKET_ERROR;
+        }
+
+        for (int i = 0; i < ret; i++) {
+            if (!check_recv_len(msgs[i].msg_len, len)) continue;
+            if (n_good != n_read + i)
+                std::memcpy(bufs[n_good], bufs[n_read + i], len);
+            if (rx_ts)
+                rx_ts[n_good] = impl::socket_msg_rx_timestamp(msgs[i].msg_hdr);
+            n_good++;
+        }
+
+        n_read += ret;
+        // short read: the socket queue has been drained
+        if (ret < n_req) break;
+    }
+#else
+    for (; n_read < max_n; n_read++) {
+        int64_t bytes_read = recv(fd, (char*)bufs[n_good], len + 1, 0);
+        if (bytes_read < 0 && impl::socket_would_block()) break;
+        if (bytes_read < 0) {
+            check_recv_len(bytes_read, len);
+            return n_good > 0 ? n_good : SOCKET_ERROR;
+        }
+        if (!check_recv_len(bytes_read, len)) continue;
+        if (rx_ts) rx_ts[n_good] = impl::socket_rx_timestamp_now();
+        n_good++;
+    }
+#endif
+
+    return n_good;
+}
+
+/*
+ * Same as recv_fixed_batch(), reading from a packet ring
+ */
+int ring_fixed_batch(impl::PacketRing& ring, uint8_t* const* bufs, int max_n,
+                     int64_t len, uint64_t* rx_ts) {
+    int n_good = 0;
+    uint64_t ts = 0;
+    while (n_good < max_n) {
+        int64_t bytes_read = ring.read(bufs[n_good], len + 1, ts);
+        if (bytes_read < 0) break;
+        if (!check_recv_len(bytes_read, len)) continue;
+        if (rx_ts) rx_ts[n_good] = ts;
+        n_good++;
+    }
+    return n_good;
+}
+
+}  // namespace
+
 bool read_lidar_packet(const client& cli, uint8_t* buf,
                        const packet_format& pf) {
+    if (cli.lidar_ring)
+        return ring_fixed_batch(*cli.lidar_ring, &buf, 1,
+                                pf.lidar_packet_size, nullptr) == 1;
     return recv_fixed(cli.lidar_fd, buf, pf.lidar_packet_size);
 }
 
+bool read_lidar_packet(const client& cli, uint8_t* buf, uint64_t& rx_ts,
+                       const packet_format& pf) {
+    if (cli.lidar_ring)
+        return ring_fixed_batch(*cli.lidar_ring, &buf, 1,
+                                pf.lidar_packet_size, &rx_ts) == 1;
+    return recv_fixed(cli.lidar_fd, buf, pf.lidar_packet_size, rx_ts);
+}
+
+int read_lidar_packets(const client& cli, uint8_t* const* bufs, int max_n,
+                       const packet_format& pf, uint64_t* rx_ts) {
+    OUSTER_TRACE_SCOPE("read_lidar_packets");
+    if (cli.lidar_ring)
+        return ring_fixed_batch(*cli.lidar_ring, bufs, max_n,
+                                pf.lidar_packet_size, rx_ts);
+    return recv_fixed_batch(cli.lidar_fd, bufs, max_n, pf.lidar_packet_size,
+                            rx_ts);
+}
+
+bool use_packet_ring(client& cli, const std::string& interface,
+                     size_t ring_size) {
+    auto ring = impl::PacketRing::create(impl::get_sock_port(cli.lidar_fd),
+                                         interface, ring_size);
+    if (!ring) return false;
+
+    // keep the port bound, but don't queue a second copy of every packet
+    if (impl::socket_drop_all(cli.lidar_fd))
+        std::cerr << "udp setsockopt(SO_ATTACH_FILTER): "
+                  << impl::socket_get_error() << std::endl;
+    cli.lidar_ring = std::move(ring);
+    return true;
+}
+
+bool join_multicast(client& cli, const std::string& group,
+                    const std::string& interface) {
+    struct sockaddr_storage ss;
+    socklen_t len = 0;
+    if (!parse_multicast(group, ss, len)) {
+        std::cerr << "join_multicast(): not a multicast address: " << group
+                  << std::endl;
+        return false;
+    }
+
+    unsigned if_index = 0;
+    if (!interface.empty()) {
+#ifdef _WIN32
+        std::cerr << "join_multicast(): interface names are not supported"
+                  << std::endl;
+        return false;
+#else
+        if_index = if_nametoindex(interface.c_str());
+        if (if_index == 0) {
+            std::cerr << "join_multicast(): no such interface: " << interface
+                      << std::endl;
+            return false;
+        }
+#endif
+    }
+
+    const auto* sa = (const struct sockaddr*)&ss;
+    return impl::socket_join_multicast(cli.lidar_fd, sa, len, if_index) &&
+           impl::socket_join_multicast(cli.imu_fd, sa, len, if_index);
+}
+
+int64_t get_lidar_drops(const client& cli) {
+    if (cli.lidar_ring) return cli.lidar_ring->drops();
+    return impl::socket_get_drops(cli.lidar_fd);
+}
+
 bool read_imu_packet(const client& cli, uint8_t* buf, const packet_format& pf) {
     return recv_fixed(cli.imu_fd, buf, pf.imu_packet_size);
 }
 
-int get_lidar_port(client& cli) { return get_sock_port(cli.lidar_fd); }
+int get_lidar_port(client& cli) { return impl::get_sock_port(cli.lidar_fd); }
 
-int get_imu_port(client& cli) { return get_sock_port(cli.imu_fd); }
+int get_imu_port(client& cli) { return impl::get_sock_port(cli.imu_fd); }
 
 /**
  * Return the socket file descriptor used to listen for lidar UDP data.
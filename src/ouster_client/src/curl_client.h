@@ -8,17 +8,21 @@
 class CurlClient : public ouster::util::HttpClient {
    public:
     CurlClient(const std::string& base_url_) : HttpClient(base_url_) {
-        curl_global_init(CURL_GLOBAL_ALL);
+        global_init();
         curl_handle = curl_easy_init();
         curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION,
                          &CurlClient::write_memory_callback);
         curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, this);
+        // clients may be used from several threads at once, see
+        // init_client_async()
+        curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1L);
+        // requests reuse the connection of the handle; keep it open while
+        // polling the sensor
+        curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl_handle, CURLOPT_TCP_NODELAY, 1L);
     }
 
-    virtual ~CurlClient() override {
-        curl_easy_cleanup(curl_handle);
-        curl_global_cleanup();
-    }
+    virtual ~CurlClient() override { curl_easy_cleanup(curl_handle); }
 
    public:
     std::string get(const std::string& url) const override {
@@ -35,6 +39,15 @@ class CurlClient : public ouster::util::HttpClient {
     }
 
    private:
+    // curl_global_init() isn't thread safe: initialize once for all clients
+    static void global_init() {
+        struct Global {
+            Global() { curl_global_init(CURL_GLOBAL_ALL); }
+            ~Global() { curl_global_cleanup(); }
+        };
+        static Global global;
+    }
+
     static std::string url_combine(const std::string& url1,
                                    const std::string& url2) {
         if (!url1.empty() && !url2.empty()) {
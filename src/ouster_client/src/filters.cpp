@@ -0,0 +1,345 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/filters.h"
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "ouster/impl/lidar_scan_impl.h"
+
+namespace ouster {
+namespace filters {
+
+using sensor::ChanField;
+
+namespace {
+
+/*
+ * Run f(band, rows_begin, rows_end) over bands of rows in [0, n_rows), using
+ * the calling thread for the first band
+ */
+template <typename F>
+void for_row_bands(size_t n_rows, int n_threads, F&& f) {
+    const size_t n_bands =
+        std::max<size_t>(1, std::min<size_t>(std::max(n_threads, 1), n_rows));
+    const size_t band = (n_rows + n_bands - 1) / n_bands;
+    std::vector<std::thread> workers;
+    for (size_t b = 1; b < n_bands; b++) {
+        const size_t begin = std::min(b * band, n_rows);
+        const size_t end = std::min(begin + band, n_rows);
+        if (begin < end) workers.emplace_back(f, b, begin, end);
+    }
+    f(size_t{0}, size_t{0}, std::min(band, n_rows));
+    for (auto& w : workers) w.join();
+}
+
+void check_shifts(const std::vector<int>& pixel_shift_by_row, size_t h) {
+    if (!pixel_shift_by_row.empty() && pixel_shift_by_row.size() != h)
+        throw std::invalid_argument("expected a pixel shift for each row");
+}
+
+/*
+ * Column offset from a pixel of row u to its neighbour in row r, in [0, w),
+ * so that both are at the same azimuth once destaggered
+ */
+size_t row_delta(const std::vector<int>& shifts, size_t u, size_t r,
+                 size_t w) {
+    if (shifts.empty()) return 0;
+    const long m = static_cast<long>(w);
+    const long d = (shifts[u] - shifts[r]) % m;
+    return static_cast<size_t>((d + m) % m);
+}
+
+// dst[v] = src[(v + k) % w], for k in [0, w)
+template <typename T>
+void rotate_row(const T* src, size_t k, size_t w, T* dst) {
+    std::memcpy(dst, src + k, (w - k) * sizeof(T));
+    std::memcpy(dst + (w - k), src, k * sizeof(T));
+}
+
+// put the smaller of each pair of pixels in a and the larger in b
+template <typename T>
+void sort_pair(T* a, T* b, size_t w) {
+    for (size_t v = 0; v < w; v++) {
+        const T x = a[v], y = b[v];
+        const bool lt = y < x;
+        a[v] = lt ? y : x;
+        b[v] = lt ? x : y;
+    }
+}
+
+/*
+ * Median of n rows of pixels, by forgetful selection: the smallest and the
+ * largest of any (n + 3) / 2 values can't be the median of all n, so they are
+ * dropped and replaced by one of the remaining values until one is left.
+ * Rows are overwritten.
+ */
+template <typename T>
+const T* median_of_rows(std::vector<T*>& rows, size_t w) {
+    const size_t n = rows.size();
+    size_t lo = 0;
+    size_t hi = (n + 3) / 2;  // rows under consideration are [lo, hi)
+    size_t next = hi;
+    while (true) {
+        for (size_t i = lo + 1; i < hi; i++) sort_pair(rows[lo], rows[i], w);
+        for (size_t i = lo + 1; i + 1 < hi; i++)
+            sort_pair(rows[i], rows[hi - 1], w);
+
+        // drop the extremes, then consider the next row
+        lo++;
+        hi--;
+        if (next < n)
+            std::swap(rows[hi++], rows[next++]);
+        else if (hi - lo <= 1)
+            return rows[lo];
+    }
+}
+
+}  // namespace
+
+template <typename T>
+void median(const Eigen::Ref<const img_t<T>>& img, Eigen::Ref<img_t<T>> dest,
+            int size, const std::vector<int>& pixel_shift_by_row,
+            int n_threads) {
+    if (size != 3 && size != 5)
+        throw std::invalid_argument("median window must be 3 or 5 pixels");
+    if (dest.rows() != img.rows() || dest.cols() != img.cols())
+        throw std::invalid_argument("unexpected image dimensions");
+    check_shifts(pixel_shift_by_row, img.rows());
+
+    const size_t h = img.rows();
+    const size_t w = img.cols();
+    if (h == 0 || w == 0) return;
+    const long lh = h, lw = w;
+    const int r = size / 2;
+    const size_t n = size * size;
+
+    auto filter_rows = [&](size_t, size_t begin, size_t end) {
+        // a row of pixels for each position in the window
+        std::vector<T> scratch(n * w);
+        std::vector<T*> rows(n);
+        for (size_t u = begin; u < end; u++) {
+            size_t i = 0;
+            for (int dy = -r; dy <= r; dy++) {
+                const long y = std::min(
+                    std::max(static_cast<long>(u) + dy, 0l), lh - 1);
+                const long delta = row_delta(pixel_shift_by_row, u, y, w);
+                for (int dx = -r; dx <= r; dx++, i++) {
+                    rows[i] = scratch.data() + i * w;
+                    const long k = ((delta + dx) % lw + lw) % lw;
+                    rotate_row(img.row(y).data(), k, w, rows[i]);
+                }
+            }
+            const T* res = median_of_rows(rows, w);
+            std::memcpy(dest.row(u).data(), res, w * sizeof(T));
+        }
+    };
+    for_row_bands(h, n_threads, filter_rows);
+}
+
+namespace {
+
+struct median_field {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, int size,
+                    const std::vector<int>& pixel_shift_by_row,
+                    int n_threads) {
+        const img_t<T> img = field;
+        median<T>(img, field, size, pixel_shift_by_row, n_threads);
+    }
+};
+
+void check_mask(const Eigen::Ref<const img_t<uint8_t>>& mask, size_t h,
+                size_t w) {
+    if (static_cast<size_t>(mask.rows()) != h ||
+        static_cast<size_t>(mask.cols()) != w)
+        throw std::invalid_argument("unexpected mask dimensions");
+}
+
+// set bit in the mask for pixels matching pred
+template <typename T, typename P>
+void mark(const Eigen::Ref<const img_t<T>>& img,
+          Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit, P pred) {
+    check_mask(mask, img.rows(), img.cols());
+    const size_t w = img.cols();
+    for (std::ptrdiff_t u = 0; u < img.rows(); u++) {
+        const T* src = img.row(u).data();
+        uint8_t* m = mask.row(u).data();
+        for (size_t v = 0; v < w; v++)
+            m[v] |= bit & static_cast<uint8_t>(-uint8_t{pred(src[v])});
+    }
+}
+
+struct invalid_field {
+    template <typename T>
+    void operator()(Eigen::Ref<const img_t<T>> field,
+                    Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit) {
+        invalid_mask<T>(field, mask, bit);
+    }
+};
+
+struct threshold_field {
+    template <typename T>
+    void operator()(Eigen::Ref<const img_t<T>> field, double lo, double hi,
+                    Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit) {
+        mark<T>(field, mask, bit, [=](T x) {
+            const double d = static_cast<double>(x);
+            return d < lo || d > hi;
+        });
+    }
+};
+
+struct zero_masked {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field,
+                    const Eigen::Ref<const img_t<uint8_t>>& mask,
+                    uint8_t bits) {
+        const size_t w = field.cols();
+        for (std::ptrdiff_t u = 0; u < field.rows(); u++) {
+            T* dst = field.row(u).data();
+            const uint8_t* m = mask.row(u).data();
+            for (size_t v = 0; v < w; v++)
+                if (m[v] & bits) dst[v] = T{0};
+        }
+    }
+};
+
+}  // namespace
+
+void median(LidarScan& scan, ChanField f, int size,
+            const std::vector<int>& pixel_shift_by_row, int n_threads) {
+    if (!scan.field_type(f))
+        throw std::out_of_range("field is not in the scan");
+    impl::visit_field(scan, f, median_field(), size,
+                      scan.destaggered ? std::vector<int>{}
+                                       : pixel_shift_by_row,
+                      n_threads);
+}
+
+template <typename T>
+void invalid_mask(const Eigen::Ref<const img_t<T>>& img,
+                  Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit) {
+    // NaN is the only value that isn't equal to itself
+    mark<T>(img, mask, bit, [](T x) { return x == T{0} || x != x; });
+}
+
+void invalid_mask(const LidarScan& scan, ChanField f,
+                  Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit) {
+    if (!scan.field_type(f))
+        throw std::out_of_range("field is not in the scan");
+    impl::visit_field(scan, f, invalid_field(), mask, bit);
+}
+
+template <typename T>
+void threshold_mask(const Eigen::Ref<const img_t<T>>& img, T lo, T hi,
+                    Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit) {
+    mark<T>(img, mask, bit, [=](T x) { return x < lo || x > hi; });
+}
+
+void threshold_mask(const LidarScan& scan, ChanField f, double lo, double hi,
+                    Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit) {
+    if (!scan.field_type(f))
+        throw std::out_of_range("field is not in the scan");
+    impl::visit_field(scan, f, threshold_field(), lo, hi, mask, bit);
+}
+
+void edge_mask(const Eigen::Ref<const img_t<uint32_t>>& range,
+               const XYZLut& lut, double min_angle_deg,
+               Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit,
+               const std::vector<int>& pixel_shift_by_row, int n_threads) {
+    const size_t h = range.rows();
+    const size_t w = range.cols();
+    check_mask(mask, h, w);
+    check_shifts(pixel_shift_by_row, h);
+    if (lut.direction.rows() != range.size() ||
+        lut.offset.rows() != range.size())
+        throw std::invalid_argument("unexpected scan dimensions");
+
+    const LidarScan::Points points = cartesian(range, lut);
+    const double cos_min = std::cos(min_angle_deg * M_PI / 180.0);
+
+    auto mark_rows = [&](size_t, size_t begin, size_t end) {
+        for (size_t u = begin; u < end; u++) {
+            const uint32_t* row = range.row(u).data();
+            uint8_t* m = mask.row(u).data();
+
+            // neighbours in the same row, then in the rows above and below
+            struct neighbour {
+                size_t row;
+                size_t delta;
+            };
+            neighbour nbs[4];
+            size_t n_nbs = 0;
+            nbs[n_nbs++] = {u, 1};
+            nbs[n_nbs++] = {u, w - 1};
+            if (u > 0)
+                nbs[n_nbs++] = {u - 1,
+                                row_delta(pixel_shift_by_row, u, u - 1, w)};
+            if (u + 1 < h)
+                nbs[n_nbs++] = {u + 1,
+                                row_delta(pixel_shift_by_row, u, u + 1, w)};
+
+            for (size_t v = 0; v < w; v++) {
+                if (row[v] == 0) continue;
+                const size_t i = u * w + v;
+                const Eigen::Vector3d p = points.row(i).matrix().transpose();
+                const Eigen::Vector3d d =
+                    lut.direction.row(i).matrix().transpose().normalized();
+                for (size_t k = 0; k < n_nbs; k++) {
+                    const size_t vv = (v + nbs[k].delta) % w;
+                    const size_t j = nbs[k].row * w + vv;
+                    const uint32_t rj = range(nbs[k].row, vv);
+                    if (rj == 0 || rj >= row[v]) continue;
+
+                    const Eigen::Vector3d diff =
+                        points.row(j).matrix().transpose() - p;
+                    const double dist = diff.norm();
+                    if (dist > 0 && std::abs(d.dot(diff)) > cos_min * dist) {
+                        m[v] |= bit;
+                        break;
+                    }
+                }
+            }
+        }
+    };
+    for_row_bands(h, n_threads, mark_rows);
+}
+
+void apply_mask(LidarScan& scan, const std::vector<ChanField>& fields,
+                const Eigen::Ref<const img_t<uint8_t>>& mask, uint8_t bits) {
+    check_mask(mask, scan.h, scan.w);
+    for (auto f : fields)
+        if (!scan.field_type(f))
+            throw std::out_of_range("field is not in the scan");
+    for (auto f : fields) impl::visit_field(scan, f, zero_masked(), mask, bits);
+}
+
+// explicitly instantiate for each field type
+#define OUSTER_FILTERS_INSTANTIATE(T)                                        \
+    template void median(const Eigen::Ref<const img_t<T>>&,                 \
+                         Eigen::Ref<img_t<T>>, int, const std::vector<int>&, \
+                         int);                                               \
+    template void invalid_mask(const Eigen::Ref<const img_t<T>>&,           \
+                               Eigen::Ref<img_t<uint8_t>>, uint8_t);         \
+    template void threshold_mask(const Eigen::Ref<const img_t<T>>&, T, T,   \
+                                 Eigen::Ref<img_t<uint8_t>>, uint8_t);
+
+OUSTER_FILTERS_INSTANTIATE(uint8_t)
+OUSTER_FILTERS_INSTANTIATE(uint16_t)
+OUSTER_FILTERS_INSTANTIATE(uint32_t)
+OUSTER_FILTERS_INSTANTIATE(uint64_t)
+OUSTER_FILTERS_INSTANTIATE(float)
+OUSTER_FILTERS_INSTANTIATE(double)
+
+#undef OUSTER_FILTERS_INSTANTIATE
+
+}  // namespace filters
+}  // namespace ouster
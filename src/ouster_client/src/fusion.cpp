@@ -0,0 +1,312 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/fusion.h"
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "ouster/impl/lidar_scan_impl.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace fusion {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+namespace {
+
+constexpr int64_t NO_WINDOW = std::numeric_limits<int64_t>::min();
+
+static_assert(sizeof(FusedPoint) == 28, "fused points should not be padded");
+
+int64_t floor_div(int64_t a, int64_t b) {
+    const int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+// the rotation rate of a lidar mode, or the fastest if unknown
+int frequency(const sensor::sensor_info& info) {
+    try {
+        return sensor::frequency_of_lidar_mode(info.mode);
+    } catch (const std::invalid_argument&) {
+        return 20;
+    }
+}
+
+// points of a sensor that may be measured in a window, with some margin for
+// jitter of the column timestamps
+size_t points_per_window(const sensor::sensor_info& info, uint64_t window_ns) {
+    const double w = info.format.columns_per_frame;
+    const double cols = std::ceil(w * frequency(info) * (window_ns * 1e-9));
+    return (static_cast<size_t>(cols) + 2) * info.format.pixels_per_column;
+}
+
+// projects into the common frame, with translations in mm like the lidar to
+// sensor transform
+XYZLutf make_fused_lut(const FusedSensor& s) {
+    mat4d extrinsic = s.extrinsic;
+    extrinsic.block<3, 1>(0, 3) *= 1000;
+    const auto& info = s.info;
+    return make_xyz_lutf(make_xyz_lut(
+        info.format.columns_per_frame, info.format.pixels_per_column,
+        sensor::range_unit, info.lidar_origin_to_beam_origin_mm,
+        extrinsic * info.lidar_to_sensor_transform, info.beam_azimuth_angles,
+        info.beam_altitude_angles));
+}
+
+// read a row of a field, saturating values to 16 bits
+struct read_row {
+    template <typename T>
+    void operator()(Eigen::Ref<const img_t<T>> field, size_t u, size_t w,
+                    std::vector<uint16_t>& dest) {
+        constexpr uint64_t max = std::numeric_limits<uint16_t>::max();
+        const T* src = field.data() + u * field.outerStride();
+        for (size_t v = 0; v < w; v++)
+            dest[v] = static_cast<uint16_t>(std::min<uint64_t>(src[v], max));
+    }
+};
+
+void read_row_or_fill_zero(const LidarScan& ls, ChanField f, size_t u,
+                           size_t w, std::vector<uint16_t>& dest) {
+    if (ls.field_type(f) != ChanFieldType::VOID)
+        impl::visit_field(ls, f, read_row(), u, w, dest);
+    else
+        std::fill(dest.begin(), dest.begin() + w, uint16_t{0});
+}
+
+// a row of a scan to project, at the first column of the row
+struct Row {
+    const float* dir[3];
+    const float* off[3];
+    const uint32_t* range;
+    const uint32_t* t;  // of each column, from the start of its window
+    const uint16_t* signal;
+    const uint16_t* reflectivity;
+    uint16_t ring;
+    uint16_t sensor;
+};
+
+/*
+ * Project the pixels [v0, v1) of a row to points, returning the number of
+ * pixels with a return. Each pixel is written to the point after the last
+ * with a return, without branching, so there must be room for all of them.
+ */
+size_t project_run(const Row& row, size_t v0, size_t v1, FusedPoint* out) {
+    size_t k = 0;
+    for (size_t v = v0; v < v1; v++) {
+        const uint32_t r = row.range[v];
+        const float rv = static_cast<float>(r);
+        FusedPoint& p = out[k];
+        p.x = row.dir[0][v] * rv + row.off[0][v];
+        p.y = row.dir[1][v] * rv + row.off[1][v];
+        p.z = row.dir[2][v] * rv + row.off[2][v];
+        p.t = row.t[v];
+        p.range = r;
+        p.signal = row.signal[v];
+        p.reflectivity = row.reflectivity[v];
+        p.ring = row.ring;
+        p.sensor = row.sensor;
+        k += r != 0;
+    }
+    return k;
+}
+
+}  // namespace
+
+ScanFuser::ScanFuser(const std::vector<FusedSensor>& sensors,
+                     const FuserConfig& config, Handler handler)
+    : config_{config}, handler_{std::move(handler)} {
+    if (sensors.empty())
+        throw std::invalid_argument("expected at least one sensor to fuse");
+    if (sensors.size() > std::numeric_limits<uint16_t>::max())
+        throw std::invalid_argument("too many sensors to fuse");
+    if (config.window_ns == 0 ||
+        config.window_ns > static_cast<uint64_t>(
+                               std::numeric_limits<int64_t>::max()))
+        throw std::invalid_argument("invalid window duration");
+    if (config.max_windows == 0)
+        throw std::invalid_argument("expected at least one window");
+
+    size_t max_w = 0;
+    for (const auto& s : sensors) {
+        const size_t w = s.info.format.columns_per_frame;
+        const size_t h = s.info.format.pixels_per_column;
+        sensors_.push_back({w, h, make_fused_lut(s), 0});
+        capacity_ += points_per_window(s.info, config.window_ns);
+        max_w = std::max(max_w, w);
+    }
+
+    clouds_.resize(config.max_windows);
+    for (auto& c : clouds_) {
+        c.points.resize(capacity_);
+        c.columns.assign(sensors.size(), 0);
+    }
+    col_window_.resize(max_w);
+    col_t_.resize(max_w);
+    signal_.resize(max_w);
+    reflectivity_.resize(max_w);
+}
+
+FusedCloud& ScanFuser::cloud(int64_t window) {
+    const auto n = static_cast<int64_t>(clouds_.size());
+    const int64_t k = window % n;
+    return clouds_[static_cast<size_t>(k < 0 ? k + n : k)];
+}
+
+void ScanFuser::open(int64_t first, int64_t last) {
+    const auto n = static_cast<int64_t>(clouds_.size());
+    if (!started_ || last - n + 1 >= end_) {
+        // all open windows make room, skip over any gap up to the scan
+        while (begin_ < end_) emit();
+        begin_ = end_ = std::max(first, last - n + 1);
+        started_ = true;
+    }
+    while (last - begin_ >= n) emit();
+    for (; end_ <= last; end_++) {
+        auto& c = cloud(end_);
+        c.ts = static_cast<uint64_t>(
+            end_ * static_cast<int64_t>(config_.window_ns) +
+            static_cast<int64_t>(config_.window_offset_ns));
+        c.size = 0;
+        std::fill(c.columns.begin(), c.columns.end(), 0);
+    }
+}
+
+void ScanFuser::emit() {
+    const auto& c = cloud(begin_++);
+    if (c.size == 0) return;
+    stats_.clouds++;
+    if (handler_) handler_(c);
+}
+
+void ScanFuser::complete(bool flush) {
+    uint64_t latest = 0;
+    for (const auto& s : sensors_) latest = std::max(latest, s.watermark);
+    // sensors lagging behind by more than the delay don't hold windows, and
+    // sensors yet to add data lag behind the first data of any sensor
+    auto lagging = [&](const Sensor& s) {
+        const uint64_t wm = s.watermark ? s.watermark : first_ts_;
+        return wm + config_.max_delay_ns < latest;
+    };
+    while (begin_ < end_) {
+        const uint64_t end = cloud(begin_).ts + config_.window_ns;
+        const bool done =
+            flush ||
+            std::all_of(sensors_.begin(), sensors_.end(), [&](const Sensor& s) {
+                return s.watermark >= end || lagging(s);
+            });
+        if (!done) break;
+        emit();
+    }
+}
+
+void ScanFuser::add(size_t sensor, const LidarScan& scan) {
+    auto& s = sensors_.at(sensor);
+    if (static_cast<size_t>(scan.w) != s.w ||
+        static_cast<size_t>(scan.h) != s.h)
+        throw std::invalid_argument("unexpected scan dimensions");
+    if (scan.destaggered)
+        throw std::invalid_argument("expected a staggered scan");
+    const auto range = scan.field(ChanField::RANGE);
+    stats_.scans++;
+
+    // find the window of each column measured
+    const auto ts = scan.timestamp();
+    const auto status = scan.status();
+    const auto window = static_cast<int64_t>(config_.window_ns);
+    const auto offset = static_cast<int64_t>(config_.window_offset_ns);
+    int64_t first = NO_WINDOW, last = NO_WINDOW;
+    for (size_t v = 0; v < s.w; v++) {
+        col_window_[v] = NO_WINDOW;
+        if (!(status[v] & 0x01) || ts[v] == 0) continue;
+        const int64_t k =
+            floor_div(static_cast<int64_t>(ts[v]) - offset, window);
+        col_window_[v] = k;
+        if (first == NO_WINDOW || k < first) first = k;
+        last = std::max(last, k);
+        s.watermark = std::max(s.watermark, static_cast<uint64_t>(ts[v]));
+        if (first_ts_ == 0) first_ts_ = ts[v];
+    }
+
+    if (last != NO_WINDOW) {
+        open(first, last);
+
+        // columns of completed windows are too late, the others are
+        // projected in runs of the same window
+        runs_.clear();
+        for (size_t v = 0; v < s.w; v++) {
+            if (col_window_[v] == NO_WINDOW) continue;
+            if (col_window_[v] < begin_) {
+                stats_.late_columns++;
+                continue;
+            }
+            auto& c = cloud(col_window_[v]);
+            c.columns[sensor]++;
+            col_t_[v] = static_cast<uint32_t>(ts[v] - c.ts);
+            if (!runs_.empty() && runs_.back().cloud == &c &&
+                runs_.back().end == v)
+                runs_.back().end++;
+            else
+                runs_.push_back({v, v + 1, &c});
+        }
+
+        const std::ptrdiff_t n = s.lut.direction.rows();
+        Row row{};
+        row.t = col_t_.data();
+        row.signal = signal_.data();
+        row.reflectivity = reflectivity_.data();
+        row.sensor = static_cast<uint16_t>(sensor);
+        for (size_t u = 0; u < s.h; u++) {
+            read_row_or_fill_zero(scan, ChanField::SIGNAL, u, s.w, signal_);
+            read_row_or_fill_zero(scan, ChanField::REFLECTIVITY, u, s.w,
+                                  reflectivity_);
+            const size_t i0 = u * s.w;
+            for (int c = 0; c < 3; c++) {
+                row.dir[c] = s.lut.direction.data() + c * n + i0;
+                row.off[c] = s.lut.offset.data() + c * n + i0;
+            }
+            row.range = range.data() + u * range.outerStride();
+            row.ring = static_cast<uint16_t>(u);
+            for (const auto& run : runs_) {
+                auto& c = *run.cloud;
+                if (run.end - run.begin <= c.points.size() - c.size) {
+                    c.size += project_run(row, run.begin, run.end,
+                                          c.points.data() + c.size);
+                    continue;
+                }
+                // only as many points as fit
+                for (size_t v = run.begin; v < run.end; v++) {
+                    if (row.range[v] == 0) continue;
+                    if (c.size == c.points.size()) {
+                        stats_.dropped_points++;
+                        continue;
+                    }
+                    c.size += project_run(row, v, v + 1,
+                                          c.points.data() + c.size);
+                }
+            }
+        }
+    }
+
+    complete(false);
+}
+
+void ScanFuser::flush() { complete(true); }
+
+size_t ScanFuser::capacity() const { return capacity_; }
+
+FuserStats ScanFuser::stats() const { return stats_; }
+
+}  // namespace fusion
+}  // namespace ouster
@@ -10,7 +10,12 @@
 #include <Eigen/Core>
 #include <Eigen/LU>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
 namespace ouster {
@@ -59,41 +64,76 @@ AutoExposure::AutoExposure(double lo_percentile, double hi_percentile,
       hi_percentile(hi_percentile),
       ae_update_every(update_every) {}
 
-template <typename T>
-void AutoExposure::update(Eigen::Ref<img_t<T>> image, bool update_state) {
-    Eigen::Map<Eigen::Array<T, -1, 1>> key_eigen(image.data(), image.size());
+namespace {
+
+/*
+ * Order preserving key of a positive float: the bits of positive IEEE floats
+ * compare like unsigned integers
+ */
+inline uint32_t float_key(float x) {
+    uint32_t key;
+    std::memcpy(&key, &x, sizeof(key));
+    return key;
+}
+
+inline float key_float(uint32_t key) {
+    float x;
+    std::memcpy(&x, &key, sizeof(x));
+    return x;
+}
+
+/*
+ * Find the key of rank k, counting from zero, with a most significant digit
+ * first radix select. Digits of 12, 10 and 10 bits keep histograms small
+ * enough to stay in cache.
+ */
+uint32_t radix_select(const std::vector<uint32_t>& keys, size_t k,
+                      std::vector<uint32_t>& hist) {
+    uint32_t prefix = 0;
+    uint32_t prefix_mask = 0;
+    int shift = 32;
+    for (int bits : {12, 10, 10}) {
+        shift -= bits;
+        const uint32_t digit_mask = (1u << bits) - 1;
+        hist.assign(digit_mask + 1, 0);
+        for (uint32_t key : keys)
+            if ((key & prefix_mask) == prefix)
+                hist[(key >> shift) & digit_mask]++;
+
+        uint32_t digit = 0;
+        while (k >= hist[digit]) k -= hist[digit++];
+        prefix |= digit << shift;
+        prefix_mask |= digit_mask << shift;
+    }
+    return prefix;
+}
+
+}  // namespace
 
-    // int a;
+template <typename T>
+bool AutoExposure::update_scaling(const T* data, size_t n, bool update_state,
+                                  double& scale, double& offset) {
     if (counter == 0 && update_state) {
-        const size_t n = key_eigen.rows();
-        std::vector<size_t> indices;
-        indices.reserve(n);
+        // ignore 0 values, which are often due to dropped packets etc. Values
+        // are selected in single precision, which is plenty for scaling
+        keys.clear();
         for (size_t i = 0; i < n; i += ae_stride) {
-            // ignore 0 values, which are often due to dropped packets etc
-            if (key_eigen[i] > 0) {
-                indices.push_back(i);
-            }
+            const float x = static_cast<float>(data[i]);
+            if (x > 0) keys.push_back(float_key(x));
         }
-        if (indices.size() < ae_min_nonzero_points) {
+        if (keys.size() < ae_min_nonzero_points) {
             // too few nonzero values, nothing to do
-            return;
+            return false;
         }
-        auto cmp = [&](const size_t a, const size_t b) {
-            return key_eigen(a) < key_eigen(b);
-        };
 
         const size_t lo_kth_extreme =
-            static_cast<size_t>(indices.size() * lo_percentile);
-        std::nth_element(indices.begin(), indices.begin() + lo_kth_extreme,
-                         indices.end(), cmp);
-        lo = key_eigen[*(indices.begin() + lo_kth_extreme)];
+            static_cast<size_t>(keys.size() * lo_percentile);
+        lo = key_float(radix_select(keys, lo_kth_extreme, hist));
 
         const size_t hi_kth_extreme =
-            static_cast<size_t>(indices.size() * hi_percentile);
-        std::nth_element(indices.begin() + lo_kth_extreme,
-                         indices.end() - hi_kth_extreme - 1, indices.end(),
-                         cmp);
-        hi = key_eigen[*(indices.end() - hi_kth_extreme - 1)];
+            static_cast<size_t>(keys.size() * hi_percentile);
+        hi = key_float(
+            radix_select(keys, keys.size() - hi_kth_extreme - 1, hist));
 
         if (!initialized) {
             initialized = true;
@@ -102,7 +142,7 @@ void AutoExposure::update(Eigen::Ref<img_t<T>> image, bool update_state) {
         }
     }
     if (!initialized) {
-        return;
+        return false;
     }
 
     // we use the simplest form of exponential smoothing
@@ -120,24 +160,38 @@ void AutoExposure::update(Eigen::Ref<img_t<T>> image, bool update_state) {
     if (std::isinf(lo_hi_scale) || std::isnan(lo_hi_scale)) {
         // map everything relative to hi_state being 0.5 due to small spread or
         // nan
-        key_eigen *= 0.5 / hi_state;
+        scale = 0.5 / hi_state;
+        offset = 0.0;
     } else if (lo_hi_scale * (0.0 - lo_state) + lo_percentile <= 0.00) {
         // apply affine transformation
-        key_eigen -= lo_state;
-        key_eigen *= lo_hi_scale;
-        key_eigen += lo_percentile;
+        scale = lo_hi_scale;
+        offset = lo_percentile - lo_state * lo_hi_scale;
     } else {
         // lo_hi_state transformation would map 0 to positive number
         // instead, map using only hi_state
-        key_eigen *= (1.0 - hi_percentile) / (hi_state);
+        scale = (1.0 - hi_percentile) / (hi_state);
+        offset = 0.0;
     }
 
-    // clamp
-    key_eigen = key_eigen.max(0.0).min(1.0);
-
     if (update_state) {
         counter = (counter + 1) % ae_update_every;
     }
+    return true;
+}
+
+template <typename T>
+void AutoExposure::update(Eigen::Ref<img_t<T>> image, bool update_state) {
+    Eigen::Map<Eigen::Array<T, -1, 1>> key_eigen(image.data(), image.size());
+
+    double scale, offset;
+    if (!update_scaling(image.data(), image.size(), update_state, scale,
+                        offset))
+        return;
+
+    // scale and clamp in a single pass
+    key_eigen = (key_eigen * static_cast<T>(scale) + static_cast<T>(offset))
+                    .max(T{0})
+                    .min(T{1});
 }
 
 // use overloads vs templates so implicit conversion to Eigen::Ref still works
@@ -151,6 +205,17 @@ void AutoExposure::operator()(Eigen::Ref<img_t<double>> image,
     update(image, update_state);
 }
 
+bool AutoExposure::scaling(const Eigen::Ref<const img_t<uint32_t>>& image,
+                           double& scale, double& offset, bool update_state) {
+    // sample in storage order, as when scaling in place
+    if (image.outerStride() == image.cols())
+        return update_scaling(image.data(), image.size(), update_state, scale,
+                              offset);
+    const img_t<uint32_t> contiguous = image;
+    return update_scaling(contiguous.data(), contiguous.size(), update_state,
+                          scale, offset);
+}
+
 namespace {
 
 /*
@@ -169,51 +234,101 @@ const int buc_update_every = 8;
 
 }  // namespace
 
+BeamUniformityCorrector::BeamUniformityCorrector()
+    : BeamUniformityCorrector(buc_update_every, 1) {}
+
+BeamUniformityCorrector::BeamUniformityCorrector(int update_every,
+                                                 int column_stride,
+                                                 int n_threads)
+    : update_every(update_every),
+      column_stride(column_stride),
+      n_threads(n_threads) {
+    if (update_every < 1 || column_stride < 1 || n_threads < 1)
+        throw std::invalid_argument("invalid beam uniformity parameters");
+}
+
+namespace {
+
+/*
+ * Run f(band, rows_begin, rows_end) over bands of rows in [0, n_rows), using
+ * the calling thread for the first band
+ */
+template <typename F>
+void for_row_bands(size_t n_rows, int n_threads, F&& f) {
+    const size_t n_bands =
+        std::max<size_t>(1, std::min<size_t>(n_threads, n_rows));
+    const size_t band = (n_rows + n_bands - 1) / n_bands;
+    std::vector<std::thread> workers;
+    for (size_t b = 1; b < n_bands; b++) {
+        const size_t begin = std::min(b * band, n_rows);
+        const size_t end = std::min(begin + band, n_rows);
+        if (begin < end) workers.emplace_back(f, b, begin, end);
+    }
+    f(size_t{0}, size_t{0}, std::min(band, n_rows));
+    for (auto& w : workers) w.join();
+}
+
+}  // namespace
+
 /*
  * computes the dark count, i.e. an additive offset in the brightness of the
  * image, to smoothe the difference between rows
  */
 template <typename T>
-static Eigen::Array<T, -1, 1> compute_dark_count(
+Eigen::ArrayXd BeamUniformityCorrector::compute_dark_count(
     const Eigen::Ref<img_t<T>>& image) {
     const size_t image_h = image.rows();
     const size_t image_w = image.cols();
 
-    Eigen::Array<T, -1, 1> tmp{image_w};
-    Eigen::Array<T, -1, 1> new_dark_count{image_h};
-
-    // probably computed lazily when used below?
-    auto row_diffs = image.bottomRows(image_h - 1) - image.topRows(image_h - 1);
-
     // to handle azimuth-masked data, only consider columns with nonzero values
-    Eigen::Array<bool, -1, 1> col_mask =
-        image.template cast<bool>().colwise().any();
-    const size_t n_cols = col_mask.count();
-
-    img_t<T> row_diffs_nonzero{image_h - 1, n_cols};
-    for (size_t i = 0, j = 0; i < image_w && j < n_cols; i++) {
-        if (col_mask[i]) {
-            row_diffs_nonzero.col(j) = row_diffs.col(i);
-            j++;
-        }
+    col_mask.assign(image_w, 0);
+    for (size_t u = 0; u < image_h; u++) {
+        const T* row = image.row(u).data();
+        for (size_t v = 0; v < image_w; v++) col_mask[v] |= row[v] != T{0};
     }
-
-    // compute the median of differences between rows
-    for (size_t i = 1; i < image_h; i++) {
-        tmp = row_diffs_nonzero.row(i - 1);
-        std::nth_element(tmp.data(), tmp.data() + n_cols / 2,
-                         tmp.data() + n_cols);
-        new_dark_count[i] = new_dark_count[i - 1] + tmp[n_cols / 2];
+    cols.clear();
+    for (size_t v = phase; v < image_w; v += column_stride)
+        if (col_mask[v]) cols.push_back(v);
+    phase = (phase + 1) % column_stride;
+    const size_t n_cols = cols.size();
+
+    // compute the median of differences between rows, in bands of rows with
+    // a scratch row per thread
+    row_medians.setZero(image_h);
+    diffs.resize(n_cols * n_threads);
+    if (n_cols > 0) {
+        auto medians = [&](size_t band, size_t begin, size_t end) {
+            double* tmp = diffs.data() + band * n_cols;
+            for (size_t u = std::max<size_t>(begin, 1); u < end; u++) {
+                const T* row = image.row(u).data();
+                const T* prev = image.row(u - 1).data();
+                for (size_t j = 0; j < n_cols; j++)
+                    tmp[j] = row[cols[j]] - prev[cols[j]];
+                std::nth_element(tmp, tmp + n_cols / 2, tmp + n_cols);
+                row_medians[u] = tmp[n_cols / 2];
+            }
+        };
+        for_row_bands(image_h, n_threads, medians);
     }
 
-    // remove gradients in the entire height of image by doing linear fit
-    Eigen::Matrix<T, -1, 2> A(image_h, 2);
-    for (size_t i = 0; i < image_h; i++) {
-        A(i, 0) = 1;
-        A(i, 1) = static_cast<T>(i);
+    Eigen::ArrayXd new_dark_count(image_h);
+    new_dark_count[0] = 0;
+    for (size_t u = 1; u < image_h; u++)
+        new_dark_count[u] = new_dark_count[u - 1] + row_medians[u];
+
+    // remove gradients in the entire height of image by doing linear fit,
+    // solving the normal equations of the line in closed form
+    const double n = static_cast<double>(image_h);
+    const double mean_u = (n - 1) / 2;
+    const double mean_dc = new_dark_count.mean();
+    double cov = 0, var = 0;
+    for (size_t u = 0; u < image_h; u++) {
+        cov += (u - mean_u) * (new_dark_count[u] - mean_dc);
+        var += (u - mean_u) * (u - mean_u);
     }
-    Eigen::Matrix<T, 2, 1> x = A.fullPivLu().solve(new_dark_count.matrix());
-    new_dark_count -= (A * x).array();
+    const double slope = var > 0 ? cov / var : 0.0;
+    for (size_t u = 0; u < image_h; u++)
+        new_dark_count[u] -= mean_dc + slope * (u - mean_u);
 
     // subtract minimum value
     new_dark_count -= new_dark_count.minCoeff();
@@ -227,21 +342,21 @@ void BeamUniformityCorrector::update(Eigen::Ref<img_t<T>> image,
 
     // compute dark counts, if necessary
     if (dark_count.size() != image_h) {
-        dark_count = compute_dark_count(image).template cast<double>();
+        dark_count = compute_dark_count(image);
     } else if (update_state && counter == 0) {
         // if previous state exists, update using exponential smoothing:
-        Eigen::ArrayXd new_dark_count =
-            compute_dark_count(image).template cast<double>();
         dark_count *= buc_damping;
-        dark_count += new_dark_count * (1.0 - buc_damping);
+        dark_count += compute_dark_count(image) * (1.0 - buc_damping);
     }
-    counter = (counter + 1) % buc_update_every;
-
-    // apply the dark count correction
-    image.colwise() -= dark_count.cast<T>();
-
-    // clamp any negative values
-    image = image.cwiseMax(0.0);
+    counter = (counter + 1) % update_every;
+
+    // apply the dark count correction and clamp any negative values
+    auto correct = [&](size_t, size_t begin, size_t end) {
+        for (size_t u = begin; u < end; u++)
+            image.row(u) =
+                (image.row(u) - static_cast<T>(dark_count[u])).max(T{0});
+    };
+    for_row_bands(image_h, n_threads, correct);
 }
 
 void BeamUniformityCorrector::operator()(Eigen::Ref<img_t<float>> image,
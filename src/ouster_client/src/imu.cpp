@@ -0,0 +1,230 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/imu.h"
+
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+
+namespace {
+
+constexpr double deg_to_rad = M_PI / 180.0;
+constexpr double standard_g = 9.80665;
+
+// rotation by an angle-axis vector, in radians
+Eigen::Quaterniond rotation_exp(const Eigen::Vector3d& rv) {
+    const double angle = rv.norm();
+    if (angle < 1e-12) return Eigen::Quaterniond::Identity();
+    return Eigen::Quaterniond(Eigen::AngleAxisd(angle, rv / angle));
+}
+
+// the timestamps of the first and last valid columns of a scan
+bool valid_range(const LidarScan& scan, uint64_t& first, uint64_t& last) {
+    const auto ts = scan.timestamp();
+    const auto status = scan.status();
+    bool any = false;
+    for (std::ptrdiff_t v = 0; v < scan.w; v++) {
+        if (!(status[v] & 0x01) || ts[v] == 0) continue;
+        first = any ? std::min(first, ts[v]) : ts[v];
+        last = any ? std::max(last, ts[v]) : ts[v];
+        any = true;
+    }
+    return any;
+}
+
+/*
+ * Orientation, velocity and position of the IMU relative to the first sample,
+ * with the rates and accelerations of each interval averaged at both ends
+ * and held before the first and after the last sample.
+ */
+class Integrator {
+   public:
+    explicit Integrator(const ImuSeries& imu) : ts_{imu.gyro_ts} {
+        const size_t n = imu.size();
+        rates_.resize(n);
+        accels_.resize(n);
+        for (size_t k = 0; k < n; k++) {
+            rates_[k] = deg_to_rad *
+                        imu.angular_velocity.row(k).transpose().cast<double>();
+            accels_[k] =
+                standard_g * imu.acceleration.row(k).transpose().cast<double>();
+        }
+        first_rate_ = rates_[0];
+        first_accel_ = accels_[0];
+        for (size_t k = 0; k + 1 < n; k++) {
+            rates_[k] = 0.5 * (rates_[k] + rates_[k + 1]);
+            accels_[k] = 0.5 * (accels_[k] + accels_[k + 1]);
+        }
+
+        q_.resize(n);
+        v_.resize(n);
+        p_.resize(n);
+        q_[0].setIdentity();
+        v_[0].setZero();
+        p_[0].setZero();
+        for (size_t k = 1; k < n; k++)
+            advance(k - 1, (ts_[k] - ts_[k - 1]) * 1e-9, q_[k], v_[k], p_[k]);
+    }
+
+    // the state at time t, in ns
+    void at(uint64_t t, Eigen::Quaterniond& q, Eigen::Vector3d& v,
+            Eigen::Vector3d& p) const {
+        auto it = std::upper_bound(ts_.data(), ts_.data() + ts_.size(), t);
+        const size_t k =
+            it == ts_.data() ? 0 : static_cast<size_t>(it - ts_.data()) - 1;
+        const double dt = (static_cast<double>(t) - ts_[k]) * 1e-9;
+        // before the first sample, hold its own rates rather than averages
+        if (it == ts_.data())
+            advance(0, dt, q, v, p, first_rate_, first_accel_);
+        else
+            advance(k, dt, q, v, p, rates_[k], accels_[k]);
+    }
+
+   private:
+    void advance(size_t k, double dt, Eigen::Quaterniond& q,
+                 Eigen::Vector3d& v, Eigen::Vector3d& p) const {
+        advance(k, dt, q, v, p, rates_[k], accels_[k]);
+    }
+
+    // constant rate and acceleration for dt from sample k, rotating the
+    // acceleration by the orientation halfway
+    void advance(size_t k, double dt, Eigen::Quaterniond& q,
+                 Eigen::Vector3d& v, Eigen::Vector3d& p,
+                 const Eigen::Vector3d& rate,
+                 const Eigen::Vector3d& accel) const {
+        const Eigen::Vector3d a =
+            q_[k] * (rotation_exp(rate * dt / 2) * accel);
+        q = (q_[k] * rotation_exp(rate * dt)).normalized();
+        v = v_[k] + a * dt;
+        p = p_[k] + v_[k] * dt + 0.5 * a * dt * dt;
+    }
+
+    const ImuSeries::Timestamps& ts_;
+    std::vector<Eigen::Vector3d> rates_, accels_;
+    Eigen::Vector3d first_rate_, first_accel_;
+    std::vector<Eigen::Quaterniond,
+                Eigen::aligned_allocator<Eigen::Quaterniond>>
+        q_;
+    std::vector<Eigen::Vector3d> v_, p_;
+};
+
+}  // namespace
+
+ImuBatcher::ImuBatcher(const sensor::sensor_info& info, size_t max_samples)
+    : pf_{sensor::get_format(info)}, max_samples_{max_samples} {
+    if (max_samples < 2)
+        throw std::invalid_argument("expected room for at least two samples");
+}
+
+bool ImuBatcher::operator()(const uint8_t* imu_buf) {
+    Sample s{pf_.imu_sys_ts(imu_buf),
+             pf_.imu_accel_ts(imu_buf),
+             pf_.imu_gyro_ts(imu_buf),
+             {pf_.imu_la_x(imu_buf), pf_.imu_la_y(imu_buf),
+              pf_.imu_la_z(imu_buf)},
+             {pf_.imu_av_x(imu_buf), pf_.imu_av_y(imu_buf),
+              pf_.imu_av_z(imu_buf)}};
+    if (!samples_.empty() && s.gyro_ts <= samples_.back().gyro_ts) {
+        dropped_++;
+        return false;
+    }
+    if (samples_.size() == max_samples_) {
+        samples_.pop_front();
+        dropped_++;
+    }
+    samples_.push_back(s);
+    return true;
+}
+
+bool ImuBatcher::operator()(const LidarScan& scan, ImuSeries& series) {
+    uint64_t first = 0, last = 0;
+    if (!valid_range(scan, first, last)) return false;
+    if (samples_.empty() || samples_.back().gyro_ts < last) return false;
+
+    auto before = [](uint64_t t, const Sample& s) { return t < s.gyro_ts; };
+    auto after = [](const Sample& s, uint64_t t) { return s.gyro_ts < t; };
+    // the last sample at or before the first column, or the first sample
+    auto b = std::upper_bound(samples_.begin(), samples_.end(), first, before);
+    if (b != samples_.begin()) b--;
+    // the first sample at or after the last column
+    auto e = std::lower_bound(b, samples_.end(), last, after) + 1;
+
+    const auto n = static_cast<std::ptrdiff_t>(e - b);
+    series.sys_ts.resize(n);
+    series.accel_ts.resize(n);
+    series.gyro_ts.resize(n);
+    series.acceleration.resize(n, 3);
+    series.angular_velocity.resize(n, 3);
+    std::ptrdiff_t k = 0;
+    for (auto it = b; it != e; ++it, ++k) {
+        series.sys_ts[k] = it->sys_ts;
+        series.accel_ts[k] = it->accel_ts;
+        series.gyro_ts[k] = it->gyro_ts;
+        for (int c = 0; c < 3; c++) {
+            series.acceleration(k, c) = it->acceleration[c];
+            series.angular_velocity(k, c) = it->angular_velocity[c];
+        }
+    }
+
+    // later scans start from the last sample at or before this one's end
+    auto keep =
+        std::upper_bound(samples_.begin(), samples_.end(), last, before);
+    if (keep != samples_.begin()) samples_.erase(samples_.begin(), keep - 1);
+    return true;
+}
+
+size_t ImuBatcher::size() const { return samples_.size(); }
+
+uint64_t ImuBatcher::dropped() const { return dropped_; }
+
+void preintegrate(const LidarScan& scan, const ImuSeries& imu,
+                  uint64_t ref_ts, ImuDeltas& deltas) {
+    if (imu.size() == 0) throw std::invalid_argument("no imu samples");
+    for (size_t k = 1; k < imu.size(); k++)
+        if (imu.gyro_ts[k] < imu.gyro_ts[k - 1])
+            throw std::invalid_argument("imu samples not sorted by timestamp");
+
+    const Integrator integrator{imu};
+    Eigen::Quaterniond q_ref;
+    Eigen::Vector3d v_ref, p_ref;
+    integrator.at(ref_ts, q_ref, v_ref, p_ref);
+    const Eigen::Quaterniond ref_inv = q_ref.conjugate();
+
+    deltas.rotation.resize(scan.w, 4);
+    deltas.velocity.resize(scan.w, 3);
+    deltas.position.resize(scan.w, 3);
+    deltas.rotation.setZero();
+    deltas.rotation.col(3).setOnes();
+    deltas.velocity.setZero();
+    deltas.position.setZero();
+
+    const auto ts = scan.timestamp();
+    const auto status = scan.status();
+    for (std::ptrdiff_t v = 0; v < scan.w; v++) {
+        if (!(status[v] & 0x01)) continue;
+        Eigen::Quaterniond q;
+        Eigen::Vector3d vel, pos;
+        integrator.at(ts[v], q, vel, pos);
+        const double dt =
+            (static_cast<double>(ts[v]) - static_cast<double>(ref_ts)) * 1e-9;
+        const Eigen::Quaterniond rot = ref_inv * q;
+        deltas.rotation.row(v) << rot.x(), rot.y(), rot.z(), rot.w();
+        deltas.velocity.row(v) = (ref_inv * (vel - v_ref)).transpose();
+        deltas.position.row(v) =
+            (ref_inv * (pos - p_ref - v_ref * dt)).transpose();
+    }
+}
+
+}  // namespace ouster
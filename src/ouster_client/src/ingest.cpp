@@ -0,0 +1,425 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/ingest.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "netcompat.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ouster {
+
+namespace sensor {
+namespace impl {
+// defined in client.cpp
+int32_t get_sock_port(SOCKET sock_fd);
+SOCKET udp_data_socket(int port);
+}  // namespace impl
+}  // namespace sensor
+
+namespace ingest {
+
+namespace simpl = sensor::impl;
+
+namespace {
+
+// max datagrams read from a socket in one go
+constexpr int MAX_RECV_BATCH = 64;
+
+// how often receive threads check for shutdown
+constexpr long POLL_TIMEOUT_US = 100000;
+
+// source addresses are compared as IPv6, with IPv4 addresses mapped
+using addr_t = std::array<uint8_t, 16>;
+
+addr_t to_addr(const struct sockaddr* sa) {
+    addr_t addr{};
+    if (sa->sa_family == AF_INET) {
+        const auto* sin = reinterpret_cast<const struct sockaddr_in*>(sa);
+        addr[10] = 0xff;
+        addr[11] = 0xff;
+        std::memcpy(addr.data() + 12, &sin->sin_addr, 4);
+    } else if (sa->sa_family == AF_INET6) {
+        const auto* sin6 = reinterpret_cast<const struct sockaddr_in6*>(sa);
+        std::memcpy(addr.data(), &sin6->sin6_addr, 16);
+    }
+    return addr;
+}
+
+addr_t resolve_addr(const std::string& host) {
+    struct addrinfo hints, *info;
+    std::memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    int ret = getaddrinfo(host.c_str(), NULL, &hints, &info);
+    if (ret != 0 || info == NULL)
+        throw std::invalid_argument("Failed to resolve sensor address: " +
+                                    host);
+
+    addr_t addr = to_addr(info->ai_addr);
+    freeaddrinfo(info);
+    return addr;
+}
+
+}  // namespace
+
+struct Session {
+    Session(int id, const addr_t& addr, bool any_src, int port,
+            const sensor::sensor_info& info, size_t pool_size,
+            ScanHandler handler)
+        : id(id),
+          addr(addr),
+          any_src(any_src),
+          port(port),
+          packet_size(sensor::get_format(info).lidar_packet_size),
+          batcher(info),
+          pool(info.format.columns_per_frame, info.format.pixels_per_column,
+               info.format.udp_profile_lidar, pool_size),
+          handler(std::move(handler)) {}
+
+    const int id;
+    const addr_t addr;
+    const bool any_src;
+    const int port;
+    const size_t packet_size;
+
+    // the batcher may be fed from several threads if the kernel doesn't keep
+    // a sensor on the same socket; also serializes calls to the handler
+    std::mutex mtx;
+    ScanBatcher batcher;
+    LidarScanPool pool;
+    ScanHandler handler;
+
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> bad_packets{0};
+    std::atomic<uint64_t> scans{0};
+};
+
+/*
+ * All sessions sending to the same local port
+ */
+struct PortGroup {
+    int port;
+    SOCKET first_sock;
+    size_t max_packet_size{0};
+    std::vector<Session*> sessions;
+    Session* any_src{nullptr};
+
+    Session* find_exact(const addr_t& addr) const {
+        for (auto* s : sessions)
+            if (s->addr == addr) return s;
+        return nullptr;
+    }
+
+    Session* find(const addr_t& addr) const {
+        Session* s = find_exact(addr);
+        return s ? s : any_src;
+    }
+};
+
+struct Worker {
+    int index;
+    std::vector<std::pair<SOCKET, PortGroup*>> socks;
+    std::thread thread;
+};
+
+struct Engine::Impl {
+    EngineConfig config;
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::vector<std::unique_ptr<PortGroup>> groups;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<SOCKET> extra_socks;
+    std::atomic<bool> running{false};
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> unknown_packets{0};
+
+    ~Impl() {
+        for (const auto& g : groups) simpl::socket_close(g->first_sock);
+        for (auto sock : extra_socks) simpl::socket_close(sock);
+    }
+
+    PortGroup& group_for(int port);
+    void open_sockets();
+    void run(Worker& w);
+    void dispatch(const PortGroup& group, const struct sockaddr* src,
+                  const uint8_t* buf, size_t len, uint64_t rx_ts);
+};
+
+PortGroup& Engine::Impl::group_for(int port) {
+    if (port != 0) {
+        for (auto& g : groups)
+            if (g->port == port) return *g;
+    }
+
+    SOCKET sock = simpl::udp_data_socket(port);
+    if (!simpl::socket_valid(sock))
+        throw std::runtime_error("Failed to bind lidar port " +
+                                 std::to_string(port));
+
+    // best effort: fall back to reading the clock in userspace
+    simpl::socket_set_rx_timestamps(sock);
+
+    auto group = std::make_unique<PortGroup>();
+    group->port = simpl::get_sock_port(sock);
+    group->first_sock = sock;
+    groups.push_back(std::move(group));
+    return *groups.back();
+}
+
+/*
+ * Assign sockets to receive threads. With SO_REUSEPORT, each thread gets its
+ * own socket for every port; otherwise ports are spread over threads
+ */
+void Engine::Impl::open_sockets() {
+    const int n_threads = std::max(config.n_threads, 1);
+    for (int i = 0; i < n_threads; i++) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->index = i;
+    }
+
+    for (size_t ig = 0; ig < groups.size(); ig++) {
+        PortGroup* g = groups[ig].get();
+#ifdef __linux__
+        workers[0]->socks.emplace_back(g->first_sock, g);
+        for (int i = 1; i < n_threads; i++) {
+            SOCKET sock = simpl::udp_data_socket(g->port);
+            if (!simpl::socket_valid(sock))
+                throw std::runtime_error("Failed to bind lidar port " +
+                                         std::to_string(g->port));
+            simpl::socket_set_rx_timestamps(sock);
+            extra_socks.push_back(sock);
+            workers[i]->socks.emplace_back(sock, g);
+        }
+#else
+        workers[ig % n_threads]->socks.emplace_back(g->first_sock, g);
+#endif
+    }
+
+    if (!config.pin_threads) return;
+    for (auto& w : workers) {
+        for (const auto& s : w->socks) {
+            if (simpl::socket_set_incoming_cpu(s.first,
+                                               config.first_cpu + w->index))
+                std::cerr << "udp setsockopt(SO_INCOMING_CPU): "
+                          << simpl::socket_get_error() << std::endl;
+        }
+    }
+}
+
+void Engine::Impl::dispatch(const PortGroup& group, const struct sockaddr* src,
+                            const uint8_t* buf, size_t len, uint64_t rx_ts) {
+    Session* s = group.find(to_addr(src));
+    if (!s) {
+        unknown_packets++;
+        return;
+    }
+
+    s->packets++;
+    if (len != s->packet_size) {
+        s->bad_packets++;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{s->mtx};
+    auto scan = s->batcher(buf, s->pool, rx_ts);
+    if (scan) {
+        s->scans++;
+        s->handler(s->id, std::move(scan));
+    }
+}
+
+void Engine::Impl::run(Worker& w) {
+#ifdef __linux__
+    if (config.pin_threads) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config.first_cpu + w.index, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus))
+            std::cerr << "ingest: failed to pin receive thread " << w.index
+                      << std::endl;
+    }
+#endif
+
+    size_t buf_size = 0;
+    for (const auto& s : w.socks)
+        buf_size = std::max(buf_size, s.second->max_packet_size + 1);
+
+    // one extra byte to detect oversized packets
+    std::vector<uint8_t> storage(buf_size * MAX_RECV_BATCH);
+    std::array<struct sockaddr_storage, MAX_RECV_BATCH> addrs;
+
+#ifdef __linux__
+    using control_t =
+        std::array<char, simpl::socket_rx_timestamp_control_size>;
+    std::array<struct mmsghdr, MAX_RECV_BATCH> msgs;
+    std::array<struct iovec, MAX_RECV_BATCH> iovs;
+    alignas(struct cmsghdr) std::array<control_t, MAX_RECV_BATCH> controls;
+#endif
+
+    while (!stop) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        SOCKET max_fd = 0;
+        for (const auto& s : w.socks) {
+            FD_SET(s.first, &rfds);
+            max_fd = std::max(max_fd, s.first);
+        }
+
+        timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = POLL_TIMEOUT_US;
+        SOCKET retval = select((int)max_fd + 1, &rfds, NULL, NULL, &tv);
+        if (!simpl::socket_valid(retval)) {
+            if (simpl::socket_exit()) continue;
+            std::cerr << "select: " << simpl::socket_get_error() << std::endl;
+            break;
+        }
+        if (retval == 0) continue;
+
+        for (const auto& s : w.socks) {
+            if (!FD_ISSET(s.first, &rfds)) continue;
+            const PortGroup& group = *s.second;
+
+            // drain the socket
+            int n = 0;
+            do {
+#ifdef __linux__
+                for (int i = 0; i < MAX_RECV_BATCH; i++) {
+                    iovs[i].iov_base = storage.data() + i * buf_size;
+                    iovs[i].iov_len = buf_size;
+                    std::memset(&msgs[i], 0, sizeof(msgs[i]));
+                    msgs[i].msg_hdr.msg_name = &addrs[i];
+                    msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+                    msgs[i].msg_hdr.msg_iov = &iovs[i];
+                    msgs[i].msg_hdr.msg_iovlen = 1;
+                    msgs[i].msg_hdr.msg_control = controls[i].data();
+                    msgs[i].msg_hdr.msg_controllen = controls[i].size();
+                }
+                n = recvmmsg(s.first, msgs.data(), MAX_RECV_BATCH,
+                             MSG_DONTWAIT, nullptr);
+                if (n < 0) {
+                    if (!simpl::socket_would_block())
+                        std::cerr << "recvmmsg: " << simpl::socket_get_error()
+                                  << std::endl;
+                    break;
+                }
+                for (int i = 0; i < n; i++)
+                    dispatch(group,
+                             reinterpret_cast<struct sockaddr*>(&addrs[i]),
+                             storage.data() + i * buf_size, msgs[i].msg_len,
+                             simpl::socket_msg_rx_timestamp(msgs[i].msg_hdr));
+#else
+                for (n = 0; n < MAX_RECV_BATCH; n++) {
+                    socklen_t addrlen = sizeof(addrs[0]);
+                    int64_t bytes_read =
+                        recvfrom(s.first, (char*)storage.data(), buf_size, 0,
+                                 (struct sockaddr*)&addrs[0], &addrlen);
+                    if (bytes_read < 0) {
+                        if (!simpl::socket_would_block())
+                            std::cerr << "recvfrom: "
+                                      << simpl::socket_get_error()
+                                      << std::endl;
+                        break;
+                    }
+                    dispatch(group, (struct sockaddr*)&addrs[0],
+                             storage.data(), bytes_read,
+                             simpl::socket_rx_timestamp_now());
+                }
+#endif
+            } while (n == MAX_RECV_BATCH && !stop);
+        }
+    }
+}
+
+Engine::Engine(const EngineConfig& config) : impl_(std::make_unique<Impl>()) {
+    impl_->config = config;
+}
+
+Engine::~Engine() { stop(); }
+
+int Engine::add_sensor(const std::string& src_ip, int port,
+                       const sensor::sensor_info& info, ScanHandler handler) {
+    if (impl_->running)
+        throw std::invalid_argument("Can't add sensors to a running engine");
+
+    const bool any_src = src_ip.empty();
+    const addr_t addr = any_src ? addr_t{} : resolve_addr(src_ip);
+
+    // check for duplicates before binding anything
+    for (const auto& g : impl_->groups) {
+        if (port == 0 || g->port != port) continue;
+        if (any_src ? g->any_src != nullptr : g->find_exact(addr) != nullptr)
+            throw std::invalid_argument("Sensor already added on port " +
+                                        std::to_string(port));
+    }
+
+    PortGroup& group = impl_->group_for(port);
+
+    const int id = static_cast<int>(impl_->sessions.size());
+    impl_->sessions.push_back(std::make_unique<Session>(
+        id, addr, any_src, group.port, info, impl_->config.pool_size,
+        std::move(handler)));
+    Session* s = impl_->sessions.back().get();
+
+    if (any_src)
+        group.any_src = s;
+    else
+        group.sessions.push_back(s);
+    group.max_packet_size = std::max(group.max_packet_size, s->packet_size);
+    return id;
+}
+
+int Engine::get_port(int sensor_id) const {
+    return impl_->sessions.at(sensor_id)->port;
+}
+
+SensorStats Engine::get_stats(int sensor_id) const {
+    const Session& s = *impl_->sessions.at(sensor_id);
+    return {s.packets, s.bad_packets, s.scans};
+}
+
+uint64_t Engine::unknown_packets() const { return impl_->unknown_packets; }
+
+void Engine::start() {
+    if (impl_->running) return;
+    if (impl_->workers.empty()) impl_->open_sockets();
+
+    impl_->stop = false;
+    impl_->running = true;
+    for (auto& w : impl_->workers) {
+        Worker* wp = w.get();
+        w->thread = std::thread([this, wp]() { impl_->run(*wp); });
+    }
+}
+
+void Engine::stop() {
+    if (!impl_->running) return;
+    impl_->stop = true;
+    for (auto& w : impl_->workers)
+        if (w->thread.joinable()) w->thread.join();
+    impl_->running = false;
+}
+
+}  // namespace ingest
+}  // namespace ouster
@@ -6,14 +6,25 @@
 #include "ouster/lidar_scan.h"
 
 #include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
 #include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
 #include "ouster/impl/lidar_scan_impl.h"
+#include "ouster/trace.h"
 #include "ouster/types.h"
+#include "parsing_kernels.h"
 
 namespace ouster {
 
@@ -22,12 +33,9 @@ using sensor::ChanFieldType;
 using sensor::UDPProfileLidar;
 
 constexpr int LidarScan::N_FIELDS;
+constexpr size_t LidarScan::arena_alignment;
 
 LidarScan::LidarScan() = default;
-LidarScan::LidarScan(const LidarScan&) = default;
-LidarScan::LidarScan(LidarScan&&) = default;
-LidarScan& LidarScan::operator=(const LidarScan&) = default;
-LidarScan& LidarScan::operator=(LidarScan&&) = default;
 LidarScan::~LidarScan() = default;
 
 namespace impl {
@@ -95,32 +103,242 @@ static std::vector<std::pair<ChanField, ChanFieldType>> lookup_scan_fields(
 
 }  // namespace impl
 
+namespace {
+
+size_t align_arena(size_t n) {
+    const size_t a = LidarScan::arena_alignment;
+    return (n + a - 1) / a * a;
+}
+
+// fields of VOID type take no space, as they can't be accessed
+size_t field_type_size(ChanFieldType t) {
+    switch (t) {
+        case ChanFieldType::VOID:
+            return 0;
+        case ChanFieldType::UINT8:
+            return 1;
+        case ChanFieldType::UINT16:
+            return 2;
+        case ChanFieldType::UINT32:
+            return 4;
+        case ChanFieldType::UINT64:
+            return 8;
+        default:
+            throw std::invalid_argument("Invalid field type for LidarScan");
+    }
+}
+
+template <typename T>
+Eigen::Map<LidarScan::Header<T>> header_map(uint8_t* arena, size_t offset,
+                                            std::ptrdiff_t w) {
+    return {reinterpret_cast<T*>(arena + offset), w};
+}
+
+template <typename T>
+Eigen::Map<const LidarScan::Header<T>> header_map(const uint8_t* arena,
+                                                  size_t offset,
+                                                  std::ptrdiff_t w) {
+    return {reinterpret_cast<const T*>(arena + offset), w};
+}
+
+}  // namespace
+
+/*
+ * Headers come first, followed by the fields in the order given. When ls is
+ * not null, record the offsets of the headers and of each field.
+ */
+size_t LidarScan::layout(
+    size_t w, size_t h,
+    const std::vector<std::pair<sensor::ChanField, sensor::ChanFieldType>>&
+        field_types,
+    LidarScan* ls) {
+    size_t offset = 0;
+    auto add = [&](size_t bytes) {
+        const size_t start = offset;
+        offset = align_arena(offset + bytes);
+        if (offset > std::numeric_limits<uint32_t>::max())
+            throw std::invalid_argument("LidarScan dimensions are too large");
+        return static_cast<uint32_t>(start);
+    };
+
+    const uint32_t timestamp = add(w * sizeof(uint64_t));
+    const uint32_t measurement_id = add(w * sizeof(uint16_t));
+    const uint32_t status = add(w * sizeof(uint32_t));
+    const uint32_t rx_timestamp = add(w * sizeof(uint64_t));
+    if (ls) {
+        ls->timestamp_ = timestamp;
+        ls->measurement_id_ = measurement_id;
+        ls->status_ = status;
+        ls->rx_timestamp_ = rx_timestamp;
+    }
+
+    std::array<bool, sensor::CHAN_FIELD_MAX> seen{};
+    for (const auto& ft : field_types) {
+        if (ft.first < 0 || ft.first >= sensor::CHAN_FIELD_MAX)
+            throw std::invalid_argument("Invalid field for LidarScan");
+        if (seen[ft.first])
+            throw std::invalid_argument("Duplicated fields found");
+        seen[ft.first] = true;
+        const uint32_t start = add(w * h * field_type_size(ft.second));
+        if (ls) ls->fields_[ft.first] = {start, ft.second};
+    }
+    return offset;
+}
+
+std::vector<std::pair<ChanField, ChanFieldType>> LidarScan::profile_fields(
+    sensor::UDPProfileLidar profile) {
+    return impl::lookup_scan_fields(profile);
+}
+
 // specify sensor:: namespace for doxygen matching
 LidarScan::LidarScan(
     size_t w, size_t h,
     std::vector<std::pair<sensor::ChanField, sensor::ChanFieldType>>
-        field_types)
-    : timestamp_{Header<uint64_t>::Zero(w)},
-      measurement_id_{Header<uint16_t>::Zero(w)},
-      status_{Header<uint32_t>::Zero(w)},
-      field_types_{std::move(field_types)},
+        field_types,
+    uint8_t* arena, size_t arena_size, bool zero)
+    : field_types_{std::move(field_types)},
       w{static_cast<std::ptrdiff_t>(w)},
       h{static_cast<std::ptrdiff_t>(h)},
       headers{w, BlockHeader{ts_t{0}, 0, 0}} {
-    // TODO: error on duplicate fields
-    for (const auto& ft : field_types_) {
-        if (fields_.count(ft.first) > 0)
-            throw std::invalid_argument("Duplicated fields found");
-        fields_[ft.first] = impl::FieldSlot{ft.second, w, h};
+    arena_size_ = layout(w, h, field_types_, this);
+    if (arena) {
+        if (arena_size < arena_size_)
+            throw std::invalid_argument("LidarScan arena is too small");
+        if (reinterpret_cast<uintptr_t>(arena) % alignof(uint64_t))
+            throw std::invalid_argument("LidarScan arena is misaligned");
+        arena_ = arena;
+    } else {
+        allocate();
     }
+    if (arena_ && (zero || !arena)) std::memset(arena_, 0, arena_size_);
+}
+
+void LidarScan::allocate() {
+    if (!arena_size_) return;
+    // over-allocate to align the start of the arena
+    owned_.reset(new uint8_t[arena_size_ + arena_alignment]);
+    const auto addr = reinterpret_cast<uintptr_t>(owned_.get());
+    arena_ = owned_.get() + (align_arena(addr) - addr);
 }
 
 LidarScan::LidarScan(size_t w, size_t h, sensor::UDPProfileLidar profile)
-    : LidarScan{w, h, impl::lookup_scan_fields(profile)} {}
+    : LidarScan{w, h, profile_fields(profile)} {}
 
 LidarScan::LidarScan(size_t w, size_t h)
     : LidarScan{w, h, UDPProfileLidar::PROFILE_LIDAR_LEGACY} {}
 
+LidarScan::LidarScan(size_t w, size_t h, sensor::UDPProfileLidar profile,
+                     uint8_t* arena, size_t size, bool zero)
+    : LidarScan{w, h, profile_fields(profile), arena, size, zero} {
+    if (!arena) throw std::invalid_argument("LidarScan arena is null");
+}
+
+LidarScan::LidarScan(const LidarScan& other)
+    : arena_size_{other.arena_size_},
+      timestamp_{other.timestamp_},
+      measurement_id_{other.measurement_id_},
+      status_{other.status_},
+      rx_timestamp_{other.rx_timestamp_},
+      fields_{other.fields_},
+      field_types_{other.field_types_},
+      summary_{other.summary_},
+      stale_columns_{other.stale_columns_},
+      w{other.w},
+      h{other.h},
+      headers{other.headers},
+      frame_id{other.frame_id},
+      destaggered{other.destaggered} {
+    allocate();
+    if (arena_) std::memcpy(arena_, other.arena_, arena_size_);
+}
+
+LidarScan::LidarScan(LidarScan&& other)
+    : owned_{std::move(other.owned_)},
+      arena_{std::exchange(other.arena_, nullptr)},
+      arena_size_{std::exchange(other.arena_size_, 0)},
+      timestamp_{other.timestamp_},
+      measurement_id_{other.measurement_id_},
+      status_{other.status_},
+      rx_timestamp_{other.rx_timestamp_},
+      fields_{other.fields_},
+      field_types_{std::move(other.field_types_)},
+      summary_{other.summary_},
+      stale_columns_{other.stale_columns_},
+      w{std::exchange(other.w, 0)},
+      h{std::exchange(other.h, 0)},
+      headers{std::move(other.headers)},
+      frame_id{other.frame_id},
+      destaggered{other.destaggered} {
+    for (const auto& ft : field_types_) other.fields_[ft.first] = {};
+    other.field_types_.clear();
+    other.headers.clear();
+}
+
+LidarScan& LidarScan::operator=(const LidarScan& other) {
+    if (this == &other) return *this;
+    if (!arena_ || !same_layout(other)) return *this = LidarScan{other};
+
+    // reuse the arena, which may have been supplied by the caller
+    std::memcpy(arena_, other.arena_, arena_size_);
+    headers = other.headers;
+    frame_id = other.frame_id;
+    destaggered = other.destaggered;
+    summary_ = other.summary_;
+    stale_columns_ = other.stale_columns_;
+    return *this;
+}
+
+LidarScan& LidarScan::operator=(LidarScan&& other) {
+    if (this == &other) return *this;
+    owned_ = std::move(other.owned_);
+    arena_ = std::exchange(other.arena_, nullptr);
+    arena_size_ = std::exchange(other.arena_size_, 0);
+    timestamp_ = other.timestamp_;
+    measurement_id_ = other.measurement_id_;
+    status_ = other.status_;
+    rx_timestamp_ = other.rx_timestamp_;
+    fields_ = other.fields_;
+    field_types_ = std::move(other.field_types_);
+    other.field_types_.clear();
+    for (const auto& ft : field_types_) other.fields_[ft.first] = {};
+    w = std::exchange(other.w, 0);
+    h = std::exchange(other.h, 0);
+    headers = std::move(other.headers);
+    other.headers.clear();
+    frame_id = other.frame_id;
+    destaggered = other.destaggered;
+    summary_ = other.summary_;
+    stale_columns_ = other.stale_columns_;
+    return *this;
+}
+
+size_t LidarScan::arena_size(size_t w, size_t h,
+                             sensor::UDPProfileLidar profile) {
+    return layout(w, h, profile_fields(profile), nullptr);
+}
+
+uint8_t* LidarScan::arena() {
+    summary_.valid = false;
+    return arena_;
+}
+
+const uint8_t* LidarScan::arena() const { return arena_; }
+
+size_t LidarScan::arena_size() const { return arena_size_; }
+
+bool LidarScan::owns_arena() const { return !arena_ || owned_; }
+
+bool LidarScan::same_layout(const LidarScan& other) const {
+    return w == other.w && h == other.h && field_types_ == other.field_types_;
+}
+
+const impl::FieldSlot& LidarScan::slot(ChanField f) const {
+    if (f < 0 || f >= sensor::CHAN_FIELD_MAX ||
+        fields_[f].tag == ChanFieldType::VOID)
+        throw std::out_of_range("field is not in the scan");
+    return fields_[f];
+}
+
 std::vector<LidarScan::ts_t> LidarScan::timestamps() const {
     std::vector<LidarScan::ts_t> res;
     res.reserve(headers.size());
@@ -139,13 +357,21 @@ const LidarScan::BlockHeader& LidarScan::header(size_t m_id) const {
 template <typename T,
           typename std::enable_if<std::is_unsigned<T>::value, T>::type>
 Eigen::Ref<img_t<T>> LidarScan::field(ChanField f) {
-    return fields_.at(f).get<T>();
+    summary_.valid = false;
+    const auto& s = slot(f);
+    if (s.tag != impl::FieldTag<T>::tag)
+        throw std::invalid_argument("Accessed field at wrong type");
+    return Eigen::Map<img_t<T>>(reinterpret_cast<T*>(arena_ + s.offset), h, w);
 }
 
 template <typename T,
           typename std::enable_if<std::is_unsigned<T>::value, T>::type>
 Eigen::Ref<const img_t<T>> LidarScan::field(ChanField f) const {
-    return fields_.at(f).get<T>();
+    const auto& s = slot(f);
+    if (s.tag != impl::FieldTag<T>::tag)
+        throw std::invalid_argument("Accessed field at wrong type");
+    return Eigen::Map<const img_t<T>>(
+        reinterpret_cast<const T*>(arena_ + s.offset), h, w);
 }
 
 // explicitly instantiate for each supported field type
@@ -159,7 +385,8 @@ template Eigen::Ref<const img_t<uint32_t>> LidarScan::field(ChanField f) const;
 template Eigen::Ref<const img_t<uint64_t>> LidarScan::field(ChanField f) const;
 
 ChanFieldType LidarScan::field_type(ChanField f) const {
-    return fields_.count(f) ? fields_.at(f).tag : ChanFieldType::VOID;
+    return f >= 0 && f < sensor::CHAN_FIELD_MAX ? fields_[f].tag
+                                                : ChanFieldType::VOID;
 }
 
 LidarScan::FieldIter LidarScan::begin() const { return field_types_.cbegin(); }
@@ -167,44 +394,66 @@ LidarScan::FieldIter LidarScan::begin() const { return field_types_.cbegin(); }
 LidarScan::FieldIter LidarScan::end() const { return field_types_.cend(); }
 
 Eigen::Ref<LidarScan::Header<uint64_t>> LidarScan::timestamp() {
-    return timestamp_;
+    summary_.valid = false;
+    return header_map<uint64_t>(arena_, timestamp_, w);
 }
 Eigen::Ref<const LidarScan::Header<uint64_t>> LidarScan::timestamp() const {
-    return timestamp_;
+    return header_map<uint64_t>(arena_, timestamp_, w);
 }
 
 Eigen::Ref<LidarScan::Header<uint16_t>> LidarScan::measurement_id() {
-    return measurement_id_;
+    return header_map<uint16_t>(arena_, measurement_id_, w);
 }
 Eigen::Ref<const LidarScan::Header<uint16_t>> LidarScan::measurement_id()
     const {
-    return measurement_id_;
+    return header_map<uint16_t>(arena_, measurement_id_, w);
 }
 
-Eigen::Ref<LidarScan::Header<uint32_t>> LidarScan::status() { return status_; }
+Eigen::Ref<LidarScan::Header<uint32_t>> LidarScan::status() {
+    summary_.valid = false;
+    return header_map<uint32_t>(arena_, status_, w);
+}
 Eigen::Ref<const LidarScan::Header<uint32_t>> LidarScan::status() const {
-    return status_;
+    return header_map<uint32_t>(arena_, status_, w);
+}
+
+Eigen::Ref<LidarScan::Header<uint64_t>> LidarScan::rx_timestamp() {
+    return header_map<uint64_t>(arena_, rx_timestamp_, w);
+}
+Eigen::Ref<const LidarScan::Header<uint64_t>> LidarScan::rx_timestamp()
+    const {
+    return header_map<uint64_t>(arena_, rx_timestamp_, w);
 }
 
 bool LidarScan::complete(sensor::ColumnWindow window) const {
-    const auto& status = this->status();
-    auto start = window.first;
-    auto end = window.second;
+    const auto start = window.first;
+    const auto end = window.second;
+
+    // batched scans count the columns that arrived
+    if (summary_.valid) {
+        const std::ptrdiff_t received = summary_.cols_received;
+        const std::ptrdiff_t in_window = summary_.window_cols_received;
+        if (received == w) return true;
+        if (window == summary_.window)
+            return in_window == (end - start + w) % w + 1;
+    }
 
-    if (start <= end) {
+    const auto& status = this->status();
+    auto valid = [](uint32_t s) { return s & 0x01; };
+    if (start <= end)
         return status.segment(start, end - start + 1)
-            .unaryExpr([](uint32_t s) { return s & 0x01; })
+            .unaryExpr(valid)
             .isConstant(0x01);
-    } else {
-        return status.segment(0, end)
-                   .unaryExpr([](uint32_t s) { return s & 0x01; })
-                   .isConstant(0x01) &&
-               status.segment(start, this->w - start)
-                   .unaryExpr([](uint32_t s) { return s & 0x01; })
-                   .isConstant(0x01);
-    }
+    return status.segment(0, end + 1).unaryExpr(valid).isConstant(0x01) &&
+           status.segment(start, this->w - start)
+               .unaryExpr(valid)
+               .isConstant(0x01);
 }
 
+const ScanSummary& LidarScan::summary() const { return summary_; }
+
+bool LidarScan::stale_columns() const { return stale_columns_; }
+
 bool operator==(const LidarScan::BlockHeader& a,
                 const LidarScan::BlockHeader& b) {
     return a.timestamp == b.timestamp && a.encoder == b.encoder &&
@@ -212,11 +461,27 @@ bool operator==(const LidarScan::BlockHeader& a,
 }
 
 bool operator==(const LidarScan& a, const LidarScan& b) {
-    return a.frame_id == b.frame_id && a.w == b.w && a.h == b.h &&
-           a.fields_ == b.fields_ && a.field_types_ == b.field_types_ &&
-           (a.timestamp() == b.timestamp()).all() &&
-           (a.measurement_id() == b.measurement_id()).all() &&
-           (a.status() == b.status()).all();
+    if (a.frame_id != b.frame_id || a.destaggered != b.destaggered ||
+        !a.same_layout(b))
+        return false;
+    if (a.arena_size_ == 0) return true;
+
+    // compare each block on its own, the alignment padding between blocks is
+    // left as is in arenas viewed without zeroing
+    auto same = [&](uint32_t offset, size_t size) {
+        return std::memcmp(a.arena_ + offset, b.arena_ + offset, size) == 0;
+    };
+    const size_t w = a.w;
+    if (!same(a.timestamp_, w * sizeof(uint64_t)) ||
+        !same(a.measurement_id_, w * sizeof(uint16_t)) ||
+        !same(a.status_, w * sizeof(uint32_t)) ||
+        !same(a.rx_timestamp_, w * sizeof(uint64_t)))
+        return false;
+    for (const auto& ft : a.field_types_)
+        if (!same(a.fields_[ft.first].offset,
+                  w * a.h * field_type_size(ft.second)))
+            return false;
+    return true;
 }
 
 XYZLut make_xyz_lut(size_t w, size_t h, double range_unit,
@@ -274,30 +539,881 @@ XYZLut make_xyz_lut(size_t w, size_t h, double range_unit,
     return lut;
 }
 
+XYZLut make_xyz_lut(const sensor::sensor_info& sensor, bool destaggered) {
+    XYZLut lut = make_xyz_lut(sensor);
+    if (!destaggered) return lut;
+    if (sensor.format.pixel_shift_by_row.size() !=
+        sensor.format.pixels_per_column)
+        throw std::invalid_argument("expected a pixel shift for each row");
+
+    // each column of the tables is a row-major image of the scan
+    const Destaggerer d(sensor);
+    XYZLut res{LidarScan::Points(lut.direction.rows(), 3),
+               LidarScan::Points(lut.offset.rows(), 3)};
+    for (int c = 0; c < 3; c++) {
+        d(lut.direction.col(c).data(), res.direction.col(c).data(),
+          sizeof(double));
+        d(lut.offset.col(c).data(), res.offset.col(c).data(), sizeof(double));
+    }
+    return res;
+}
+
+namespace {
+
+// everything make_xyz_lut depends on, compared exactly
+std::vector<double> lut_key(const sensor::sensor_info& sensor,
+                            bool destaggered) {
+    const auto& f = sensor.format;
+    std::vector<double> key{static_cast<double>(f.columns_per_frame),
+                            static_cast<double>(f.pixels_per_column),
+                            sensor.lidar_origin_to_beam_origin_mm,
+                            static_cast<double>(destaggered)};
+    const auto& t = sensor.lidar_to_sensor_transform;
+    key.insert(key.end(), t.data(), t.data() + t.size());
+    key.insert(key.end(), sensor.beam_azimuth_angles.begin(),
+               sensor.beam_azimuth_angles.end());
+    key.insert(key.end(), sensor.beam_altitude_angles.begin(),
+               sensor.beam_altitude_angles.end());
+    if (destaggered)
+        key.insert(key.end(), f.pixel_shift_by_row.begin(),
+                   f.pixel_shift_by_row.end());
+    return key;
+}
+
+/*
+ * Tables in use, generated while holding the lock so that concurrent users
+ * of a sensor don't generate them twice
+ */
+template <typename L>
+struct LutCache {
+    std::mutex mtx;
+    std::map<std::vector<double>, std::weak_ptr<const L>> luts;
+
+    template <typename F>
+    std::shared_ptr<const L> get(const std::vector<double>& key, F&& make) {
+        std::lock_guard<std::mutex> lock{mtx};
+        for (auto it = luts.begin(); it != luts.end();)
+            it = it->second.expired() ? luts.erase(it) : std::next(it);
+
+        auto& entry = luts[key];
+        auto lut = entry.lock();
+        if (!lut) {
+            lut = std::make_shared<const L>(make());
+            entry = lut;
+        }
+        return lut;
+    }
+};
+
+}  // namespace
+
+std::shared_ptr<const XYZLut> shared_xyz_lut(const sensor::sensor_info& sensor,
+                                             bool destaggered) {
+    static LutCache<XYZLut> cache;
+    return cache.get(lut_key(sensor, destaggered),
+                     [&] { return make_xyz_lut(sensor, destaggered); });
+}
+
+std::shared_ptr<const XYZLutf> shared_xyz_lutf(
+    const sensor::sensor_info& sensor, bool destaggered) {
+    static LutCache<XYZLutf> cache;
+    return cache.get(lut_key(sensor, destaggered), [&] {
+        return make_xyz_lutf(*shared_xyz_lut(sensor, destaggered));
+    });
+}
+
+namespace {
+
+template <typename L>
+struct float_bits;
+
+template <>
+struct float_bits<float> {
+    using type = uint32_t;
+};
+
+template <>
+struct float_bits<double> {
+    using type = uint64_t;
+};
+
+/*
+ * Pick xo unless x is zero, with integer operations: the compiler won't turn
+ * a floating point comparison into a blend without -fno-trapping-math.
+ */
+template <typename L>
+inline L offset_if_nonzero(L x, L xo) {
+    using B = typename float_bits<L>::type;
+    B b, bo;
+    std::memcpy(&b, &x, sizeof(L));
+    std::memcpy(&bo, &xo, sizeof(L));
+    const B keep = (b << 1) == 0 ? ~B{0} : B{0};
+    const B res = (b & keep) | (bo & ~keep);
+    L r;
+    std::memcpy(&r, &res, sizeof(L));
+    return r;
+}
+
+/*
+ * Project a row of w pixels starting at pixel i0 of lookup tables of n points,
+ * writing component c of point i to dst[i * PS + c * cs], or dst[i * ps + c *
+ * cs] if PS is zero. Offsets are only added to non-zero components, like
+ * cartesian() always did.
+ *
+ * Written so that the compiler vectorizes the common layouts: the point
+ * stride is a constant, ranges are converted as signed halves, offsets are
+ * loaded unconditionally and blended and all components of a point are
+ * stored together.
+ */
+template <std::ptrdiff_t PS, typename L, typename T>
+void project_row(const uint32_t* r, const L* dir, const L* off,
+                 std::ptrdiff_t n, std::ptrdiff_t i0, std::ptrdiff_t w, T* dst,
+                 std::ptrdiff_t ps, std::ptrdiff_t cs) {
+    const std::ptrdiff_t stride = PS ? PS : ps;
+    const L* dx = dir + i0;
+    const L* dy = dir + n + i0;
+    const L* dz = dir + 2 * n + i0;
+    const L* ox = off + i0;
+    const L* oy = off + n + i0;
+    const L* oz = off + 2 * n + i0;
+    for (std::ptrdiff_t v = 0; v < w; v++) {
+        // exact, unlike unsigned conversion this has vector instructions
+        const L rv =
+            static_cast<L>(static_cast<int32_t>(r[v] >> 16)) * L{65536} +
+            static_cast<L>(static_cast<int32_t>(r[v] & 0xffff));
+        const L x = dx[v] * rv;
+        const L y = dy[v] * rv;
+        const L z = dz[v] * rv;
+        const L xo = x + ox[v];
+        const L yo = y + oy[v];
+        const L zo = z + oz[v];
+        dst[v * stride] = static_cast<T>(offset_if_nonzero(x, xo));
+        dst[v * stride + cs] = static_cast<T>(offset_if_nonzero(y, yo));
+        dst[v * stride + 2 * cs] = static_cast<T>(offset_if_nonzero(z, zo));
+    }
+}
+
+// a range image to project and where to write its points
+template <typename T>
+struct projection {
+    Eigen::Ref<const img_t<uint32_t>> range;
+    T* out;
+};
+
+/*
+ * Project several range images row by row, so that each row of the lookup
+ * tables is read from memory once and from cache for the other images.
+ */
+template <std::ptrdiff_t PS, typename L, typename T>
+void project(const std::vector<projection<T>>& images, const L* dir,
+             const L* off, std::ptrdiff_t n, std::ptrdiff_t ps,
+             std::ptrdiff_t cs, std::ptrdiff_t rows_begin,
+             std::ptrdiff_t rows_end) {
+    const std::ptrdiff_t w = images.front().range.cols();
+    const std::ptrdiff_t stride = PS ? PS : ps;
+    for (std::ptrdiff_t u = rows_begin; u < rows_end; u++) {
+        const std::ptrdiff_t i0 = u * w;
+        for (const auto& img : images)
+            project_row<PS>(img.range.data() + u * img.range.outerStride(),
+                            dir, off, n, i0, w, img.out + i0 * stride, ps, cs);
+    }
+}
+
+template <typename L, typename T>
+void project(const std::vector<projection<T>>& images, const L& lut,
+             std::ptrdiff_t ps, std::ptrdiff_t cs, std::ptrdiff_t rows_begin,
+             std::ptrdiff_t rows_end) {
+    if (images.empty()) return;
+    const auto& first = images.front().range;
+    for (const auto& img : images)
+        if (img.range.cols() * img.range.rows() != lut.direction.rows() ||
+            img.range.rows() != first.rows())
+            throw std::invalid_argument("unexpected image dimensions");
+    if (rows_begin < 0 || rows_end > first.rows())
+        throw std::invalid_argument("rows out of the image");
+
+    const auto* dir = lut.direction.data();
+    const auto* off = lut.offset.data();
+    const std::ptrdiff_t n = lut.direction.rows();
+    const auto b = rows_begin;
+    const auto e = rows_end;
+    switch (ps) {
+        case 1: return project<1>(images, dir, off, n, ps, cs, b, e);
+        case 3: return project<3>(images, dir, off, n, ps, cs, b, e);
+        case 4: return project<4>(images, dir, off, n, ps, cs, b, e);
+        default: return project<0>(images, dir, off, n, ps, cs, b, e);
+    }
+}
+
+template <typename L, typename T>
+void project(const Eigen::Ref<const img_t<uint32_t>>& range, const L& lut,
+             T* out, std::ptrdiff_t ps, std::ptrdiff_t cs) {
+    project(std::vector<projection<T>>{{range, out}}, lut, ps, cs, 0,
+            range.rows());
+}
+
+// columns missing from a lazily batched scan may hold stale data, see
+// BATCH_LAZY_ZERO. Other scans are projected as they are
+template <typename T>
+void zero_invalid(const LidarScan& scan, T* out, std::ptrdiff_t ps,
+                  std::ptrdiff_t cs, std::ptrdiff_t rows_begin,
+                  std::ptrdiff_t rows_end) {
+    if (!scan.stale_columns() || scan.destaggered) return;
+    const auto& status = scan.status();
+    for (std::ptrdiff_t v = 0; v < scan.w; v++) {
+        if (status[v] & 0x01) continue;
+        for (std::ptrdiff_t u = rows_begin; u < rows_end; u++)
+            for (std::ptrdiff_t c = 0; c < 3; c++)
+                out[(u * scan.w + v) * ps + c * cs] = T{0};
+    }
+}
+
+}  // namespace
+
 LidarScan::Points cartesian(const LidarScan& scan, const XYZLut& lut) {
-    return cartesian(scan.field(ChanField::RANGE), lut);
+    LidarScan::Points points(lut.direction.rows(), 3);
+    project(scan.field(ChanField::RANGE), lut, points.data(), 1,
+            points.rows());
+    zero_invalid(scan, points.data(), 1, points.rows(), 0, scan.h);
+    return points;
 }
 
 LidarScan::Points cartesian(const Eigen::Ref<const img_t<uint32_t>>& range,
                             const XYZLut& lut) {
-    if (range.cols() * range.rows() != lut.direction.rows())
+    LidarScan::Points points(lut.direction.rows(), 3);
+    project(range, lut, points.data(), 1, points.rows());
+    return points;
+}
+
+template <typename L, typename T>
+void cartesian_into(const Eigen::Ref<const img_t<uint32_t>>& range,
+                    const L& lut, T* out, std::ptrdiff_t stride) {
+    if (stride < 3) throw std::invalid_argument("point stride less than 3");
+    project(range, lut, out, stride, 1);
+}
+
+template <typename L, typename T>
+void cartesian_into(const LidarScan& scan, const L& lut, T* out,
+                    std::ptrdiff_t stride) {
+    if (stride < 3) throw std::invalid_argument("point stride less than 3");
+    project(scan.field(ChanField::RANGE), lut, out, stride, 1);
+    zero_invalid(scan, out, stride, 1, 0, scan.h);
+}
+
+template <typename L, typename T>
+void cartesian_into(const LidarScan& scan,
+                    const std::vector<sensor::ChanField>& ranges, const L& lut,
+                    const std::vector<T*>& out, std::ptrdiff_t stride,
+                    std::ptrdiff_t rows_begin, std::ptrdiff_t rows_end) {
+    if (stride < 3) throw std::invalid_argument("point stride less than 3");
+    if (ranges.size() != out.size())
+        throw std::invalid_argument("expected an output for each range field");
+    if (rows_end < 0) rows_end = scan.h;
+
+    std::vector<projection<T>> images;
+    for (size_t i = 0; i < ranges.size(); i++)
+        images.push_back({scan.field(ranges[i]), out[i]});
+    project(images, lut, stride, 1, rows_begin, rows_end);
+    for (T* o : out) zero_invalid(scan, o, stride, 1, rows_begin, rows_end);
+}
+
+// lookup tables in single precision only produce single precision points
+template void cartesian_into(const Eigen::Ref<const img_t<uint32_t>>&,
+                             const XYZLut&, double*, std::ptrdiff_t);
+template void cartesian_into(const Eigen::Ref<const img_t<uint32_t>>&,
+                             const XYZLut&, float*, std::ptrdiff_t);
+template void cartesian_into(const Eigen::Ref<const img_t<uint32_t>>&,
+                             const XYZLutf&, float*, std::ptrdiff_t);
+template void cartesian_into(const LidarScan&, const XYZLut&, double*,
+                             std::ptrdiff_t);
+template void cartesian_into(const LidarScan&, const XYZLut&, float*,
+                             std::ptrdiff_t);
+template void cartesian_into(const LidarScan&, const XYZLutf&, float*,
+                             std::ptrdiff_t);
+template void cartesian_into(const LidarScan&, const std::vector<ChanField>&,
+                             const XYZLut&, const std::vector<double*>&,
+                             std::ptrdiff_t, std::ptrdiff_t, std::ptrdiff_t);
+template void cartesian_into(const LidarScan&, const std::vector<ChanField>&,
+                             const XYZLut&, const std::vector<float*>&,
+                             std::ptrdiff_t, std::ptrdiff_t, std::ptrdiff_t);
+template void cartesian_into(const LidarScan&, const std::vector<ChanField>&,
+                             const XYZLutf&, const std::vector<float*>&,
+                             std::ptrdiff_t, std::ptrdiff_t, std::ptrdiff_t);
+
+ScanRegion make_scan_region(size_t w, size_t h, sensor::ColumnWindow window,
+                            int col_step, int row_step) {
+    const int sw = static_cast<int>(w);
+    if (window.first < 0 || window.first >= sw || window.second < 0 ||
+        window.second >= sw)
+        throw std::invalid_argument("column window out of the scan");
+    if (col_step < 1 || row_step < 1)
+        throw std::invalid_argument("region step less than one");
+
+    ScanRegion region;
+    for (int u = 0; u < static_cast<int>(h); u += row_step)
+        region.rows.push_back(u);
+    const int n = (window.second - window.first + sw) % sw + 1;
+    for (int k = 0; k < n; k += col_step)
+        region.cols.push_back((window.first + k) % sw);
+    return region;
+}
+
+ScanRegion make_scan_region(const sensor::sensor_info& sensor, int col_step,
+                            int row_step) {
+    return make_scan_region(sensor.format.columns_per_frame,
+                            sensor.format.pixels_per_column,
+                            sensor.format.column_window, col_step, row_step);
+}
+
+namespace {
+
+void check_region(const ScanRegion& region, size_t w, size_t h) {
+    auto out = [](const std::vector<int>& ind, size_t n) {
+        return std::any_of(ind.begin(), ind.end(), [n](int i) {
+            return i < 0 || static_cast<size_t>(i) >= n;
+        });
+    };
+    if (out(region.rows, h) || out(region.cols, w))
+        throw std::invalid_argument("region out of the scan");
+}
+
+/*
+ * Project rows [rows_begin, rows_end) of a region, gathering the ranges of
+ * its columns so that rows project with the same kernel as whole scans
+ */
+template <std::ptrdiff_t PS, typename L, typename T>
+void project_region(const std::vector<projection<T>>& images,
+                    const ScanRegion& region, const L* dir, const L* off,
+                    std::ptrdiff_t ps, std::ptrdiff_t cs,
+                    std::ptrdiff_t rows_begin, std::ptrdiff_t rows_end) {
+    const std::ptrdiff_t nc = region.cols.size();
+    const std::ptrdiff_t n = region.rows.size() * nc;
+    const std::ptrdiff_t stride = PS ? PS : ps;
+    std::vector<uint32_t> row(nc);
+    for (std::ptrdiff_t j = rows_begin; j < rows_end; j++) {
+        const std::ptrdiff_t i0 = j * nc;
+        for (const auto& img : images) {
+            const uint32_t* src =
+                img.range.data() + region.rows[j] * img.range.outerStride();
+            for (std::ptrdiff_t k = 0; k < nc; k++)
+                row[k] = src[region.cols[k]];
+            project_row<PS>(row.data(), dir, off, n, i0, nc,
+                            img.out + i0 * stride, ps, cs);
+        }
+    }
+}
+
+template <typename L, typename T>
+void project_region(const LidarScan& scan, const ScanRegion& region,
+                    const std::vector<projection<T>>& images, const L& lut,
+                    std::ptrdiff_t ps, std::ptrdiff_t cs,
+                    std::ptrdiff_t rows_begin, std::ptrdiff_t rows_end) {
+    check_region(region, scan.w, scan.h);
+    const std::ptrdiff_t nr = region.rows.size();
+    const std::ptrdiff_t nc = region.cols.size();
+    if (lut.direction.rows() != nr * nc)
+        throw std::invalid_argument("unexpected lookup table dimensions");
+    if (rows_begin < 0 || rows_end > nr)
+        throw std::invalid_argument("rows out of the region");
+
+    const auto* dir = lut.direction.data();
+    const auto* off = lut.offset.data();
+    const auto b = rows_begin;
+    const auto e = rows_end;
+    switch (ps) {
+        case 1:
+            project_region<1>(images, region, dir, off, ps, cs, b, e);
+            break;
+        case 3:
+            project_region<3>(images, region, dir, off, ps, cs, b, e);
+            break;
+        case 4:
+            project_region<4>(images, region, dir, off, ps, cs, b, e);
+            break;
+        default:
+            project_region<0>(images, region, dir, off, ps, cs, b, e);
+    }
+
+    // as zero_invalid(), for the columns of the region
+    if (!scan.stale_columns() || scan.destaggered) return;
+    const auto& status = scan.status();
+    for (std::ptrdiff_t k = 0; k < nc; k++) {
+        if (status[region.cols[k]] & 0x01) continue;
+        for (const auto& img : images)
+            for (std::ptrdiff_t j = rows_begin; j < rows_end; j++)
+                for (std::ptrdiff_t c = 0; c < 3; c++)
+                    img.out[(j * nc + k) * ps + c * cs] = T{0};
+    }
+}
+
+}  // namespace
+
+template <typename L>
+L slice_xyz_lut(const L& lut, size_t w, const ScanRegion& region) {
+    if (w == 0 || lut.direction.rows() % w != 0)
+        throw std::invalid_argument("unexpected lookup table dimensions");
+    check_region(region, w, lut.direction.rows() / w);
+
+    const size_t nc = region.cols.size();
+    L res;
+    res.direction.resize(region.rows.size() * nc, 3);
+    res.offset.resize(region.rows.size() * nc, 3);
+    for (size_t j = 0; j < region.rows.size(); j++) {
+        for (size_t k = 0; k < nc; k++) {
+            const size_t i = region.rows[j] * w + region.cols[k];
+            res.direction.row(j * nc + k) = lut.direction.row(i);
+            res.offset.row(j * nc + k) = lut.offset.row(i);
+        }
+    }
+    return res;
+}
+
+template XYZLut slice_xyz_lut(const XYZLut&, size_t, const ScanRegion&);
+template XYZLutf slice_xyz_lut(const XYZLutf&, size_t, const ScanRegion&);
+
+LidarScan::Points cartesian(const LidarScan& scan, const ScanRegion& region,
+                            const XYZLut& region_lut) {
+    LidarScan::Points points(region_lut.direction.rows(), 3);
+    project_region(
+        scan, region,
+        std::vector<projection<double>>{
+            {scan.field(ChanField::RANGE), points.data()}},
+        region_lut, 1, points.rows(), 0, region.rows.size());
+    return points;
+}
+
+template <typename L, typename T>
+void cartesian_into(const LidarScan& scan, const ScanRegion& region,
+                    const std::vector<sensor::ChanField>& ranges,
+                    const L& region_lut, const std::vector<T*>& out,
+                    std::ptrdiff_t stride, std::ptrdiff_t rows_begin,
+                    std::ptrdiff_t rows_end) {
+    if (stride < 3) throw std::invalid_argument("point stride less than 3");
+    if (ranges.size() != out.size())
+        throw std::invalid_argument("expected an output for each range field");
+    if (rows_end < 0) rows_end = region.rows.size();
+
+    std::vector<projection<T>> images;
+    for (size_t i = 0; i < ranges.size(); i++)
+        images.push_back({scan.field(ranges[i]), out[i]});
+    project_region(scan, region, images, region_lut, stride, 1, rows_begin,
+                   rows_end);
+}
+
+template void cartesian_into(const LidarScan&, const ScanRegion&,
+                             const std::vector<ChanField>&, const XYZLut&,
+                             const std::vector<double*>&, std::ptrdiff_t,
+                             std::ptrdiff_t, std::ptrdiff_t);
+template void cartesian_into(const LidarScan&, const ScanRegion&,
+                             const std::vector<ChanField>&, const XYZLut&,
+                             const std::vector<float*>&, std::ptrdiff_t,
+                             std::ptrdiff_t, std::ptrdiff_t);
+template void cartesian_into(const LidarScan&, const ScanRegion&,
+                             const std::vector<ChanField>&, const XYZLutf&,
+                             const std::vector<float*>&, std::ptrdiff_t,
+                             std::ptrdiff_t, std::ptrdiff_t);
+
+ImuSample imu_sample(const sensor::packet_format& pf, const uint8_t* imu_buf) {
+    return {pf.imu_gyro_ts(imu_buf),
+            {pf.imu_av_x(imu_buf), pf.imu_av_y(imu_buf), pf.imu_av_z(imu_buf)}};
+}
+
+std::vector<mat4d> column_poses(const LidarScan& scan,
+                                const std::function<mat4d(uint64_t)>& pose_at) {
+    std::vector<mat4d> poses(scan.w, mat4d::Identity());
+    const auto& ts = scan.timestamp();
+    const auto& status = scan.status();
+    for (std::ptrdiff_t v = 0; v < scan.w; v++)
+        if (status[v] & 0x01) poses[v] = pose_at(ts[v]);
+    return poses;
+}
+
+namespace {
+
+// rotation by an angle-axis vector, in radians
+Eigen::Quaterniond rotation_exp(const Eigen::Vector3d& rv) {
+    const double angle = rv.norm();
+    if (angle < 1e-12) return Eigen::Quaterniond::Identity();
+    return Eigen::Quaterniond(Eigen::AngleAxisd(angle, rv / angle));
+}
+
+}  // namespace
+
+std::vector<mat4d> imu_column_poses(const LidarScan& scan,
+                                    const std::vector<ImuSample>& imu,
+                                    const mat4d& imu_to_sensor_transform,
+                                    uint64_t ref_ts) {
+    if (imu.empty()) throw std::invalid_argument("no imu samples");
+    for (size_t k = 1; k < imu.size(); k++)
+        if (imu[k].ts < imu[k - 1].ts)
+            throw std::invalid_argument("imu samples not sorted by timestamp");
+
+    // orientation at each sample relative to the first, averaging the rates
+    // at both ends of each interval
+    constexpr double deg_to_rad = M_PI / 180.0;
+    const size_t n = imu.size();
+    std::vector<Eigen::Vector3d> rates(n);
+    for (size_t k = 0; k + 1 < n; k++)
+        rates[k] = 0.5 * deg_to_rad *
+                   (imu[k].angular_velocity + imu[k + 1].angular_velocity);
+    rates[n - 1] = deg_to_rad * imu[n - 1].angular_velocity;
+
+    std::vector<Eigen::Quaterniond> orientations(n);
+    orientations[0].setIdentity();
+    for (size_t k = 1; k < n; k++) {
+        const double dt = (imu[k].ts - imu[k - 1].ts) * 1e-9;
+        orientations[k] =
+            (orientations[k - 1] * rotation_exp(rates[k - 1] * dt))
+                .normalized();
+    }
+
+    auto orientation_at = [&](uint64_t t) {
+        auto it = std::upper_bound(
+            imu.begin(), imu.end(), t,
+            [](uint64_t t, const ImuSample& s) { return t < s.ts; });
+        const size_t k = it == imu.begin() ? 0 : (it - imu.begin()) - 1;
+        const Eigen::Vector3d& rate =
+            it == imu.begin() ? deg_to_rad * imu[0].angular_velocity
+                              : rates[k];
+        const double dt = (static_cast<double>(t) - imu[k].ts) * 1e-9;
+        return orientations[k] * rotation_exp(rate * dt);
+    };
+
+    // rotations of the imu frame, expressed in the sensor frame
+    const Eigen::Matrix4d to_sensor = imu_to_sensor_transform;
+    const Eigen::Matrix4d from_sensor = to_sensor.inverse();
+    const Eigen::Quaterniond ref_inv = orientation_at(ref_ts).conjugate();
+    return column_poses(scan, [&](uint64_t t) {
+        Eigen::Matrix4d rotation = Eigen::Matrix4d::Identity();
+        rotation.topLeftCorner<3, 3>() =
+            (ref_inv * orientation_at(t)).toRotationMatrix();
+        return mat4d{to_sensor * rotation * from_sensor};
+    });
+}
+
+namespace {
+
+/*
+ * Project a row of w pixels like project_row(), transforming the point of
+ * column v by the affine transform with element (row, col) stored in
+ * m[(col * 3 + row) * w + v]. Zeroed transforms give zero points for missing
+ * columns, and translation is dropped for pixels without a return.
+ */
+template <std::ptrdiff_t PS, typename L, typename T>
+void deskew_row(const uint32_t* r, const L* dir, const L* off,
+                std::ptrdiff_t n, std::ptrdiff_t i0, std::ptrdiff_t w,
+                const L* m, T* dst, std::ptrdiff_t ps, std::ptrdiff_t cs) {
+    const std::ptrdiff_t stride = PS ? PS : ps;
+    const L* dx = dir + i0;
+    const L* dy = dir + n + i0;
+    const L* dz = dir + 2 * n + i0;
+    const L* ox = off + i0;
+    const L* oy = off + n + i0;
+    const L* oz = off + 2 * n + i0;
+    for (std::ptrdiff_t v = 0; v < w; v++) {
+        const L rv =
+            static_cast<L>(static_cast<int32_t>(r[v] >> 16)) * L{65536} +
+            static_cast<L>(static_cast<int32_t>(r[v] & 0xffff));
+        const L x = dx[v] * rv;
+        const L y = dy[v] * rv;
+        const L z = dz[v] * rv;
+        const L px = offset_if_nonzero(x, x + ox[v]);
+        const L py = offset_if_nonzero(y, y + oy[v]);
+        const L pz = offset_if_nonzero(z, z + oz[v]);
+        const L ret = static_cast<L>(r[v] != 0);
+        const L* c = m + v;
+        dst[v * stride] = static_cast<T>(c[0] * px + c[3 * w] * py +
+                                         c[6 * w] * pz + c[9 * w] * ret);
+        dst[v * stride + cs] =
+            static_cast<T>(c[w] * px + c[4 * w] * py + c[7 * w] * pz +
+                           c[10 * w] * ret);
+        dst[v * stride + 2 * cs] =
+            static_cast<T>(c[2 * w] * px + c[5 * w] * py + c[8 * w] * pz +
+                           c[11 * w] * ret);
+    }
+}
+
+template <std::ptrdiff_t PS, typename L, typename T>
+void deskew(const Eigen::Ref<const img_t<uint32_t>>& range, const L* dir,
+            const L* off, const L* m, T* out, std::ptrdiff_t ps,
+            std::ptrdiff_t cs) {
+    const std::ptrdiff_t w = range.cols();
+    const std::ptrdiff_t n = range.size();
+    const std::ptrdiff_t stride = PS ? PS : ps;
+    for (std::ptrdiff_t u = 0; u < range.rows(); u++)
+        deskew_row<PS>(range.data() + u * range.outerStride(), dir, off, n,
+                       u * w, w, m, out + u * w * stride, ps, cs);
+}
+
+template <typename L, typename T>
+void deskew(const LidarScan& scan, const L& lut,
+            const std::vector<mat4d>& poses, T* out, std::ptrdiff_t ps,
+            std::ptrdiff_t cs) {
+    using S = typename std::decay<decltype(lut.direction)>::type::Scalar;
+    const auto range = scan.field(ChanField::RANGE);
+    if (range.size() != lut.direction.rows())
         throw std::invalid_argument("unexpected image dimensions");
+    if (static_cast<std::ptrdiff_t>(poses.size()) != scan.w)
+        throw std::invalid_argument("expected a pose for each column");
+    if (scan.destaggered)
+        throw std::invalid_argument("cannot deskew a destaggered scan");
+
+    // transforms by component, so that each is read contiguously across a row
+    const std::ptrdiff_t w = scan.w;
+    std::vector<S> m(12 * w, S{0});
+    const auto& status = scan.status();
+    for (std::ptrdiff_t v = 0; v < w; v++) {
+        if (!(status[v] & 0x01)) continue;
+        for (int col = 0; col < 4; col++)
+            for (int row = 0; row < 3; row++)
+                m[(col * 3 + row) * w + v] =
+                    static_cast<S>(poses[v](row, col));
+    }
 
-    auto reshaped = Eigen::Map<const Eigen::Array<uint32_t, -1, 1>>(
-        range.data(), range.cols() * range.rows());
-    auto nooffset = lut.direction.colwise() * reshaped.cast<double>();
-    return (nooffset.array() == 0.0).select(nooffset, nooffset + lut.offset);
+    const auto* dir = lut.direction.data();
+    const auto* off = lut.offset.data();
+    switch (ps) {
+        case 1: return deskew<1>(range, dir, off, m.data(), out, ps, cs);
+        case 3: return deskew<3>(range, dir, off, m.data(), out, ps, cs);
+        case 4: return deskew<4>(range, dir, off, m.data(), out, ps, cs);
+        default: return deskew<0>(range, dir, off, m.data(), out, ps, cs);
+    }
 }
 
-ScanBatcher::ScanBatcher(size_t w, const sensor::packet_format& pf)
+}  // namespace
+
+template <typename L, typename T>
+void deskewed_cartesian_into(const LidarScan& scan, const L& lut,
+                             const std::vector<mat4d>& poses, T* out,
+                             std::ptrdiff_t stride) {
+    if (stride < 3) throw std::invalid_argument("point stride less than 3");
+    deskew(scan, lut, poses, out, stride, 1);
+}
+
+LidarScan::Points deskewed_cartesian(const LidarScan& scan, const XYZLut& lut,
+                                     const std::vector<mat4d>& poses) {
+    LidarScan::Points points(lut.direction.rows(), 3);
+    deskew(scan, lut, poses, points.data(), 1, points.rows());
+    return points;
+}
+
+template void deskewed_cartesian_into(const LidarScan&, const XYZLut&,
+                                      const std::vector<mat4d>&, double*,
+                                      std::ptrdiff_t);
+template void deskewed_cartesian_into(const LidarScan&, const XYZLut&,
+                                      const std::vector<mat4d>&, float*,
+                                      std::ptrdiff_t);
+template void deskewed_cartesian_into(const LidarScan&, const XYZLutf&,
+                                      const std::vector<mat4d>&, float*,
+                                      std::ptrdiff_t);
+
+Destaggerer::Destaggerer(const std::vector<int>& pixel_shift_by_row, size_t w,
+                         bool inverse)
+    : w_{w} {
+    if (w == 0) throw std::invalid_argument("image width is zero");
+    const auto sw = static_cast<std::ptrdiff_t>(w);
+    for (int shift : pixel_shift_by_row) {
+        const std::ptrdiff_t s = (inverse ? -shift : shift) % sw;
+        offsets_.push_back(static_cast<size_t>(s < 0 ? s + sw : s));
+    }
+}
+
+Destaggerer::Destaggerer(const sensor::sensor_info& info, bool inverse)
+    : Destaggerer(info.format.pixel_shift_by_row,
+                  info.format.columns_per_frame, inverse) {}
+
+void Destaggerer::copy_rows(const uint8_t* img, std::ptrdiff_t img_stride,
+                            uint8_t* dest, std::ptrdiff_t dest_stride,
+                            size_t pixel_size, size_t rows_begin,
+                            size_t rows_end) const {
+    for (size_t u = rows_begin; u < rows_end; u++) {
+        const uint8_t* src = img + u * img_stride;
+        uint8_t* dst = dest + u * dest_stride;
+        const size_t n = (w_ - offsets_[u]) * pixel_size;
+        std::memcpy(dst + offsets_[u] * pixel_size, src, n);
+        std::memcpy(dst, src + n, offsets_[u] * pixel_size);
+    }
+}
+
+void Destaggerer::operator()(const void* img, void* dest,
+                             size_t pixel_size) const {
+    const auto stride = static_cast<std::ptrdiff_t>(w_ * pixel_size);
+    copy_rows(static_cast<const uint8_t*>(img), stride,
+              static_cast<uint8_t*>(dest), stride, pixel_size, 0, h());
+}
+
+namespace {
+
+// raw memory of a field, to copy rows of any type
+struct field_memory {
+    template <typename R>
+    void operator()(R&& field, uint8_t*& data, std::ptrdiff_t& stride,
+                    size_t& pixel_size) {
+        using T = typename std::decay<R>::type::Scalar;
+        data = reinterpret_cast<uint8_t*>(
+            const_cast<typename std::remove_const<T>::type*>(field.data()));
+        stride = field.outerStride() * sizeof(T);
+        pixel_size = sizeof(T);
+    }
+};
+
+}  // namespace
+
+void Destaggerer::operator()(const LidarScan& scan,
+                             const std::vector<ChanField>& fields,
+                             LidarScan& dest, int n_threads) const {
+    if (static_cast<size_t>(scan.h) != h() ||
+        static_cast<size_t>(scan.w) != w() || dest.h != scan.h ||
+        dest.w != scan.w)
+        throw std::invalid_argument("unexpected scan dimensions");
+
+    struct field_rows {
+        const uint8_t* src;
+        std::ptrdiff_t src_stride;
+        uint8_t* dst;
+        std::ptrdiff_t dst_stride;
+        size_t pixel_size;
+    };
+    std::vector<field_rows> rows;
+    for (auto f : fields) {
+        if (!scan.field_type(f) || !dest.field_type(f))
+            throw std::out_of_range("field is not in the scan");
+        if (scan.field_type(f) != dest.field_type(f))
+            throw std::invalid_argument("field types don't match");
+
+        field_rows r;
+        uint8_t* src;
+        impl::visit_field(scan, f, field_memory(), src, r.src_stride,
+                          r.pixel_size);
+        impl::visit_field(dest, f, field_memory(), r.dst, r.dst_stride,
+                          r.pixel_size);
+        r.src = src;
+        rows.push_back(r);
+    }
+
+    auto copy_band = [&](size_t begin, size_t end) {
+        for (const auto& r : rows)
+            copy_rows(r.src, r.src_stride, r.dst, r.dst_stride, r.pixel_size,
+                      begin, end);
+    };
+
+    // split rows into bands, copying the first on the calling thread
+    const size_t n = std::min<size_t>(std::max(n_threads, 1), h());
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < n; i++)
+        workers.emplace_back(copy_band, i * h() / n, (i + 1) * h() / n);
+    copy_band(0, h() / n);
+    for (auto& t : workers) t.join();
+}
+
+namespace impl {
+
+/*
+ * Field parsing entry points of a lidar profile with a layout known at compile
+ * time, one per destination field type. See parsing_kernels.h.
+ */
+struct ScanBatcherKernel {
+    template <typename T>
+    using parse_fn = bool (*)(ChanField, const uint8_t*, int, const int*, int,
+                              T*, std::ptrdiff_t);
+
+    parse_fn<uint8_t> parse_u8;
+    parse_fn<uint16_t> parse_u16;
+    parse_fn<uint32_t> parse_u32;
+    parse_fn<uint64_t> parse_u64;
+
+    template <typename T>
+    parse_fn<T> get() const;
+};
+
+template <>
+ScanBatcherKernel::parse_fn<uint8_t> ScanBatcherKernel::get() const {
+    return parse_u8;
+}
+template <>
+ScanBatcherKernel::parse_fn<uint16_t> ScanBatcherKernel::get() const {
+    return parse_u16;
+}
+template <>
+ScanBatcherKernel::parse_fn<uint32_t> ScanBatcherKernel::get() const {
+    return parse_u32;
+}
+template <>
+ScanBatcherKernel::parse_fn<uint64_t> ScanBatcherKernel::get() const {
+    return parse_u64;
+}
+
+template <typename LAYOUT>
+constexpr ScanBatcherKernel make_kernel() {
+    return {&LAYOUT::template packet_field<uint8_t>,
+            &LAYOUT::template packet_field<uint16_t>,
+            &LAYOUT::template packet_field<uint32_t>,
+            &LAYOUT::template packet_field<uint64_t>};
+}
+
+static const Table<UDPProfileLidar, ScanBatcherKernel, 4> batcher_kernels{{
+    {UDPProfileLidar::PROFILE_LIDAR_LEGACY,
+     make_kernel<sensor::impl::LegacyLayout>()},
+    {UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL,
+     make_kernel<sensor::impl::DualLayout>()},
+    {UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16,
+     make_kernel<sensor::impl::SingleLayout>()},
+    {UDPProfileLidar::PROFILE_RNG15_RFL8_NIR8,
+     make_kernel<sensor::impl::LowBandwidthLayout>()},
+}};
+
+/*
+ * Returns nullptr when no specialized kernel exists for the profile, in which
+ * case the ScanBatcher falls back to packet_format::col_field().
+ */
+static const ScanBatcherKernel* lookup_batcher_kernel(
+    UDPProfileLidar profile) {
+    auto end = batcher_kernels.end();
+    auto it =
+        std::find_if(batcher_kernels.begin(), end,
+                     [profile](const auto& kv) { return kv.first == profile; });
+    return it == end ? nullptr : &it->second;
+}
+
+}  // namespace impl
+
+ScanBatcher::ScanBatcher(size_t w, const sensor::packet_format& pf,
+                         uint8_t flags)
     : w(w),
       h(pf.pixels_per_column),
       next_m_id(0),
       cache(pf.lidar_packet_size),
-      pf(pf) {}
+      col_m_ids(pf.columns_per_packet),
+      kernel(impl::lookup_batcher_kernel(pf.udp_profile_lidar)),
+      flags(flags),
+      column_window(0, static_cast<int>(w) - 1),
+      seen_cols(w),
+      pf(pf) {
+    if (flags & BATCH_DESTAGGER)
+        throw std::invalid_argument("BATCH_DESTAGGER requires sensor metadata");
+}
+
+ScanBatcher::ScanBatcher(const sensor::sensor_info& info, uint8_t flags)
+    : ScanBatcher(info.format.columns_per_frame, sensor::get_format(info),
+                  flags & ~BATCH_DESTAGGER) {
+    column_window = info.format.column_window;
+    if (!(flags & BATCH_DESTAGGER)) return;
+    if (info.format.pixel_shift_by_row.size() != static_cast<size_t>(h))
+        throw std::invalid_argument("expected a pixel shift for each row");
+    this->flags = flags;
+    destagger = Destaggerer(info);
+    staging.resize(h * pf.columns_per_packet);
+}
 
-ScanBatcher::ScanBatcher(const sensor::sensor_info& info)
-    : ScanBatcher(info.format.columns_per_frame, sensor::get_format(info)) {}
+ScanBatcher::ScanBatcher(const sensor::sensor_info& info,
+                         const ReorderWindow& window, uint8_t flags)
+    : ScanBatcher(info, flags) {
+    if (window.scans == 0)
+        throw std::invalid_argument("reorder window holds no scans");
+    reorder = true;
+    this->window = window;
+    window_cols = (column_window.second - column_window.first + w) % w + 1;
+}
 
 namespace {
 
@@ -312,6 +1428,50 @@ struct zero_field_cols {
     }
 };
 
+/*
+ * Set the destaggered pixels of columns in the range [start, end) to zero
+ */
+struct zero_destaggered_cols {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, ChanField,
+                    const Destaggerer& d, std::ptrdiff_t start,
+                    std::ptrdiff_t end) {
+        const std::ptrdiff_t w = field.cols();
+        for (std::ptrdiff_t u = 0; u < field.rows(); u++) {
+            // shifted columns wrap around at most once
+            const std::ptrdiff_t b = start + d.offset(u);
+            const std::ptrdiff_t e = end + d.offset(u);
+            T* row = field.row(u).data();
+            std::fill(row + std::min(b, w), row + std::min(e, w), T{0});
+            if (e > w)
+                std::fill(row + std::max(b - w, std::ptrdiff_t{0}),
+                          row + (e - w), T{0});
+        }
+    }
+};
+
+/*
+ * Count the pixels of the given columns of a field that are zero, at their
+ * destaggered positions given a destaggerer
+ */
+struct count_zero_cols {
+    template <typename T>
+    void operator()(Eigen::Ref<const img_t<T>> field,
+                    const std::vector<int>& m_ids, const Destaggerer* d,
+                    uint64_t& n) {
+        const std::ptrdiff_t w = field.cols();
+        for (std::ptrdiff_t u = 0; u < field.rows(); u++) {
+            const std::ptrdiff_t off = d ? d->offset(u) : 0;
+            const T* row = field.row(u).data();
+            for (int m_id : m_ids) {
+                std::ptrdiff_t v = m_id + off;
+                if (v >= w) v -= w;
+                n += row[v] == 0;
+            }
+        }
+    }
+};
+
 /*
  * Zero out all measurement block headers in range [start, end)
  */
@@ -319,27 +1479,273 @@ void zero_header_cols(LidarScan& ls, std::ptrdiff_t start, std::ptrdiff_t end) {
     ls.timestamp().segment(start, end - start).setZero();
     ls.measurement_id().segment(start, end - start).setZero();
     ls.status().segment(start, end - start).setZero();
-
-    // zero deprecated header blocks
-    for (auto m_id = start; m_id < end; m_id++) ls.header(m_id) = {};
+    ls.rx_timestamp().segment(start, end - start).setZero();
 }
 
 /*
- * Generic operation to read a channel field from a packet measurement block
- * into a scan
+ * Generic operation to read a channel field from all valid measurement blocks
+ * of a packet into a scan. Columns with a negative entry in m_ids are skipped.
+ * Uses the profile-specific kernel when available.
+ */
+struct parse_field_cols {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, ChanField f,
+                    const impl::ScanBatcherKernel* kernel,
+                    const sensor::packet_format& pf, const uint8_t* packet_buf,
+                    const int* m_ids) {
+        if (f >= ChanField::CUSTOM0 && f <= ChanField::CUSTOM9) return;
+
+        if (kernel &&
+            kernel->get<T>()(f, packet_buf, pf.pixels_per_column, m_ids,
+                             pf.columns_per_packet, field.data(),
+                             field.cols()))
+            return;
+
+        const int h = pf.pixels_per_column;
+        const int n_cols = pf.columns_per_packet;
+        if (h > sensor::impl::batch_tile_size) {
+            for (int icol = 0; icol < n_cols; icol++) {
+                if (m_ids[icol] < 0) continue;
+                pf.col_field(pf.nth_col(icol, packet_buf), f,
+                             field.col(m_ids[icol]).data(), field.cols());
+            }
+            return;
+        }
+
+        // stage columns contiguously, then write out row by row
+        T tile[sensor::impl::batch_tile_size];
+        const int block_cols = sensor::impl::batch_tile_size / h;
+        for (int c0 = 0; c0 < n_cols; c0 += block_cols) {
+            const int nc = std::min(block_cols, n_cols - c0);
+            for (int c = 0; c < nc; c++) {
+                if (m_ids[c0 + c] < 0) continue;
+                pf.col_field(pf.nth_col(c0 + c, packet_buf), f, tile + c * h,
+                             1);
+            }
+            sensor::impl::transpose_tile(tile, nc, h, m_ids + c0, field.data(),
+                                         field.cols());
+        }
+    }
+};
+
+/*
+ * Read a channel field from all valid measurement blocks of a packet into a
+ * staging image with a column per block, then scatter each row to its
+ * destaggered position in the scan.
  */
-struct parse_field_col {
+struct parse_destaggered_cols {
     template <typename T>
-    void operator()(Eigen::Ref<img_t<T>> field, ChanField f, uint16_t m_id,
-                    const sensor::packet_format& pf, const uint8_t* col_buf) {
+    void operator()(Eigen::Ref<img_t<T>> field, ChanField f,
+                    const impl::ScanBatcherKernel* kernel,
+                    const sensor::packet_format& pf, const uint8_t* packet_buf,
+                    const int* m_ids, const int* staging_ids,
+                    std::vector<uint64_t>& staging, const Destaggerer& d) {
         if (f >= ChanField::CUSTOM0 && f <= ChanField::CUSTOM9) return;
-        pf.col_field(col_buf, f, field.col(m_id).data(), field.cols());
+
+        const int n_cols = pf.columns_per_packet;
+        Eigen::Map<img_t<T>> tile(reinterpret_cast<T*>(staging.data()),
+                                  field.rows(), n_cols);
+        parse_field_cols()(Eigen::Ref<img_t<T>>(tile), f, kernel, pf,
+                           packet_buf, staging_ids);
+
+        const std::ptrdiff_t w = field.cols();
+        for (std::ptrdiff_t u = 0; u < field.rows(); u++) {
+            const std::ptrdiff_t off = d.offset(u);
+            const T* src = tile.row(u).data();
+            T* row = field.row(u).data();
+            for (int c = 0; c < n_cols; c++) {
+                if (m_ids[c] < 0) continue;
+                std::ptrdiff_t v = m_ids[c] + off;
+                if (v >= w) v -= w;
+                row[v] = src[c];
+            }
+        }
     }
 };
 
 }  // namespace
 
-bool ScanBatcher::operator()(const uint8_t* packet_buf, LidarScan& ls) {
+namespace impl {
+
+struct ScanPoolState {
+    LidarScan prototype;
+    std::mutex mtx;
+    std::vector<std::unique_ptr<LidarScan>> free;
+};
+
+}  // namespace impl
+
+void LidarScanPool::Releaser::operator()(LidarScan* ls) const {
+    std::unique_ptr<LidarScan> scan{ls};
+    if (!scan || !pool) return;
+    std::lock_guard<std::mutex> lock{pool->mtx};
+    pool->free.push_back(std::move(scan));
+}
+
+LidarScanPool::LidarScanPool(const LidarScan& prototype, size_t size)
+    : state_(std::make_shared<impl::ScanPoolState>()) {
+    state_->prototype = prototype;
+    state_->free.reserve(size);
+    for (size_t i = 0; i < size; i++)
+        state_->free.push_back(std::make_unique<LidarScan>(prototype));
+}
+
+LidarScanPool::LidarScanPool(size_t w, size_t h,
+                             sensor::UDPProfileLidar profile, size_t size)
+    : LidarScanPool(LidarScan{w, h, profile}, size) {}
+
+LidarScanPool::Handle LidarScanPool::acquire() {
+    std::unique_ptr<LidarScan> scan;
+    {
+        std::lock_guard<std::mutex> lock{state_->mtx};
+        if (!state_->free.empty()) {
+            scan = std::move(state_->free.back());
+            state_->free.pop_back();
+        }
+    }
+    if (!scan) scan = std::make_unique<LidarScan>(state_->prototype);
+    return Handle{scan.release(), Releaser{state_}};
+}
+
+size_t LidarScanPool::available() const {
+    std::lock_guard<std::mutex> lock{state_->mtx};
+    return state_->free.size();
+}
+
+/*
+ * Mark columns in the range [start, end) as missing
+ */
+void ScanBatcher::zero_cols(LidarScan& ls, std::ptrdiff_t start,
+                            std::ptrdiff_t end) {
+    if (start >= end) return;
+    counters.zeroed_cols += end - start;
+    if (flags & BATCH_DESTAGGER)
+        impl::foreach_field(ls, zero_destaggered_cols(), destagger, start,
+                            end);
+    else if (!(flags & BATCH_LAZY_ZERO))
+        impl::foreach_field(ls, zero_field_cols(), start, end);
+    zero_header_cols(ls, start, end);
+
+    // zero deprecated header blocks
+    if (!(flags & BATCH_NO_BLOCK_HEADERS))
+        for (auto m_id = start; m_id < end; m_id++) ls.header(m_id) = {};
+}
+
+/*
+ * Reset the summary of a scan about to be batched
+ */
+void ScanBatcher::start_scan(LidarScan& ls) {
+    ls.summary_ = {};
+    ls.summary_.window = column_window;
+    // destaggered fields of missing columns are always zeroed
+    ls.stale_columns_ =
+        (flags & BATCH_LAZY_ZERO) && !(flags & BATCH_DESTAGGER);
+    std::fill(seen_cols.begin(), seen_cols.end(), 0);
+}
+
+/*
+ * Mark the summary of a completed scan valid, after its missing columns were
+ * zeroed through the scan's accessors
+ */
+void ScanBatcher::finish_scan(LidarScan& ls) {
+    ls.summary_.cols_missing = static_cast<uint32_t>(w) -
+                               ls.summary_.cols_received;
+    ls.summary_.valid = true;
+}
+
+/*
+ * Parse the columns of a packet into a scan. Without a slot, columns missing
+ * before each column are zeroed as batching moves forward; with a slot, the
+ * columns that arrived are recorded and missing ones zeroed on release.
+ */
+void ScanBatcher::parse(const uint8_t* packet_buf, LidarScan& ls,
+                        uint64_t rx_ts, InFlight* slot) {
+    // counted once parsed, including packets replayed from the cache
+    counters.packets++;
+    ScanSummary& summary = ls.summary_;
+    uint8_t* seen = slot ? slot->seen.data() : seen_cols.data();
+    const auto& cw = column_window;
+    new_cols.clear();
+
+    // parse measurement blocks
+    for (int icol = 0; icol < pf.columns_per_packet; icol++) {
+        const uint8_t* col_buf = pf.nth_col(icol, packet_buf);
+        const uint16_t m_id = pf.col_measurement_id(col_buf);
+        const std::chrono::nanoseconds ts(pf.col_timestamp(col_buf));
+        const uint32_t encoder = pf.col_encoder(col_buf);
+        const uint32_t status = pf.col_status(col_buf);
+        const bool valid = (status & 0x01);
+
+        // drop invalid / out-of-bounds data in case of misconfiguration
+        col_m_ids[icol] = -1;
+        if (!valid || m_id >= w) continue;
+        col_m_ids[icol] = m_id;
+
+        if (!seen[m_id]) {
+            seen[m_id] = 1;
+            new_cols.push_back(m_id);
+            const uint64_t t = ts.count();
+            if (summary.cols_received++ == 0) {
+                summary.first_timestamp = summary.last_timestamp = t;
+            } else {
+                summary.first_timestamp = std::min(summary.first_timestamp, t);
+                summary.last_timestamp = std::max(summary.last_timestamp, t);
+            }
+            const bool in_window = cw.first <= cw.second
+                                       ? m_id >= cw.first && m_id <= cw.second
+                                       : m_id >= cw.first || m_id <= cw.second;
+            summary.window_cols_received += in_window;
+            if (slot) slot->n_seen++;
+        }
+
+        if (!slot && m_id >= next_m_id) {
+            // zero out missing columns if we jumped forward
+            zero_cols(ls, next_m_id, m_id);
+            next_m_id = m_id + 1;
+        }
+
+        // old header API; will be removed in a future release
+        if (!(flags & BATCH_NO_BLOCK_HEADERS))
+            ls.header(m_id) = {ts, encoder, status};
+
+        // write new header values
+        ls.timestamp()[m_id] = ts.count();
+        ls.measurement_id()[m_id] = m_id;
+        ls.status()[m_id] = status;
+        ls.rx_timestamp()[m_id] = rx_ts;
+    }
+
+    // parse channel data of all valid columns, one field at a time
+    if (flags & BATCH_DESTAGGER) {
+        staging_ids.resize(col_m_ids.size());
+        for (size_t c = 0; c < col_m_ids.size(); c++)
+            staging_ids[c] = col_m_ids[c] < 0 ? -1 : static_cast<int>(c);
+        impl::foreach_field(ls, parse_destaggered_cols(), kernel, pf,
+                            packet_buf, col_m_ids.data(), staging_ids.data(),
+                            staging, destagger);
+    } else {
+        impl::foreach_field(ls, parse_field_cols(), kernel, pf, packet_buf,
+                            col_m_ids.data());
+    }
+
+    // count pixels without returns in the columns that just arrived
+    if (new_cols.empty()) return;
+    const LidarScan& cls = ls;
+    const Destaggerer* d = (flags & BATCH_DESTAGGER) ? &destagger : nullptr;
+    if (cls.field_type(ChanField::RANGE) != ChanFieldType::VOID)
+        impl::visit_field(cls, ChanField::RANGE, count_zero_cols(), new_cols,
+                          d, summary.zero_range);
+    if (cls.field_type(ChanField::RANGE2) != ChanFieldType::VOID)
+        impl::visit_field(cls, ChanField::RANGE2, count_zero_cols(), new_cols,
+                          d, summary.zero_range2);
+}
+
+bool ScanBatcher::operator()(const uint8_t* packet_buf, LidarScan& ls,
+                             uint64_t rx_ts) {
+    OUSTER_TRACE_SCOPE("ScanBatcher");
+    if (reorder)
+        throw std::invalid_argument(
+            "batching with a reorder window requires a scan pool");
     if (ls.w != w || ls.h != h)
         throw std::invalid_argument("unexpected scan dimensions");
 
@@ -347,7 +1753,7 @@ bool ScanBatcher::operator()(const uint8_t* packet_buf, LidarScan& ls) {
     if (cached_packet) {
         cached_packet = false;
         ls.frame_id = -1;
-        this->operator()(cache.data(), ls);
+        this->operator()(cache.data(), ls, cache_rx_ts);
     }
 
     const uint16_t f_id = pf.frame_id(packet_buf);
@@ -356,48 +1762,144 @@ bool ScanBatcher::operator()(const uint8_t* packet_buf, LidarScan& ls) {
         // expecting to start batching a new scan
         next_m_id = 0;
         ls.frame_id = f_id;
+        ls.destaggered = flags & BATCH_DESTAGGER;
+        start_scan(ls);
     } else if (ls.frame_id == f_id + 1) {
         // drop reordered packets from the previous frame
+        counters.reordered_packets++;
+        OUSTER_TRACE_COUNTER("ScanBatcher.reordered_packets",
+                             counters.reordered_packets);
         return false;
     } else if (ls.frame_id != f_id) {
         // got a packet from a new frame
-        impl::foreach_field(ls, zero_field_cols(), next_m_id, w);
-        zero_header_cols(ls, next_m_id, w);
+        zero_cols(ls, next_m_id, w);
+        finish_scan(ls);
         std::memcpy(cache.data(), packet_buf, cache.size());
+        cache_rx_ts = rx_ts;
         cached_packet = true;
+        counters.scans++;
+        OUSTER_TRACE_COUNTER("ScanBatcher.scans", counters.scans);
+        OUSTER_TRACE_COUNTER("ScanBatcher.zeroed_cols", counters.zeroed_cols);
         return true;
     }
 
-    // parse measurement blocks
-    for (int icol = 0; icol < pf.columns_per_packet; icol++) {
-        const uint8_t* col_buf = pf.nth_col(icol, packet_buf);
-        const uint16_t m_id = pf.col_measurement_id(col_buf);
-        const std::chrono::nanoseconds ts(pf.col_timestamp(col_buf));
-        const uint32_t encoder = pf.col_encoder(col_buf);
-        const uint32_t status = pf.col_status(col_buf);
-        const bool valid = (status & 0x01);
+    parse(packet_buf, ls, rx_ts, nullptr);
+    return false;
+}
 
-        // drop invalid / out-of-bounds data in case of misconfiguration
-        if (!valid || m_id >= w) continue;
+/*
+ * Zero the columns of the oldest scan in flight that never arrived and move
+ * it to the ready queue
+ */
+void ScanBatcher::release_front() {
+    InFlight& slot = in_flight.front();
+    LidarScan& ls = *slot.scan;
+    if (slot.n_seen < window_cols) counters.expired_scans++;
+    for (std::ptrdiff_t v = 0; v < w;) {
+        if (slot.seen[v]) {
+            v++;
+            continue;
+        }
+        const std::ptrdiff_t start = v;
+        while (v < w && !slot.seen[v]) v++;
+        zero_cols(ls, start, v);
+    }
+    finish_scan(ls);
+
+    released_any = true;
+    last_released = static_cast<uint16_t>(ls.frame_id);
+    counters.scans++;
+    OUSTER_TRACE_COUNTER("ScanBatcher.scans", counters.scans);
+    OUSTER_TRACE_COUNTER("ScanBatcher.zeroed_cols", counters.zeroed_cols);
+    ready.push_back(std::move(slot.scan));
+    in_flight.pop_front();
+}
 
-        // zero out missing columns if we jumped forward
-        if (m_id >= next_m_id) {
-            impl::foreach_field(ls, zero_field_cols(), next_m_id, m_id);
-            zero_header_cols(ls, next_m_id, m_id);
-            next_m_id = m_id + 1;
+LidarScanPool::Handle ScanBatcher::reorder_packet(const uint8_t* packet_buf,
+                                                  LidarScanPool& pool,
+                                                  uint64_t rx_ts) {
+    const uint16_t f_id = pf.frame_id(packet_buf);
+    // frame ids wrap around; compare by signed distance
+    auto before = [](uint16_t a, uint16_t b) {
+        return static_cast<int16_t>(static_cast<uint16_t>(a - b)) < 0;
+    };
+
+    auto it = std::find_if(in_flight.begin(), in_flight.end(),
+                           [&](const InFlight& slot) {
+                               return !before(
+                                   static_cast<uint16_t>(slot.scan->frame_id),
+                                   f_id);
+                           });
+    if (it == in_flight.end() || it->scan->frame_id != int32_t{f_id}) {
+        if (released_any && !before(last_released, f_id)) {
+            // drop packets of frames already released
+            counters.reordered_packets++;
+            OUSTER_TRACE_COUNTER("ScanBatcher.reordered_packets",
+                                 counters.reordered_packets);
+            return release(rx_ts);
         }
 
-        // old header API; will be removed in a future release
-        ls.header(m_id) = {ts, encoder, status};
+        // start batching a new frame; frames before it are now due
+        InFlight slot{pool.acquire(), std::vector<uint8_t>(w, 0), 0,
+                      std::numeric_limits<uint64_t>::max()};
+        if (slot.scan->w != w || slot.scan->h != h)
+            throw std::invalid_argument("unexpected scan dimensions");
+        slot.scan->frame_id = f_id;
+        slot.scan->destaggered = flags & BATCH_DESTAGGER;
+        start_scan(*slot.scan);
+        const uint64_t due = rx_ts + window.max_delay;
+        for (auto prev = in_flight.begin(); prev != it; ++prev)
+            prev->due = std::min(prev->due, due);
+        it = in_flight.insert(it, std::move(slot));
+    } else if (std::next(it) != in_flight.end()) {
+        counters.late_packets++;
+        OUSTER_TRACE_COUNTER("ScanBatcher.late_packets",
+                             counters.late_packets);
+    }
 
-        // write new header values
-        ls.timestamp()[m_id] = ts.count();
-        ls.measurement_id()[m_id] = m_id;
-        ls.status()[m_id] = status;
+    parse(packet_buf, *it->scan, rx_ts, &*it);
 
-        impl::foreach_field(ls, parse_field_col(), m_id, pf, col_buf);
+    // make room for the latest frame
+    while (in_flight.size() > window.scans) release_front();
+    return release(rx_ts);
+}
+
+LidarScanPool::Handle ScanBatcher::operator()(const uint8_t* packet_buf,
+                                              LidarScanPool& pool,
+                                              uint64_t rx_ts) {
+    if (reorder) {
+        OUSTER_TRACE_SCOPE("ScanBatcher");
+        return reorder_packet(packet_buf, pool, rx_ts);
     }
-    return false;
+
+    if (!pooled) {
+        pooled = pool.acquire();
+        pooled->frame_id = -1;
+    }
+    if (!this->operator()(packet_buf, *pooled, rx_ts)) return {};
+
+    // start the next scan with the cached packet right away
+    auto done = std::move(pooled);
+    pooled = pool.acquire();
+    pooled->frame_id = -1;
+    cached_packet = false;
+    this->operator()(cache.data(), *pooled, cache_rx_ts);
+    return done;
+}
+
+LidarScanPool::Handle ScanBatcher::release(uint64_t now) {
+    // scans are released in frame order, so only the oldest can be next
+    while (ready.empty() && !in_flight.empty()) {
+        const InFlight& slot = in_flight.front();
+        if (slot.n_seen < window_cols && slot.due > now &&
+            now != std::numeric_limits<uint64_t>::max())
+            break;
+        release_front();
+    }
+    if (ready.empty()) return {};
+    auto done = std::move(ready.front());
+    ready.pop_front();
+    return done;
 }
 
 }  // namespace ouster
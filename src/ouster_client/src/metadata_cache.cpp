@@ -0,0 +1,421 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/metadata_cache.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace ouster {
+namespace sensor {
+
+namespace {
+
+/*
+ * Serialized sensor_info, in host byte order: header, then each member of
+ * sensor_info in declaration order. Strings and vectors are prefixed with
+ * their length as a uint32, matrices are 16 doubles in column major order.
+ *
+ * Cache entries: header, hash, metadata json, serialized sensor_info, and a
+ * uint8 flag followed by the row count and the direction and offset columns
+ * of the lookup table if it's cached.
+ */
+constexpr uint32_t INFO_MAGIC = 0x3149534f;   // "OSI1"
+constexpr uint32_t ENTRY_MAGIC = 0x31434d4f;  // "OMC1"
+constexpr uint32_t FORMAT_VERSION = 1;
+
+class Writer {
+   public:
+    template <typename T>
+    void put(T v) {
+        const auto p = reinterpret_cast<const uint8_t*>(&v);
+        buf_.insert(buf_.end(), p, p + sizeof(T));
+    }
+
+    template <typename T>
+    void put_array(const T* data, size_t n) {
+        const auto p = reinterpret_cast<const uint8_t*>(data);
+        buf_.insert(buf_.end(), p, p + n * sizeof(T));
+    }
+
+    template <typename T>
+    void put_vector(const std::vector<T>& v) {
+        put(static_cast<uint32_t>(v.size()));
+        put_array(v.data(), v.size());
+    }
+
+    void put_string(const std::string& s) {
+        put(static_cast<uint32_t>(s.size()));
+        put_array(s.data(), s.size());
+    }
+
+    std::vector<uint8_t>& buf() { return buf_; }
+
+   private:
+    std::vector<uint8_t> buf_;
+};
+
+class Reader {
+   public:
+    Reader(const uint8_t* buf, size_t size) : p_{buf}, end_{buf + size} {}
+
+    template <typename T>
+    T get() {
+        T v;
+        get_array(&v, 1);
+        return v;
+    }
+
+    template <typename T>
+    void get_array(T* data, size_t n) {
+        const uint8_t* p = take(n * sizeof(T));
+        if (n) std::memcpy(data, p, n * sizeof(T));
+    }
+
+    template <typename T>
+    std::vector<T> get_vector() {
+        std::vector<T> v(count(sizeof(T)));
+        get_array(v.data(), v.size());
+        return v;
+    }
+
+    std::string get_string() {
+        const size_t n = count(1);
+        return std::string(reinterpret_cast<const char*>(take(n)), n);
+    }
+
+    const uint8_t* take(size_t n) {
+        if (static_cast<size_t>(end_ - p_) < n)
+            throw std::runtime_error("Truncated binary sensor metadata");
+        const uint8_t* p = p_;
+        p_ += n;
+        return p;
+    }
+
+   private:
+    // number of elements that follow, checked before allocating
+    size_t count(size_t elem_size) {
+        const size_t n = get<uint32_t>();
+        if (static_cast<size_t>(end_ - p_) / elem_size < n)
+            throw std::runtime_error("Truncated binary sensor metadata");
+        return n;
+    }
+
+    const uint8_t* p_;
+    const uint8_t* end_;
+};
+
+void put_header(Writer& w, uint32_t magic) {
+    w.put(magic);
+    w.put(FORMAT_VERSION);
+}
+
+void check_header(Reader& r, uint32_t magic) {
+    if (r.get<uint32_t>() != magic || r.get<uint32_t>() != FORMAT_VERSION)
+        throw std::runtime_error("Incompatible binary sensor metadata");
+}
+
+void put_info(Writer& w, const sensor_info& info) {
+    put_header(w, INFO_MAGIC);
+    w.put_string(info.name);
+    w.put_string(info.sn);
+    w.put_string(info.fw_rev);
+    w.put(static_cast<uint32_t>(info.mode));
+    w.put_string(info.prod_line);
+
+    const auto& f = info.format;
+    w.put(f.pixels_per_column);
+    w.put(f.columns_per_packet);
+    w.put(f.columns_per_frame);
+    w.put_vector(f.pixel_shift_by_row);
+    w.put(static_cast<int32_t>(f.column_window.first));
+    w.put(static_cast<int32_t>(f.column_window.second));
+    w.put(static_cast<uint32_t>(f.udp_profile_lidar));
+    w.put(static_cast<uint32_t>(f.udp_profile_imu));
+
+    w.put_vector(info.beam_azimuth_angles);
+    w.put_vector(info.beam_altitude_angles);
+    w.put(info.lidar_origin_to_beam_origin_mm);
+    w.put_array(info.imu_to_sensor_transform.data(), 16);
+    w.put_array(info.lidar_to_sensor_transform.data(), 16);
+    w.put_array(info.extrinsic.data(), 16);
+    w.put(info.init_id);
+    w.put(info.udp_port_lidar);
+    w.put(info.udp_port_imu);
+}
+
+sensor_info get_info(Reader& r) {
+    check_header(r, INFO_MAGIC);
+    sensor_info info;
+    info.name = r.get_string();
+    info.sn = r.get_string();
+    info.fw_rev = r.get_string();
+    info.mode = static_cast<lidar_mode>(r.get<uint32_t>());
+    info.prod_line = r.get_string();
+
+    auto& f = info.format;
+    f.pixels_per_column = r.get<uint32_t>();
+    f.columns_per_packet = r.get<uint32_t>();
+    f.columns_per_frame = r.get<uint32_t>();
+    f.pixel_shift_by_row = r.get_vector<int>();
+    f.column_window.first = r.get<int32_t>();
+    f.column_window.second = r.get<int32_t>();
+    f.udp_profile_lidar = static_cast<UDPProfileLidar>(r.get<uint32_t>());
+    f.udp_profile_imu = static_cast<UDPProfileIMU>(r.get<uint32_t>());
+
+    info.beam_azimuth_angles = r.get_vector<double>();
+    info.beam_altitude_angles = r.get_vector<double>();
+    info.lidar_origin_to_beam_origin_mm = r.get<double>();
+    r.get_array(info.imu_to_sensor_transform.data(), 16);
+    r.get_array(info.lidar_to_sensor_transform.data(), 16);
+    r.get_array(info.extrinsic.data(), 16);
+    info.init_id = r.get<uint32_t>();
+    info.udp_port_lidar = r.get<uint16_t>();
+    info.udp_port_imu = r.get<uint16_t>();
+    return info;
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream in{path, std::ios::binary | std::ios::ate};
+    if (!in) return {};
+    std::string data(static_cast<size_t>(in.tellg()), '\0');
+    in.seekg(0);
+    in.read(&data[0], static_cast<std::streamsize>(data.size()));
+    return in ? data : std::string{};
+}
+
+// read-only contents of a file, mapped where supported
+class FileData {
+   public:
+    explicit FileData(const std::string& path) {
+#ifdef _WIN32
+        copy_ = read_file(path);
+        data_ = reinterpret_cast<const uint8_t*>(copy_.data());
+        size_ = copy_.size();
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, static_cast<size_t>(st.st_size),
+                           PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data_ = static_cast<const uint8_t*>(p);
+                size_ = static_cast<size_t>(st.st_size);
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    ~FileData() {
+#ifndef _WIN32
+        if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+    }
+
+    FileData(const FileData&) = delete;
+    FileData& operator=(const FileData&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+   private:
+    const uint8_t* data_{nullptr};
+    size_t size_{0};
+#ifdef _WIN32
+    std::string copy_;
+#endif
+};
+
+int make_dir(const std::string& path) {
+#ifdef _WIN32
+    return _mkdir(path.c_str());
+#else
+    return mkdir(path.c_str(), 0755);
+#endif
+}
+
+// create a directory and its parents, if missing
+void make_dirs(const std::string& dir) {
+    for (size_t i = 1; i <= dir.size(); i++) {
+        if (i < dir.size() && dir[i] != '/' && dir[i] != '\\') continue;
+        const std::string parent = dir.substr(0, i);
+        if (make_dir(parent) != 0 && errno != EEXIST)
+            throw std::runtime_error("Failed to create directory " + parent +
+                                     ": " + std::strerror(errno));
+    }
+}
+
+int process_id() {
+#ifdef _WIN32
+    return _getpid();
+#else
+    return static_cast<int>(getpid());
+#endif
+}
+
+}  // namespace
+
+std::vector<uint8_t> to_binary(const sensor_info& info) {
+    Writer w;
+    put_info(w, info);
+    return std::move(w.buf());
+}
+
+sensor_info sensor_info_from_binary(const uint8_t* buf, size_t size) {
+    Reader r{buf, size};
+    return get_info(r);
+}
+
+MetadataCache::MetadataCache(const std::string& dir) : dir_{dir} {}
+
+std::string MetadataCache::key(const std::string& sn,
+                               const std::string& fw_rev,
+                               const std::string& mode) {
+    std::string key = sn + "_" + fw_rev + "_" + mode;
+    for (auto& c : key) {
+        const bool safe = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+                          (c >= 'A' && c <= 'Z') || c == '.' || c == '-';
+        if (!safe) c = '_';
+    }
+    return key;
+}
+
+std::string MetadataCache::hash(const std::string& data) {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 0x100000001b3;
+    }
+    std::ostringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << h;
+    return ss.str();
+}
+
+std::string MetadataCache::path(const std::string& key) const {
+    return dir_ + "/" + key + ".bin";
+}
+
+const std::string& MetadataCache::dir() const { return dir_; }
+
+optional<MetadataCache::Entry> MetadataCache::load(
+    const std::string& key) const {
+    const FileData data{path(key)};
+    if (!data.size()) return nonstd::nullopt;
+
+    try {
+        Reader r{data.data(), data.size()};
+        check_header(r, ENTRY_MAGIC);
+        Entry entry;
+        entry.hash = r.get_string();
+        entry.metadata = r.get_string();
+        entry.info = get_info(r);
+        if (r.get<uint8_t>()) {
+            const auto rows = static_cast<Eigen::Index>(r.get<uint64_t>());
+            const size_t n = static_cast<size_t>(rows) * 3;
+            if (n / 3 != static_cast<size_t>(rows) ||
+                n > data.size() / sizeof(double))
+                throw std::runtime_error("Corrupt lookup table");
+            XYZLut lut;
+            lut.direction.resize(rows, 3);
+            lut.offset.resize(rows, 3);
+            r.get_array(lut.direction.data(), n);
+            r.get_array(lut.offset.data(), n);
+            entry.lut = std::move(lut);
+        }
+        return entry;
+    } catch (const std::runtime_error&) {
+        return nonstd::nullopt;
+    }
+}
+
+void MetadataCache::store(const std::string& key, const Entry& entry) const {
+    Writer w;
+    put_header(w, ENTRY_MAGIC);
+    w.put_string(entry.hash);
+    w.put_string(entry.metadata);
+    put_info(w, entry.info);
+    w.put(static_cast<uint8_t>(entry.lut ? 1 : 0));
+    if (entry.lut) {
+        const auto& lut = *entry.lut;
+        if (lut.direction.rows() != lut.offset.rows())
+            throw std::invalid_argument("Inconsistent lookup table");
+        w.put(static_cast<uint64_t>(lut.direction.rows()));
+        w.put_array(lut.direction.data(), lut.direction.size());
+        w.put_array(lut.offset.data(), lut.offset.size());
+    }
+
+    // write a temporary file and rename it, so readers never see a partial
+    // entry
+    make_dirs(dir_);
+    const std::string dst = path(key);
+    const std::string tmp = dst + "." + std::to_string(process_id()) + ".tmp";
+    {
+        std::ofstream out{tmp, std::ios::binary | std::ios::trunc};
+        out.write(reinterpret_cast<const char*>(w.buf().data()),
+                  static_cast<std::streamsize>(w.buf().size()));
+        if (!out) {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Failed to write metadata cache " + tmp);
+        }
+    }
+#ifdef _WIN32
+    std::remove(dst.c_str());
+#endif
+    if (std::rename(tmp.c_str(), dst.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Failed to write metadata cache " + dst);
+    }
+}
+
+MetadataCache::Entry MetadataCache::load_json(const std::string& json_file,
+                                              bool with_lut) const {
+    const std::string json = read_file(json_file);
+    if (json.empty())
+        throw std::runtime_error("Failed to read metadata file: " + json_file);
+
+    const std::string h = hash(json);
+    const std::string k = "json_" + h;
+    auto entry = load(k);
+    if (entry && entry->hash == h && (entry->lut || !with_lut))
+        return std::move(*entry);
+
+    Entry fresh;
+    fresh.hash = h;
+    fresh.metadata = json;
+    fresh.info = parse_metadata(json);
+    if (with_lut) fresh.lut = make_xyz_lut(fresh.info);
+    try {
+        store(k, fresh);
+    } catch (const std::runtime_error&) {
+        // the cache is an optimization only
+    }
+    return fresh;
+}
+
+}  // namespace sensor
+}  // namespace ouster
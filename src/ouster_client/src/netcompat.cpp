@@ -5,6 +5,8 @@
 
 #include "netcompat.h"
 
+#include <chrono>
+#include <cstdint>
 #include <string>
 
 #if defined _WIN32
@@ -19,6 +21,11 @@
 
 #include <cerrno>
 #include <cstring>
+#include <ctime>
+
+#ifdef __linux__
+#include <linux/sock_diag.h>
+#endif
 
 #endif
 
@@ -79,6 +86,14 @@ bool socket_exit() {
 #endif
 }
 
+bool socket_would_block() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
 int socket_set_non_blocking(SOCKET value) {
 #ifdef _WIN32
     u_long non_blocking_mode = 1;
@@ -113,6 +128,69 @@ int socket_set_rcvtimeout(SOCKET sock, int timeout_sec) {
 #endif
 }
 
+int socket_set_incoming_cpu(SOCKET sock, int cpu) {
+#ifdef SO_INCOMING_CPU
+    return setsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, (const char*)&cpu,
+                      sizeof cpu);
+#else
+    (void)sock;
+    (void)cpu;
+    return SOCKET_ERROR;
+#endif
+}
+
+int64_t socket_get_drops(SOCKET sock) {
+#if defined(SO_MEMINFO) && defined(__linux__)
+    uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t len = sizeof(meminfo);
+    if (getsockopt(sock, SOL_SOCKET, SO_MEMINFO, meminfo, &len) ||
+        len <= SK_MEMINFO_DROPS * sizeof(uint32_t))
+        return -1;
+    return meminfo[SK_MEMINFO_DROPS];
+#else
+    (void)sock;
+    return -1;
+#endif
+}
+
+int socket_set_rx_timestamps(SOCKET sock) {
+#ifdef SO_TIMESTAMPNS
+    int option = 1;
+    return setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, (const char*)&option,
+                      sizeof option);
+#else
+    (void)sock;
+    return SOCKET_ERROR;
+#endif
+}
+
+#ifndef _WIN32
+uint64_t socket_msg_rx_timestamp(const struct msghdr& msg) {
+#ifdef SO_TIMESTAMPNS
+    auto hdr = const_cast<struct msghdr*>(&msg);
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET ||
+            cmsg->cmsg_type != SCM_TIMESTAMPNS)
+            continue;
+        struct timespec ts;
+        std::memcpy(&ts, CMSG_DATA(cmsg), sizeof ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL +
+               static_cast<uint64_t>(ts.tv_nsec);
+    }
+#else
+    (void)msg;
+#endif
+    return socket_rx_timestamp_now();
+}
+#endif
+
+uint64_t socket_rx_timestamp_now() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(system_clock::now().time_since_epoch())
+        .count();
+}
+
 }  // namespace impl
 }  // namespace sensor
 }  // namespace ouster
@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 #if defined _WIN32  // --------- On Windows ---------
@@ -25,6 +27,7 @@
 #else  // --------- Compiling on *nix ---------
 
 #include <arpa/inet.h>
+#include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <sys/select.h>
@@ -74,6 +77,12 @@ bool socket_valid(SOCKET value);
  */
 bool socket_exit();
 
+/**
+ * Check if the last error was a non-blocking socket with no data available
+ * @return If the operation would have blocked
+ */
+bool socket_would_block();
+
 /**
  * Set a specified socket to non-blocking
  * @param[in] value The socket file descriptor to set non-blocking
@@ -96,6 +105,51 @@ int socket_set_reuse(SOCKET value);
  */
 int socket_set_rcvtimeout(SOCKET sock, int timeout_sec);
 
+/**
+ * Set SO_INCOMING_CPU on the specified socket, where supported
+ * @param[in] sock The socket file descriptor
+ * @param[in] cpu The cpu whose packets should be steered to the socket
+ * @return success
+ */
+int socket_set_incoming_cpu(SOCKET sock, int cpu);
+
+/**
+ * Get the number of datagrams the kernel dropped because the receive buffer
+ * of a socket was full, where supported
+ * @param[in] sock The socket file descriptor
+ * @return The drops since the socket was opened, or -1 if unsupported
+ */
+int64_t socket_get_drops(SOCKET sock);
+
+/**
+ * Ask the kernel to timestamp datagrams received on a socket, where supported
+ * @param[in] sock The socket file descriptor
+ * @return success
+ */
+int socket_set_rx_timestamps(SOCKET sock);
+
+/**
+ * Size of the control buffer needed to receive a timestamp with recvmsg()
+ */
+constexpr size_t socket_rx_timestamp_control_size = 64;
+
+#ifndef _WIN32
+/**
+ * Get the receive timestamp of a datagram read with recvmsg()
+ *
+ * Falls back to the current system time if the kernel didn't attach one.
+ * @param[in] msg The message header filled in by recvmsg()
+ * @return Nanoseconds since the unix epoch
+ */
+uint64_t socket_msg_rx_timestamp(const struct msghdr& msg);
+#endif
+
+/**
+ * Get the current system time, used when no kernel timestamp is available
+ * @return Nanoseconds since the unix epoch
+ */
+uint64_t socket_rx_timestamp_now();
+
 }  // namespace impl
 }  // namespace sensor
 }  // namespace ouster
@@ -0,0 +1,129 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/packet_fanout.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ouster/client.h"
+#include "ouster/trace.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace sensor {
+
+namespace impl {
+// defined in client.cpp
+client_state poll_client_us(const client& c, int64_t timeout_us);
+}  // namespace impl
+
+namespace {
+
+// max lidar packets read in one go
+constexpr int MAX_RECV_BATCH = 64;
+
+// how often the receive thread checks for shutdown
+constexpr int64_t POLL_TIMEOUT_US = 100000;
+
+}  // namespace
+
+struct PacketFanout::Impl {
+    std::shared_ptr<client> cli;
+    packet_format pf;
+    std::vector<PacketHandler> handlers;
+
+    std::thread thread;
+    std::atomic<bool> stop{false};
+    bool running{false};
+
+    std::atomic<uint64_t> lidar_packets{0};
+    std::atomic<uint64_t> imu_packets{0};
+
+    Impl(std::shared_ptr<client> cli, const packet_format& pf)
+        : cli(std::move(cli)), pf(pf) {}
+
+    void dispatch(client_state st, const uint8_t* buf, uint64_t rx_ts) {
+        for (const auto& h : handlers) h(st, buf, rx_ts);
+    }
+
+    void run();
+};
+
+void PacketFanout::Impl::run() {
+    // one extra byte to detect oversized datagrams, see read_lidar_packet()
+    const size_t buf_size = pf.lidar_packet_size + 1;
+    std::vector<uint8_t> storage(MAX_RECV_BATCH * buf_size);
+    std::vector<uint8_t*> bufs(MAX_RECV_BATCH);
+    for (int i = 0; i < MAX_RECV_BATCH; i++)
+        bufs[i] = storage.data() + i * buf_size;
+    std::vector<uint64_t> rx_ts(MAX_RECV_BATCH);
+
+    while (!stop) {
+        const client_state st = impl::poll_client_us(*cli, POLL_TIMEOUT_US);
+        if (st & (CLIENT_ERROR | EXIT)) break;
+
+        if (st & LIDAR_DATA) {
+            OUSTER_TRACE_SCOPE("PacketFanout.lidar");
+            int n = 0;
+            do {
+                n = read_lidar_packets(*cli, bufs.data(), MAX_RECV_BATCH, pf,
+                                       rx_ts.data());
+                for (int i = 0; i < n; i++)
+                    dispatch(LIDAR_DATA, bufs[i], rx_ts[i]);
+                if (n > 0) lidar_packets += n;
+            } while (n == MAX_RECV_BATCH && !stop);
+        }
+
+        if (st & IMU_DATA) {
+            while (!stop && read_imu_packet(*cli, storage.data(), pf)) {
+                dispatch(IMU_DATA, storage.data(), 0);
+                imu_packets++;
+            }
+        }
+    }
+}
+
+PacketFanout::PacketFanout(std::shared_ptr<client> cli,
+                           const packet_format& pf) {
+    if (!cli) throw std::invalid_argument("expected a client");
+    impl_ = std::make_unique<Impl>(std::move(cli), pf);
+}
+
+PacketFanout::~PacketFanout() { stop(); }
+
+size_t PacketFanout::add_handler(PacketHandler handler) {
+    if (!handler) throw std::invalid_argument("expected a handler");
+    if (impl_->running)
+        throw std::invalid_argument("cannot add a handler while running");
+    impl_->handlers.push_back(std::move(handler));
+    return impl_->handlers.size();
+}
+
+void PacketFanout::start() {
+    if (impl_->running) return;
+    impl_->stop = false;
+    impl_->running = true;
+    impl_->thread = std::thread([this]() { impl_->run(); });
+}
+
+void PacketFanout::stop() {
+    if (!impl_->running) return;
+    impl_->stop = true;
+    if (impl_->thread.joinable()) impl_->thread.join();
+    impl_->running = false;
+}
+
+FanoutStats PacketFanout::stats() const {
+    return {impl_->lidar_packets, impl_->imu_packets};
+}
+
+}  // namespace sensor
+}  // namespace ouster
@@ -0,0 +1,351 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "packet_ring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#ifdef __linux__
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace ouster {
+namespace sensor {
+namespace impl {
+
+#ifdef __linux__
+
+namespace {
+
+// blocks are retired to userspace when full or after this many ms
+constexpr unsigned int BLOCK_TIMEOUT_MS = 2;
+constexpr size_t BLOCK_SIZE = 1 << 20;
+// must fit the largest possible datagram
+constexpr size_t FRAME_SIZE = 1 << 16;
+
+constexpr uint16_t IP_MF_FLAG = 0x2000;
+constexpr uint16_t IP_OFFSET_MASK = 0x1fff;
+constexpr size_t MAX_DATAGRAM_SIZE = 65535;
+constexpr uint8_t IPPROTO_UDP_NUM = 17;
+constexpr size_t UDP_HEADER_SIZE = 8;
+constexpr size_t IPV6_HEADER_SIZE = 40;
+
+uint16_t load_be16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+/*
+ * Classic BPF program accepting UDP datagrams to port, as seen by a SOCK_DGRAM
+ * packet socket, i.e. starting at the network header. Non-initial IPv4
+ * fragments carry no UDP header and are all accepted, to be matched after
+ * reassembly. IPv6 packets with extension headers are not matched.
+ */
+void make_port_filter(uint16_t port, struct sock_filter (&prog)[17]) {
+    const struct sock_filter filter[17] = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),  // ip version
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 4, 0, 7),
+        // ipv4
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP_NUM, 0, 11),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6),
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, IP_OFFSET_MASK, 8, 0),
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 5, 6),
+        // ipv6
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 0, 5),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 6),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP_NUM, 0, 3),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, IPV6_HEADER_SIZE + 2),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0x40000),  // accept
+        BPF_STMT(BPF_RET | BPF_K, 0),        // drop
+    };
+    std::copy(std::begin(filter), std::end(filter), std::begin(prog));
+}
+
+/*
+ * Find the payload of a UDP datagram sent to port, given len bytes starting at
+ * its UDP header
+ */
+bool udp_payload(const uint8_t* udp, size_t len, uint16_t port,
+                 const uint8_t*& payload, size_t& payload_len) {
+    if (len < UDP_HEADER_SIZE || load_be16(udp + 2) != port) return false;
+
+    const size_t udp_len = load_be16(udp + 4);
+    if (udp_len < UDP_HEADER_SIZE || udp_len > len) return false;
+    payload = udp + UDP_HEADER_SIZE;
+    payload_len = udp_len - UDP_HEADER_SIZE;
+    return true;
+}
+
+struct tpacket_block_desc* block_desc(uint8_t* block) {
+    return reinterpret_cast<struct tpacket_block_desc*>(block);
+}
+
+// block status is shared with the kernel
+uint32_t load_status(uint8_t* block) {
+    auto status = block_desc(block)->hdr.bh1.block_status;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return status;
+}
+
+}  // namespace
+
+PacketRing::PacketRing(SOCKET fd, uint8_t* map, size_t block_size,
+                       size_t n_blocks, uint16_t port)
+    : fd_(fd),
+      map_(map),
+      block_size_(block_size),
+      n_blocks_(n_blocks),
+      port_(port) {}
+
+std::unique_ptr<PacketRing> PacketRing::create(int port,
+                                               const std::string& interface,
+                                               size_t ring_size) {
+    auto fail = [](const char* what, SOCKET fd) {
+        std::cerr << "packet ring " << what << ": " << socket_get_error()
+                  << std::endl;
+        if (socket_valid(fd)) socket_close(fd);
+        return std::unique_ptr<PacketRing>();
+    };
+
+    unsigned int ifindex = 0;
+    if (!interface.empty()) {
+        ifindex = if_nametoindex(interface.c_str());
+        if (ifindex == 0) return fail("if_nametoindex()", SOCKET_ERROR);
+    }
+
+    // no protocol until bound, so nothing is captured before the filter is set
+    SOCKET fd = socket(AF_PACKET, SOCK_DGRAM, 0);
+    if (!socket_valid(fd)) return fail("socket()", fd);
+
+    struct sock_filter filter[17];
+    make_port_filter(static_cast<uint16_t>(port), filter);
+    struct sock_fprog prog;
+    prog.len = sizeof(filter) / sizeof(filter[0]);
+    prog.filter = filter;
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)))
+        return fail("setsockopt(SO_ATTACH_FILTER)", fd);
+
+    int version = TPACKET_V3;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)))
+        return fail("setsockopt(PACKET_VERSION)", fd);
+
+    const size_t n_blocks = std::max<size_t>(ring_size / BLOCK_SIZE, 2);
+    struct tpacket_req3 req;
+    std::memset(&req, 0, sizeof(req));
+    req.tp_block_size = BLOCK_SIZE;
+    req.tp_block_nr = n_blocks;
+    req.tp_frame_size = FRAME_SIZE;
+    req.tp_frame_nr = (BLOCK_SIZE / FRAME_SIZE) * n_blocks;
+    req.tp_retire_blk_tov = BLOCK_TIMEOUT_MS;
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)))
+        return fail("setsockopt(PACKET_RX_RING)", fd);
+
+    void* map = mmap(NULL, BLOCK_SIZE * n_blocks, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (map == MAP_FAILED) return fail("mmap()", fd);
+
+    std::unique_ptr<PacketRing> ring{
+        new PacketRing(fd, static_cast<uint8_t*>(map), BLOCK_SIZE, n_blocks,
+                       static_cast<uint16_t>(port))};
+
+    struct sockaddr_ll addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = ifindex;
+    if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr))) {
+        std::cerr << "packet ring bind(): " << socket_get_error() << std::endl;
+        return std::unique_ptr<PacketRing>();
+    }
+
+    return ring;
+}
+
+PacketRing::~PacketRing() {
+    munmap(map_, block_size_ * n_blocks_);
+    socket_close(fd_);
+}
+
+bool PacketRing::next_block() {
+    uint8_t* block = map_ + block_ind_ * block_size_;
+    if (!(load_status(block) & TP_STATUS_USER)) return false;
+
+    block_ = block;
+    remaining_ = block_desc(block)->hdr.bh1.num_pkts;
+    pkt_ = block + block_desc(block)->hdr.bh1.offset_to_first_pkt;
+    return true;
+}
+
+void PacketRing::release_block() {
+    std::atomic_thread_fence(std::memory_order_release);
+    block_desc(block_)->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    block_ = nullptr;
+    block_ind_ = (block_ind_ + 1) % n_blocks_;
+}
+
+bool PacketRing::pending() {
+    if (block_ && remaining_ > 0) return true;
+    if (block_) release_block();
+    return next_block();
+}
+
+/*
+ * Add an IPv4 fragment to its datagram. Returns the reassembled IP payload
+ * once all fragments have been seen, or nullptr. Assumes fragments are not
+ * duplicated; incomplete datagrams are evicted by newer ones.
+ */
+const uint8_t* PacketRing::reassemble(const uint8_t* net, size_t len,
+                                      size_t& out_len) {
+    const size_t ihl = (net[0] & 0x0f) * 4;
+    const uint16_t frag = load_be16(net + 6);
+    const uint16_t id = load_be16(net + 4);
+    const size_t offset = (frag & IP_OFFSET_MASK) * 8;
+    uint32_t src;
+    std::memcpy(&src, net + 12, sizeof(src));
+
+    auto it = std::find_if(
+        reassembly_.begin(), reassembly_.end(), [&](const Reassembly& r) {
+            return r.active && r.src == src && r.id == id;
+        });
+    if (it == reassembly_.end()) {
+        it = reassembly_.begin() + next_reassembly_;
+        next_reassembly_ = (next_reassembly_ + 1) % reassembly_.size();
+        it->active = true;
+        it->src = src;
+        it->id = id;
+        it->received = 0;
+        it->total = 0;
+        it->data.resize(MAX_DATAGRAM_SIZE);
+    }
+
+    const size_t frag_len = len - ihl;
+    if (offset + frag_len > MAX_DATAGRAM_SIZE) {
+        it->active = false;
+        return nullptr;
+    }
+    std::memcpy(it->data.data() + offset, net + ihl, frag_len);
+    it->received += frag_len;
+    if (!(frag & IP_MF_FLAG)) it->total = offset + frag_len;
+
+    if (it->total == 0 || it->received < it->total) return nullptr;
+    it->active = false;
+    out_len = it->total;
+    return it->data.data();
+}
+
+int64_t PacketRing::read(uint8_t* buf, size_t len, uint64_t& rx_ts) {
+    while (pending()) {
+        auto hdr = reinterpret_cast<struct tpacket3_hdr*>(pkt_);
+        pkt_ += hdr->tp_next_offset;
+        remaining_--;
+
+        // skip our own packets when capturing on loopback
+        auto sll = reinterpret_cast<const struct sockaddr_ll*>(
+            reinterpret_cast<uint8_t*>(hdr) +
+            TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        if (sll->sll_pkttype == PACKET_OUTGOING) continue;
+
+        // locate the UDP header, reassembling fragmented datagrams
+        const uint8_t* net = reinterpret_cast<uint8_t*>(hdr) + hdr->tp_net;
+        size_t net_len = hdr->tp_snaplen;
+        const uint8_t* udp = nullptr;
+        size_t udp_len = 0;
+        if (net_len >= 20 && (net[0] >> 4) == 4) {
+            const size_t ihl = (net[0] & 0x0f) * 4;
+            net_len = std::min<size_t>(net_len, load_be16(net + 2));
+            if (ihl < 20 || net_len < ihl || net[9] != IPPROTO_UDP_NUM)
+                continue;
+            if (load_be16(net + 6) & (IP_MF_FLAG | IP_OFFSET_MASK)) {
+                udp = reassemble(net, net_len, udp_len);
+            } else {
+                udp = net + ihl;
+                udp_len = net_len - ihl;
+            }
+        } else if (net_len >= IPV6_HEADER_SIZE && (net[0] >> 4) == 6 &&
+                   net[6] == IPPROTO_UDP_NUM) {
+            udp = net + IPV6_HEADER_SIZE;
+            udp_len = net_len - IPV6_HEADER_SIZE;
+        }
+
+        const uint8_t* payload = nullptr;
+        size_t payload_len = 0;
+        if (!udp || !udp_payload(udp, udp_len, port_, payload, payload_len))
+            continue;
+
+        const size_t n = std::min(len, payload_len);
+        std::memcpy(buf, payload, n);
+        rx_ts = static_cast<uint64_t>(hdr->tp_sec) * 1000000000ULL +
+                hdr->tp_nsec;
+        return static_cast<int64_t>(n);
+    }
+    return -1;
+}
+
+uint64_t PacketRing::drops() {
+    // reading the statistics resets them
+    struct tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+    if (!getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &stats, &len))
+        drops_ += stats.tp_drops;
+    return drops_;
+}
+
+int socket_drop_all(SOCKET sock) {
+    struct sock_filter drop = BPF_STMT(BPF_RET | BPF_K, 0);
+    struct sock_fprog prog;
+    prog.len = 1;
+    prog.filter = &drop;
+    return setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+#else
+
+PacketRing::PacketRing(SOCKET fd, uint8_t* map, size_t block_size,
+                       size_t n_blocks, uint16_t port)
+    : fd_(fd),
+      map_(map),
+      block_size_(block_size),
+      n_blocks_(n_blocks),
+      port_(port) {}
+
+std::unique_ptr<PacketRing> PacketRing::create(int, const std::string&,
+                                               size_t) {
+    std::cerr << "packet ring: only supported on Linux" << std::endl;
+    return std::unique_ptr<PacketRing>();
+}
+
+PacketRing::~PacketRing() = default;
+
+bool PacketRing::next_block() { return false; }
+
+void PacketRing::release_block() {}
+
+bool PacketRing::pending() { return false; }
+
+int64_t PacketRing::read(uint8_t*, size_t, uint64_t&) { return -1; }
+
+uint64_t PacketRing::drops() { return drops_; }
+
+int socket_drop_all(SOCKET) { return SOCKET_ERROR; }
+
+#endif
+
+}  // namespace impl
+}  // namespace sensor
+}  // namespace ouster
@@ -0,0 +1,130 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Memory-mapped AF_PACKET receive ring for UDP data
+ *
+ * Captures the UDP datagrams sent to a single port through a TPACKET_V3 block
+ * ring shared with the kernel, so that draining many packets doesn't cost a
+ * syscall per packet. Only implemented on Linux.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "netcompat.h"
+
+namespace ouster {
+namespace sensor {
+namespace impl {
+
+class PacketRing {
+    SOCKET fd_;
+    uint8_t* map_;
+    size_t block_size_;
+    size_t n_blocks_;
+    uint16_t port_;
+    uint64_t drops_{0};
+
+    // block currently being read, if any
+    size_t block_ind_{0};
+    uint8_t* block_{nullptr};
+    uint8_t* pkt_{nullptr};
+    uint32_t remaining_{0};
+
+    // IPv4 datagrams being reassembled from fragments
+    struct Reassembly {
+        bool active{false};
+        uint32_t src{0};
+        uint16_t id{0};
+        size_t received{0};
+        size_t total{0};
+        std::vector<uint8_t> data;
+    };
+    std::array<Reassembly, 4> reassembly_;
+    size_t next_reassembly_{0};
+
+    PacketRing(SOCKET fd, uint8_t* map, size_t block_size, size_t n_blocks,
+               uint16_t port);
+
+    bool next_block();
+    void release_block();
+    const uint8_t* reassemble(const uint8_t* net, size_t len, size_t& out_len);
+
+   public:
+    /**
+     * Open a packet ring capturing UDP datagrams sent to a port.
+     *
+     * @param[in] port local UDP destination port to capture.
+     * @param[in] interface network interface to capture on, or "" for all.
+     * @param[in] ring_size total size of the ring in bytes.
+     *
+     * @return the ring, or nullptr if it couldn't be set up. Errors are
+     * logged to stderr.
+     */
+    static std::unique_ptr<PacketRing> create(int port,
+                                              const std::string& interface,
+                                              size_t ring_size);
+
+    ~PacketRing();
+
+    PacketRing(const PacketRing&) = delete;
+    PacketRing& operator=(const PacketRing&) = delete;
+
+    /**
+     * Get the file descriptor to wait on for new data with select().
+     *
+     * @return the packet socket.
+     */
+    SOCKET fd() const { return fd_; }
+
+    /**
+     * Check whether a packet may be read without waiting.
+     *
+     * @return true if there's unread data in the ring.
+     */
+    bool pending();
+
+    /**
+     * Copy the payload of the next captured datagram into buf. Does not block.
+     *
+     * Same semantics as recv(): payloads longer than len are truncated.
+     *
+     * @param[out] buf buffer to copy the payload into.
+     * @param[in] len size of buf.
+     * @param[out] rx_ts kernel receive timestamp, in nanoseconds since the
+     * unix epoch.
+     *
+     * @return the number of bytes copied, or -1 if the ring is empty.
+     */
+    int64_t read(uint8_t* buf, size_t len, uint64_t& rx_ts);
+
+    /**
+     * Get the number of datagrams the kernel dropped because the ring was
+     * full.
+     *
+     * @return the drops since the ring was opened.
+     */
+    uint64_t drops();
+};
+
+/**
+ * Stop a UDP socket from queueing any data by attaching a filter that drops
+ * every datagram, while leaving the port bound.
+ *
+ * @param[in] sock the socket file descriptor.
+ *
+ * @return success
+ */
+int socket_drop_all(SOCKET sock);
+
+}  // namespace impl
+}  // namespace sensor
+}  // namespace ouster
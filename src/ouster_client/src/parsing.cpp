@@ -15,6 +15,7 @@
 #include <utility>
 
 #include "ouster/types.h"
+#include "simd_gather.h"
 
 namespace ouster {
 namespace sensor {
@@ -190,6 +191,25 @@ static void col_field_impl(const uint8_t* col_buf, DST* dst, size_t offset,
     if (sizeof(DST) < sizeof(SRC))
         throw std::invalid_argument("Dest type too small for specified field");
 
+    // deinterleave in vectorized chunks through a small contiguous buffer
+    if (impl::gather_field_u32_supported(sizeof(SRC), shift)) {
+        constexpr int chunk_size = 64;
+        uint32_t chunk[chunk_size];
+
+        const uint8_t* src = col_buf + col_header_size + offset;
+        for (int px0 = 0; px0 < pixels_per_column; px0 += chunk_size) {
+            const int n = std::min(chunk_size, pixels_per_column - px0);
+            impl::gather_field_u32(src + px0 * channel_data_size,
+                                   channel_data_size, sizeof(SRC),
+                                   static_cast<uint32_t>(mask), shift, n,
+                                   chunk);
+            DST* px_dst = dst + px0 * dst_stride;
+            for (int i = 0; i < n; i++)
+                px_dst[i * dst_stride] = static_cast<DST>(chunk[i]);
+        }
+        return;
+    }
+
     for (int px = 0; px < pixels_per_column; px++) {
         auto px_src =
             col_buf + col_header_size + offset + (px * channel_data_size);
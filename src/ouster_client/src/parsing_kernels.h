@@ -0,0 +1,235 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Channel field parsing specialized at compile time per lidar profile
+ *
+ * Mirrors the runtime field tables in parsing.cpp, but with the packet layout,
+ * field offsets, masks and shifts as template parameters so that the
+ * per-pixel loops can be fully resolved, unrolled and vectorized by the
+ * compiler. Any change to the tables in parsing.cpp must be reflected here.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <type_traits>
+
+#include "ouster/types.h"
+#include "simd_gather.h"
+
+namespace ouster {
+namespace sensor {
+namespace impl {
+
+/*
+ * Compile-time equivalent of a FieldInfo entry: the type of a channel field in
+ * the packet, its byte offset in the channel data block, mask and shift
+ */
+template <ChanField F, typename SRC, size_t OFFSET, uint64_t MASK, int SHIFT>
+struct FieldSpec {
+    static constexpr ChanField field = F;
+    using src_t = SRC;
+    static constexpr size_t offset = OFFSET;
+    static constexpr uint64_t mask = MASK;
+    static constexpr int shift = SHIFT;
+};
+
+/*
+ * Copy a single pixel of a field out of the channel data block at px_src
+ */
+template <typename SPEC, typename DST>
+inline DST spec_px_field(const uint8_t* px_src) {
+    using SRC = typename SPEC::src_t;
+    constexpr int rshift = SPEC::shift > 0 ? SPEC::shift : 0;
+    constexpr int lshift = SPEC::shift < 0 ? -SPEC::shift : 0;
+
+    SRC v;
+    std::memcpy(&v, px_src + SPEC::offset, sizeof(SRC));
+    DST d = v;
+    if (SPEC::mask) d &= SPEC::mask;
+    if (rshift) d >>= rshift;
+    if (lshift) d <<= lshift;
+    return d;
+}
+
+// max number of pixels staged at once when writing packet data into a scan
+constexpr int batch_tile_size = 2048;
+
+/*
+ * Write n_cols columns of h pixels stored contiguously in tile into columns
+ * m_ids[c] of the row-major image dst, skipping columns with negative ids.
+ * Goes one image row at a time so consecutive measurement ids turn into
+ * contiguous writes; the tile itself is small enough to stay in cache.
+ */
+template <typename T, typename DST>
+inline void transpose_tile(const T* tile, int n_cols, int h, const int* m_ids,
+                           DST* dst, std::ptrdiff_t dst_stride) {
+    for (int px = 0; px < h; px++) {
+        DST* row = dst + px * dst_stride;
+        const T* t = tile + px;
+        for (int c = 0; c < n_cols; c++, t += h)
+            if (m_ids[c] >= 0) row[m_ids[c]] = static_cast<DST>(*t);
+    }
+}
+
+/*
+ * Compile-time description of the packet layout of a lidar profile along with
+ * the channel fields it contains
+ */
+template <size_t PACKET_HEADER, size_t COL_HEADER, size_t CHAN_SIZE,
+          size_t COL_FOOTER, typename... FIELDS>
+struct ProfileLayout {
+    static constexpr size_t packet_header_size = PACKET_HEADER;
+    static constexpr size_t col_header_size = COL_HEADER;
+    static constexpr size_t channel_data_size = CHAN_SIZE;
+    static constexpr size_t col_footer_size = COL_FOOTER;
+
+    static constexpr size_t col_size(int pixels_per_column) {
+        return col_header_size + pixels_per_column * channel_data_size +
+               col_footer_size;
+    }
+
+    // decode one column of a field into a contiguous buffer
+    template <typename SPEC, typename T>
+    static void decode_col(const uint8_t* px_src, int pixels_per_column,
+                           T* out, std::true_type /*use_gather*/) {
+        gather_field_u32(px_src + SPEC::offset, channel_data_size,
+                         sizeof(typename SPEC::src_t), SPEC::mask, SPEC::shift,
+                         pixels_per_column, out);
+    }
+
+    template <typename SPEC, typename T>
+    static void decode_col(const uint8_t* px_src, int pixels_per_column,
+                           T* out, std::false_type /*use_gather*/) {
+        for (int px = 0; px < pixels_per_column; px++)
+            out[px] = spec_px_field<SPEC, T>(px_src + px * channel_data_size);
+    }
+
+    /*
+     * Parse one field from every column of a packet with m_ids[icol] >= 0
+     * into column m_ids[icol] of the row-major destination image dst.
+     *
+     * Columns are first decoded into a small column-contiguous tile and then
+     * written out one image row at a time, so that the writes to dst are
+     * contiguous runs instead of one pixel every dst_stride elements.
+     */
+    template <typename SPEC, typename DST>
+    static void packet_field_impl(const uint8_t* packet_buf,
+                                  int pixels_per_column, const int* m_ids,
+                                  int n_cols, DST* dst,
+                                  std::ptrdiff_t dst_stride) {
+        using SRC = typename SPEC::src_t;
+        if (sizeof(DST) < sizeof(SRC))
+            throw std::invalid_argument(
+                "Dest type too small for specified field");
+
+        using use_gather = std::integral_constant<
+            bool, gather_field_u32_supported(sizeof(SRC), SPEC::shift)>;
+        using tile_t =
+            typename std::conditional<use_gather::value, uint32_t, DST>::type;
+
+        const size_t stride = col_size(pixels_per_column);
+        const uint8_t* col_buf = packet_buf + packet_header_size;
+
+        // very tall columns: don't bother tiling
+        if (pixels_per_column > batch_tile_size) {
+            for (int icol = 0; icol < n_cols; icol++, col_buf += stride) {
+                if (m_ids[icol] < 0) continue;
+                const uint8_t* px_src = col_buf + col_header_size;
+                for (int px = 0; px < pixels_per_column; px++)
+                    dst[px * dst_stride + m_ids[icol]] =
+                        spec_px_field<SPEC, DST>(px_src +
+                                                 px * channel_data_size);
+            }
+            return;
+        }
+
+        tile_t tile[batch_tile_size];
+        const int block_cols = batch_tile_size / pixels_per_column;
+        for (int c0 = 0; c0 < n_cols; c0 += block_cols) {
+            const int nc = std::min(block_cols, n_cols - c0);
+            for (int c = 0; c < nc; c++) {
+                if (m_ids[c0 + c] < 0) continue;
+                decode_col<SPEC>(col_buf + (c0 + c) * stride + col_header_size,
+                                 pixels_per_column,
+                                 tile + c * pixels_per_column, use_gather{});
+            }
+            transpose_tile(tile, nc, pixels_per_column, m_ids + c0, dst,
+                           dst_stride);
+        }
+    }
+
+    /*
+     * Parse field f from a packet, see packet_field_impl().
+     *
+     * Returns false without touching dst if f is not part of this layout.
+     */
+    template <typename DST>
+    static bool packet_field(ChanField f, const uint8_t* packet_buf,
+                             int pixels_per_column, const int* m_ids,
+                             int n_cols, DST* dst, std::ptrdiff_t dst_stride) {
+        bool found = false;
+        (void)std::initializer_list<int>{
+            (f == FIELDS::field
+                 ? (found = true,
+                    packet_field_impl<FIELDS, DST>(packet_buf,
+                                                   pixels_per_column, m_ids,
+                                                   n_cols, dst, dst_stride),
+                    0)
+                 : 0)...};
+        return found;
+    }
+};
+
+using LegacyLayout = ProfileLayout<
+    0, 16, 12, 4, FieldSpec<ChanField::RANGE, uint32_t, 0, 0x000fffff, 0>,
+    FieldSpec<ChanField::FLAGS, uint8_t, 3, 0, 4>,
+    FieldSpec<ChanField::REFLECTIVITY, uint16_t, 4, 0, 0>,
+    FieldSpec<ChanField::SIGNAL, uint16_t, 6, 0, 0>,
+    FieldSpec<ChanField::NEAR_IR, uint16_t, 8, 0, 0>,
+    FieldSpec<ChanField::RAW32_WORD1, uint32_t, 0, 0, 0>,
+    FieldSpec<ChanField::RAW32_WORD2, uint32_t, 4, 0, 0>,
+    FieldSpec<ChanField::RAW32_WORD3, uint32_t, 8, 0, 0>>;
+
+using DualLayout = ProfileLayout<
+    32, 12, 16, 0, FieldSpec<ChanField::RANGE, uint32_t, 0, 0x0007ffff, 0>,
+    FieldSpec<ChanField::FLAGS, uint8_t, 2, 0b11111000, 3>,
+    FieldSpec<ChanField::REFLECTIVITY, uint8_t, 3, 0, 0>,
+    FieldSpec<ChanField::RANGE2, uint32_t, 4, 0x0007ffff, 0>,
+    FieldSpec<ChanField::FLAGS2, uint8_t, 6, 0b11111000, 3>,
+    FieldSpec<ChanField::REFLECTIVITY2, uint8_t, 7, 0, 0>,
+    FieldSpec<ChanField::SIGNAL, uint16_t, 8, 0, 0>,
+    FieldSpec<ChanField::SIGNAL2, uint16_t, 10, 0, 0>,
+    FieldSpec<ChanField::NEAR_IR, uint16_t, 12, 0, 0>,
+    FieldSpec<ChanField::RAW32_WORD1, uint32_t, 0, 0, 0>,
+    FieldSpec<ChanField::RAW32_WORD2, uint32_t, 4, 0, 0>,
+    FieldSpec<ChanField::RAW32_WORD3, uint32_t, 8, 0, 0>,
+    FieldSpec<ChanField::RAW32_WORD4, uint32_t, 12, 0, 0>>;
+
+using SingleLayout = ProfileLayout<
+    32, 12, 12, 0, FieldSpec<ChanField::RANGE, uint32_t, 0, 0x0007ffff, 0>,
+    FieldSpec<ChanField::FLAGS, uint8_t, 2, 0b11111000, 3>,
+    FieldSpec<ChanField::REFLECTIVITY, uint8_t, 4, 0, 0>,
+    FieldSpec<ChanField::SIGNAL, uint16_t, 6, 0, 0>,
+    FieldSpec<ChanField::NEAR_IR, uint16_t, 8, 0, 0>,
+    FieldSpec<ChanField::RAW32_WORD1, uint32_t, 0, 0, 0>,
+    FieldSpec<ChanField::RAW32_WORD2, uint32_t, 4, 0, 0>,
+    FieldSpec<ChanField::RAW32_WORD3, uint32_t, 8, 0, 0>>;
+
+using LowBandwidthLayout = ProfileLayout<
+    32, 12, 4, 0, FieldSpec<ChanField::RANGE, uint16_t, 0, 0x7fff, -3>,
+    FieldSpec<ChanField::FLAGS, uint8_t, 1, 0b10000000, 7>,
+    FieldSpec<ChanField::REFLECTIVITY, uint8_t, 2, 0, 0>,
+    FieldSpec<ChanField::NEAR_IR, uint8_t, 3, 0, -4>,
+    FieldSpec<ChanField::RAW32_WORD1, uint32_t, 0, 0, 0>>;
+
+}  // namespace impl
+}  // namespace sensor
+}  // namespace ouster
@@ -0,0 +1,707 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/scan_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define OUSTER_CODEC_AVX2
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define OUSTER_CODEC_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "ouster/impl/lidar_scan_impl.h"
+
+namespace ouster {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+namespace {
+
+/*
+ * Encoded layout, in host byte order:
+ *
+ *   header | timestamp | rx_timestamp | measurement_id | status | fields
+ *
+ * Each field is a field_header followed by a bit stream, MSB first. Every row
+ * starts with a 2-bit predictor, followed by blocks of BLOCK residuals with a
+ * 7-bit Rice parameter each. Bit streams end with PADDING zero bytes so the
+ * decoder can load 8 bytes at a time while reading a value without bounds
+ * checks.
+ */
+constexpr uint32_t CODEC_MAGIC = 0x3143534f;  // "OSC1"
+
+struct header {
+    uint32_t magic;
+    uint32_t w;
+    uint32_t h;
+    int32_t frame_id;
+    uint32_t n_fields;
+    uint32_t flags;
+};
+
+constexpr uint32_t FLAG_DESTAGGERED = 1 << 0;  // fields have shifts applied
+
+struct field_header {
+    uint32_t field;
+    uint32_t type;
+    uint64_t size;
+};
+
+static_assert(sizeof(header) == 24, "Unexpected header padding");
+static_assert(sizeof(field_header) == 16, "Unexpected header padding");
+
+enum predictor : uint32_t {
+    PRED_NONE = 0,  // raw values
+    PRED_LEFT = 1,  // previous pixel in the row
+    PRED_UP = 2,    // same pixel in the previous row
+    PRED_MED = 3    // median edge detector of left, up and up-left
+};
+
+constexpr int BLOCK = 32;
+constexpr int K_BITS = 7;
+constexpr uint32_t K_ZERO = 127;  // all residuals of the block are zero
+constexpr int ESCAPE = 16;        // unary length at which values are raw
+constexpr size_t PADDING = 16;
+
+// rotate rows as destagger() does
+size_t row_offset(int shift, size_t w) {
+    const long long m = static_cast<long long>(w);
+    return static_cast<size_t>(((shift % m) + m) % m);
+}
+
+uint64_t load_be64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+#ifdef _MSC_VER
+    return _byteswap_uint64(v);
+#else
+    return __builtin_bswap64(v);
+#endif
+}
+
+int clz64(uint64_t v) {
+    if (v == 0) return 64;
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanReverse64(&idx, v);
+    return 63 - static_cast<int>(idx);
+#else
+    return __builtin_clzll(v);
+#endif
+}
+
+int bit_width(uint64_t v) { return 64 - clz64(v); }
+
+template <typename T>
+T zigzag(T r) {
+    constexpr int bits = 8 * sizeof(T);
+    return static_cast<T>(static_cast<T>(r << 1) ^
+                          static_cast<T>(0 - static_cast<T>(r >> (bits - 1))));
+}
+
+template <typename T>
+T unzigzag(T z) {
+    return static_cast<T>(static_cast<T>(z >> 1) ^
+                          static_cast<T>(0 - static_cast<T>(z & 1)));
+}
+
+// a + b - c clamped to the range of a and b, branchless for narrow types
+template <typename T>
+T med(T a, T b, T c) {
+    const int64_t p = static_cast<int64_t>(a) + b - c;
+    return static_cast<T>(std::min<int64_t>(
+        std::max<int64_t>(p, std::min(a, b)), std::max(a, b)));
+}
+
+inline uint64_t med(uint64_t a, uint64_t b, uint64_t c) {
+    if (c >= std::max(a, b)) return std::min(a, b);
+    if (c <= std::min(a, b)) return std::max(a, b);
+    return a + b - c;
+}
+
+class BitWriter {
+    std::vector<uint8_t>& out_;
+    uint64_t acc_{0};
+    int n_{0};
+
+   public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+    // write up to 56 bits
+    void put(uint64_t v, int bits) {
+        acc_ = (acc_ << bits) | v;
+        n_ += bits;
+        while (n_ >= 8) {
+            n_ -= 8;
+            out_.push_back(static_cast<uint8_t>(acc_ >> n_));
+        }
+    }
+
+    void put_long(uint64_t v, int bits) {
+        if (bits > 32) {
+            put(v >> 32, bits - 32);
+            bits = 32;
+        }
+        put(v & ((uint64_t{1} << bits) - 1), bits);
+    }
+
+    void finish() {
+        if (n_ > 0) out_.push_back(static_cast<uint8_t>(acc_ << (8 - n_)));
+        n_ = 0;
+        out_.insert(out_.end(), PADDING, 0);
+    }
+};
+
+class BitReader {
+    const uint8_t* data_;
+    size_t pos_{0};
+    size_t limit_;
+
+   public:
+    // the padding is only ever loaded, never consumed
+    BitReader(const uint8_t* data, size_t size)
+        : data_(data), limit_((size - PADDING) * 8) {}
+
+    // the next 57 or more bits, MSB aligned
+    uint64_t peek() const {
+        return load_be64(data_ + (pos_ >> 3)) << (pos_ & 7);
+    }
+
+    void skip(int bits) { pos_ += bits; }
+
+    const uint8_t* data() const { return data_; }
+    size_t pos() const { return pos_; }
+    void seek(size_t pos) { pos_ = pos; }
+
+    // bits left before the padding
+    size_t remaining() const { return pos_ < limit_ ? limit_ - pos_ : 0; }
+
+    // read 1 to 56 bits
+    uint64_t get(int bits) {
+        const uint64_t v = peek() >> (64 - bits);
+        pos_ += bits;
+        return v;
+    }
+
+    uint64_t get_long(int bits) {
+        if (bits <= 32) return get(bits);
+        const uint64_t hi = get(bits - 32);
+        return (hi << 32) | get(32);
+    }
+
+    // check that the stream didn't run into the padding, before reading a value
+    void check() const {
+        if (pos_ > limit_)
+            throw std::invalid_argument("Truncated encoded scan field");
+    }
+};
+
+/*
+ * Reconstruct a row predicted from the previous row: x = up + unzigzag(z).
+ * Vectorized for the common 16 and 32-bit fields.
+ */
+template <typename T>
+void add_up_scalar(const T* z, const T* up, size_t n, T* x) {
+    for (size_t i = 0; i < n; i++)
+        x[i] = static_cast<T>(up[i] + unzigzag(z[i]));
+}
+
+using add_up16_fn = void (*)(const uint16_t*, const uint16_t*, size_t,
+                             uint16_t*);
+using add_up32_fn = void (*)(const uint32_t*, const uint32_t*, size_t,
+                             uint32_t*);
+
+#ifdef OUSTER_CODEC_AVX2
+__attribute__((target("avx2"))) void add_up16_avx2(const uint16_t* z,
+                                                   const uint16_t* up,
+                                                   size_t n, uint16_t* x) {
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i vz =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(z + i));
+        const __m256i vu =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(up + i));
+        const __m256i sign =
+            _mm256_sub_epi16(zero, _mm256_and_si256(vz, one));
+        const __m256i r = _mm256_xor_si256(_mm256_srli_epi16(vz, 1), sign);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(x + i),
+                            _mm256_add_epi16(vu, r));
+    }
+    add_up_scalar(z + i, up + i, n - i, x + i);
+}
+
+__attribute__((target("avx2"))) void add_up32_avx2(const uint32_t* z,
+                                                   const uint32_t* up,
+                                                   size_t n, uint32_t* x) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i vz =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(z + i));
+        const __m256i vu =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(up + i));
+        const __m256i sign =
+            _mm256_sub_epi32(zero, _mm256_and_si256(vz, one));
+        const __m256i r = _mm256_xor_si256(_mm256_srli_epi32(vz, 1), sign);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(x + i),
+                            _mm256_add_epi32(vu, r));
+    }
+    add_up_scalar(z + i, up + i, n - i, x + i);
+}
+#endif
+
+#ifdef OUSTER_CODEC_NEON
+void add_up16_neon(const uint16_t* z, const uint16_t* up, size_t n,
+                   uint16_t* x) {
+    const uint16x8_t one = vdupq_n_u16(1);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const uint16x8_t vz = vld1q_u16(z + i);
+        const uint16x8_t sign = vreinterpretq_u16_s16(
+            vnegq_s16(vreinterpretq_s16_u16(vandq_u16(vz, one))));
+        const uint16x8_t r = veorq_u16(vshrq_n_u16(vz, 1), sign);
+        vst1q_u16(x + i, vaddq_u16(vld1q_u16(up + i), r));
+    }
+    add_up_scalar(z + i, up + i, n - i, x + i);
+}
+
+void add_up32_neon(const uint32_t* z, const uint32_t* up, size_t n,
+                   uint32_t* x) {
+    const uint32x4_t one = vdupq_n_u32(1);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint32x4_t vz = vld1q_u32(z + i);
+        const uint32x4_t sign = vreinterpretq_u32_s32(
+            vnegq_s32(vreinterpretq_s32_u32(vandq_u32(vz, one))));
+        const uint32x4_t r = veorq_u32(vshrq_n_u32(vz, 1), sign);
+        vst1q_u32(x + i, vaddq_u32(vld1q_u32(up + i), r));
+    }
+    add_up_scalar(z + i, up + i, n - i, x + i);
+}
+#endif
+
+add_up16_fn select_add_up16() {
+#ifdef OUSTER_CODEC_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return add_up16_avx2;
+#endif
+#ifdef OUSTER_CODEC_NEON
+    return add_up16_neon;
+#endif
+    return add_up_scalar<uint16_t>;
+}
+
+add_up32_fn select_add_up32() {
+#ifdef OUSTER_CODEC_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return add_up32_avx2;
+#endif
+#ifdef OUSTER_CODEC_NEON
+    return add_up32_neon;
+#endif
+    return add_up_scalar<uint32_t>;
+}
+
+template <typename T>
+void add_up(const T* z, const T* up, size_t n, T* x) {
+    add_up_scalar(z, up, n, x);
+}
+
+template <>
+void add_up(const uint16_t* z, const uint16_t* up, size_t n, uint16_t* x) {
+    static const add_up16_fn impl = select_add_up16();
+    impl(z, up, n, x);
+}
+
+template <>
+void add_up(const uint32_t* z, const uint32_t* up, size_t n, uint32_t* x) {
+    static const add_up32_fn impl = select_add_up32();
+    impl(z, up, n, x);
+}
+
+/*
+ * Residuals of a row for a predictor, zigzag coded except for PRED_NONE.
+ * up is null for the first row.
+ */
+template <typename T>
+void residuals(predictor p, const T* x, const T* up, size_t w, T* z) {
+    switch (p) {
+        case PRED_NONE:
+            std::copy(x, x + w, z);
+            return;
+        case PRED_LEFT:
+            z[0] = zigzag<T>(static_cast<T>(x[0] - (up ? up[0] : 0)));
+            for (size_t v = 1; v < w; v++)
+                z[v] = zigzag<T>(static_cast<T>(x[v] - x[v - 1]));
+            return;
+        case PRED_UP:
+            for (size_t v = 0; v < w; v++)
+                z[v] = zigzag<T>(static_cast<T>(x[v] - (up ? up[v] : 0)));
+            return;
+        case PRED_MED:
+            z[0] = zigzag<T>(static_cast<T>(x[0] - (up ? up[0] : 0)));
+            for (size_t v = 1; v < w; v++) {
+                const T pred = up ? med(x[v - 1], up[v], up[v - 1]) : x[v - 1];
+                z[v] = zigzag<T>(static_cast<T>(x[v] - pred));
+            }
+            return;
+    }
+}
+
+template <typename T>
+void reconstruct(predictor p, const T* z, const T* up, size_t w, T* x) {
+    switch (p) {
+        case PRED_NONE:
+            std::copy(z, z + w, x);
+            return;
+        case PRED_LEFT:
+            x[0] = static_cast<T>((up ? up[0] : 0) + unzigzag(z[0]));
+            for (size_t v = 1; v < w; v++)
+                x[v] = static_cast<T>(x[v - 1] + unzigzag(z[v]));
+            return;
+        case PRED_UP:
+            if (up) {
+                add_up(z, up, w, x);
+            } else {
+                for (size_t v = 0; v < w; v++) x[v] = unzigzag(z[v]);
+            }
+            return;
+        case PRED_MED:
+            x[0] = static_cast<T>((up ? up[0] : 0) + unzigzag(z[0]));
+            for (size_t v = 1; v < w; v++) {
+                const T pred = up ? med(x[v - 1], up[v], up[v - 1]) : x[v - 1];
+                x[v] = static_cast<T>(pred + unzigzag(z[v]));
+            }
+            return;
+    }
+}
+
+template <typename T>
+void put_block(BitWriter& bits, const T* z, int n) {
+    constexpr int value_bits = 8 * sizeof(T);
+
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += static_cast<double>(z[i]);
+    if (sum == 0) {
+        bits.put(K_ZERO, K_BITS);
+        return;
+    }
+
+    // Rice parameter close to log2 of the mean residual
+    const double mean = sum / n;
+    const int k = mean < 2 ? 0
+                           : std::min(value_bits - 1,
+                                      static_cast<int>(std::log2(mean)));
+    bits.put(static_cast<uint64_t>(k), K_BITS);
+
+    const uint64_t low_mask =
+        k == 0 ? 0 : (~uint64_t{0} >> (64 - k));
+    for (int i = 0; i < n; i++) {
+        const uint64_t v = z[i];
+        const uint64_t q = v >> k;
+        if (q < static_cast<uint64_t>(ESCAPE)) {
+            bits.put(1, static_cast<int>(q) + 1);
+            if (k > 0) bits.put_long(v & low_mask, k);
+        } else {
+            bits.put(0, ESCAPE);
+            bits.put_long(v, value_bits);
+        }
+    }
+}
+
+template <typename T>
+void get_values(BitReader& bits, int k, T* z, int n) {
+    constexpr int value_bits = 8 * sizeof(T);
+    for (int i = 0; i < n; i++) {
+        bits.check();
+        const uint64_t v = bits.peek();
+        const int q = clz64(v);
+        if (q >= ESCAPE) {
+            bits.skip(ESCAPE);
+            z[i] = static_cast<T>(bits.get_long(value_bits));
+        } else if (q + 1 + k <= 57) {
+            // the whole code is in the loaded bits
+            const uint64_t low = ((v << q) << 1) >> 1 >> (63 - k);
+            bits.skip(q + 1 + k);
+            z[i] = static_cast<T>((static_cast<uint64_t>(q) << k) | low);
+        } else {
+            bits.skip(q + 1);
+            const uint64_t low = bits.get_long(k);
+            z[i] = static_cast<T>((static_cast<uint64_t>(q) << k) | low);
+        }
+    }
+}
+
+template <typename T>
+void get_block(BitReader& bits, T* z, int n) {
+    constexpr int value_bits = 8 * sizeof(T);
+
+    bits.check();
+    const int k = static_cast<int>(bits.get(K_BITS));
+    if (k == static_cast<int>(K_ZERO)) {
+        std::fill(z, z + n, T{0});
+        return;
+    }
+    if (k >= value_bits)
+        throw std::invalid_argument("Invalid encoded scan field");
+
+    // codes that aren't escaped are at most ESCAPE + 1 + k bits
+    const int per_refill = 56 / (ESCAPE + 1 + k);
+    const size_t max_bits = static_cast<size_t>(n) * (ESCAPE + value_bits);
+    if (per_refill == 0 || bits.remaining() < max_bits) {
+        get_values(bits, k, z, n);
+        return;
+    }
+
+    // fast path: no bounds checks, and a branchless refill of the bit buffer
+    // to at least 56 bits before decoding up to per_refill values
+    const uint8_t* data = bits.data();
+    const uint8_t* ptr = data + (bits.pos() >> 3);
+    uint64_t buf = load_be64(ptr) << (bits.pos() & 7);
+    int count = 56 - static_cast<int>(bits.pos() & 7);
+    ptr += 7;
+    for (int i = 0; i < n;) {
+        buf |= load_be64(ptr) >> count;
+        ptr += (63 - count) >> 3;
+        count |= 56;
+        for (int j = 0; j < per_refill && i < n; j++, i++) {
+            const int q = clz64(buf);
+            if (q >= ESCAPE) {
+                bits.seek(static_cast<size_t>(ptr - data) * 8 - count + ESCAPE);
+                z[i++] = static_cast<T>(bits.get_long(value_bits));
+                ptr = data + (bits.pos() >> 3);
+                buf = load_be64(ptr) << (bits.pos() & 7);
+                count = 56 - static_cast<int>(bits.pos() & 7);
+                ptr += 7;
+                break;
+            }
+            const int len = q + 1 + k;
+            const uint64_t low = ((buf << q) << 1) >> 1 >> (63 - k);
+            buf <<= len;
+            count -= len;
+            z[i] = static_cast<T>((static_cast<uint64_t>(q) << k) | low);
+        }
+    }
+    bits.seek(static_cast<size_t>(ptr - data) * 8 - count);
+}
+
+struct encode_field {
+    template <typename T>
+    void operator()(Eigen::Ref<const img_t<T>> field,
+                    const std::vector<int>& shifts, std::vector<uint8_t>& out) {
+        const size_t h = field.rows();
+        const size_t w = field.cols();
+        std::vector<T> prev(w), cur(w), z(w), best(w);
+        BitWriter bits(out);
+
+        for (size_t u = 0; u < h; u++) {
+            // destagger the row
+            const T* src = field.data() + u * w;
+            const size_t off = row_offset(shifts[u], w);
+            std::copy(src, src + w - off, cur.begin() + off);
+            std::copy(src + w - off, src + w, cur.begin());
+
+            const T* up = u > 0 ? prev.data() : nullptr;
+            uint64_t best_cost = UINT64_MAX;
+            predictor best_pred = PRED_NONE;
+            for (predictor p : {PRED_NONE, PRED_LEFT, PRED_UP, PRED_MED}) {
+                residuals(p, cur.data(), up, w, z.data());
+                uint64_t cost = 0;
+                for (size_t v = 0; v < w; v++) cost += bit_width(z[v]);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_pred = p;
+                    std::swap(z, best);
+                }
+            }
+
+            bits.put(best_pred, 2);
+            for (size_t v = 0; v < w; v += BLOCK)
+                put_block(bits, best.data() + v,
+                          static_cast<int>(std::min<size_t>(BLOCK, w - v)));
+            std::swap(prev, cur);
+        }
+        bits.finish();
+    }
+};
+
+struct decode_field {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, const std::vector<int>& shifts,
+                    const uint8_t* data, size_t size) {
+        const size_t h = field.rows();
+        const size_t w = field.cols();
+        std::vector<T> prev(w), cur(w), z(w);
+        BitReader bits(data, size);
+
+        for (size_t u = 0; u < h; u++) {
+            bits.check();
+            const predictor p = static_cast<predictor>(bits.get(2));
+            for (size_t v = 0; v < w; v += BLOCK) {
+                bits.check();
+                get_block(bits, z.data() + v,
+                          static_cast<int>(std::min<size_t>(BLOCK, w - v)));
+            }
+
+            const T* up = u > 0 ? prev.data() : nullptr;
+            reconstruct(p, z.data(), up, w, cur.data());
+
+            // stagger the row back
+            T* dst = field.data() + u * w;
+            const size_t off = row_offset(shifts[u], w);
+            std::copy(cur.begin() + off, cur.end(), dst);
+            std::copy(cur.begin(), cur.begin() + off, dst + w - off);
+            std::swap(prev, cur);
+        }
+    }
+};
+
+template <typename T>
+void append(std::vector<uint8_t>& out, const T* data, size_t n) {
+    const auto* p = reinterpret_cast<const uint8_t*>(data);
+    out.insert(out.end(), p, p + n * sizeof(T));
+}
+
+template <typename T>
+const uint8_t* take(const uint8_t* p, const uint8_t* end, T* data, size_t n) {
+    if (static_cast<size_t>(end - p) < n * sizeof(T))
+        throw std::invalid_argument("Truncated encoded scan");
+    std::memcpy(data, p, n * sizeof(T));
+    return p + n * sizeof(T);
+}
+
+}  // namespace
+
+ScanCodec::ScanCodec(const sensor::sensor_info& info)
+    : ScanCodec(info.format.pixel_shift_by_row) {}
+
+ScanCodec::ScanCodec(std::vector<int> pixel_shift_by_row)
+    : pixel_shift_by_row_(std::move(pixel_shift_by_row)) {}
+
+void ScanCodec::encode(const LidarScan& scan,
+                       const std::vector<ChanField>& fields,
+                       std::vector<uint8_t>& out) const {
+    if (static_cast<size_t>(scan.h) != pixel_shift_by_row_.size())
+        throw std::invalid_argument("Scan height doesn't match pixel shifts");
+
+    const size_t w = scan.w;
+    out.clear();
+
+    header hdr{CODEC_MAGIC,
+               static_cast<uint32_t>(w),
+               static_cast<uint32_t>(scan.h),
+               scan.frame_id,
+               static_cast<uint32_t>(fields.size()),
+               scan.destaggered ? FLAG_DESTAGGERED : 0};
+    append(out, &hdr, 1);
+    append(out, scan.timestamp().data(), w);
+    append(out, scan.rx_timestamp().data(), w);
+    append(out, scan.measurement_id().data(), w);
+    append(out, scan.status().data(), w);
+
+    // destaggered fields already have the row shifts applied
+    const std::vector<int> no_shifts(scan.h, 0);
+    const auto& shifts = scan.destaggered ? no_shifts : pixel_shift_by_row_;
+
+    for (const auto f : fields) {
+        const ChanFieldType type = scan.field_type(f);
+        if (type == ChanFieldType::VOID)
+            throw std::invalid_argument("Scan doesn't have field to encode");
+
+        const size_t header_pos = out.size();
+        field_header fh{static_cast<uint32_t>(f), static_cast<uint32_t>(type),
+                        0};
+        append(out, &fh, 1);
+
+        impl::visit_field(scan, f, encode_field{}, shifts, out);
+
+        fh.size = out.size() - header_pos - sizeof(fh);
+        std::memcpy(out.data() + header_pos, &fh, sizeof(fh));
+    }
+}
+
+std::vector<uint8_t> ScanCodec::encode(
+    const LidarScan& scan, const std::vector<ChanField>& fields) const {
+    std::vector<uint8_t> out;
+    encode(scan, fields, out);
+    return out;
+}
+
+void ScanCodec::decode(const uint8_t* data, size_t size,
+                       LidarScan& scan) const {
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+
+    header hdr;
+    p = take(p, end, &hdr, 1);
+    if (hdr.magic != CODEC_MAGIC)
+        throw std::invalid_argument("Not an encoded scan");
+    if (hdr.h != pixel_shift_by_row_.size())
+        throw std::invalid_argument("Encoded scan doesn't match pixel shifts");
+    if (hdr.w == 0) throw std::invalid_argument("Invalid encoded scan");
+    const size_t w = hdr.w;
+    const size_t h = hdr.h;
+
+    // find the encoded fields before touching the scan
+    std::vector<std::pair<ChanField, ChanFieldType>> field_types;
+    std::vector<std::pair<const uint8_t*, size_t>> payloads;
+    const uint8_t* fields =
+        p + w * (2 * sizeof(uint64_t) + sizeof(uint16_t) + sizeof(uint32_t));
+    if (fields > end) throw std::invalid_argument("Truncated encoded scan");
+    for (const uint8_t* f = fields; field_types.size() < hdr.n_fields;) {
+        field_header fh;
+        f = take(f, end, &fh, 1);
+        const auto type = static_cast<ChanFieldType>(fh.type);
+        if (type < ChanFieldType::UINT8 || type > ChanFieldType::UINT64 ||
+            fh.size < PADDING || fh.size > static_cast<size_t>(end - f))
+            throw std::invalid_argument("Invalid encoded scan field");
+        field_types.emplace_back(static_cast<ChanField>(fh.field), type);
+        payloads.emplace_back(f, fh.size);
+        f += fh.size;
+    }
+
+    bool compatible =
+        static_cast<size_t>(scan.w) == w && static_cast<size_t>(scan.h) == h;
+    for (const auto& ft : field_types) {
+        if (!compatible) break;
+        compatible = std::any_of(scan.begin(), scan.end(), [&](const auto& s) {
+            return s == ft;
+        });
+    }
+    if (!compatible)
+        scan = LidarScan(w, h, field_types.begin(), field_types.end());
+
+    scan.frame_id = hdr.frame_id;
+    scan.destaggered = hdr.flags & FLAG_DESTAGGERED;
+    p = take(p, end, scan.timestamp().data(), w);
+    p = take(p, end, scan.rx_timestamp().data(), w);
+    p = take(p, end, scan.measurement_id().data(), w);
+    take(p, end, scan.status().data(), w);
+
+    const std::vector<int> no_shifts(h, 0);
+    const auto& shifts = scan.destaggered ? no_shifts : pixel_shift_by_row_;
+    for (size_t i = 0; i < field_types.size(); i++)
+        impl::visit_field(scan, field_types[i].first, decode_field{}, shifts,
+                          payloads[i].first, payloads[i].second);
+}
+
+}  // namespace ouster
@@ -0,0 +1,465 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/scan_shm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+/*
+ * Layout of a segment: the header, the slot states, the metadata json and,
+ * starting on a page boundary, the arena of each slot. Subscribers map the
+ * arenas read-only.
+ *
+ * Each slot is a seqlock: while writing scan s, the publisher sets the slot
+ * sequence to 2s - 1 and then to 2s. A reader viewing scan s checks that the
+ * sequence is still 2s after reading. The publishing counter is only bumped
+ * once the slot is written, and subscribers keep a slot of margin from the
+ * one the publisher writes next.
+ */
+namespace ouster {
+namespace impl {
+
+namespace {
+
+constexpr uint64_t shm_magic = 0x314e435352545355;  // "USTRSCN1"
+constexpr uint32_t shm_version = 1;
+
+struct alignas(64) ShmSlot {
+    std::atomic<uint64_t> seq;
+    int32_t frame_id;
+    uint8_t destaggered;
+};
+
+struct ShmHeader {
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+    uint32_t n_slots;
+    uint64_t w, h;
+    uint64_t arena_size;
+    uint32_t n_fields;
+    uint8_t fields[sensor::CHAN_FIELD_MAX][2];
+    uint64_t slots_offset;
+    uint64_t metadata_offset, metadata_size;
+    uint64_t arenas_offset;
+
+    alignas(64) std::atomic<uint64_t> published;
+    std::atomic<uint32_t> notify;
+    std::atomic<uint32_t> waiters;
+    std::atomic<uint32_t> closed;
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) &&
+                  sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "shared memory counters must be plain words");
+
+size_t align_to(size_t n, size_t a) { return (n + a - 1) / a * a; }
+
+std::string shm_name(const std::string& name) {
+    if (name.empty()) throw std::invalid_argument("Empty shared memory name");
+    return name[0] == '/' ? name : "/" + name;
+}
+
+#ifdef __linux__
+// wait until the word changes from val, or the timeout expires
+void wait_word(std::atomic<uint32_t>& word, uint32_t val,
+               std::chrono::nanoseconds timeout) {
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+    ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, val,
+            &ts, nullptr, 0);
+}
+
+void wake_word(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE,
+            std::numeric_limits<int>::max(), nullptr, nullptr, 0);
+}
+#else
+void wait_word(std::atomic<uint32_t>& word, uint32_t val,
+               std::chrono::nanoseconds timeout) {
+    const auto poll = std::chrono::nanoseconds{std::chrono::milliseconds{1}};
+    if (word.load() == val)
+        std::this_thread::sleep_for(std::min(timeout, poll));
+}
+
+void wake_word(std::atomic<uint32_t>&) {}
+#endif
+
+}  // namespace
+
+struct ShmSegment {
+    std::string name;
+    bool owner{false};
+    int fd{-1};
+    uint8_t* addr{nullptr};
+    size_t size{0};
+    uint8_t* arenas{nullptr};
+    size_t arenas_size{0};
+    bool arenas_mapped{false};  // separate read-only mapping of subscribers
+
+    ShmHeader& header() const { return *reinterpret_cast<ShmHeader*>(addr); }
+
+    ShmSlot& slot(size_t i) const {
+        return reinterpret_cast<ShmSlot*>(addr + header().slots_offset)[i];
+    }
+
+    uint8_t* arena(size_t i) const {
+        return arenas + i * header().arena_size;
+    }
+
+#ifndef _WIN32
+    ~ShmSegment() {
+        if (arenas_mapped) munmap(arenas, arenas_size);
+        if (addr) munmap(addr, size);
+        if (fd >= 0) close(fd);
+        if (owner) shm_unlink(name.c_str());
+    }
+#endif
+};
+
+}  // namespace impl
+
+using impl::ShmHeader;
+using impl::ShmSegment;
+
+#ifdef _WIN32
+
+ScanShmPublisher::ScanShmPublisher(const std::string&,
+                                   const sensor::sensor_info&, size_t) {
+    throw std::runtime_error("Shared memory scans are not supported");
+}
+
+ScanShmPublisher::ScanShmPublisher(const std::string&,
+                                   const sensor::sensor_info&,
+                                   const LidarScan&, size_t) {
+    throw std::runtime_error("Shared memory scans are not supported");
+}
+
+ScanShmPublisher::~ScanShmPublisher() = default;
+uint64_t ScanShmPublisher::publish(const LidarScan&) { return 0; }
+uint64_t ScanShmPublisher::published() const { return 0; }
+size_t ScanShmPublisher::n_slots() const { return 0; }
+
+ScanShmSubscriber::ScanShmSubscriber(const std::string&) {
+    throw std::runtime_error("Shared memory scans are not supported");
+}
+
+ScanShmSubscriber::~ScanShmSubscriber() = default;
+const sensor::sensor_info& ScanShmSubscriber::info() const { return info_; }
+const LidarScan* ScanShmSubscriber::next(float) { return nullptr; }
+bool ScanShmSubscriber::read(LidarScan&, float) { return false; }
+bool ScanShmSubscriber::valid() const { return false; }
+uint64_t ScanShmSubscriber::seq() const { return seq_; }
+uint64_t ScanShmSubscriber::dropped() const { return dropped_; }
+bool ScanShmSubscriber::closed() const { return true; }
+
+#else
+
+ScanShmPublisher::ScanShmPublisher(const std::string& name,
+                                   const sensor::sensor_info& info,
+                                   size_t n_slots) {
+    create(name, info,
+           LidarScan{info.format.columns_per_frame,
+                     info.format.pixels_per_column,
+                     info.format.udp_profile_lidar},
+           n_slots);
+}
+
+ScanShmPublisher::ScanShmPublisher(const std::string& name,
+                                   const sensor::sensor_info& info,
+                                   const LidarScan& prototype,
+                                   size_t n_slots) {
+    create(name, info, prototype, n_slots);
+}
+
+void ScanShmPublisher::create(const std::string& name,
+                              const sensor::sensor_info& info,
+                              const LidarScan& prototype, size_t n_slots) {
+    if (n_slots < 2)
+        throw std::invalid_argument("At least 2 shared memory slots needed");
+    if (prototype.w == 0 || prototype.h == 0)
+        throw std::invalid_argument("Can't publish empty scans");
+
+    prototype_ = LidarScan{static_cast<size_t>(prototype.w),
+                           static_cast<size_t>(prototype.h), prototype.begin(),
+                           prototype.end()};
+    const std::string metadata = to_string(info);
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t slots_offset = impl::align_to(sizeof(ShmHeader), 64);
+    const size_t metadata_offset =
+        slots_offset + n_slots * sizeof(impl::ShmSlot);
+    const size_t arenas_offset =
+        impl::align_to(metadata_offset + metadata.size(), page);
+    const size_t arena_size = prototype_.arena_size();
+
+    shm_.reset(new ShmSegment{});
+    shm_->name = impl::shm_name(name);
+    shm_->size = arenas_offset + n_slots * arena_size;
+
+    // replace a segment left over by a publisher that didn't clean up
+    shm_unlink(shm_->name.c_str());
+    shm_->fd = shm_open(shm_->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (shm_->fd < 0)
+        throw std::runtime_error("Failed to create shared memory " + name +
+                                 ": " + std::strerror(errno));
+    shm_->owner = true;
+
+    if (ftruncate(shm_->fd, static_cast<off_t>(shm_->size)) != 0)
+        throw std::runtime_error("Failed to size shared memory " + name +
+                                 ": " + std::strerror(errno));
+    void* addr = mmap(nullptr, shm_->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      shm_->fd, 0);
+    if (addr == MAP_FAILED)
+        throw std::runtime_error("Failed to map shared memory " + name + ": " +
+                                 std::strerror(errno));
+    shm_->addr = static_cast<uint8_t*>(addr);
+    shm_->arenas = shm_->addr + arenas_offset;
+    shm_->arenas_size = shm_->size - arenas_offset;
+
+    auto& hdr = *new (shm_->addr) ShmHeader{};
+    hdr.version = impl::shm_version;
+    hdr.n_slots = static_cast<uint32_t>(n_slots);
+    hdr.w = static_cast<uint64_t>(prototype_.w);
+    hdr.h = static_cast<uint64_t>(prototype_.h);
+    hdr.arena_size = arena_size;
+    for (const auto& ft : prototype_) {
+        hdr.fields[hdr.n_fields][0] = static_cast<uint8_t>(ft.first);
+        hdr.fields[hdr.n_fields][1] = static_cast<uint8_t>(ft.second);
+        hdr.n_fields++;
+    }
+    hdr.slots_offset = slots_offset;
+    hdr.metadata_offset = metadata_offset;
+    hdr.metadata_size = metadata.size();
+    hdr.arenas_offset = arenas_offset;
+    for (size_t i = 0; i < n_slots; i++) new (&shm_->slot(i)) impl::ShmSlot{};
+    std::memcpy(shm_->addr + metadata_offset, metadata.data(),
+                metadata.size());
+
+    // subscribers only look at a segment once its header is complete
+    hdr.magic.store(impl::shm_magic, std::memory_order_release);
+}
+
+ScanShmPublisher::~ScanShmPublisher() {
+    if (!shm_ || !shm_->addr) return;
+    auto& hdr = shm_->header();
+    hdr.closed = 1;
+    hdr.notify++;
+    impl::wake_word(hdr.notify);
+}
+
+uint64_t ScanShmPublisher::publish(const LidarScan& scan) {
+    if (scan.w != prototype_.w || scan.h != prototype_.h ||
+        !std::equal(scan.begin(), scan.end(), prototype_.begin(),
+                    prototype_.end()))
+        throw std::invalid_argument(
+            "Scan doesn't match the dimensions and fields of shared memory");
+
+    auto& hdr = shm_->header();
+    const uint64_t seq = hdr.published.load(std::memory_order_relaxed) + 1;
+    const size_t i = (seq - 1) % hdr.n_slots;
+    auto& slot = shm_->slot(i);
+
+    slot.seq.store(2 * seq - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(shm_->arena(i), scan.arena(), hdr.arena_size);
+    slot.frame_id = scan.frame_id;
+    slot.destaggered = scan.destaggered;
+    slot.seq.store(2 * seq, std::memory_order_release);
+    hdr.published.store(seq, std::memory_order_release);
+
+    hdr.notify++;
+    if (hdr.waiters) impl::wake_word(hdr.notify);
+    return seq;
+}
+
+uint64_t ScanShmPublisher::published() const {
+    return shm_->header().published.load(std::memory_order_relaxed);
+}
+
+size_t ScanShmPublisher::n_slots() const { return shm_->header().n_slots; }
+
+ScanShmSubscriber::ScanShmSubscriber(const std::string& name)
+    : shm_{new ShmSegment{}} {
+    shm_->name = impl::shm_name(name);
+    shm_->fd = shm_open(shm_->name.c_str(), O_RDWR, 0);
+    if (shm_->fd < 0)
+        throw std::runtime_error("Failed to open shared memory " + name +
+                                 ": " + std::strerror(errno));
+
+    struct stat st;
+    if (fstat(shm_->fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(ShmHeader))
+        throw std::runtime_error("Shared memory " + name + " is not in use");
+    const size_t size = static_cast<size_t>(st.st_size);
+
+    // map the header and slot states first, to find the arenas
+    void* addr = mmap(nullptr, sizeof(ShmHeader), PROT_READ, MAP_SHARED,
+                      shm_->fd, 0);
+    if (addr == MAP_FAILED)
+        throw std::runtime_error("Failed to map shared memory " + name + ": " +
+                                 std::strerror(errno));
+    const auto& peek = *static_cast<const ShmHeader*>(addr);
+    const bool ok =
+        peek.magic.load(std::memory_order_acquire) == impl::shm_magic &&
+        peek.version == impl::shm_version;
+    const size_t arenas_offset = peek.arenas_offset;
+    munmap(addr, sizeof(ShmHeader));
+    if (!ok || arenas_offset >= size)
+        throw std::runtime_error("Shared memory " + name +
+                                 " doesn't hold compatible scans");
+
+    addr = mmap(nullptr, arenas_offset, PROT_READ | PROT_WRITE, MAP_SHARED,
+                shm_->fd, 0);
+    if (addr == MAP_FAILED)
+        throw std::runtime_error("Failed to map shared memory " + name + ": " +
+                                 std::strerror(errno));
+    shm_->addr = static_cast<uint8_t*>(addr);
+    shm_->size = arenas_offset;
+
+    addr = mmap(nullptr, size - arenas_offset, PROT_READ, MAP_SHARED,
+                shm_->fd, static_cast<off_t>(arenas_offset));
+    if (addr == MAP_FAILED)
+        throw std::runtime_error("Failed to map shared memory " + name + ": " +
+                                 std::strerror(errno));
+    shm_->arenas = static_cast<uint8_t*>(addr);
+    shm_->arenas_size = size - arenas_offset;
+    shm_->arenas_mapped = true;
+
+    const auto& hdr = shm_->header();
+    std::vector<std::pair<sensor::ChanField, sensor::ChanFieldType>> fields;
+    for (uint32_t f = 0; f < std::min<uint32_t>(hdr.n_fields,
+                                                sensor::CHAN_FIELD_MAX);
+         f++)
+        fields.emplace_back(
+            static_cast<sensor::ChanField>(hdr.fields[f][0]),
+            static_cast<sensor::ChanFieldType>(hdr.fields[f][1]));
+    if (LidarScan::arena_size(hdr.w, hdr.h, fields.begin(), fields.end()) !=
+            hdr.arena_size ||
+        hdr.n_slots < 2 ||
+        shm_->arenas_size < hdr.n_slots * hdr.arena_size ||
+        hdr.metadata_offset + hdr.metadata_size > arenas_offset)
+        throw std::runtime_error("Shared memory " + name +
+                                 " doesn't hold compatible scans");
+
+    info_ = sensor::parse_metadata(std::string{
+        reinterpret_cast<const char*>(shm_->addr + hdr.metadata_offset),
+        hdr.metadata_size});
+
+    // the arenas are read-only, so the views must never be modified
+    views_.reserve(hdr.n_slots);
+    for (size_t i = 0; i < hdr.n_slots; i++)
+        views_.emplace_back(hdr.w, hdr.h, fields.begin(), fields.end(),
+                            shm_->arena(i), hdr.arena_size, false);
+
+    // start with scans published from now on
+    seq_ = hdr.published.load(std::memory_order_acquire);
+}
+
+ScanShmSubscriber::~ScanShmSubscriber() = default;
+
+const sensor::sensor_info& ScanShmSubscriber::info() const { return info_; }
+
+bool ScanShmSubscriber::wait(float timeout_sec) {
+    using clock = std::chrono::steady_clock;
+    auto& hdr = shm_->header();
+    const auto deadline =
+        clock::now() + std::chrono::duration_cast<clock::duration>(
+                           std::chrono::duration<float>{timeout_sec});
+    while (true) {
+        const uint32_t notify = hdr.notify;
+        if (hdr.published.load(std::memory_order_acquire) > seq_) return true;
+        if (hdr.closed) return false;
+        const auto now = clock::now();
+        if (now >= deadline) return false;
+
+        // the publisher wakes waiters after bumping notify
+        hdr.waiters++;
+        impl::wait_word(hdr.notify, notify, deadline - now);
+        hdr.waiters--;
+    }
+}
+
+const LidarScan* ScanShmSubscriber::next(float timeout_sec) {
+    auto& hdr = shm_->header();
+    while (wait(timeout_sec)) {
+        const uint64_t published =
+            hdr.published.load(std::memory_order_acquire);
+
+        // keep a slot of margin from the one written next
+        uint64_t seq = seq_ + 1;
+        if (published - seq + 2 > hdr.n_slots) {
+            const uint64_t oldest = published + 2 - hdr.n_slots;
+            dropped_ += oldest - seq;
+            seq = oldest;
+        }
+
+        const size_t i = (seq - 1) % hdr.n_slots;
+        const auto& slot = shm_->slot(i);
+        auto& view = views_[i];
+        view.frame_id = slot.frame_id;
+        view.destaggered = slot.destaggered;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != 2 * seq) {
+            // lapped by the publisher while looking: skip the scan
+            dropped_++;
+            seq_ = seq;
+            continue;
+        }
+        seq_ = seq;
+        return &view;
+    }
+    return nullptr;
+}
+
+bool ScanShmSubscriber::read(LidarScan& scan, float timeout_sec) {
+    while (const LidarScan* view = next(timeout_sec)) {
+        scan = *view;
+        if (valid()) return true;
+        dropped_++;
+    }
+    return false;
+}
+
+bool ScanShmSubscriber::valid() const {
+    if (!seq_) return false;
+    const auto& hdr = shm_->header();
+    const auto& slot = shm_->slot((seq_ - 1) % hdr.n_slots);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq.load(std::memory_order_relaxed) == 2 * seq_;
+}
+
+uint64_t ScanShmSubscriber::seq() const { return seq_; }
+
+uint64_t ScanShmSubscriber::dropped() const { return dropped_; }
+
+bool ScanShmSubscriber::closed() const { return shm_->header().closed != 0; }
+
+#endif
+
+}  // namespace ouster
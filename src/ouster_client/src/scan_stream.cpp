@@ -0,0 +1,585 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/scan_stream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+#include "netcompat.h"
+#include "ouster/impl/lidar_scan_impl.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/scan_codec.h"
+#include "ouster/types.h"
+
+namespace ouster {
+
+using sensor::ChanField;
+namespace simpl = sensor::impl;
+
+namespace {
+
+/*
+ * Stream layout, in host byte order. Every message is a uint32_t size
+ * followed by its payload; the first is the stream header:
+ *
+ *   magic | range_step | n rows | rows | n cols | cols | shifts | metadata
+ *
+ * with a shift for each row of the region, used by the codec of the cropped
+ * scans. Every following message is a scan encoded by ScanCodec.
+ */
+constexpr uint32_t STREAM_MAGIC = 0x3153534f;  // "OSS1"
+
+// upper bound on messages, to fail fast on garbage
+constexpr uint32_t MAX_MESSAGE_SIZE = 1u << 30;
+
+// how often the server thread checks for shutdown and new frames to write
+constexpr long POLL_TIMEOUT_US = 10000;
+
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+using Message = std::shared_ptr<const std::vector<uint8_t>>;
+
+template <typename T>
+void append(std::vector<uint8_t>& out, const T* data, size_t n) {
+    const auto* p = reinterpret_cast<const uint8_t*>(data);
+    out.insert(out.end(), p, p + n * sizeof(T));
+}
+
+template <typename T>
+const uint8_t* take(const uint8_t* p, const uint8_t* end, T* data, size_t n) {
+    if (static_cast<size_t>(end - p) < n * sizeof(T))
+        throw std::runtime_error("Truncated scan stream header");
+    std::memcpy(data, p, n * sizeof(T));
+    return p + n * sizeof(T);
+}
+
+// prepend the size of a message
+void seal(std::vector<uint8_t>& msg) {
+    const uint32_t size = static_cast<uint32_t>(msg.size() - sizeof(size));
+    std::memcpy(msg.data(), &size, sizeof(size));
+}
+
+bool is_range(ChanField f) {
+    return f == ChanField::RANGE || f == ChanField::RANGE2;
+}
+
+// the row shifts of scans cropped to a region, scaled to its width
+std::vector<int> region_shifts(const sensor::sensor_info& info,
+                               const ScanRegion& region) {
+    const int w = info.format.columns_per_frame;
+    const int n = static_cast<int>(region.cols.size());
+    std::vector<int> shifts;
+    for (int u : region.rows)
+        shifts.push_back(info.format.pixel_shift_by_row.at(u) * n / w);
+    return shifts;
+}
+
+/*
+ * Copy the pixels of a region of a field, quantizing ranges
+ */
+struct crop_field {
+    template <typename T>
+    void operator()(Eigen::Ref<const img_t<T>> src, ChanField f,
+                    LidarScan& dst, const ScanRegion& region, uint32_t step) {
+        auto out = dst.field<T>(f);
+        const bool quantize = step > 1 && is_range(f);
+        for (size_t j = 0; j < region.rows.size(); j++) {
+            const T* row = src.row(region.rows[j]).data();
+            T* out_row = out.row(j).data();
+            for (size_t k = 0; k < region.cols.size(); k++) {
+                const T x = row[region.cols[k]];
+                out_row[k] = quantize ? static_cast<T>((x + step / 2) / step)
+                                      : x;
+            }
+        }
+    }
+};
+
+struct dequantize_field {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, uint32_t step) {
+        field *= static_cast<T>(step);
+    }
+};
+
+SOCKET tcp_listen_socket(int port) {
+    struct addrinfo hints, *info_start, *ai;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    const auto port_s = std::to_string(port);
+    if (getaddrinfo(NULL, port_s.c_str(), &hints, &info_start) != 0)
+        return SOCKET_ERROR;
+
+    // prefer a dual-stack socket, see udp_data_socket()
+    for (auto preferred_af : {AF_INET6, AF_INET}) {
+        for (ai = info_start; ai != NULL; ai = ai->ai_next) {
+            if (ai->ai_family != preferred_af) continue;
+            SOCKET fd =
+                socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (!simpl::socket_valid(fd)) continue;
+
+            int off = 0, on = 1;
+            if (ai->ai_family == AF_INET6)
+                setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, (char*)&off,
+                           sizeof(off));
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (char*)&on, sizeof(on));
+
+            if (::bind(fd, ai->ai_addr, (socklen_t)ai->ai_addrlen) ||
+                listen(fd, 8) || simpl::socket_set_non_blocking(fd)) {
+                simpl::socket_close(fd);
+                continue;
+            }
+            freeaddrinfo(info_start);
+            return fd;
+        }
+    }
+    freeaddrinfo(info_start);
+    return SOCKET_ERROR;
+}
+
+SOCKET tcp_connect(const std::string& host, int port) {
+    struct addrinfo hints, *info_start, *ai;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    const auto port_s = std::to_string(port);
+    if (getaddrinfo(host.c_str(), port_s.c_str(), &hints, &info_start) != 0)
+        return SOCKET_ERROR;
+
+    for (ai = info_start; ai != NULL; ai = ai->ai_next) {
+        SOCKET fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (!simpl::socket_valid(fd)) continue;
+        if (connect(fd, ai->ai_addr, (socklen_t)ai->ai_addrlen)) {
+            simpl::socket_close(fd);
+            continue;
+        }
+        freeaddrinfo(info_start);
+        return fd;
+    }
+    freeaddrinfo(info_start);
+    return SOCKET_ERROR;
+}
+
+void set_no_delay(SOCKET fd) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char*)&on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, (char*)&on, sizeof(on));
+#endif
+}
+
+}  // namespace
+
+struct ScanStreamServer::Impl {
+    struct Connection {
+        SOCKET fd;
+        std::deque<Message> queue;
+        size_t offset{0};  // into the front message
+    };
+
+    sensor::sensor_info info;
+    StreamConfig config;
+    bool crop{false};
+    ScanCodec codec;
+    Message header;
+    LidarScan cropped;
+
+    SOCKET listen_fd{SOCKET_ERROR};
+    int port{0};
+
+    // guards connections and counters
+    mutable std::mutex mtx;
+    std::vector<Connection> connections;
+    StreamStats stats{0, 0, 0, 0};
+
+    std::thread thread;
+    std::atomic<bool> stop{false};
+
+    Impl(const sensor::sensor_info& info, const StreamConfig& config)
+        : info(info),
+          config(config),
+          codec(region_shifts(info, this->config.region)) {}
+
+    // write queued messages until the socket would block; false on errors
+    static bool flush(Connection& c) {
+        while (!c.queue.empty()) {
+            const auto& msg = *c.queue.front();
+            const auto n = ::send(c.fd, (const char*)msg.data() + c.offset,
+                                  static_cast<int>(msg.size() - c.offset),
+                                  SEND_FLAGS);
+            if (n < 0) return simpl::socket_would_block();
+            c.offset += static_cast<size_t>(n);
+            if (c.offset < msg.size()) return true;
+            c.queue.pop_front();
+            c.offset = 0;
+        }
+        return true;
+    }
+
+    // flush all connections, closing those that failed; expects the lock
+    void flush_all() {
+        auto failed = std::remove_if(
+            connections.begin(), connections.end(), [](Connection& c) {
+                if (flush(c)) return false;
+                simpl::socket_close(c.fd);
+                return true;
+            });
+        connections.erase(failed, connections.end());
+        stats.clients = connections.size();
+    }
+
+    void accept_all() {
+        while (true) {
+            SOCKET fd = ::accept(listen_fd, NULL, NULL);
+            if (!simpl::socket_valid(fd)) return;
+            if (simpl::socket_set_non_blocking(fd)) {
+                simpl::socket_close(fd);
+                continue;
+            }
+            set_no_delay(fd);
+            std::lock_guard<std::mutex> lock{mtx};
+            connections.push_back({fd, {header}, 0});
+            stats.clients = connections.size();
+        }
+    }
+
+    void run() {
+        while (!stop) {
+            fd_set rfds, wfds;
+            FD_ZERO(&rfds);
+            FD_ZERO(&wfds);
+            FD_SET(listen_fd, &rfds);
+            SOCKET max_fd = listen_fd;
+            {
+                std::lock_guard<std::mutex> lock{mtx};
+                for (const auto& c : connections) {
+                    if (c.queue.empty()) continue;
+                    FD_SET(c.fd, &wfds);
+                    max_fd = std::max(max_fd, c.fd);
+                }
+            }
+
+            timeval tv;
+            tv.tv_sec = 0;
+            tv.tv_usec = POLL_TIMEOUT_US;
+            SOCKET retval =
+                select((int)max_fd + 1, &rfds, &wfds, NULL, &tv);
+            if (!simpl::socket_valid(retval)) {
+                if (simpl::socket_exit()) continue;
+                std::cerr << "select: " << simpl::socket_get_error()
+                          << std::endl;
+                break;
+            }
+
+            if (FD_ISSET(listen_fd, &rfds)) accept_all();
+            std::lock_guard<std::mutex> lock{mtx};
+            flush_all();
+        }
+    }
+};
+
+ScanStreamServer::ScanStreamServer(const sensor::sensor_info& info, int port,
+                                   const StreamConfig& config) {
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    if (config.fields.empty())
+        throw std::invalid_argument("expected fields to stream");
+    if (config.range_step == 0)
+        throw std::invalid_argument("range step must be at least one");
+    if (config.max_pending == 0)
+        throw std::invalid_argument("max pending must be at least one");
+    if (info.format.pixel_shift_by_row.size() != h)
+        throw std::invalid_argument("expected a pixel shift for each row");
+    for (int u : config.region.rows)
+        if (u < 0 || static_cast<size_t>(u) >= h)
+            throw std::invalid_argument("region row out of the scan");
+    for (int v : config.region.cols)
+        if (v < 0 || static_cast<size_t>(v) >= w)
+            throw std::invalid_argument("region column out of the scan");
+
+    StreamConfig cfg = config;
+    const bool crop = !cfg.region.rows.empty() || !cfg.region.cols.empty();
+    if (!crop) cfg.region = make_scan_region(w, h, {0, int(w) - 1});
+    if (cfg.region.rows.empty() || cfg.region.cols.empty())
+        throw std::invalid_argument("expected a region with rows and columns");
+    impl_ = std::make_unique<Impl>(info, cfg);
+    impl_->crop = crop || cfg.range_step > 1;
+
+    const ScanRegion& region = impl_->config.region;
+    std::vector<uint8_t> hdr(sizeof(uint32_t));
+    const auto n_rows = static_cast<uint32_t>(region.rows.size());
+    const auto n_cols = static_cast<uint32_t>(region.cols.size());
+    const auto shifts = region_shifts(info, region);
+    const std::string metadata = sensor::to_string(info);
+    append(hdr, &STREAM_MAGIC, 1);
+    append(hdr, &cfg.range_step, 1);
+    append(hdr, &n_rows, 1);
+    append(hdr, region.rows.data(), n_rows);
+    append(hdr, &n_cols, 1);
+    append(hdr, region.cols.data(), n_cols);
+    append(hdr, shifts.data(), n_rows);
+    append(hdr, metadata.data(), metadata.size());
+    seal(hdr);
+    impl_->header =
+        std::make_shared<const std::vector<uint8_t>>(std::move(hdr));
+
+    impl_->listen_fd = tcp_listen_socket(port);
+    if (!simpl::socket_valid(impl_->listen_fd))
+        throw std::runtime_error("Failed to listen on port " +
+                                 std::to_string(port));
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof ss;
+    getsockname(impl_->listen_fd, (struct sockaddr*)&ss, &len);
+    impl_->port = ntohs(ss.ss_family == AF_INET6
+                            ? ((struct sockaddr_in6*)&ss)->sin6_port
+                            : ((struct sockaddr_in*)&ss)->sin_port);
+
+    impl_->thread = std::thread([this]() { impl_->run(); });
+}
+
+ScanStreamServer::~ScanStreamServer() {
+    impl_->stop = true;
+    if (impl_->thread.joinable()) impl_->thread.join();
+    for (auto& c : impl_->connections) simpl::socket_close(c.fd);
+    simpl::socket_close(impl_->listen_fd);
+}
+
+int ScanStreamServer::port() const { return impl_->port; }
+
+size_t ScanStreamServer::send(const LidarScan& scan) {
+    const auto& info = impl_->info;
+    if (static_cast<size_t>(scan.w) != info.format.columns_per_frame ||
+        static_cast<size_t>(scan.h) != info.format.pixels_per_column)
+        throw std::invalid_argument("unexpected scan dimensions");
+    if (scan.destaggered)
+        throw std::invalid_argument("expected a staggered scan");
+
+    const auto& config = impl_->config;
+    const LidarScan* src = &scan;
+    if (impl_->crop) {
+        // crop to a scan of the streamed fields only
+        const ScanRegion& region = config.region;
+        LidarScan& out = impl_->cropped;
+        std::vector<std::pair<ChanField, sensor::ChanFieldType>> fts;
+        for (auto f : config.fields) {
+            const auto type = scan.field_type(f);
+            if (type == sensor::ChanFieldType::VOID)
+                throw std::invalid_argument("scan lacks a field to stream");
+            fts.emplace_back(f, type);
+        }
+        const size_t h = region.rows.size(), w = region.cols.size();
+        const bool same =
+            static_cast<size_t>(out.w) == w &&
+            static_cast<size_t>(out.h) == h &&
+            std::equal(fts.begin(), fts.end(), out.begin(), out.end());
+        if (!same) out = LidarScan(w, h, fts.begin(), fts.end());
+
+        out.frame_id = scan.frame_id;
+        for (size_t k = 0; k < w; k++) {
+            const int v = region.cols[k];
+            out.timestamp()[k] = scan.timestamp()[v];
+            out.rx_timestamp()[k] = scan.rx_timestamp()[v];
+            out.measurement_id()[k] = scan.measurement_id()[v];
+            out.status()[k] = scan.status()[v];
+        }
+        for (auto f : config.fields)
+            impl::visit_field(scan, f, crop_field{}, f, out, region,
+                              config.range_step);
+        src = &out;
+    }
+
+    auto msg = std::make_shared<std::vector<uint8_t>>(sizeof(uint32_t));
+    std::vector<uint8_t> encoded;
+    impl_->codec.encode(*src, config.fields, encoded);
+    msg->insert(msg->end(), encoded.begin(), encoded.end());
+    seal(*msg);
+    const Message frame = std::move(msg);
+
+    std::lock_guard<std::mutex> lock{impl_->mtx};
+    auto& stats = impl_->stats;
+    stats.frames++;
+    size_t n = 0;
+    for (auto& c : impl_->connections) {
+        // keep frames whole: the front may be partially written
+        if (c.queue.size() >= config.max_pending) {
+            stats.dropped_frames++;
+            continue;
+        }
+        c.queue.push_back(frame);
+        stats.bytes += frame->size();
+        n++;
+    }
+    // write right away rather than waiting for the server thread
+    impl_->flush_all();
+    return n;
+}
+
+StreamStats ScanStreamServer::stats() const {
+    std::lock_guard<std::mutex> lock{impl_->mtx};
+    return impl_->stats;
+}
+
+struct ScanStreamClient::Impl {
+    SOCKET fd{SOCKET_ERROR};
+    sensor::sensor_info info;
+    ScanRegion region;
+    uint32_t range_step{1};
+    std::unique_ptr<ScanCodec> codec;
+
+    // received bytes not yet consumed
+    std::vector<uint8_t> buf;
+    size_t begin{0};
+
+    ~Impl() {
+        if (simpl::socket_valid(fd)) simpl::socket_close(fd);
+    }
+
+    /*
+     * Return the next complete message, reading until timeout_sec has passed.
+     * The message stays valid until the next call.
+     */
+    bool next_message(float timeout_sec, const uint8_t*& data,
+                      uint32_t& size) {
+        using clock = std::chrono::steady_clock;
+        const bool forever = timeout_sec < 0;
+        const auto deadline =
+            clock::now() + std::chrono::microseconds(
+                               static_cast<int64_t>(timeout_sec * 1e6f));
+        while (true) {
+            const size_t avail = buf.size() - begin;
+            if (avail >= sizeof(size)) {
+                std::memcpy(&size, buf.data() + begin, sizeof(size));
+                if (size > MAX_MESSAGE_SIZE)
+                    throw std::runtime_error("Invalid scan stream message");
+                if (avail >= sizeof(size) + size) {
+                    data = buf.data() + begin + sizeof(size);
+                    begin += sizeof(size) + size;
+                    return true;
+                }
+            }
+
+            // compact before reading more
+            if (begin > 0) {
+                buf.erase(buf.begin(), buf.begin() + begin);
+                begin = 0;
+            }
+
+            const auto left = std::chrono::duration_cast<
+                std::chrono::microseconds>(deadline - clock::now());
+            if (!forever && left.count() < 0) return false;
+            fd_set rfds;
+            FD_ZERO(&rfds);
+            FD_SET(fd, &rfds);
+            timeval tv;
+            tv.tv_sec = static_cast<long>(left.count() / 1000000);
+            tv.tv_usec = static_cast<long>(left.count() % 1000000);
+            SOCKET retval =
+                select((int)fd + 1, &rfds, NULL, NULL, forever ? NULL : &tv);
+            if (!simpl::socket_valid(retval)) {
+                if (simpl::socket_exit()) continue;
+                throw std::runtime_error("select: " +
+                                         simpl::socket_get_error());
+            }
+            if (retval == 0) return false;
+
+            const size_t chunk = 1 << 16;
+            const size_t old = buf.size();
+            buf.resize(old + chunk);
+            const auto n = recv(fd, (char*)buf.data() + old,
+                                static_cast<int>(chunk), 0);
+            buf.resize(old + std::max<decltype(n)>(n, 0));
+            if (n == 0) throw std::runtime_error("Scan stream closed");
+            if (n < 0 && !simpl::socket_would_block())
+                throw std::runtime_error("recv: " + simpl::socket_get_error());
+        }
+    }
+};
+
+ScanStreamClient::ScanStreamClient(const std::string& host, int port,
+                                   float timeout_sec)
+    : impl_(std::make_unique<Impl>()) {
+    impl_->fd = tcp_connect(host, port);
+    if (!simpl::socket_valid(impl_->fd))
+        throw std::runtime_error("Failed to connect to " + host + ":" +
+                                 std::to_string(port));
+    set_no_delay(impl_->fd);
+
+    const uint8_t* data = nullptr;
+    uint32_t size = 0;
+    if (!impl_->next_message(timeout_sec, data, size))
+        throw std::runtime_error("No scan stream header within the timeout");
+
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    uint32_t magic = 0, n_rows = 0, n_cols = 0;
+    p = take(p, end, &magic, 1);
+    if (magic != STREAM_MAGIC) throw std::runtime_error("Not a scan stream");
+    p = take(p, end, &impl_->range_step, 1);
+    p = take(p, end, &n_rows, 1);
+    if (n_rows > size) throw std::runtime_error("Invalid scan stream header");
+    impl_->region.rows.resize(n_rows);
+    p = take(p, end, impl_->region.rows.data(), n_rows);
+    p = take(p, end, &n_cols, 1);
+    if (n_cols > size) throw std::runtime_error("Invalid scan stream header");
+    impl_->region.cols.resize(n_cols);
+    p = take(p, end, impl_->region.cols.data(), n_cols);
+    std::vector<int> shifts(n_rows);
+    p = take(p, end, shifts.data(), n_rows);
+    impl_->info =
+        sensor::parse_metadata(std::string{(const char*)p, (size_t)(end - p)});
+    impl_->codec = std::make_unique<ScanCodec>(std::move(shifts));
+}
+
+ScanStreamClient::~ScanStreamClient() = default;
+
+const sensor::sensor_info& ScanStreamClient::metadata() const {
+    return impl_->info;
+}
+
+const ScanRegion& ScanStreamClient::region() const { return impl_->region; }
+
+bool ScanStreamClient::read(LidarScan& scan, float timeout_sec) {
+    const uint8_t* data = nullptr;
+    uint32_t size = 0;
+    if (!impl_->next_message(timeout_sec, data, size)) return false;
+    try {
+        impl_->codec->decode(data, size, scan);
+    } catch (const std::invalid_argument& e) {
+        throw std::runtime_error(std::string{"Invalid scan stream frame: "} +
+                                 e.what());
+    }
+    if (impl_->range_step > 1)
+        for (const auto& ft : scan)
+            if (is_range(ft.first))
+                impl::visit_field(scan, ft.first, dequantize_field{},
+                                  impl_->range_step);
+    return true;
+}
+
+}  // namespace ouster
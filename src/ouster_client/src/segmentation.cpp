@@ -0,0 +1,361 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/segmentation.h"
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ouster/impl/lidar_scan_impl.h"
+
+namespace ouster {
+namespace segmentation {
+
+using sensor::ChanField;
+
+namespace {
+
+/*
+ * Run f(begin, end) over blocks of columns in [0, n_cols), using the calling
+ * thread for the first block
+ */
+template <typename F>
+void for_col_blocks(size_t n_cols, int n_threads, F&& f) {
+    const size_t n_blocks =
+        std::max<size_t>(1, std::min<size_t>(std::max(n_threads, 1), n_cols));
+    const size_t block = (n_cols + n_blocks - 1) / n_blocks;
+    std::vector<std::thread> workers;
+    for (size_t b = 1; b < n_blocks; b++) {
+        const size_t begin = std::min(b * block, n_cols);
+        const size_t end = std::min(begin + block, n_cols);
+        if (begin < end) workers.emplace_back(f, begin, end);
+    }
+    f(size_t{0}, std::min(block, n_cols));
+    for (auto& w : workers) w.join();
+}
+
+void check_inputs(const Eigen::Ref<const img_t<uint32_t>>& range,
+                  const XYZLut& lut, const std::vector<int>& shifts) {
+    if (lut.direction.rows() != range.size() ||
+        lut.offset.rows() != range.size())
+        throw std::invalid_argument("unexpected scan dimensions");
+    if (!shifts.empty() && shifts.size() != static_cast<size_t>(range.rows()))
+        throw std::invalid_argument("expected a pixel shift for each row");
+}
+
+void check_mask(const Eigen::Ref<const img_t<uint8_t>>& mask, size_t h,
+                size_t w) {
+    if (static_cast<size_t>(mask.rows()) != h ||
+        static_cast<size_t>(mask.cols()) != w)
+        throw std::invalid_argument("unexpected mask dimensions");
+}
+
+/*
+ * Column of each row holding the pixel at the azimuth of column zero of the
+ * first row, in [0, w), so that pixels of azimuth a are at a + offset
+ */
+std::vector<size_t> azimuth_offsets(const std::vector<int>& shifts, size_t h,
+                                    size_t w) {
+    std::vector<size_t> offsets(h, 0);
+    if (shifts.empty()) return offsets;
+    const long m = static_cast<long>(w);
+    for (size_t u = 0; u < h; u++) {
+        const long d = (shifts[0] - shifts[u]) % m;
+        offsets[u] = static_cast<size_t>((d + m) % m);
+    }
+    return offsets;
+}
+
+// a point of the range image, with the unit direction of its beam
+struct Point {
+    Eigen::Vector3d p;
+    Eigen::Vector3d dir;
+};
+
+Point point_at(const Eigen::Ref<const img_t<uint32_t>>& range,
+               const XYZLut& lut, size_t u, size_t v, size_t w) {
+    const size_t i = u * w + v;
+    const Eigen::Vector3d d = lut.direction.row(i).matrix().transpose();
+    return {d * range(u, v) + lut.offset.row(i).matrix().transpose(),
+            d.normalized()};
+}
+
+/*
+ * Whether neighbouring points are on the same surface: the angle at the
+ * farther one between its line of sight and the line to the nearer one is
+ * at least the minimum
+ */
+bool joined(const Point& a, uint32_t ra, const Point& b, uint32_t rb,
+            double cos_min) {
+    const Point& far = ra >= rb ? a : b;
+    const Point& near = ra >= rb ? b : a;
+    const Eigen::Vector3d diff = near.p - far.p;
+    const double dist = diff.norm();
+    return dist == 0 || -far.dir.dot(diff) <= cos_min * dist;
+}
+
+// union-find over pixels, joining roots to the smaller index
+struct DisjointSets {
+    std::vector<uint32_t> parent;
+
+    explicit DisjointSets(size_t n) : parent(n) {
+        for (size_t i = 0; i < n; i++) parent[i] = static_cast<uint32_t>(i);
+    }
+
+    uint32_t find(uint32_t i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    void join(uint32_t a, uint32_t b) {
+        a = find(a);
+        b = find(b);
+        if (a < b)
+            parent[b] = a;
+        else if (b < a)
+            parent[a] = b;
+    }
+};
+
+struct write_ground {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field,
+                    const Eigen::Ref<const img_t<uint8_t>>& mask) {
+        field = mask.cast<T>();
+    }
+};
+
+struct write_labels {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field,
+                    const Eigen::Ref<const img_t<uint32_t>>& labels) {
+        const uint64_t max = std::numeric_limits<T>::max();
+        field = labels.unaryExpr([max](uint32_t l) {
+            return static_cast<T>(l <= max ? l : 0);
+        });
+    }
+};
+
+bool is_custom(ChanField f) {
+    return f >= ChanField::CUSTOM0 && f <= ChanField::CUSTOM9;
+}
+
+}  // namespace
+
+void ground_mask(const Eigen::Ref<const img_t<uint32_t>>& range,
+                 const XYZLut& lut, const GroundParams& params,
+                 Eigen::Ref<img_t<uint8_t>> mask, uint8_t bit,
+                 const std::vector<int>& pixel_shift_by_row, int n_threads) {
+    const size_t h = range.rows();
+    const size_t w = range.cols();
+    check_inputs(range, lut, pixel_shift_by_row);
+    check_mask(mask, h, w);
+    if (h == 0 || w == 0) return;
+
+    const auto offsets = azimuth_offsets(pixel_shift_by_row, h, w);
+    const double tan_max = std::tan(params.max_slope_deg * M_PI / 180.0);
+    const double tan2_max = tan_max * tan_max;
+    const double* dx = lut.direction.col(0).data();
+    const double* dy = lut.direction.col(1).data();
+    const double* dz = lut.direction.col(2).data();
+    const double* ox = lut.offset.col(0).data();
+    const double* oy = lut.offset.col(1).data();
+    const double* oz = lut.offset.col(2).data();
+
+    // walk a block of columns up a row at a time, with the last ground point
+    // of each column
+    auto mark_cols = [&](size_t begin, size_t end) {
+        const size_t n = end - begin;
+        std::vector<double> gx(n), gy(n), gz(n);
+        std::vector<uint8_t> started(n, 0);
+        for (size_t u = h; u-- > 0;) {
+            const uint32_t* row = range.row(u).data();
+            uint8_t* m = mask.row(u).data();
+            for (size_t k = 0; k < n; k++) {
+                size_t v = begin + k + offsets[u];
+                if (v >= w) v -= w;
+                const uint32_t r = row[v];
+                if (r == 0) continue;
+
+                const size_t i = u * w + v;
+                const double x = dx[i] * r + ox[i];
+                const double y = dy[i] * r + oy[i];
+                const double z = dz[i] * r + oz[i];
+                bool ground;
+                if (!started[k]) {
+                    ground = z <= params.max_start_z;
+                } else {
+                    const double ex = x - gx[k], ey = y - gy[k];
+                    const double ez = z - gz[k];
+                    // ground leads away from the sensor, unlike the base of
+                    // an object nearer than the last ground point
+                    ground = ex * x + ey * y > 0 &&
+                             ez * ez <= tan2_max * (ex * ex + ey * ey);
+                }
+                if (!ground) continue;
+                m[v] |= bit;
+                started[k] = 1;
+                gx[k] = x;
+                gy[k] = y;
+                gz[k] = z;
+            }
+        }
+    };
+    for_col_blocks(w, n_threads, mark_cols);
+}
+
+size_t cluster(const Eigen::Ref<const img_t<uint32_t>>& range,
+               const XYZLut& lut, const ClusterParams& params,
+               Eigen::Ref<img_t<uint32_t>> labels,
+               const Eigen::Ref<const img_t<uint8_t>>& mask, uint8_t bits,
+               const std::vector<int>& pixel_shift_by_row, int n_threads) {
+    const size_t h = range.rows();
+    const size_t w = range.cols();
+    check_inputs(range, lut, pixel_shift_by_row);
+    check_mask(mask, h, w);
+    if (static_cast<size_t>(labels.rows()) != h ||
+        static_cast<size_t>(labels.cols()) != w)
+        throw std::invalid_argument("unexpected label dimensions");
+    labels.setZero();
+    if (h == 0 || w == 0) return 0;
+
+    const auto offsets = azimuth_offsets(pixel_shift_by_row, h, w);
+    const double cos_min = std::cos(params.min_angle_deg * M_PI / 180.0);
+    auto col = [&](size_t u, size_t a) {
+        const size_t v = a + offsets[u];
+        return v >= w ? v - w : v;
+    };
+    auto kept = [&](size_t u, size_t v) {
+        return range(u, v) != 0 && !(mask(u, v) & bits);
+    };
+
+    // sets are indexed by row and azimuth, so blocks of azimuths only touch
+    // their own sets until the edges between blocks are joined
+    DisjointSets sets(h * w);
+    std::vector<size_t> block_begins;
+    std::mutex mtx;
+    auto join_cols = [&](size_t begin, size_t end) {
+        {
+            std::lock_guard<std::mutex> lock{mtx};
+            block_begins.push_back(begin);
+        }
+        for (size_t u = 0; u < h; u++) {
+            for (size_t a = begin; a < end; a++) {
+                const size_t v = col(u, a);
+                if (!kept(u, v)) continue;
+                const Point p = point_at(range, lut, u, v, w);
+                const uint32_t i = static_cast<uint32_t>(u * w + a);
+
+                // the next azimuth, wrapping around within a single block
+                const size_t an = a + 1 < w ? a + 1 : 0;
+                const bool inside = a + 1 < end || (begin == 0 && end == w);
+                const size_t vn = col(u, an);
+                if (inside && kept(u, vn) &&
+                    joined(p, range(u, v), point_at(range, lut, u, vn, w),
+                           range(u, vn), cos_min))
+                    sets.join(i, static_cast<uint32_t>(u * w + an));
+
+                // the same azimuth in the next row
+                if (u + 1 == h) continue;
+                const size_t vd = col(u + 1, a);
+                if (kept(u + 1, vd) &&
+                    joined(p, range(u, v), point_at(range, lut, u + 1, vd, w),
+                           range(u + 1, vd), cos_min))
+                    sets.join(i, static_cast<uint32_t>((u + 1) * w + a));
+            }
+        }
+    };
+    for_col_blocks(w, n_threads, join_cols);
+
+    // join across the boundaries of blocks, including the wrap around
+    if (block_begins.size() > 1) {
+        for (size_t begin : block_begins) {
+            const size_t a = begin == 0 ? w - 1 : begin - 1;
+            for (size_t u = 0; u < h; u++) {
+                const size_t v = col(u, a), vn = col(u, begin);
+                if (kept(u, v) && kept(u, vn) &&
+                    joined(point_at(range, lut, u, v, w), range(u, v),
+                           point_at(range, lut, u, vn, w), range(u, vn),
+                           cos_min))
+                    sets.join(static_cast<uint32_t>(u * w + a),
+                              static_cast<uint32_t>(u * w + begin));
+            }
+        }
+    }
+
+    // size and first pixel of each set, in image order
+    const uint32_t none = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> size(h * w, 0);
+    std::vector<uint32_t> first(h * w, none);
+    std::vector<uint32_t> root_of(h * w, none);  // by image index
+    const long lw = static_cast<long>(w);
+    for (size_t u = 0; u < h; u++) {
+        for (size_t v = 0; v < w; v++) {
+            if (!kept(u, v)) continue;
+            const long d = static_cast<long>(v) - static_cast<long>(offsets[u]);
+            const size_t a = static_cast<size_t>((d + lw) % lw);
+            const uint32_t root = sets.find(static_cast<uint32_t>(u * w + a));
+            const uint32_t i = static_cast<uint32_t>(u * w + v);
+            root_of[i] = root;
+            if (size[root]++ == 0) first[root] = i;
+        }
+    }
+
+    std::vector<uint32_t> roots;
+    for (size_t i = 0; i < h * w; i++)
+        if (size[i] && size[i] >= params.min_points)
+            roots.push_back(static_cast<uint32_t>(i));
+    std::sort(roots.begin(), roots.end(), [&](uint32_t a, uint32_t b) {
+        return size[a] != size[b] ? size[a] > size[b] : first[a] < first[b];
+    });
+
+    // reuse the sizes to map roots to labels
+    std::vector<uint32_t>& label_of = size;
+    std::fill(label_of.begin(), label_of.end(), 0);
+    for (size_t l = 0; l < roots.size(); l++)
+        label_of[roots[l]] = static_cast<uint32_t>(l + 1);
+    for (size_t i = 0; i < h * w; i++)
+        if (root_of[i] != none) labels.data()[i] = label_of[root_of[i]];
+    return roots.size();
+}
+
+size_t segment(LidarScan& scan, const XYZLut& lut, const GroundParams& ground,
+               const ClusterParams& clusters, ChanField ground_field,
+               ChanField label_field,
+               const std::vector<int>& pixel_shift_by_row, int n_threads) {
+    if (!is_custom(ground_field) || !is_custom(label_field))
+        throw std::invalid_argument("expected custom fields for the results");
+    for (auto f : {ChanField::RANGE, ground_field, label_field})
+        if (!scan.field_type(f))
+            throw std::out_of_range("field is not in the scan");
+
+    const auto& shifts =
+        scan.destaggered ? std::vector<int>{} : pixel_shift_by_row;
+    const LidarScan& cscan = scan;
+    const auto range = cscan.field<uint32_t>(ChanField::RANGE);
+
+    img_t<uint8_t> mask = img_t<uint8_t>::Zero(scan.h, scan.w);
+    ground_mask(range, lut, ground, mask, 1, shifts, n_threads);
+    img_t<uint32_t> labels(scan.h, scan.w);
+    const size_t n =
+        cluster(range, lut, clusters, labels, mask, 1, shifts, n_threads);
+
+    impl::visit_field(scan, ground_field, write_ground(), mask);
+    impl::visit_field(scan, label_field, write_labels(), labels);
+    return n;
+}
+
+}  // namespace segmentation
+}  // namespace ouster
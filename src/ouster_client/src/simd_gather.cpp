@@ -0,0 +1,168 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "simd_gather.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define OUSTER_GATHER_AVX2
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define OUSTER_GATHER_NEON
+#include <arm_neon.h>
+#endif
+
+namespace ouster {
+namespace sensor {
+namespace impl {
+
+namespace {
+
+using gather_fn = void (*)(const uint8_t*, size_t, size_t, uint32_t, int, int,
+                           uint32_t*);
+
+// effective mask after truncating a 4-byte load to the field size
+uint32_t field_mask(size_t src_size, uint32_t mask) {
+    const uint32_t width_mask =
+        src_size >= 4 ? 0xffffffff : (uint32_t{1} << (8 * src_size)) - 1;
+    return mask ? (mask & width_mask) : width_mask;
+}
+
+void gather_scalar(const uint8_t* src, size_t src_stride, size_t src_size,
+                   uint32_t mask, int shift, int n, uint32_t* dst) {
+    for (int i = 0; i < n; i++) {
+        uint32_t v = 0;
+        std::memcpy(&v, src + i * src_stride, src_size);
+        if (mask) v &= mask;
+        if (shift > 0) v >>= shift;
+        if (shift < 0) v <<= -shift;
+        dst[i] = v;
+    }
+}
+
+#ifdef OUSTER_GATHER_AVX2
+/*
+ * Gather 8 full words per iteration and truncate them to the field size with
+ * the mask. Only the last field may not have 4 readable bytes, so it is always
+ * left to the scalar tail unless the field is a full word.
+ */
+__attribute__((target("avx2"))) void gather_avx2(
+    const uint8_t* src, size_t src_stride, size_t src_size, uint32_t mask,
+    int shift, int n, uint32_t* dst) {
+    const int n_safe = (src_size == 4) ? n : n - 1;
+    const int stride = static_cast<int>(src_stride);
+
+    const __m256i idx = _mm256_mullo_epi32(
+        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+    const __m256i vmask =
+        _mm256_set1_epi32(static_cast<int>(field_mask(src_size, mask)));
+    const __m128i rshift = _mm_cvtsi32_si128(shift > 0 ? shift : 0);
+    const __m128i lshift = _mm_cvtsi32_si128(shift < 0 ? -shift : 0);
+
+    int i = 0;
+    for (; i + 8 <= n_safe; i += 8) {
+        __m256i v = _mm256_i32gather_epi32(
+            reinterpret_cast<const int*>(src + i * src_stride), idx, 1);
+        v = _mm256_and_si256(v, vmask);
+        v = _mm256_srl_epi32(v, rshift);
+        v = _mm256_sll_epi32(v, lshift);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+    }
+    gather_scalar(src + i * src_stride, src_stride, src_size, mask, shift,
+                  n - i, dst + i);
+}
+#endif
+
+#ifdef OUSTER_GATHER_NEON
+/*
+ * Deinterleave with structured loads, which read WORDS consecutive words per
+ * lane. A block of 4 fields reads 4 * src_stride bytes, so stop one field
+ * early to stay within bounds and finish with the scalar tail.
+ */
+template <int WORDS>
+void gather_neon_impl(const uint8_t* src, size_t src_stride, size_t src_size,
+                      uint32_t mask, int shift, int n, uint32_t* dst) {
+    const uint32x4_t vmask = vdupq_n_u32(field_mask(src_size, mask));
+    // vshlq with a negative count is a logical right shift
+    const int32x4_t vshift = vdupq_n_s32(-shift);
+
+    int i = 0;
+    for (; i + 5 <= n; i += 4) {
+        const uint32_t* p =
+            reinterpret_cast<const uint32_t*>(src + i * src_stride);
+        uint32x4_t v;
+        switch (WORDS) {
+            case 1:
+                v = vld1q_u32(p);
+                break;
+            case 2:
+                v = vld2q_u32(p).val[0];
+                break;
+            case 3:
+                v = vld3q_u32(p).val[0];
+                break;
+            default:
+                v = vld4q_u32(p).val[0];
+                break;
+        }
+        v = vshlq_u32(vandq_u32(v, vmask), vshift);
+        vst1q_u32(dst + i, v);
+    }
+    gather_scalar(src + i * src_stride, src_stride, src_size, mask, shift,
+                  n - i, dst + i);
+}
+
+void gather_neon(const uint8_t* src, size_t src_stride, size_t src_size,
+                 uint32_t mask, int shift, int n, uint32_t* dst) {
+    switch (src_stride) {
+        case 4:
+            return gather_neon_impl<1>(src, src_stride, src_size, mask, shift,
+                                       n, dst);
+        case 8:
+            return gather_neon_impl<2>(src, src_stride, src_size, mask, shift,
+                                       n, dst);
+        case 12:
+            return gather_neon_impl<3>(src, src_stride, src_size, mask, shift,
+                                       n, dst);
+        case 16:
+            return gather_neon_impl<4>(src, src_stride, src_size, mask, shift,
+                                       n, dst);
+        default:
+            return gather_scalar(src, src_stride, src_size, mask, shift, n,
+                                 dst);
+    }
+}
+#endif
+
+gather_fn select_gather() {
+#ifdef OUSTER_GATHER_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return gather_avx2;
+#endif
+#ifdef OUSTER_GATHER_NEON
+    return gather_neon;
+#endif
+    return gather_scalar;
+}
+
+}  // namespace
+
+void gather_field_u32(const uint8_t* src, size_t src_stride, size_t src_size,
+                      uint32_t mask, int shift, int n, uint32_t* dst) {
+    static const gather_fn impl = select_gather();
+
+    // full-word loads need at least a word between consecutive fields
+    if (src_stride < 4 || n <= 0)
+        return gather_scalar(src, src_stride, src_size, mask, shift, n, dst);
+    impl(src, src_stride, src_size, mask, shift, n, dst);
+}
+
+}  // namespace impl
+}  // namespace sensor
+}  // namespace ouster
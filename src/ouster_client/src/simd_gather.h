@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Vectorized extraction of interleaved channel fields
+ *
+ * Channel data in lidar packets is stored as an array of fixed-size per-pixel
+ * structs, so every field is strided by the channel data size. These helpers
+ * deinterleave one field of many pixels at once, picking an AVX2 or NEON
+ * implementation at runtime when the CPU supports it.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ouster {
+namespace sensor {
+namespace impl {
+
+/**
+ * Check whether gather_field_u32() can reproduce the result of decoding a
+ * field of src_size bytes with the given shift directly into its destination
+ * type. Holds unless a left shift would push bits past 32.
+ *
+ * @param[in] src_size size in bytes of the field in the packet.
+ * @param[in] shift field shift; > 0 is a right shift, < 0 is a left shift.
+ *
+ * @return true if the 32-bit gather path may be used.
+ */
+constexpr bool gather_field_u32_supported(size_t src_size, int shift) {
+    return src_size <= 4 && (shift >= 0 || src_size * 8 - shift <= 32);
+}
+
+/**
+ * Extract n fields of src_size bytes spaced src_stride bytes apart.
+ *
+ * Equivalent to reading each little-endian field into a zeroed uint32_t,
+ * applying the mask if it is non-zero, then shifting right by shift (or left
+ * by -shift), and writing the results contiguously to dst. Never reads past
+ * the last field, i.e. src + (n - 1) * src_stride + src_size.
+ *
+ * @param[in] src pointer to the first field.
+ * @param[in] src_stride distance in bytes between consecutive fields.
+ * @param[in] src_size size of the field in bytes: 1, 2 or 4.
+ * @param[in] mask bit mask applied to each field, or zero for no mask.
+ * @param[in] shift > 0 for a right shift, < 0 for a left shift.
+ * @param[in] n number of fields to extract.
+ * @param[out] dst output array of at least n elements.
+ */
+void gather_field_u32(const uint8_t* src, size_t src_stride, size_t src_size,
+                      uint32_t mask, int shift, int n, uint32_t* dst);
+
+}  // namespace impl
+}  // namespace sensor
+}  // namespace ouster
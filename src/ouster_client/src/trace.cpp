@@ -0,0 +1,133 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace ouster {
+namespace trace {
+
+namespace impl {
+std::atomic<Sink*> current_sink{nullptr};
+}  // namespace impl
+
+void set_sink(Sink* sink) {
+    impl::current_sink.store(sink, std::memory_order_release);
+}
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+uint32_t thread_id() {
+    static std::atomic<uint32_t> next{1};
+    thread_local const uint32_t id = next++;
+    return id;
+}
+
+RingSink::RingSink(size_t capacity) : capacity_{std::max<size_t>(capacity, 1)} {
+    ring_.reserve(capacity_);
+}
+
+void RingSink::add(const Event& e) {
+    std::lock_guard<std::mutex> lock{mtx_};
+    if (ring_.size() < capacity_)
+        ring_.push_back(e);
+    else
+        ring_[next_] = e;
+    next_ = (next_ + 1) % capacity_;
+
+    auto& s = stats_[e.name];
+    s.count++;
+    if (e.is_counter) {
+        s.last_value = e.value;
+    } else {
+        const uint64_t d = e.end_ns - e.start_ns;
+        s.total_ns += d;
+        s.max_ns = std::max(s.max_ns, d);
+    }
+}
+
+void RingSink::span(const char* name, uint64_t start_ns, uint64_t end_ns,
+                    uint32_t thread) {
+    add({name, start_ns, end_ns, 0, thread, false});
+}
+
+void RingSink::counter(const char* name, int64_t value, uint64_t ts_ns,
+                       uint32_t thread) {
+    add({name, ts_ns, ts_ns, value, thread, true});
+}
+
+std::vector<RingSink::Event> RingSink::events() const {
+    std::lock_guard<std::mutex> lock{mtx_};
+    if (ring_.size() < capacity_) return ring_;
+
+    // the oldest event is the next to be overwritten
+    std::vector<Event> res;
+    res.reserve(ring_.size());
+    res.insert(res.end(), ring_.begin() + next_, ring_.end());
+    res.insert(res.end(), ring_.begin(), ring_.begin() + next_);
+    return res;
+}
+
+std::map<std::string, RingSink::Stats> RingSink::stats() const {
+    std::lock_guard<std::mutex> lock{mtx_};
+
+    // the same name may be reported from different literals
+    std::map<std::string, Stats> res;
+    for (const auto& kv : stats_) {
+        auto& s = res[kv.first];
+        const auto& t = kv.second;
+        if (t.count && !s.count) s.last_value = t.last_value;
+        s.count += t.count;
+        s.total_ns += t.total_ns;
+        s.max_ns = std::max(s.max_ns, t.max_ns);
+    }
+    return res;
+}
+
+void RingSink::clear() {
+    std::lock_guard<std::mutex> lock{mtx_};
+    ring_.clear();
+    next_ = 0;
+    stats_.clear();
+}
+
+ChromeTraceSink::ChromeTraceSink(const std::string& path) : out_{path} {
+    if (!out_) throw std::runtime_error("Failed to open trace file " + path);
+    out_ << "[";
+}
+
+ChromeTraceSink::~ChromeTraceSink() { out_ << "\n]\n"; }
+
+// timestamps of the trace event format are in microseconds
+void ChromeTraceSink::span(const char* name, uint64_t start_ns,
+                           uint64_t end_ns, uint32_t thread) {
+    std::lock_guard<std::mutex> lock{mtx_};
+    out_ << (first_ ? "\n" : ",\n") << "{\"name\":\"" << name
+         << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread
+         << ",\"ts\":" << start_ns / 1000 << "." << start_ns % 1000 / 100
+         << ",\"dur\":" << (end_ns - start_ns) / 1000 << "."
+         << (end_ns - start_ns) % 1000 / 100 << "}";
+    first_ = false;
+}
+
+void ChromeTraceSink::counter(const char* name, int64_t value, uint64_t ts_ns,
+                              uint32_t thread) {
+    std::lock_guard<std::mutex> lock{mtx_};
+    out_ << (first_ ? "\n" : ",\n") << "{\"name\":\"" << name
+         << "\",\"ph\":\"C\",\"pid\":0,\"tid\":" << thread
+         << ",\"ts\":" << ts_ns / 1000 << "." << ts_ns % 1000 / 100
+         << ",\"args\":{\"value\":" << value << "}}";
+    first_ = false;
+}
+
+}  // namespace trace
+}  // namespace ouster
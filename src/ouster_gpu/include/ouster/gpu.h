@@ -0,0 +1,199 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Process lidar scans on a CUDA device
+ *
+ * A ScanProcessor keeps the lookup tables and pixel shifts of a sensor
+ * resident in device memory. Scans are uploaded by copying their arena as a
+ * whole, after which projection, destaggering and auto exposure run as
+ * kernels writing to device memory supplied by the caller, e.g. the input
+ * tensors of a network, without the results ever returning to the host.
+ *
+ * All work is queued on the stream of the processor. This header doesn't
+ * include the CUDA runtime; pointers to device memory are plain pointers.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "ouster/image_processing.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+/// The CUDA runtime stream type, cudaStream_t
+struct CUstream_st;
+
+namespace ouster {
+namespace gpu {
+
+/** A CUDA stream, the same type as cudaStream_t. */
+using stream_t = CUstream_st*;
+
+/** Which pixels ScanProcessor::cartesian() keeps. */
+struct range_filter {
+    uint32_t min_range{1};  ///< pixels closer than this, in mm, are zeroed
+    uint32_t max_range{std::numeric_limits<uint32_t>::max()};  ///< and beyond
+};
+
+/**
+ * Processes the scans of a sensor on a CUDA device.
+ *
+ * Scans are uploaded one at a time and processed in the order calls are
+ * made, asynchronously to the host. Scans must be staggered, as batched
+ * without BATCH_DESTAGGER, and have a uint32_t range field to be projected.
+ *
+ * Not thread safe. Processors of different sensors or with different streams
+ * may be used from different threads.
+ */
+class ScanProcessor {
+   public:
+    /**
+     * Upload the lookup tables and pixel shifts of the sensor to the device.
+     *
+     * @throw std::invalid_argument if the metadata has no pixel shift for each
+     * row.
+     * @throw std::runtime_error on CUDA errors, e.g. if there is no device.
+     *
+     * @param[in] info sensor metadata.
+     * @param[in] stream the stream to queue work on, the default stream if
+     * null. The stream must outlive the processor.
+     */
+    explicit ScanProcessor(const sensor::sensor_info& info,
+                           stream_t stream = nullptr);
+
+    /** Synchronize with the stream and free all device memory. */
+    ~ScanProcessor();
+
+    ScanProcessor(const ScanProcessor&) = delete;
+    ScanProcessor& operator=(const ScanProcessor&) = delete;
+
+    /**
+     * Copy a scan to the device, in a single transfer of its arena.
+     *
+     * The copy is asynchronous if the arena is page-locked, e.g. a scan
+     * constructed on memory from cudaHostAlloc(), in which case the scan must
+     * not be modified until the stream is synchronized. Otherwise, the copy
+     * is done when upload returns. Device memory is reallocated only when
+     * the fields of scans change.
+     *
+     * @throw std::invalid_argument if the scan doesn't match the dimensions
+     * of the sensor or is destaggered.
+     * @throw std::runtime_error on CUDA errors.
+     *
+     * @param[in] scan the scan to process.
+     */
+    void upload(const LidarScan& scan);
+
+    /**
+     * Project a range field of the uploaded scan to points in the sensor
+     * frame, in meters, on the device.
+     *
+     * Points are written like cartesian_into(): point i of the staggered scan
+     * at xyz + i * stride. Pixels outside the range filter and pixels of
+     * columns not marked valid are zeroed.
+     *
+     * @throw std::invalid_argument if no scan was uploaded, the stride is
+     * less than 3 or the range field isn't of type uint32_t.
+     * @throw std::out_of_range if the scan has no such field.
+     * @throw std::runtime_error on CUDA errors.
+     *
+     * @param[out] xyz device memory for w * h points.
+     * @param[in] stride distance between points, in floats.
+     * @param[in] filter the ranges of points to keep.
+     * @param[in] range the range field to project.
+     */
+    void cartesian(float* xyz, std::ptrdiff_t stride = 3,
+                   const range_filter& filter = {},
+                   sensor::ChanField range = sensor::RANGE);
+
+    /**
+     * Convert a field of the uploaded scan to a single precision image on the
+     * device.
+     *
+     * @throw std::invalid_argument if no scan was uploaded.
+     * @throw std::out_of_range if the scan has no such field.
+     * @throw std::runtime_error on CUDA errors.
+     *
+     * @param[in] f the field to convert.
+     * @param[out] dest device memory for the h x w row-major image.
+     * @param[in] destagger whether to destagger the image, see destagger().
+     */
+    void image(sensor::ChanField f, float* dest, bool destagger = true);
+
+    /**
+     * Like image(), scaling the image between 0 and 1 by auto exposure.
+     *
+     * The scaling is computed on the host from a sample of the field of the
+     * scan, which should be the last scan uploaded, see
+     * viz::AutoExposure::scaling(). Only the scaled image is computed on the
+     * device, and it's zeroed until there was enough data to scale.
+     *
+     * @throw std::invalid_argument if no scan was uploaded or the field isn't
+     * of type uint32_t.
+     * @throw std::out_of_range if the scan has no such field.
+     * @throw std::runtime_error on CUDA errors.
+     *
+     * @param[in] scan the scan last uploaded, in host memory.
+     * @param[in] f the field to scale.
+     * @param[in,out] ae the auto exposure state, updated with the field.
+     * @param[out] dest device memory for the h x w row-major image.
+     * @param[in] destagger whether to destagger the image.
+     */
+    void auto_exposure(const LidarScan& scan, sensor::ChanField f,
+                       viz::AutoExposure& ae, float* dest,
+                       bool destagger = true);
+
+    /**
+     * Get the uploaded scan in device memory, in the layout of its arena on
+     * the host.
+     *
+     * @return the device arena, or nullptr if no scan was uploaded.
+     */
+    const uint8_t* device_arena() const;
+
+    /**
+     * Wait for all work queued by the processor to finish.
+     *
+     * @throw std::runtime_error on CUDA errors, including those of kernels
+     * that failed asynchronously.
+     */
+    void synchronize();
+
+    /**
+     * Get the stream work is queued on.
+     *
+     * @return the stream, null for the default stream.
+     */
+    stream_t stream() const;
+
+   private:
+    struct Field {
+        size_t offset;  // in the arena, in bytes
+        sensor::ChanFieldType type;
+    };
+
+    const Field& field(sensor::ChanField f) const;
+
+    size_t w_, h_;
+    stream_t stream_;
+
+    // resident for the lifetime of the processor
+    float* direction_{nullptr};
+    float* offset_{nullptr};
+    int* shifts_{nullptr};
+
+    // the uploaded scan
+    uint8_t* arena_{nullptr};
+    size_t arena_capacity_{0};
+    bool uploaded_{false};
+    size_t status_offset_{0};
+    Field fields_[sensor::CHAN_FIELD_MAX]{};
+};
+
+}  // namespace gpu
+}  // namespace ouster
@@ -0,0 +1,265 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include <cuda_runtime.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ouster/gpu.h"
+#include "ouster/image_processing.h"
+#include "ouster/impl/lidar_scan_impl.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace gpu {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+namespace {
+
+constexpr int BLOCK = 256;
+
+void check(cudaError_t err, const char* what) {
+    if (err != cudaSuccess)
+        throw std::runtime_error(std::string{what} + ": " +
+                                 cudaGetErrorString(err));
+}
+
+template <typename T>
+T* device_alloc(size_t n) {
+    void* p = nullptr;
+    check(cudaMalloc(&p, n * sizeof(T)), "cudaMalloc");
+    return static_cast<T*>(p);
+}
+
+template <typename T>
+void upload_array(T* dst, const T* src, size_t n, cudaStream_t stream) {
+    check(cudaMemcpyAsync(dst, src, n * sizeof(T), cudaMemcpyHostToDevice,
+                          stream),
+          "cudaMemcpyAsync");
+}
+
+unsigned blocks(size_t n) {
+    return static_cast<unsigned>((n + BLOCK - 1) / BLOCK);
+}
+
+// where pixel v of row u of a staggered image goes, see destagger()
+__device__ inline size_t destaggered(const int* shifts, size_t u, size_t v,
+                                     size_t w) {
+    const long n = static_cast<long>(w);
+    const long off = (shifts[u] % n + n) % n;
+    return u * w + (v + static_cast<size_t>(off)) % w;
+}
+
+/*
+ * One thread per pixel, like cartesian_into(): offsets are only added to
+ * non-zero components, pixels of invalid columns and outside the filter are
+ * zeroed.
+ */
+__global__ void project_kernel(const uint32_t* range, const uint32_t* status,
+                               const float* dir, const float* off, size_t w,
+                               size_t n, uint32_t min_range,
+                               uint32_t max_range, float* xyz,
+                               std::ptrdiff_t stride) {
+    const size_t i = blockIdx.x * static_cast<size_t>(blockDim.x) + threadIdx.x;
+    if (i >= n) return;
+    const uint32_t r = range[i];
+    const bool keep =
+        (status[i % w] & 0x01) && r >= min_range && r <= max_range;
+    const float rv = keep ? static_cast<float>(r) : 0.0f;
+    float* p = xyz + i * stride;
+    for (int c = 0; c < 3; c++) {
+        const float x = dir[c * n + i] * rv;
+        p[c] = x != 0.0f ? x + off[c * n + i] : 0.0f;
+    }
+}
+
+// convert and optionally destagger, scaling values to x * scale + offset,
+// clamped between lo and hi
+template <typename T>
+__global__ void image_kernel(const T* src, const int* shifts, size_t w,
+                             size_t n, float scale, float offset, float lo,
+                             float hi, float* dest) {
+    const size_t i = blockIdx.x * static_cast<size_t>(blockDim.x) + threadIdx.x;
+    if (i >= n) return;
+    const size_t u = i / w;
+    const size_t v = i % w;
+    const float x = static_cast<float>(src[i]) * scale + offset;
+    dest[shifts ? destaggered(shifts, u, v, w) : i] = fminf(fmaxf(x, lo), hi);
+}
+
+template <typename T>
+void launch_image(const uint8_t* src, const int* shifts, size_t w, size_t n,
+                  float scale, float offset, float lo, float hi, float* dest,
+                  cudaStream_t stream) {
+    image_kernel<T><<<blocks(n), BLOCK, 0, stream>>>(
+        reinterpret_cast<const T*>(src), shifts, w, n, scale, offset, lo, hi,
+        dest);
+}
+
+void launch_image(ChanFieldType type, const uint8_t* src, const int* shifts,
+                  size_t w, size_t n, float scale, float offset, float lo,
+                  float hi, float* dest, cudaStream_t stream) {
+    switch (type) {
+        case ChanFieldType::UINT8:
+            return launch_image<uint8_t>(src, shifts, w, n, scale, offset, lo,
+                                         hi, dest, stream);
+        case ChanFieldType::UINT16:
+            return launch_image<uint16_t>(src, shifts, w, n, scale, offset, lo,
+                                          hi, dest, stream);
+        case ChanFieldType::UINT32:
+            return launch_image<uint32_t>(src, shifts, w, n, scale, offset, lo,
+                                          hi, dest, stream);
+        case ChanFieldType::UINT64:
+            return launch_image<unsigned long long>(
+                src, shifts, w, n, scale, offset, lo, hi, dest, stream);
+        default:
+            throw std::invalid_argument("Invalid field for LidarScan");
+    }
+}
+
+// the offset of a field in the arena of its scan
+struct arena_offset {
+    template <typename T>
+    void operator()(Eigen::Ref<const img_t<T>> field, const LidarScan& ls,
+                    size_t& offset) {
+        offset = reinterpret_cast<const uint8_t*>(field.data()) - ls.arena();
+    }
+};
+
+}  // namespace
+
+ScanProcessor::ScanProcessor(const sensor::sensor_info& info,
+                             stream_t stream)
+    : w_{info.format.columns_per_frame},
+      h_{info.format.pixels_per_column},
+      stream_{stream} {
+    const auto& shifts = info.format.pixel_shift_by_row;
+    if (shifts.size() != h_)
+        throw std::invalid_argument("expected a pixel shift for each row");
+
+    const XYZLutf lut = make_xyz_lutf(make_xyz_lut(info));
+    const size_t n = w_ * h_;
+    try {
+        direction_ = device_alloc<float>(3 * n);
+        offset_ = device_alloc<float>(3 * n);
+        shifts_ = device_alloc<int>(h_);
+        upload_array(direction_, lut.direction.data(), 3 * n, stream_);
+        upload_array(offset_, lut.offset.data(), 3 * n, stream_);
+        upload_array(shifts_, shifts.data(), h_, stream_);
+        // the tables are freed on return
+        check(cudaStreamSynchronize(stream_), "cudaStreamSynchronize");
+    } catch (...) {
+        cudaFree(direction_);
+        cudaFree(offset_);
+        cudaFree(shifts_);
+        throw;
+    }
+}
+
+ScanProcessor::~ScanProcessor() {
+    cudaStreamSynchronize(stream_);
+    cudaFree(direction_);
+    cudaFree(offset_);
+    cudaFree(shifts_);
+    cudaFree(arena_);
+}
+
+void ScanProcessor::upload(const LidarScan& scan) {
+    if (static_cast<size_t>(scan.w) != w_ || static_cast<size_t>(scan.h) != h_)
+        throw std::invalid_argument("unexpected scan dimensions");
+    if (scan.destaggered)
+        throw std::invalid_argument("expected a staggered scan");
+
+    const size_t size = scan.arena_size();
+    if (size > arena_capacity_) {
+        // scans previously uploaded may still be in use
+        check(cudaStreamSynchronize(stream_), "cudaStreamSynchronize");
+        cudaFree(arena_);
+        arena_ = nullptr;
+        arena_capacity_ = 0;
+        arena_ = device_alloc<uint8_t>(size);
+        arena_capacity_ = size;
+    }
+
+    for (auto& f : fields_) f = {0, ChanFieldType::VOID};
+    for (const auto& ft : scan) {
+        size_t offset = 0;
+        impl::visit_field(scan, ft.first, arena_offset{}, scan, offset);
+        fields_[ft.first] = {offset, ft.second};
+    }
+    status_offset_ = reinterpret_cast<const uint8_t*>(scan.status().data()) -
+                     scan.arena();
+
+    upload_array(arena_, scan.arena(), size, stream_);
+    uploaded_ = true;
+}
+
+const ScanProcessor::Field& ScanProcessor::field(ChanField f) const {
+    if (!uploaded_) throw std::invalid_argument("no scan was uploaded");
+    const auto& field = fields_[f];
+    if (field.type == ChanFieldType::VOID)
+        throw std::out_of_range("no such field in the scan");
+    return field;
+}
+
+void ScanProcessor::cartesian(float* xyz, std::ptrdiff_t stride,
+                              const range_filter& filter, ChanField range) {
+    if (stride < 3) throw std::invalid_argument("point stride less than 3");
+    const auto& f = field(range);
+    if (f.type != ChanFieldType::UINT32)
+        throw std::invalid_argument("expected a uint32_t range field");
+
+    const size_t n = w_ * h_;
+    project_kernel<<<blocks(n), BLOCK, 0, stream_>>>(
+        reinterpret_cast<const uint32_t*>(arena_ + f.offset),
+        reinterpret_cast<const uint32_t*>(arena_ + status_offset_), direction_,
+        offset_, w_, n, filter.min_range, filter.max_range, xyz, stride);
+    check(cudaGetLastError(), "project_kernel");
+}
+
+void ScanProcessor::image(ChanField f, float* dest, bool destagger) {
+    const auto& fd = field(f);
+    launch_image(fd.type, arena_ + fd.offset, destagger ? shifts_ : nullptr,
+                 w_, w_ * h_, 1.0f, 0.0f, 0.0f,
+                 std::numeric_limits<float>::infinity(), dest, stream_);
+    check(cudaGetLastError(), "image_kernel");
+}
+
+void ScanProcessor::auto_exposure(const LidarScan& scan, ChanField f,
+                                  viz::AutoExposure& ae, float* dest,
+                                  bool destagger) {
+    const auto& fd = field(f);
+    if (fd.type != ChanFieldType::UINT32)
+        throw std::invalid_argument("expected a uint32_t field");
+
+    // zeroes the image until there is enough data to scale
+    double scale = 0.0, offset = 0.0;
+    ae.scaling(scan.field<uint32_t>(f), scale, offset);
+    launch_image(fd.type, arena_ + fd.offset, destagger ? shifts_ : nullptr,
+                 w_, w_ * h_, static_cast<float>(scale),
+                 static_cast<float>(offset), 0.0f, 1.0f, dest, stream_);
+    check(cudaGetLastError(), "image_kernel");
+}
+
+const uint8_t* ScanProcessor::device_arena() const {
+    return uploaded_ ? arena_ : nullptr;
+}
+
+void ScanProcessor::synchronize() {
+    check(cudaStreamSynchronize(stream_), "cudaStreamSynchronize");
+}
+
+stream_t ScanProcessor::stream() const { return stream_; }
+
+}  // namespace gpu
+}  // namespace ouster
@@ -8,10 +8,15 @@
 
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
+
+#include "ouster/types.h"
 
 namespace ouster {
 namespace sensor_utils {
@@ -33,6 +38,27 @@ struct packet_info {
     int network_protocol;  ///< IANA protocol number. Always 17 (UDP)
 };
 
+/**
+ * A UDP datagram read from a pcap file without copying its payload.
+ *
+ * Addresses are in network byte order, with IPv4 addresses stored as
+ * v4-mapped IPv6 addresses (::ffff:a.b.c.d).
+ */
+struct packet_view {
+    using ts = std::chrono::microseconds;  ///< Microsecond timestamp
+
+    std::array<uint8_t, 16> dst_addr;  ///< The destination address
+    std::array<uint8_t, 16> src_addr;  ///< The source address
+    int dst_port;                      ///< The destination port
+    int src_port;                      ///< The source port
+    const uint8_t* payload;            ///< The packet payload
+    size_t payload_size;               ///< The size of the packet payload
+    ts timestamp;                      ///< The packet capture timestamp
+    int fragments_in_packet;           ///< Number of fragments in the packet
+    int ip_version;                    ///< The ip version, 4 or 6
+    int encapsulation_protocol;        ///< PCAP encapsulation type
+};
+
 /**
  * To string method for packet info structs.
  *
@@ -96,6 +122,193 @@ bool next_packet_info(playback_handle& handle, packet_info& info);
  */
 size_t read_packet(playback_handle& handle, uint8_t* buf, size_t buffer_size);
 
+/**
+ * Read the next UDP packet avaliable in the playback_handle without copying.
+ *
+ * The payload points into the memory-mapped file, or into a buffer owned by
+ * the handle for fragmented packets. It stays valid until the next call to
+ * next_packet, next_packet_info or replay_reset with the same handle.
+ *
+ * Packets returned here can't be read with read_packet.
+ *
+ * @param[in] handle The playback handle.
+ * @param[out] view The returned packet.
+ *
+ * @return The status on whether there is a new packet or not.
+ */
+bool next_packet(playback_handle& handle, packet_view& view);
+
+/**
+ * Statistics of the UDP packets with the same addresses and ports, used to
+ * find the sensor data streams of a pcap file.
+ */
+struct udp_stream_stats {
+    std::array<uint8_t, 16> dst_addr;      ///< As in packet_view
+    std::array<uint8_t, 16> src_addr;      ///< As in packet_view
+    std::string dst_ip;                    ///< The formatted destination IP
+    std::string src_ip;                    ///< The formatted source IP
+    int dst_port;                          ///< The destination port
+    int src_port;                          ///< The source port
+    int ip_version;                        ///< The ip version, 4 or 6
+    uint64_t count;                        ///< Number of packets
+    std::vector<size_t> payload_sizes;     ///< Distinct payload sizes
+    std::vector<int> fragments_in_packet;  ///< Distinct fragment counts
+};
+
+/**
+ * Offsets of the lidar frames in a pcap file, for random access.
+ *
+ * Frames are indexed per sensor, identified by the source address of the
+ * lidar packets sent to one destination port. A frame starts with the first
+ * packet carrying a new frame id.
+ */
+struct pcap_index {
+    /** Where to start reading to get a frame. */
+    struct frame_info {
+        uint64_t offset;          ///< File offset of the first packet
+        uint64_t section_offset;  ///< Offset of the pcapng section, or zero
+        uint64_t timestamp_us;    ///< Capture timestamp of the first packet
+        uint16_t frame_id;        ///< Frame id of the first packet
+    };
+
+    /** The frames sent from one source address. */
+    struct stream {
+        std::array<uint8_t, 16> src_addr;  ///< Source, as in packet_view
+        std::vector<frame_info> frames;    ///< Frames in file order
+    };
+
+    uint64_t file_size;           ///< Size of the indexed pcap file
+    int lidar_port;               ///< Destination port of the lidar packets
+    size_t lidar_packet_size;     ///< Size of the indexed lidar packets
+    std::vector<stream> streams;  ///< Streams in order of appearance
+
+    /// All UDP streams of the file, regardless of port, in order of appearance
+    std::vector<udp_stream_stats> udp_streams;
+};
+
+/**
+ * Build a frame index by reading a whole pcap file.
+ *
+ * @throw std::runtime_error if the file can't be read.
+ *
+ * @param[in] file The file path of the pcap file.
+ * @param[in] lidar_port The destination port of the lidar packets to index.
+ * @param[in] pf The packet format of the lidar packets.
+ *
+ * @return The index.
+ */
+pcap_index build_index(const std::string& file, int lidar_port,
+                       const sensor::packet_format& pf);
+
+/**
+ * Get the path of the index file kept next to a pcap file.
+ *
+ * @param[in] file The file path of the pcap file.
+ *
+ * @return The path of the index file.
+ */
+std::string index_path(const std::string& file);
+
+/**
+ * Write an index to a file.
+ *
+ * @param[in] index The index to write.
+ * @param[in] index_file The path of the index file.
+ *
+ * @return true if the index was written.
+ */
+bool save_index(const pcap_index& index, const std::string& index_file);
+
+/**
+ * Read an index from a file.
+ *
+ * @param[in] index_file The path of the index file.
+ * @param[out] index The index read.
+ *
+ * @return false if the file is missing or isn't a valid index.
+ */
+bool load_index(const std::string& index_file, pcap_index& index);
+
+/**
+ * Get the frame index of a pcap file, using the index file kept next to it.
+ *
+ * The index file is used if it matches the size of the pcap file, the port
+ * and the packet size. Otherwise the index is rebuilt and written back,
+ * ignoring errors if the index file can't be written.
+ *
+ * @throw std::runtime_error if the pcap file can't be read.
+ *
+ * @param[in] file The file path of the pcap file.
+ * @param[in] lidar_port The destination port of the lidar packets to index.
+ * @param[in] pf The packet format of the lidar packets.
+ *
+ * @return The index.
+ */
+pcap_index get_index(const std::string& file, int lidar_port,
+                     const sensor::packet_format& pf);
+
+/**
+ * Get statistics of the UDP streams of a pcap file.
+ *
+ * Uses the statistics of the whole file saved in the index file kept next to
+ * it, if it matches the size of the pcap file, for any port. Otherwise reads
+ * the start of the file, without writing an index.
+ *
+ * @throw std::runtime_error if the pcap file can't be read.
+ *
+ * @param[in] file The file path of the pcap file.
+ * @param[in] max_packets The number of packets to read without an index, or 0
+ * to read the whole file.
+ *
+ * @return The statistics of each stream, in order of appearance.
+ */
+std::vector<udp_stream_stats> get_stream_stats(const std::string& file,
+                                               size_t max_packets = 0);
+
+/**
+ * Continue playback from the start of a frame.
+ *
+ * @param[in] handle The playback handle.
+ * @param[in] stream A stream of the index of the file being played back.
+ * @param[in] frame The position of the frame in the stream.
+ *
+ * @return false if the frame is out of range, leaving the handle unchanged.
+ */
+bool replay_seek(playback_handle& handle, const pcap_index::stream& stream,
+                 size_t frame);
+
+/**
+ * Continue playback from the first frame captured at or after a time.
+ *
+ * @param[in] handle The playback handle.
+ * @param[in] stream A stream of the index of the file being played back.
+ * @param[in] timestamp The capture time to seek to.
+ *
+ * @return false if there is no such frame, leaving the handle unchanged.
+ */
+bool replay_seek(playback_handle& handle, const pcap_index::stream& stream,
+                 std::chrono::microseconds timestamp);
+
+/** Buffering options for recording pcap files. */
+struct record_options {
+    /// Write buffers from a background thread instead of the recording thread
+    bool async_write{false};
+    /// Size of the buffers, each written to the file in a single call
+    size_t buffer_size{1 << 20};
+    /// Number of buffers, including the one being filled, for async writes
+    size_t n_buffers{8};
+    /// Drop packets instead of blocking when all buffers wait to be written
+    bool drop_when_full{false};
+};
+
+/** Counters of a recording. */
+struct record_stats {
+    uint64_t packets_recorded;  ///< Packets buffered for writing
+    uint64_t packets_dropped;   ///< Packets dropped because buffers were full
+    uint64_t packets_written;   ///< Packets written to the file
+    uint64_t bytes_written;     ///< Bytes written to the file
+};
+
 /**
  * Initialize the record handle for recording single sensor pcap files. Will be
  * removed
@@ -123,12 +336,44 @@ std::shared_ptr<record_handle> record_initialize(
     const std::string& file, int frag_size, bool use_sll_encapsulation = false);
 
 /**
- * Uninitialize the record handle, closing underlying file.
+ * Initialize the record handle for recording multi sensor pcap files with
+ * custom buffering.
+ *
+ * With async_write set, record_packet() only copies packets into buffers, and
+ * full buffers are written by a background thread. If the thread falls behind
+ * by n_buffers buffers, record_packet() blocks or drops packets depending on
+ * drop_when_full.
+ *
+ * @throw std::runtime_error if the file can't be created.
+ *
+ * @param[in] file The file path to the target pcap to record to.
+ * @param[in] frag_size The size of the fragments for packet fragmentation.
+ * @param[in] use_sll_encapsulation Whether to use sll encapsulation.
+ * @param[in] options The buffering options.
+ */
+std::shared_ptr<record_handle> record_initialize(
+    const std::string& file, int frag_size, bool use_sll_encapsulation,
+    const record_options& options);
+
+/**
+ * Uninitialize the record handle, writing buffered packets and closing the
+ * underlying file.
+ *
+ * @throw std::runtime_error if writing to the file failed.
  *
  * @param[in] handle An initialized handle for the recording state.
  */
 void record_uninitialize(record_handle& handle);
 
+/**
+ * Get the counters of a recording. Must be called from the recording thread.
+ *
+ * @param[in] handle An initialized handle for the recording state.
+ *
+ * @return The counters of the recording so far.
+ */
+record_stats get_record_stats(record_handle& handle);
+
 /**
  * Record a buffer to a single sensor record_handle pcap file. Source
  * and destination IPs must be provided during initialization. Will be removed.
@@ -140,8 +385,10 @@ void record_uninitialize(record_handle& handle);
  * @param[in] buffer_size The size of the buffer to record to the pcap file.
  * @param[in] microsecond_timestamp The timestamp to record the packet as
  * microseconds.
+ *
+ * @return false if the packet was dropped, see record_options.
  */
-[[deprecated]] void record_packet(record_handle& handle, int src_port,
+[[deprecated]] bool record_packet(record_handle& handle, int src_port,
                                   int dst_port, const uint8_t* buf,
                                   size_t buffer_size,
                                   uint64_t microsecond_timestamp);
@@ -158,8 +405,13 @@ void record_uninitialize(record_handle& handle);
  * @param[in] buffer_size The size of the buffer to record to the pcap file.
  * @param[in] microsecond_timestamp The timestamp to record the packet as
  * microseconds.
+ *
+ * @throw std::invalid_argument on invalid addresses or oversized buffers.
+ * @throw std::runtime_error if writing to the file failed.
+ *
+ * @return false if the packet was dropped, see record_options.
  */
-void record_packet(record_handle& handle, const std::string& src_ip,
+bool record_packet(record_handle& handle, const std::string& src_ip,
                    const std::string& dst_ip, int src_port, int dst_port,
                    const uint8_t* buf, size_t buffer_size,
                    uint64_t microsecond_timestamp);
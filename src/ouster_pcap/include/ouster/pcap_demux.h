@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Decode the lidar data of several sensors in a pcap file in one pass
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace sensor_utils {
+
+/**
+ * Batch the lidar packets of several sensors in a pcap file into scans,
+ * reading the file once and returning scans in file order.
+ *
+ * Packets are routed to a stream by their source address and destination
+ * port. A stream is started for each source sending packets of the size of a
+ * sensor to its lidar port, and has its own ScanBatcher, so that sensors
+ * sending to the same port from different addresses are kept apart. If
+ * several sensors use the same port, packets go to the first sensor with a
+ * matching packet size and init_id.
+ */
+class PcapDemux {
+   public:
+    /** A stream of lidar packets from one source. */
+    struct stream {
+        size_t sensor;                     ///< Index of the sensor metadata
+        std::array<uint8_t, 16> src_addr;  ///< Source, as in packet_view
+        int dst_port;                      ///< Destination port
+    };
+
+    /**
+     * Start decoding the lidar data of several sensors, with the default
+     * fields of the lidar profile of each sensor.
+     *
+     * @throw std::runtime_error if the file can't be read.
+     * @throw std::invalid_argument if lidar_ports isn't empty and doesn't
+     * have a port for each sensor.
+     *
+     * @param[in] file The file path of the pcap file.
+     * @param[in] infos The metadata of each sensor.
+     * @param[in] complete If true, drop incomplete scans.
+     * @param[in] lidar_ports The destination port of the lidar packets of each
+     * sensor, or empty to use the ports in the metadata.
+     */
+    PcapDemux(const std::string& file,
+              const std::vector<sensor::sensor_info>& infos,
+              bool complete = false, const std::vector<int>& lidar_ports = {});
+
+    /**
+     * Start decoding the lidar data of several sensors into scans with custom
+     * fields.
+     *
+     * @throw std::runtime_error if the file can't be read.
+     * @throw std::invalid_argument if there isn't a prototype for each sensor,
+     * or lidar_ports isn't empty and doesn't have a port for each sensor.
+     *
+     * @param[in] file The file path of the pcap file.
+     * @param[in] infos The metadata of each sensor.
+     * @param[in] prototypes A scan with the dimensions and fields to decode,
+     * for each sensor.
+     * @param[in] complete If true, drop incomplete scans.
+     * @param[in] lidar_ports The destination port of the lidar packets of each
+     * sensor, or empty to use the ports in the metadata.
+     */
+    PcapDemux(const std::string& file,
+              const std::vector<sensor::sensor_info>& infos,
+              const std::vector<LidarScan>& prototypes, bool complete = false,
+              const std::vector<int>& lidar_ports = {});
+
+    ~PcapDemux();
+
+    PcapDemux(const PcapDemux&) = delete;
+    PcapDemux& operator=(const PcapDemux&) = delete;
+
+    /**
+     * Get the next scan of any stream, in the order their last packets appear
+     * in the file.
+     *
+     * @param[out] scan The next scan, reusing its previous contents if it has
+     * the dimensions and fields of the prototype of the sensor.
+     * @param[out] stream_index The position of the stream of the scan in
+     * streams().
+     *
+     * @return false once all scans were returned.
+     */
+    bool next(LidarScan& scan, size_t& stream_index);
+
+    /**
+     * Get the streams found so far.
+     *
+     * @return The streams, in order of appearance.
+     */
+    const std::vector<stream>& streams() const;
+
+    /** Restart decoding from the beginning of the file. */
+    void reset();
+
+   private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace sensor_utils
+}  // namespace ouster
@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Decode the lidar frames of a pcap file on several threads
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace sensor_utils {
+
+/**
+ * Batch the lidar packets of a pcap file into scans using a pool of worker
+ * threads, returning scans in file order.
+ *
+ * The frames listed in the index of the file (see get_index()) are split into
+ * chunks of consecutive frames. Each worker seeks to the start of a chunk with
+ * its own playback handle and ScanBatcher and decodes the frames of the chunk.
+ * Workers stay at most 2 * n_workers chunks ahead of the reader, so about
+ * 2 * n_workers * chunk_frames scans are buffered at most.
+ *
+ * If several sensors send lidar data to the same port, only the sensor with
+ * the most frames is decoded.
+ */
+class PcapScanReader {
+   public:
+    /**
+     * Start decoding a pcap file, with the default fields of the lidar
+     * profile of the sensor.
+     *
+     * Builds or loads the index of the file before starting the workers.
+     *
+     * @throw std::runtime_error if the file can't be read.
+     *
+     * @param[in] file The file path of the pcap file.
+     * @param[in] info The sensor metadata of the lidar data.
+     * @param[in] n_workers The number of worker threads, or 0 for one per
+     * hardware thread.
+     * @param[in] chunk_frames The number of frames decoded by a worker at a
+     * time.
+     * @param[in] complete If true, drop incomplete scans.
+     * @param[in] lidar_port The destination port of the lidar packets, or 0
+     * to use the port in the metadata.
+     */
+    PcapScanReader(const std::string& file, const sensor::sensor_info& info,
+                   int n_workers = 0, size_t chunk_frames = 4,
+                   bool complete = false, int lidar_port = 0);
+
+    /**
+     * Start decoding a pcap file into scans with custom fields.
+     *
+     * @throw std::runtime_error if the file can't be read.
+     *
+     * @param[in] file The file path of the pcap file.
+     * @param[in] info The sensor metadata of the lidar data.
+     * @param[in] prototype A scan with the dimensions and fields to decode.
+     * @param[in] n_workers The number of worker threads, or 0 for one per
+     * hardware thread.
+     * @param[in] chunk_frames The number of frames decoded by a worker at a
+     * time.
+     * @param[in] complete If true, drop incomplete scans.
+     * @param[in] lidar_port The destination port of the lidar packets, or 0
+     * to use the port in the metadata.
+     */
+    PcapScanReader(const std::string& file, const sensor::sensor_info& info,
+                   const LidarScan& prototype, int n_workers = 0,
+                   size_t chunk_frames = 4, bool complete = false,
+                   int lidar_port = 0);
+
+    /** Stops and joins the worker threads. */
+    ~PcapScanReader();
+
+    PcapScanReader(const PcapScanReader&) = delete;
+    PcapScanReader& operator=(const PcapScanReader&) = delete;
+
+    /**
+     * Get the next scan in file order, waiting for it to be decoded.
+     *
+     * The previous contents of scan are reused by the workers if it has the
+     * dimensions and fields of the prototype.
+     *
+     * @throw std::runtime_error if a worker failed to read the file.
+     *
+     * @param[out] scan The next scan.
+     *
+     * @return false once all scans were returned.
+     */
+    bool next(LidarScan& scan);
+
+    /**
+     * Get the number of frames in the file, including incomplete frames.
+     *
+     * @return The number of indexed frames.
+     */
+    size_t frame_count() const;
+
+   private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace sensor_utils
+}  // namespace ouster
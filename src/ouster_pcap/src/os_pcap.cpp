@@ -6,15 +6,29 @@
 
 #include "ouster/os_pcap.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <cstring>
 #include <exception>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include <tins/tins.h>
 
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#include "ouster/trace.h"
+#include "pcap_file.h"
+#include "pcap_writer.h"
+
 using namespace Tins;
 
 namespace ouster {
@@ -27,24 +41,29 @@ struct record_handle {
     std::string src_ip;     ///< The source IP
     std::string file_name;  ///< The filename of the output pcap file
     size_t frag_size;       ///< The size of the udp data fragmentation
-    std::unique_ptr<Tins::PacketWriter>
+    std::unique_ptr<impl::PcapFileWriter>
         pcap_file_writer;  ///< Object that holds the pcap writer
-    bool use_sll_encapsulation;
-    record_handle() {}
-
-    ~record_handle() {}
+    record_stats stats;    ///< Counters of the writer once it's closed
 };
 
 struct playback_handle {
     std::string file_name;  ///< The filename of the pcap file
 
-    std::unique_ptr<Tins::FileSniffer>
-        pcap_reader;  ///< Object that holds the unified pcap reader
-    Tins::Packet packet_cache;
+    std::unique_ptr<impl::PcapFileReader>
+        pcap_reader;  ///< Object that holds the memory-mapped pcap reader
+    packet_view packet_cache;
     bool have_new_packet;
 
     Tins::IPv4Reassembler
-        reassembler;  ///< The reassembler mainly for lidar packets
+        reassembler;  ///< The reassembler, only used for fragmented packets
+    std::vector<uint8_t>
+        reassembled;  ///< Holds the payload of the last reassembled packet
+
+    // Formatted addresses of the last packet, reused while they don't change
+    std::array<uint8_t, 16> dst_addr;
+    std::array<uint8_t, 16> src_addr;
+    std::string dst_ip;
+    std::string src_ip;
 
     int encap_proto;
 
@@ -78,8 +97,9 @@ std::shared_ptr<playback_handle> replay_initialize(
         std::make_shared<playback_handle>();
 
     result->file_name = file_name;
-    result->pcap_reader.reset(new FileSniffer(file_name));
+    result->pcap_reader.reset(new impl::PcapFileReader(file_name));
     result->encap_proto = result->pcap_reader->link_type();
+    result->have_new_packet = false;
 
     return result;
 }
@@ -89,97 +109,426 @@ void replay_uninitialize(playback_handle& handle) {
 }
 
 void replay_reset(playback_handle& handle) {
-    handle.pcap_reader.reset(new FileSniffer(handle.file_name));
+    handle.pcap_reader->reset();
+    handle.reassembler.clear_streams();
+    handle.have_new_packet = false;
+}
+
+namespace {
+
+/*
+ * Feed an IPv4 fragment to the reassembler. Returns true with the payload and
+ * ports of dgram set once the last missing fragment of a datagram arrives.
+ */
+bool reassemble(playback_handle& handle, impl::udp_datagram& dgram) {
+    try {
+        IP ip(dgram.ip, static_cast<uint32_t>(dgram.ip_size));
+        if (handle.reassembler.process(ip) != IPv4Reassembler::REASSEMBLED)
+            return false;
+
+        UDP* udp = ip.find_pdu<UDP>();
+        if (udp == NULL)
+            throw std::runtime_error("Malformed Packet: No UDP Detected");
+        RawPDU* raw = ip.find_pdu<RawPDU>();
+        if (raw)
+            handle.reassembled.swap(raw->payload());
+        else
+            handle.reassembled.clear();
+
+        dgram.src_port = udp->sport();
+        dgram.dst_port = udp->dport();
+        dgram.payload = handle.reassembled.data();
+        dgram.payload_size = handle.reassembled.size();
+    } catch (const Tins::malformed_packet&) {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Format an address, reusing the previous string if it didn't change
+ */
+void format_addr(const std::array<uint8_t, 16>& addr, int ip_version,
+                 std::array<uint8_t, 16>& last_addr, std::string& last_str) {
+    if (!last_str.empty() && addr == last_addr) return;
+
+    char buf[INET6_ADDRSTRLEN];
+    const char* res =
+        ip_version == 4
+            ? inet_ntop(AF_INET, (void*)(addr.data() + 12), buf, sizeof(buf))
+            : inet_ntop(AF_INET6, (void*)addr.data(), buf, sizeof(buf));
+    last_addr = addr;
+    last_str = res ? res : "";
+}
+
+/*
+ * Count a packet in the statistics of its stream. Packets usually come in
+ * runs of the same stream, so the stream of the last packet is checked first.
+ */
+void add_stats(std::vector<udp_stream_stats>& streams, size_t& last,
+               const packet_view& view) {
+    auto same_stream = [&](const udp_stream_stats& s) {
+        return s.src_port == view.src_port && s.dst_port == view.dst_port &&
+               s.src_addr == view.src_addr && s.dst_addr == view.dst_addr;
+    };
+
+    if (last >= streams.size() || !same_stream(streams[last])) {
+        auto it = std::find_if(streams.begin(), streams.end(), same_stream);
+        last = it - streams.begin();
+        if (it == streams.end()) {
+            udp_stream_stats s{};
+            s.dst_addr = view.dst_addr;
+            s.src_addr = view.src_addr;
+            std::array<uint8_t, 16> addr;
+            format_addr(view.dst_addr, view.ip_version, addr, s.dst_ip);
+            format_addr(view.src_addr, view.ip_version, addr, s.src_ip);
+            s.dst_port = view.dst_port;
+            s.src_port = view.src_port;
+            s.ip_version = view.ip_version;
+            streams.push_back(std::move(s));
+        }
+    }
+
+    auto& s = streams[last];
+    s.count++;
+    if (std::find(s.payload_sizes.begin(), s.payload_sizes.end(),
+                  view.payload_size) == s.payload_sizes.end())
+        s.payload_sizes.push_back(view.payload_size);
+    if (std::find(s.fragments_in_packet.begin(), s.fragments_in_packet.end(),
+                  view.fragments_in_packet) == s.fragments_in_packet.end())
+        s.fragments_in_packet.push_back(view.fragments_in_packet);
+}
+
+}  // namespace
+
+bool next_packet(playback_handle& handle, packet_view& view) {
+    OUSTER_TRACE_SCOPE("pcap.next_packet");
+    impl::pcap_frame frame;
+    impl::udp_datagram dgram;
+
+    // the packet last returned by next_packet_info may be overwritten
+    handle.have_new_packet = false;
+
+    int frames_read = 0;
+    while (handle.pcap_reader->next(frame)) {
+        frames_read++;
+        const auto res = impl::parse_udp(frame, dgram);
+        if (res == impl::NOT_UDP) continue;
+        if (res == impl::FRAGMENT && !reassemble(handle, dgram)) continue;
+
+        view.dst_addr = dgram.dst_addr;
+        view.src_addr = dgram.src_addr;
+        view.dst_port = dgram.dst_port;
+        view.src_port = dgram.src_port;
+        view.payload = dgram.payload;
+        view.payload_size = dgram.payload_size;
+        view.timestamp = packet_view::ts{frame.timestamp_us};
+        view.fragments_in_packet = frames_read;
+        view.ip_version = dgram.ip_version;
+        view.encapsulation_protocol = frame.link_type;
+        return true;
+    }
+
+    return false;
 }
 
 bool next_packet_info(playback_handle& handle, packet_info& info) {
-    bool result = false;
-
-    bool reassm = false;
-    int reassm_packets = 0;
-    while (!reassm) {
-        reassm_packets++;
-        handle.packet_cache = handle.pcap_reader->next_packet();
-        if (handle.packet_cache) {
-            auto pdu = handle.packet_cache.pdu();
-            if (pdu) {
-                IP* ip = pdu->find_pdu<IP>();
-                IPv6* ipv6 = pdu->find_pdu<IPv6>();
-                // Using short circuiting here
-                if ((ip && ip->protocol() == PROTOCOL_UDP) ||
-                    (ipv6 && ipv6->next_header() == PROTOCOL_UDP)) {
-                    // reassm is also used in the while loop
-                    reassm = (handle.reassembler.process(*pdu) !=
-                              IPv4Reassembler::FRAGMENTED);
-                    if (reassm) {
-                        info.fragments_in_packet = reassm_packets;
-                        reassm_packets = 0;
-
-                        info.encapsulation_protocol = handle.encap_proto;
-                        result = true;
-                        UDP* udp = pdu->find_pdu<UDP>();
-                        auto raw = pdu->find_pdu<RawPDU>();
-                        if (ip) {
-                            info.dst_ip = ip->dst_addr().to_string();
-                            info.src_ip = ip->src_addr().to_string();
-                            info.ip_version = 4;
-                            info.network_protocol = ip->protocol();
-                        } else if (ipv6) {
-                            info.dst_ip = ipv6->dst_addr().to_string();
-                            info.src_ip = ipv6->src_addr().to_string();
-                            info.ip_version = 6;
-                            info.network_protocol = ipv6->next_header();
-                        } else {
-                            throw std::runtime_error(
-                                "Malformed packet: no IP headers");
-                        }
-                        // find_pdu<UDP> will only return NULL when the ipv4
-                        // reassembly succeeds on an ipv6 packet, leading to a
-                        // malformed packet
-                        if (udp != NULL) {
-                            info.dst_port = udp->dport();
-                            info.src_port = udp->sport();
-                            info.payload_size = raw->payload_size();
-                            info.timestamp = handle.packet_cache.timestamp();
-                            handle.have_new_packet = true;
-                        } else {
-                            throw std::runtime_error(
-                                "Malformed Packet: No UDP Detected");
-                        }
-                    }
-                }
+    handle.have_new_packet = next_packet(handle, handle.packet_cache);
+    if (!handle.have_new_packet) return false;
+
+    const packet_view& view = handle.packet_cache;
+    format_addr(view.dst_addr, view.ip_version, handle.dst_addr,
+                handle.dst_ip);
+    format_addr(view.src_addr, view.ip_version, handle.src_addr,
+                handle.src_ip);
+    info.dst_ip = handle.dst_ip;
+    info.src_ip = handle.src_ip;
+    info.dst_port = view.dst_port;
+    info.src_port = view.src_port;
+    info.payload_size = view.payload_size;
+    info.timestamp = view.timestamp;
+    info.fragments_in_packet = view.fragments_in_packet;
+    info.ip_version = view.ip_version;
+    info.encapsulation_protocol = view.encapsulation_protocol;
+    info.network_protocol = PROTOCOL_UDP;
+
+    return true;
+}
+
+size_t read_packet(playback_handle& handle, uint8_t* buf, size_t buffer_size) {
+    OUSTER_TRACE_SCOPE("pcap.read_packet");
+    if (!handle.have_new_packet) return 0;
+
+    const packet_view& view = handle.packet_cache;
+    if (view.payload_size > buffer_size) {
+        throw std::invalid_argument(
+            "Incompatible argument: expected a bytearray of "
+            "size > " +
+            std::to_string(view.payload_size));
+    }
+    handle.have_new_packet = false;
+    std::memcpy(buf, view.payload, view.payload_size);
+    return view.payload_size;
+}
+
+pcap_index build_index(const std::string& file, int lidar_port,
+                       const sensor::packet_format& pf) {
+    auto handle = replay_initialize(file);
+
+    pcap_index index;
+    index.lidar_port = lidar_port;
+    index.lidar_packet_size = pf.lidar_packet_size;
+
+    // frame id of the last packet seen in each stream
+    std::vector<uint16_t> last_frame_id;
+    size_t last_stream = 0;
+
+    packet_view view;
+    pcap_index::frame_info frame;
+    handle->pcap_reader->tell(frame.offset, frame.section_offset);
+    while (next_packet(*handle, view)) {
+        add_stats(index.udp_streams, last_stream, view);
+        if (view.dst_port == lidar_port &&
+            view.payload_size == pf.lidar_packet_size) {
+            auto it = std::find_if(index.streams.begin(), index.streams.end(),
+                                   [&](const pcap_index::stream& s) {
+                                       return s.src_addr == view.src_addr;
+                                   });
+            const size_t ind = it - index.streams.begin();
+            const uint16_t f_id = pf.frame_id(view.payload);
+            if (it == index.streams.end()) {
+                index.streams.push_back({view.src_addr, {}});
+                last_frame_id.push_back(f_id);
+            }
+
+            // like ScanBatcher, ignore reordered packets of the last frame
+            auto& frames = index.streams[ind].frames;
+            const uint16_t last = last_frame_id[ind];
+            if (frames.empty() ||
+                (f_id != last && f_id != (uint16_t)(last - 1))) {
+                frame.timestamp_us = view.timestamp.count();
+                frame.frame_id = f_id;
+                frames.push_back(frame);
+                last_frame_id[ind] = f_id;
             }
-        } else {
-            reassm = true;
         }
+        handle->pcap_reader->tell(frame.offset, frame.section_offset);
     }
+    index.file_size = handle->pcap_reader->size();
 
-    return result;
+    return index;
 }
 
-size_t read_packet(playback_handle& handle, uint8_t* buf, size_t buffer_size) {
-    size_t result = 0;
-    if (handle.have_new_packet) {
-        result = true;
-        auto pdu = handle.packet_cache.pdu();
-        auto raw = pdu->find_pdu<RawPDU>();
-        if (raw) {
-            auto temp = (uint32_t*)&(raw->payload()[0]);
-            auto size = raw->payload_size();
-            if (size > buffer_size) {
-                throw std::invalid_argument(
-                    "Incompatible argument: expected a bytearray of "
-                    "size > " +
-                    std::to_string(size));
-            } else {
-                handle.have_new_packet = false;
-                result = size;
-                memcpy(buf, temp, size);
+std::string index_path(const std::string& file) { return file + ".idx"; }
+
+namespace {
+
+constexpr char INDEX_MAGIC[8] = {'O', 'S', 'P', 'C', 'I', 'D', 'X', '2'};
+
+template <typename T>
+void write_val(std::ostream& out, T val) {
+    out.write(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+template <typename T>
+bool read_val(std::istream& in, T& val) {
+    return static_cast<bool>(
+        in.read(reinterpret_cast<char*>(&val), sizeof(T)));
+}
+
+}  // namespace
+
+bool save_index(const pcap_index& index, const std::string& index_file) {
+    // write to a temporary file so readers never see a partial index
+    const std::string tmp_file = index_file + ".tmp";
+    {
+        std::ofstream out(tmp_file, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+
+        out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        write_val<uint64_t>(out, index.file_size);
+        write_val<int32_t>(out, index.lidar_port);
+        write_val<uint64_t>(out, index.lidar_packet_size);
+        write_val<uint64_t>(out, index.streams.size());
+        for (const auto& stream : index.streams) {
+            out.write(reinterpret_cast<const char*>(stream.src_addr.data()),
+                      stream.src_addr.size());
+            write_val<uint64_t>(out, stream.frames.size());
+            for (const auto& f : stream.frames) {
+                write_val<uint64_t>(out, f.offset);
+                write_val<uint64_t>(out, f.section_offset);
+                write_val<uint64_t>(out, f.timestamp_us);
+                write_val<uint16_t>(out, f.frame_id);
             }
         }
+        write_val<uint64_t>(out, index.udp_streams.size());
+        for (const auto& s : index.udp_streams) {
+            out.write(reinterpret_cast<const char*>(s.dst_addr.data()),
+                      s.dst_addr.size());
+            out.write(reinterpret_cast<const char*>(s.src_addr.data()),
+                      s.src_addr.size());
+            write_val<int32_t>(out, s.dst_port);
+            write_val<int32_t>(out, s.src_port);
+            write_val<int32_t>(out, s.ip_version);
+            write_val<uint64_t>(out, s.count);
+            write_val<uint64_t>(out, s.payload_sizes.size());
+            for (size_t size : s.payload_sizes) write_val<uint64_t>(out, size);
+            write_val<uint64_t>(out, s.fragments_in_packet.size());
+            for (int n : s.fragments_in_packet) write_val<int32_t>(out, n);
+        }
+        if (!out.flush()) {
+            out.close();
+            std::remove(tmp_file.c_str());
+            return false;
+        }
     }
 
-    return result;
+    // rename doesn't replace existing files on windows
+    std::remove(index_file.c_str());
+    if (std::rename(tmp_file.c_str(), index_file.c_str()) != 0) {
+        std::remove(tmp_file.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool load_index(const std::string& index_file, pcap_index& index) {
+    std::ifstream in(index_file, std::ios::binary);
+    if (!in) return false;
+
+    char magic[sizeof(INDEX_MAGIC)];
+    if (!in.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0)
+        return false;
+
+    pcap_index result;
+    int32_t port;
+    uint64_t packet_size, n_streams;
+    if (!read_val(in, result.file_size) || !read_val(in, port) ||
+        !read_val(in, packet_size) || !read_val(in, n_streams))
+        return false;
+    result.lidar_port = port;
+    result.lidar_packet_size = packet_size;
+
+    for (uint64_t i = 0; i < n_streams; i++) {
+        pcap_index::stream stream;
+        uint64_t n_frames;
+        if (!in.read(reinterpret_cast<char*>(stream.src_addr.data()),
+                     stream.src_addr.size()) ||
+            !read_val(in, n_frames))
+            return false;
+
+        // frames are added as read so a bad count can't exhaust memory
+        for (uint64_t j = 0; j < n_frames; j++) {
+            pcap_index::frame_info f;
+            if (!read_val(in, f.offset) || !read_val(in, f.section_offset) ||
+                !read_val(in, f.timestamp_us) || !read_val(in, f.frame_id))
+                return false;
+            stream.frames.push_back(f);
+        }
+        result.streams.push_back(std::move(stream));
+    }
+
+    uint64_t n_udp_streams;
+    if (!read_val(in, n_udp_streams)) return false;
+    for (uint64_t i = 0; i < n_udp_streams; i++) {
+        udp_stream_stats s;
+        int32_t dst_port, src_port, ip_version;
+        uint64_t n_sizes, n_fragments;
+        if (!in.read(reinterpret_cast<char*>(s.dst_addr.data()),
+                     s.dst_addr.size()) ||
+            !in.read(reinterpret_cast<char*>(s.src_addr.data()),
+                     s.src_addr.size()) ||
+            !read_val(in, dst_port) || !read_val(in, src_port) ||
+            !read_val(in, ip_version) || !read_val(in, s.count) ||
+            !read_val(in, n_sizes))
+            return false;
+        s.dst_port = dst_port;
+        s.src_port = src_port;
+        s.ip_version = ip_version;
+        for (uint64_t j = 0; j < n_sizes; j++) {
+            uint64_t size;
+            if (!read_val(in, size)) return false;
+            s.payload_sizes.push_back(size);
+        }
+        if (!read_val(in, n_fragments)) return false;
+        for (uint64_t j = 0; j < n_fragments; j++) {
+            int32_t n;
+            if (!read_val(in, n)) return false;
+            s.fragments_in_packet.push_back(n);
+        }
+
+        std::array<uint8_t, 16> addr;
+        format_addr(s.dst_addr, s.ip_version, addr, s.dst_ip);
+        format_addr(s.src_addr, s.ip_version, addr, s.src_ip);
+        result.udp_streams.push_back(std::move(s));
+    }
+
+    index = std::move(result);
+    return true;
+}
+
+pcap_index get_index(const std::string& file, int lidar_port,
+                     const sensor::packet_format& pf) {
+    const uint64_t file_size = impl::PcapFileReader(file).size();
+
+    pcap_index index;
+    const std::string idx_file = index_path(file);
+    if (load_index(idx_file, index) && index.file_size == file_size &&
+        index.lidar_port == lidar_port &&
+        index.lidar_packet_size == pf.lidar_packet_size)
+        return index;
+
+    index = build_index(file, lidar_port, pf);
+    save_index(index, idx_file);
+    return index;
+}
+
+std::vector<udp_stream_stats> get_stream_stats(const std::string& file,
+                                               size_t max_packets) {
+    auto handle = replay_initialize(file);
+
+    pcap_index index;
+    if (load_index(index_path(file), index) &&
+        index.file_size == handle->pcap_reader->size())
+        return index.udp_streams;
+
+    std::vector<udp_stream_stats> streams;
+    size_t last_stream = 0;
+    packet_view view;
+    for (size_t n = 0;
+         (max_packets == 0 || n < max_packets) && next_packet(*handle, view);
+         n++)
+        add_stats(streams, last_stream, view);
+
+    return streams;
+}
+
+namespace {
+
+bool seek_frame(playback_handle& handle, const pcap_index::frame_info& f) {
+    if (!handle.pcap_reader->seek(f.offset, f.section_offset)) return false;
+    handle.reassembler.clear_streams();
+    handle.have_new_packet = false;
+    return true;
+}
+
+}  // namespace
+
+bool replay_seek(playback_handle& handle, const pcap_index::stream& stream,
+                 size_t frame) {
+    if (frame >= stream.frames.size()) return false;
+    return seek_frame(handle, stream.frames[frame]);
+}
+
+bool replay_seek(playback_handle& handle, const pcap_index::stream& stream,
+                 std::chrono::microseconds timestamp) {
+    const uint64_t ts = timestamp.count();
+    auto it = std::lower_bound(stream.frames.begin(), stream.frames.end(), ts,
+                               [](const pcap_index::frame_info& f,
+                                  uint64_t t) { return f.timestamp_us < t; });
+    if (it == stream.frames.end()) return false;
+    return seek_frame(handle, *it);
 }
 
 std::shared_ptr<record_handle> record_initialize(const std::string& file_name,
@@ -187,175 +536,74 @@ std::shared_ptr<record_handle> record_initialize(const std::string& file_name,
                                                  const std::string& dst_ip,
                                                  int frag_size,
                                                  bool use_sll_encapsulation) {
-    std::shared_ptr<record_handle> result = std::make_shared<record_handle>();
-
-    result->file_name = file_name;
-    result->frag_size = frag_size;
+    auto result =
+        record_initialize(file_name, frag_size, use_sll_encapsulation, {});
     result->src_ip = src_ip;
     result->dst_ip = dst_ip;
-    result->use_sll_encapsulation = use_sll_encapsulation;
-    if (use_sll_encapsulation) {
-        result->pcap_file_writer.reset(
-            new PacketWriter(file_name, DataLinkType<SLL>()));
-    } else {
-        result->pcap_file_writer.reset(
-            new PacketWriter(file_name, DataLinkType<EthernetII>()));
-    }
     return result;
 }
 
 std::shared_ptr<record_handle> record_initialize(const std::string& file_name,
                                                  int frag_size,
                                                  bool use_sll_encapsulation) {
-    return record_initialize(file_name, "", "", frag_size,
-                             use_sll_encapsulation);
-}
-
-void record_uninitialize(record_handle& handle) {
-    if (handle.pcap_file_writer) handle.pcap_file_writer.reset();
+    return record_initialize(file_name, frag_size, use_sll_encapsulation, {});
 }
 
-/*
- * This was a tricky problem, due to how the ip stack is set up.
- *
- * SLL Container -> ipv4 container -> udp container -> raw data
- *
- * The ipv4 container is what does the packet fragmentation and reassembly.
- * With each full packet we need the ipv4 reassembly to contain only one udp
-header.
-* Due to this, we have to only create one official Tins::UDP packet.
-* We grab the packet id from this packet
-* Every packet after the first Tins::UDP packet needs to just be a ipv4
-* container with a manually set packet type of UDP(dec 17)
-* Every packet but the final packet needs to have the current flag set:
-*
-* pkt.flags(IP::MORE_FRAGMENTS);
-*
-*/
-
-// SLL is the linux pcap capture container
-std::vector<IP> buffer_to_frag_packets(record_handle& handle,
-                                       const std::string& src_ip,
-                                       const std::string& dst_ip, int src_port,
-                                       int dst_port, const uint8_t* buf,
-                                       size_t buf_size) {
-    std::vector<IP> result;
-
-    int id = -1;   ///< This variable is used to track the packet id,
-                   ///< if -1 then create a packet and grab its id
-    size_t i = 0;  ///< Loop variable that contains current bytes processed
-    size_t offset_modifier =
-        0;  ///< This variable contains the offset to account
-            ///< for the udp packet with the fragment_offset
-
-    while (i < buf_size) {
-        // First create the ipv4 packet
-        IP pkt = IP(dst_ip, src_ip);
-
-        // Now figure out the size of the packet payload
-        size_t size = std::min(handle.frag_size, (buf_size - i));
-
-        // Correctly set this packets fragment offset
-        // NOTE: for some reason this has to be divided by 8
-        // NOTE: Reference here
-        // http://libtins.github.io/docs/latest/dd/d3f/classTins_1_1IP.html#a32a6bf84af274748317ef61ce1a91ce5
-        pkt.fragment_offset((i + offset_modifier) / 8);
-
-        // If this is the first packet
-        if (i == 0) {
-            // Fully create the libtins udp structure
-            auto udp = UDP(dst_port, src_port);
-
-            if ((size + udp.header_size()) > handle.frag_size) {
-                // Due to the udp header being included in the payload,
-                // we need to subtract its size from the payload
-                size -= udp.header_size();
-                // Set the "There is more data to follow" flag
-                pkt.flags(IP::MORE_FRAGMENTS);
-            }
-
-            // Pack what we can minus the udp header size into the payload
-            pkt /= udp / RawPDU((uint8_t*)(buf + i), size);
-
-            // Manually set the ipv4 protocol to UDP
-            pkt.protocol(PROTOCOL_UDP);
-
-            // Set the fragment_offset offset with the size of the udp header
-            offset_modifier = udp.header_size();
-        }
-        // This is a packet in the middle or end
-        else {
-            // Set the "There is more data to follow" flag
-            if (i + size < buf_size) pkt.flags(IP::MORE_FRAGMENTS);
-
-            // Manually set the ipv4 protocol to UDP
-            pkt.protocol(PROTOCOL_UDP);
-
-            // Pack what we can into the payload
-            pkt /= RawPDU((uint8_t*)(buf + i), size);
-        }
-
-        // Here is where we correctly set the packet id
-        if (id < 0) {
-            // If this is the first packet, set id to the generated packet id
-            id = pkt.id();
-        } else {
-            // If this is a following packet, use the first packets id
-            pkt.id(id);
-        }
+std::shared_ptr<record_handle> record_initialize(
+    const std::string& file_name, int frag_size, bool use_sll_encapsulation,
+    const record_options& options) {
+    if (frag_size <= 0)
+        throw std::invalid_argument("Invalid fragment size for recording");
 
-        // Add the resulting packet to the vector
-        result.push_back(pkt);
+    std::shared_ptr<record_handle> result = std::make_shared<record_handle>();
+    result->file_name = file_name;
+    result->frag_size = frag_size;
+    result->stats = {};
+    result->pcap_file_writer.reset(
+        new impl::PcapFileWriter(file_name, use_sll_encapsulation, options));
+    return result;
+}
 
-        // Increment the current byte being processed
-        i += size;
+void record_uninitialize(record_handle& handle) {
+    if (!handle.pcap_file_writer) return;
+    // keep counters and drop the writer even if the last write fails
+    std::unique_ptr<impl::PcapFileWriter> writer =
+        std::move(handle.pcap_file_writer);
+    try {
+        writer->close();
+    } catch (...) {
+        handle.stats = writer->stats();
+        throw;
     }
+    handle.stats = writer->stats();
+}
 
-    return result;
+record_stats get_record_stats(record_handle& handle) {
+    if (handle.pcap_file_writer) return handle.pcap_file_writer->stats();
+    return handle.stats;
 }
 
-void record_packet(record_handle& handle, int src_port, int dst_port,
+bool record_packet(record_handle& handle, int src_port, int dst_port,
                    const uint8_t* buf, size_t buffer_size,
                    uint64_t microsecond_timestamp) {
-    record_packet(handle, handle.src_ip, handle.dst_ip, src_port, dst_port, buf,
-                  buffer_size, microsecond_timestamp);
+    return record_packet(handle, handle.src_ip, handle.dst_ip, src_port,
+                         dst_port, buf, buffer_size, microsecond_timestamp);
 }
 
-void record_packet(record_handle& handle, const std::string& src_ip,
+bool record_packet(record_handle& handle, const std::string& src_ip,
                    const std::string& dst_ip, int src_port, int dst_port,
                    const uint8_t* buf, size_t buffer_size,
                    uint64_t microsecond_timestamp) {
+    OUSTER_TRACE_SCOPE("pcap.record_packet");
     // ensure IPs were provided
     if (dst_ip.empty() || src_ip.empty()) {
         throw std::invalid_argument("Invalid addresses provided for packet");
     }
-    // For each of the packets write it to the pcap file
-    for (auto item : buffer_to_frag_packets(handle, src_ip, dst_ip, src_port,
-                                            dst_port, buf, buffer_size)) {
-        Packet packet;
-        PDU* pdu;
-        if (handle.use_sll_encapsulation) {
-            pdu = new SLL();
-        } else {
-            pdu = new EthernetII();
-        }
-        *pdu /= item;
-        // Nasty libtins bug that causes write to fail
-        // https://www.gitmemory.com/issue/mfontanini/libtins/348/488141933
-        auto _ = pdu->serialize();
-        /*
-         * The next block is due to the fact that the previous serialize does
-         * not treat the udp packet as if it were decodable. Manually tell
-         * libtins to go in and serialize the udp packet as well
-         */
-        if (pdu->inner_pdu()->inner_pdu()->inner_pdu() != NULL) {
-            _ = pdu->inner_pdu()->inner_pdu()->inner_pdu()->serialize();
-        }
-        packet = Packet(
-            *pdu, Timestamp(std::chrono::microseconds{microsecond_timestamp}));
-        handle.pcap_file_writer->write(packet);
-        delete pdu;
-    }
+    if (!handle.pcap_file_writer)
+        throw std::runtime_error("Record handle is uninitialized");
+    return handle.pcap_file_writer->write_udp(
+        src_ip, dst_ip, src_port, dst_port, handle.frag_size, buf,
+        buffer_size, microsecond_timestamp);
 }
 
 }  // namespace sensor_utils
@@ -0,0 +1,218 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/pcap_demux.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "ouster/os_pcap.h"
+
+namespace ouster {
+namespace sensor_utils {
+
+namespace {
+
+struct Sensor {
+    sensor::sensor_info info;
+    const sensor::packet_format* pf;
+    LidarScan prototype;
+    int lidar_port;
+};
+
+struct StreamState {
+    std::unique_ptr<ScanBatcher> batcher;
+    LidarScan ls;
+};
+
+}  // namespace
+
+struct PcapDemux::Impl {
+    const bool complete;
+    std::vector<Sensor> sensors;
+    std::shared_ptr<playback_handle> handle;
+
+    std::vector<stream> streams;
+    std::vector<StreamState> states;
+    size_t last_stream{0};
+
+    bool eof{false};
+    size_t flushed{0};  // streams whose last scan was returned after eof
+
+    Impl(const std::string& file, const std::vector<sensor::sensor_info>& infos,
+         const std::vector<LidarScan>& prototypes, bool complete_,
+         const std::vector<int>& lidar_ports)
+        : complete(complete_) {
+        if (prototypes.size() != infos.size())
+            throw std::invalid_argument("Expected a prototype for each sensor");
+        if (!lidar_ports.empty() && lidar_ports.size() != infos.size())
+            throw std::invalid_argument(
+                "Expected a lidar port for each sensor");
+
+        for (size_t i = 0; i < infos.size(); i++) {
+            const auto& p = prototypes[i];
+            const int port =
+                lidar_ports.empty() ? infos[i].udp_port_lidar : lidar_ports[i];
+            sensors.push_back({infos[i], &sensor::get_format(infos[i]),
+                               LidarScan(p.w, p.h, p.begin(), p.end()), port});
+        }
+
+        handle = replay_initialize(file);
+    }
+
+    ~Impl() {
+        if (handle) replay_uninitialize(*handle);
+    }
+
+    LidarScan new_scan(const Sensor& s) const {
+        const auto& p = s.prototype;
+        LidarScan ls(p.w, p.h, p.begin(), p.end());
+        ls.frame_id = -1;
+        return ls;
+    }
+
+    bool matches_prototype(const LidarScan& ls, const Sensor& s) const {
+        const auto& p = s.prototype;
+        return ls.w == p.w && ls.h == p.h &&
+               std::equal(ls.begin(), ls.end(), p.begin(), p.end());
+    }
+
+    // find the stream of a lidar packet, starting a new one if needed
+    bool route(const packet_view& view, size_t& ind) {
+        auto same_stream = [&](const stream& s) {
+            return s.dst_port == view.dst_port && s.src_addr == view.src_addr;
+        };
+
+        if (last_stream >= streams.size() ||
+            !same_stream(streams[last_stream])) {
+            auto it = std::find_if(streams.begin(), streams.end(), same_stream);
+            if (it == streams.end()) {
+                // assign a new source to the first sensor it matches
+                auto s = std::find_if(
+                    sensors.begin(), sensors.end(), [&](const Sensor& s) {
+                        if (s.lidar_port == 0 ||
+                            s.lidar_port != view.dst_port ||
+                            s.pf->lidar_packet_size != view.payload_size)
+                            return false;
+                        const auto init_id = s.pf->init_id(view.payload);
+                        return !init_id || init_id == s.info.init_id;
+                    });
+                if (s == sensors.end()) return false;
+
+                streams.push_back({static_cast<size_t>(s - sensors.begin()),
+                                   view.src_addr, view.dst_port});
+                states.push_back(
+                    {std::unique_ptr<ScanBatcher>(new ScanBatcher(s->info)),
+                     new_scan(*s)});
+                it = streams.end() - 1;
+            }
+            last_stream = it - streams.begin();
+        }
+
+        ind = last_stream;
+        const Sensor& s = sensors[streams[ind].sensor];
+        return view.payload_size == s.pf->lidar_packet_size;
+    }
+
+    bool keep(const LidarScan& ls, const Sensor& s) const {
+        return !complete || ls.complete(s.info.format.column_window);
+    }
+
+    bool next(LidarScan& scan, size_t& stream_index) {
+        packet_view view;
+        while (!eof) {
+            if (!next_packet(*handle, view)) {
+                eof = true;
+                break;
+            }
+
+            size_t ind;
+            if (!route(view, ind)) continue;
+
+            // batch with capture timestamps, as for live data
+            auto& st = states[ind];
+            const uint64_t rx_ts = view.timestamp.count() * 1000;
+            if (!(*st.batcher)(view.payload, st.ls, rx_ts)) continue;
+
+            const Sensor& s = sensors[streams[ind].sensor];
+            if (!keep(st.ls, s)) continue;
+
+            // hand out the finished scan, batching into the caller's if we can
+            if (matches_prototype(scan, s))
+                std::swap(scan, st.ls);
+            else
+                scan = std::exchange(st.ls, new_scan(s));
+            st.ls.frame_id = -1;
+            stream_index = ind;
+            return true;
+        }
+
+        // the last frame of each stream doesn't end with a packet of the next
+        while (flushed < states.size()) {
+            const size_t ind = flushed++;
+            auto& ls = states[ind].ls;
+            if (ls.frame_id == -1 || !keep(ls, sensors[streams[ind].sensor]))
+                continue;
+            scan = std::move(ls);
+            stream_index = ind;
+            return true;
+        }
+
+        return false;
+    }
+
+    void reset() {
+        replay_reset(*handle);
+        for (size_t i = 0; i < states.size(); i++) {
+            const Sensor& s = sensors[streams[i].sensor];
+            states[i].batcher.reset(new ScanBatcher(s.info));
+            states[i].ls = new_scan(s);
+        }
+        eof = false;
+        flushed = 0;
+    }
+};
+
+namespace {
+
+std::vector<LidarScan> default_prototypes(
+    const std::vector<sensor::sensor_info>& infos) {
+    std::vector<LidarScan> prototypes;
+    for (const auto& info : infos)
+        prototypes.emplace_back(info.format.columns_per_frame,
+                                info.format.pixels_per_column,
+                                info.format.udp_profile_lidar);
+    return prototypes;
+}
+
+}  // namespace
+
+PcapDemux::PcapDemux(const std::string& file,
+                     const std::vector<sensor::sensor_info>& infos,
+                     bool complete, const std::vector<int>& lidar_ports)
+    : PcapDemux(file, infos, default_prototypes(infos), complete,
+                lidar_ports) {}
+
+PcapDemux::PcapDemux(const std::string& file,
+                     const std::vector<sensor::sensor_info>& infos,
+                     const std::vector<LidarScan>& prototypes, bool complete,
+                     const std::vector<int>& lidar_ports)
+    : impl_(new Impl(file, infos, prototypes, complete, lidar_ports)) {}
+
+PcapDemux::~PcapDemux() = default;
+
+bool PcapDemux::next(LidarScan& scan, size_t& stream_index) {
+    return impl_->next(scan, stream_index);
+}
+
+const std::vector<PcapDemux::stream>& PcapDemux::streams() const {
+    return impl_->streams;
+}
+
+void PcapDemux::reset() { impl_->reset(); }
+
+}  // namespace sensor_utils
+}  // namespace ouster
@@ -0,0 +1,479 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "pcap_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ouster {
+namespace sensor_utils {
+namespace impl {
+
+namespace {
+
+constexpr uint32_t PCAP_MAGIC_US = 0xa1b2c3d4;
+constexpr uint32_t PCAP_MAGIC_NS = 0xa1b23c4d;
+constexpr size_t PCAP_HEADER_SIZE = 24;
+constexpr size_t PCAP_RECORD_SIZE = 16;
+
+constexpr uint32_t NG_SECTION_HEADER = 0x0a0d0d0a;
+constexpr uint32_t NG_BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+constexpr uint32_t NG_INTERFACE_DESCRIPTION = 1;
+constexpr uint32_t NG_PACKET = 2;
+constexpr uint32_t NG_SIMPLE_PACKET = 3;
+constexpr uint32_t NG_ENHANCED_PACKET = 6;
+constexpr uint16_t NG_OPT_END = 0;
+constexpr uint16_t NG_OPT_IF_TSRESOL = 9;
+
+constexpr int LINKTYPE_NULL = 0;
+constexpr int LINKTYPE_ETHERNET = 1;
+constexpr int LINKTYPE_RAW_OPENBSD = 12;
+constexpr int LINKTYPE_RAW = 101;
+constexpr int LINKTYPE_LINUX_SLL = 113;
+constexpr int LINKTYPE_IPV4 = 228;
+constexpr int LINKTYPE_IPV6 = 229;
+constexpr int LINKTYPE_LINUX_SLL2 = 276;
+
+constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+constexpr uint16_t ETHERTYPE_IPV6 = 0x86dd;
+constexpr uint16_t ETHERTYPE_VLAN = 0x8100;
+constexpr uint16_t ETHERTYPE_QINQ = 0x88a8;
+
+constexpr uint8_t PROTOCOL_UDP = 17;
+constexpr size_t UDP_HEADER_SIZE = 8;
+constexpr size_t IPV6_HEADER_SIZE = 40;
+
+uint16_t be16(const uint8_t* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+
+uint32_t swap32(uint32_t v) {
+    return ((v & 0xff) << 24) | ((v & 0xff00) << 8) | ((v >> 8) & 0xff00) |
+           (v >> 24);
+}
+
+uint32_t load32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+void v4_mapped(const uint8_t* addr, std::array<uint8_t, 16>& out) {
+    out.fill(0);
+    out[10] = 0xff;
+    out[11] = 0xff;
+    std::memcpy(out.data() + 12, addr, 4);
+}
+
+/*
+ * Find the start of the IP header in a frame, or return nullptr
+ */
+const uint8_t* find_ip(const pcap_frame& frame, size_t& len) {
+    const uint8_t* p = frame.data;
+    len = frame.size;
+
+    uint16_t ethertype = 0;
+    switch (frame.link_type) {
+        case LINKTYPE_ETHERNET: {
+            if (len < 14) return nullptr;
+            ethertype = be16(p + 12);
+            size_t hdr = 14;
+            while ((ethertype == ETHERTYPE_VLAN ||
+                    ethertype == ETHERTYPE_QINQ) &&
+                   len >= hdr + 4) {
+                ethertype = be16(p + hdr + 2);
+                hdr += 4;
+            }
+            p += hdr;
+            len -= hdr;
+            break;
+        }
+        case LINKTYPE_LINUX_SLL:
+            if (len < 16) return nullptr;
+            ethertype = be16(p + 14);
+            p += 16;
+            len -= 16;
+            break;
+        case LINKTYPE_LINUX_SLL2:
+            if (len < 20) return nullptr;
+            ethertype = be16(p);
+            p += 20;
+            len -= 20;
+            break;
+        case LINKTYPE_NULL: {
+            // address family in the byte order of the capturing host
+            if (len < 4) return nullptr;
+            uint32_t family = load32(p);
+            if (family > 0xffff) family = swap32(family);
+            if (family == 2)
+                ethertype = ETHERTYPE_IPV4;
+            else if (family == 24 || family == 28 || family == 30)
+                ethertype = ETHERTYPE_IPV6;
+            p += 4;
+            len -= 4;
+            break;
+        }
+        case LINKTYPE_RAW:
+        case LINKTYPE_RAW_OPENBSD:
+        case LINKTYPE_IPV4:
+        case LINKTYPE_IPV6:
+            if (len < 1) return nullptr;
+            ethertype = (p[0] >> 4) == 6 ? ETHERTYPE_IPV6 : ETHERTYPE_IPV4;
+            break;
+        default:
+            return nullptr;
+    }
+
+    if (ethertype != ETHERTYPE_IPV4 && ethertype != ETHERTYPE_IPV6)
+        return nullptr;
+    return p;
+}
+
+}  // namespace
+
+parse_result parse_udp(const pcap_frame& frame, udp_datagram& dgram) {
+    size_t len = 0;
+    const uint8_t* ip = find_ip(frame, len);
+    if (!ip || len < 1) return NOT_UDP;
+
+    const uint8_t* udp = nullptr;
+    size_t udp_len = 0;
+    const int version = ip[0] >> 4;
+    if (version == 4) {
+        const size_t ihl = (ip[0] & 0x0f) * 4;
+        if (ihl < 20 || len < ihl || ip[9] != PROTOCOL_UDP) return NOT_UDP;
+
+        // ignore link layer padding
+        const size_t total = std::min<size_t>(be16(ip + 2), len);
+        if (total < ihl) return NOT_UDP;
+
+        dgram.ip = ip;
+        dgram.ip_size = total;
+        dgram.ip_version = version;
+        v4_mapped(ip + 12, dgram.src_addr);
+        v4_mapped(ip + 16, dgram.dst_addr);
+
+        // more fragments flag or nonzero offset
+        if (be16(ip + 6) & 0x3fff) return FRAGMENT;
+
+        udp = ip + ihl;
+        udp_len = total - ihl;
+    } else if (version == 6) {
+        // extension headers are not supported
+        if (len < IPV6_HEADER_SIZE || ip[6] != PROTOCOL_UDP) return NOT_UDP;
+
+        const size_t total =
+            std::min<size_t>(IPV6_HEADER_SIZE + be16(ip + 4), len);
+        dgram.ip = ip;
+        dgram.ip_size = total;
+        dgram.ip_version = version;
+        std::memcpy(dgram.src_addr.data(), ip + 8, 16);
+        std::memcpy(dgram.dst_addr.data(), ip + 24, 16);
+        udp = ip + IPV6_HEADER_SIZE;
+        udp_len = total - IPV6_HEADER_SIZE;
+    } else {
+        return NOT_UDP;
+    }
+
+    if (udp_len < UDP_HEADER_SIZE) return NOT_UDP;
+    dgram.src_port = be16(udp);
+    dgram.dst_port = be16(udp + 2);
+    dgram.payload = udp + UDP_HEADER_SIZE;
+    dgram.payload_size = udp_len - UDP_HEADER_SIZE;
+    return UDP;
+}
+
+PcapFileReader::PcapFileReader(const std::string& file) {
+#ifdef _WIN32
+    HANDLE fh = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                            nullptr);
+    if (fh == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Failed to open pcap file: " + file);
+    LARGE_INTEGER fsize;
+    if (!GetFileSizeEx(fh, &fsize)) fsize.QuadPart = 0;
+    size_ = (size_t)fsize.QuadPart;
+    if (size_ > 0) {
+        HANDLE mh =
+            CreateFileMappingA(fh, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mh) {
+            map_ = (const uint8_t*)MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mh);
+        }
+    }
+    CloseHandle(fh);
+#else
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Failed to open pcap file: " + file);
+    struct stat st;
+    size_ = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+    if (size_ > 0) {
+        void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, size_, MADV_SEQUENTIAL);
+            map_ = (const uint8_t*)map;
+        }
+    }
+    close(fd);
+#endif
+    if (!map_ && size_ > 0)
+        throw std::runtime_error("Failed to map pcap file: " + file);
+
+    try {
+        read_file_header(file);
+    } catch (...) {
+        unmap();
+        throw;
+    }
+}
+
+void PcapFileReader::read_file_header(const std::string& file) {
+    if (size_ < 4) throw std::runtime_error("Not a pcap file: " + file);
+
+    const uint32_t magic = load32(map_);
+    if (magic == NG_SECTION_HEADER) {
+        ng_ = true;
+        if (!read_section_header())
+            throw std::runtime_error("Bad pcapng section header: " + file);
+
+        // look ahead for the first interface to report its link type
+        for (size_t off = offset_; size_ - off >= 12;) {
+            const uint32_t blk_len = get32(map_ + off + 4);
+            if (blk_len < 12 || size_ - off < blk_len) break;
+            if (get32(map_ + off) == NG_INTERFACE_DESCRIPTION &&
+                blk_len >= 20) {
+                link_type_ = get16(map_ + off + 8);
+                break;
+            }
+            off += blk_len;
+        }
+    } else {
+        if (magic == swap32(PCAP_MAGIC_US) || magic == swap32(PCAP_MAGIC_NS))
+            swapped_ = true;
+        else if (magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS)
+            throw std::runtime_error("Not a pcap file: " + file);
+        if (size_ < PCAP_HEADER_SIZE)
+            throw std::runtime_error("Truncated pcap header: " + file);
+
+        ts_nsec_ = get32(map_) == PCAP_MAGIC_NS;
+        const uint32_t snap_len = get32(map_ + 16);
+        link_type_ = (int)(get32(map_ + 20) & 0xffff);
+        interfaces_.push_back({link_type_, snap_len, false, 6});
+        offset_ = PCAP_HEADER_SIZE;
+    }
+}
+
+PcapFileReader::~PcapFileReader() { unmap(); }
+
+void PcapFileReader::unmap() {
+    if (!map_) return;
+#ifdef _WIN32
+    UnmapViewOfFile(map_);
+#else
+    munmap(const_cast<uint8_t*>(map_), size_);
+#endif
+    map_ = nullptr;
+}
+
+int PcapFileReader::link_type() const { return link_type_; }
+
+void PcapFileReader::reset() {
+    if (ng_) {
+        offset_ = 0;
+        read_section_header();
+    } else {
+        offset_ = PCAP_HEADER_SIZE;
+    }
+}
+
+void PcapFileReader::tell(uint64_t& offset, uint64_t& section_offset) const {
+    offset = offset_;
+    section_offset = ng_ ? section_offset_ : 0;
+}
+
+bool PcapFileReader::seek(uint64_t offset, uint64_t section_offset) {
+    if (!ng_) {
+        if (offset < PCAP_HEADER_SIZE || offset > size_) return false;
+        offset_ = offset;
+        return true;
+    }
+
+    if (section_offset > offset || offset > size_) return false;
+    offset_ = section_offset;
+    if (size_ - offset_ < 12 || get32(map_ + offset_) != NG_SECTION_HEADER ||
+        !read_section_header())
+        return false;
+
+    // pick up the interface descriptions following the section header
+    while (offset_ < offset && size_ - offset_ >= 12 &&
+           get32(map_ + offset_) == NG_INTERFACE_DESCRIPTION) {
+        const uint32_t blk_len = get32(map_ + offset_ + 4);
+        if (blk_len < 12 || blk_len % 4 || size_ - offset_ < blk_len) break;
+        read_interface(map_ + offset_ + 8, blk_len - 12);
+        offset_ += blk_len;
+    }
+    offset_ = offset;
+    return true;
+}
+
+bool PcapFileReader::next(pcap_frame& frame) {
+    return ng_ ? next_ng(frame) : next_classic(frame);
+}
+
+uint16_t PcapFileReader::get16(const uint8_t* p) const {
+    uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return swapped_ ? (uint16_t)((v >> 8) | (v << 8)) : v;
+}
+
+uint32_t PcapFileReader::get32(const uint8_t* p) const {
+    const uint32_t v = load32(p);
+    return swapped_ ? swap32(v) : v;
+}
+
+bool PcapFileReader::next_classic(pcap_frame& frame) {
+    if (size_ - offset_ < PCAP_RECORD_SIZE) return false;
+    const uint8_t* rec = map_ + offset_;
+    const uint32_t ts_sec = get32(rec);
+    const uint32_t ts_frac = get32(rec + 4);
+    const uint32_t incl_len = get32(rec + 8);
+    if (size_ - offset_ - PCAP_RECORD_SIZE < incl_len) return false;
+
+    frame.data = rec + PCAP_RECORD_SIZE;
+    frame.size = incl_len;
+    frame.link_type = interfaces_.front().link_type;
+    frame.timestamp_us =
+        ts_sec * 1000000ULL + (ts_nsec_ ? ts_frac / 1000 : ts_frac);
+    offset_ += PCAP_RECORD_SIZE + incl_len;
+    return true;
+}
+
+/*
+ * Read the section header block at offset_, which sets the byte order and
+ * starts a new list of interfaces
+ */
+bool PcapFileReader::read_section_header() {
+    if (size_ - offset_ < 28) return false;
+    const uint8_t* blk = map_ + offset_;
+    const uint32_t order = load32(blk + 8);
+    if (order == NG_BYTE_ORDER_MAGIC)
+        swapped_ = false;
+    else if (order == swap32(NG_BYTE_ORDER_MAGIC))
+        swapped_ = true;
+    else
+        return false;
+
+    const uint32_t blk_len = get32(blk + 4);
+    if (blk_len < 28 || blk_len % 4 || size_ - offset_ < blk_len) return false;
+    interfaces_.clear();
+    section_offset_ = offset_;
+    offset_ += blk_len;
+    return true;
+}
+
+void PcapFileReader::read_interface(const uint8_t* body, size_t len) {
+    if (len < 8) return;
+    interface iface{get16(body), get32(body + 4), false, 6};
+
+    const uint8_t* opt = body + 8;
+    const uint8_t* end = body + len;
+    while (end - opt >= 4) {
+        const uint16_t code = get16(opt);
+        const uint16_t opt_len = get16(opt + 2);
+        if (code == NG_OPT_END || end - opt - 4 < opt_len) break;
+        if (code == NG_OPT_IF_TSRESOL && opt_len >= 1) {
+            iface.ts_pow2 = opt[4] & 0x80;
+            iface.ts_exp = opt[4] & 0x7f;
+        }
+        opt += 4 + ((opt_len + 3) & ~3u);
+    }
+    interfaces_.push_back(iface);
+}
+
+uint64_t PcapFileReader::ng_timestamp_us(const interface& iface,
+                                         uint64_t ts) const {
+    if (iface.ts_pow2) {
+        if (iface.ts_exp >= 64) return 0;
+        const uint64_t mask = (1ULL << iface.ts_exp) - 1;
+        return (ts >> iface.ts_exp) * 1000000ULL +
+               (((ts & mask) * 1000000ULL) >> iface.ts_exp);
+    }
+    uint64_t scale = 1;
+    if (iface.ts_exp >= 6) {
+        // 10^20 doesn't fit in 64 bits
+        if (iface.ts_exp - 6 > 19) return 0;
+        for (int i = 6; i < iface.ts_exp; i++) scale *= 10;
+        return ts / scale;
+    }
+    for (int i = iface.ts_exp; i < 6; i++) scale *= 10;
+    return ts * scale;
+}
+
+bool PcapFileReader::next_ng(pcap_frame& frame) {
+    while (size_ - offset_ >= 12) {
+        const uint8_t* blk = map_ + offset_;
+        const uint32_t type = get32(blk);
+
+        if (type == NG_SECTION_HEADER) {
+            if (!read_section_header()) return false;
+            continue;
+        }
+
+        const uint32_t blk_len = get32(blk + 4);
+        if (blk_len < 12 || blk_len % 4 || size_ - offset_ < blk_len)
+            return false;
+        offset_ += blk_len;
+
+        const uint8_t* body = blk + 8;
+        const size_t body_len = blk_len - 12;
+
+        if (type == NG_INTERFACE_DESCRIPTION) {
+            read_interface(body, body_len);
+        } else if (type == NG_ENHANCED_PACKET || type == NG_PACKET) {
+            if (body_len < 20) continue;
+            const uint32_t if_id =
+                type == NG_PACKET ? get16(body) : get32(body);
+            if (if_id >= interfaces_.size()) continue;
+            const uint32_t cap_len = get32(body + 12);
+            if (body_len - 20 < cap_len) continue;
+
+            const interface& iface = interfaces_[if_id];
+            const uint64_t ts =
+                ((uint64_t)get32(body + 4) << 32) | get32(body + 8);
+            frame.data = body + 20;
+            frame.size = cap_len;
+            frame.link_type = iface.link_type;
+            frame.timestamp_us = ng_timestamp_us(iface, ts);
+            return true;
+        } else if (type == NG_SIMPLE_PACKET) {
+            // no timestamp, captured length is implied by the snap length
+            if (body_len < 4 || interfaces_.empty()) continue;
+            const interface& iface = interfaces_.front();
+            size_t cap_len = std::min<size_t>(get32(body), body_len - 4);
+            if (iface.snap_len)
+                cap_len = std::min<size_t>(cap_len, iface.snap_len);
+            frame.data = body + 4;
+            frame.size = cap_len;
+            frame.link_type = iface.link_type;
+            frame.timestamp_us = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace impl
+}  // namespace sensor_utils
+}  // namespace ouster
@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Memory-mapped pcap and pcapng reading
+ *
+ * Frames are returned as pointers into the mapped file, and UDP headers are
+ * parsed in place. Doesn't depend on libtins; fragmented datagrams are
+ * reported as such and left to the caller to reassemble.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ouster {
+namespace sensor_utils {
+namespace impl {
+
+/** A captured frame, pointing into the mapped file. */
+struct pcap_frame {
+    const uint8_t* data;    ///< Captured bytes, starting at the link layer
+    size_t size;            ///< Number of captured bytes
+    int link_type;          ///< LINKTYPE_* value of the capture interface
+    uint64_t timestamp_us;  ///< Capture timestamp in microseconds
+};
+
+/** A UDP datagram parsed from a frame. */
+struct udp_datagram {
+    std::array<uint8_t, 16> src_addr;  ///< Source, IPv4 as v4-mapped IPv6
+    std::array<uint8_t, 16> dst_addr;  ///< Destination, same form
+    int ip_version;                    ///< 4 or 6
+    int src_port;                      ///< UDP source port
+    int dst_port;                      ///< UDP destination port
+    const uint8_t* payload;            ///< Start of the UDP payload
+    size_t payload_size;               ///< Size of the UDP payload
+    const uint8_t* ip;                 ///< Start of the IP header
+    size_t ip_size;                    ///< Size of the IP datagram
+};
+
+/** Result of parsing a frame. */
+enum parse_result {
+    NOT_UDP = 0,  ///< Not a UDP datagram or unsupported link type
+    UDP = 1,      ///< Complete UDP datagram, all fields set
+    FRAGMENT = 2  ///< IPv4 fragment: ports and payload are not set
+};
+
+/**
+ * Parse the IP and UDP headers of a frame in place.
+ *
+ * @param[in] frame the captured frame.
+ * @param[out] dgram the parsed datagram, pointing into the frame.
+ *
+ * @return whether the frame holds a UDP datagram.
+ */
+parse_result parse_udp(const pcap_frame& frame, udp_datagram& dgram);
+
+/**
+ * Sequential reader for pcap and pcapng files backed by a read-only mapping.
+ */
+class PcapFileReader {
+    struct interface {
+        int link_type;
+        uint32_t snap_len;
+        // timestamp units per second expressed as 10^-n or 2^-n
+        bool ts_pow2;
+        uint8_t ts_exp;
+    };
+
+    const uint8_t* map_{nullptr};
+    size_t size_{0};
+    size_t offset_{0};
+    size_t section_offset_{0};
+
+    bool ng_{false};
+    bool swapped_{false};
+    bool ts_nsec_{false};
+    int link_type_{-1};
+    std::vector<interface> interfaces_;
+
+    void read_file_header(const std::string& file);
+    void unmap();
+    uint16_t get16(const uint8_t* p) const;
+    uint32_t get32(const uint8_t* p) const;
+    bool next_classic(pcap_frame& frame);
+    bool next_ng(pcap_frame& frame);
+    bool read_section_header();
+    void read_interface(const uint8_t* body, size_t len);
+    uint64_t ng_timestamp_us(const interface& iface, uint64_t ts) const;
+
+   public:
+    /**
+     * Map a capture file and read its header.
+     *
+     * @throw std::runtime_error if the file can't be opened or isn't a pcap or
+     * pcapng file.
+     *
+     * @param[in] file path to the capture.
+     */
+    explicit PcapFileReader(const std::string& file);
+
+    ~PcapFileReader();
+
+    PcapFileReader(const PcapFileReader&) = delete;
+    PcapFileReader& operator=(const PcapFileReader&) = delete;
+
+    /**
+     * Get the link type of the capture, or of its first interface for pcapng.
+     *
+     * @return the LINKTYPE_* value, or -1 if no interface is described.
+     */
+    int link_type() const;
+
+    /**
+     * Get the size of the file.
+     *
+     * @return the size in bytes.
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * Get the next captured frame. The frame stays valid for the lifetime of
+     * the reader.
+     *
+     * @param[out] frame the next frame.
+     *
+     * @return false at the end of the file, or if the rest is truncated.
+     */
+    bool next(pcap_frame& frame);
+
+    /** Go back to the first frame. */
+    void reset();
+
+    /**
+     * Get the position of the next frame.
+     *
+     * @param[out] offset file offset of the next frame.
+     * @param[out] section_offset file offset of the pcapng section holding
+     * the next frame, or zero for pcap files.
+     */
+    void tell(uint64_t& offset, uint64_t& section_offset) const;
+
+    /**
+     * Go to a position returned by tell(). For pcapng files, only interfaces
+     * described at the start of the section are restored.
+     *
+     * @param[in] offset file offset of the frame.
+     * @param[in] section_offset file offset of the section holding the frame.
+     *
+     * @return false if the position is out of bounds.
+     */
+    bool seek(uint64_t offset, uint64_t section_offset);
+};
+
+}  // namespace impl
+}  // namespace sensor_utils
+}  // namespace ouster
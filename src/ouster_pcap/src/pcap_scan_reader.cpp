@@ -0,0 +1,251 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/pcap_scan_reader.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ouster/os_pcap.h"
+
+namespace ouster {
+namespace sensor_utils {
+
+namespace {
+
+// scans decoded from a range of frames [begin, end)
+struct Chunk {
+    size_t begin;
+    size_t end;
+    std::deque<LidarScan> scans;
+    bool done{false};
+};
+
+}  // namespace
+
+struct PcapScanReader::Impl {
+    const std::string file;
+    const sensor::sensor_info info;
+    const LidarScan prototype;
+    const bool complete;
+    const int lidar_port;
+    const size_t window;
+
+    pcap_index index;
+    const pcap_index::stream* stream{nullptr};
+    std::vector<Chunk> chunks;
+
+    std::mutex mtx;
+    std::condition_variable cv_ready;  // a scan was added or a chunk is done
+    std::condition_variable cv_taken;  // the reader moved to the next chunk
+    size_t next_chunk{0};              // next chunk to hand to a worker
+    size_t read_chunk{0};              // chunk the reader is waiting on
+    bool stop{false};
+    std::exception_ptr error;
+    std::vector<LidarScan> free_scans;
+
+    std::vector<std::thread> workers;
+
+    Impl(const std::string& file_, const sensor::sensor_info& info_,
+         const LidarScan& prototype_, int n_workers, size_t chunk_frames,
+         bool complete_, int lidar_port_)
+        : file(file_),
+          info(info_),
+          prototype(prototype_.w, prototype_.h, prototype_.begin(),
+                    prototype_.end()),
+          complete(complete_),
+          lidar_port(lidar_port_ ? lidar_port_ : info_.udp_port_lidar),
+          window(2 * std::max(n_workers, 1)) {
+        const auto& pf = sensor::get_format(info);
+        index = get_index(file, lidar_port, pf);
+
+        for (const auto& s : index.streams)
+            if (!stream || s.frames.size() > stream->frames.size())
+                stream = &s;
+
+        const size_t n_frames = stream ? stream->frames.size() : 0;
+        chunk_frames = std::max<size_t>(chunk_frames, 1);
+        for (size_t f = 0; f < n_frames; f += chunk_frames)
+            chunks.push_back({f, std::min(f + chunk_frames, n_frames), {}});
+
+        const size_t n_threads =
+            std::min<size_t>(std::max(n_workers, 1), chunks.size());
+        for (size_t i = 0; i < n_threads; i++)
+            workers.emplace_back([this]() { run(); });
+    }
+
+    ~Impl() {
+        {
+            std::lock_guard<std::mutex> lock{mtx};
+            stop = true;
+        }
+        cv_taken.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    bool matches_prototype(const LidarScan& ls) const {
+        return ls.w == prototype.w && ls.h == prototype.h &&
+               std::equal(ls.begin(), ls.end(), prototype.begin(),
+                          prototype.end());
+    }
+
+    // get a scan to batch into, reusing one returned by the reader if any
+    LidarScan get_scan() {
+        {
+            std::lock_guard<std::mutex> lock{mtx};
+            if (!free_scans.empty()) {
+                LidarScan ls = std::move(free_scans.back());
+                free_scans.pop_back();
+                return ls;
+            }
+        }
+        return LidarScan(prototype.w, prototype.h, prototype.begin(),
+                         prototype.end());
+    }
+
+    void push(Chunk& chunk, LidarScan&& ls) {
+        const bool keep =
+            !complete || ls.complete(info.format.column_window);
+        std::lock_guard<std::mutex> lock{mtx};
+        if (keep)
+            chunk.scans.push_back(std::move(ls));
+        else
+            free_scans.push_back(std::move(ls));
+        cv_ready.notify_all();
+    }
+
+    void decode(playback_handle& handle, Chunk& chunk) {
+        if (!replay_seek(handle, *stream, chunk.begin))
+            throw std::runtime_error("Failed to seek in pcap file: " + file);
+
+        const auto& pf = sensor::get_format(info);
+        ScanBatcher batcher(info);
+        LidarScan ls = get_scan();
+        ls.frame_id = -1;
+
+        // packets of other frames may come before the first packet of the
+        // indexed frame, like reordered ones of the previous frame
+        const uint16_t first_frame_id = stream->frames[chunk.begin].frame_id;
+        bool started = false;
+
+        packet_view view;
+        size_t frames_left = chunk.end - chunk.begin;
+        while (frames_left > 0 && next_packet(handle, view)) {
+            if (view.dst_port != lidar_port ||
+                view.payload_size != pf.lidar_packet_size ||
+                view.src_addr != stream->src_addr)
+                continue;
+            if (!started && pf.frame_id(view.payload) != first_frame_id)
+                continue;
+            started = true;
+
+            // batch with capture timestamps, as for live data
+            const uint64_t rx_ts = view.timestamp.count() * 1000;
+            if (batcher(view.payload, ls, rx_ts)) {
+                push(chunk, std::move(ls));
+                frames_left--;
+                ls = get_scan();
+                ls.frame_id = -1;
+            }
+        }
+
+        // the last frame of the file doesn't end with a packet of the next
+        if (frames_left > 0 && ls.frame_id != -1) push(chunk, std::move(ls));
+    }
+
+    void run() {
+        try {
+            auto handle = replay_initialize(file);
+            while (true) {
+                size_t c;
+                {
+                    std::unique_lock<std::mutex> lock{mtx};
+                    cv_taken.wait(lock, [this] {
+                        return stop || next_chunk >= chunks.size() ||
+                               next_chunk < read_chunk + window;
+                    });
+                    if (stop || next_chunk >= chunks.size()) return;
+                    c = next_chunk++;
+                }
+
+                decode(*handle, chunks[c]);
+
+                std::lock_guard<std::mutex> lock{mtx};
+                chunks[c].done = true;
+                cv_ready.notify_all();
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock{mtx};
+            if (!error) error = std::current_exception();
+            stop = true;
+            cv_ready.notify_all();
+            cv_taken.notify_all();
+        }
+    }
+
+    bool next(LidarScan& scan) {
+        std::unique_lock<std::mutex> lock{mtx};
+        while (true) {
+            cv_ready.wait(lock, [this] {
+                return error || read_chunk >= chunks.size() ||
+                       !chunks[read_chunk].scans.empty() ||
+                       chunks[read_chunk].done;
+            });
+            if (error) std::rethrow_exception(error);
+            if (read_chunk >= chunks.size()) return false;
+
+            Chunk& chunk = chunks[read_chunk];
+            if (!chunk.scans.empty()) {
+                if (matches_prototype(scan))
+                    free_scans.push_back(std::move(scan));
+                scan = std::move(chunk.scans.front());
+                chunk.scans.pop_front();
+                return true;
+            }
+
+            // chunk is done and drained
+            read_chunk++;
+            cv_taken.notify_all();
+        }
+    }
+};
+
+PcapScanReader::PcapScanReader(const std::string& file,
+                               const sensor::sensor_info& info, int n_workers,
+                               size_t chunk_frames, bool complete,
+                               int lidar_port)
+    : PcapScanReader(file, info,
+                     LidarScan(info.format.columns_per_frame,
+                               info.format.pixels_per_column,
+                               info.format.udp_profile_lidar),
+                     n_workers, chunk_frames, complete, lidar_port) {}
+
+PcapScanReader::PcapScanReader(const std::string& file,
+                               const sensor::sensor_info& info,
+                               const LidarScan& prototype, int n_workers,
+                               size_t chunk_frames, bool complete,
+                               int lidar_port) {
+    if (n_workers <= 0)
+        n_workers = std::max<int>(std::thread::hardware_concurrency(), 1);
+    impl_.reset(new Impl(file, info, prototype, n_workers, chunk_frames,
+                         complete, lidar_port));
+}
+
+PcapScanReader::~PcapScanReader() = default;
+
+bool PcapScanReader::next(LidarScan& scan) { return impl_->next(scan); }
+
+size_t PcapScanReader::frame_count() const {
+    return impl_->stream ? impl_->stream->frames.size() : 0;
+}
+
+}  // namespace sensor_utils
+}  // namespace ouster
@@ -0,0 +1,339 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "pcap_writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+namespace ouster {
+namespace sensor_utils {
+namespace impl {
+
+namespace {
+
+constexpr int LINKTYPE_ETHERNET = 1;
+constexpr int LINKTYPE_LINUX_SLL = 113;
+
+constexpr size_t ETHERNET_HEADER_SIZE = 14;
+constexpr size_t SLL_HEADER_SIZE = 16;
+constexpr size_t IPV4_HEADER_SIZE = 20;
+constexpr size_t UDP_HEADER_SIZE = 8;
+constexpr size_t RECORD_HEADER_SIZE = 16;
+
+constexpr size_t MAX_IP_SIZE = 65535;
+constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+constexpr uint16_t IP_MORE_FRAGMENTS = 0x2000;
+constexpr uint8_t IP_DEFAULT_TTL = 128;
+constexpr uint8_t IP_PROTOCOL_UDP = 17;
+
+void put16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v >> 8);
+    p[1] = static_cast<uint8_t>(v);
+}
+
+uint16_t get16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t parse_ipv4(const std::string& ip) {
+    in_addr addr;
+    if (inet_pton(AF_INET, ip.c_str(), &addr) != 1)
+        throw std::invalid_argument("Invalid IPv4 address: " + ip);
+    return ntohl(addr.s_addr);
+}
+
+}  // namespace
+
+PcapFileWriter::PcapFileWriter(const std::string& file,
+                               bool use_sll_encapsulation,
+                               const record_options& options)
+    : link_type_(use_sll_encapsulation ? LINKTYPE_LINUX_SLL
+                                       : LINKTYPE_ETHERNET),
+      link_size_(use_sll_encapsulation ? SLL_HEADER_SIZE
+                                       : ETHERNET_HEADER_SIZE),
+      options_(options) {
+    if (options_.buffer_size == 0)
+        throw std::invalid_argument("Record buffer size must be positive");
+
+    file_ = std::fopen(file.c_str(), "wb");
+    if (!file_) throw std::runtime_error("Failed to create pcap file: " + file);
+    // buffers are already sized for large writes
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+
+    current_.data.resize(options_.buffer_size);
+    n_buffers_ = 1;
+
+    // classic pcap header in host byte order, microsecond timestamps
+    struct {
+        uint32_t magic;
+        uint16_t version_major;
+        uint16_t version_minor;
+        int32_t thiszone;
+        uint32_t sigfigs;
+        uint32_t snaplen;
+        uint32_t network;
+    } header{0xa1b2c3d4, 2, 4, 0, 0, 65535,
+             static_cast<uint32_t>(link_type_)};
+    static_assert(sizeof(header) == 24, "Unexpected pcap header padding");
+    std::memcpy(current_.data.data(), &header, sizeof(header));
+    current_.used = sizeof(header);
+
+    if (options_.async_write) writer_ = std::thread([this]() { run(); });
+}
+
+PcapFileWriter::~PcapFileWriter() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+PcapFileWriter::stream& PcapFileWriter::get_stream(const std::string& src_ip,
+                                                   const std::string& dst_ip,
+                                                   int src_port,
+                                                   int dst_port) {
+    auto matches = [&](const stream& s) {
+        return s.src_port == src_port && s.dst_port == dst_port &&
+               s.src_ip == src_ip && s.dst_ip == dst_ip;
+    };
+
+    // packets usually alternate between a few streams
+    if (last_stream_ < streams_.size() && matches(streams_[last_stream_]))
+        return streams_[last_stream_];
+    for (size_t i = 0; i < streams_.size(); i++) {
+        if (matches(streams_[i])) {
+            last_stream_ = i;
+            return streams_[i];
+        }
+    }
+
+    if (src_port < 0 || src_port > 65535 || dst_port < 0 || dst_port > 65535)
+        throw std::invalid_argument("Invalid UDP port");
+
+    stream s{src_ip, dst_ip, src_port, dst_port, {}, 0, 0};
+    s.header.assign(link_size_ + IPV4_HEADER_SIZE + UDP_HEADER_SIZE, 0);
+
+    uint8_t* link = s.header.data();
+    if (link_type_ == LINKTYPE_LINUX_SLL)
+        put16(link + 14, ETHERTYPE_IPV4);
+    else
+        put16(link + 12, ETHERTYPE_IPV4);
+
+    // length, id, flags / fragment offset and checksum are set per fragment
+    uint8_t* ip = link + link_size_;
+    const uint32_t src = parse_ipv4(src_ip);
+    const uint32_t dst = parse_ipv4(dst_ip);
+    ip[0] = 0x45;
+    ip[8] = IP_DEFAULT_TTL;
+    ip[9] = IP_PROTOCOL_UDP;
+    put16(ip + 12, static_cast<uint16_t>(src >> 16));
+    put16(ip + 14, static_cast<uint16_t>(src));
+    put16(ip + 16, static_cast<uint16_t>(dst >> 16));
+    put16(ip + 18, static_cast<uint16_t>(dst));
+    for (size_t i = 0; i < IPV4_HEADER_SIZE; i += 2) s.ip_sum += get16(ip + i);
+
+    // length is set per datagram, checksum is left out
+    uint8_t* udp = ip + IPV4_HEADER_SIZE;
+    put16(udp, static_cast<uint16_t>(src_port));
+    put16(udp + 2, static_cast<uint16_t>(dst_port));
+
+    streams_.push_back(std::move(s));
+    last_stream_ = streams_.size() - 1;
+    return streams_.back();
+}
+
+bool PcapFileWriter::reserve(size_t size) {
+    if (current_.data.size() - current_.used >= size) return true;
+
+    if (current_.used == 0) {
+        // a single datagram larger than the buffer size
+    } else if (!options_.async_write) {
+        write_buffer(current_);
+    } else {
+        std::unique_lock<std::mutex> lock{mtx_};
+        if (free_.empty() && n_buffers_ < options_.n_buffers) {
+            free_.emplace_back();
+            free_.back().data.resize(options_.buffer_size);
+            n_buffers_++;
+        }
+        if (free_.empty()) {
+            if (options_.drop_when_full) return false;
+            cv_free_.wait(lock, [this] { return !free_.empty(); });
+        }
+        queued_.push_back(std::move(current_));
+        current_ = std::move(free_.back());
+        free_.pop_back();
+        cv_queued_.notify_one();
+    }
+
+    if (current_.data.size() < size) current_.data.resize(size);
+    return true;
+}
+
+void PcapFileWriter::write_buffer(buffer& buf) {
+    const bool ok = buf.used == 0 ||
+                    std::fwrite(buf.data.data(), buf.used, 1, file_) == 1;
+    {
+        std::lock_guard<std::mutex> lock{mtx_};
+        if (ok) {
+            bytes_written_ += buf.used;
+            packets_written_ += buf.packets;
+        } else if (error_.empty()) {
+            error_ = std::string("Failed to write pcap file: ") +
+                     std::strerror(errno);
+        }
+    }
+    buf.used = 0;
+    buf.packets = 0;
+}
+
+void PcapFileWriter::run() {
+    std::unique_lock<std::mutex> lock{mtx_};
+    while (true) {
+        cv_queued_.wait(lock, [this] { return closing_ || !queued_.empty(); });
+        if (queued_.empty()) return;
+
+        buffer buf = std::move(queued_.front());
+        queued_.pop_front();
+        lock.unlock();
+        write_buffer(buf);
+        lock.lock();
+
+        free_.push_back(std::move(buf));
+        cv_free_.notify_one();
+    }
+}
+
+void PcapFileWriter::check_error() {
+    std::lock_guard<std::mutex> lock{mtx_};
+    if (!error_.empty()) throw std::runtime_error(error_);
+}
+
+bool PcapFileWriter::write_udp(const std::string& src_ip,
+                               const std::string& dst_ip, int src_port,
+                               int dst_port, size_t frag_size,
+                               const uint8_t* buf, size_t size,
+                               uint64_t timestamp_us) {
+    if (!file_) throw std::runtime_error("Pcap file is closed");
+    check_error();
+
+    const size_t udp_size = UDP_HEADER_SIZE + size;
+    if (IPV4_HEADER_SIZE + udp_size > MAX_IP_SIZE)
+        throw std::invalid_argument("Datagram too large to record");
+
+    // all fragments but the last must hold a multiple of 8 bytes
+    const size_t frag = std::min(frag_size, MAX_IP_SIZE - IPV4_HEADER_SIZE);
+    const size_t frag_payload = udp_size <= frag ? udp_size : frag & ~size_t{7};
+    if (frag_payload == 0)
+        throw std::invalid_argument("Fragment size too small to record");
+
+    const size_t n_frags = (udp_size + frag_payload - 1) / frag_payload;
+    const size_t frame_overhead = link_size_ + IPV4_HEADER_SIZE;
+    const size_t total =
+        n_frags * (RECORD_HEADER_SIZE + frame_overhead) + udp_size;
+
+    if (!reserve(total)) {
+        stats_.packets_dropped++;
+        return false;
+    }
+
+    stream& s = get_stream(src_ip, dst_ip, src_port, dst_port);
+    const uint16_t id = s.next_id++;
+    put16(s.header.data() + frame_overhead + 4,
+          static_cast<uint16_t>(udp_size));
+
+    const uint32_t ts_sec = static_cast<uint32_t>(timestamp_us / 1000000);
+    const uint32_t ts_usec = static_cast<uint32_t>(timestamp_us % 1000000);
+
+    uint8_t* out = current_.data.data() + current_.used;
+    for (size_t off = 0; off < udp_size; off += frag_payload) {
+        const size_t len = std::min(frag_payload, udp_size - off);
+        const uint32_t frame_size =
+            static_cast<uint32_t>(frame_overhead + len);
+
+        const uint32_t record[4] = {ts_sec, ts_usec, frame_size, frame_size};
+        std::memcpy(out, record, RECORD_HEADER_SIZE);
+        out += RECORD_HEADER_SIZE;
+
+        // copy the templated headers, including the UDP header once
+        const bool first = off == 0;
+        std::memcpy(out, s.header.data(),
+                    first ? s.header.size() : frame_overhead);
+
+        uint8_t* ip = out + link_size_;
+        const uint16_t ip_len = static_cast<uint16_t>(IPV4_HEADER_SIZE + len);
+        const uint16_t flags = static_cast<uint16_t>(
+            (off / 8) | (off + len < udp_size ? IP_MORE_FRAGMENTS : 0));
+        put16(ip + 2, ip_len);
+        put16(ip + 4, id);
+        put16(ip + 6, flags);
+        uint32_t sum = s.ip_sum + ip_len + id + flags;
+        sum = (sum & 0xffff) + (sum >> 16);
+        sum = (sum & 0xffff) + (sum >> 16);
+        put16(ip + 10, static_cast<uint16_t>(~sum));
+        out += frame_overhead;
+
+        if (first) {
+            // buf may be null for empty datagrams
+            out += UDP_HEADER_SIZE;
+            if (len > UDP_HEADER_SIZE)
+                std::memcpy(out, buf, len - UDP_HEADER_SIZE);
+            out += len - UDP_HEADER_SIZE;
+        } else {
+            std::memcpy(out, buf + off - UDP_HEADER_SIZE, len);
+            out += len;
+        }
+    }
+
+    current_.used += total;
+    current_.packets++;
+    stats_.packets_recorded++;
+    return true;
+}
+
+void PcapFileWriter::close() {
+    if (!file_) return;
+
+    if (!options_.async_write) {
+        write_buffer(current_);
+    } else {
+        {
+            std::lock_guard<std::mutex> lock{mtx_};
+            if (current_.used > 0) queued_.push_back(std::move(current_));
+            closing_ = true;
+        }
+        cv_queued_.notify_one();
+        writer_.join();
+    }
+
+    const bool closed = std::fclose(file_) == 0;
+    file_ = nullptr;
+    if (!closed) {
+        std::lock_guard<std::mutex> lock{mtx_};
+        if (error_.empty()) error_ = "Failed to close pcap file";
+    }
+    check_error();
+}
+
+record_stats PcapFileWriter::stats() {
+    record_stats result = stats_;
+    std::lock_guard<std::mutex> lock{mtx_};
+    result.packets_written = packets_written_;
+    result.bytes_written = bytes_written_;
+    return result;
+}
+
+}  // namespace impl
+}  // namespace sensor_utils
+}  // namespace ouster
@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Buffered pcap writing of UDP datagrams
+ *
+ * Link, IPv4 and UDP headers are serialized once per stream and patched per
+ * fragment. Frames are appended to fixed-size buffers which are written in one
+ * call each, optionally from a background thread. Doesn't depend on libtins.
+ */
+
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ouster/os_pcap.h"
+
+namespace ouster {
+namespace sensor_utils {
+namespace impl {
+
+/**
+ * Writer for classic pcap files holding UDP over IPv4.
+ *
+ * Write functions must be called from a single thread.
+ */
+class PcapFileWriter {
+    // pre-serialized headers of a (src, dst) address and port pair
+    struct stream {
+        std::string src_ip;
+        std::string dst_ip;
+        int src_port;
+        int dst_port;
+        std::vector<uint8_t> header;  // link + IPv4 + UDP header
+        uint32_t ip_sum;              // IPv4 header sum of the constant words
+        uint16_t next_id;
+    };
+
+    struct buffer {
+        std::vector<uint8_t> data;
+        size_t used{0};
+        size_t packets{0};
+    };
+
+    const int link_type_;
+    const size_t link_size_;
+    const record_options options_;
+
+    std::FILE* file_{nullptr};
+    std::vector<stream> streams_;
+    size_t last_stream_{0};
+
+    buffer current_;
+    record_stats stats_{};
+
+    // shared with the writer thread
+    std::mutex mtx_;
+    std::condition_variable cv_queued_;
+    std::condition_variable cv_free_;
+    std::deque<buffer> queued_;
+    std::vector<buffer> free_;
+    size_t n_buffers_{0};
+    bool closing_{false};
+    std::string error_;
+    uint64_t bytes_written_{0};
+    uint64_t packets_written_{0};
+    std::thread writer_;
+
+    stream& get_stream(const std::string& src_ip, const std::string& dst_ip,
+                       int src_port, int dst_port);
+    bool reserve(size_t size);
+    void write_buffer(buffer& buf);
+    void run();
+    void check_error();
+
+   public:
+    /**
+     * Create a pcap file and write its header.
+     *
+     * @throw std::runtime_error if the file can't be created.
+     *
+     * @param[in] file path of the pcap file to create.
+     * @param[in] use_sll_encapsulation use Linux cooked capture headers
+     * instead of Ethernet.
+     * @param[in] options buffering options.
+     */
+    PcapFileWriter(const std::string& file, bool use_sll_encapsulation,
+                   const record_options& options);
+
+    /** Write buffered packets and close the file, ignoring errors. */
+    ~PcapFileWriter();
+
+    PcapFileWriter(const PcapFileWriter&) = delete;
+    PcapFileWriter& operator=(const PcapFileWriter&) = delete;
+
+    /**
+     * Write a UDP datagram, split into IPv4 fragments of at most frag_size
+     * bytes of IP payload.
+     *
+     * @throw std::invalid_argument on invalid IPv4 addresses or sizes.
+     * @throw std::runtime_error if the writer failed to write to the file.
+     *
+     * @return false if the datagram was dropped because all buffers were
+     * queued for writing.
+     */
+    bool write_udp(const std::string& src_ip, const std::string& dst_ip,
+                   int src_port, int dst_port, size_t frag_size,
+                   const uint8_t* buf, size_t size, uint64_t timestamp_us);
+
+    /**
+     * Write buffered packets, stop the writer thread and close the file.
+     *
+     * @throw std::runtime_error if any write failed.
+     */
+    void close();
+
+    /**
+     * Get the counters of the writer.
+     *
+     * @return the packets and bytes written or dropped so far.
+     */
+    record_stats stats();
+};
+
+}  // namespace impl
+}  // namespace sensor_utils
+}  // namespace ouster
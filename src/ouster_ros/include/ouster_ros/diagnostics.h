@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Latency and drop diagnostics of the nodelets converting scans,
+ * published on /diagnostics
+ */
+
+#pragma once
+
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <ros/ros.h>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster_ros {
+
+/** When the packets of a scan were received, and how long converting took */
+struct ScanTimings {
+    ros::Time first_rx;  ///< receive time of the first packet of the scan
+    ros::Time last_rx;   ///< receive time of the packet completing the scan
+    std::chrono::nanoseconds batching{0};    ///< spent batching its packets
+    std::chrono::nanoseconds projection{0};  ///< spent projecting clouds
+};
+
+/**
+ * Summarizes the packets and scans handled by a nodelet into a diagnostic
+ * status, published once per period: receive to publish latency, batching
+ * and projection times, packets and zeroed columns per scan, and packets or
+ * scans lost along the way. Updating only takes a lock and a few additions,
+ * so it can be left on. Thread safe.
+ */
+class ScanDiagnostics {
+   public:
+    /**
+     * @param[in] nh the node handle to advertise /diagnostics with
+     * @param[in] name the name of the status, usually the nodelet
+     * @param[in] info sensor metadata, for the serial number and the columns
+     * expected to be missing outside of the column window
+     * @param[in] period seconds between statuses
+     */
+    ScanDiagnostics(ros::NodeHandle& nh, const std::string& name,
+                    const ouster::sensor::sensor_info& info, double period);
+
+    /**
+     * Add a scan once its messages are published. Scans must be added in the
+     * order they were batched
+     * @param[in] t when its packets were received and how long it took
+     * @param[in] stats the counters of the batcher when the scan completed
+     */
+    void add_scan(const ScanTimings& t, const ouster::BatcherStats& stats);
+
+    /** Count a completed scan that was dropped instead of converted */
+    void add_dropped_scan();
+
+    /**
+     * Count lidar packets read from the sensor
+     * @param[in] n the number of packets
+     * @param[in] kernel_drops packets dropped by the kernel so far, see
+     * sensor::get_lidar_drops(), or -1 if unknown
+     */
+    void add_received_packets(int n, int64_t kernel_drops);
+
+   private:
+    struct Summary {
+        size_t n{0};
+        double sum{0}, max{0};
+        void add(double v);
+        double mean() const { return n ? sum / n : 0; }
+    };
+
+    // publish and reset the summaries once a period has passed
+    void publish_if_due(const ros::Time& now);
+
+    const std::string name_, hardware_id_;
+    const double period_;
+    const uint64_t window_zeroed_cols_;  // per scan, outside of the window
+    ros::Publisher pub_;
+
+    std::mutex mtx_;
+    ros::Time period_start_;
+    ouster::BatcherStats last_stats_{};
+    int64_t last_kernel_drops_{-1};
+
+    // since the start of the period
+    size_t scans_{0}, dropped_scans_{0}, received_packets_{0};
+    uint64_t packets_{0}, batched_scans_{0}, zeroed_cols_{0},
+        reordered_packets_{0}, kernel_drops_{0};
+    Summary latency_, age_, batching_, projection_;
+    bool any_scans_{false}, any_packets_{false};
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Reusable messages for publishing without copies
+ */
+
+#pragma once
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace ouster_ros {
+
+/**
+ * Messages to fill in and publish by shared pointer.
+ *
+ * Publishing a shared pointer hands the message itself to subscribers in the
+ * same process, where publishing by value copies it for each. A message is
+ * only handed out again once every subscriber has dropped it, so it is never
+ * modified while in use and its buffers are reused instead of reallocated.
+ *
+ * Not thread safe: each publishing thread should have its own pool.
+ */
+template <typename M>
+class MessagePool {
+   public:
+    /**
+     * @param[in] capacity the number of messages to keep around for reuse.
+     */
+    explicit MessagePool(size_t capacity) : capacity_{capacity} {}
+
+    /**
+     * Get a message that no one else holds, allocating one if all of the
+     * pooled messages are in use.
+     *
+     * @return a message, holding the contents it was last published with.
+     */
+    boost::shared_ptr<M> acquire() {
+        auto msg = try_acquire();
+        return msg ? msg : boost::make_shared<M>();
+    }
+
+    /**
+     * Get a message that no one else holds, never holding more messages than
+     * the capacity. Publishers can wait for subscribers in the same process
+     * to drop messages by retrying.
+     *
+     * @return a message, or null if all of the messages are in use.
+     */
+    boost::shared_ptr<M> try_acquire() {
+        for (size_t k = 0; k < pool_.size(); k++) {
+            auto& msg = pool_[next_];
+            next_ = (next_ + 1) % pool_.size();
+            if (msg.use_count() == 1) return msg;
+        }
+        if (pool_.size() < capacity_) {
+            pool_.push_back(boost::make_shared<M>());
+            return pool_.back();
+        }
+        return nullptr;
+    }
+
+   private:
+    size_t capacity_;
+    size_t next_{0};
+    std::vector<boost::shared_ptr<M>> pool_;
+};
+
+}  // namespace ouster_ros
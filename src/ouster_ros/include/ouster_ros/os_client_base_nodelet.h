@@ -10,6 +10,12 @@
  * udp_dest: hostname or IP where the sensor will send data packets
  * lidar_port: port to which the sensor should send lidar data
  * imu_port: port to which the sensor should send imu data
+ * rx_cpu: cpu to pin the packet receive thread to, -1 for any
+ * rx_priority: SCHED_FIFO priority of the receive thread, 0 for the default
+ * process_scans: also batch scans on the receive thread and publish point
+ * clouds and images, in place of the OusterCloud and OusterImage nodelets
+ * scan_workers: the number of threads converting scans with process_scans
+ * diagnostics_period: seconds between statuses on /diagnostics, 0 to disable
  */
 
 #include <nodelet/nodelet.h>
@@ -16,6 +16,7 @@
 
 #include <chrono>
 #include <string>
+#include <vector>
 
 #include "ouster/client.h"
 #include "ouster/lidar_scan.h"
@@ -75,6 +76,14 @@ sensor_msgs::Imu packet_to_imu_msg(const PacketMsg& pm,
     const PacketMsg& pm, const std::string& frame,
     const sensor::packet_format& pf);
 
+/**
+ * The field of a LidarScan holding the first or second return of a field
+ * @param[in] input_field range, signal, reflectivity or near ir, of any return
+ * @param[in] second whether to pick the field of the second return
+ * @return the field of the return; near ir is shared by both returns
+ */
+sensor::ChanField suitable_return(sensor::ChanField input_field, bool second);
+
 /**
  * Populate a PCL point cloud from a LidarScan
  * @param[in] xyz_lut lookup table from sensor beam angles (see lidar_scan.h)
@@ -88,6 +97,117 @@ void scan_to_cloud(const ouster::XYZLut& xyz_lut,
                    ouster::LidarScan::ts_t scan_ts, const ouster::LidarScan& ls,
                    ouster_ros::Cloud& cloud, int return_index = 0);
 
+/**
+ * Populate a PCL point cloud for each return of a LidarScan, projecting all
+ * returns in a single pass over the lookup table
+ * @param[in] xyz_lut single precision lookup table from sensor beam angles
+ * (see lidar_scan.h)
+ * @param[in] scan_ts scan start used to caluclate relative timestamps for
+ * points
+ * @param[in] ls input lidar data
+ * @param[out] clouds output pcl pointclouds to populate, one per return
+ * starting at the first
+ */
+void scan_to_clouds(const ouster::XYZLutf& xyz_lut,
+                    ouster::LidarScan::ts_t scan_ts,
+                    const ouster::LidarScan& ls,
+                    std::vector<ouster_ros::Cloud>& clouds);
+
+/**
+ * Populate a PCL point cloud for each return of a region of a LidarScan. The
+ * clouds are organized by the rows and columns of the region
+ * @param[in] region_lut single precision lookup table sliced to the region
+ * (see slice_xyz_lut in lidar_scan.h)
+ * @param[in] region the pixels of the scan to convert
+ * @param[in] scan_ts scan start used to caluclate relative timestamps for
+ * points
+ * @param[in] ls input lidar data
+ * @param[out] clouds output pcl pointclouds to populate, one per return
+ * starting at the first
+ */
+void scan_to_clouds(const ouster::XYZLutf& region_lut,
+                    const ouster::ScanRegion& region,
+                    ouster::LidarScan::ts_t scan_ts,
+                    const ouster::LidarScan& ls,
+                    std::vector<ouster_ros::Cloud>& clouds);
+
+/** Optional fields of the points of clouds written by scan_to_cloud_msgs */
+enum CloudField : uint32_t {
+    CLOUD_INTENSITY = 1 << 0,     ///< signal
+    CLOUD_T = 1 << 1,             ///< ns since the start of the scan
+    CLOUD_REFLECTIVITY = 1 << 2,  ///< reflectivity
+    CLOUD_RING = 1 << 3,          ///< row of the scan
+    CLOUD_AMBIENT = 1 << 4,       ///< near infrared
+    CLOUD_RANGE = 1 << 5,         ///< range in mm
+    CLOUD_ALL_FIELDS = (1 << 6) - 1
+};
+
+/** Points of clouds written by scan_to_cloud_msgs */
+struct CloudLayout {
+    uint32_t fields{CLOUD_ALL_FIELDS};  ///< CloudField flags, always with xyz
+    bool compact{false};  ///< intensity as uint16 instead of float32
+};
+
+/**
+ * Parse a comma separated list of point fields, e.g. "intensity,t,range".
+ * @param[in] s the names of the fields, as in ouster_ros::Point, or "all"
+ * @return the CloudField flags, or an empty optional if a field is unknown
+ */
+ouster::optional<uint32_t> cloud_fields_of_string(const std::string& s);
+
+/**
+ * Get one of the preregistered point layouts by name:
+ * - "original": all of the fields of ouster_ros::Point, 32 bytes per point
+ * - "xyz": coordinates only, 12 bytes, as pcl::PointXYZ without padding
+ * - "xyzi": coordinates and intensity, 16 bytes, as pcl::PointXYZI without
+ *   padding
+ * - "xyzir": coordinates, intensity and ring, 20 bytes
+ * - "compact": all fields with a 16 bit intensity, 28 bytes
+ * @param[in] s the name of the layout
+ * @return the layout, or an empty optional if the name is unknown
+ */
+ouster::optional<CloudLayout> cloud_layout_of_point_type(const std::string& s);
+
+/**
+ * Write a point cloud for each return of a LidarScan directly into ROS
+ * messages, without going through PCL. Points hold the x, y and z coordinates
+ * and the fields of the layout, largest first and each aligned to its size,
+ * with the same names and types as ouster_ros::Point by default. The memory
+ * of the messages is reused when large enough; headers are left to the caller
+ * @param[in] xyz_lut single precision lookup table from sensor beam angles
+ * (see lidar_scan.h)
+ * @param[in] scan_ts scan start used to caluclate relative timestamps for
+ * points
+ * @param[in] ls input lidar data
+ * @param[in] layout the fields and precision of the points
+ * @param[out] msgs the messages to write, one per return starting at the first;
+ * returns with a null message are skipped
+ */
+void scan_to_cloud_msgs(const ouster::XYZLutf& xyz_lut,
+                        ouster::LidarScan::ts_t scan_ts,
+                        const ouster::LidarScan& ls, const CloudLayout& layout,
+                        const std::vector<sensor_msgs::PointCloud2*>& msgs);
+
+/**
+ * Write a point cloud for each return of a region of a LidarScan directly
+ * into ROS messages, as above. The clouds are organized by the rows and
+ * columns of the region
+ * @param[in] region_lut single precision lookup table sliced to the region
+ * (see slice_xyz_lut in lidar_scan.h)
+ * @param[in] region the pixels of the scan to convert
+ * @param[in] scan_ts scan start used to caluclate relative timestamps for
+ * points
+ * @param[in] ls input lidar data
+ * @param[in] layout the fields and precision of the points
+ * @param[out] msgs the messages to write, one per return starting at the first;
+ * returns with a null message are skipped
+ */
+void scan_to_cloud_msgs(const ouster::XYZLutf& region_lut,
+                        const ouster::ScanRegion& region,
+                        ouster::LidarScan::ts_t scan_ts,
+                        const ouster::LidarScan& ls, const CloudLayout& layout,
+                        const std::vector<sensor_msgs::PointCloud2*>& msgs);
+
 /**
  * Serialize a PCL point cloud to a ROS message
  * @param[in] cloud the PCL point cloud to convert
@@ -99,6 +219,18 @@ sensor_msgs::PointCloud2 cloud_to_cloud_msg(const Cloud& cloud,
                                             const ros::Time& timestamp,
                                             const std::string& frame);
 
+/**
+ * Serialize a PCL point cloud into an existing ROS message, reusing the memory
+ * of its data when it is large enough
+ * @param[in] cloud the PCL point cloud to convert
+ * @param[in] timestamp the timestamp to apply to the ROS message
+ * @param[in] frame the frame to set in the ROS message
+ * @param[out] msg the ROS message to populate
+ */
+void cloud_to_cloud_msg(const Cloud& cloud, const ros::Time& timestamp,
+                        const std::string& frame,
+                        sensor_msgs::PointCloud2& msg);
+
 /**
  * Serialize a PCL point cloud to a ROS message
  * @param[in] cloud the PCL point cloud to convert
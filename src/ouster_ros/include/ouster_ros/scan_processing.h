@@ -0,0 +1,234 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Conversion of lidar scans to point clouds and images, shared by the
+ * nodelets converting scans
+ */
+
+#pragma once
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf2_ros/static_transform_broadcaster.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ouster/image_processing.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+#include "ouster_ros/PacketMsg.h"
+#include "ouster_ros/diagnostics.h"
+#include "ouster_ros/ros.h"
+
+namespace ouster_ros {
+
+/**
+ * The number of returns in the lidar packets of a sensor
+ * @param[in] info sensor metadata
+ * @return 2 for dual return profiles, 1 otherwise
+ */
+int num_returns(const sensor::sensor_info& info);
+
+/** What part of scans to convert to point clouds, and how */
+struct CloudConfig {
+    CloudLayout layout{};   ///< fields and precision of points
+    int roi_first_col{-1};  ///< first column, -1 for the column window
+    int roi_last_col{-1};   ///< last column, -1 for the column window
+    int col_step{1};        ///< convert every nth column
+    int row_step{1};        ///< convert every nth row
+};
+
+/**
+ * Read the point cloud parameters of a nodelet: roi_first_col, roi_last_col,
+ * col_step, row_step, and either a point_type preset (see
+ * cloud_layout_of_point_type) or point_fields and compact_points
+ * @throw std::runtime_error if point_type or a field of point_fields is
+ * unknown
+ * @param[in] pnh the private node handle of the nodelet
+ * @return the configuration, with defaults for missing parameters
+ */
+CloudConfig cloud_config_of_params(const ros::NodeHandle& pnh);
+
+/**
+ * Converts the scans of a sensor to point clouds, one per return. Conversion
+ * doesn't modify the converter, so it may be shared by threads
+ */
+class CloudConverter {
+   public:
+    /**
+     * @param[in] info sensor metadata
+     * @param[in] config what part of scans to convert, and how
+     */
+    CloudConverter(const sensor::sensor_info& info, const CloudConfig& config);
+
+    /**
+     * Fill in the point clouds of a scan, see scan_to_cloud_msgs
+     * @param[in] ls the scan, staggered
+     * @param[in] scan_ts scan start used to calculate relative timestamps
+     * @param[out] msgs one message per return; returns with a null message
+     * are skipped
+     */
+    void operator()(const ouster::LidarScan& ls,
+                    std::chrono::nanoseconds scan_ts,
+                    const std::vector<sensor_msgs::PointCloud2*>& msgs) const;
+
+    /** The number of returns, and of point clouds per scan */
+    int n_returns() const { return n_returns_; }
+
+   private:
+    int n_returns_;
+    CloudLayout layout_;
+    std::shared_ptr<const ouster::XYZLutf> xyz_lut_;
+    std::unique_ptr<ouster::ScanRegion> region_;
+    ouster::XYZLutf region_lut_;
+};
+
+/**
+ * Publishes range, signal, reflectivity and near ir images of scans on
+ * range_image, signal_image, reflec_image and nearir_image, suffixed with 2
+ * for the second return. Only images with subscribers are computed; idle
+ * images still update their exposure, from a subset of columns, so that they
+ * are well exposed as soon as someone subscribes. Not thread safe: scans must
+ * be published in order
+ */
+class ImagePublisher {
+   public:
+    /**
+     * @param[in] info sensor metadata
+     * @param[in] nh the node handle to advertise topics with
+     */
+    ImagePublisher(const sensor::sensor_info& info, ros::NodeHandle& nh);
+
+    /**
+     * Publish the images of a scan
+     * @param[in] ls the scan, staggered or destaggered
+     * @param[in] stamp the timestamp of the images
+     */
+    void operator()(const ouster::LidarScan& ls, const ros::Time& stamp);
+
+   private:
+    void publish_range_image(const ouster::LidarScan& ls,
+                             sensor::ChanField f, const ros::Publisher& pub,
+                             const ros::Time& stamp);
+
+    void publish_scaled_image(const ouster::LidarScan& ls,
+                              sensor::ChanField f, bool update_state,
+                              ouster::viz::AutoExposure& ae,
+                              ouster::viz::BeamUniformityCorrector* buc,
+                              bool take_sqrt, const ros::Publisher& pub,
+                              const ros::Time& stamp);
+
+    int n_returns_;
+    ouster::Destaggerer destagger_;
+
+    ros::Publisher nearir_image_pub_;
+    std::vector<ros::Publisher> range_image_pubs_;
+    std::vector<ros::Publisher> signal_image_pubs_;
+    std::vector<ros::Publisher> reflec_image_pubs_;
+
+    // working images, reused between scans
+    ouster::img_t<uint32_t> range_;
+    ouster::img_t<float> image_;
+
+    ouster::viz::AutoExposure nearir_ae_, signal_ae_, reflec_ae_;
+    ouster::viz::BeamUniformityCorrector nearir_buc_;
+};
+
+/**
+ * Batches the packets of a sensor into scans and converts them on a pool of
+ * workers, publishing the same topics as the OusterCloud and OusterImage
+ * nodelets without passing packets through ROS. Point clouds are projected
+ * in parallel, then clouds and images are published in the order of scans.
+ *
+ * Packets are added from a single thread. Adding never waits for the
+ * workers: when they are all busy, completed scans are dropped.
+ */
+class ScanPipeline {
+   public:
+    /**
+     * Start the workers.
+     * @param[in] info sensor metadata
+     * @param[in] nh the node handle to advertise topics with
+     * @param[in] tf_prefix namespace for tf transforms, empty for none
+     * @param[in] config what part of scans to convert to point clouds
+     * @param[in] use_ros_time stamp messages with the time packets were
+     * received instead of the time of measurement
+     * @param[in] n_workers the number of worker threads
+     * @param[in] diagnostics where to report the timings of scans, if any;
+     * must outlive the pipeline
+     */
+    ScanPipeline(const sensor::sensor_info& info, ros::NodeHandle& nh,
+                 const std::string& tf_prefix, const CloudConfig& config,
+                 bool use_ros_time, int n_workers,
+                 ScanDiagnostics* diagnostics = nullptr);
+
+    /** Stop the workers, dropping scans that haven't been picked up yet */
+    ~ScanPipeline();
+
+    /**
+     * Batch a lidar packet, handing the scan to the workers when complete
+     * @param[in] buf the packet
+     * @param[in] receive_time when the packet was received
+     */
+    void add_lidar_packet(const uint8_t* buf, const ros::Time& receive_time);
+
+    /**
+     * Publish an imu packet as an imu message
+     * @param[in] pm the packet
+     * @param[in] receive_time when the packet was received
+     */
+    void add_imu_packet(const PacketMsg& pm, const ros::Time& receive_time);
+
+   private:
+    struct Job {
+        uint64_t seq;
+        ouster::LidarScanPool::Handle scan;
+        std::chrono::nanoseconds scan_ts;
+        ros::Time stamp;
+        ScanTimings timings;
+        ouster::BatcherStats stats;
+    };
+
+    void work();
+
+    const sensor::sensor_info info_;
+    const sensor::packet_format& pf_;
+    const bool use_ros_time_;
+    const size_t max_jobs_;
+    std::string sensor_frame_, imu_frame_, lidar_frame_;
+
+    ScanDiagnostics* const diagnostics_;
+    CloudConverter clouds_;
+    ImagePublisher images_;
+    std::vector<ros::Publisher> cloud_pubs_;
+    ros::Publisher imu_pub_;
+    tf2_ros::StaticTransformBroadcaster tf_bcast_;
+
+    // only used from the thread adding packets
+    ouster::ScanBatcher batcher_;
+    ouster::LidarScanPool scan_pool_;
+    ouster::LidarScanPool::Handle scan_;
+    ros::Time frame_ts_;  // receive time of the first packet of the frame
+    std::chrono::nanoseconds batching_{0};  // spent on the frame so far
+
+    std::mutex mtx_;
+    std::condition_variable job_cv_;   // signaled when jobs are added
+    std::condition_variable turn_cv_;  // signaled when a scan is published
+    std::deque<Job> jobs_;
+    uint64_t next_seq_{0};      // of the next job added
+    uint64_t next_publish_{0};  // of the next job to publish
+    bool stop_{false};
+    std::vector<std::thread> workers_;
+};
+
+}  // namespace ouster_ros
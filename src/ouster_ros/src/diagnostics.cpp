@@ -0,0 +1,173 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file diagnostics.cpp
+ * @brief Latency and drop diagnostics of the nodelets converting scans
+ */
+
+#include "ouster_ros/diagnostics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace ouster_ros {
+
+using diagnostic_msgs::DiagnosticStatus;
+
+namespace {
+
+std::string format(double v, int precision = 2) {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(precision) << v;
+    return ss.str();
+}
+
+void add_value(DiagnosticStatus& status, const std::string& key,
+               const std::string& value) {
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = value;
+    status.values.push_back(kv);
+}
+
+double to_ms(std::chrono::nanoseconds d) { return d.count() * 1e-6; }
+
+// columns of a scan outside of the column window, which wraps around
+uint64_t cols_outside_window(const ouster::sensor::sensor_info& info) {
+    const int w = info.format.columns_per_frame;
+    const auto& window = info.format.column_window;
+    const int inside = window.first <= window.second
+                           ? window.second - window.first + 1
+                           : w - window.first + window.second + 1;
+    return static_cast<uint64_t>(std::max(w - inside, 0));
+}
+
+}  // namespace
+
+void ScanDiagnostics::Summary::add(double v) {
+    n++;
+    sum += v;
+    max = std::max(max, v);
+}
+
+ScanDiagnostics::ScanDiagnostics(ros::NodeHandle& nh, const std::string& name,
+                                 const ouster::sensor::sensor_info& info,
+                                 double period)
+    : name_{name},
+      hardware_id_{info.sn},
+      period_{period},
+      window_zeroed_cols_{cols_outside_window(info)},
+      pub_{nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics",
+                                                          10)} {}
+
+void ScanDiagnostics::add_scan(const ScanTimings& t,
+                               const ouster::BatcherStats& stats) {
+    const auto now = ros::Time::now();
+    std::lock_guard<std::mutex> lock{mtx_};
+    any_scans_ = true;
+    scans_++;
+    latency_.add((now - t.last_rx).toSec() * 1e3);
+    age_.add((now - t.first_rx).toSec() * 1e3);
+    batching_.add(to_ms(t.batching));
+    projection_.add(to_ms(t.projection));
+
+    // counters are cumulative, and restart with a new batcher
+    if (stats.scans <= last_stats_.scans) last_stats_ = {};
+    packets_ += stats.packets - last_stats_.packets;
+    batched_scans_ += stats.scans - last_stats_.scans;
+    zeroed_cols_ += stats.zeroed_cols - last_stats_.zeroed_cols;
+    reordered_packets_ +=
+        stats.reordered_packets - last_stats_.reordered_packets;
+    last_stats_ = stats;
+    publish_if_due(now);
+}
+
+void ScanDiagnostics::add_dropped_scan() {
+    std::lock_guard<std::mutex> lock{mtx_};
+    dropped_scans_++;
+}
+
+void ScanDiagnostics::add_received_packets(int n, int64_t kernel_drops) {
+    const auto now = ros::Time::now();
+    std::lock_guard<std::mutex> lock{mtx_};
+    any_packets_ = true;
+    received_packets_ += n;
+    if (kernel_drops >= 0) {
+        if (last_kernel_drops_ >= 0)
+            kernel_drops_ += kernel_drops - last_kernel_drops_;
+        last_kernel_drops_ = kernel_drops;
+    }
+    publish_if_due(now);
+}
+
+void ScanDiagnostics::publish_if_due(const ros::Time& now) {
+    if (period_start_.isZero()) period_start_ = now;
+    const double elapsed = (now - period_start_).toSec();
+    if (elapsed < period_) return;
+
+    DiagnosticStatus status;
+    status.name = name_;
+    status.hardware_id = hardware_id_;
+    status.level = DiagnosticStatus::OK;
+    status.message = "OK";
+    auto warn = [&](bool lost, const char* what) {
+        if (!lost) return;
+        if (status.level == DiagnosticStatus::OK) status.message.clear();
+        status.level = DiagnosticStatus::WARN;
+        if (!status.message.empty()) status.message += ", ";
+        status.message += what;
+    };
+
+    if (any_packets_) {
+        add_value(status, "Lidar packets per second",
+                  format(received_packets_ / elapsed, 0));
+        if (last_kernel_drops_ >= 0)
+            add_value(status, "Kernel packet drops",
+                      std::to_string(kernel_drops_));
+        warn(kernel_drops_ > 0, "socket buffer overflows");
+    }
+
+    if (any_scans_) {
+        add_value(status, "Scans per second", format(scans_ / elapsed));
+        add_value(status, "Receive to publish latency mean (ms)",
+                  format(latency_.mean()));
+        add_value(status, "Receive to publish latency max (ms)",
+                  format(latency_.max));
+        add_value(status, "First packet to publish mean (ms)",
+                  format(age_.mean()));
+        add_value(status, "Batching time mean (ms)",
+                  format(batching_.mean()));
+        add_value(status, "Batching time max (ms)", format(batching_.max));
+        add_value(status, "Projection time mean (ms)",
+                  format(projection_.mean()));
+        add_value(status, "Projection time max (ms)",
+                  format(projection_.max));
+        const double per_scan = batched_scans_ ? 1.0 / batched_scans_ : 0;
+        add_value(status, "Packets per scan", format(packets_ * per_scan, 1));
+        add_value(status, "Zeroed columns per scan",
+                  format(zeroed_cols_ * per_scan, 1));
+        add_value(status, "Reordered packets dropped",
+                  std::to_string(reordered_packets_));
+        add_value(status, "Scans dropped", std::to_string(dropped_scans_));
+        warn(zeroed_cols_ > window_zeroed_cols_ * batched_scans_,
+             "incomplete scans");
+        warn(reordered_packets_ > 0, "reordered packets");
+        warn(dropped_scans_ > 0, "dropped scans");
+    }
+
+    auto msg = boost::make_shared<diagnostic_msgs::DiagnosticArray>();
+    msg->header.stamp = now;
+    msg->status.push_back(status);
+    pub_.publish(msg);
+
+    period_start_ = now;
+    scans_ = dropped_scans_ = received_packets_ = 0;
+    packets_ = batched_scans_ = zeroed_cols_ = reordered_packets_ =
+        kernel_drops_ = 0;
+    latency_ = age_ = batching_ = projection_ = Summary{};
+}
+
+}  // namespace ouster_ros
@@ -19,16 +19,24 @@
 #include <chrono>
 #include <memory>
 #include <queue>
+#include <utility>
+#include <vector>
 
 #include "ouster/lidar_scan.h"
+#include "ouster/trace.h"
 #include "ouster/types.h"
 #include "ouster_ros/GetMetadata.h"
+#include "ouster_ros/PacketBatchMsg.h"
 #include "ouster_ros/PacketMsg.h"
+#include "ouster_ros/diagnostics.h"
+#include "ouster_ros/message_pool.h"
 #include "ouster_ros/ros.h"
+#include "ouster_ros/scan_processing.h"
 
 namespace sensor = ouster::sensor;
+using ouster_ros::PacketBatchMsg;
 using ouster_ros::PacketMsg;
-using sensor::UDPProfileLidar;
+using CloudMsgPool = ouster_ros::MessagePool<sensor_msgs::PointCloud2>;
 using namespace std::chrono_literals;
 
 namespace nodelets_os {
@@ -46,6 +54,9 @@ class OusterCloud : public nodelet::Nodelet {
         auto timestamp_mode_arg = pnh.param("timestamp_mode", std::string{});
         use_ros_time = (timestamp_mode_arg == "TIME_FROM_ROS_TIME");
 
+        const auto cloud_config = ouster_ros::cloud_config_of_params(pnh);
+        const auto diagnostics_period = pnh.param("diagnostics_period", 1.0);
+
         auto& nh = getNodeHandle();
         ouster_ros::GetMetadata metadata{};
         auto client = nh.serviceClient<ouster_ros::GetMetadata>("get_metadata");
@@ -62,10 +73,7 @@ class OusterCloud : public nodelet::Nodelet {
         uint32_t H = info.format.pixels_per_column;
         uint32_t W = info.format.columns_per_frame;
 
-        n_returns = info.format.udp_profile_lidar ==
-                            UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL
-                        ? 2
-                        : 1;
+        n_returns = ouster_ros::num_returns(info);
 
         NODELET_INFO_STREAM("Profile has " << n_returns << " return(s)");
 
@@ -77,25 +85,29 @@ class OusterCloud : public nodelet::Nodelet {
         };
 
         lidar_pubs.resize(n_returns);
+        cloud_pools.assign(n_returns, CloudMsgPool{4});
         for (int i = 0; i < n_returns; i++) {
             auto pub = nh.advertise<sensor_msgs::PointCloud2>(
                 std::string("points") + img_suffix(i), 10);
             lidar_pubs[i] = pub;
         }
 
-        xyz_lut = ouster::make_xyz_lut(info);
-
+        clouds = std::make_unique<ouster_ros::CloudConverter>(info,
+                                                              cloud_config);
         ls = ouster::LidarScan{W, H, info.format.udp_profile_lidar};
-        cloud = ouster_ros::Cloud{W, H};
-
-        scan_batcher = std::make_unique<ouster::ScanBatcher>(info);
 
-        auto lidar_handler = use_ros_time
-                                 ? &OusterCloud::lidar_handler_ros_time
-                                 : &OusterCloud::lidar_handler_sensor_time;
-
-        lidar_packet_sub =
-            nh.subscribe<PacketMsg>("lidar_packets", 2048, lidar_handler, this);
+        scan_batcher = std::make_unique<ouster::ScanBatcher>(
+            info, ouster::BATCH_LAZY_ZERO | ouster::BATCH_NO_BLOCK_HEADERS);
+        if (diagnostics_period > 0)
+            diagnostics = std::make_unique<ouster_ros::ScanDiagnostics>(
+                nh, getName(), info, diagnostics_period);
+
+        // packets arrive one per message or batched, see OusterSensor
+        lidar_packet_sub = nh.subscribe<PacketMsg>(
+            "lidar_packets", 2048, &OusterCloud::lidar_handler, this);
+        lidar_batch_sub = nh.subscribe<PacketBatchMsg>(
+            "lidar_packet_batches", 20, &OusterCloud::lidar_batch_handler,
+            this);
         imu_packet_sub = nh.subscribe<PacketMsg>(
             "imu_packets", 100, &OusterCloud::imu_handler, this);
 
@@ -107,42 +119,79 @@ class OusterCloud : public nodelet::Nodelet {
             info.lidar_to_sensor_transform, sensor_frame, lidar_frame));
     }
 
-    void convert_scan_to_pointcloud_publish(std::chrono::nanoseconds scan_ts,
-                                            const ros::Time& msg_ts) {
+    // returns the time spent projecting point clouds
+    std::chrono::nanoseconds convert_scan_to_pointcloud_publish(
+        std::chrono::nanoseconds scan_ts, const ros::Time& msg_ts) {
+        // only convert the returns someone listens to, in a single projection
+        std::vector<boost::shared_ptr<sensor_msgs::PointCloud2>> msgs(
+            n_returns);
+        std::vector<sensor_msgs::PointCloud2*> msg_ptrs(n_returns, nullptr);
+        bool any = false;
         for (int i = 0; i < n_returns; ++i) {
-            scan_to_cloud(xyz_lut, scan_ts, ls, cloud, i);
-            sensor_msgs::PointCloud2 pc =
-                ouster_ros::cloud_to_cloud_msg(cloud, msg_ts, sensor_frame);
-            sensor_msgs::PointCloud2Ptr pc_ptr =
-                boost::make_shared<sensor_msgs::PointCloud2>(pc);
-            lidar_pubs[i].publish(pc_ptr);
+            if (lidar_pubs[i].getNumSubscribers() == 0) continue;
+            msgs[i] = cloud_pools[i].acquire();
+            msg_ptrs[i] = msgs[i].get();
+            any = true;
         }
+        if (!any) return {};
+
+        const auto start = std::chrono::steady_clock::now();
+        (*clouds)(ls, scan_ts, msg_ptrs);
+        const auto projection = std::chrono::steady_clock::now() - start;
+
+        for (int i = 0; i < n_returns; ++i) {
+            if (!msgs[i]) continue;
+            // publish by pointer, without copies for nodelets in process
+            msgs[i]->header.stamp = msg_ts;
+            msgs[i]->header.frame_id = sensor_frame;
+            lidar_pubs[i].publish(msgs[i]);
+        }
+        return projection;
     }
 
-    void lidar_handler_sensor_time(const PacketMsg::ConstPtr& packet) {
-        if (!(*scan_batcher)(packet->buf.data(), ls)) return;
-        auto ts_v = ls.timestamp();
-        auto idx = std::find_if(ts_v.data(), ts_v.data() + ts_v.size(),
-                                [](uint64_t h) { return h != 0; });
-        if (idx == ts_v.data() + ts_v.size()) return;
-        auto scan_ts = std::chrono::nanoseconds{ts_v(idx - ts_v.data())};
-        convert_scan_to_pointcloud_publish(scan_ts, to_ros_time(scan_ts));
+    void lidar_handler(const PacketMsg::ConstPtr& packet) {
+        handle_lidar_packet(packet->buf.data(), ros::Time::now());
     }
 
-    void lidar_handler_ros_time(const PacketMsg::ConstPtr& packet) {
-        auto packet_receive_time = ros::Time::now();
-        static auto frame_ts = packet_receive_time;  // first point cloud time
-        if (!(*scan_batcher)(packet->buf.data(), ls)) return;
+    void lidar_batch_handler(const PacketBatchMsg::ConstPtr& batch) {
+        const auto receive_time = ros::Time::now();
+        const size_t packet_size = sensor::get_format(info).lidar_packet_size;
+        for (auto offset : batch->offsets) {
+            if (offset + packet_size > batch->buf.size()) {
+                NODELET_ERROR_THROTTLE(1, "OusterCloud: truncated batch");
+                return;
+            }
+            handle_lidar_packet(batch->buf.data() + offset, receive_time);
+        }
+    }
+
+    void handle_lidar_packet(const uint8_t* buf,
+                             const ros::Time& packet_receive_time) {
+        OUSTER_TRACE_SCOPE("OusterCloud.lidar_packet");
+        using clock = std::chrono::steady_clock;
+        if (frame_ts.isZero()) frame_ts = packet_receive_time;
+        const auto start = diagnostics ? clock::now() : clock::time_point{};
+        const bool done = (*scan_batcher)(buf, ls);
+        if (diagnostics) batching += clock::now() - start;
+        if (!done) return;
+
+        ouster_ros::ScanTimings timings{frame_ts, packet_receive_time,
+                                        std::exchange(batching, {}), {}};
+        frame_ts = packet_receive_time;  // time for next point cloud msg
         auto ts_v = ls.timestamp();
         auto idx = std::find_if(ts_v.data(), ts_v.data() + ts_v.size(),
                                 [](uint64_t h) { return h != 0; });
         if (idx == ts_v.data() + ts_v.size()) return;
         auto scan_ts = std::chrono::nanoseconds{ts_v(idx - ts_v.data())};
-        convert_scan_to_pointcloud_publish(scan_ts, frame_ts);
-        frame_ts = packet_receive_time;  // set time for next point cloud msg
+        const ros::Time msg_ts =
+            use_ros_time ? timings.first_rx : to_ros_time(scan_ts);
+        timings.projection =
+            convert_scan_to_pointcloud_publish(scan_ts, msg_ts);
+        if (diagnostics) diagnostics->add_scan(timings, scan_batcher->stats());
     }
 
     void imu_handler(const PacketMsg::ConstPtr& packet) {
+        if (imu_pub.getNumSubscribers() == 0) return;
         auto pf = sensor::get_format(info);
         ros::Time msg_ts =
             use_ros_time ? ros::Time::now()
@@ -166,16 +215,17 @@ class OusterCloud : public nodelet::Nodelet {
 
    private:
     ros::Subscriber lidar_packet_sub;
+    ros::Subscriber lidar_batch_sub;
     std::vector<ros::Publisher> lidar_pubs;
+    std::vector<CloudMsgPool> cloud_pools;
     ros::Subscriber imu_packet_sub;
     ros::Publisher imu_pub;
 
     sensor::sensor_info info;
     int n_returns = 0;
 
-    ouster::XYZLut xyz_lut;
+    std::unique_ptr<ouster_ros::CloudConverter> clouds;
     ouster::LidarScan ls;
-    ouster_ros::Cloud cloud;
     std::unique_ptr<ouster::ScanBatcher> scan_batcher;
 
     std::string sensor_frame;
@@ -185,6 +235,10 @@ class OusterCloud : public nodelet::Nodelet {
     tf2_ros::StaticTransformBroadcaster tf_bcast;
 
     bool use_ros_time;
+    ros::Time frame_ts;  // receive time of the first packet of the frame
+
+    std::unique_ptr<ouster_ros::ScanDiagnostics> diagnostics;
+    std::chrono::nanoseconds batching{0};  // spent on the frame so far
 };
 }  // namespace nodelets_os
 
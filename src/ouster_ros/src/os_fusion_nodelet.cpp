@@ -0,0 +1,236 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file os_fusion_nodelet.cpp
+ * @brief A nodelet to publish the points of several sensors as one cloud
+ */
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <ros/console.h>
+#include <ros/ros.h>
+#include <ros/service.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf2_eigen/tf2_eigen.h>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ouster/fusion.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+#include "ouster_ros/GetMetadata.h"
+#include "ouster_ros/PacketBatchMsg.h"
+#include "ouster_ros/PacketMsg.h"
+#include "ouster_ros/message_pool.h"
+
+namespace sensor = ouster::sensor;
+namespace fusion = ouster::fusion;
+using ouster_ros::PacketBatchMsg;
+using ouster_ros::PacketMsg;
+using CloudMsgPool = ouster_ros::MessagePool<sensor_msgs::PointCloud2>;
+
+namespace nodelets_os {
+class OusterFusion : public nodelet::Nodelet {
+   private:
+    virtual void onInit() override {
+        auto& pnh = getPrivateNodeHandle();
+        auto& nh = getNodeHandle();
+
+        std::vector<std::string> namespaces, frames;
+        pnh.getParam("sensors", namespaces);
+        pnh.getParam("sensor_frames", frames);
+        if (namespaces.empty()) {
+            auto error_msg = "OusterFusion: no sensors to fuse";
+            NODELET_ERROR_STREAM(error_msg);
+            throw std::runtime_error(error_msg);
+        }
+        // the frames of sensors launched with their namespace as tf_prefix
+        if (frames.empty()) {
+            for (const auto& ns : namespaces)
+                frames.push_back(ns.substr(ns.find_first_not_of('/')) +
+                                 "/os_sensor");
+        }
+        if (frames.size() != namespaces.size()) {
+            auto error_msg = "OusterFusion: expected a frame for each sensor";
+            NODELET_ERROR_STREAM(error_msg);
+            throw std::runtime_error(error_msg);
+        }
+        fixed_frame = pnh.param("fixed_frame", std::string{"base_link"});
+        const auto tf_timeout = pnh.param("tf_timeout", 10.0);
+
+        tf2_ros::Buffer tf_buffer;
+        tf2_ros::TransformListener tf_listener{tf_buffer};
+        std::vector<fusion::FusedSensor> sensors;
+        for (size_t i = 0; i < namespaces.size(); i++) {
+            const auto info = get_metadata(nh, namespaces[i]);
+            const auto tf = tf_buffer.lookupTransform(
+                fixed_frame, frames[i], ros::Time(0),
+                ros::Duration(tf_timeout));
+            sensors.push_back({info, tf2::transformToEigen(tf).matrix()});
+            NODELET_INFO_STREAM("OusterFusion: fusing " << namespaces[i]
+                                << " in frame " << frames[i]);
+
+            Stream s;
+            s.packet_size = sensor::get_format(info).lidar_packet_size;
+            s.batcher = std::make_unique<ouster::ScanBatcher>(
+                info, ouster::BATCH_LAZY_ZERO | ouster::BATCH_NO_BLOCK_HEADERS);
+            s.ls = ouster::LidarScan{info.format.columns_per_frame,
+                                     info.format.pixels_per_column,
+                                     info.format.udp_profile_lidar};
+            streams.push_back(std::move(s));
+        }
+
+        // windows of a rotation of the first sensor by default
+        const double period =
+            1.0 / sensor::frequency_of_lidar_mode(sensors.front().info.mode);
+        const auto window = pnh.param("window", period);
+        fusion::FuserConfig config;
+        config.window_ns = static_cast<uint64_t>(window * 1e9);
+        config.window_offset_ns =
+            static_cast<uint64_t>(pnh.param("window_offset", 0.0) * 1e9);
+        config.max_delay_ns =
+            static_cast<uint64_t>(pnh.param("max_delay", window) * 1e9);
+        fuser = std::make_unique<fusion::ScanFuser>(
+            sensors, config,
+            [this](const fusion::FusedCloud& c) { publish_cloud(c); });
+        NODELET_INFO_STREAM("OusterFusion: clouds of up to "
+                            << fuser->capacity() << " points every "
+                            << window << "s");
+
+        cloud_pub = nh.advertise<sensor_msgs::PointCloud2>("points", 10);
+
+        // packets arrive one per message or batched, see OusterSensor
+        for (size_t i = 0; i < namespaces.size(); i++) {
+            const auto& ns = namespaces[i];
+            boost::function<void(const PacketMsg::ConstPtr&)> on_packet =
+                [this, i](const PacketMsg::ConstPtr& packet) {
+                    std::lock_guard<std::mutex> lock{mtx};
+                    handle_lidar_packet(i, packet->buf.data());
+                };
+            boost::function<void(const PacketBatchMsg::ConstPtr&)> on_batch =
+                [this, i](const PacketBatchMsg::ConstPtr& batch) {
+                    lidar_batch_handler(i, *batch);
+                };
+            streams[i].packet_sub =
+                nh.subscribe<PacketMsg>(ns + "/lidar_packets", 2048, on_packet);
+            streams[i].batch_sub = nh.subscribe<PacketBatchMsg>(
+                ns + "/lidar_packet_batches", 20, on_batch);
+        }
+    }
+
+    sensor::sensor_info get_metadata(ros::NodeHandle& nh,
+                                     const std::string& ns) {
+        ouster_ros::GetMetadata metadata{};
+        auto client =
+            nh.serviceClient<ouster_ros::GetMetadata>(ns + "/get_metadata");
+        client.waitForExistence();
+        if (!client.call(metadata)) {
+            auto error_msg =
+                "OusterFusion: Calling get_metadata service of " + ns +
+                " failed";
+            NODELET_ERROR_STREAM(error_msg);
+            throw std::runtime_error(error_msg);
+        }
+        return sensor::parse_metadata(metadata.response.metadata);
+    }
+
+    void lidar_batch_handler(size_t i, const PacketBatchMsg& batch) {
+        std::lock_guard<std::mutex> lock{mtx};
+        const size_t packet_size = streams[i].packet_size;
+        for (auto offset : batch.offsets) {
+            if (offset + packet_size > batch.buf.size()) {
+                NODELET_ERROR_THROTTLE(1, "OusterFusion: truncated batch");
+                return;
+            }
+            handle_lidar_packet(i, batch.buf.data() + offset);
+        }
+    }
+
+    // called with the lock held
+    void handle_lidar_packet(size_t i, const uint8_t* buf) {
+        auto& s = streams[i];
+        if (!(*s.batcher)(buf, s.ls)) return;
+        if (cloud_pub.getNumSubscribers() == 0) return;
+
+        fuser->add(i, s.ls);
+        const auto stats = fuser->stats();
+        if (stats.late_columns > late_columns) {
+            NODELET_WARN_THROTTLE(
+                1, "OusterFusion: dropped %lu late columns",
+                static_cast<unsigned long>(stats.late_columns - late_columns));
+            late_columns = stats.late_columns;
+        }
+    }
+
+    // called with the lock held, from handle_lidar_packet
+    void publish_cloud(const fusion::FusedCloud& cloud) {
+        auto msg = cloud_pool.acquire();
+        if (msg->fields.empty()) describe_points(*msg);
+        msg->header.stamp.fromNSec(cloud.ts);
+        msg->header.frame_id = fixed_frame;
+        msg->height = 1;
+        msg->width = static_cast<uint32_t>(cloud.size);
+        msg->is_bigendian = false;
+        msg->is_dense = true;
+        msg->point_step = sizeof(fusion::FusedPoint);
+        msg->row_step = msg->point_step * msg->width;
+        msg->data.resize(msg->row_step);
+        std::memcpy(msg->data.data(), cloud.points.data(), msg->row_step);
+        // publish by pointer, without copies for nodelets in process
+        cloud_pub.publish(msg);
+    }
+
+    // the fields of fusion::FusedPoint, in its layout
+    static void describe_points(sensor_msgs::PointCloud2& msg) {
+        using sensor_msgs::PointField;
+        auto add = [&](const char* name, uint32_t offset, uint8_t datatype) {
+            PointField f;
+            f.name = name;
+            f.offset = offset;
+            f.datatype = datatype;
+            f.count = 1;
+            msg.fields.push_back(f);
+        };
+        using P = fusion::FusedPoint;
+        add("x", offsetof(P, x), PointField::FLOAT32);
+        add("y", offsetof(P, y), PointField::FLOAT32);
+        add("z", offsetof(P, z), PointField::FLOAT32);
+        add("t", offsetof(P, t), PointField::UINT32);
+        add("range", offsetof(P, range), PointField::UINT32);
+        add("intensity", offsetof(P, signal), PointField::UINT16);
+        add("reflectivity", offsetof(P, reflectivity), PointField::UINT16);
+        add("ring", offsetof(P, ring), PointField::UINT16);
+        add("sensor", offsetof(P, sensor), PointField::UINT16);
+    }
+
+   private:
+    struct Stream {
+        size_t packet_size{0};
+        std::unique_ptr<ouster::ScanBatcher> batcher;
+        ouster::LidarScan ls;
+        ros::Subscriber packet_sub;
+        ros::Subscriber batch_sub;
+    };
+
+    std::string fixed_frame;
+    ros::Publisher cloud_pub;
+    CloudMsgPool cloud_pool{4};
+
+    // batching and fusing scans of all sensors is serialized
+    std::mutex mtx;
+    std::vector<Stream> streams;
+    std::unique_ptr<fusion::ScanFuser> fuser;
+    uint64_t late_columns{0};
+};
+}  // namespace nodelets_os
+
+PLUGINLIB_EXPORT_CLASS(nodelets_os::OusterFusion, nodelet::Nodelet)
@@ -4,48 +4,44 @@
  *
  * @file os_image_nodelet.cpp
  * @brief A nodelet to decode range, near ir and signal images from ouster
- * point cloud
+ * lidar packets
  *
  * Publishes ~/range_image, ~/nearir_image, and ~/signal_image.  Please bear
  * in mind that there is rounding/clamping to display 8 bit images. For computer
  * vision applications, use higher bit depth values in /os_cloud_node/points
+ *
+ * Images are batched straight from the lidar packets, destaggered as they are
+ * parsed, rather than from the point clouds of OusterCloud.
  */
 
 #include <nodelet/nodelet.h>
-#include <pcl/conversions.h>
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
-#include <pcl_conversions/pcl_conversions.h>
 #include <pluginlib/class_list_macros.h>
 #include <ros/ros.h>
-#include <sensor_msgs/Image.h>
-#include <sensor_msgs/PointCloud2.h>
-#include <sensor_msgs/image_encodings.h>
 
-#include <iomanip>
-#include <iostream>
-#include <sstream>
+#include <algorithm>
+#include <memory>
 #include <string>
-#include <thread>
-#include <vector>
 
-#include "ouster/client.h"
-#include "ouster/image_processing.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/trace.h"
 #include "ouster/types.h"
 #include "ouster_ros/GetMetadata.h"
-#include "ouster_ros/ros.h"
+#include "ouster_ros/PacketBatchMsg.h"
+#include "ouster_ros/PacketMsg.h"
+#include "ouster_ros/scan_processing.h"
 
 namespace sensor = ouster::sensor;
-namespace viz = ouster::viz;
-using sensor::UDPProfileLidar;
-
-using pixel_type = uint16_t;
-const size_t pixel_value_max = std::numeric_limits<pixel_type>::max();
+using ouster_ros::PacketBatchMsg;
+using ouster_ros::PacketMsg;
 
 namespace nodelets_os {
 class OusterImage : public nodelet::Nodelet {
    private:
     virtual void onInit() override {
+        auto& pnh = getPrivateNodeHandle();
+        auto timestamp_mode_arg = pnh.param("timestamp_mode", std::string{});
+        use_ros_time = (timestamp_mode_arg == "TIME_FROM_ROS_TIME");
+
         auto& nh = getNodeHandle();
 
         ouster_ros::GetMetadata metadata{};
@@ -60,157 +56,70 @@ class OusterImage : public nodelet::Nodelet {
         NODELET_INFO("OusterImage: retrieved sensor metadata!");
 
         info = sensor::parse_metadata(metadata.response.metadata);
-
-        const int n_returns =
-            info.format.udp_profile_lidar ==
-                    UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL
-                ? 2
-                : 1;
-
-        nearir_image_pub =
-            nh.advertise<sensor_msgs::Image>("nearir_image", 100);
-
-        auto topic = [](auto base, int ind) {
-            if (ind == 0) return std::string(base);
-            return std::string(base) +
-                   std::to_string(ind + 1);  // need second return to return 2
-        };
-
-        ros::Publisher a_pub;
-        for (int i = 0; i < n_returns; i++) {
-            a_pub =
-                nh.advertise<sensor_msgs::Image>(topic("range_image", i), 100);
-            range_image_pubs.push_back(a_pub);
-
-            a_pub =
-                nh.advertise<sensor_msgs::Image>(topic("signal_image", i), 100);
-            signal_image_pubs.push_back(a_pub);
-
-            a_pub =
-                nh.advertise<sensor_msgs::Image>(topic("reflec_image", i), 100);
-            reflec_image_pubs.push_back(a_pub);
-        }
+        images = std::make_unique<ouster_ros::ImagePublisher>(info, nh);
 
         uint32_t H = info.format.pixels_per_column;
         uint32_t W = info.format.columns_per_frame;
-        cloud = ouster_ros::Cloud{W, H};
-
-        // image processing
-        pc1_sub = nh.subscribe<sensor_msgs::PointCloud2>(
-            topic("points", 0), 100, &OusterImage::first_cloud_handler, this);
-
-        if (n_returns > 1) {
-            pc2_sub = nh.subscribe<sensor_msgs::PointCloud2>(
-                topic("points", 1), 100, &OusterImage::second_cloud_handler,
-                this);
-        }
+        ls = ouster::LidarScan{W, H, info.format.udp_profile_lidar};
+
+        // batch scans destaggered, ready to be copied into images
+        scan_batcher = std::make_unique<ouster::ScanBatcher>(
+            info, ouster::BATCH_DESTAGGER | ouster::BATCH_NO_BLOCK_HEADERS);
+
+        // image processing, from the same packets as OusterCloud
+        lidar_packet_sub = nh.subscribe<PacketMsg>(
+            "lidar_packets", 2048, &OusterImage::lidar_handler, this);
+        lidar_batch_sub = nh.subscribe<PacketBatchMsg>(
+            "lidar_packet_batches", 20, &OusterImage::lidar_batch_handler,
+            this);
     }
 
-    void base_cloud_handler(const sensor_msgs::PointCloud2::ConstPtr& m,
-                            int return_index) {
-        pcl::fromROSMsg(*m, cloud);
-
-        const bool first = (return_index == 0);
-        uint32_t H = info.format.pixels_per_column;
-        uint32_t W = info.format.columns_per_frame;
+    void lidar_handler(const PacketMsg::ConstPtr& packet) {
+        handle_lidar_packet(packet->buf.data(), ros::Time::now());
+    }
 
-        auto range_image = make_image_msg(H, W, m->header.stamp);
-        auto signal_image = make_image_msg(H, W, m->header.stamp);
-        auto reflec_image = make_image_msg(H, W, m->header.stamp);
-        auto nearir_image = make_image_msg(H, W, m->header.stamp);
-
-        ouster::img_t<float> nearir_image_eigen(H, W);
-        ouster::img_t<float> signal_image_eigen(H, W);
-        ouster::img_t<float> reflec_image_eigen(H, W);
-
-        // views into message data
-        auto range_image_map = Eigen::Map<ouster::img_t<pixel_type>>(
-            (pixel_type*)range_image->data.data(), H, W);
-        auto signal_image_map = Eigen::Map<ouster::img_t<pixel_type>>(
-            (pixel_type*)signal_image->data.data(), H, W);
-        auto reflec_image_map = Eigen::Map<ouster::img_t<pixel_type>>(
-            (pixel_type*)reflec_image->data.data(), H, W);
-
-        auto nearir_image_map = Eigen::Map<ouster::img_t<pixel_type>>(
-            (pixel_type*)nearir_image->data.data(), H, W);
-
-        const auto& px_offset = info.format.pixel_shift_by_row;
-
-        // copy data out of Cloud message, with destaggering
-        for (size_t u = 0; u < H; u++) {
-            for (size_t v = 0; v < W; v++) {
-                const size_t vv = (v + W - px_offset[u]) % W;
-                const auto& pt = cloud[u * W + vv];
-
-                // 16 bit img: use 4mm resolution and throw out returns >
-                // 260m
-                auto r = (pt.range + 0b10) >> 2;
-                range_image_map(u, v) = r > pixel_value_max ? 0 : r;
-
-                signal_image_eigen(u, v) = pt.intensity;
-                reflec_image_eigen(u, v) = pt.reflectivity;
-                nearir_image_eigen(u, v) = pt.ambient;
+    void lidar_batch_handler(const PacketBatchMsg::ConstPtr& batch) {
+        const auto receive_time = ros::Time::now();
+        const size_t packet_size = sensor::get_format(info).lidar_packet_size;
+        for (auto offset : batch->offsets) {
+            if (offset + packet_size > batch->buf.size()) {
+                NODELET_ERROR_THROTTLE(1, "OusterImage: truncated batch");
+                return;
             }
+            handle_lidar_packet(batch->buf.data() + offset, receive_time);
         }
-
-        signal_ae(signal_image_eigen, first);
-        reflec_ae(reflec_image_eigen, first);
-        nearir_buc(nearir_image_eigen);
-        nearir_ae(nearir_image_eigen, first);
-        nearir_image_eigen = nearir_image_eigen.sqrt();
-        signal_image_eigen = signal_image_eigen.sqrt();
-
-        // copy data into image messages
-        signal_image_map =
-            (signal_image_eigen * pixel_value_max).cast<pixel_type>();
-        reflec_image_map =
-            (reflec_image_eigen * pixel_value_max).cast<pixel_type>();
-        if (first) {
-            nearir_image_map =
-                (nearir_image_eigen * pixel_value_max).cast<pixel_type>();
-            nearir_image_pub.publish(nearir_image);
-        }
-
-        // publish at return index
-        range_image_pubs[return_index].publish(range_image);
-        signal_image_pubs[return_index].publish(signal_image);
-        reflec_image_pubs[return_index].publish(reflec_image);
-    }
-
-    void first_cloud_handler(const sensor_msgs::PointCloud2::ConstPtr& m) {
-        base_cloud_handler(m, 0);
-    }
-
-    void second_cloud_handler(const sensor_msgs::PointCloud2::ConstPtr& m) {
-        base_cloud_handler(m, 1);
     }
 
-    static sensor_msgs::ImagePtr make_image_msg(size_t H, size_t W,
-                                                const ros::Time& stamp) {
-        auto msg = boost::make_shared<sensor_msgs::Image>();
-        msg->width = W;
-        msg->height = H;
-        msg->step = W * sizeof(pixel_type);
-        msg->encoding = sensor_msgs::image_encodings::MONO16;
-        msg->data.resize(W * H * sizeof(pixel_type));
-        msg->header.stamp = stamp;
-        return msg;
+    void handle_lidar_packet(const uint8_t* buf,
+                             const ros::Time& packet_receive_time) {
+        OUSTER_TRACE_SCOPE("OusterImage.lidar_packet");
+        if (frame_ts.isZero()) frame_ts = packet_receive_time;
+        if (!(*scan_batcher)(buf, ls)) return;
+        auto ts_v = ls.timestamp();
+        auto idx = std::find_if(ts_v.data(), ts_v.data() + ts_v.size(),
+                                [](uint64_t h) { return h != 0; });
+        if (idx == ts_v.data() + ts_v.size()) return;
+        if (use_ros_time) {
+            (*images)(ls, frame_ts);
+            frame_ts = packet_receive_time;  // time for next images
+        } else {
+            ros::Time t;
+            t.fromNSec(ts_v(idx - ts_v.data()));
+            (*images)(ls, t);
+        }
     }
 
    private:
-    ros::Publisher nearir_image_pub;
-    std::vector<ros::Publisher> range_image_pubs;
-    std::vector<ros::Publisher> signal_image_pubs;
-    std::vector<ros::Publisher> reflec_image_pubs;
-
-    ros::Subscriber pc1_sub;
-    ros::Subscriber pc2_sub;
+    ros::Subscriber lidar_packet_sub;
+    ros::Subscriber lidar_batch_sub;
 
     sensor::sensor_info info;
+    ouster::LidarScan ls;
+    std::unique_ptr<ouster::ScanBatcher> scan_batcher;
+    std::unique_ptr<ouster_ros::ImagePublisher> images;
 
-    ouster_ros::Cloud cloud;
-    viz::AutoExposure nearir_ae, signal_ae, reflec_ae;
-    viz::BeamUniformityCorrector nearir_buc;
+    bool use_ros_time;
+    ros::Time frame_ts;  // receive time of the first packet of the frame
 };
 }  // namespace nodelets_os
 
@@ -5,17 +5,38 @@
  * @file os_replay_nodelet.cpp
  * @brief This nodelet mainly handles publishing saved metadata
  *
+ * Packets are usually played back from a bag. When built with pcap support,
+ * the nodelet can instead publish the packets of a pcap file itself, paced
+ * at a multiple of real time or as fast as subscribers take them.
  */
 
 #include <pluginlib/class_list_macros.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "ouster/metadata_cache.h"
+#include "ouster/trace.h"
+#include "ouster_ros/PacketMsg.h"
+#include "ouster_ros/message_pool.h"
 #include "ouster_ros/os_client_base_nodelet.h"
 
+#ifdef OUSTER_ROS_PCAP
+#include "ouster/os_pcap.h"
+#endif
+
 namespace sensor = ouster::sensor;
+using ouster_ros::PacketMsg;
 
 namespace nodelets_os {
 
 class OusterReplay : public OusterClientBase {
+   public:
+    ~OusterReplay() override { stop_replay(); }
+
    private:
     virtual void onInit() override {
         auto& pnh = getPrivateNodeHandle();
@@ -29,7 +50,13 @@ class OusterReplay : public OusterClientBase {
 
         // populate info for config service
         try {
-            info = sensor::metadata_from_json(meta_file);
+            // parsed once, then loaded from the cache if there's one
+            auto cache_dir = pnh.param("metadata_cache", std::string{});
+            info = cache_dir.empty()
+                       ? sensor::metadata_from_json(meta_file)
+                       : sensor::MetadataCache{cache_dir}
+                             .load_json(meta_file)
+                             .info;
             cached_metadata = to_string(info);
             display_lidar_info(info);
         } catch (const std::runtime_error& e) {
@@ -37,9 +64,143 @@ class OusterReplay : public OusterClientBase {
         }
 
         OusterClientBase::onInit();
+
+        auto pcap_file = pnh.param("pcap_file", std::string{});
+        if (!pcap_file.empty()) {
+            replay_rate = pnh.param("replay_rate", 1.0);
+            replay_queue = pnh.param("replay_queue", 256);
+            replay_loop = pnh.param("replay_loop", false);
+            start_replay(pcap_file);
+        }
+    }
+
+#ifdef OUSTER_ROS_PCAP
+    void start_replay(const std::string& file) {
+        auto& nh = getNodeHandle();
+        lidar_packet_pub = nh.advertise<PacketMsg>("lidar_packets", 1280);
+        imu_packet_pub = nh.advertise<PacketMsg>("imu_packets", 100);
+
+        auto handle = ouster::sensor_utils::replay_initialize(file);
+        if (!handle) {
+            auto error_msg = "Failed to open pcap file " + file;
+            NODELET_ERROR_STREAM(error_msg);
+            throw std::runtime_error(error_msg);
+        }
+
+        if (replay_rate > 0)
+            NODELET_INFO("Replaying %s at %.2fx real time", file.c_str(),
+                         replay_rate);
+        else
+            NODELET_INFO("Replaying %s as fast as subscribers take packets",
+                         file.c_str());
+
+        replay_running = true;
+        replay_thread = std::thread([this, handle] {
+            do {
+                replay_file(*handle);
+                ouster::sensor_utils::replay_reset(*handle);
+            } while (replay_loop && replay_running);
+            ouster::sensor_utils::replay_uninitialize(*handle);
+            NODELET_INFO("Replay finished");
+        });
+    }
+
+    /*
+     * Publish the packets of the sensor, waiting for the capture time of
+     * each packet scaled by the rate. Without a rate, wait for subscribers
+     * in the same process to drop packets instead when replay_queue packets
+     * are in flight.
+     */
+    void replay_file(ouster::sensor_utils::playback_handle& handle) {
+        using clock = std::chrono::steady_clock;
+        const auto& pf = sensor::get_format(info);
+        ouster_ros::MessagePool<PacketMsg> lidar_pool(replay_queue);
+        ouster_ros::MessagePool<PacketMsg> imu_pool(replay_queue);
+
+        // packets are told apart by size, and by port if known
+        auto matches = [](const ouster::sensor_utils::packet_view& view,
+                          int port, size_t size) {
+            return view.payload_size == size &&
+                   (port == 0 || view.dst_port == port);
+        };
+
+        ouster::sensor_utils::packet_view view;
+        const auto start = clock::now();
+        std::chrono::microseconds first_ts{-1};
+
+        // throughput since the last report
+        auto report_time = start;
+        std::chrono::microseconds report_ts{0};
+        size_t n_packets = 0, n_bytes = 0;
+
+        while (replay_running &&
+               ouster::sensor_utils::next_packet(handle, view)) {
+            const bool lidar =
+                matches(view, info.udp_port_lidar, pf.lidar_packet_size);
+            if (!lidar && !matches(view, info.udp_port_imu, pf.imu_packet_size))
+                continue;
+
+            if (first_ts.count() < 0) first_ts = report_ts = view.timestamp;
+            auto& pool = lidar ? lidar_pool : imu_pool;
+            boost::shared_ptr<PacketMsg> msg;
+            if (replay_rate > 0) {
+                const auto offset = std::chrono::duration_cast<clock::duration>(
+                    (view.timestamp - first_ts) / replay_rate);
+                std::this_thread::sleep_until(start + offset);
+                msg = pool.acquire();
+            } else {
+                while (replay_running && !(msg = pool.try_acquire()))
+                    std::this_thread::sleep_for(std::chrono::microseconds{50});
+                if (!msg) break;
+            }
+
+            // sized as read from a live sensor
+            OUSTER_TRACE_SCOPE("OusterReplay.publish");
+            msg->buf.resize(view.payload_size + 1);
+            std::memcpy(msg->buf.data(), view.payload, view.payload_size);
+            (lidar ? lidar_packet_pub : imu_packet_pub).publish(msg);
+            n_packets++;
+            n_bytes += view.payload_size;
+
+            const auto now = clock::now();
+            const std::chrono::duration<double> elapsed = now - report_time;
+            if (elapsed.count() >= 5.0) {
+                const std::chrono::duration<double> replayed =
+                    view.timestamp - report_ts;
+                NODELET_INFO(
+                    "Replayed %.0f packets/s, %.1f MB/s, %.2fx real time",
+                    n_packets / elapsed.count(),
+                    n_bytes / elapsed.count() * 1e-6,
+                    replayed.count() / elapsed.count());
+                report_time = now;
+                report_ts = view.timestamp;
+                n_packets = n_bytes = 0;
+            }
+        }
+    }
+#else
+    void start_replay(const std::string&) {
+        auto error_msg = "Built without pcap support, can't replay pcap_file";
+        NODELET_ERROR_STREAM(error_msg);
+        throw std::runtime_error(error_msg);
+    }
+#endif
+
+    void stop_replay() {
+        replay_running = false;
+        if (replay_thread.joinable()) replay_thread.join();
     }
+
+   private:
+    double replay_rate = 1.0;  // multiple of real time, 0 for backpressure
+    int replay_queue = 256;    // packets in flight without a rate
+    bool replay_loop = false;
+    ros::Publisher lidar_packet_pub;
+    ros::Publisher imu_packet_pub;
+    std::thread replay_thread;
+    std::atomic<bool> replay_running{false};
 };
 
 }  // namespace nodelets_os
 
-PLUGINLIB_EXPORT_CLASS(nodelets_os::OusterReplay, nodelet::Nodelet)
\ No newline at end of file
+PLUGINLIB_EXPORT_CLASS(nodelets_os::OusterReplay, nodelet::Nodelet)
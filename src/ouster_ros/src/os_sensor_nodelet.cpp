@@ -7,35 +7,67 @@
  */
 
 #include <pluginlib/class_list_macros.h>
+#include <pthread.h>
+#include <sched.h>
 
+#include <atomic>
+#include <cstring>
 #include <fstream>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "ouster/trace.h"
 #include "ouster_ros/GetConfig.h"
+#include "ouster_ros/PacketBatchMsg.h"
 #include "ouster_ros/PacketMsg.h"
 #include "ouster_ros/SetConfig.h"
+#include "ouster_ros/diagnostics.h"
+#include "ouster_ros/message_pool.h"
 #include "ouster_ros/os_client_base_nodelet.h"
+#include "ouster_ros/scan_processing.h"
 
 namespace sensor = ouster::sensor;
 using nonstd::optional;
 using ouster_ros::GetConfig;
+using ouster_ros::PacketBatchMsg;
 using ouster_ros::PacketMsg;
 using ouster_ros::SetConfig;
 
 namespace nodelets_os {
 
 class OusterSensor : public OusterClientBase {
+   public:
+    ~OusterSensor() override { stop_receive_thread(); }
+
    private:
     virtual void onInit() override {
         auto& pnh = getPrivateNodeHandle();
         hostname = pnh.param("sensor_hostname", std::string{});
         auto lidar_port = pnh.param("lidar_port", 0);
         auto imu_port = pnh.param("imu_port", 0);
+        rx_cpu = pnh.param("rx_cpu", -1);
+        rx_priority = pnh.param("rx_priority", 0);
+        batch_packets = pnh.param("lidar_batch", 0);
+        diagnostics_period = pnh.param("diagnostics_period", 1.0);
+        metadata_cache = pnh.param("metadata_cache", std::string{});
+        process_scans = pnh.param("process_scans", false);
+        if (process_scans) {
+            scan_workers = pnh.param("scan_workers", 2);
+            tf_prefix = pnh.param("tf_prefix", std::string{});
+            use_ros_time = pnh.param("timestamp_mode", std::string{}) ==
+                           "TIME_FROM_ROS_TIME";
+            cloud_config = ouster_ros::cloud_config_of_params(pnh);
+        }
         auto sensor_conf = create_sensor_config_rosparams(pnh);
         configure_sensor(hostname, sensor_conf.first, sensor_conf.second);
         sensor_client = create_client(hostname, lidar_port, imu_port);
         update_config_and_metadata(*sensor_client);
         save_metadata(pnh);
+        if (diagnostics_period > 0)
+            diagnostics = std::make_unique<ouster_ros::ScanDiagnostics>(
+                getNodeHandle(), getName(), info, diagnostics_period);
         OusterClientBase::onInit();
         create_get_config_service();
         create_set_config_service();
@@ -121,15 +153,20 @@ class OusterSensor : public OusterClientBase {
                         return false;
                     }
 
+                    // the packet format may change with the config
+                    stop_receive_thread();
                     try {
                         configure_sensor(hostname, config, 0);
                     } catch (const std::runtime_error& e) {
+                        start_receive_thread();
                         return false;
                     } catch (const std::invalid_argument& ia) {
+                        start_receive_thread();
                         return false;
                     }
                     success = update_config_and_metadata(*sensor_client);
                     response.config = cached_config;
+                    start_receive_thread();
                     return success;
                 });
 
@@ -149,9 +186,9 @@ class OusterSensor : public OusterClientBase {
                                                << " initialization...");
 
         // use no-config version of init_client to allow for random ports
-        auto cli =
-            sensor::init_client(hostname, "", sensor::MODE_UNSPEC,
-                                sensor::TIME_FROM_UNSPEC, lidar_port, imu_port);
+        auto cli = sensor::init_client(hostname, "", sensor::MODE_UNSPEC,
+                                       sensor::TIME_FROM_UNSPEC, lidar_port,
+                                       imu_port, 60, metadata_cache);
 
         if (!cli) {
             auto error_msg = "Failed to initialize client";
@@ -328,55 +365,190 @@ class OusterSensor : public OusterClientBase {
 
     void start_connection_loop() {
         auto& nh = getNodeHandle();
+        if (batch_packets == 0)
+            lidar_packet_pub = nh.advertise<PacketMsg>("lidar_packets", 1280);
+        else
+            lidar_batch_pub =
+                nh.advertise<PacketBatchMsg>("lidar_packet_batches", 20);
+        imu_packet_pub = nh.advertise<PacketMsg>("imu_packets", 100);
+        start_receive_thread();
+    }
 
+    // receive on a thread of our own, off the callback queue
+    void start_receive_thread() {
         auto pf = sensor::get_format(info);
-        lidar_packet.buf.resize(pf.lidar_packet_size + 1);
-        imu_packet.buf.resize(pf.imu_packet_size + 1);
-
-        lidar_packet_pub = nh.advertise<PacketMsg>("lidar_packets", 1280);
-        imu_packet_pub = nh.advertise<PacketMsg>("imu_packets", 100);
+        // scans are batched as packets are received, for the current format
+        if (process_scans)
+            scan_pipeline = std::make_unique<ouster_ros::ScanPipeline>(
+                info, getNodeHandle(), tf_prefix, cloud_config, use_ros_time,
+                scan_workers, diagnostics.get());
+
+        lidar_packets.resize(lidar_batch_size);
+        lidar_bufs.resize(lidar_batch_size);
+        for (int i = 0; i < lidar_batch_size; i++)
+            acquire_lidar_packet(i, pf);
+        lidar_batch_msg = acquire_lidar_batch();
+
+        rx_running = true;
+        rx_thread = std::thread([this, pf] {
+            configure_receive_thread();
+            while (rx_running) {
+                if (!connection_loop(*sensor_client, pf)) break;
+            }
+        });
+    }
 
-        timer_ = nh.createTimer(
-            ros::Duration(0),
-            boost::bind(&OusterSensor::timer_callback, this, _1), true);
+    void stop_receive_thread() {
+        rx_running = false;
+        if (rx_thread.joinable()) rx_thread.join();
+        scan_pipeline.reset();
     }
 
-    void connection_loop(sensor::client& cli, const sensor::sensor_info& info) {
-        auto pf = sensor::get_format(info);
+    // optionally pin the thread to a cpu and give it real-time priority
+    void configure_receive_thread() {
+        if (rx_cpu >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(rx_cpu, &cpus);
+            const int err =
+                pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+            if (err)
+                NODELET_WARN("Failed to pin receive thread to cpu %d: %s",
+                             rx_cpu, std::strerror(err));
+        }
+        if (rx_priority > 0) {
+            sched_param param{};
+            param.sched_priority = rx_priority;
+            const int err =
+                pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (err)
+                NODELET_WARN(
+                    "Failed to set receive thread priority to %d: %s",
+                    rx_priority, std::strerror(err));
+        }
+    }
 
+    // returns false when the client is exiting
+    bool connection_loop(sensor::client& cli,
+                         const sensor::packet_format& pf) {
         auto state = sensor::poll_client(cli);
         if (state == sensor::EXIT) {
             NODELET_INFO("poll_client: caught signal, exiting");
-            return;
+            return false;
         }
         if (state & sensor::CLIENT_ERROR) {
             NODELET_ERROR("poll_client: returned error");
-            return;
+            return true;
         }
         if (state & sensor::LIDAR_DATA) {
-            if (sensor::read_lidar_packet(cli, lidar_packet.buf.data(), pf))
-                lidar_packet_pub.publish(lidar_packet);
+            OUSTER_TRACE_SCOPE("OusterSensor.lidar_data");
+            // drain everything queued on the socket in batched reads
+            int n = 0;
+            do {
+                n = sensor::read_lidar_packets(cli, lidar_bufs.data(),
+                                               lidar_batch_size, pf);
+                if (diagnostics)
+                    diagnostics->add_received_packets(
+                        n, sensor::get_lidar_drops(cli));
+                if (scan_pipeline) {
+                    const auto receive_time = ros::Time::now();
+                    for (int i = 0; i < n; ++i)
+                        scan_pipeline->add_lidar_packet(lidar_bufs[i],
+                                                        receive_time);
+                }
+                for (int i = 0; i < n; ++i) publish_lidar_packet(i, pf);
+            } while (n == lidar_batch_size && rx_running);
         }
         if (state & sensor::IMU_DATA) {
-            if (sensor::read_imu_packet(cli, imu_packet.buf.data(), pf))
+            auto imu_packet = imu_pool.acquire();
+            imu_packet->buf.resize(pf.imu_packet_size + 1);
+            if (sensor::read_imu_packet(cli, imu_packet->buf.data(), pf)) {
+                if (scan_pipeline)
+                    scan_pipeline->add_imu_packet(*imu_packet,
+                                                  ros::Time::now());
                 imu_packet_pub.publish(imu_packet);
+            }
         }
+        return true;
+    }
+
+    // read the ith packet of the next batched read into a free message
+    void acquire_lidar_packet(int i, const sensor::packet_format& pf) {
+        lidar_packets[i] = packet_pool.acquire();
+        lidar_packets[i]->buf.resize(pf.lidar_packet_size + 1);
+        lidar_bufs[i] = lidar_packets[i]->buf.data();
+    }
+
+    boost::shared_ptr<PacketBatchMsg> acquire_lidar_batch() {
+        auto batch = batch_pool.acquire();
+        batch->buf.clear();
+        batch->offsets.clear();
+        return batch;
+    }
+
+    /*
+     * Publish the ith packet of the last read, or add it to the current
+     * batch, which is published when full or when the packet starts a new
+     * frame. Messages are published by pointer, so that subscribers in the
+     * same process get them without copies
+     */
+    void publish_lidar_packet(int i, const sensor::packet_format& pf) {
+        if (batch_packets == 0) {
+            lidar_packet_pub.publish(lidar_packets[i]);
+            acquire_lidar_packet(i, pf);
+            return;
+        }
+
+        const uint8_t* buf = lidar_bufs[i];
+        auto& batch = *lidar_batch_msg;
+        if (!batch.offsets.empty() && batch_packets < 0 &&
+            pf.frame_id(buf) != batch_frame_id)
+            publish_lidar_batch();
+        if (batch.offsets.empty()) batch_frame_id = pf.frame_id(buf);
+
+        batch.offsets.push_back(batch.buf.size());
+        batch.buf.insert(batch.buf.end(), buf, buf + pf.lidar_packet_size);
+        if (batch_packets > 0 &&
+            batch.offsets.size() >= static_cast<size_t>(batch_packets))
+            publish_lidar_batch();
     }
 
-    void timer_callback(const ros::TimerEvent&) {
-        connection_loop(*sensor_client, info);
-        timer_.stop();
-        timer_.start();
+    void publish_lidar_batch() {
+        lidar_batch_pub.publish(lidar_batch_msg);
+        lidar_batch_msg = acquire_lidar_batch();
     }
 
    private:
-    PacketMsg lidar_packet;
-    PacketMsg imu_packet;
+    static constexpr int lidar_batch_size = 64;
+    std::vector<boost::shared_ptr<PacketMsg>> lidar_packets;
+    std::vector<uint8_t*> lidar_bufs;
+    int batch_packets = 0;  // packets per batch, -1 for frames, 0 for none
+    boost::shared_ptr<PacketBatchMsg> lidar_batch_msg;
+    // only used from the receive thread, or while it is stopped
+    ouster_ros::MessagePool<PacketMsg> packet_pool{1024};
+    ouster_ros::MessagePool<PacketBatchMsg> batch_pool{32};
+    ouster_ros::MessagePool<PacketMsg> imu_pool{128};
+    uint16_t batch_frame_id = 0;
     ros::Publisher lidar_packet_pub;
+    ros::Publisher lidar_batch_pub;
     ros::Publisher imu_packet_pub;
     std::shared_ptr<sensor::client> sensor_client;
-    ros::Timer timer_;
+    std::thread rx_thread;
+    std::atomic<bool> rx_running{false};
+    int rx_cpu = -1;
+    int rx_priority = 0;
+    // convert scans in this nodelet instead of OusterCloud and OusterImage
+    bool process_scans = false;
+    int scan_workers = 2;
+    std::string tf_prefix;
+    bool use_ros_time = false;
+    ouster_ros::CloudConfig cloud_config;
+    // declared before the pipeline, which reports to it
+    double diagnostics_period = 1.0;  // seconds, 0 to disable
+    std::unique_ptr<ouster_ros::ScanDiagnostics> diagnostics;
+    std::unique_ptr<ouster_ros::ScanPipeline> scan_pipeline;
     std::string hostname;
+    std::string metadata_cache;
     ros::ServiceServer get_config_srv;
     ros::ServiceServer set_config_srv;
     std::string cached_config;
@@ -10,9 +10,13 @@
 #include <tf2/LinearMath/Transform.h>
 #include <tf2_eigen/tf2_eigen.h>
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstring>
+#include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "ouster/types.h"
@@ -78,14 +82,6 @@ sensor_msgs::Imu packet_to_imu_msg(const PacketMsg& pm,
     return packet_to_imu_msg(pm, timestamp, frame, pf);
 }
 
-struct read_and_cast {
-    template <typename T, typename U>
-    void operator()(Eigen::Ref<const ouster::img_t<T>> field,
-                    ouster::img_t<U>& dest) {
-        dest = field.template cast<U>();
-    }
-};
-
 sensor::ChanField suitable_return(sensor::ChanField input_field, bool second) {
     switch (input_field) {
         case sensor::ChanField::RANGE:
@@ -107,56 +103,162 @@ sensor::ChanField suitable_return(sensor::ChanField input_field, bool second) {
     }
 }
 
-template <typename T>
-inline ouster::img_t<T> get_or_fill_zero(sensor::ChanField f,
-                                         const ouster::LidarScan& ls) {
-    ouster::img_t<T> result{ls.h, ls.w};
+// read a row of a field at the given columns, or all of them, casting values
+struct read_row {
+    template <typename T, typename D>
+    void operator()(Eigen::Ref<const ouster::img_t<T>> field, int u,
+                    const std::vector<int>* cols, std::vector<D>& dest) {
+        const T* src = field.data() + u * field.outerStride();
+        if (cols) {
+            for (size_t k = 0; k < dest.size(); k++)
+                dest[k] = static_cast<D>(src[(*cols)[k]]);
+        } else {
+            for (size_t v = 0; v < dest.size(); v++)
+                dest[v] = static_cast<D>(src[v]);
+        }
+    }
+};
+
+template <typename D>
+void read_row_or_fill_zero(sensor::ChanField f, const ouster::LidarScan& ls,
+                           int u, const std::vector<int>* cols,
+                           std::vector<D>& dest) {
     if (ls.field_type(f)) {
-        ouster::impl::visit_field(ls, f, read_and_cast(), result);
+        ouster::impl::visit_field(ls, f, read_row(), u, cols, dest);
     } else {
-        result = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic,
-                               Eigen::RowMajor>::Zero(ls.h, ls.w);
+        std::fill(dest.begin(), dest.end(), D{0});
+    }
+}
+
+/*
+ * Fill the clouds of the given returns one row at a time, projecting all
+ * returns in one pass over the lookup table and filling in the other fields of
+ * the points while they are in cache. Only the pixels of the region are
+ * filled in if there is one, with the lookup table sliced to it.
+ */
+template <typename L>
+void fill_clouds(const L& xyz_lut, const ouster::ScanRegion* region,
+                 ouster::LidarScan::ts_t scan_ts, const ouster::LidarScan& ls,
+                 const std::vector<int>& return_indices,
+                 const std::vector<Cloud*>& clouds) {
+    static_assert(sizeof(Point) % sizeof(float) == 0,
+                  "points must be made of whole floats");
+    constexpr std::ptrdiff_t point_stride = sizeof(Point) / sizeof(float);
+
+    const std::vector<int>* cols = region ? &region->cols : nullptr;
+    const size_t n_rows = region ? region->rows.size() : ls.h;
+    const size_t n_cols = region ? region->cols.size() : ls.w;
+
+    struct return_fields {
+        sensor::ChanField range, signal, reflectivity, near_ir;
+    };
+    std::vector<return_fields> fields;
+    std::vector<sensor::ChanField> ranges;
+    std::vector<float*> xyz;
+    for (size_t i = 0; i < clouds.size(); i++) {
+        const bool second = (return_indices[i] == 1);
+        fields.push_back(
+            {suitable_return(sensor::ChanField::RANGE, second),
+             suitable_return(sensor::ChanField::SIGNAL, second),
+             suitable_return(sensor::ChanField::REFLECTIVITY, second),
+             suitable_return(sensor::ChanField::NEAR_IR, second)});
+        ranges.push_back(fields.back().range);
+        clouds[i]->resize(n_rows * n_cols);
+        xyz.push_back(&clouds[i]->points[0].x);
+    }
+
+    const auto timestamp = ls.timestamp();
+    const auto status = ls.status();
+
+    // relative timestamps of valid columns, zero for missing columns, whose
+    // fields are also zeroed if they may hold stale data, see BATCH_LAZY_ZERO
+    std::vector<uint32_t> ts(n_cols);
+    std::vector<uint8_t> valid(n_cols);
+    for (size_t k = 0; k < ts.size(); k++) {
+        const int v = cols ? (*cols)[k] : static_cast<int>(k);
+        const bool missing = !(status[v] & 0x01);
+        valid[k] = !(missing && ls.stale_columns());
+        ts[k] = !missing ? static_cast<uint32_t>(
+                                (std::chrono::nanoseconds(timestamp[v]) -
+                                 scan_ts)
+                                    .count())
+                          : 0;
+    }
+
+    std::vector<float> signal(n_cols);
+    std::vector<uint16_t> reflectivity(n_cols), near_ir(n_cols);
+    std::vector<uint32_t> range(n_cols);
+    for (int j = 0; j < static_cast<int>(n_rows); j++) {
+        const int u = region ? region->rows[j] : j;
+
+        // zeroes the coordinates of missing columns
+        if (region)
+            ouster::cartesian_into(ls, *region, ranges, xyz_lut, xyz,
+                                   point_stride, j, j + 1);
+        else
+            ouster::cartesian_into(ls, ranges, xyz_lut, xyz, point_stride, j,
+                                   j + 1);
+
+        for (size_t i = 0; i < clouds.size(); i++) {
+            const auto& f = fields[i];
+            read_row_or_fill_zero(f.signal, ls, u, cols, signal);
+            read_row_or_fill_zero(f.reflectivity, ls, u, cols, reflectivity);
+            read_row_or_fill_zero(f.near_ir, ls, u, cols, near_ir);
+            read_row_or_fill_zero(f.range, ls, u, cols, range);
+
+            Point* row = &clouds[i]->points[j * n_cols];
+            for (size_t k = 0; k < ts.size(); k++) {
+                Point& p = row[k];
+                const bool ok = valid[k];
+                p.data[3] = 1.0f;
+                p.intensity = ok ? signal[k] : 0.0f;
+                p.t = ts[k];
+                p.reflectivity = ok ? reflectivity[k] : 0;
+                p.ring = static_cast<uint8_t>(u);
+                p.ambient = ok ? near_ir[k] : 0;
+                p.range = ok ? range[k] : 0;
+            }
+        }
     }
-    return result;
 }
 
 void scan_to_cloud(const ouster::XYZLut& xyz_lut,
                    ouster::LidarScan::ts_t scan_ts, const ouster::LidarScan& ls,
                    ouster_ros::Cloud& cloud, int return_index) {
-    bool second = (return_index == 1);
-    cloud.resize(ls.w * ls.h);
-
-    ouster::img_t<uint16_t> near_ir = get_or_fill_zero<uint16_t>(
-        suitable_return(sensor::ChanField::NEAR_IR, second), ls);
-
-    ouster::img_t<uint32_t> range = get_or_fill_zero<uint32_t>(
-        suitable_return(sensor::ChanField::RANGE, second), ls);
-
-    ouster::img_t<uint32_t> signal = get_or_fill_zero<uint32_t>(
-        suitable_return(sensor::ChanField::SIGNAL, second), ls);
-
-    ouster::img_t<uint16_t> reflectivity = get_or_fill_zero<uint16_t>(
-        suitable_return(sensor::ChanField::REFLECTIVITY, second), ls);
-
-    auto points = ouster::cartesian(range, xyz_lut);
-    auto timestamp = ls.timestamp();
-
-    for (auto u = 0; u < ls.h; u++) {
-        for (auto v = 0; v < ls.w; v++) {
-            const auto xyz = points.row(u * ls.w + v);
-            const auto ts =
-                (std::chrono::nanoseconds(timestamp[v]) - scan_ts).count();
-            cloud(v, u) = ouster_ros::Point{
-                {{static_cast<float>(xyz(0)), static_cast<float>(xyz(1)),
-                  static_cast<float>(xyz(2)), 1.0f}},
-                static_cast<float>(signal(u, v)),
-                static_cast<uint32_t>(ts),
-                static_cast<uint16_t>(reflectivity(u, v)),
-                static_cast<uint8_t>(u),
-                static_cast<uint16_t>(near_ir(u, v)),
-                static_cast<uint32_t>(range(u, v))};
-        }
+    fill_clouds(xyz_lut, nullptr, scan_ts, ls, {return_index}, {&cloud});
+}
+
+namespace {
+
+void fill_all_returns(const ouster::XYZLutf& xyz_lut,
+                      const ouster::ScanRegion* region,
+                      ouster::LidarScan::ts_t scan_ts,
+                      const ouster::LidarScan& ls,
+                      std::vector<ouster_ros::Cloud>& clouds) {
+    std::vector<int> return_indices;
+    std::vector<Cloud*> ptrs;
+    for (size_t i = 0; i < clouds.size(); i++) {
+        return_indices.push_back(static_cast<int>(i));
+        ptrs.push_back(&clouds[i]);
     }
+    fill_clouds(xyz_lut, region, scan_ts, ls, return_indices, ptrs);
+}
+
+}  // namespace
+
+void scan_to_clouds(const ouster::XYZLutf& xyz_lut,
+                    ouster::LidarScan::ts_t scan_ts,
+                    const ouster::LidarScan& ls,
+                    std::vector<ouster_ros::Cloud>& clouds) {
+    fill_all_returns(xyz_lut, nullptr, scan_ts, ls, clouds);
+}
+
+void scan_to_clouds(const ouster::XYZLutf& region_lut,
+                    const ouster::ScanRegion& region,
+                    ouster::LidarScan::ts_t scan_ts,
+                    const ouster::LidarScan& ls,
+                    std::vector<ouster_ros::Cloud>& clouds) {
+    fill_all_returns(region_lut, &region, scan_ts, ls, clouds);
 }
 
 sensor_msgs::PointCloud2 cloud_to_cloud_msg(const Cloud& cloud,
@@ -169,6 +271,262 @@ sensor_msgs::PointCloud2 cloud_to_cloud_msg(const Cloud& cloud,
     return msg;
 }
 
+ouster::optional<uint32_t> cloud_fields_of_string(const std::string& s) {
+    const std::vector<std::pair<std::string, uint32_t>> names{
+        {"intensity", CLOUD_INTENSITY},       {"t", CLOUD_T},
+        {"reflectivity", CLOUD_REFLECTIVITY}, {"ring", CLOUD_RING},
+        {"ambient", CLOUD_AMBIENT},           {"range", CLOUD_RANGE},
+        {"all", CLOUD_ALL_FIELDS}};
+
+    uint32_t fields = 0;
+    std::stringstream ss{s};
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        if (name.empty() || name == "x" || name == "y" || name == "z")
+            continue;
+        auto it = std::find_if(names.begin(), names.end(),
+                               [&](const std::pair<std::string, uint32_t>& n) {
+                                   return n.first == name;
+                               });
+        if (it == names.end()) return nonstd::nullopt;
+        fields |= it->second;
+    }
+    return fields;
+}
+
+ouster::optional<CloudLayout> cloud_layout_of_point_type(
+    const std::string& s) {
+    const std::vector<std::pair<std::string, CloudLayout>> layouts{
+        {"original", {CLOUD_ALL_FIELDS, false}},
+        {"xyz", {0, false}},
+        {"xyzi", {CLOUD_INTENSITY, false}},
+        {"xyzir", {CLOUD_INTENSITY | CLOUD_RING, false}},
+        {"compact", {CLOUD_ALL_FIELDS, true}}};
+
+    auto it = std::find_if(layouts.begin(), layouts.end(),
+                           [&](const std::pair<std::string, CloudLayout>& l) {
+                               return l.first == s;
+                           });
+    if (it == layouts.end()) return nonstd::nullopt;
+    return it->second;
+}
+
+namespace {
+
+// byte offsets of the fields of a point, or -1 for fields left out
+struct point_offsets {
+    int intensity{-1}, t{-1}, reflectivity{-1}, ring{-1}, ambient{-1},
+        range{-1};
+    uint32_t step{0};
+};
+
+// describe the fields of the points of msg, each aligned to its size
+point_offsets describe_points(const CloudLayout& layout,
+                              sensor_msgs::PointCloud2& msg) {
+    using sensor_msgs::PointField;
+    msg.fields.clear();
+    uint32_t end = 0;
+    auto add = [&](const char* name, uint8_t datatype, uint32_t size) {
+        const uint32_t offset = (end + size - 1) / size * size;
+        PointField f;
+        f.name = name;
+        f.offset = offset;
+        f.datatype = datatype;
+        f.count = 1;
+        msg.fields.push_back(f);
+        end = offset + size;
+        return static_cast<int>(offset);
+    };
+
+    point_offsets res;
+    add("x", PointField::FLOAT32, 4);
+    add("y", PointField::FLOAT32, 4);
+    add("z", PointField::FLOAT32, 4);
+    // largest fields first, leaving no gaps between them
+    const uint32_t f = layout.fields;
+    const bool intensity = f & CLOUD_INTENSITY;
+    if (intensity && !layout.compact)
+        res.intensity = add("intensity", PointField::FLOAT32, 4);
+    if (f & CLOUD_T) res.t = add("t", PointField::UINT32, 4);
+    if (f & CLOUD_RANGE) res.range = add("range", PointField::UINT32, 4);
+    if (intensity && layout.compact)
+        res.intensity = add("intensity", PointField::UINT16, 2);
+    if (f & CLOUD_REFLECTIVITY)
+        res.reflectivity = add("reflectivity", PointField::UINT16, 2);
+    if (f & CLOUD_AMBIENT) res.ambient = add("ambient", PointField::UINT16, 2);
+    if (f & CLOUD_RING) res.ring = add("ring", PointField::UINT8, 1);
+
+    // whole floats, so that coordinates can be projected in place
+    res.step = (end + 3) / 4 * 4;
+    return res;
+}
+
+// write the values of a row to a field of consecutive points, zero where
+// the column isn't valid if given
+template <typename T, typename S>
+void write_field(uint8_t* points, uint32_t step, int offset,
+                 const std::vector<S>& values,
+                 const std::vector<uint8_t>* valid = nullptr) {
+    if (offset < 0) return;
+    uint8_t* dst = points + offset;
+    for (size_t k = 0; k < values.size(); k++) {
+        const T v =
+            !valid || (*valid)[k] ? static_cast<T>(values[k]) : T{0};
+        std::memcpy(dst + k * step, &v, sizeof(T));
+    }
+}
+
+void fill_cloud_msgs(const ouster::XYZLutf& xyz_lut,
+                     const ouster::ScanRegion* region,
+                     ouster::LidarScan::ts_t scan_ts,
+                     const ouster::LidarScan& ls, const CloudLayout& layout,
+                     const std::vector<sensor_msgs::PointCloud2*>& msgs) {
+    const std::vector<int>* cols = region ? &region->cols : nullptr;
+    const size_t n_rows = region ? region->rows.size() : ls.h;
+    const size_t n_cols = region ? region->cols.size() : ls.w;
+
+    // only the returns with a message, projected together
+    struct return_fields {
+        sensor::ChanField range, signal, reflectivity, near_ir;
+    };
+    std::vector<return_fields> fields;
+    std::vector<sensor::ChanField> ranges;
+    std::vector<sensor_msgs::PointCloud2*> out;
+    std::vector<float*> xyz;
+    point_offsets offsets;
+    for (size_t i = 0; i < msgs.size(); i++) {
+        if (!msgs[i]) continue;
+        const bool second = (i == 1);
+        fields.push_back(
+            {suitable_return(sensor::ChanField::RANGE, second),
+             suitable_return(sensor::ChanField::SIGNAL, second),
+             suitable_return(sensor::ChanField::REFLECTIVITY, second),
+             suitable_return(sensor::ChanField::NEAR_IR, second)});
+        ranges.push_back(fields.back().range);
+        out.push_back(msgs[i]);
+
+        auto& msg = *msgs[i];
+        offsets = describe_points(layout, msg);
+        msg.height = n_rows;
+        msg.width = n_cols;
+        msg.is_bigendian = false;
+        msg.is_dense = true;
+        msg.point_step = offsets.step;
+        msg.row_step = offsets.step * n_cols;
+        // vector storage is aligned for floats
+        msg.data.resize(msg.row_step * n_rows);
+        xyz.push_back(reinterpret_cast<float*>(msg.data.data()));
+    }
+    if (out.empty()) return;
+    const std::ptrdiff_t float_stride = offsets.step / sizeof(float);
+
+    const auto timestamp = ls.timestamp();
+    const auto status = ls.status();
+
+    // relative timestamps of valid columns, zero for missing columns, whose
+    // fields are also zeroed if they may hold stale data, see BATCH_LAZY_ZERO
+    std::vector<uint32_t> ts(n_cols);
+    std::vector<uint8_t> valid(n_cols);
+    for (size_t k = 0; k < ts.size(); k++) {
+        const int v = cols ? (*cols)[k] : static_cast<int>(k);
+        const bool missing = !(status[v] & 0x01);
+        valid[k] = !(missing && ls.stale_columns());
+        ts[k] = !missing ? static_cast<uint32_t>(
+                                (std::chrono::nanoseconds(timestamp[v]) -
+                                 scan_ts)
+                                    .count())
+                          : 0;
+    }
+
+    std::vector<uint32_t> signal(n_cols), range(n_cols);
+    std::vector<uint16_t> reflectivity(n_cols), near_ir(n_cols);
+    std::vector<uint8_t> ring(n_cols);
+    for (int j = 0; j < static_cast<int>(n_rows); j++) {
+        const int u = region ? region->rows[j] : j;
+        std::fill(ring.begin(), ring.end(), static_cast<uint8_t>(u));
+
+        // in place, zeroing the coordinates of missing columns
+        if (region)
+            ouster::cartesian_into(ls, *region, ranges, xyz_lut, xyz,
+                                   float_stride, j, j + 1);
+        else
+            ouster::cartesian_into(ls, ranges, xyz_lut, xyz, float_stride, j,
+                                   j + 1);
+
+        for (size_t i = 0; i < out.size(); i++) {
+            const auto& f = fields[i];
+            const auto& o = offsets;
+            uint8_t* row = out[i]->data.data() + j * out[i]->row_step;
+            const uint32_t step = o.step;
+            if (o.intensity >= 0) {
+                read_row_or_fill_zero(f.signal, ls, u, cols, signal);
+                if (layout.compact)
+                    write_field<uint16_t>(row, step, o.intensity, signal,
+                                          &valid);
+                else
+                    write_field<float>(row, step, o.intensity, signal,
+                                       &valid);
+            }
+            if (o.reflectivity >= 0) {
+                read_row_or_fill_zero(f.reflectivity, ls, u, cols,
+                                      reflectivity);
+                write_field<uint16_t>(row, step, o.reflectivity, reflectivity,
+                                      &valid);
+            }
+            if (o.ambient >= 0) {
+                read_row_or_fill_zero(f.near_ir, ls, u, cols, near_ir);
+                write_field<uint16_t>(row, step, o.ambient, near_ir, &valid);
+            }
+            if (o.range >= 0) {
+                read_row_or_fill_zero(f.range, ls, u, cols, range);
+                write_field<uint32_t>(row, step, o.range, range, &valid);
+            }
+            write_field<uint32_t>(row, step, o.t, ts);
+            write_field<uint8_t>(row, step, o.ring, ring);
+        }
+    }
+}
+
+}  // namespace
+
+void scan_to_cloud_msgs(const ouster::XYZLutf& xyz_lut,
+                        ouster::LidarScan::ts_t scan_ts,
+                        const ouster::LidarScan& ls, const CloudLayout& layout,
+                        const std::vector<sensor_msgs::PointCloud2*>& msgs) {
+    fill_cloud_msgs(xyz_lut, nullptr, scan_ts, ls, layout, msgs);
+}
+
+void scan_to_cloud_msgs(const ouster::XYZLutf& region_lut,
+                        const ouster::ScanRegion& region,
+                        ouster::LidarScan::ts_t scan_ts,
+                        const ouster::LidarScan& ls, const CloudLayout& layout,
+                        const std::vector<sensor_msgs::PointCloud2*>& msgs) {
+    fill_cloud_msgs(region_lut, &region, scan_ts, ls, layout, msgs);
+}
+
+void cloud_to_cloud_msg(const Cloud& cloud, const ros::Time& timestamp,
+                        const std::string& frame,
+                        sensor_msgs::PointCloud2& msg) {
+    // field layout of the points, as pcl::toROSMsg() would describe them
+    if (msg.fields.empty()) pcl::toROSMsg(Cloud{}, msg);
+
+    msg.header.frame_id = frame;
+    msg.header.stamp = timestamp;
+    msg.height = cloud.height;
+    msg.width = cloud.width;
+    msg.is_bigendian = false;
+    msg.is_dense = cloud.is_dense;
+    msg.point_step = sizeof(Point);
+    msg.row_step = msg.point_step * msg.width;
+
+    // the points are already laid out as the message expects them
+    const size_t n_bytes = cloud.points.size() * sizeof(Point);
+    msg.data.resize(n_bytes);
+    std::memcpy(msg.data.data(), cloud.points.data(), n_bytes);
+}
+
 sensor_msgs::PointCloud2 cloud_to_cloud_msg(const Cloud& cloud, ns ts,
                                             const std::string& frame) {
     ros::Time timestamp;
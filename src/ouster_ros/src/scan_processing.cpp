@@ -0,0 +1,403 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_ros/scan_processing.h"
+
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/Imu.h>
+#include <sensor_msgs/image_encodings.h>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "ouster/trace.h"
+#include "ouster_ros/message_pool.h"
+
+namespace ouster_ros {
+
+namespace viz = ouster::viz;
+using sensor::ChanField;
+
+int num_returns(const sensor::sensor_info& info) {
+    return info.format.udp_profile_lidar ==
+                   sensor::UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL
+               ? 2
+               : 1;
+}
+
+CloudConfig cloud_config_of_params(const ros::NodeHandle& pnh) {
+    CloudConfig config;
+
+    // optionally only convert a sector of columns and a subset of beams
+    config.roi_first_col = pnh.param("roi_first_col", -1);
+    config.roi_last_col = pnh.param("roi_last_col", -1);
+    config.col_step = pnh.param("col_step", 1);
+    config.row_step = pnh.param("row_step", 1);
+
+    // fields and precision of the points of published clouds
+    const auto point_type = pnh.param("point_type", std::string{});
+    if (!point_type.empty()) {
+        const auto layout = cloud_layout_of_point_type(point_type);
+        if (!layout) {
+            auto error_msg = "Unknown point_type: " + point_type;
+            ROS_ERROR_STREAM(error_msg);
+            throw std::runtime_error(error_msg);
+        }
+        config.layout = *layout;
+        return config;
+    }
+
+    const auto point_fields = pnh.param("point_fields", std::string{"all"});
+    const auto fields = cloud_fields_of_string(point_fields);
+    if (!fields) {
+        auto error_msg = "Unknown field in point_fields: " + point_fields;
+        ROS_ERROR_STREAM(error_msg);
+        throw std::runtime_error(error_msg);
+    }
+    config.layout.fields = *fields;
+    config.layout.compact = pnh.param("compact_points", false);
+
+    return config;
+}
+
+CloudConverter::CloudConverter(const sensor::sensor_info& info,
+                               const CloudConfig& config)
+    : n_returns_{num_returns(info)},
+      layout_{config.layout},
+      xyz_lut_{ouster::shared_xyz_lutf(info)} {
+    const size_t W = info.format.columns_per_frame;
+    const size_t H = info.format.pixels_per_column;
+    if (config.roi_first_col >= 0 || config.roi_last_col >= 0 ||
+        config.col_step != 1 || config.row_step != 1) {
+        // default to the columns the sensor fires over
+        auto window = info.format.column_window;
+        if (config.roi_first_col >= 0) window.first = config.roi_first_col;
+        if (config.roi_last_col >= 0) window.second = config.roi_last_col;
+        region_ = std::make_unique<ouster::ScanRegion>(
+            ouster::make_scan_region(W, H, window, config.col_step,
+                                     config.row_step));
+        region_lut_ = ouster::slice_xyz_lut(*xyz_lut_, W, *region_);
+        ROS_INFO_STREAM("Converting columns "
+                        << window.first << " to " << window.second
+                        << " every " << config.col_step << ", every "
+                        << config.row_step << " rows");
+    }
+}
+
+void CloudConverter::operator()(
+    const ouster::LidarScan& ls, std::chrono::nanoseconds scan_ts,
+    const std::vector<sensor_msgs::PointCloud2*>& msgs) const {
+    // all returns in one pass over the scan, straight into the messages
+    if (region_)
+        scan_to_cloud_msgs(region_lut_, *region_, scan_ts, ls, layout_, msgs);
+    else
+        scan_to_cloud_msgs(*xyz_lut_, scan_ts, ls, layout_, msgs);
+}
+
+namespace {
+
+using pixel_type = uint16_t;
+const size_t pixel_value_max = std::numeric_limits<pixel_type>::max();
+
+// columns of the images of idle outputs used to keep exposure up to date
+constexpr int idle_column_stride = 8;
+
+/*
+ * Copy every col_stride-th column of a field of a scan into an image, casting
+ * values and destaggering rows if given the shifts of a staggered scan.
+ */
+struct read_image {
+    template <typename T, typename D>
+    void operator()(Eigen::Ref<const ouster::img_t<T>> field,
+                    ouster::img_t<D>& dest, const ouster::Destaggerer* shifts,
+                    int col_stride) {
+        const size_t h = field.rows(), w = field.cols();
+        dest.resize(h, (w + col_stride - 1) / col_stride);
+        for (size_t u = 0; u < h; u++) {
+            const T* src = field.data() + u * field.outerStride();
+            D* dst = dest.data() + u * dest.cols();
+            // a row is shifted right by offset, wrapping around
+            const size_t offset = shifts ? shifts->offset(u) : 0;
+            for (std::ptrdiff_t k = 0; k < dest.cols(); k++) {
+                size_t v = k * col_stride + w - offset;
+                if (v >= w) v -= w;
+                dst[k] = static_cast<D>(src[v]);
+            }
+        }
+    }
+};
+
+template <typename D>
+void read_image_or_fill_zero(const ouster::LidarScan& ls, ChanField f,
+                             const ouster::Destaggerer& destagger,
+                             ouster::img_t<D>& dest, int col_stride = 1) {
+    if (ls.field_type(f)) {
+        const auto* shifts = ls.destaggered ? nullptr : &destagger;
+        ouster::impl::visit_field(ls, f, read_image(), dest, shifts,
+                                  col_stride);
+    } else {
+        dest.setZero(ls.h, (ls.w + col_stride - 1) / col_stride);
+    }
+}
+
+sensor_msgs::ImagePtr make_image_msg(size_t H, size_t W,
+                                     const ros::Time& stamp) {
+    auto msg = boost::make_shared<sensor_msgs::Image>();
+    msg->width = W;
+    msg->height = H;
+    msg->step = W * sizeof(pixel_type);
+    msg->encoding = sensor_msgs::image_encodings::MONO16;
+    msg->data.resize(W * H * sizeof(pixel_type));
+    msg->header.stamp = stamp;
+    return msg;
+}
+
+}  // namespace
+
+ImagePublisher::ImagePublisher(const sensor::sensor_info& info,
+                               ros::NodeHandle& nh)
+    : n_returns_{num_returns(info)}, destagger_{info} {
+    nearir_image_pub_ = nh.advertise<sensor_msgs::Image>("nearir_image", 100);
+
+    auto topic = [](auto base, int ind) {
+        if (ind == 0) return std::string(base);
+        return std::string(base) +
+               std::to_string(ind + 1);  // need second return to return 2
+    };
+
+    for (int i = 0; i < n_returns_; i++) {
+        range_image_pubs_.push_back(
+            nh.advertise<sensor_msgs::Image>(topic("range_image", i), 100));
+        signal_image_pubs_.push_back(
+            nh.advertise<sensor_msgs::Image>(topic("signal_image", i), 100));
+        reflec_image_pubs_.push_back(
+            nh.advertise<sensor_msgs::Image>(topic("reflec_image", i), 100));
+    }
+}
+
+void ImagePublisher::operator()(const ouster::LidarScan& ls,
+                                const ros::Time& stamp) {
+    for (int i = 0; i < n_returns_; i++) {
+        // exposure follows the first return, and is shared by the second
+        const bool first = (i == 0);
+        const bool second = !first;
+        publish_range_image(ls, suitable_return(ChanField::RANGE, second),
+                            range_image_pubs_[i], stamp);
+        publish_scaled_image(ls, suitable_return(ChanField::SIGNAL, second),
+                             first, signal_ae_, nullptr, true,
+                             signal_image_pubs_[i], stamp);
+        publish_scaled_image(
+            ls, suitable_return(ChanField::REFLECTIVITY, second), first,
+            reflec_ae_, nullptr, false, reflec_image_pubs_[i], stamp);
+    }
+    publish_scaled_image(ls, ChanField::NEAR_IR, true, nearir_ae_,
+                         &nearir_buc_, true, nearir_image_pub_, stamp);
+}
+
+void ImagePublisher::publish_range_image(const ouster::LidarScan& ls,
+                                         ChanField f,
+                                         const ros::Publisher& pub,
+                                         const ros::Time& stamp) {
+    if (pub.getNumSubscribers() == 0) return;
+
+    auto msg = make_image_msg(ls.h, ls.w, stamp);
+    auto map = Eigen::Map<ouster::img_t<pixel_type>>(
+        (pixel_type*)msg->data.data(), ls.h, ls.w);
+
+    read_image_or_fill_zero(ls, f, destagger_, range_);
+
+    // 16 bit img: use 4mm resolution and throw out returns > 260m
+    map = range_.unaryExpr([](uint32_t r) {
+        r = (r + 0b10) >> 2;
+        return static_cast<pixel_type>(r > pixel_value_max ? 0 : r);
+    });
+    pub.publish(msg);
+}
+
+void ImagePublisher::publish_scaled_image(const ouster::LidarScan& ls,
+                                          ChanField f, bool update_state,
+                                          viz::AutoExposure& ae,
+                                          viz::BeamUniformityCorrector* buc,
+                                          bool take_sqrt,
+                                          const ros::Publisher& pub,
+                                          const ros::Time& stamp) {
+    if (pub.getNumSubscribers() == 0) {
+        if (!update_state) return;
+        read_image_or_fill_zero(ls, f, destagger_, image_, idle_column_stride);
+        if (buc) (*buc)(image_);
+        ae(image_);
+        return;
+    }
+
+    auto msg = make_image_msg(ls.h, ls.w, stamp);
+    auto map = Eigen::Map<ouster::img_t<pixel_type>>(
+        (pixel_type*)msg->data.data(), ls.h, ls.w);
+
+    read_image_or_fill_zero(ls, f, destagger_, image_);
+    if (buc) (*buc)(image_);
+    ae(image_, update_state);
+    if (take_sqrt) image_ = image_.sqrt();
+
+    // copy data into image message
+    map = (image_ * pixel_value_max).cast<pixel_type>();
+    pub.publish(msg);
+}
+
+ScanPipeline::ScanPipeline(const sensor::sensor_info& info,
+                           ros::NodeHandle& nh, const std::string& tf_prefix,
+                           const CloudConfig& config, bool use_ros_time,
+                           int n_workers, ScanDiagnostics* diagnostics)
+    : info_{info},
+      pf_{sensor::get_format(info_)},
+      use_ros_time_{use_ros_time},
+      max_jobs_{static_cast<size_t>(std::max(n_workers, 1))},
+      diagnostics_{diagnostics},
+      clouds_{info_, config},
+      images_{info_, nh},
+      batcher_{info_, ouster::BATCH_NO_BLOCK_HEADERS},
+      scan_pool_{info_.format.columns_per_frame,
+                 info_.format.pixels_per_column,
+                 info_.format.udp_profile_lidar, max_jobs_ * 2 + 1},
+      scan_{scan_pool_.acquire()} {
+    std::string prefix = tf_prefix;
+    if (!prefix.empty() && prefix.back() != '/') prefix.append("/");
+    sensor_frame_ = prefix + "os_sensor";
+    imu_frame_ = prefix + "os_imu";
+    lidar_frame_ = prefix + "os_lidar";
+
+    auto topic = [](int ind) {
+        if (ind == 0) return std::string("points");
+        return "points" + std::to_string(ind + 1);
+    };
+    for (int i = 0; i < clouds_.n_returns(); i++)
+        cloud_pubs_.push_back(
+            nh.advertise<sensor_msgs::PointCloud2>(topic(i), 10));
+    imu_pub_ = nh.advertise<sensor_msgs::Imu>("imu", 100);
+
+    tf_bcast_.sendTransform(transform_to_tf_msg(info_.imu_to_sensor_transform,
+                                                sensor_frame_, imu_frame_));
+    tf_bcast_.sendTransform(transform_to_tf_msg(
+        info_.lidar_to_sensor_transform, sensor_frame_, lidar_frame_));
+
+    for (size_t i = 0; i < max_jobs_; i++)
+        workers_.emplace_back([this] { work(); });
+}
+
+ScanPipeline::~ScanPipeline() {
+    {
+        std::lock_guard<std::mutex> lock{mtx_};
+        stop_ = true;
+    }
+    job_cv_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+void ScanPipeline::add_lidar_packet(const uint8_t* buf,
+                                    const ros::Time& receive_time) {
+    OUSTER_TRACE_SCOPE("ScanPipeline.add_lidar_packet");
+    using clock = std::chrono::steady_clock;
+    if (frame_ts_.isZero()) frame_ts_ = receive_time;
+    const auto batch_start = diagnostics_ ? clock::now() : clock::time_point{};
+    const bool done = batcher_(buf, *scan_);
+    if (diagnostics_) batching_ += clock::now() - batch_start;
+    if (!done) return;
+
+    // stamp with the first valid column, as OusterCloud does
+    const ros::Time frame_ts = std::exchange(frame_ts_, receive_time);
+    const ScanTimings timings{frame_ts, receive_time,
+                              std::exchange(batching_, {}), {}};
+    auto ts_v = scan_->timestamp();
+    auto idx = std::find_if(ts_v.data(), ts_v.data() + ts_v.size(),
+                            [](uint64_t h) { return h != 0; });
+    if (idx == ts_v.data() + ts_v.size()) return;
+    const std::chrono::nanoseconds scan_ts{*idx};
+    ros::Time stamp = frame_ts;
+    if (!use_ros_time_) stamp.fromNSec(scan_ts.count());
+
+    {
+        std::lock_guard<std::mutex> lock{mtx_};
+        if (jobs_.size() >= max_jobs_) {
+            ROS_WARN_THROTTLE(1, "ScanPipeline: workers busy, dropping scan");
+            if (diagnostics_) diagnostics_->add_dropped_scan();
+            OUSTER_TRACE_COUNTER("ScanPipeline.dropped_scans", 1);
+            return;
+        }
+        jobs_.push_back({next_seq_++, std::move(scan_), scan_ts, stamp,
+                         timings, batcher_.stats()});
+        OUSTER_TRACE_COUNTER("ScanPipeline.jobs", jobs_.size());
+    }
+    job_cv_.notify_one();
+    scan_ = scan_pool_.acquire();
+}
+
+void ScanPipeline::add_imu_packet(const PacketMsg& pm,
+                                  const ros::Time& receive_time) {
+    if (imu_pub_.getNumSubscribers() == 0) return;
+    ros::Time stamp = receive_time;
+    if (!use_ros_time_) stamp.fromNSec(pf_.imu_gyro_ts(pm.buf.data()));
+    imu_pub_.publish(boost::make_shared<sensor_msgs::Imu>(
+        packet_to_imu_msg(pm, stamp, imu_frame_, pf_)));
+}
+
+void ScanPipeline::work() {
+    // each worker fills its own messages
+    const int n_returns = clouds_.n_returns();
+    std::vector<MessagePool<sensor_msgs::PointCloud2>> pools(
+        n_returns, MessagePool<sensor_msgs::PointCloud2>{4});
+
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock{mtx_};
+            job_cv_.wait(lock, [&] { return stop_ || !jobs_.empty(); });
+            if (stop_) return;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        // project the subscribed returns in parallel with other workers
+        std::vector<boost::shared_ptr<sensor_msgs::PointCloud2>> msgs(
+            n_returns);
+        std::vector<sensor_msgs::PointCloud2*> msg_ptrs(n_returns, nullptr);
+        bool any = false;
+        for (int i = 0; i < n_returns; i++) {
+            if (cloud_pubs_[i].getNumSubscribers() == 0) continue;
+            msgs[i] = pools[i].acquire();
+            msg_ptrs[i] = msgs[i].get();
+            any = true;
+        }
+        if (any) {
+            OUSTER_TRACE_SCOPE("ScanPipeline.project");
+            const auto start = std::chrono::steady_clock::now();
+            clouds_(*job.scan, job.scan_ts, msg_ptrs);
+            job.timings.projection = std::chrono::steady_clock::now() - start;
+        }
+
+        // then publish in order, with images depending on previous scans
+        {
+            std::unique_lock<std::mutex> lock{mtx_};
+            turn_cv_.wait(lock, [&] { return next_publish_ == job.seq; });
+        }
+        OUSTER_TRACE_SCOPE("ScanPipeline.publish");
+        for (int i = 0; i < n_returns; i++) {
+            if (!msgs[i]) continue;
+            msgs[i]->header.stamp = job.stamp;
+            msgs[i]->header.frame_id = sensor_frame_;
+            cloud_pubs_[i].publish(msgs[i]);
+        }
+        images_(*job.scan, job.stamp);
+        job.scan.reset();
+        if (diagnostics_) diagnostics_->add_scan(job.timings, job.stats);
+        {
+            std::lock_guard<std::mutex> lock{mtx_};
+            next_publish_++;
+        }
+        turn_cv_.notify_all();
+    }
+}
+
+}  // namespace ouster_ros
@@ -0,0 +1,266 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Read and write sequences of lidar scans in a compact file format
+ *
+ * A scan file stores the fields of each scan as planes rather than packets, so
+ * frames are read without parsing or batching. The layout is:
+ *
+ *   file header | sensor metadata | scan layout | chunk ... | index | trailer
+ *
+ * Each chunk holds consecutive frames and is compressed independently with
+ * zlib, or stored as is. Chunk headers list the frame ids and timestamps of
+ * their frames, and the index at the end of the file lists the chunks. Files
+ * that weren't closed properly are read by walking the chunk headers.
+ *
+ * Values are stored in host byte order, which is little-endian on all
+ * supported platforms.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+namespace ouster {
+namespace sensor_utils {
+
+/** Options for writing scan files. */
+struct scan_file_options {
+    /// Number of frames per chunk
+    size_t chunk_frames{8};
+    /// zlib compression level from 1 (fastest) to 9 (smallest), or 0 to store
+    /// chunks uncompressed so they can be read in place
+    int compression_level{1};
+};
+
+/**
+ * Write a sequence of lidar scans to a scan file.
+ *
+ * All scans must have the dimensions and fields of the scan layout given to
+ * the constructor. Frames are written once a chunk is full.
+ */
+class ScanFileWriter {
+   public:
+    /**
+     * Create a scan file for scans with the default fields of the lidar
+     * profile of the sensor.
+     *
+     * @throw std::runtime_error if the file can't be created.
+     *
+     * @param[in] file The path of the file to create.
+     * @param[in] info The sensor metadata to embed in the file.
+     * @param[in] options The chunking and compression options.
+     */
+    ScanFileWriter(const std::string& file, const sensor::sensor_info& info,
+                   const scan_file_options& options = {});
+
+    /**
+     * Create a scan file for scans with custom fields.
+     *
+     * @throw std::runtime_error if the file can't be created.
+     *
+     * @param[in] file The path of the file to create.
+     * @param[in] info The sensor metadata to embed in the file.
+     * @param[in] prototype A scan with the dimensions and fields to store.
+     * @param[in] options The chunking and compression options.
+     */
+    ScanFileWriter(const std::string& file, const sensor::sensor_info& info,
+                   const LidarScan& prototype,
+                   const scan_file_options& options = {});
+
+    /** Write buffered frames and the index, ignoring errors. */
+    ~ScanFileWriter();
+
+    ScanFileWriter(const ScanFileWriter&) = delete;
+    ScanFileWriter& operator=(const ScanFileWriter&) = delete;
+
+    /**
+     * Add a scan to the file.
+     *
+     * @throw std::invalid_argument if the scan doesn't match the layout.
+     * @throw std::runtime_error if writing to the file failed.
+     *
+     * @param[in] scan The scan to write.
+     */
+    void write(const LidarScan& scan);
+
+    /**
+     * Write buffered frames and the index, and close the file.
+     *
+     * @throw std::runtime_error if writing to the file failed.
+     */
+    void close();
+
+    /**
+     * Get the number of scans added so far.
+     *
+     * @return The number of frames.
+     */
+    size_t frame_count() const;
+
+   private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+/**
+ * The fields of a stored frame, pointing into the mapped file or into a
+ * decompressed chunk.
+ *
+ * Views share ownership of the memory they point to, so they stay valid after
+ * the reader moves to other chunks or is destroyed.
+ */
+struct scan_view {
+    /** A field plane of h x w values in row-major order. */
+    struct plane {
+        sensor::ChanField field;     ///< The channel field
+        sensor::ChanFieldType type;  ///< The type of the values
+        const void* data;            ///< The values
+    };
+
+    std::shared_ptr<const void> owner;  ///< Keeps the memory alive
+    size_t w;                           ///< Number of columns
+    size_t h;                           ///< Number of rows
+    int32_t frame_id;                   ///< Frame id of the scan
+    const uint64_t* timestamp;          ///< w column timestamps
+    const uint16_t* measurement_id;     ///< w measurement ids
+    const uint32_t* status;             ///< w column statuses
+    const uint64_t* rx_timestamp;       ///< w receive timestamps
+    std::vector<plane> planes;          ///< Field planes in layout order
+
+    /**
+     * Get the plane of a field.
+     *
+     * @param[in] f The channel field.
+     *
+     * @return The plane, or nullptr if the field isn't stored.
+     */
+    const plane* find(sensor::ChanField f) const;
+};
+
+/**
+ * Read scans from a memory-mapped scan file.
+ *
+ * Decompressed chunks are cached, so reading frames in order decompresses each
+ * chunk once. Member functions can be called from several threads.
+ */
+class ScanFileReader {
+   public:
+    /** Stored scan dimensions and fields. */
+    using FieldTypes =
+        std::vector<std::pair<sensor::ChanField, sensor::ChanFieldType>>;
+
+    /**
+     * Map a scan file and read its metadata and index.
+     *
+     * @throw std::runtime_error if the file can't be read or isn't a scan
+     * file.
+     *
+     * @param[in] file The path of the file.
+     */
+    explicit ScanFileReader(const std::string& file);
+
+    ~ScanFileReader();
+
+    ScanFileReader(const ScanFileReader&) = delete;
+    ScanFileReader& operator=(const ScanFileReader&) = delete;
+
+    /**
+     * Get the sensor metadata embedded in the file.
+     *
+     * @return The parsed metadata.
+     */
+    const sensor::sensor_info& info() const;
+
+    /**
+     * Get the sensor metadata embedded in the file as written.
+     *
+     * @return The metadata json.
+     */
+    const std::string& metadata() const;
+
+    /** @return The number of columns of stored scans. */
+    size_t w() const;
+
+    /** @return The number of rows of stored scans. */
+    size_t h() const;
+
+    /** @return The fields of stored scans. */
+    const FieldTypes& field_types() const;
+
+    /** @return The number of stored scans. */
+    size_t frame_count() const;
+
+    /**
+     * Get the frame id of a stored scan without decoding it.
+     *
+     * @throw std::out_of_range if frame isn't less than frame_count().
+     *
+     * @param[in] frame The index of the scan in the file.
+     *
+     * @return The frame id.
+     */
+    int32_t frame_id(size_t frame) const;
+
+    /**
+     * Get the timestamp of a stored scan without decoding it.
+     *
+     * @throw std::out_of_range if frame isn't less than frame_count().
+     *
+     * @param[in] frame The index of the scan in the file.
+     *
+     * @return The first non-zero column timestamp, or zero if none.
+     */
+    std::chrono::nanoseconds frame_timestamp(size_t frame) const;
+
+    /**
+     * Find the first scan with a timestamp at or after a time.
+     *
+     * @param[in] ts The time to look for.
+     *
+     * @return The index of the scan, or frame_count() if all are earlier.
+     */
+    size_t find_frame(std::chrono::nanoseconds ts) const;
+
+    /**
+     * Get a stored scan without copying its fields.
+     *
+     * @throw std::out_of_range if frame isn't less than frame_count().
+     * @throw std::runtime_error if the chunk of the frame is corrupted.
+     *
+     * @param[in] frame The index of the scan in the file.
+     *
+     * @return A view of the scan.
+     */
+    scan_view view(size_t frame) const;
+
+    /**
+     * Copy a stored scan into a LidarScan. The scan is reallocated unless it
+     * already has the stored dimensions and fields.
+     *
+     * @throw std::out_of_range if frame isn't less than frame_count().
+     * @throw std::runtime_error if the chunk of the frame is corrupted.
+     *
+     * @param[in] frame The index of the scan in the file.
+     * @param[out] scan The decoded scan.
+     */
+    void read(size_t frame, LidarScan& scan) const;
+
+   private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace sensor_utils
+}  // namespace ouster
@@ -0,0 +1,727 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/scan_file.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ouster/impl/lidar_scan_impl.h"
+
+namespace ouster {
+namespace sensor_utils {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+namespace {
+
+constexpr char FILE_MAGIC[8] = {'O', 'U', 'S', 'T', 'S', 'C', 'N', '1'};
+constexpr char TRAILER_MAGIC[8] = {'O', 'U', 'S', 'T', 'S', 'C', 'N', 'E'};
+constexpr uint32_t FILE_VERSION = 1;
+constexpr uint32_t CHUNK_MAGIC = 0x4b4e4843;  // "CHNK"
+constexpr uint32_t INDEX_MAGIC = 0x58444e49;  // "INDX"
+
+enum codec : uint32_t { CODEC_NONE = 0, CODEC_ZLIB = 1 };
+
+struct file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t metadata_size;
+    uint32_t w;
+    uint32_t h;
+    uint32_t n_fields;
+    uint32_t reserved;
+};
+
+struct field_entry {
+    uint32_t field;
+    uint32_t type;
+};
+
+struct chunk_header {
+    uint32_t magic;
+    uint32_t n_frames;
+    uint32_t codec;
+    uint32_t reserved;
+    uint64_t raw_size;
+    uint64_t stored_size;
+};
+
+struct frame_entry {
+    uint64_t timestamp;
+    int32_t frame_id;
+    uint32_t chunk;
+};
+
+struct index_header {
+    uint32_t magic;
+    uint32_t n_chunks;
+    uint64_t n_frames;
+};
+
+struct trailer {
+    uint64_t index_offset;
+    char magic[8];
+};
+
+static_assert(sizeof(file_header) == 32, "Unexpected header padding");
+static_assert(sizeof(chunk_header) == 32, "Unexpected header padding");
+static_assert(sizeof(frame_entry) == 16, "Unexpected header padding");
+static_assert(sizeof(index_header) == 16, "Unexpected header padding");
+static_assert(sizeof(trailer) == 16, "Unexpected header padding");
+
+// everything in the file and in frames starts on 8 byte boundaries
+size_t pad8(size_t n) { return (n + 7) & ~size_t{7}; }
+
+size_t field_type_size(ChanFieldType t) {
+    switch (t) {
+        case ChanFieldType::UINT8:
+            return 1;
+        case ChanFieldType::UINT16:
+            return 2;
+        case ChanFieldType::UINT32:
+            return 4;
+        case ChanFieldType::UINT64:
+            return 8;
+        default:
+            throw std::invalid_argument("Invalid field type for scan file");
+    }
+}
+
+struct field_data {
+    template <typename T>
+    void operator()(Eigen::Ref<const img_t<T>> field, ChanField,
+                    std::vector<const void*>& data) const {
+        data.push_back(field.data());
+    }
+};
+
+struct field_data_mut {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, ChanField,
+                    std::vector<void*>& data) const {
+        data.push_back(field.data());
+    }
+};
+
+// offsets of the headers and planes of a frame in a chunk
+struct frame_layout {
+    size_t timestamp;
+    size_t rx_timestamp;
+    size_t status;
+    size_t measurement_id;
+    std::vector<size_t> planes;
+    std::vector<size_t> plane_sizes;
+    size_t size;
+
+    frame_layout(size_t w, size_t h,
+                 const ScanFileReader::FieldTypes& field_types) {
+        size = 0;
+        auto add = [&](size_t n) {
+            const size_t off = size;
+            size += pad8(n);
+            return off;
+        };
+        timestamp = add(w * sizeof(uint64_t));
+        rx_timestamp = add(w * sizeof(uint64_t));
+        status = add(w * sizeof(uint32_t));
+        measurement_id = add(w * sizeof(uint16_t));
+        for (const auto& ft : field_types) {
+            plane_sizes.push_back(w * h * field_type_size(ft.second));
+            planes.push_back(add(plane_sizes.back()));
+        }
+    }
+};
+
+uint64_t first_timestamp(const LidarScan& scan) {
+    const auto ts = scan.timestamp();
+    for (int i = 0; i < ts.size(); i++)
+        if (ts[i] != 0) return ts[i];
+    return 0;
+}
+
+}  // namespace
+
+/*
+ * Writer
+ */
+
+struct ScanFileWriter::Impl {
+    const scan_file_options options;
+    const size_t w;
+    const size_t h;
+    const ScanFileReader::FieldTypes field_types;
+    const frame_layout layout;
+
+    std::FILE* file{nullptr};
+    uint64_t offset{0};
+
+    std::vector<uint8_t> chunk;
+    std::vector<frame_entry> chunk_frames;
+    std::vector<uint8_t> compressed;
+
+    std::vector<uint64_t> chunk_offsets;
+    std::vector<frame_entry> frames;
+
+    Impl(const std::string& path, const sensor::sensor_info& info,
+         const LidarScan& prototype, const scan_file_options& opts)
+        : options(opts),
+          w(prototype.w),
+          h(prototype.h),
+          field_types(prototype.begin(), prototype.end()),
+          layout(w, h, field_types) {
+        if (options.chunk_frames == 0)
+            throw std::invalid_argument("Scan file chunks must hold frames");
+        if (options.compression_level < 0 || options.compression_level > 9)
+            throw std::invalid_argument("Invalid scan file compression level");
+
+        file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            throw std::runtime_error("Failed to create scan file: " + path);
+
+        try {
+            const std::string metadata = sensor::to_string(info);
+            file_header header{};
+            std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+            header.version = FILE_VERSION;
+            header.metadata_size = static_cast<uint32_t>(metadata.size());
+            header.w = static_cast<uint32_t>(w);
+            header.h = static_cast<uint32_t>(h);
+            header.n_fields = static_cast<uint32_t>(field_types.size());
+            put(&header, sizeof(header));
+            put(metadata.data(), metadata.size());
+            pad();
+
+            for (const auto& ft : field_types) {
+                field_type_size(ft.second);  // throws on invalid types
+                field_entry e{static_cast<uint32_t>(ft.first),
+                              static_cast<uint32_t>(ft.second)};
+                put(&e, sizeof(e));
+            }
+        } catch (...) {
+            std::fclose(file);
+            file = nullptr;
+            throw;
+        }
+
+        chunk.reserve(layout.size * options.chunk_frames);
+    }
+
+    ~Impl() {
+        if (file) std::fclose(file);
+    }
+
+    void put(const void* data, size_t size) {
+        if (size > 0 && std::fwrite(data, size, 1, file) != 1)
+            throw std::runtime_error("Failed to write scan file");
+        offset += size;
+    }
+
+    void pad() {
+        static const uint8_t zeros[8] = {};
+        put(zeros, pad8(offset) - offset);
+    }
+
+    void write(const LidarScan& scan) {
+        if (!file) throw std::runtime_error("Scan file is closed");
+        if (static_cast<size_t>(scan.w) != w ||
+            static_cast<size_t>(scan.h) != h ||
+            !std::equal(scan.begin(), scan.end(), field_types.begin(),
+                        field_types.end()))
+            throw std::invalid_argument(
+                "Scan doesn't match the layout of the scan file");
+
+        const size_t base = chunk.size();
+        chunk.resize(base + layout.size);
+        uint8_t* out = chunk.data() + base;
+
+        std::memcpy(out + layout.timestamp, scan.timestamp().data(),
+                    w * sizeof(uint64_t));
+        std::memcpy(out + layout.rx_timestamp, scan.rx_timestamp().data(),
+                    w * sizeof(uint64_t));
+        std::memcpy(out + layout.status, scan.status().data(),
+                    w * sizeof(uint32_t));
+        std::memcpy(out + layout.measurement_id, scan.measurement_id().data(),
+                    w * sizeof(uint16_t));
+
+        std::vector<const void*> data;
+        impl::foreach_field(scan, field_data{}, data);
+        for (size_t i = 0; i < data.size(); i++)
+            std::memcpy(out + layout.planes[i], data[i], layout.plane_sizes[i]);
+
+        frame_entry e{first_timestamp(scan), scan.frame_id,
+                      static_cast<uint32_t>(chunk_offsets.size())};
+        chunk_frames.push_back(e);
+        frames.push_back(e);
+
+        if (chunk_frames.size() >= options.chunk_frames) flush();
+    }
+
+    void flush() {
+        if (chunk_frames.empty()) return;
+
+        chunk_header header{};
+        header.magic = CHUNK_MAGIC;
+        header.n_frames = static_cast<uint32_t>(chunk_frames.size());
+        header.raw_size = chunk.size();
+
+        const uint8_t* stored = chunk.data();
+        header.stored_size = chunk.size();
+        header.codec = CODEC_NONE;
+        if (options.compression_level > 0) {
+            uLongf size = compressBound(static_cast<uLong>(chunk.size()));
+            compressed.resize(size);
+            if (compress2(compressed.data(), &size, chunk.data(),
+                          static_cast<uLong>(chunk.size()),
+                          options.compression_level) != Z_OK)
+                throw std::runtime_error("Failed to compress scan file chunk");
+            stored = compressed.data();
+            header.stored_size = size;
+            header.codec = CODEC_ZLIB;
+        }
+
+        chunk_offsets.push_back(offset);
+        put(&header, sizeof(header));
+        put(chunk_frames.data(), chunk_frames.size() * sizeof(frame_entry));
+        put(stored, header.stored_size);
+        pad();
+
+        chunk.clear();
+        chunk_frames.clear();
+    }
+
+    void close() {
+        if (!file) return;
+
+        std::FILE* f = file;
+        try {
+            flush();
+
+            trailer t{};
+            t.index_offset = offset;
+            std::memcpy(t.magic, TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+
+            index_header index{INDEX_MAGIC,
+                               static_cast<uint32_t>(chunk_offsets.size()),
+                               frames.size()};
+            put(&index, sizeof(index));
+            put(chunk_offsets.data(), chunk_offsets.size() * sizeof(uint64_t));
+            put(frames.data(), frames.size() * sizeof(frame_entry));
+            put(&t, sizeof(t));
+        } catch (...) {
+            file = nullptr;
+            std::fclose(f);
+            throw;
+        }
+
+        file = nullptr;
+        if (std::fclose(f) != 0)
+            throw std::runtime_error("Failed to write scan file");
+    }
+};
+
+ScanFileWriter::ScanFileWriter(const std::string& file,
+                               const sensor::sensor_info& info,
+                               const scan_file_options& options)
+    : ScanFileWriter(file, info,
+                     LidarScan(info.format.columns_per_frame,
+                               info.format.pixels_per_column,
+                               info.format.udp_profile_lidar),
+                     options) {}
+
+ScanFileWriter::ScanFileWriter(const std::string& file,
+                               const sensor::sensor_info& info,
+                               const LidarScan& prototype,
+                               const scan_file_options& options)
+    : impl_(new Impl(file, info, prototype, options)) {}
+
+ScanFileWriter::~ScanFileWriter() {
+    try {
+        impl_->close();
+    } catch (...) {
+    }
+}
+
+void ScanFileWriter::write(const LidarScan& scan) { impl_->write(scan); }
+
+void ScanFileWriter::close() { impl_->close(); }
+
+size_t ScanFileWriter::frame_count() const { return impl_->frames.size(); }
+
+/*
+ * Reader
+ */
+
+const scan_view::plane* scan_view::find(ChanField f) const {
+    for (const auto& p : planes)
+        if (p.field == f) return &p;
+    return nullptr;
+}
+
+namespace {
+
+// read-only mapping of a whole file
+struct mapping {
+    const uint8_t* data{nullptr};
+    size_t size{0};
+
+    explicit mapping(const std::string& file) {
+#ifdef _WIN32
+        HANDLE fh = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                                nullptr);
+        if (fh == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Failed to open scan file: " + file);
+        LARGE_INTEGER fsize;
+        if (!GetFileSizeEx(fh, &fsize)) fsize.QuadPart = 0;
+        size = (size_t)fsize.QuadPart;
+        if (size > 0) {
+            HANDLE mh =
+                CreateFileMappingA(fh, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mh) {
+                data = (const uint8_t*)MapViewOfFile(mh, FILE_MAP_READ, 0, 0,
+                                                     0);
+                CloseHandle(mh);
+            }
+        }
+        CloseHandle(fh);
+#else
+        int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Failed to open scan file: " + file);
+        struct stat st;
+        size = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+        if (size > 0) {
+            void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) data = (const uint8_t*)map;
+        }
+        close(fd);
+#endif
+        if (!data) throw std::runtime_error("Failed to map scan file: " + file);
+    }
+
+    ~mapping() {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(const_cast<uint8_t*>(data), size);
+#endif
+    }
+
+    mapping(const mapping&) = delete;
+    mapping& operator=(const mapping&) = delete;
+};
+
+struct chunk_info {
+    uint64_t offset;
+    uint32_t codec;
+    uint64_t raw_size;
+    uint64_t stored_size;
+    size_t first_frame;
+    size_t n_frames;
+};
+
+}  // namespace
+
+struct ScanFileReader::Impl {
+    std::shared_ptr<const mapping> map;
+    std::string metadata;
+    sensor::sensor_info info;
+    size_t w{0};
+    size_t h{0};
+    FieldTypes field_types;
+    std::unique_ptr<frame_layout> layout;
+
+    std::vector<chunk_info> chunks;
+    std::vector<frame_entry> frames;
+
+    // last decompressed chunk
+    mutable std::mutex mtx;
+    mutable size_t cached_chunk{SIZE_MAX};
+    mutable std::shared_ptr<const std::vector<uint8_t>> cached;
+
+    explicit Impl(const std::string& file) : map(new mapping(file)) {
+        const uint8_t* p = map->data;
+        const size_t size = map->size;
+
+        file_header header;
+        if (size < sizeof(header))
+            throw std::runtime_error("Not a scan file: " + file);
+        std::memcpy(&header, p, sizeof(header));
+        if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+            throw std::runtime_error("Not a scan file: " + file);
+        if (header.version != FILE_VERSION)
+            throw std::runtime_error("Unsupported scan file version: " + file);
+
+        size_t off = sizeof(header);
+        const size_t fields_size = header.n_fields * sizeof(field_entry);
+        if (size - off < pad8(header.metadata_size) + fields_size)
+            throw std::runtime_error("Truncated scan file: " + file);
+        metadata.assign(reinterpret_cast<const char*>(p + off),
+                        header.metadata_size);
+        off += pad8(header.metadata_size);
+        info = sensor::parse_metadata(metadata);
+
+        w = header.w;
+        h = header.h;
+        for (uint32_t i = 0; i < header.n_fields; i++) {
+            field_entry e;
+            std::memcpy(&e, p + off, sizeof(e));
+            off += sizeof(e);
+            field_types.emplace_back(static_cast<ChanField>(e.field),
+                                     static_cast<ChanFieldType>(e.type));
+        }
+        layout.reset(new frame_layout(w, h, field_types));
+
+        if (!read_index()) walk_chunks(off);
+    }
+
+    // read the index written on close, if any
+    bool read_index() {
+        const uint8_t* p = map->data;
+        const size_t size = map->size;
+
+        trailer t;
+        if (size < sizeof(file_header) + sizeof(t)) return false;
+        std::memcpy(&t, p + size - sizeof(t), sizeof(t));
+        if (std::memcmp(t.magic, TRAILER_MAGIC, sizeof(TRAILER_MAGIC)) != 0)
+            return false;
+
+        index_header index;
+        const size_t index_end = size - sizeof(t);
+        if (t.index_offset > index_end ||
+            index_end - t.index_offset < sizeof(index))
+            return false;
+        std::memcpy(&index, p + t.index_offset, sizeof(index));
+        if (index.magic != INDEX_MAGIC ||
+            index.n_frames > index_end / sizeof(frame_entry) ||
+            (index_end - t.index_offset - sizeof(index)) !=
+                index.n_chunks * sizeof(uint64_t) +
+                    index.n_frames * sizeof(frame_entry))
+            return false;
+
+        const uint8_t* offsets = p + t.index_offset + sizeof(index);
+        std::vector<chunk_info> new_chunks;
+        for (uint32_t i = 0; i < index.n_chunks; i++) {
+            uint64_t chunk_offset;
+            std::memcpy(&chunk_offset, offsets + i * sizeof(uint64_t),
+                        sizeof(uint64_t));
+            chunk_info c;
+            if (!read_chunk_header(chunk_offset, c)) return false;
+            new_chunks.push_back(c);
+        }
+
+        std::vector<frame_entry> new_frames(index.n_frames);
+        std::memcpy(new_frames.data(),
+                    offsets + index.n_chunks * sizeof(uint64_t),
+                    new_frames.size() * sizeof(frame_entry));
+
+        size_t first = 0;
+        for (uint32_t i = 0; i < new_chunks.size(); i++) {
+            auto& c = new_chunks[i];
+            if (new_frames.size() - first < c.n_frames) return false;
+            for (size_t f = first; f < first + c.n_frames; f++)
+                if (new_frames[f].chunk != i) return false;
+            c.first_frame = first;
+            first += c.n_frames;
+        }
+        if (first != new_frames.size()) return false;
+
+        chunks = std::move(new_chunks);
+        frames = std::move(new_frames);
+        return true;
+    }
+
+    // recover the frames of a file that wasn't closed from the chunk headers
+    void walk_chunks(size_t off) {
+        chunks.clear();
+        frames.clear();
+        chunk_info c;
+        while (read_chunk_header(off, c)) {
+            c.first_frame = frames.size();
+            const uint8_t* entries = map->data + off + sizeof(chunk_header);
+            for (size_t i = 0; i < c.n_frames; i++) {
+                frame_entry e;
+                std::memcpy(&e, entries + i * sizeof(e), sizeof(e));
+                e.chunk = static_cast<uint32_t>(chunks.size());
+                frames.push_back(e);
+            }
+            chunks.push_back(c);
+            off = pad8(off + sizeof(chunk_header) +
+                       c.n_frames * sizeof(frame_entry) + c.stored_size);
+        }
+    }
+
+    bool read_chunk_header(uint64_t off, chunk_info& c) const {
+        const size_t size = map->size;
+        chunk_header header;
+        if (off > size || size - off < sizeof(header)) return false;
+        std::memcpy(&header, map->data + off, sizeof(header));
+
+        const uint64_t entries = header.n_frames * sizeof(frame_entry);
+        if (header.magic != CHUNK_MAGIC ||
+            header.raw_size != header.n_frames * layout->size ||
+            (header.codec != CODEC_NONE && header.codec != CODEC_ZLIB) ||
+            (header.codec == CODEC_NONE &&
+             header.stored_size != header.raw_size) ||
+            size - off - sizeof(header) < entries ||
+            size - off - sizeof(header) - entries < header.stored_size)
+            return false;
+
+        c.offset = off;
+        c.codec = header.codec;
+        c.raw_size = header.raw_size;
+        c.stored_size = header.stored_size;
+        c.n_frames = header.n_frames;
+        return true;
+    }
+
+    void check_frame(size_t frame) const {
+        if (frame >= frames.size())
+            throw std::out_of_range("Scan file frame out of range");
+    }
+
+    // get a pointer to the raw frames of a chunk and the memory owning it
+    const uint8_t* chunk_data(size_t c,
+                              std::shared_ptr<const void>& owner) const {
+        const chunk_info& chunk = chunks[c];
+        const uint8_t* stored = map->data + chunk.offset +
+                                sizeof(chunk_header) +
+                                chunk.n_frames * sizeof(frame_entry);
+
+        if (chunk.codec == CODEC_NONE) {
+            owner = map;
+            return stored;
+        }
+
+        std::lock_guard<std::mutex> lock{mtx};
+        if (cached_chunk != c) {
+            auto raw = std::make_shared<std::vector<uint8_t>>(chunk.raw_size);
+            uLongf raw_size = static_cast<uLongf>(chunk.raw_size);
+            if (uncompress(raw->data(), &raw_size, stored,
+                           static_cast<uLong>(chunk.stored_size)) != Z_OK ||
+                raw_size != chunk.raw_size)
+                throw std::runtime_error("Corrupted scan file chunk");
+            cached = std::move(raw);
+            cached_chunk = c;
+        }
+        owner = cached;
+        return cached->data();
+    }
+
+    scan_view view(size_t frame) const {
+        check_frame(frame);
+        const frame_entry& e = frames[frame];
+        const chunk_info& c = chunks[e.chunk];
+
+        scan_view v;
+        const uint8_t* base = chunk_data(e.chunk, v.owner) +
+                              (frame - c.first_frame) * layout->size;
+        v.w = w;
+        v.h = h;
+        v.frame_id = e.frame_id;
+        v.timestamp =
+            reinterpret_cast<const uint64_t*>(base + layout->timestamp);
+        v.rx_timestamp =
+            reinterpret_cast<const uint64_t*>(base + layout->rx_timestamp);
+        v.status = reinterpret_cast<const uint32_t*>(base + layout->status);
+        v.measurement_id =
+            reinterpret_cast<const uint16_t*>(base + layout->measurement_id);
+        for (size_t i = 0; i < field_types.size(); i++)
+            v.planes.push_back({field_types[i].first, field_types[i].second,
+                                base + layout->planes[i]});
+        return v;
+    }
+
+    void read(size_t frame, LidarScan& scan) const {
+        const scan_view v = view(frame);
+
+        if (static_cast<size_t>(scan.w) != w ||
+            static_cast<size_t>(scan.h) != h ||
+            !std::equal(scan.begin(), scan.end(), field_types.begin(),
+                        field_types.end()))
+            scan = LidarScan(w, h, field_types.begin(), field_types.end());
+
+        scan.frame_id = v.frame_id;
+        std::memcpy(scan.timestamp().data(), v.timestamp,
+                    w * sizeof(uint64_t));
+        std::memcpy(scan.rx_timestamp().data(), v.rx_timestamp,
+                    w * sizeof(uint64_t));
+        std::memcpy(scan.status().data(), v.status, w * sizeof(uint32_t));
+        std::memcpy(scan.measurement_id().data(), v.measurement_id,
+                    w * sizeof(uint16_t));
+
+        std::vector<void*> data;
+        impl::foreach_field(scan, field_data_mut{}, data);
+        for (size_t i = 0; i < data.size(); i++)
+            std::memcpy(data[i], v.planes[i].data, layout->plane_sizes[i]);
+    }
+};
+
+ScanFileReader::ScanFileReader(const std::string& file)
+    : impl_(new Impl(file)) {}
+
+ScanFileReader::~ScanFileReader() = default;
+
+const sensor::sensor_info& ScanFileReader::info() const { return impl_->info; }
+
+const std::string& ScanFileReader::metadata() const {
+    return impl_->metadata;
+}
+
+size_t ScanFileReader::w() const { return impl_->w; }
+
+size_t ScanFileReader::h() const { return impl_->h; }
+
+const ScanFileReader::FieldTypes& ScanFileReader::field_types() const {
+    return impl_->field_types;
+}
+
+size_t ScanFileReader::frame_count() const { return impl_->frames.size(); }
+
+int32_t ScanFileReader::frame_id(size_t frame) const {
+    impl_->check_frame(frame);
+    return impl_->frames[frame].frame_id;
+}
+
+std::chrono::nanoseconds ScanFileReader::frame_timestamp(size_t frame) const {
+    impl_->check_frame(frame);
+    return std::chrono::nanoseconds{impl_->frames[frame].timestamp};
+}
+
+size_t ScanFileReader::find_frame(std::chrono::nanoseconds ts) const {
+    const auto& frames = impl_->frames;
+    const uint64_t t = ts.count();
+    auto it = std::lower_bound(
+        frames.begin(), frames.end(), t,
+        [](const frame_entry& e, uint64_t t) { return e.timestamp < t; });
+    return it - frames.begin();
+}
+
+scan_view ScanFileReader::view(size_t frame) const {
+    return impl_->view(frame);
+}
+
+void ScanFileReader::read(size_t frame, LidarScan& scan) const {
+    impl_->read(frame, scan);
+}
+
+}  // namespace sensor_utils
+}  // namespace ouster
@@ -9,6 +9,7 @@
 
 #include <array>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -34,6 +35,7 @@ using vec3d = std::array<double, 3>;
 // TODO: messes up lidar_scan_viz
 namespace impl {
 class GLCloud;
+class GLAccumulatedCloud;
 class GLImage;
 class GLCuboid;
 class GLLabel;
@@ -44,6 +46,7 @@ struct CameraData;
 struct WindowCtx;
 class Camera;
 class Cloud;
+class AccumulatedCloud;
 class Image;
 class Cuboid;
 class Label;
@@ -81,10 +84,13 @@ class PointViz {
      * @param[in] fix_aspect @todo document me
      * @param[in] window_width @todo document me
      * @param[in] window_height @todo document me
+     * @param[in] headless render offscreen without ever showing the window,
+     * e.g. to record frames with push_frame_handler(). Works without a
+     * display when GLFW supports EGL on its null platform (GLFW 3.4+)
      */
     PointViz(const std::string& name, bool fix_aspect = false,
              int window_width = default_window_width,
-             int window_height = default_window_height);
+             int window_height = default_window_height, bool headless = false);
 
     /**
      * Tears down the rendering context and closes the viz window
@@ -169,6 +175,20 @@ class PointViz {
     void push_mouse_pos_handler(
         std::function<bool(const WindowCtx&, double, double)>&& f);
 
+    /**
+     * Add a callback for handling rendered frames
+     *
+     * Frames are read back asynchronously and handed over a frame or two after
+     * they're drawn, from the thread calling run(). Reading back only happens
+     * while frame handlers are present.
+     *
+     * @param[in] f the callback. The first argument is the RGBA pixels of the
+     * frame, bottom row first, valid only during the call. The second and
+     * third arguments are the width and height of the frame
+     */
+    void push_frame_handler(
+        std::function<bool(const uint8_t*, int, int)>&& f);
+
     /**
      * Remove the last added callback for handling keyboard input
      */
@@ -189,6 +209,11 @@ class PointViz {
      */
     void pop_mouse_pos_handler();
 
+    /**
+     * @copydoc pop_key_handler()
+     */
+    void pop_frame_handler();
+
     /**
      * Get a reference to the camera controls
      *
@@ -210,6 +235,13 @@ class PointViz {
      */
     void add(const std::shared_ptr<Cloud>& cloud);
 
+    /**
+     * Add an accumulated cloud to the scene
+     *
+     * @param[in] cloud the accumulated cloud to add
+     */
+    void add(const std::shared_ptr<AccumulatedCloud>& cloud);
+
     /**
      * Add an object to the scene
      *
@@ -238,6 +270,14 @@ class PointViz {
      */
     bool remove(const std::shared_ptr<Cloud>& cloud);
 
+    /**
+     * Remove an accumulated cloud from the scene
+     *
+     * @param[in] cloud the accumulated cloud to remove
+     * @return true if successfully removed else false
+     */
+    bool remove(const std::shared_ptr<AccumulatedCloud>& cloud);
+
     /**
      * Remove an object from the scene
      *
@@ -428,6 +468,7 @@ class Cloud {
 
     bool range_changed_{false};
     bool key_changed_{false};
+    bool key_field_changed_{false};
     bool mask_changed_{false};
     bool xyz_changed_{false};
     bool offset_changed_{false};
@@ -435,16 +476,22 @@ class Cloud {
     bool palette_changed_{false};
     bool pose_changed_{false};
     bool point_size_changed_{false};
+    bool lod_changed_{false};
 
-    std::vector<float> range_data_{};
-    std::vector<float> key_data_{};
-    std::vector<float> mask_data_{};
+    // stored as uploaded to the gpu
+    std::vector<uint32_t> range_data_{};
+    std::vector<uint16_t> key_data_{};  // normalized to [0, 1]
+    std::vector<uint32_t> key_field_{};  // raw, allocated when first set
+    std::vector<uint8_t> mask_data_{};  // normalized to [0, 1]
     std::vector<float> xyz_data_{};
     std::vector<float> off_data_{};
     std::vector<float> transform_data_{};
     std::vector<float> palette_data_{};
     mat4d pose_{};
     float point_size_{2};
+    size_t lod_block_cols_{0};
+    float lod_full_detail_range_{0};
+    size_t lod_max_points_{0};
 
     Cloud(size_t w, size_t h, const mat4d& extrinsic);
 
@@ -500,19 +547,51 @@ class Cloud {
     /**
      * Set the key values, used for colouring.
      *
+     * Keys are kept with 16 bits of precision, clamped to [0, 1].
+     *
      * @param[in] key pointer to array of at least as many elements as there are
      *        points, preferably normalized between 0 and 1
      */
     void set_key(const float* key);
 
+    /**
+     * Set the key values, used for colouring, without conversion.
+     *
+     * @param[in] key pointer to array of at least as many elements as there are
+     *        points, where 0 to 65535 map to 0 to 1
+     */
+    void set_key(const uint16_t* key);
+
+    /**
+     * Set the key values, used for colouring, from a raw channel field.
+     *
+     * The field is scaled for display with auto exposure while drawing,
+     * replacing keys set by set_key().
+     *
+     * @param[in] field pointer to array of at least as many elements as there
+     *        are points, e.g. the signal field of a staggered scan
+     */
+    void set_key_field(const uint32_t* field);
+
     /**
      * Set the RGBA mask values, used as an overlay on top of the key.
      *
+     * Masks are kept with 8 bits of precision, clamped to [0, 1].
+     *
      * @param[in] mask pointer to array of at least 4x as many elements as there
      * are points, preferably normalized between 0 and 1
      */
     void set_mask(const float* mask);
 
+    /**
+     * Set the RGBA mask values, used as an overlay on top of the key, without
+     * conversion.
+     *
+     * @param[in] mask pointer to array of at least 4x as many elements as there
+     * are points, where 0 to 255 map to 0 to 1
+     */
+    void set_mask(const uint8_t* mask);
+
     /**
      * Set the XYZ values.
      *
@@ -567,21 +646,160 @@ class Cloud {
      */
     void set_palette(const float* palette, size_t palette_size);
 
+    /**
+     * Set the level of detail used to draw the point cloud.
+     *
+     * Columns are split into blocks. Blocks outside of the view are skipped,
+     * and far blocks are drawn with every 2nd, 4th, ... row: density halves
+     * every time the distance to the camera doubles beyond full_detail_range.
+     * All blocks are thinned further if more than max_points would be drawn.
+     * Bounds of blocks are recomputed on the render thread when points or
+     * column poses change, so this suits clouds that are mostly static,
+     * e.g. accumulated scans. Unstructured clouds form a single block.
+     *
+     * @param[in] block_cols number of columns per block, 0 to draw all points
+     * @param[in] full_detail_range distance from the camera up to which blocks
+     *            are drawn with all rows
+     * @param[in] max_points maximum number of points drawn per frame, 0 for no
+     *            limit
+     */
+    void set_lod(size_t block_cols, float full_detail_range = 50,
+                 size_t max_points = 0);
+
     friend class impl::GLCloud;
 };
 
+/**
+ * @brief Manages the state of the last n scans of a sensor, e.g. for trails or
+ * building maps.
+ *
+ * Scans are kept on the gpu in a ring of n slots, each with its own pose. New
+ * scans overwrite the oldest in place, so memory stays constant and all scans
+ * are drawn at once, however many there are. Points are transformed by the
+ * extrinsic, then by the pose of their scan; per-column poses aren't
+ * supported.
+ */
+class AccumulatedCloud {
+    // a scan added since the last call to PointViz::update()
+    struct Scan {
+        std::vector<uint32_t> range;
+        std::vector<uint16_t> key;  // normalized to [0, 1]
+        mat4d pose;
+    };
+
+    size_t n_{0};
+    size_t n_scans_{0};
+    mat4d extrinsic_{};
+
+    bool palette_changed_{false};
+    bool point_size_changed_{false};
+    bool reset_{false};
+
+    std::vector<float> xyz_data_{};
+    std::vector<float> off_data_{};
+    std::vector<float> palette_data_{};
+    float point_size_{2};
+
+    // at most n_scans_, oldest first; storage is reused between updates
+    std::vector<Scan> scans_{};
+    size_t n_added_{0};
+
+   public:
+    /**
+     * Accumulated point cloud of a sensor.
+     *
+     * Call add_scan() to update
+     *
+     * @param[in] w number of columns
+     * @param[in] h number of pixels per column
+     * @param[in] dir unit vectors for projection
+     * @param[in] off offsets for xyz projection
+     * @param[in] n_scans number of scans kept
+     * @param[in] extrinsic sensor extrinsic calibration. 4x4 column-major
+     *        homogeneous transformation matrix
+     */
+    AccumulatedCloud(size_t w, size_t h, const float* dir, const float* off,
+                     size_t n_scans, const mat4d& extrinsic = identity4d);
+
+    /**
+     * Clear dirty flags and the scans added.
+     *
+     * Resets any changes since the last call to PointViz::update()
+     */
+    void clear();
+
+    /**
+     * Get the number of points of a scan.
+     *
+     * @return the number of points of a scan
+     */
+    size_t get_size() { return n_; }
+
+    /**
+     * Get the number of scans kept.
+     *
+     * @return the number of scans kept
+     */
+    size_t get_n_scans() { return n_scans_; }
+
+    /**
+     * Add a scan, replacing the oldest once n_scans are kept.
+     *
+     * Scans added between calls to PointViz::update() are all sent, up to
+     * n_scans.
+     *
+     * @param[in] range pointer to array of at least as many elements as there
+     *        are points of a scan, representing the range of the points
+     * @param[in] key pointer to array of at least as many elements as there
+     *        are points of a scan, preferably normalized between 0 and 1.
+     *        Keys are kept with 16 bits of precision
+     * @param[in] pose pose of the scan, 4x4 column-major homogeneous
+     *        transformation matrix
+     */
+    void add_scan(const uint32_t* range, const float* key,
+                  const mat4d& pose = identity4d);
+
+    /**
+     * Drop all scans kept, including those already drawn.
+     */
+    void reset();
+
+    /**
+     * Set point size.
+     *
+     * @param[in] size point size
+     */
+    void set_point_size(float size);
+
+    /**
+     * Set the point cloud color palette.
+     *
+     * @param[in] palette the new palette to use, must have size 3*palette_size
+     * @param[in] palette_size the number of colors in the new palette
+     */
+    void set_palette(const float* palette, size_t palette_size);
+
+    friend class impl::GLAccumulatedCloud;
+};
+
 /**
  * @brief Manages the state of an image.
  */
 class Image {
     bool position_changed_{false};
     bool image_changed_{false};
+    bool field_changed_{false};
+    bool pixel_shift_changed_{false};
+    bool palette_changed_{false};
     bool mask_changed_{false};
 
     vec4f position_{};
     size_t image_width_{0};
     size_t image_height_{0};
     std::vector<float> image_data_{};
+    std::vector<uint32_t> field_data_{};
+    std::vector<int> pixel_shift_{};
+    std::vector<float> palette_data_{};
     size_t mask_width_{0};
     size_t mask_height_{0};
     std::vector<float> mask_data_{};
@@ -610,6 +828,37 @@ class Image {
      */
     void set_image(size_t width, size_t height, const float* image_data);
 
+    /**
+     * Set the image data from a raw channel field.
+     *
+     * The field is scaled for display with auto exposure and destaggered with
+     * the pixel shifts set by set_pixel_shift() while drawing, replacing the
+     * image set by set_image().
+     *
+     * @param[in] width width of the field in pixels
+     * @param[in] height height of the field in pixels
+     * @param[in] field pointer to an array of width * height elements
+     *        interpreted as a row-major, usually staggered, monochrome image
+     */
+    void set_field(size_t width, size_t height, const uint32_t* field);
+
+    /**
+     * Set the pixel shifts applied to fields set by set_field().
+     *
+     * @param[in] pixel_shift_by_row offset of each row, usually from the
+     *        sensor metadata; empty to draw fields as they are
+     */
+    void set_pixel_shift(const std::vector<int>& pixel_shift_by_row);
+
+    /**
+     * Set the image color palette.
+     *
+     * @param[in] palette the palette to use, must have size 3*palette_size
+     * @param[in] palette_size the number of colors in the palette; zero to
+     *        draw the image in grayscale
+     */
+    void set_palette(const float* palette, size_t palette_size);
+
     /**
      * Set the RGBA mask.
      *
@@ -8,6 +8,8 @@
 #include <Eigen/Core>
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include <vector>
 
@@ -21,8 +23,9 @@ namespace viz {
 namespace impl {
 
 struct CloudIds {
-    GLuint xyz_id, off_id, range_id, key_id, mask_id, model_id, proj_view_id,
-        palette_id, transformation_id, trans_index_id;
+    GLuint xyz_id, off_id, range_id, key_id, key_field_id, mask_id, model_id,
+        proj_view_id, palette_id, transformation_id, trans_index_id,
+        use_key_field_id, key_field_scale_id;
     CloudIds() {}
 
     /**
@@ -35,30 +38,145 @@ struct CloudIds {
           off_id(glGetAttribLocation(point_program_id, "offset")),
           range_id(glGetAttribLocation(point_program_id, "range")),
           key_id(glGetAttribLocation(point_program_id, "key")),
+          key_field_id(glGetAttribLocation(point_program_id, "key_field")),
           mask_id(glGetAttribLocation(point_program_id, "mask")),
           model_id(glGetUniformLocation(point_program_id, "model")),
           proj_view_id(glGetUniformLocation(point_program_id, "proj_view")),
           palette_id(glGetUniformLocation(point_program_id, "palette")),
           transformation_id(
               glGetUniformLocation(point_program_id, "transformation")),
-          trans_index_id(glGetAttribLocation(point_program_id, "trans_index")) {
-    }
+          trans_index_id(glGetAttribLocation(point_program_id, "trans_index")),
+          use_key_field_id(
+              glGetUniformLocation(point_program_id, "use_key_field")),
+          key_field_scale_id(
+              glGetUniformLocation(point_program_id, "key_field_scale")) {}
 };
 
+StreamBuffer::StreamBuffer(size_t size, const void* data, bool persistent)
+    : size{size}, persistent{persistent && size > 0} {
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+#ifdef GL_MAP_PERSISTENT_BIT
+    if (this->persistent) {
+        const GLbitfield flags =
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, n_slots * size, nullptr, flags);
+        mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, n_slots * size, flags);
+        if (mapped) {
+            std::memcpy(mapped, data, size);
+            return;
+        }
+        // can't map after all: storage is immutable, so start over
+        glDeleteBuffers(1, &buffer);
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        this->persistent = false;
+    }
+#endif
+    glBufferData(GL_ARRAY_BUFFER, size, data, GL_STREAM_DRAW);
+}
+
+StreamBuffer::~StreamBuffer() {
+    for (auto& f : fences)
+        if (f) glDeleteSync(f);
+    if (mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+void StreamBuffer::upload(const void* data) {
+    if (mapped) {
+        // wait for draws still reading the slot from two uploads ago
+        slot = (slot + 1) % n_slots;
+        if (GLsync& f = fences[slot]) {
+            while (glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                    1000000000) == GL_TIMEOUT_EXPIRED) {
+            }
+            glDeleteSync(f);
+            f = nullptr;
+        }
+        std::memcpy(static_cast<uint8_t*>(mapped) + slot * size, data, size);
+        return;
+    }
+
+    // orphan the old storage instead of waiting for draws reading it
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+}
+
+void StreamBuffer::bind(GLuint attrib, GLint components, GLenum type,
+                        GLboolean normalized) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(attrib,
+                          components,  // size
+                          type,        // type
+                          normalized,  // normalized?
+                          0,           // stride
+                          reinterpret_cast<void*>(slot * size)  // offset
+    );
+}
+
+void StreamBuffer::bind_integer(GLuint attrib, GLint components,
+                                GLenum type) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribIPointer(attrib,
+                           components,  // size
+                           type,        // type
+                           0,           // stride
+                           reinterpret_cast<void*>(slot * size)  // offset
+    );
+}
+
+void StreamBuffer::fence() {
+    if (!mapped) return;
+    GLsync& f = fences[slot];
+    if (f) glDeleteSync(f);
+    f = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool StreamBuffer::persistent_supported() {
+#ifdef GL_MAP_PERSISTENT_BIT
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 4)) return true;
+
+    GLint n_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &n_extensions);
+    for (GLint i = 0; i < n_extensions; i++) {
+        const auto ext = glGetStringi(GL_EXTENSIONS, i);
+        if (ext && std::strcmp(reinterpret_cast<const char*>(ext),
+                               "GL_ARB_buffer_storage") == 0)
+            return true;
+    }
+#endif
+    return false;
+}
+
 bool GLCloud::initialized = false;
 GLuint GLCloud::program_id;
 CloudIds GLCloud::cloud_ids;
-
-GLCloud::GLCloud(const Cloud& cloud) : point_size{cloud.point_size_} {
+bool GLCloud::persistent_buffers = false;
+
+GLCloud::GLCloud(const Cloud& cloud)
+    : xyz_buffer{sizeof(GLfloat) * cloud.xyz_data_.size(),
+                 cloud.xyz_data_.data(), persistent_buffers},
+      off_buffer{sizeof(GLfloat) * cloud.off_data_.size(),
+                 cloud.off_data_.data(), persistent_buffers},
+      range_buffer{sizeof(GLuint) * cloud.range_data_.size(),
+                   cloud.range_data_.data(), persistent_buffers},
+      key_buffer{sizeof(GLushort) * cloud.key_data_.size(),
+                 cloud.key_data_.data(), persistent_buffers},
+      mask_buffer{sizeof(GLubyte) * cloud.mask_data_.size(),
+                  cloud.mask_data_.data(), persistent_buffers},
+      point_size{cloud.point_size_} {
     if (!GLCloud::initialized)
         throw std::logic_error("GLCloud not initialized");
 
     // allocate gl object names
-    glGenBuffers(1, &xyz_buffer);
-    glGenBuffers(1, &off_buffer);
-    glGenBuffers(1, &range_buffer);
-    glGenBuffers(1, &key_buffer);
-    glGenBuffers(1, &mask_buffer);
     glGenBuffers(1, &trans_index_buffer);
     glGenTextures(1, &transform_texture);
     glGenTextures(1, &palette_texture);
@@ -70,26 +188,6 @@ GLCloud::GLCloud(const Cloud& cloud) : point_size{cloud.point_size_} {
     }
 
     // initialize GL state
-    glBindBuffer(GL_ARRAY_BUFFER, xyz_buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cloud.xyz_data_.size(),
-                 cloud.xyz_data_.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, off_buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cloud.off_data_.size(),
-                 cloud.off_data_.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, range_buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cloud.range_data_.size(),
-                 cloud.range_data_.data(), GL_DYNAMIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, key_buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cloud.key_data_.size(),
-                 cloud.key_data_.data(), GL_DYNAMIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mask_buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cloud.mask_data_.size(),
-                 cloud.mask_data_.data(), GL_STATIC_DRAW);
-
     glBindBuffer(GL_ARRAY_BUFFER, trans_index_buffer);
     glBufferData(GL_ARRAY_BUFFER,
                  sizeof(GLfloat) * cloud.transform_data_.size(),
@@ -103,11 +201,6 @@ GLCloud::GLCloud(const Cloud& cloud) : point_size{cloud.point_size_} {
 }
 
 GLCloud::~GLCloud() {
-    glDeleteBuffers(1, &xyz_buffer);
-    glDeleteBuffers(1, &off_buffer);
-    glDeleteBuffers(1, &range_buffer);
-    glDeleteBuffers(1, &key_buffer);
-    glDeleteBuffers(1, &mask_buffer);
     glDeleteBuffers(1, &trans_index_buffer);
     glDeleteTextures(1, &transform_texture);
     glDeleteTextures(1, &palette_texture);
@@ -117,6 +210,17 @@ GLCloud::~GLCloud() {
  * Render the point cloud with the point of view of the Camera
  */
 void GLCloud::draw(const WindowCtx&, const CameraData& camera, Cloud& cloud) {
+    if (cloud.lod_changed_) {
+        lod_block_cols = cloud.lod_block_cols_;
+        lod_full_detail_range = cloud.lod_full_detail_range_;
+        lod_max_points = cloud.lod_max_points_;
+        lod_bounds_stale = true;
+        cloud.lod_changed_ = false;
+    }
+    if (cloud.range_changed_ || cloud.xyz_changed_ || cloud.offset_changed_ ||
+        cloud.transform_changed_)
+        lod_bounds_stale = true;
+
     if (cloud.point_size_changed_) {
         point_size = cloud.point_size_;
         cloud.point_size_changed_ = false;
@@ -157,70 +261,63 @@ void GLCloud::draw(const WindowCtx&, const CameraData& camera, Cloud& cloud) {
     glBindTexture(GL_TEXTURE_2D, transform_texture);
 
     if (cloud.mask_changed_) {
-        glBindBuffer(GL_ARRAY_BUFFER, mask_buffer);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cloud.mask_data_.size(),
-                     cloud.mask_data_.data(), GL_STATIC_DRAW);
+        mask_buffer.upload(cloud.mask_data_.data());
         cloud.mask_changed_ = false;
     }
 
     if (cloud.xyz_changed_) {
-        glBindBuffer(GL_ARRAY_BUFFER, xyz_buffer);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cloud.xyz_data_.size(),
-                     cloud.xyz_data_.data(), GL_STATIC_DRAW);
+        xyz_buffer.upload(cloud.xyz_data_.data());
         cloud.xyz_changed_ = false;
     }
 
     if (cloud.offset_changed_) {
-        glBindBuffer(GL_ARRAY_BUFFER, off_buffer);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cloud.off_data_.size(),
-                     cloud.off_data_.data(), GL_STATIC_DRAW);
+        off_buffer.upload(cloud.off_data_.data());
         cloud.offset_changed_ = false;
     }
 
     if (cloud.range_changed_) {
-        glBindBuffer(GL_ARRAY_BUFFER, range_buffer);
-        glBufferData(GL_ARRAY_BUFFER,
-                     sizeof(GLfloat) * cloud.range_data_.size(),
-                     cloud.range_data_.data(), GL_DYNAMIC_DRAW);
+        range_buffer.upload(cloud.range_data_.data());
         cloud.range_changed_ = false;
     }
 
     if (cloud.key_changed_) {
-        glBindBuffer(GL_ARRAY_BUFFER, key_buffer);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cloud.key_data_.size(),
-                     cloud.key_data_.data(), GL_DYNAMIC_DRAW);
+        key_buffer.upload(cloud.key_data_.data());
+        use_key_field = false;
         cloud.key_changed_ = false;
     }
 
+    if (cloud.key_field_changed_) {
+        const auto& field = cloud.key_field_;
+        if (key_field_buffer)
+            key_field_buffer->upload(field.data());
+        else
+            key_field_buffer = std::make_unique<StreamBuffer>(
+                sizeof(GLuint) * field.size(), field.data(),
+                persistent_buffers);
+
+        // scale like AutoExposure would, without touching the field
+        double scale, offset;
+        const Eigen::Map<const img_t<uint32_t>> img{
+            field.data(), static_cast<Eigen::Index>(cloud.n_ / cloud.w_),
+            static_cast<Eigen::Index>(cloud.w_)};
+        if (key_field_ae.scaling(img, scale, offset)) {
+            key_field_scale[0] = static_cast<GLfloat>(scale);
+            key_field_scale[1] = static_cast<GLfloat>(offset);
+        }
+        use_key_field = true;
+        cloud.key_field_changed_ = false;
+    }
+    glUniform1i(GLCloud::cloud_ids.use_key_field_id, use_key_field);
+    glUniform2fv(GLCloud::cloud_ids.key_field_scale_id, 1, key_field_scale);
+
     glEnableVertexAttribArray(GLCloud::cloud_ids.mask_id);
-    glBindBuffer(GL_ARRAY_BUFFER, mask_buffer);
-    glVertexAttribPointer(GLCloud::cloud_ids.mask_id,
-                          4,         // size
-                          GL_FLOAT,  // type
-                          GL_FALSE,  // normalized?
-                          0,         // stride
-                          (void*)0   // array buffer offset
-    );
+    mask_buffer.bind(GLCloud::cloud_ids.mask_id, 4, GL_UNSIGNED_BYTE, GL_TRUE);
 
     glEnableVertexAttribArray(GLCloud::cloud_ids.xyz_id);
-    glBindBuffer(GL_ARRAY_BUFFER, xyz_buffer);
-    glVertexAttribPointer(GLCloud::cloud_ids.xyz_id,
-                          3,         // size
-                          GL_FLOAT,  // type
-                          GL_FALSE,  // normalized?
-                          0,         // stride
-                          (void*)0   // array buffer offset
-    );
+    xyz_buffer.bind(GLCloud::cloud_ids.xyz_id, 3);
 
     glEnableVertexAttribArray(GLCloud::cloud_ids.off_id);
-    glBindBuffer(GL_ARRAY_BUFFER, off_buffer);
-    glVertexAttribPointer(GLCloud::cloud_ids.off_id,
-                          3,         // size
-                          GL_FLOAT,  // type
-                          GL_FALSE,  // normalized?
-                          0,         // stride
-                          (void*)0   // array buffer offset
-    );
+    off_buffer.bind(GLCloud::cloud_ids.off_id, 3);
 
     glEnableVertexAttribArray(GLCloud::cloud_ids.trans_index_id);
     glBindBuffer(GL_ARRAY_BUFFER, trans_index_buffer);
@@ -233,37 +330,156 @@ void GLCloud::draw(const WindowCtx&, const CameraData& camera, Cloud& cloud) {
     );
 
     glEnableVertexAttribArray(GLCloud::cloud_ids.range_id);
-    glBindBuffer(GL_ARRAY_BUFFER, range_buffer);
-    glVertexAttribPointer(GLCloud::cloud_ids.range_id,
-                          1,         // size
-                          GL_FLOAT,  // type
-                          GL_FALSE,  // normalized?
-                          0,         // stride
-                          (void*)0   // array buffer offset
-    );
+    range_buffer.bind_integer(GLCloud::cloud_ids.range_id, 1, GL_UNSIGNED_INT);
     glEnableVertexAttribArray(GLCloud::cloud_ids.key_id);
-    glBindBuffer(GL_ARRAY_BUFFER, key_buffer);
-    glVertexAttribPointer(GLCloud::cloud_ids.key_id,
-                          1,         // size
-                          GL_FLOAT,  // type
-                          GL_FALSE,  // normalized?
-                          0,         // stride
-                          (void*)0   // array buffer offset
-    );
+    key_buffer.bind(GLCloud::cloud_ids.key_id, 1, GL_UNSIGNED_SHORT, GL_TRUE);
+    if (use_key_field) {
+        glEnableVertexAttribArray(GLCloud::cloud_ids.key_field_id);
+        key_field_buffer->bind_integer(GLCloud::cloud_ids.key_field_id, 1,
+                                       GL_UNSIGNED_INT);
+    }
 
-    glDrawArrays(GL_POINTS, 0, cloud.n_);
+    if (lod_block_cols) {
+        if (lod_bounds_stale) update_lod_bounds(cloud);
+        draw_lod(camera, mvp, cloud);
+    } else {
+        glDrawArrays(GL_POINTS, 0, cloud.n_);
+    }
+    mask_buffer.fence();
+    xyz_buffer.fence();
+    off_buffer.fence();
+    range_buffer.fence();
+    key_buffer.fence();
+    if (use_key_field) key_field_buffer->fence();
     glDisableVertexAttribArray(GLCloud::cloud_ids.mask_id);
     glDisableVertexAttribArray(GLCloud::cloud_ids.xyz_id);
     glDisableVertexAttribArray(GLCloud::cloud_ids.off_id);
     glDisableVertexAttribArray(GLCloud::cloud_ids.trans_index_id);
     glDisableVertexAttribArray(GLCloud::cloud_ids.range_id);
     glDisableVertexAttribArray(GLCloud::cloud_ids.key_id);
+    glDisableVertexAttribArray(GLCloud::cloud_ids.key_field_id);
+}
+
+void GLCloud::update_lod_bounds(const Cloud& cloud) {
+    const size_t w = cloud.w_;
+    const size_t h = cloud.n_ / w;
+    const size_t n_blocks = (w + lod_block_cols - 1) / lod_block_cols;
+    lod_bounds.assign(n_blocks, Eigen::AlignedBox3f{});
+
+    const Eigen::Matrix4f model =
+        Eigen::Map<const Eigen::Matrix4d>{cloud.extrinsic_.data()}
+            .cast<float>();
+    const auto& transform = cloud.transform_data_;
+
+    for (size_t v = 0; v < w; v++) {
+        // column pose, laid out as in the transformation texture
+        Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+        for (size_t c = 0; c < 4; c++)
+            for (size_t k = 0; k < 3; k++)
+                pose(k, c) = transform[(c * w + v) * 3 + k];
+        const Eigen::Matrix4f m = pose * model;
+
+        auto& box = lod_bounds[v / lod_block_cols];
+        for (size_t u = 0; u < h; u++) {
+            const size_t i = u * w + v;
+            const uint32_t range = cloud.range_data_[i];
+            if (range == 0) {
+                // the shader draws these at the origin of the column pose
+                box.extend(pose.block<3, 1>(0, 3));
+                continue;
+            }
+            const Eigen::Vector3f p =
+                Eigen::Map<const Eigen::Vector3f>{&cloud.xyz_data_[3 * i]} *
+                    static_cast<float>(range) +
+                Eigen::Map<const Eigen::Vector3f>{&cloud.off_data_[3 * i]};
+            box.extend((m * p.homogeneous()).head<3>());
+        }
+    }
+    lod_bounds_stale = false;
+}
+
+namespace {
+
+// whether any part of a box may be in view: it isn't if all of its corners are
+// outside of the same clipping plane
+bool in_frustum(const Eigen::Matrix4f& mvp, const Eigen::AlignedBox3f& box) {
+    int outside[6] = {0, 0, 0, 0, 0, 0};
+    for (int c = 0; c < 8; c++) {
+        const auto corner = static_cast<Eigen::AlignedBox3f::CornerType>(c);
+        const Eigen::Vector4f p = mvp * box.corner(corner).homogeneous();
+        for (int k = 0; k < 3; k++) {
+            if (p[k] < -p[3]) outside[2 * k]++;
+            if (p[k] > p[3]) outside[2 * k + 1]++;
+        }
+    }
+    return std::none_of(std::begin(outside), std::end(outside),
+                        [](int n) { return n == 8; });
+}
+
+}  // namespace
+
+void GLCloud::draw_lod(const CameraData& camera, const Eigen::Matrix4f& mvp,
+                       const Cloud& cloud) {
+    const size_t w = cloud.w_;
+    const size_t h = cloud.n_ / w;
+    const Eigen::Matrix4f model_view =
+        (camera.view * camera.target * map_pose).cast<float>();
+
+    // cull blocks out of view, and halve the density of the rest every time
+    // their distance doubles beyond the full detail range
+    lod_strides.assign(lod_bounds.size(), 0);
+    for (size_t b = 0; b < lod_bounds.size(); b++) {
+        const auto& box = lod_bounds[b];
+        if (box.isEmpty() || !in_frustum(mvp, box)) continue;
+        const Eigen::Vector4f center =
+            model_view * box.center().homogeneous();
+        const float distance = std::max(
+            center.head<3>().norm() - box.diagonal().norm() / 2, 0.0f);
+        size_t stride = 1;
+        while (stride < h && distance > lod_full_detail_range * stride)
+            stride *= 2;
+        lod_strides[b] = stride;
+    }
+
+    // thin all blocks further until under budget
+    auto n_drawn = [&](size_t factor) {
+        size_t n = 0;
+        for (size_t b = 0; b < lod_strides.size(); b++) {
+            if (!lod_strides[b]) continue;
+            const size_t stride = std::min(lod_strides[b] * factor, h);
+            const size_t v0 = b * lod_block_cols;
+            const size_t cols = std::min(lod_block_cols, w - v0);
+            n += cols * ((h + stride - 1) / stride);
+        }
+        return n;
+    };
+    size_t factor = 1;
+    while (lod_max_points && factor < h && n_drawn(factor) > lod_max_points)
+        factor *= 2;
+
+    // points are laid out by row, so each row of a block is a range
+    lod_first.clear();
+    lod_count.clear();
+    for (size_t b = 0; b < lod_strides.size(); b++) {
+        if (!lod_strides[b]) continue;
+        const size_t stride = std::min(lod_strides[b] * factor, h);
+        const size_t v0 = b * lod_block_cols;
+        const size_t cols = std::min(lod_block_cols, w - v0);
+        for (size_t u = 0; u < h; u += stride) {
+            lod_first.push_back(static_cast<GLint>(u * w + v0));
+            lod_count.push_back(static_cast<GLsizei>(cols));
+        }
+    }
+    if (!lod_first.empty())
+        glMultiDrawArrays(GL_POINTS, lod_first.data(), lod_count.data(),
+                          static_cast<GLsizei>(lod_first.size()));
 }
 
 void GLCloud::initialize() {
     GLCloud::program_id =
         load_shaders(point_vertex_shader_code, point_fragment_shader_code);
     GLCloud::cloud_ids = CloudIds(GLCloud::program_id);
+    GLCloud::persistent_buffers = StreamBuffer::persistent_supported();
     GLCloud::initialized = true;
 }
 
@@ -276,6 +492,195 @@ void GLCloud::beginDraw() { glUseProgram(GLCloud::program_id); }
 
 void GLCloud::endDraw() {}
 
+struct AccumulatedCloudIds {
+    GLuint xyz_id, off_id, range_id, key_id, poses_id, n_points_id, model_id,
+        proj_view_id, palette_id;
+    AccumulatedCloudIds() {}
+
+    explicit AccumulatedCloudIds(GLuint program_id)
+        : xyz_id(glGetAttribLocation(program_id, "xyz")),
+          off_id(glGetAttribLocation(program_id, "offset")),
+          range_id(glGetUniformLocation(program_id, "range")),
+          key_id(glGetUniformLocation(program_id, "key")),
+          poses_id(glGetUniformLocation(program_id, "poses")),
+          n_points_id(glGetUniformLocation(program_id, "n_points")),
+          model_id(glGetUniformLocation(program_id, "model")),
+          proj_view_id(glGetUniformLocation(program_id, "proj_view")),
+          palette_id(glGetUniformLocation(program_id, "palette")) {}
+};
+
+namespace {
+
+// allocate a buffer texture of size bytes, read as the format
+void init_buffer_texture(GLuint buffer, GLuint texture, size_t size,
+                         GLenum format) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+// copy size bytes of data to a slot of a buffer
+void upload_slot(GLuint buffer, size_t slot, size_t size, const void* data) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, slot * size, size, data);
+}
+
+}  // namespace
+
+bool GLAccumulatedCloud::initialized = false;
+GLuint GLAccumulatedCloud::program_id;
+AccumulatedCloudIds GLAccumulatedCloud::ids;
+
+GLAccumulatedCloud::GLAccumulatedCloud(const AccumulatedCloud& cloud)
+    : point_size{cloud.point_size_},
+      n{cloud.n_},
+      n_scans{cloud.n_scans_},
+      extrinsic{Eigen::Map<const Eigen::Matrix4d>{cloud.extrinsic_.data()}
+                    .cast<float>()} {
+    if (!GLAccumulatedCloud::initialized)
+        throw std::logic_error("GLAccumulatedCloud not initialized");
+
+    GLint max_texels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    if (n * n_scans > static_cast<size_t>(max_texels))
+        throw std::runtime_error(
+            "AccumulatedCloud exceeds the maximum buffer texture size");
+
+    glGenBuffers(1, &xyz_buffer);
+    glGenBuffers(1, &off_buffer);
+    glGenBuffers(1, &range_buffer);
+    glGenBuffers(1, &key_buffer);
+    glGenBuffers(1, &pose_buffer);
+    glGenTextures(1, &range_texture);
+    glGenTextures(1, &key_texture);
+    glGenTextures(1, &pose_texture);
+    glGenTextures(1, &palette_texture);
+
+    // the lut is shared by all scans
+    glBindBuffer(GL_ARRAY_BUFFER, xyz_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cloud.xyz_data_.size(),
+                 cloud.xyz_data_.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, off_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cloud.off_data_.size(),
+                 cloud.off_data_.data(), GL_STATIC_DRAW);
+
+    init_buffer_texture(range_buffer, range_texture,
+                        sizeof(GLuint) * n * n_scans, GL_R32UI);
+    init_buffer_texture(key_buffer, key_texture,
+                        sizeof(GLushort) * n * n_scans, GL_R16);
+    init_buffer_texture(pose_buffer, pose_texture,
+                        sizeof(GLfloat) * 16 * n_scans, GL_RGBA32F);
+
+    load_texture(cloud.palette_data_.data(), cloud.palette_data_.size() / 3, 1,
+                 palette_texture);
+}
+
+GLAccumulatedCloud::~GLAccumulatedCloud() {
+    glDeleteBuffers(1, &xyz_buffer);
+    glDeleteBuffers(1, &off_buffer);
+    glDeleteBuffers(1, &range_buffer);
+    glDeleteBuffers(1, &key_buffer);
+    glDeleteBuffers(1, &pose_buffer);
+    glDeleteTextures(1, &range_texture);
+    glDeleteTextures(1, &key_texture);
+    glDeleteTextures(1, &pose_texture);
+    glDeleteTextures(1, &palette_texture);
+}
+
+void GLAccumulatedCloud::draw(const WindowCtx&, const CameraData& camera,
+                              AccumulatedCloud& cloud) {
+    if (cloud.point_size_changed_) {
+        point_size = cloud.point_size_;
+        cloud.point_size_changed_ = false;
+    }
+    glPointSize(point_size);
+
+    if (cloud.reset_) {
+        next_slot = n_filled = 0;
+        cloud.reset_ = false;
+    }
+
+    // overwrite the oldest slots with the scans added, oldest first
+    for (size_t i = 0; i < cloud.n_added_; i++) {
+        const auto& scan = cloud.scans_[i];
+        const Eigen::Matrix4f pose =
+            Eigen::Map<const Eigen::Matrix4d>{scan.pose.data()}.cast<float>();
+        upload_slot(range_buffer, next_slot, sizeof(GLuint) * n,
+                    scan.range.data());
+        upload_slot(key_buffer, next_slot, sizeof(GLushort) * n,
+                    scan.key.data());
+        upload_slot(pose_buffer, next_slot, sizeof(GLfloat) * 16, pose.data());
+        next_slot = (next_slot + 1) % n_scans;
+        n_filled = std::min(n_filled + 1, n_scans);
+    }
+    cloud.n_added_ = 0;
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    const Eigen::Matrix4f proj_view =
+        (camera.proj * camera.view * camera.target).cast<float>();
+    glUniformMatrix4fv(ids.model_id, 1, GL_FALSE, extrinsic.data());
+    glUniformMatrix4fv(ids.proj_view_id, 1, GL_FALSE, proj_view.data());
+    glUniform1i(ids.n_points_id, static_cast<GLint>(n));
+
+    glUniform1i(ids.palette_id, 0);
+    glActiveTexture(GL_TEXTURE0);
+    if (cloud.palette_changed_) {
+        load_texture(cloud.palette_data_.data(), cloud.palette_data_.size() / 3,
+                     1, palette_texture);
+        cloud.palette_changed_ = false;
+    }
+    glBindTexture(GL_TEXTURE_2D, palette_texture);
+
+    glUniform1i(ids.range_id, 1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, range_texture);
+    glUniform1i(ids.key_id, 2);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, key_texture);
+    glUniform1i(ids.poses_id, 3);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_BUFFER, pose_texture);
+
+    glEnableVertexAttribArray(ids.xyz_id);
+    glBindBuffer(GL_ARRAY_BUFFER, xyz_buffer);
+    glVertexAttribPointer(ids.xyz_id, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glEnableVertexAttribArray(ids.off_id);
+    glBindBuffer(GL_ARRAY_BUFFER, off_buffer);
+    glVertexAttribPointer(ids.off_id, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+    // one instance per scan
+    if (n_filled)
+        glDrawArraysInstanced(GL_POINTS, 0, static_cast<GLsizei>(n),
+                              static_cast<GLsizei>(n_filled));
+
+    glDisableVertexAttribArray(ids.xyz_id);
+    glDisableVertexAttribArray(ids.off_id);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void GLAccumulatedCloud::initialize() {
+    GLAccumulatedCloud::program_id = load_shaders(
+        accumulated_vertex_shader_code, point_fragment_shader_code);
+    GLAccumulatedCloud::ids =
+        AccumulatedCloudIds(GLAccumulatedCloud::program_id);
+    GLAccumulatedCloud::initialized = true;
+}
+
+void GLAccumulatedCloud::uninitialize() {
+    GLAccumulatedCloud::initialized = false;
+    glDeleteProgram(GLAccumulatedCloud::program_id);
+}
+
+void GLAccumulatedCloud::beginDraw() {
+    glUseProgram(GLAccumulatedCloud::program_id);
+}
+
+void GLAccumulatedCloud::endDraw() {}
+
 }  // namespace impl
 }  // namespace viz
 }  // namespace ouster
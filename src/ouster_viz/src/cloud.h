@@ -6,9 +6,14 @@
 #pragma once
 
 #include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <cstddef>
+#include <memory>
+#include <vector>
 
 #include "camera.h"
 #include "glfw.h"
+#include "ouster/image_processing.h"
 #include "ouster/point_viz.h"
 
 namespace ouster {
@@ -21,6 +26,63 @@ namespace impl {
  */
 struct CloudIds;
 
+/*
+ * A vertex attribute buffer of fixed size, streamed to every time its data
+ * changes. Storage is allocated once. Where buffer storage is available (GL
+ * 4.4 or ARB_buffer_storage), it is persistently mapped and split into three
+ * slots written in turn, so that uploading never waits on draws still reading
+ * the previous data. Otherwise, uploads orphan the storage and copy with
+ * glBufferSubData.
+ */
+class StreamBuffer {
+    static constexpr int n_slots = 3;
+
+    GLuint buffer;
+    size_t size;
+    bool persistent;
+    int slot{0};
+    void* mapped{nullptr};
+    GLsync fences[n_slots]{};
+
+   public:
+    /*
+     * Allocate the buffer and upload initial data
+     */
+    StreamBuffer(size_t size, const void* data, bool persistent);
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    ~StreamBuffer();
+
+    /*
+     * Replace the contents of the buffer with size bytes of data
+     */
+    void upload(const void* data);
+
+    /*
+     * Point a float attribute at the current contents of the buffer, read as
+     * floats or as integers normalized to [0, 1]
+     */
+    void bind(GLuint attrib, GLint components, GLenum type = GL_FLOAT,
+              GLboolean normalized = GL_FALSE);
+
+    /*
+     * Point an integer attribute at the current contents of the buffer
+     */
+    void bind_integer(GLuint attrib, GLint components, GLenum type);
+
+    /*
+     * Mark the end of draws reading the current contents
+     */
+    void fence();
+
+    /*
+     * Whether the current context supports persistently mapped buffers
+     */
+    static bool persistent_supported();
+};
+
 /*
  * Manages opengl state for drawing a point cloud
  */
@@ -29,19 +91,47 @@ class GLCloud {
     static bool initialized;
     static GLuint program_id;
     static CloudIds cloud_ids;
+    static bool persistent_buffers;
 
    private:
     // per-object gl state
-    GLuint xyz_buffer;
-    GLuint off_buffer;
-    GLuint range_buffer;
-    GLuint key_buffer;
-    GLuint mask_buffer;
+    StreamBuffer xyz_buffer;
+    StreamBuffer off_buffer;
+    StreamBuffer range_buffer;
+    StreamBuffer key_buffer;
+    StreamBuffer mask_buffer;
+    std::unique_ptr<StreamBuffer> key_field_buffer;  // once a field is set
     GLuint trans_index_buffer;
     GLuint transform_texture;
     GLuint palette_texture;
     GLfloat point_size;
 
+    // scaling of raw key fields
+    bool use_key_field{false};
+    AutoExposure key_field_ae;
+    GLfloat key_field_scale[2]{0, 0};
+
+    // level of detail, see Cloud::set_lod()
+    size_t lod_block_cols{0};
+    float lod_full_detail_range{0};
+    size_t lod_max_points{0};
+    bool lod_bounds_stale{true};
+    std::vector<Eigen::AlignedBox3f> lod_bounds;  // per block, as drawn
+    std::vector<size_t> lod_strides;              // per block, 0 if culled
+    std::vector<GLint> lod_first;
+    std::vector<GLsizei> lod_count;
+
+    /*
+     * Compute the bounds of each block of columns, after column poses
+     */
+    void update_lod_bounds(const Cloud& cloud);
+
+    /*
+     * Draw the rows of blocks in view, thinned by distance and budget
+     */
+    void draw_lod(const CameraData& camera, const Eigen::Matrix4f& mvp,
+                  const Cloud& cloud);
+
     Eigen::Matrix4d map_pose;
     Eigen::Matrix4f extrinsic;
 
@@ -69,6 +159,62 @@ class GLCloud {
     static void endDraw();
 };
 
+/*
+ * Contains handles to variables in GLSL shader program compiled from
+ * accumulated_vertex_shader_code and point_fragment_shader_code
+ */
+struct AccumulatedCloudIds;
+
+/*
+ * Manages opengl state for drawing an accumulated cloud
+ *
+ * The ranges, keys and poses of all scans are kept in buffer textures of a
+ * fixed number of slots. Added scans are copied into the oldest slot, and the
+ * slots filled so far are drawn as instances of the xyz lut.
+ */
+class GLAccumulatedCloud {
+    // global gl state
+    static bool initialized;
+    static GLuint program_id;
+    static AccumulatedCloudIds ids;
+
+    // per-object gl state
+    GLuint xyz_buffer;
+    GLuint off_buffer;
+    GLuint range_buffer, range_texture;
+    GLuint key_buffer, key_texture;
+    GLuint pose_buffer, pose_texture;
+    GLuint palette_texture;
+    GLfloat point_size;
+
+    size_t n;        // points per scan
+    size_t n_scans;  // slots
+    size_t next_slot{0};
+    size_t n_filled{0};
+    Eigen::Matrix4f extrinsic;
+
+   public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    GLAccumulatedCloud(const AccumulatedCloud& cloud);
+
+    ~GLAccumulatedCloud();
+
+    /*
+     * Upload scans added since the last draw and render the slots filled
+     */
+    void draw(const WindowCtx& ctx, const CameraData& camera,
+              AccumulatedCloud& cloud);
+
+    static void initialize();
+
+    static void uninitialize();
+
+    static void beginDraw();
+
+    static void endDraw();
+};
+
 }  // namespace impl
 }  // namespace viz
 }  // namespace ouster
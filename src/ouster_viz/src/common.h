@@ -102,12 +102,14 @@ inline GLuint load_shaders(const std::string& vertex_shader_code,
  * @param texture_id handle generated by glGenTextures
  * @param internal_format internal format, e.g. GL_RGB or GL_RGB32F
  * @param format  format, e.g. GL_RGB or GL_RED
+ * @param type    type of the elements, e.g. GL_UNSIGNED_INT with the
+ *                GL_RED_INTEGER format for integer textures
  */
 template <class F>
 void load_texture(const F& texture, const size_t width, const size_t height,
                   const GLuint texture_id,
                   const GLenum internal_format = GL_RGB,
-                  const GLenum format = GL_RGB) {
+                  const GLenum format = GL_RGB, const GLenum type = GL_FLOAT) {
     glBindTexture(GL_TEXTURE_2D, texture_id);
 
     // we have only 1 level, so we override base/max levels
@@ -122,7 +124,7 @@ void load_texture(const F& texture, const size_t width, const size_t height,
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format,
-                 GL_FLOAT, texture);
+                 type, texture);
 }
 
 /**
@@ -132,9 +134,17 @@ void load_texture(const F& texture, const size_t width, const size_t height,
  * @param xyz            XYZ point before it was multiplied by range.
  *                       Corresponds to the "xyzlut" used by LidarScan.
  *
- * @param range          Range of each point.
+ * @param range          Range of each point, as an unsigned integer.
  *
  * @param key            Key for colouring each point for aesthetic reasons.
+ *                       Uploaded as 16 bit normalized integers.
+ *
+ * @param key_field      Raw key of each point, used instead of key if
+ *                       use_key_field is set. Scaled to [0, 1] by
+ *                       key_field_scale, a factor and an offset.
+ *
+ * @param mask           RGBA overlay of each point, uploaded as 8 bit
+ *                       normalized integers.
  *
  * @param trans_index    Index of which of the transformations to use for this
  *                       point. Normalized between 0 and 1. (0 being the first
@@ -156,20 +166,23 @@ static const std::string point_vertex_shader_code =
 
             in vec3 xyz;
             in vec3 offset;
-            in float range;
+            in uint range;
             in float key;
+            in uint key_field;
             in vec4 mask;
             in float trans_index;
 
             uniform sampler2D transformation;
             uniform mat4 model;
             uniform mat4 proj_view;
+            uniform bool use_key_field;
+            uniform vec2 key_field_scale;
 
             out float vcolor;
             out vec4 overlay_rgba;
             void main(){
-                vec4 local_point = range > 0
-                                   ? model * vec4(xyz * range + offset, 1.0)
+                vec4 local_point = range > 0u
+                                   ? model * vec4(xyz * float(range) + offset, 1.0)
                                    : vec4(0, 0, 0, 1.0);
                 // Here, we get the four columns of the transformation.
                 // Since this version of GLSL doesn't have texel fetch,
@@ -189,7 +202,11 @@ static const std::string point_vertex_shader_code =
                 );
 
                 gl_Position = proj_view * car_pose * local_point;
-                vcolor = sqrt(key);
+                float k = use_key_field
+                          ? clamp(float(key_field) * key_field_scale.x
+                                  + key_field_scale.y, 0.0, 1.0)
+                          : key;
+                vcolor = sqrt(k);
                 overlay_rgba = mask;
             })SHADER";
 static const std::string point_fragment_shader_code =
@@ -203,6 +220,39 @@ static const std::string point_fragment_shader_code =
                 color = vec4(texture(palette, vec2(vcolor, 1)).xyz * (1.0 - overlay_rgba.w)
                              + overlay_rgba.xyz * overlay_rgba.w, 1);
             })SHADER";
+/**
+ * The accumulated vertex shader draws one instance of the xyz lut per scan
+ * slot, fetching the range and key of each point and the pose of its scan from
+ * buffer textures. Points without range are moved out of view.
+ */
+static const std::string accumulated_vertex_shader_code =
+    R"SHADER(
+            #version 330 core
+
+            in vec3 xyz;
+            in vec3 offset;
+
+            uniform usamplerBuffer range;
+            uniform samplerBuffer key;
+            uniform samplerBuffer poses;
+            uniform int n_points;
+            uniform mat4 model;
+            uniform mat4 proj_view;
+
+            out float vcolor;
+            out vec4 overlay_rgba;
+            void main(){
+                int i = gl_InstanceID * n_points + gl_VertexID;
+                uint r = texelFetch(range, i).r;
+                int p = 4 * gl_InstanceID;
+                mat4 pose = mat4(texelFetch(poses, p), texelFetch(poses, p + 1),
+                                 texelFetch(poses, p + 2), texelFetch(poses, p + 3));
+                gl_Position = r > 0u
+                              ? proj_view * pose * model * vec4(xyz * float(r) + offset, 1.0)
+                              : vec4(2.0, 2.0, 2.0, 1.0);
+                vcolor = sqrt(texelFetch(key, i).r);
+                overlay_rgba = vec4(0.0);
+            })SHADER";
 static const std::string ring_vertex_shader_code =
     R"SHADER(
             #version 330 core
@@ -255,12 +305,38 @@ static const std::string image_fragment_shader_code =
             in vec2 uv;
             uniform sampler2D image;
             uniform sampler2D mask;
+            uniform usampler2D field;
+            uniform isampler2D pixel_shift;
+            uniform sampler2D palette;
+            uniform bool use_field;
+            uniform bool use_pixel_shift;
+            uniform bool use_palette;
+            uniform vec2 field_scale;
             out vec4 color;
             void main() {
                 vec4 m = texture(mask, uv);
                 float a = m.a;
-                float r = sqrt(texture(image, uv).r) * (1.0 - a);
-                color = vec4(vec3(r, r, r) + m.rgb * a, 1.0);
+                float x;
+                if (use_field) {
+                    // destagger and scale raw fields while drawing. Shifts
+                    // are uploaded modulo the width
+                    ivec2 size = textureSize(field, 0);
+                    ivec2 px = clamp(ivec2(uv * vec2(size)), ivec2(0),
+                                     size - 1);
+                    if (use_pixel_shift) {
+                        int shift =
+                            texelFetch(pixel_shift, ivec2(0, px.y), 0).r;
+                        px.x = (px.x - shift + size.x) % size.x;
+                    }
+                    float v = float(texelFetch(field, px, 0).r);
+                    x = clamp(v * field_scale.x + field_scale.y, 0.0, 1.0);
+                } else {
+                    x = texture(image, uv).r;
+                }
+                float r = sqrt(x);
+                vec3 rgb = use_palette ? texture(palette, vec2(r, 1)).rgb
+                                       : vec3(r, r, r);
+                color = vec4(rgb * (1.0 - a) + m.rgb * a, 1.0);
             })SHADER";
 
 }  // namespace impl
@@ -5,6 +5,7 @@
 
 #include "glfw.h"
 
+#include <cstdlib>
 #include <functional>
 #include <iostream>
 #include <stdexcept>
@@ -126,13 +127,23 @@ void handle_cursor_enter(GLFWwindow* window, int entered) {
  * Initialize GLFW window
  */
 GLFWContext::GLFWContext(const std::string& name, bool fix_aspect,
-                         int window_width, int window_height) {
+                         int window_width, int window_height, bool headless)
+    : headless{headless} {
     glfwSetErrorCallback(error_callback);
 
     // avoid chdir to resources dir on macos
 #ifdef __APPLE__
     glfwInitHint(GLFW_COCOA_CHDIR_RESOURCES, false);
 #endif
+
+    // without a display, create the context with EGL on the null platform
+    const bool null_platform =
+        headless && !std::getenv("DISPLAY") && !std::getenv("WAYLAND_DISPLAY");
+#ifdef GLFW_PLATFORM_NULL
+    if (null_platform) glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+    (void)null_platform;
+#endif
     if (!glfwInit()) {
         throw std::runtime_error("Failed to initialize GLFW");
     }
@@ -145,6 +156,10 @@ GLFWContext::GLFWContext(const std::string& name, bool fix_aspect,
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, 1);
     glfwWindowHint(GLFW_VISIBLE, false);
+#ifdef GLFW_PLATFORM_NULL
+    if (null_platform)
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+#endif
 
     // open a window and create its OpenGL context
     window =
@@ -227,7 +242,9 @@ void GLFWContext::running(bool state) {
 }
 
 void GLFWContext::visible(bool state) {
-    if (state)
+    if (headless)
+        return;
+    else if (state)
         glfwShowWindow(window);
     else
         glfwHideWindow(window);
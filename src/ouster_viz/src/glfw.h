@@ -23,7 +23,8 @@ namespace viz {
 
 struct GLFWContext {
     explicit GLFWContext(const std::string& name, bool fix_aspect,
-                         int window_width, int window_height);
+                         int window_width, int window_height,
+                         bool headless = false);
 
     // manages glfw window pointer lifetime
     GLFWContext(const GLFWContext&) = delete;
@@ -42,10 +43,14 @@ struct GLFWContext {
     bool running();
     void running(bool);
 
+    // no-op when headless: the window is never shown
     void visible(bool);
 
     GLFWwindow* window;
 
+    // rendering offscreen, without showing a window
+    const bool headless;
+
     // state set by GLFW callbacks
     WindowCtx window_context;
 
@@ -5,6 +5,7 @@
 
 #include "image.h"
 
+#include <Eigen/Core>
 #include <stdexcept>
 #include <vector>
 
@@ -23,6 +24,13 @@ GLuint GLImage::vertex_id;
 GLuint GLImage::uv_id;
 GLuint GLImage::image_id;
 GLuint GLImage::mask_id;
+GLuint GLImage::field_id;
+GLuint GLImage::pixel_shift_id;
+GLuint GLImage::palette_id;
+GLuint GLImage::use_field_id;
+GLuint GLImage::use_pixel_shift_id;
+GLuint GLImage::use_palette_id;
+GLuint GLImage::field_scale_id;
 
 GLImage::GLImage() {
     if (!GLImage::initialized)
@@ -36,15 +44,24 @@ GLImage::GLImage() {
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, 6 * sizeof(GLubyte), indices,
                  GL_STATIC_DRAW);
 
-    GLuint textures[2];
-    glGenTextures(2, textures);
+    GLuint textures[5];
+    glGenTextures(5, textures);
     image_texture_id = textures[0];
     mask_texture_id = textures[1];
+    field_texture_id = textures[2];
+    pixel_shift_texture_id = textures[3];
+    palette_texture_id = textures[4];
 
     // initialize textures
     GLfloat init[4] = {0, 0, 0, 0};
+    GLuint init_int[1] = {0};
     load_texture(init, 1, 1, image_texture_id, GL_RED, GL_RED);
     load_texture(init, 1, 1, mask_texture_id, GL_RGBA, GL_RGBA);
+    load_texture(init_int, 1, 1, field_texture_id, GL_R32UI, GL_RED_INTEGER,
+                 GL_UNSIGNED_INT);
+    load_texture(init_int, 1, 1, pixel_shift_texture_id, GL_R32I,
+                 GL_RED_INTEGER, GL_INT);
+    load_texture(init, 1, 1, palette_texture_id);
 }
 
 GLImage::GLImage(const Image& /*image*/) : GLImage{} {}
@@ -53,6 +70,9 @@ GLImage::~GLImage() {
     glDeleteBuffers(2, vertexbuffers.data());
     glDeleteTextures(1, &image_texture_id);
     glDeleteTextures(1, &mask_texture_id);
+    glDeleteTextures(1, &field_texture_id);
+    glDeleteTextures(1, &pixel_shift_texture_id);
+    glDeleteTextures(1, &palette_texture_id);
 }
 
 void GLImage::draw(const WindowCtx& ctx, const CameraData&, Image& image) {
@@ -73,10 +93,79 @@ void GLImage::draw(const WindowCtx& ctx, const CameraData&, Image& image) {
     if (image.image_changed_) {
         load_texture(image.image_data_.data(), image.image_width_,
                      image.image_height_, image_texture_id, GL_RED, GL_RED);
+        use_field = false;
         image.image_changed_ = false;
     }
     glBindTexture(GL_TEXTURE_2D, image_texture_id);
 
+    glUniform1i(field_id, 2);
+    glUniform1i(pixel_shift_id, 3);
+    glUniform1i(palette_id, 4);
+
+    glActiveTexture(GL_TEXTURE2);
+    if (image.field_changed_) {
+        const bool resized = field_width != image.image_width_ ||
+                             field_height != image.image_height_;
+        field_width = image.image_width_;
+        field_height = image.image_height_;
+        if (resized)
+            load_texture(image.field_data_.data(), field_width, field_height,
+                         field_texture_id, GL_R32UI, GL_RED_INTEGER,
+                         GL_UNSIGNED_INT);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, field_width,
+                            field_height, GL_RED_INTEGER, GL_UNSIGNED_INT,
+                            image.field_data_.data());
+
+        // scale like AutoExposure would, without touching the field
+        double scale, offset;
+        const Eigen::Map<const img_t<uint32_t>> img{
+            image.field_data_.data(), static_cast<Eigen::Index>(field_height),
+            static_cast<Eigen::Index>(field_width)};
+        if (field_ae.scaling(img, scale, offset)) {
+            field_scale[0] = static_cast<GLfloat>(scale);
+            field_scale[1] = static_cast<GLfloat>(offset);
+        }
+        use_field = true;
+        image.field_changed_ = false;
+        // shifts are uploaded modulo the width
+        if (resized) image.pixel_shift_changed_ = true;
+    }
+    glBindTexture(GL_TEXTURE_2D, field_texture_id);
+
+    glActiveTexture(GL_TEXTURE3);
+    if (image.pixel_shift_changed_) {
+        use_pixel_shift = !image.pixel_shift_.empty() &&
+                          image.pixel_shift_.size() == field_height;
+        if (use_pixel_shift) {
+            const int w = static_cast<int>(field_width);
+            std::vector<GLint> shifts(field_height);
+            for (size_t u = 0; u < field_height; u++)
+                shifts[u] = (image.pixel_shift_[u] % w + w) % w;
+            load_texture(shifts.data(), 1, field_height,
+                         pixel_shift_texture_id, GL_R32I, GL_RED_INTEGER,
+                         GL_INT);
+        }
+        image.pixel_shift_changed_ = false;
+    }
+    glBindTexture(GL_TEXTURE_2D, pixel_shift_texture_id);
+
+    glActiveTexture(GL_TEXTURE4);
+    if (image.palette_changed_) {
+        use_palette = !image.palette_data_.empty();
+        if (use_palette)
+            load_texture(image.palette_data_.data(),
+                         image.palette_data_.size() / 3, 1,
+                         palette_texture_id);
+        image.palette_changed_ = false;
+    }
+    glBindTexture(GL_TEXTURE_2D, palette_texture_id);
+
+    glUniform1i(use_field_id, use_field);
+    glUniform1i(use_pixel_shift_id, use_field && use_pixel_shift);
+    glUniform1i(use_palette_id, use_palette);
+    glUniform2fv(field_scale_id, 1, field_scale);
+
     glActiveTexture(GL_TEXTURE1);
     if (image.mask_changed_) {
         load_texture(image.mask_data_.data(), image.mask_width_,
@@ -132,6 +221,18 @@ void GLImage::initialize() {
     GLImage::uv_id = glGetAttribLocation(GLImage::program_id, "vertex_uv");
     GLImage::image_id = glGetUniformLocation(GLImage::program_id, "image");
     GLImage::mask_id = glGetUniformLocation(GLImage::program_id, "mask");
+    GLImage::field_id = glGetUniformLocation(GLImage::program_id, "field");
+    GLImage::pixel_shift_id =
+        glGetUniformLocation(GLImage::program_id, "pixel_shift");
+    GLImage::palette_id = glGetUniformLocation(GLImage::program_id, "palette");
+    GLImage::use_field_id =
+        glGetUniformLocation(GLImage::program_id, "use_field");
+    GLImage::use_pixel_shift_id =
+        glGetUniformLocation(GLImage::program_id, "use_pixel_shift");
+    GLImage::use_palette_id =
+        glGetUniformLocation(GLImage::program_id, "use_palette");
+    GLImage::field_scale_id =
+        glGetUniformLocation(GLImage::program_id, "field_scale");
     GLImage::initialized = true;
 }
 
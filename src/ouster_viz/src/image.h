@@ -9,6 +9,7 @@
 
 #include "camera.h"
 #include "glfw.h"
+#include "ouster/image_processing.h"
 #include "ouster/point_viz.h"
 
 namespace ouster {
@@ -31,15 +32,33 @@ class GLImage {
     static GLuint uv_id;
     static GLuint image_id;
     static GLuint mask_id;
+    static GLuint field_id;
+    static GLuint pixel_shift_id;
+    static GLuint palette_id;
+    static GLuint use_field_id;
+    static GLuint use_pixel_shift_id;
+    static GLuint use_palette_id;
+    static GLuint field_scale_id;
 
     // per-image gl state
     std::array<GLuint, 2> vertexbuffers;
     GLuint image_texture_id{0};
     GLuint mask_texture_id{0};
+    GLuint field_texture_id{0};
+    GLuint pixel_shift_texture_id{0};
+    GLuint palette_texture_id{0};
     GLuint image_index_id{0};
 
     float x0{-1}, x1{0}, y0{0}, y1{-1}, hshift{0};
 
+    // raw fields, scaled and destaggered while drawing
+    bool use_field{false};
+    bool use_pixel_shift{false};
+    bool use_palette{false};
+    size_t field_width{0}, field_height{0};
+    AutoExposure field_ae;
+    GLfloat field_scale[2]{0, 0};
+
    public:
     GLImage();
 
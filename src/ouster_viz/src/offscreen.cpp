@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "offscreen.h"
+
+#include <stdexcept>
+
+namespace ouster {
+namespace viz {
+namespace impl {
+
+GLOffscreen::GLOffscreen(int width, int height) {
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &color_buffer);
+    glGenRenderbuffers(1, &depth_buffer);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width,
+                          height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, color_buffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, depth_buffer);
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &color_buffer);
+        glDeleteRenderbuffers(1, &depth_buffer);
+        throw std::runtime_error("Failed to create offscreen framebuffer");
+    }
+}
+
+GLOffscreen::~GLOffscreen() {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &color_buffer);
+    glDeleteRenderbuffers(1, &depth_buffer);
+}
+
+void GLOffscreen::bind() { glBindFramebuffer(GL_FRAMEBUFFER, framebuffer); }
+
+GLFrameCapture::GLFrameCapture() {
+    for (auto& slot : slots) glGenBuffers(1, &slot.buffer);
+}
+
+GLFrameCapture::~GLFrameCapture() {
+    for (auto& slot : slots) {
+        if (slot.fence) glDeleteSync(slot.fence);
+        glDeleteBuffers(1, &slot.buffer);
+    }
+}
+
+void GLFrameCapture::deliver(Slot& slot, const Handler& handler) {
+    // waits only if the copy hasn't completed yet
+    while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                            1000000000) == GL_TIMEOUT_EXPIRED) {
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    const size_t size = static_cast<size_t>(slot.width) * slot.height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void* pixels =
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (pixels)
+        handler(static_cast<const uint8_t*>(pixels), slot.width, slot.height);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void GLFrameCapture::capture(int width, int height, const Handler& handler) {
+    // all buffers in flight: wait for the oldest
+    Slot& slot = slots[next];
+    if (slot.fence) deliver(slot, handler);
+
+    const size_t size = static_cast<size_t>(width) * height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (size > slot.capacity) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        slot.capacity = size;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width;
+    slot.height = height;
+    next = (next + 1) % n_buffers;
+
+    // hand over completed reads, oldest first, without waiting
+    for (int i = 0; i < n_buffers; i++) {
+        Slot& s = slots[(next + i) % n_buffers];
+        if (!s.fence) continue;
+        const GLenum res = glClientWaitSync(s.fence, 0, 0);
+        if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+            break;
+        deliver(s, handler);
+    }
+}
+
+void GLFrameCapture::flush(const Handler& handler) {
+    for (int i = 0; i < n_buffers; i++) {
+        Slot& s = slots[(next + i) % n_buffers];
+        if (s.fence) deliver(s, handler);
+    }
+}
+
+}  // namespace impl
+}  // namespace viz
+}  // namespace ouster
@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "glfw.h"
+
+namespace ouster {
+namespace viz {
+namespace impl {
+
+/*
+ * A framebuffer to render into instead of a window, for headless rendering
+ */
+class GLOffscreen {
+    GLuint framebuffer{0};
+    GLuint color_buffer{0};
+    GLuint depth_buffer{0};
+
+   public:
+    /*
+     * Allocate color and depth buffers of the given size
+     */
+    GLOffscreen(int width, int height);
+
+    GLOffscreen(const GLOffscreen&) = delete;
+    GLOffscreen& operator=(const GLOffscreen&) = delete;
+
+    ~GLOffscreen();
+
+    /*
+     * Draw into and read from the framebuffer
+     */
+    void bind();
+};
+
+/*
+ * Reads back rendered frames asynchronously into a ring of pixel buffers
+ *
+ * Reading a frame only queues a copy on the gpu. Frames are handed to the
+ * callback once the copy completes, usually a frame or two later, so reading
+ * back never waits for rendering unless all buffers are in flight.
+ */
+class GLFrameCapture {
+   public:
+    /*
+     * Called with the RGBA pixels of a frame, bottom row first, its width and
+     * its height
+     */
+    using Handler = std::function<void(const uint8_t*, int, int)>;
+
+   private:
+    static constexpr int n_buffers = 3;
+
+    struct Slot {
+        GLuint buffer{0};
+        GLsync fence{nullptr};
+        size_t capacity{0};
+        int width{0}, height{0};
+    };
+
+    std::array<Slot, n_buffers> slots;
+    int next{0};
+
+    void deliver(Slot& slot, const Handler& handler);
+
+   public:
+    GLFrameCapture();
+
+    GLFrameCapture(const GLFrameCapture&) = delete;
+    GLFrameCapture& operator=(const GLFrameCapture&) = delete;
+
+    ~GLFrameCapture();
+
+    /*
+     * Queue a read of the current read framebuffer, and hand completed reads
+     * to the handler in order
+     */
+    void capture(int width, int height, const Handler& handler);
+
+    /*
+     * Wait for all reads in flight and hand them to the handler
+     */
+    void flush(const Handler& handler);
+};
+
+}  // namespace impl
+}  // namespace viz
+}  // namespace ouster
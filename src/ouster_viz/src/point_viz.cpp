@@ -7,8 +7,11 @@
 
 #include <Eigen/Core>
 #include <algorithm>
-#include <cassert>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <list>
 #include <memory>
 #include <mutex>
@@ -24,6 +27,7 @@
 #include "glfw.h"
 #include "image.h"
 #include "misc.h"
+#include "offscreen.h"
 
 static_assert(std::is_same<GLfloat, float>::value,
               "Platform has unexpected definition of GLfloat");
@@ -34,21 +38,47 @@ namespace viz {
 namespace {
 
 /*
- * Helper for addable / removable drawable objects
+ * Helper for addable / removable drawable objects, triple buffered
+ *
+ * The producer owns the objects added by users (back) and the published
+ * states (mid); the render thread owns the states being drawn (front) and
+ * their gl objects. Publishing swaps the contents of back and mid, and drawing
+ * picks up published states by swapping pointers with the front. Neither
+ * copies, blocks the other, or allocates once an object has been published
+ * twice: after that, it always has a state in mid and in front.
+ *
+ * publish() must only be called while nothing is published, and pick_up()
+ * only after a call to publish(); PointViz uses an atomic flag to hand over.
  */
 template <typename GL, typename T>
 class Indexed {
+    // a state tagged with the generation of the object it belongs to
+    struct State {
+        std::unique_ptr<T> state;
+        uint64_t gen{0};
+    };
+
     struct Front {
         std::unique_ptr<GL> gl;
-        std::unique_ptr<T> state;
+        uint64_t gl_gen{0};
+        State state;
     };
     using Back = std::shared_ptr<T>;
 
-    std::vector<Front> front;
+    // producer side
     std::vector<Back> back;
+    std::vector<Back> published;  // object of each slot at the last publish
+    std::vector<uint64_t> gens;   // current generation of each slot
+    uint64_t next_gen{1};
+
+    // handed over
+    std::vector<State> mid;
+
+    // render side
+    std::vector<Front> front;
 
    public:
-    Indexed() : front{}, back{} {}
+    Indexed() : back{}, published{}, gens{}, mid{}, front{} {}
 
     void add(const std::shared_ptr<T>& t) {
         // find and use first empty slot, or grow
@@ -73,33 +103,69 @@ class Indexed {
 
     void draw(const WindowCtx& ctx, const impl::CameraData& camera) {
         for (auto& f : front) {
-            if (!f.state) continue;  // skip deleted
-            if (!f.gl)
-                f.gl = std::make_unique<GL>(*f.state);  // init GL for added
-            f.gl->draw(ctx, camera, *f.state);
+            if (!f.state.state) {
+                // release gl state of removed objects
+                f.gl.reset();
+                continue;
+            }
+            if (!f.gl || f.gl_gen != f.state.gen) {
+                // init GL for added
+                f.gl = std::make_unique<GL>(*f.state.state);
+                f.gl_gen = f.state.gen;
+            }
+            f.gl->draw(ctx, camera, *f.state.state);
         }
     }
 
-    void swap() {
-        assert(front.size() <= back.size());
-
+    /*
+     * Send updated, added or removed state of the producer to mid
+     */
+    void publish() {
         // in case back grew
-        if (front.size() < back.size()) front.resize(back.size());
+        published.resize(back.size());
+        gens.resize(back.size(), 0);
+        mid.resize(back.size());
 
-        // send updated, added or deleted state to the front
         for (size_t i = 0; i < back.size(); i++) {
-            if (back[i] && front[i].state) {
-                std::swap(*front[i].state, *back[i]);
-            } else if (back[i] && !front[i].state) {
-                front[i].state = std::make_unique<T>(*back[i]);
+            if (back[i] != published[i]) {
+                published[i] = back[i];
+                gens[i] = back[i] ? next_gen++ : 0;
+            }
+
+            State& m = mid[i];
+            if (!back[i]) {
+                m = State{};
+            } else if (m.state && m.gen == gens[i]) {
+                // hand over the changes, getting back a drawn state
+                std::swap(*m.state, *back[i]);
+            } else {
+                // copy only until the object has a state on each side
+                m = State{std::make_unique<T>(*back[i]), gens[i]};
                 back[i]->clear();
-            } else if (!back[i] && front[i].state) {
-                front[i].state.reset();
             }
         }
     }
+
+    /*
+     * Swap published states with the drawn ones, on the render thread
+     */
+    void pick_up() {
+        if (front.size() < mid.size()) front.resize(mid.size());
+        for (size_t i = 0; i < mid.size(); i++)
+            std::swap(front[i].state, mid[i]);
+    }
 };
 
+/*
+ * Convert a value between 0 and 1 to an unsigned normalized integer, as read
+ * by the gpu, clamping values out of range
+ */
+template <typename T>
+T normalized(float x) {
+    constexpr float max = std::numeric_limits<T>::max();
+    return static_cast<T>(std::lround(std::min(1.0f, std::max(0.0f, x)) * max));
+}
+
 }  // namespace
 
 /*
@@ -109,16 +175,17 @@ struct PointViz::Impl {
     std::unique_ptr<GLFWContext> glfw;
     GLuint vao;
 
-    // state for drawing
-    std::mutex update_mx;
-    bool front_changed{false};
+    // set when objects are published, cleared when they're picked up
+    std::atomic<bool> front_changed{false};
 
+    // camera and target are small, so they're copied under a lock
+    std::mutex update_mx;
     Camera camera_back, camera_front;
-
-    TargetDisplay target;
+    TargetDisplay target, target_front;
     impl::GLRings rings;
 
     Indexed<impl::GLCloud, Cloud> clouds;
+    Indexed<impl::GLAccumulatedCloud, AccumulatedCloud> accumulated_clouds;
     Indexed<impl::GLCuboid, Cuboid> cuboids;
     Indexed<impl::GLLabel, Label> labels;
     Indexed<impl::GLImage, Image> images;
@@ -130,6 +197,19 @@ struct PointViz::Impl {
     Handlers<bool(const WindowCtx&, int, int)> mouse_button_handlers;
     Handlers<bool(const WindowCtx&, double, double)> scroll_handlers;
     Handlers<bool(const WindowCtx&, double, double)> mouse_pos_handlers;
+    Handlers<bool(const uint8_t*, int, int)> frame_handlers;
+
+    // render target when headless, sized to the viewport
+    std::unique_ptr<impl::GLOffscreen> offscreen;
+    int offscreen_width{0}, offscreen_height{0};
+
+    // created once frames are first handled
+    std::unique_ptr<impl::GLFrameCapture> capture;
+
+    void handle_frame(const uint8_t* rgba, int width, int height) {
+        for (auto& f : frame_handlers)
+            if (!f(rgba, width, height)) break;
+    }
 
     Impl(std::unique_ptr<GLFWContext>&& glfw) : glfw{std::move(glfw)} {}
 };
@@ -139,9 +219,9 @@ struct PointViz::Impl {
  */
 
 PointViz::PointViz(const std::string& name, bool fix_aspect, int window_width,
-                   int window_height) {
+                   int window_height, bool headless) {
     auto glfw = std::make_unique<GLFWContext>(name, fix_aspect, window_width,
-                                              window_height);
+                                              window_height, headless);
 
     // set context for GL initialization
     glfwMakeContextCurrent(glfw->window);
@@ -158,6 +238,7 @@ PointViz::PointViz(const std::string& name, bool fix_aspect, int window_width,
 
     // TODO: need to check if these were already called?
     impl::GLCloud::initialize();
+    impl::GLAccumulatedCloud::initialize();
     impl::GLImage::initialize();
     impl::GLRings::initialize();
     impl::GLCuboid::initialize();
@@ -196,7 +277,19 @@ PointViz::PointViz(const std::string& name, bool fix_aspect, int window_width,
     };
 }
 
-PointViz::~PointViz() { glDeleteVertexArrays(1, &pimpl->vao); }
+PointViz::~PointViz() {
+    // hand over frames still being read back
+    if (pimpl->capture) {
+        glfwMakeContextCurrent(pimpl->glfw->window);
+        pimpl->capture->flush(
+            [this](const uint8_t* rgba, int width, int height) {
+                pimpl->handle_frame(rgba, width, height);
+            });
+    }
+    pimpl->capture.reset();
+    pimpl->offscreen.reset();
+    glDeleteVertexArrays(1, &pimpl->vao);
+}
 
 void PointViz::run() {
     pimpl->glfw->running(true);
@@ -219,43 +312,81 @@ void PointViz::running(bool state) { pimpl->glfw->running(state); }
 void PointViz::visible(bool state) { pimpl->glfw->visible(state); }
 
 bool PointViz::update() {
-    std::lock_guard<std::mutex> guard{pimpl->update_mx};
-
     // propagate camera changes
-    pimpl->camera_front = pimpl->camera_back;
+    {
+        std::lock_guard<std::mutex> guard{pimpl->update_mx};
+        pimpl->camera_front = pimpl->camera_back;
+        pimpl->target_front = pimpl->target;
+    }
 
     // last frame hasn't been drawn yet
-    if (pimpl->front_changed) return false;
+    if (pimpl->front_changed.load(std::memory_order_acquire)) return false;
 
-    pimpl->clouds.swap();
-    pimpl->cuboids.swap();
-    pimpl->labels.swap();
-    pimpl->images.swap();
-    pimpl->rings.update(pimpl->target);
+    pimpl->clouds.publish();
+    pimpl->accumulated_clouds.publish();
+    pimpl->cuboids.publish();
+    pimpl->labels.publish();
+    pimpl->images.publish();
 
-    pimpl->front_changed = true;
+    pimpl->front_changed.store(true, std::memory_order_release);
 
     return true;
 }
 
 void PointViz::draw() {
+    const auto& window_ctx = pimpl->glfw->window_context;
+    const int width = window_ctx.viewport_width;
+    const int height = window_ctx.viewport_height;
+
+    // the pixels of a hidden window may not be rendered; use a framebuffer
+    if (pimpl->glfw->headless) {
+        if (!pimpl->offscreen || pimpl->offscreen_width != width ||
+            pimpl->offscreen_height != height) {
+            pimpl->offscreen.reset();
+            pimpl->offscreen =
+                std::make_unique<impl::GLOffscreen>(width, height);
+            pimpl->offscreen_width = width;
+            pimpl->offscreen_height = height;
+        }
+        pimpl->offscreen->bind();
+    }
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glBindVertexArray(pimpl->vao);
 
+    // pick up the objects published since the last frame
+    if (pimpl->front_changed.load(std::memory_order_acquire)) {
+        pimpl->clouds.pick_up();
+        pimpl->accumulated_clouds.pick_up();
+        pimpl->cuboids.pick_up();
+        pimpl->labels.pick_up();
+        pimpl->images.pick_up();
+        pimpl->front_changed.store(false, std::memory_order_release);
+    }
+
     // draw images
     {
-        std::lock_guard<std::mutex> guard{pimpl->update_mx};
         const auto& ctx = pimpl->glfw->window_context;
 
         // calculate camera matrices
-        auto camera_data =
-            pimpl->camera_front.matrices(impl::window_aspect(ctx));
+        Camera camera;
+        {
+            std::lock_guard<std::mutex> guard{pimpl->update_mx};
+            camera = pimpl->camera_front;
+            pimpl->rings.update(pimpl->target_front);
+        }
+        auto camera_data = camera.matrices(impl::window_aspect(ctx));
 
         // draw clouds
         impl::GLCloud::beginDraw();
         pimpl->clouds.draw(ctx, camera_data);
         impl::GLCloud::endDraw();
 
+        // draw accumulated clouds
+        impl::GLAccumulatedCloud::beginDraw();
+        pimpl->accumulated_clouds.draw(ctx, camera_data);
+        impl::GLAccumulatedCloud::endDraw();
+
         // draw rings
         pimpl->rings.draw(ctx, camera_data);
 
@@ -279,11 +410,20 @@ void PointViz::draw() {
 
         // switch back to point viz vao
         glBindVertexArray(pimpl->vao);
+    }
 
-        // mark front buffers no longer dirty
-        pimpl->front_changed = false;
+    // queue the read back of the frame before swapping
+    if (!pimpl->frame_handlers.empty()) {
+        if (!pimpl->capture)
+            pimpl->capture = std::make_unique<impl::GLFrameCapture>();
+        pimpl->capture->capture(
+            width, height, [this](const uint8_t* rgba, int w, int h) {
+                pimpl->handle_frame(rgba, w, h);
+            });
     }
 
+    if (pimpl->glfw->headless) glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
     glfwSwapBuffers(pimpl->glfw->window);
 }
 
@@ -311,6 +451,11 @@ void PointViz::push_mouse_pos_handler(
     pimpl->mouse_pos_handlers.push_front(std::move(f));
 }
 
+void PointViz::push_frame_handler(
+    std::function<bool(const uint8_t*, int, int)>&& f) {
+    pimpl->frame_handlers.push_front(std::move(f));
+}
+
 void PointViz::pop_key_handler() { pimpl->key_handlers.pop_front(); }
 
 void PointViz::pop_mouse_button_handler() {
@@ -322,6 +467,8 @@ void PointViz::pop_mouse_pos_handler() {
     pimpl->mouse_pos_handlers.pop_front();
 }
 
+void PointViz::pop_frame_handler() { pimpl->frame_handlers.pop_front(); }
+
 /*
  * Add / remove / access objects in the scene
  */
@@ -333,6 +480,10 @@ void PointViz::add(const std::shared_ptr<Cloud>& cloud) {
     pimpl->clouds.add(cloud);
 }
 
+void PointViz::add(const std::shared_ptr<AccumulatedCloud>& cloud) {
+    pimpl->accumulated_clouds.add(cloud);
+}
+
 void PointViz::add(const std::shared_ptr<Cuboid>& cuboid) {
     pimpl->cuboids.add(cuboid);
 }
@@ -349,6 +500,10 @@ bool PointViz::remove(const std::shared_ptr<Cloud>& cloud) {
     return pimpl->clouds.remove(cloud);
 }
 
+bool PointViz::remove(const std::shared_ptr<AccumulatedCloud>& cloud) {
+    return pimpl->accumulated_clouds.remove(cloud);
+}
+
 bool PointViz::remove(const std::shared_ptr<Cuboid>& cuboid) {
     return pimpl->cuboids.remove(cuboid);
 }
@@ -416,26 +571,48 @@ Cloud::Cloud(size_t w, size_t h, const float* dir, const float* off,
 void Cloud::clear() {
     range_changed_ = false;
     key_changed_ = false;
+    key_field_changed_ = false;
     mask_changed_ = false;
     xyz_changed_ = false;
     offset_changed_ = false;
     transform_changed_ = false;
     palette_changed_ = false;
     pose_changed_ = false;
+    lod_changed_ = false;
 }
 
 void Cloud::set_range(const uint32_t* x) {
-    std::transform(x, x + n_, std::begin(range_data_),
-                   [](uint32_t i) { return static_cast<float>(i); });
+    std::copy(x, x + n_, range_data_.begin());
     range_changed_ = true;
 }
 
 void Cloud::set_key(const float* key_data) {
+    std::transform(key_data, key_data + n_, key_data_.begin(),
+                   normalized<uint16_t>);
+    key_changed_ = true;
+    key_field_changed_ = false;
+}
+
+void Cloud::set_key(const uint16_t* key_data) {
     std::copy(key_data, key_data + n_, key_data_.begin());
     key_changed_ = true;
+    key_field_changed_ = false;
+}
+
+void Cloud::set_key_field(const uint32_t* field) {
+    key_field_.resize(n_);
+    std::copy(field, field + n_, key_field_.begin());
+    key_field_changed_ = true;
+    key_changed_ = false;
 }
 
 void Cloud::set_mask(const float* mask_data) {
+    std::transform(mask_data, mask_data + 4 * n_, mask_data_.begin(),
+                   normalized<uint8_t>);
+    mask_changed_ = true;
+}
+
+void Cloud::set_mask(const uint8_t* mask_data) {
     std::copy(mask_data, mask_data + 4 * n_, mask_data_.begin());
     mask_changed_ = true;
 }
@@ -489,11 +666,85 @@ void Cloud::set_palette(const float* palette, size_t palette_size) {
     palette_changed_ = true;
 }
 
+void Cloud::set_lod(size_t block_cols, float full_detail_range,
+                    size_t max_points) {
+    lod_block_cols_ = std::min(block_cols, w_);
+    lod_full_detail_range_ = full_detail_range;
+    lod_max_points_ = max_points;
+    lod_changed_ = true;
+}
+
+AccumulatedCloud::AccumulatedCloud(size_t w, size_t h, const float* dir,
+                                   const float* off, size_t n_scans,
+                                   const mat4d& extrinsic)
+    : n_{w * h},
+      n_scans_{n_scans},
+      extrinsic_{extrinsic},
+      xyz_data_(3 * n_, 0),
+      off_data_(3 * n_, 0) {
+    if (n_scans == 0)
+        throw std::invalid_argument("AccumulatedCloud needs at least one scan");
+
+    // unit vectors and offsets are the same for all scans
+    for (size_t i = 0; i < n_; i++) {
+        for (size_t k = 0; k < 3; k++) {
+            xyz_data_[3 * i + k] = dir[i + n_ * k];
+            off_data_[3 * i + k] = off[i + n_ * k];
+        }
+    }
+    point_size_changed_ = true;
+
+    set_palette(&spezia_palette[0][0], spezia_n);
+}
+
+void AccumulatedCloud::clear() {
+    palette_changed_ = false;
+    point_size_changed_ = false;
+    reset_ = false;
+    n_added_ = 0;
+}
+
+void AccumulatedCloud::add_scan(const uint32_t* range, const float* key,
+                                const mat4d& pose) {
+    if (n_added_ == n_scans_) {
+        // the oldest scan would be overwritten on the gpu anyway
+        std::rotate(scans_.begin(), scans_.begin() + 1,
+                    scans_.begin() + n_added_);
+        n_added_--;
+    }
+    if (n_added_ == scans_.size()) scans_.emplace_back();
+
+    Scan& scan = scans_[n_added_++];
+    scan.range.assign(range, range + n_);
+    scan.key.resize(n_);
+    std::transform(key, key + n_, scan.key.begin(), normalized<uint16_t>);
+    scan.pose = pose;
+}
+
+void AccumulatedCloud::reset() {
+    n_added_ = 0;
+    reset_ = true;
+}
+
+void AccumulatedCloud::set_point_size(float size) {
+    point_size_ = size;
+    point_size_changed_ = true;
+}
+
+void AccumulatedCloud::set_palette(const float* palette, size_t palette_size) {
+    palette_data_.resize(palette_size * 3);
+    std::copy(palette, palette + (palette_size * 3), palette_data_.begin());
+    palette_changed_ = true;
+}
+
 Image::Image() = default;
 
 void Image::clear() {
     position_changed_ = false;
     image_changed_ = false;
+    field_changed_ = false;
+    pixel_shift_changed_ = false;
+    palette_changed_ = false;
     mask_changed_ = false;
 }
 
@@ -504,6 +755,28 @@ void Image::set_image(size_t width, size_t height, const float* image_data) {
     image_height_ = height;
     std::copy(image_data, image_data + n, image_data_.begin());
     image_changed_ = true;
+    field_changed_ = false;
+}
+
+void Image::set_field(size_t width, size_t height, const uint32_t* field) {
+    const size_t n = width * height;
+    field_data_.resize(n);
+    image_width_ = width;
+    image_height_ = height;
+    std::copy(field, field + n, field_data_.begin());
+    field_changed_ = true;
+    image_changed_ = false;
+}
+
+void Image::set_pixel_shift(const std::vector<int>& pixel_shift_by_row) {
+    pixel_shift_ = pixel_shift_by_row;
+    pixel_shift_changed_ = true;
+}
+
+void Image::set_palette(const float* palette, size_t palette_size) {
+    palette_data_.resize(palette_size * 3);
+    std::copy(palette, palette + (palette_size * 3), palette_data_.begin());
+    palette_changed_ = true;
 }
 
 void Image::set_mask(size_t width, size_t height, const float* mask_data) {
@@ -20,6 +20,7 @@
 #include <chrono>
 #include <deque>
 #include <map>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -29,6 +30,8 @@
 #include "ouster/image_processing.h"
 #include "ouster/impl/build.h"
 #include "ouster/lidar_scan.h"
+#include "ouster/scan_shm.h"
+#include "ouster/scan_stream.h"
 #include "ouster/types.h"
 
 namespace py = pybind11;
@@ -159,6 +162,41 @@ inline uint8_t* getptr(size_t bound, py::buffer& buf) {
     return (uint8_t*)info.ptr;
 }
 
+/*
+ * Check that a buffer holds contiguous rows of packets of the given size and
+ * return the number of packets. Holding on to the buffer info keeps the buffer
+ * from being resized while parsing without the GIL.
+ */
+inline size_t packet_count(size_t packet_size, const py::buffer_info& info) {
+    using shape_t = std::decay<decltype(info.shape[0])>::type;
+    using stride_t = std::decay<decltype(info.strides[0])>::type;
+    if (info.format != py::format_descriptor<uint8_t>::format() ||
+        info.ndim != 2 || info.shape[1] != static_cast<shape_t>(packet_size) ||
+        info.strides[1] != 1 ||
+        info.strides[0] != static_cast<stride_t>(packet_size)) {
+        throw std::invalid_argument(
+            "Incompatible argument: expected a contiguous uint8 array of shape "
+            "(N, " + std::to_string(packet_size) + ")");
+    }
+    return info.shape[0];
+}
+
+/*
+ * Parse a channel field of n packets into an array of n * h * w values
+ */
+template <typename T>
+void packet_fields_into(const packet_format& pf, sensor::ChanField f,
+                        const uint8_t* packets, size_t n, T* out) {
+    const size_t packet_px = pf.pixels_per_column * pf.columns_per_packet;
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t* p = packets + i * pf.lidar_packet_size;
+        T* dst = out + i * packet_px;
+        for (int icol = 0; icol < pf.columns_per_packet; icol++)
+            pf.col_field(pf.nth_col(icol, p), f, dst + icol,
+                         pf.columns_per_packet);
+    }
+}
+
 /*
  * Map a dtype to a channel field type
  */
@@ -175,6 +213,238 @@ static sensor::ChanFieldType field_type_of_dtype(const py::dtype& dt) {
         throw std::invalid_argument("Invalid dtype for a channel field");
 }
 
+/*
+ * Make an array viewing a scan read-only if the scan doesn't own its memory,
+ * as views of shared memory scans don't
+ */
+inline py::array scan_view(const LidarScan& ls, py::array view) {
+    if (!ls.owns_arena()) view.attr("setflags")(py::arg("write") = false);
+    return view;
+}
+
+/*
+ * Lookup tables shared with every other user of the same sensor metadata, see
+ * shared_xyz_lut()
+ */
+struct SharedXYZLut {
+    std::shared_ptr<const XYZLut> lut;
+};
+
+/*
+ * Project a range image or scan into a preallocated array of w * h points,
+ * with the same results as cartesian().
+ */
+template <typename S>
+void cartesian_into(const XYZLut& lut, const S& src, py::array& out) {
+    if (static_cast<size_t>(out.size()) !=
+            static_cast<size_t>(lut.direction.rows()) * 3 ||
+        !(out.flags() & py::array::c_style))
+        throw std::invalid_argument(
+            "Expected a C_CONTIGUOUS array of h * w * 3 elements");
+
+    // mutable_data() checks that the array is writeable
+    if (out.dtype() == py::dtype::of<float>())
+        ouster::cartesian_into(src, lut,
+                               static_cast<float*>(out.mutable_data()));
+    else if (out.dtype() == py::dtype::of<double>())
+        ouster::cartesian_into(src, lut,
+                               static_cast<double*>(out.mutable_data()));
+    else
+        throw std::invalid_argument("Expected a float32 or float64 array");
+}
+
+/*
+ * Batch scans from a buffered client without going through Python for every
+ * packet. Implements the same batching, filtering, timeouts and latency
+ * management as the Python Scans iterator, with the GIL released while
+ * waiting for and batching packets.
+ */
+class ScanSource {
+    using time_point = chrono::steady_clock::time_point;
+
+    BufferedUDPSource& cli_;
+    sensor_info info_;
+    packet_format pf_;
+    size_t w_;
+    std::unique_ptr<ScanBatcher> batcher_;
+    LidarScan prototype_;
+    std::unique_ptr<LidarScan> ls_;
+    sensor::ColumnWindow window_;
+    bool complete_;
+    float timeout_;
+    float packet_timeout_;
+    size_t max_latency_;
+    bool overflow_err_;
+    bool check_latency_{false};
+
+    static time_point deadline(time_point start, float timeout_sec) {
+        using fsec = chrono::duration<float>;
+        return timeout_sec >= 0
+                   ? start + chrono::duration_cast<chrono::nanoseconds>(
+                                 fsec{timeout_sec})
+                   : time_point::max();
+    }
+
+    // wait for a packet until the deadline while allowing Python to handle
+    // signals. Must be called without holding the GIL
+    sensor::client_state peek(const uint8_t*& buf, uint64_t& rx_ts,
+                              time_point until) {
+        using fsec = chrono::duration<float>;
+        constexpr float poll_interval = 0.1;
+        while (true) {
+            const auto now = chrono::steady_clock::now();
+            const float wait =
+                now < until ? std::min(poll_interval, fsec{until - now}.count())
+                            : 0.0f;
+            auto st = cli_.peek(buf, wait, &rx_ts);
+            if (st != sensor::client_state::TIMEOUT) return st;
+            if (chrono::steady_clock::now() >= until) return st;
+
+            py::gil_scoped_acquire acquire;
+            if (PyErr_CheckSignals() != 0) throw py::error_already_set();
+        }
+    }
+
+    void batch(const uint8_t* buf, uint64_t rx_ts, bool& done) {
+        if (!ls_)
+            ls_.reset(new LidarScan(prototype_.w, prototype_.h,
+                                    prototype_.begin(), prototype_.end()));
+        done = (*batcher_)(buf, *ls_, rx_ts);
+    }
+
+   public:
+    ScanSource(BufferedUDPSource& cli, const sensor_info& info,
+               const LidarScan& prototype, bool complete, float timeout,
+               float packet_timeout, size_t max_latency, bool overflow_err)
+        : cli_(cli),
+          info_(info),
+          pf_(sensor::get_format(info)),
+          w_(info.format.columns_per_frame),
+          batcher_(new ScanBatcher(info_)),
+          prototype_(prototype),
+          window_(info.format.column_window),
+          complete_(complete),
+          timeout_(timeout),
+          packet_timeout_(packet_timeout),
+          max_latency_(max_latency),
+          overflow_err_(overflow_err) {
+        if (prototype.w != static_cast<std::ptrdiff_t>(w_) ||
+            prototype.h != static_cast<std::ptrdiff_t>(pf_.pixels_per_column))
+            throw std::invalid_argument(
+                "Prototype scan doesn't match the packet format");
+    }
+
+    size_t lidar_packet_size() const { return pf_.lidar_packet_size; }
+
+    /*
+     * Batch a lidar packet already taken out of the client
+     */
+    void push(const uint8_t* buf, uint64_t rx_ts) {
+        bool done = false;
+        batch(buf, rx_ts, done);
+        if (done) ls_.reset();
+    }
+
+    /*
+     * Drop buffered packets until the start of the n_frames + 1th frame,
+     * leaving its first packet in the client. Returns LIDAR_DATA on success.
+     */
+    sensor::client_state flush(int n_frames, bool full) {
+        if (full) cli_.flush(0);
+
+        int last_frame = -1;
+        auto last_packet = chrono::steady_clock::now();
+        while (true) {
+            const uint8_t* buf = nullptr;
+            uint64_t rx_ts = 0;
+            auto st = peek(buf, rx_ts, deadline(last_packet, packet_timeout_));
+            if (!buf) return st;
+            if (st & sensor::client_state::LIDAR_DATA) {
+                const int frame = pf_.frame_id(buf);
+                if (frame != last_frame) {
+                    last_frame = frame;
+                    if (--n_frames < 0) return sensor::client_state::LIDAR_DATA;
+                }
+                last_packet = chrono::steady_clock::now();
+            } else if (st & sensor::client_state::CLIENT_ERROR) {
+                cli_.advance();
+                return st;
+            }
+            cli_.advance();
+        }
+    }
+
+    /*
+     * Wait for the next scan. Returns LIDAR_DATA when a scan was batched, or
+     * the state that ended batching: TIMEOUT, CLIENT_ERROR, EXIT or a state
+     * with CLIENT_OVERFLOW set if overflow is an error.
+     */
+    sensor::client_state next(std::unique_ptr<LidarScan>& scan) {
+        const auto start = chrono::steady_clock::now();
+        const auto scan_deadline = deadline(start, timeout_);
+        auto last_packet = start;
+
+        // drop data along frame boundaries when the consumer falls behind,
+        // clearing out the already-batched first packet of the next frame
+        if (check_latency_) {
+            check_latency_ = false;
+            const size_t packets_per_frame = w_ / pf_.columns_per_packet;
+            const size_t buf_frames = cli_.size() / packets_per_frame;
+            if (buf_frames + 1 > max_latency_) {
+                auto st = flush(static_cast<int>(buf_frames + 1 - max_latency_),
+                                false);
+                if (st != sensor::client_state::LIDAR_DATA) return st;
+                batcher_.reset(new ScanBatcher(info_));
+                ls_.reset();
+            }
+        }
+
+        while (true) {
+            if (chrono::steady_clock::now() >= scan_deadline)
+                return sensor::client_state::TIMEOUT;
+
+            const uint8_t* buf = nullptr;
+            uint64_t rx_ts = 0;
+            auto st = peek(buf, rx_ts,
+                           std::min(scan_deadline,
+                                    deadline(last_packet, packet_timeout_)));
+            if (st == sensor::client_state::EXIT) {
+                // flush the last, partial scan
+                bool keep = ls_ && (!complete_ || ls_->complete(window_));
+                if (keep) scan = std::move(ls_);
+                ls_.reset();
+                return keep ? sensor::client_state::LIDAR_DATA : st;
+            }
+            if (!buf) return st;
+            last_packet = chrono::steady_clock::now();
+
+            if (overflow_err_ && (st & BufferedUDPSource::CLIENT_OVERFLOW)) {
+                cli_.advance();
+                return st;
+            }
+
+            bool done = false;
+            if (st & sensor::client_state::LIDAR_DATA) {
+                batch(buf, rx_ts, done);
+            } else if (!(st & sensor::client_state::IMU_DATA) &&
+                       (st & sensor::client_state::CLIENT_ERROR)) {
+                cli_.advance();
+                return st;
+            }
+            cli_.advance();
+
+            if (done) {
+                check_latency_ = max_latency_ > 0;
+                if (!complete_ || ls_->complete(window_)) {
+                    scan = std::move(ls_);
+                    return sensor::client_state::LIDAR_DATA;
+                }
+                ls_.reset();
+            }
+        }
+    }
+};
+
 PYBIND11_PLUGIN(_client) {
     py::module m("_client", R"(
     Sensor client bindings generated by pybind11.
@@ -286,6 +556,82 @@ PYBIND11_PLUGIN(_client) {
             }
         })
 
+        .def("packet_fields", [](packet_format& pf, sensor::ChanField f, py::buffer buf) -> py::array {
+            auto info = buf.request();
+            const size_t n = packet_count(pf.lidar_packet_size, info);
+            auto ptr = static_cast<const uint8_t*>(info.ptr);
+
+            auto packet_fields = [&](auto& res) -> void {
+                auto dst = res.mutable_data();
+                py::gil_scoped_release release;
+                packet_fields_into(pf, f, ptr, n, dst);
+            };
+
+            std::vector<size_t> dims{n, static_cast<size_t>(pf.pixels_per_column),
+                                     static_cast<size_t>(pf.columns_per_packet)};
+
+            switch (pf.field_type(f)) {
+                case sensor::ChanFieldType::UINT8: {
+                    py::array_t<uint8_t> res(dims);
+                    packet_fields(res);
+                    return std::move(res);
+                }
+                case sensor::ChanFieldType::UINT16: {
+                    py::array_t<uint16_t> res(dims);
+                    packet_fields(res);
+                    return std::move(res);
+                }
+                case sensor::ChanFieldType::UINT32: {
+                    py::array_t<uint32_t> res(dims);
+                    packet_fields(res);
+                    return std::move(res);
+                }
+                case sensor::ChanFieldType::UINT64: {
+                    py::array_t<uint64_t> res(dims);
+                    packet_fields(res);
+                    return std::move(res);
+                }
+                default:
+                    throw py::key_error("Invalid field for PacketFormat");
+            }
+        })
+
+        .def("packet_headers", [](packet_format& pf, py::object o, py::buffer buf) {
+
+            auto packet_headers = [&](auto&& f) -> py::array {
+                using T = typename std::result_of<decltype(f)(const uint8_t*)>::type;
+
+                auto info = buf.request();
+                const size_t n = packet_count(pf.lidar_packet_size, info);
+                auto ptr = static_cast<const uint8_t*>(info.ptr);
+                const int cols = pf.columns_per_packet;
+                auto res = py::array_t<T>(
+                    std::vector<size_t>{n, static_cast<size_t>(cols)});
+                auto dst = res.mutable_data();
+
+                {
+                    py::gil_scoped_release release;
+                    for (size_t i = 0; i < n; i++) {
+                        const uint8_t* p = ptr + i * pf.lidar_packet_size;
+                        for (int icol = 0; icol < cols; icol++)
+                            dst[i * cols + icol] = f(pf.nth_col(icol, p));
+                    }
+                }
+
+                return std::move(res);
+            };
+
+            auto ind = py::int_(o).cast<int>();
+            switch (ind) {
+                case 0: return packet_headers([&](auto col) { return pf.col_timestamp(col); });
+                case 1: return packet_headers([&](auto col) { return pf.col_encoder(col); });
+                case 2: return packet_headers([&](auto col) { return pf.col_measurement_id(col); });
+                case 3: return packet_headers([&](auto col) { return pf.col_status(col); });
+                case 4: return packet_headers([&](auto col) { return pf.col_frame_id(col); });
+                default: throw py::key_error("Invalid header index for PacketFormat");
+            }
+        })
+
         // IMU packet accessors
         .def("imu_sys_ts", [](packet_format& pf, py::buffer buf) { return pf.imu_sys_ts(getptr(pf.imu_packet_size, buf)); })
         .def("imu_accel_ts", [](packet_format& pf, py::buffer buf) { return pf.imu_accel_ts(getptr(pf.imu_packet_size, buf)); })
@@ -525,6 +871,8 @@ PYBIND11_PLUGIN(_client) {
              py::arg("timeout_sec") = 30, py::arg("capacity") = 128)
         .def("get_metadata", &BufferedUDPSource::get_metadata,
              py::arg("timeout_sec") = 60, py::arg("legacy") = true)
+        .def("use_packet_ring", &BufferedUDPSource::use_packet_ring,
+             py::arg("interface") = "", py::arg("ring_size") = 16 << 20)
         .def("shutdown", &BufferedUDPSource::shutdown)
         .def("consume",
              [](BufferedUDPSource& self, py::buffer buf, float timeout_sec) {
@@ -556,6 +904,68 @@ PYBIND11_PLUGIN(_client) {
                  } while (chrono::steady_clock::now() < timeout_time);
                  return res;
              })
+        .def(
+            "consume_batch",
+            [](BufferedUDPSource& self, size_t packet_size, size_t max_packets,
+               float timeout_sec) {
+                using fsec = chrono::duration<float>;
+                if (packet_size == 0 || max_packets == 0)
+                    throw std::invalid_argument("Expected a nonempty batch");
+
+                py::array_t<uint8_t> packets({max_packets, packet_size});
+                py::array_t<uint64_t> rx_ts(max_packets);
+                std::vector<sensor::client_state> states(max_packets);
+                uint8_t* packets_ptr = packets.mutable_data();
+                uint64_t* rx_ts_ptr = rx_ts.mutable_data();
+
+                // timeout_sec == 0 means nonblocking, < 0 means forever
+                auto timeout_time =
+                    timeout_sec >= 0
+                        ? chrono::steady_clock::now() + fsec{timeout_sec}
+                        : chrono::steady_clock::time_point::max();
+                float poll_interval = timeout_sec ? 0.1 : 0.0;
+
+                // wait without the GIL, allowing interrupts from Python by
+                // polling
+                size_t n = 0;
+                auto st = sensor::client_state::TIMEOUT;
+                {
+                    py::gil_scoped_release release;
+                    do {
+                        st = self.consume_batch(packets_ptr, packet_size,
+                                                max_packets, poll_interval, n,
+                                                states.data(), rx_ts_ptr);
+                        if (st != sensor::client_state::TIMEOUT) break;
+
+                        py::gil_scoped_acquire acquire;
+                        if (PyErr_CheckSignals() != 0)
+                            throw py::error_already_set();
+                    } while (chrono::steady_clock::now() < timeout_time);
+                }
+
+                py::array_t<int> py_states(n);
+                for (size_t i = 0; i < n; i++)
+                    py_states.mutable_data()[i] = static_cast<int>(states[i]);
+                const py::slice first_n(0, n, 1);
+                return py::make_tuple(st, py_states, packets[first_n],
+                                      rx_ts[first_n]);
+            },
+            py::arg("packet_size"), py::arg("max_packets") = 64,
+            py::arg("timeout_sec") = 1.0f, R"(
+            Read the packets buffered at once, waiting for the first.
+
+            Returns a tuple of the state of the last packet read, or TIMEOUT or
+            EXIT if none were, the ClientState of each packet, the packets as
+            the rows of an (N, packet_size) uint8 array and their receive
+            timestamps. The GIL is released while waiting.
+            )")
+        .def("notify_fd", &BufferedUDPSource::notify_fd, R"(
+            File descriptor that becomes readable when packets arrive.
+
+            Clear it with ``clear_notify()``, then read all buffered packets
+            before waiting on it again, e.g. from an asyncio reader.
+            )")
+        .def("clear_notify", &BufferedUDPSource::clear_notify)
         .def("produce",
              [](BufferedUDPSource& self, const packet_format& pf) {
                  py::gil_scoped_release release;
@@ -564,10 +974,54 @@ PYBIND11_PLUGIN(_client) {
         .def("flush", &BufferedUDPSource::flush, py::arg("n_packets") = 0)
         .def_property_readonly("capacity", &BufferedUDPSource::capacity)
         .def_property_readonly("size", &BufferedUDPSource::size)
+        .def_property_readonly("rx_timestamp",
+                               &BufferedUDPSource::last_rx_timestamp)
         .def_property_readonly("lidar_port", &BufferedUDPSource::get_lidar_port)
         .def_property_readonly("imu_port", &BufferedUDPSource::get_imu_port);
 
+    py::class_<ScanSource>(m, "ScanSource")
+        .def(py::init<BufferedUDPSource&, const sensor_info&, const LidarScan&,
+                      bool, float, float, size_t, bool>(),
+             py::arg("client"), py::arg("info"), py::arg("prototype"),
+             py::arg("complete") = false, py::arg("timeout") = -1.0f,
+             py::arg("packet_timeout") = -1.0f, py::arg("max_latency") = 0,
+             py::arg("overflow_err") = false, py::keep_alive<1, 2>())
+        .def(
+            "push",
+            [](ScanSource& self, py::buffer& buf, uint64_t rx_timestamp) {
+                self.push(getptr(self.lidar_packet_size(), buf), rx_timestamp);
+            },
+            py::arg("buf"), py::arg("rx_timestamp") = 0)
+        .def("flush", &ScanSource::flush, py::arg("n_frames") = 3,
+             py::arg("full") = false, py::call_guard<py::gil_scoped_release>())
+        .def("next", [](ScanSource& self) {
+            std::unique_ptr<LidarScan> scan;
+            sensor::client_state st;
+            {
+                py::gil_scoped_release release;
+                st = self.next(scan);
+            }
+            return py::make_tuple(
+                st, scan ? py::cast(std::move(scan)) : py::none());
+        });
+
     // Scans
+    py::class_<ScanSummary>(m, "ScanSummary", R"(
+        Counters of a scan collected while batching its packets.
+
+        Only valid for scans returned by a batcher, until they're modified.
+        )")
+        .def_readonly("valid", &ScanSummary::valid)
+        .def_readonly("window", &ScanSummary::window)
+        .def_readonly("cols_received", &ScanSummary::cols_received)
+        .def_readonly("window_cols_received",
+                      &ScanSummary::window_cols_received)
+        .def_readonly("cols_missing", &ScanSummary::cols_missing)
+        .def_readonly("first_timestamp", &ScanSummary::first_timestamp)
+        .def_readonly("last_timestamp", &ScanSummary::last_timestamp)
+        .def_readonly("zero_range", &ScanSummary::zero_range)
+        .def_readonly("zero_range2", &ScanSummary::zero_range2);
+
     py::class_<LidarScan>(m, "LidarScan", py::metaclass(), R"(
         Represents a single "scan" or "frame" of lidar data.
 
@@ -646,6 +1100,8 @@ PYBIND11_PLUGIN(_client) {
         .def_readwrite(
             "frame_id", &LidarScan::frame_id,
             "Corresponds to the frame id header in the packet format.")
+        .def_readwrite("destaggered", &LidarScan::destaggered,
+                       "Whether fields are stored destaggered.")
         .def(
             "complete",
             [](const LidarScan& self,
@@ -658,6 +1114,10 @@ PYBIND11_PLUGIN(_client) {
             py::arg("window") =
                 static_cast<nonstd::optional<sensor::ColumnWindow>>(
                     nonstd::nullopt))
+        .def_property_readonly(
+            "summary",
+            [](const LidarScan& self) { return self.summary(); },
+            "Counters collected while batching the scan, see ScanSummary.")
         .def(
             "field",
             [](LidarScan& self, sensor::ChanField f) {
@@ -669,7 +1129,7 @@ PYBIND11_PLUGIN(_client) {
                         py::dtype::of<typename decltype(field)::Scalar>();
                     res = py::array(dtype, dims, field.data(), py::cast(self));
                 });
-                return res;
+                return scan_view(self, res);
             },
             R"(
         Return a view of the specified channel field.
@@ -688,28 +1148,33 @@ PYBIND11_PLUGIN(_client) {
                 auto ind = py::int_(o).cast<int>();
                 switch (ind) {
                     case 0:
-                        return py::array(py::dtype::of<uint64_t>(),
-                                         static_cast<size_t>(self.w),
-                                         self.timestamp().data(),
-                                         py::cast(self));
+                        return scan_view(
+                            self, py::array(py::dtype::of<uint64_t>(),
+                                            static_cast<size_t>(self.w),
+                                            self.timestamp().data(),
+                                            py::cast(self)));
                     case 1:
                         // encoder values are deprecated and not included in
                         // the updated C++ LidarScan API. Access old values
                         // instead
-                        return py::array(py::dtype::of<uint32_t>(),
-                                         {static_cast<size_t>(self.w)},
-                                         {sizeof(LidarScan::BlockHeader)},
-                                         &self.headers.at(0).encoder,
-                                         py::cast(self));
+                        return scan_view(
+                            self, py::array(py::dtype::of<uint32_t>(),
+                                            {static_cast<size_t>(self.w)},
+                                            {sizeof(LidarScan::BlockHeader)},
+                                            &self.headers.at(0).encoder,
+                                            py::cast(self)));
                     case 2:
-                        return py::array(py::dtype::of<uint16_t>(),
-                                         static_cast<size_t>(self.w),
-                                         self.measurement_id().data(),
-                                         py::cast(self));
+                        return scan_view(
+                            self, py::array(py::dtype::of<uint16_t>(),
+                                            static_cast<size_t>(self.w),
+                                            self.measurement_id().data(),
+                                            py::cast(self)));
                     case 3:
-                        return py::array(py::dtype::of<uint32_t>(),
-                                         static_cast<size_t>(self.w),
-                                         self.status().data(), py::cast(self));
+                        return scan_view(
+                            self, py::array(py::dtype::of<uint32_t>(),
+                                            static_cast<size_t>(self.w),
+                                            self.status().data(),
+                                            py::cast(self)));
                     default:
                         throw std::invalid_argument(
                             "Unexpected index for LidarScan.header()");
@@ -730,24 +1195,35 @@ PYBIND11_PLUGIN(_client) {
         .def_property_readonly(
             "timestamp",
             [](LidarScan& self) {
-                return py::array(py::dtype::of<uint64_t>(), self.w,
-                                 self.timestamp().data(), py::cast(self));
+                return scan_view(
+                    self, py::array(py::dtype::of<uint64_t>(), self.w,
+                                    self.timestamp().data(), py::cast(self)));
             },
             "The measurement timestamp header as a W-element numpy array.")
         .def_property_readonly(
             "measurement_id",
             [](LidarScan& self) {
-                return py::array(py::dtype::of<uint16_t>(), self.w,
-                                 self.measurement_id().data(), py::cast(self));
+                return scan_view(
+                    self, py::array(py::dtype::of<uint16_t>(), self.w,
+                                    self.measurement_id().data(), py::cast(self)));
             },
             "The measurement id header as a W-element numpy array.")
         .def_property_readonly(
             "status",
             [](LidarScan& self) {
-                return py::array(py::dtype::of<uint32_t>(), self.w,
-                                 self.status().data(), py::cast(self));
+                return scan_view(
+                    self, py::array(py::dtype::of<uint32_t>(), self.w,
+                                    self.status().data(), py::cast(self)));
             },
             "The measurement status header as a W-element numpy array.")
+        .def_property_readonly(
+            "rx_timestamp",
+            [](LidarScan& self) {
+                return scan_view(
+                    self, py::array(py::dtype::of<uint64_t>(), self.w,
+                                    self.rx_timestamp().data(), py::cast(self)));
+            },
+            "The host receive timestamp header as a W-element numpy array.")
         .def_property_readonly(
             "fields",
             // NOTE: keep_alive seems to be ignored without cpp_function wrapper
@@ -767,6 +1243,154 @@ PYBIND11_PLUGIN(_client) {
         .def("to_native", [](py::object& self) { return self; })
         .def_static("from_native", [](py::object& scan) { return scan; });
 
+    py::class_<ScanShmPublisher>(m, "ScanShmPublisher", R"(
+        Publishes scans to other processes on the host through shared memory.
+
+        The segment is removed, waking up subscribers, when the publisher is
+        garbage collected.
+        )")
+        .def(py::init<const std::string&, const sensor_info&, size_t>(),
+             py::arg("name"), py::arg("info"), py::arg("n_slots") = 8)
+        .def(py::init<const std::string&, const sensor_info&, const LidarScan&,
+                      size_t>(),
+             py::arg("name"), py::arg("info"), py::arg("prototype"),
+             py::arg("n_slots") = 8)
+        .def("publish", &ScanShmPublisher::publish, py::arg("scan"),
+             py::call_guard<py::gil_scoped_release>(), R"(
+        Copy a scan into shared memory.
+
+        Args:
+            scan: A scan with the dimensions and fields of the segment
+
+        Returns:
+            The sequence number of the scan, starting at 1
+        )")
+        .def_property_readonly("published", &ScanShmPublisher::published)
+        .def_property_readonly("n_slots", &ScanShmPublisher::n_slots);
+
+    py::class_<ScanShmSubscriber>(m, "ScanShmSubscriber", R"(
+        Reads the scans of a ScanShmPublisher, possibly in another process.
+        )")
+        .def(py::init<const std::string&>(), py::arg("name"))
+        .def_property_readonly("info", &ScanShmSubscriber::info,
+                               py::return_value_policy::copy)
+        .def("next", &ScanShmSubscriber::next, py::arg("timeout_sec") = 1.0f,
+             py::call_guard<py::gil_scoped_release>(),
+             py::return_value_policy::reference_internal, R"(
+        Wait for the next scan and view it in shared memory, without copying.
+
+        The fields of the view are read-only and get overwritten once the
+        publisher wraps around; check ``valid()`` after using them, or use
+        ``read()`` for a copy.
+
+        Args:
+            timeout_sec: How long to wait for a scan
+
+        Returns:
+            The scan, or None on timeout or once the publisher is gone
+        )")
+        .def("read", &ScanShmSubscriber::read, py::arg("scan"),
+             py::arg("timeout_sec") = 1.0f,
+             py::call_guard<py::gil_scoped_release>(), R"(
+        Wait for the next scan and copy it.
+
+        Args:
+            scan: The scan to copy into, reallocated if its dimensions or
+                fields differ
+            timeout_sec: How long to wait for a scan
+
+        Returns:
+            False on timeout or once the publisher is gone
+        )")
+        .def("valid", &ScanShmSubscriber::valid,
+             "Whether the scan last returned by next() is still intact.")
+        .def_property_readonly("seq", &ScanShmSubscriber::seq)
+        .def_property_readonly("dropped", &ScanShmSubscriber::dropped)
+        .def_property_readonly("closed", &ScanShmSubscriber::closed);
+
+    py::class_<StreamConfig>(m, "StreamConfig", R"(
+        What a ScanStreamServer sends of each scan.
+
+        The region is given by the rows and columns of the scan to send, both
+        empty to send whole scans.
+        )")
+        .def(py::init<>())
+        .def_readwrite("fields", &StreamConfig::fields)
+        .def_property(
+            "rows", [](const StreamConfig& self) { return self.region.rows; },
+            [](StreamConfig& self, std::vector<int> rows) {
+                self.region.rows = std::move(rows);
+            })
+        .def_property(
+            "cols", [](const StreamConfig& self) { return self.region.cols; },
+            [](StreamConfig& self, std::vector<int> cols) {
+                self.region.cols = std::move(cols);
+            })
+        .def_readwrite("range_step", &StreamConfig::range_step)
+        .def_readwrite("max_pending", &StreamConfig::max_pending);
+
+    py::class_<ScanStreamServer>(m, "ScanStreamServer", R"(
+        Sends compressed scans to any number of ScanStreamClients over TCP.
+        )")
+        .def(py::init<const sensor_info&, int, const StreamConfig&>(),
+             py::arg("info"), py::arg("port") = 0,
+             py::arg("config") = StreamConfig{})
+        .def_property_readonly("port", &ScanStreamServer::port)
+        .def("send", &ScanStreamServer::send, py::arg("scan"),
+             py::call_guard<py::gil_scoped_release>(), R"(
+        Encode a scan and queue it for all connected clients.
+
+        Args:
+            scan: A staggered scan of the sensor
+
+        Returns:
+            The number of clients the scan was queued for
+        )")
+        .def_property_readonly(
+            "frames",
+            [](const ScanStreamServer& self) { return self.stats().frames; })
+        .def_property_readonly(
+            "bytes",
+            [](const ScanStreamServer& self) { return self.stats().bytes; })
+        .def_property_readonly("dropped_frames",
+                               [](const ScanStreamServer& self) {
+                                   return self.stats().dropped_frames;
+                               })
+        .def_property_readonly(
+            "clients",
+            [](const ScanStreamServer& self) { return self.stats().clients; });
+
+    py::class_<ScanStreamClient>(m, "ScanStreamClient", R"(
+        Receives the scans of a ScanStreamServer.
+
+        Scans have the dimensions of the region sent, with only the fields
+        sent.
+        )")
+        .def(py::init<const std::string&, int, float>(), py::arg("host"),
+             py::arg("port"), py::arg("timeout_sec") = 5.0f,
+             py::call_guard<py::gil_scoped_release>())
+        .def_property_readonly("metadata", &ScanStreamClient::metadata,
+                               py::return_value_policy::copy)
+        .def_property_readonly(
+            "rows",
+            [](const ScanStreamClient& self) { return self.region().rows; })
+        .def_property_readonly(
+            "cols",
+            [](const ScanStreamClient& self) { return self.region().cols; })
+        .def("read", &ScanStreamClient::read, py::arg("scan"),
+             py::arg("timeout_sec") = 1.0f,
+             py::call_guard<py::gil_scoped_release>(), R"(
+        Read the next scan.
+
+        Args:
+            scan: The scan to decode into, reallocated if its dimensions or
+                fields differ from the stream
+            timeout_sec: How long to wait for a scan, forever if negative
+
+        Returns:
+            False on timeout
+        )");
+
     // Destagger overloads for most numpy scalar types
     m.def("destagger_int8", &ouster::destagger<int8_t>);
     m.def("destagger_int16", &ouster::destagger<int16_t>);
@@ -779,28 +1403,99 @@ PYBIND11_PLUGIN(_client) {
     m.def("destagger_float", &ouster::destagger<float>);
     m.def("destagger_double", &ouster::destagger<double>);
 
+    py::class_<Destaggerer>(m, "Destaggerer")
+        .def(py::init<const sensor_info&, bool>(), py::arg("info"),
+             py::arg("inverse") = false)
+        .def(
+            "__call__",
+            [](const Destaggerer& self, py::array& img, py::array& out) {
+                const auto h = static_cast<py::ssize_t>(self.h());
+                const auto w = static_cast<py::ssize_t>(self.w());
+                if (img.ndim() < 2 || img.shape(0) != h || img.shape(1) != w ||
+                    !(img.flags() & py::array::c_style))
+                    throw std::invalid_argument(
+                        "Expected a C_CONTIGUOUS array of shape (h, w, ...)");
+                if (out.ndim() != img.ndim() ||
+                    !std::equal(img.shape(), img.shape() + img.ndim(),
+                                out.shape()) ||
+                    out.itemsize() != img.itemsize() ||
+                    !(out.flags() & py::array::c_style))
+                    throw std::invalid_argument(
+                        "Expected a C_CONTIGUOUS output array of the same "
+                        "shape and item size");
+
+                if (img.size() == 0) return out;
+
+                // pixels may be made of several values, all copied at once
+                const size_t pixel_size =
+                    img.size() * img.itemsize() / (h * w);
+                const void* src = img.data();
+                void* dst = out.mutable_data();
+                py::gil_scoped_release release;
+                self(src, dst, pixel_size);
+                return out;
+            },
+            py::arg("img"), py::arg("out"))
+        .def(
+            "__call__",
+            [](const Destaggerer& self, const LidarScan& scan,
+               const std::vector<sensor::ChanField>& fields, LidarScan& dest,
+               int n_threads) { self(scan, fields, dest, n_threads); },
+            py::arg("scan"), py::arg("fields"), py::arg("dest"),
+            py::arg("n_threads") = 1, py::call_guard<py::gil_scoped_release>())
+        .def_property_readonly("h", &Destaggerer::h)
+        .def_property_readonly("w", &Destaggerer::w);
+
     py::class_<ScanBatcher>(m, "ScanBatcher")
         .def(py::init<int, packet_format>())
-        .def(py::init<sensor_info>())
-        .def("__call__", [](ScanBatcher& self, py::buffer& buf, LidarScan& ls) {
-            uint8_t* ptr = getptr(self.pf.lidar_packet_size, buf);
-            return self(ptr, ls);
-        });
+        .def(
+            "__init__",
+            [](ScanBatcher& self, const sensor_info& info, bool destagger) {
+                new (&self)
+                    ScanBatcher(info, destagger ? BATCH_DESTAGGER : 0);
+            },
+            py::arg("info"), py::arg("destagger") = false)
+        .def(
+            "__call__",
+            [](ScanBatcher& self, py::buffer& buf, LidarScan& ls,
+               uint64_t rx_timestamp) {
+                uint8_t* ptr = getptr(self.pf.lidar_packet_size, buf);
+                return self(ptr, ls, rx_timestamp);
+            },
+            py::arg("buf"), py::arg("ls"), py::arg("rx_timestamp") = 0);
 
     // XYZ Projection
-    py::class_<XYZLut>(m, "XYZLut")
-        .def("__init__",
-             [](XYZLut& self, const sensor_info& sensor) {
-                 new (&self) XYZLut{};
-                 self = make_xyz_lut(sensor);
-             })
+    py::class_<SharedXYZLut>(m, "XYZLut")
+        .def(
+            "__init__",
+            [](SharedXYZLut& self, const sensor_info& sensor,
+               bool destaggered) {
+                new (&self) SharedXYZLut{shared_xyz_lut(sensor, destaggered)};
+            },
+            py::arg("info"), py::arg("destaggered") = false)
         .def("__call__",
-             [](const XYZLut& self, Eigen::Ref<img_t<uint32_t>>& range) {
-                 return cartesian(range, self);
+             [](const SharedXYZLut& self, Eigen::Ref<img_t<uint32_t>>& range) {
+                 return cartesian(range, *self.lut);
              })
-        .def("__call__", [](const XYZLut& self, const LidarScan& scan) {
-            return cartesian(scan, self);
-        });
+        .def("__call__", [](const SharedXYZLut& self, const LidarScan& scan) {
+            return cartesian(scan, *self.lut);
+        })
+        .def(
+            "__call__",
+            [](const SharedXYZLut& self, Eigen::Ref<img_t<uint32_t>>& range,
+               py::array& out) {
+                cartesian_into(*self.lut, range, out);
+                return out;
+            },
+            py::arg("range"), py::arg("out"))
+        .def(
+            "__call__",
+            [](const SharedXYZLut& self, const LidarScan& scan,
+               py::array& out) {
+                cartesian_into(*self.lut, scan, out);
+                return out;
+            },
+            py::arg("scan"), py::arg("out"));
 
     // Image processing
     py::class_<viz::AutoExposure>(m, "AutoExposure")
@@ -815,6 +1510,8 @@ PYBIND11_PLUGIN(_client) {
 
     py::class_<viz::BeamUniformityCorrector>(m, "BeamUniformityCorrector")
         .def(py::init<>())
+        .def(py::init<int, int, int>(), py::arg("update_every"),
+             py::arg("column_stride"), py::arg("n_threads") = 1)
         .def("__call__", &image_proc_call<viz::BeamUniformityCorrector, float>,
              py::arg("image"), py::arg("update_state") = true)
         .def("__call__", &image_proc_call<viz::BeamUniformityCorrector, double>,
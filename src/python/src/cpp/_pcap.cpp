@@ -5,16 +5,25 @@
  * @file
  * @brief ouster_pyclient_pcap python module
  */
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 
 #include <cmath>
+#include <cstring>
 #include <sstream>
 #include <string>
+#include <vector>
 
+#include "ouster/arrow_file.h"
 #include "ouster/impl/build.h"
+#include "ouster/lidar_scan.h"
 #include "ouster/os_pcap.h"
+#include "ouster/pcap_demux.h"
+#include "ouster/pcap_scan_reader.h"
+#include "ouster/types.h"
 
 using namespace ouster::sensor_utils;
+using ouster::LidarScan;
 namespace py = pybind11;
 
 PYBIND11_MAKE_OPAQUE(std::shared_ptr<playback_handle>);
@@ -82,6 +91,224 @@ This module is generated from the C++ code and not meant to be used directly.
         replay_reset(*handle);
     });
 
+    m.def(
+        "read_lidar_packets",
+        [](std::shared_ptr<playback_handle>& handle,
+           const ouster::sensor::sensor_info& info, int lidar_port,
+           size_t max_packets) -> py::tuple {
+            const auto& pf = ouster::sensor::get_format(info);
+            const size_t size = pf.lidar_packet_size;
+            std::vector<uint8_t> data;
+            std::vector<double> timestamps;
+            {
+                py::gil_scoped_release release;
+                packet_view packet;
+                while ((max_packets == 0 || timestamps.size() < max_packets) &&
+                       next_packet(*handle, packet)) {
+                    // skip packets that LidarPacket would reject
+                    if (packet.dst_port != lidar_port ||
+                        packet.payload_size != size)
+                        continue;
+                    const auto init_id = pf.init_id(packet.payload);
+                    if (init_id && init_id != info.init_id) continue;
+
+                    data.insert(data.end(), packet.payload,
+                                packet.payload + size);
+                    timestamps.push_back(packet.timestamp.count() / 1e6);
+                }
+            }
+
+            const size_t n = timestamps.size();
+            py::array_t<uint8_t> packets(std::vector<size_t>{n, size});
+            py::array_t<double> ts(std::vector<size_t>{n});
+            if (n) {
+                std::memcpy(packets.mutable_data(), data.data(), data.size());
+                std::memcpy(ts.mutable_data(), timestamps.data(),
+                            n * sizeof(double));
+            }
+            return py::make_tuple(packets, ts);
+        },
+        py::arg("handle"), py::arg("info"), py::arg("lidar_port"),
+        py::arg("max_packets") = 0);
+
+    // random access
+    py::class_<pcap_index::stream>(m, "pcap_stream")
+        .def("__len__",
+             [](const pcap_index::stream& self) { return self.frames.size(); })
+        .def_property_readonly("src_addr",
+                               [](const pcap_index::stream& self) {
+                                   return py::bytes(
+                                       reinterpret_cast<const char*>(
+                                           self.src_addr.data()),
+                                       self.src_addr.size());
+                               })
+        .def(
+            "frame_timestamp",
+            [](const pcap_index::stream& self, size_t frame) -> double {
+                if (frame >= self.frames.size())
+                    throw py::index_error("Frame index out of range");
+                return self.frames[frame].timestamp_us / 1e6;
+            },
+            py::arg("frame"));
+
+    py::class_<pcap_index>(m, "pcap_index")
+        .def_readonly("file_size", &pcap_index::file_size)
+        .def_readonly("lidar_port", &pcap_index::lidar_port)
+        .def_property_readonly("streams", [](py::object self) {
+            py::list result;
+            for (const auto& stream : self.cast<const pcap_index&>().streams)
+                result.append(py::cast(
+                    stream, py::return_value_policy::reference_internal, self));
+            return result;
+        });
+
+    py::class_<udp_stream_stats>(m, "udp_stream_stats")
+        .def_readonly("dst_ip", &udp_stream_stats::dst_ip)
+        .def_readonly("src_ip", &udp_stream_stats::src_ip)
+        .def_readonly("dst_port", &udp_stream_stats::dst_port)
+        .def_readonly("src_port", &udp_stream_stats::src_port)
+        .def_readonly("ip_version", &udp_stream_stats::ip_version)
+        .def_readonly("count", &udp_stream_stats::count)
+        .def_property_readonly("payload_sizes",
+                               [](const udp_stream_stats& self) {
+                                   py::list result;
+                                   for (size_t s : self.payload_sizes)
+                                       result.append(py::int_(s));
+                                   return result;
+                               })
+        .def_property_readonly("fragments_in_packet",
+                               [](const udp_stream_stats& self) {
+                                   py::list result;
+                                   for (int n : self.fragments_in_packet)
+                                       result.append(py::int_(n));
+                                   return result;
+                               });
+
+    m.def(
+        "get_stream_stats",
+        [](const std::string& file_name, size_t max_packets) {
+            std::vector<udp_stream_stats> stats;
+            {
+                py::gil_scoped_release release;
+                stats = get_stream_stats(file_name, max_packets);
+            }
+            py::list result;
+            for (auto& s : stats) result.append(py::cast(std::move(s)));
+            return result;
+        },
+        py::arg("file_name"), py::arg("max_packets") = 0);
+
+    m.def("get_index", &get_index, py::arg("file_name"), py::arg("lidar_port"),
+          py::arg("pf"));
+
+    m.def("replay_seek",
+          [](std::shared_ptr<playback_handle>& handle,
+             const pcap_index::stream& stream, size_t frame) -> bool {
+              return replay_seek(*handle, stream, frame);
+          });
+
+    m.def("replay_seek_time",
+          [](std::shared_ptr<playback_handle>& handle,
+             const pcap_index::stream& stream, double timestamp) -> bool {
+              return replay_seek(*handle, stream,
+                                 std::chrono::microseconds{
+                                     llround(timestamp * 1e6)});
+          });
+
+    // parallel decoding
+    py::class_<PcapScanReader>(m, "PcapScanReader")
+        .def(py::init<const std::string&, const ouster::sensor::sensor_info&,
+                      const LidarScan&, int, size_t, bool, int>(),
+             py::arg("file_name"), py::arg("info"), py::arg("prototype"),
+             py::arg("n_workers") = 0, py::arg("chunk_frames") = 4,
+             py::arg("complete") = false, py::arg("lidar_port") = 0,
+             py::call_guard<py::gil_scoped_release>())
+        .def("next",
+             [](PcapScanReader& self) -> py::object {
+                 LidarScan ls;
+                 bool found;
+                 {
+                     py::gil_scoped_release release;
+                     found = self.next(ls);
+                 }
+                 if (!found) return py::none();
+                 return py::cast(std::move(ls));
+             })
+        .def_property_readonly("frame_count", &PcapScanReader::frame_count);
+
+    // columnar export
+    m.def(
+        "to_arrow",
+        [](const std::string& file_name,
+           const ouster::sensor::sensor_info& info,
+           const std::string& arrow_file, const LidarScan& prototype, bool xyz,
+           size_t batch_frames, int n_threads, int n_workers,
+           size_t chunk_frames, bool complete, int lidar_port) -> size_t {
+            arrow_file_options options;
+            options.batch_frames = batch_frames;
+            options.xyz = xyz;
+            options.n_threads = n_threads;
+            PcapScanReader reader(file_name, info, prototype, n_workers,
+                                  chunk_frames, complete, lidar_port);
+            ArrowFileWriter writer(arrow_file, info, prototype, options);
+            LidarScan ls;
+            while (reader.next(ls)) writer.write(ls);
+            writer.close();
+            return writer.frame_count();
+        },
+        py::arg("file_name"), py::arg("info"), py::arg("arrow_file"),
+        py::arg("prototype"), py::arg("xyz") = false,
+        py::arg("batch_frames") = 8, py::arg("n_threads") = 1,
+        py::arg("n_workers") = 0, py::arg("chunk_frames") = 4,
+        py::arg("complete") = false, py::arg("lidar_port") = 0,
+        py::call_guard<py::gil_scoped_release>());
+
+    // multi-sensor decoding
+    py::class_<PcapDemux>(m, "PcapDemux")
+        .def(py::init([](const std::string& file_name, py::list infos,
+                         py::list prototypes, bool complete,
+                         py::list lidar_ports) {
+                 std::vector<ouster::sensor::sensor_info> infos_;
+                 for (auto info : infos)
+                     infos_.push_back(info.cast<ouster::sensor::sensor_info>());
+                 std::vector<LidarScan> prototypes_;
+                 for (auto p : prototypes)
+                     prototypes_.push_back(p.cast<LidarScan>());
+                 std::vector<int> ports;
+                 for (auto port : lidar_ports)
+                     ports.push_back(port.cast<int>());
+
+                 py::gil_scoped_release release;
+                 return new PcapDemux(file_name, infos_, prototypes_, complete,
+                                      ports);
+             }),
+             py::arg("file_name"), py::arg("infos"), py::arg("prototypes"),
+             py::arg("complete") = false, py::arg("lidar_ports") = py::list())
+        .def("next",
+             [](PcapDemux& self) -> py::object {
+                 LidarScan ls;
+                 size_t stream;
+                 bool found;
+                 {
+                     py::gil_scoped_release release;
+                     found = self.next(ls, stream);
+                 }
+                 if (!found) return py::none();
+                 return py::make_tuple(stream, py::cast(std::move(ls)));
+             })
+        .def("reset", &PcapDemux::reset,
+             py::call_guard<py::gil_scoped_release>())
+        .def_property_readonly("streams", [](const PcapDemux& self) {
+            py::list result;
+            for (const auto& s : self.streams())
+                result.append(py::make_tuple(
+                    s.sensor,
+                    py::bytes(reinterpret_cast<const char*>(s.src_addr.data()),
+                              s.src_addr.size()),
+                    s.dst_port));
+            return result;
+        });
+
     // pcap writing
     py::class_<std::shared_ptr<record_handle>>(m, "record_handle");
 
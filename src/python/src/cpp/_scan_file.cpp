@@ -0,0 +1,170 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief ouster_pyclient_scan_file python module
+ */
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+
+#include <cstdint>
+#include <string>
+
+#include "ouster/impl/build.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/scan_file.h"
+#include "ouster/types.h"
+
+using namespace ouster::sensor_utils;
+using ouster::LidarScan;
+using ouster::sensor::ChanField;
+using ouster::sensor::ChanFieldType;
+namespace py = pybind11;
+
+namespace {
+
+py::dtype field_dtype(ChanFieldType t) {
+    switch (t) {
+        case ChanFieldType::UINT8:
+            return py::dtype::of<uint8_t>();
+        case ChanFieldType::UINT16:
+            return py::dtype::of<uint16_t>();
+        case ChanFieldType::UINT32:
+            return py::dtype::of<uint32_t>();
+        case ChanFieldType::UINT64:
+            return py::dtype::of<uint64_t>();
+        default:
+            throw std::invalid_argument("Invalid field type");
+    }
+}
+
+// views may point into a read-only mapping of the file
+py::array readonly(py::array arr) {
+    arr.attr("setflags")(py::arg("write") = false);
+    return arr;
+}
+
+}  // namespace
+
+PYBIND11_PLUGIN(_scan_file) {
+    py::module m("_scan_file", R"(Scan file bindings generated by pybind11.
+
+This module is generated from the C++ code and not meant to be used directly.
+)");
+
+    // turn off signatures in docstrings: mypy stubs provide better types
+    py::options options;
+    options.disable_function_signatures();
+
+    py::class_<ScanFileWriter>(m, "ScanFileWriter")
+        .def(py::init([](const std::string& file,
+                         const ouster::sensor::sensor_info& info,
+                         const LidarScan* prototype, size_t chunk_frames,
+                         int compression_level) {
+                 scan_file_options opts;
+                 opts.chunk_frames = chunk_frames;
+                 opts.compression_level = compression_level;
+                 if (prototype)
+                     return new ScanFileWriter(file, info, *prototype, opts);
+                 return new ScanFileWriter(file, info, opts);
+             }),
+             py::arg("file_name"), py::arg("info"),
+             py::arg("prototype") = nullptr, py::arg("chunk_frames") = 8,
+             py::arg("compression_level") = 1)
+        .def("write", &ScanFileWriter::write, py::arg("scan"),
+             py::call_guard<py::gil_scoped_release>())
+        .def("close", &ScanFileWriter::close,
+             py::call_guard<py::gil_scoped_release>())
+        .def_property_readonly("frame_count", &ScanFileWriter::frame_count);
+
+    py::class_<scan_view>(m, "ScanView")
+        .def_readonly("w", &scan_view::w)
+        .def_readonly("h", &scan_view::h)
+        .def_readonly("frame_id", &scan_view::frame_id)
+        .def_property_readonly(
+            "timestamp",
+            [](const scan_view& self) {
+                return readonly(py::array(py::dtype::of<uint64_t>(), self.w,
+                                          self.timestamp, py::cast(self)));
+            })
+        .def_property_readonly(
+            "measurement_id",
+            [](const scan_view& self) {
+                return readonly(py::array(py::dtype::of<uint16_t>(), self.w,
+                                          self.measurement_id,
+                                          py::cast(self)));
+            })
+        .def_property_readonly(
+            "status",
+            [](const scan_view& self) {
+                return readonly(py::array(py::dtype::of<uint32_t>(), self.w,
+                                          self.status, py::cast(self)));
+            })
+        .def_property_readonly(
+            "rx_timestamp",
+            [](const scan_view& self) {
+                return readonly(py::array(py::dtype::of<uint64_t>(), self.w,
+                                          self.rx_timestamp, py::cast(self)));
+            })
+        .def_property_readonly("fields",
+                               [](const scan_view& self) {
+                                   py::list res;
+                                   for (const auto& p : self.planes)
+                                       res.append(py::cast(p.field));
+                                   return res;
+                               })
+        .def("field", [](const scan_view& self, ChanField f) {
+            const auto* p = self.find(f);
+            if (!p) throw py::key_error("Field not stored in scan file");
+            std::vector<size_t> dims{self.h, self.w};
+            return readonly(
+                py::array(field_dtype(p->type), dims, p->data, py::cast(self)));
+        });
+
+    py::class_<ScanFileReader>(m, "ScanFileReader")
+        .def(py::init<const std::string&>(), py::arg("file_name"))
+        .def_property_readonly("info", &ScanFileReader::info)
+        .def_property_readonly("metadata", &ScanFileReader::metadata)
+        .def_property_readonly("w", &ScanFileReader::w)
+        .def_property_readonly("h", &ScanFileReader::h)
+        .def_property_readonly("fields",
+                               [](const ScanFileReader& self) {
+                                   py::dict res;
+                                   for (const auto& ft : self.field_types())
+                                       res[py::cast(ft.first)] =
+                                           field_dtype(ft.second);
+                                   return res;
+                               })
+        .def("__len__", &ScanFileReader::frame_count)
+        .def("frame_id", &ScanFileReader::frame_id, py::arg("frame"))
+        .def(
+            "frame_timestamp",
+            [](const ScanFileReader& self, size_t frame) {
+                return self.frame_timestamp(frame).count();
+            },
+            py::arg("frame"))
+        .def(
+            "find_frame",
+            [](const ScanFileReader& self, int64_t ts) {
+                return self.find_frame(std::chrono::nanoseconds{ts});
+            },
+            py::arg("timestamp"))
+        .def("view", &ScanFileReader::view, py::arg("frame"),
+             py::call_guard<py::gil_scoped_release>())
+        .def(
+            "read",
+            [](const ScanFileReader& self, size_t frame) {
+                LidarScan ls;
+                {
+                    py::gil_scoped_release release;
+                    self.read(frame, ls);
+                }
+                return ls;
+            },
+            py::arg("frame"));
+
+    m.attr("__version__") = ouster::SDK_VERSION;
+
+    return m.ptr();
+}
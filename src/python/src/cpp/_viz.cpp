@@ -11,9 +11,11 @@
 #include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/pytypes.h>
+#include <pybind11/stl.h>
 
 #include <atomic>
 #include <csignal>
+#include <cstring>
 #include <memory>
 #include <stdexcept>
 #include <utility>
@@ -79,9 +81,10 @@ PYBIND11_PLUGIN(_viz) {
     options.disable_function_signatures();
 
     py::class_<viz::PointViz>(m, "PointViz")
-        .def(py::init<const std::string&, bool, int, int>(), py::arg("name"),
-             py::arg("fix_aspect") = false, py::arg("window_width") = 800,
-             py::arg("window_height") = 600)
+        .def(py::init<const std::string&, bool, int, int, bool>(),
+             py::arg("name"), py::arg("fix_aspect") = false,
+             py::arg("window_width") = 800, py::arg("window_height") = 600,
+             py::arg("headless") = false)
 
         .def(
             "run",
@@ -129,6 +132,34 @@ PYBIND11_PLUGIN(_viz) {
             },
             "Add a callback for handling keyboard input.")
 
+        .def(
+            "push_frame_handler",
+            [](viz::PointViz& self, std::function<bool(py::array)> f) {
+                self.push_frame_handler(
+                    [f](const uint8_t* rgba, int w, int h) {
+                        // called from run() with the gil released
+                        py::gil_scoped_acquire acquire;
+                        py::array_t<uint8_t> frame{{h, w, 4}};
+                        auto out = frame.mutable_unchecked<3>();
+                        const size_t row = static_cast<size_t>(w) * 4;
+                        // rows are read bottom first; return them top first
+                        for (int y = 0; y < h; y++)
+                            std::memcpy(out.mutable_data(y, 0, 0),
+                                        rgba + (h - 1 - y) * row, row);
+                        return f(frame);
+                    });
+            },
+            R"(
+             Add a callback for handling rendered frames.
+
+             The callback is passed each frame as an RGBA array of shape
+             ``(height, width, 4)``, a frame or two after it's drawn. Frames are
+             only read back while callbacks are present.
+        )")
+
+        .def("pop_frame_handler", &viz::PointViz::pop_frame_handler,
+             "Remove the last added callback for handling rendered frames.")
+
         // control scene
         .def_property_readonly("camera", &viz::PointViz::camera,
                                py::return_value_policy::reference_internal,
@@ -146,6 +177,9 @@ PYBIND11_PLUGIN(_viz) {
 
              Args:
                  obj: A cloud, label, image or cuboid.)")
+        .def("add",
+             py::overload_cast<const std::shared_ptr<viz::AccumulatedCloud>&>(
+                 &viz::PointViz::add))
         .def("add", py::overload_cast<const std::shared_ptr<viz::Cuboid>&>(
                         &viz::PointViz::add))
         .def("add", py::overload_cast<const std::shared_ptr<viz::Label>&>(
@@ -164,6 +198,9 @@ PYBIND11_PLUGIN(_viz) {
              Returns:
                  True if the object was in the scene and was removed.
              )")
+        .def("remove",
+             py::overload_cast<const std::shared_ptr<viz::AccumulatedCloud>&>(
+                 &viz::PointViz::remove))
         .def("remove", py::overload_cast<const std::shared_ptr<viz::Cuboid>&>(
                            &viz::PointViz::remove))
         .def("remove", py::overload_cast<const std::shared_ptr<viz::Label>&>(
@@ -300,6 +337,21 @@ PYBIND11_PLUGIN(_viz) {
                   range: array of at least as many elements as there are points,
                          representing the range of the points
               )")
+        .def(
+            "set_key",
+            [](viz::Cloud& self,
+               py::array_t<uint16_t, py::array::c_style> key) {
+                check_array(key, self.get_size(), 0, 'C');
+                self.set_key(key.data());
+            },
+            py::arg("key"),
+            R"(
+                 Set the key values, used for colouring, without conversion.
+
+                 Args:
+                    key: uint16 array of at least as many elements as there
+                         are points, where 0 to 65535 map to 0 to 1
+             )")
         .def(
             "set_key",
             [](viz::Cloud& self, py::array_t<float> key) {
@@ -314,6 +366,41 @@ PYBIND11_PLUGIN(_viz) {
                     key: array of at least as many elements as there are
                          points, preferably normalized between 0 and 1
              )")
+        .def(
+            "set_key_field",
+            [](viz::Cloud& self, py::array_t<uint32_t> field) {
+                check_array(field, self.get_size(), 0, 'C');
+                self.set_key_field(field.data());
+            },
+            py::arg("field"),
+            R"(
+                 Set the key values from a raw channel field.
+
+                 The field is scaled for display with auto exposure while
+                 drawing, replacing keys set by set_key().
+
+                 Args:
+                    field: array of at least as many elements as there are
+                           points, e.g. the signal field of a staggered scan
+             )")
+        .def(
+            "set_mask",
+            [](viz::Cloud& self,
+               py::array_t<uint8_t, py::array::c_style> mask) {
+                check_array(mask, self.get_size() * 4, 0, 'C');
+                if (mask.ndim() != 2 && mask.ndim() != 3)
+                    throw std::invalid_argument(
+                        "Expected an array of dimensions: 2 or 3");
+                self.set_mask(mask.data());
+            },
+            py::arg("mask"),
+            R"(
+                 Set the RGBA mask values without conversion.
+
+                 Args:
+                    mask: uint8 array of at least 4x as many elements as there
+                          are points, where 0 to 255 map to 0 to 1
+             )")
         .def(
             "set_mask",
             [](viz::Cloud& self, py::array_t<float> mask) {
@@ -380,6 +467,113 @@ PYBIND11_PLUGIN(_viz) {
             R"(
             Set the point cloud color palette.
 
+            Args:
+                palette: the new palette to use, must have size 3*palette_size
+        )")
+        .def("set_lod", &viz::Cloud::set_lod, py::arg("block_cols"),
+             py::arg("full_detail_range") = 50.0f, py::arg("max_points") = 0,
+             R"(
+            Set the level of detail used to draw the point cloud.
+
+            Columns are split into blocks. Blocks outside of the view are
+            skipped, and far blocks are drawn with every 2nd, 4th, ... row:
+            density halves every time the distance to the camera doubles beyond
+            full_detail_range. All blocks are thinned further if more than
+            max_points would be drawn.
+
+            Args:
+                block_cols: number of columns per block, 0 to draw all points
+                full_detail_range: distance from the camera up to which blocks
+                                   are drawn with all rows
+                max_points: maximum number of points drawn per frame, 0 for no
+                            limit
+        )");
+
+    py::class_<viz::AccumulatedCloud, std::shared_ptr<viz::AccumulatedCloud>>(
+        m, "AccumulatedCloud", R"(
+             Manages the state of the last n scans of a sensor.
+
+             Scans are kept on the gpu in a ring of n slots, each with its own
+             pose. New scans overwrite the oldest in place, and all scans are
+             drawn at once.
+             )")
+        .def(
+            "__init__",
+            [](viz::AccumulatedCloud& self, const sensor::sensor_info& info,
+               size_t n_scans) {
+                const auto xyz_lut = make_xyz_lut(info);
+
+                // make_xyz_lut still outputs doubles
+                Eigen::Array<float, Eigen::Dynamic, 3> direction =
+                    xyz_lut.direction.cast<float>();
+                Eigen::Array<float, Eigen::Dynamic, 3> offset =
+                    xyz_lut.offset.cast<float>();
+
+                viz::mat4d extrinsica;
+                std::copy(info.extrinsic.data(), info.extrinsic.data() + 16,
+                          extrinsica.data());
+
+                new (&self) viz::AccumulatedCloud{
+                    info.format.columns_per_frame,
+                    info.format.pixels_per_column, direction.data(),
+                    offset.data(), n_scans, extrinsica};
+            },
+            py::arg("metadata"), py::arg("n_scans"),
+            R"(
+                 ``def __init__(self, si: SensorInfo, n_scans: int) -> None:``
+
+                 Accumulated point cloud of a sensor.
+
+                 Call add_scan() to update
+
+                 Args:
+                    info: sensor metadata
+                    n_scans: number of scans kept
+             )")
+        .def(
+            "add_scan",
+            [](viz::AccumulatedCloud& self, py::array_t<uint32_t> range,
+               py::array_t<float> key, pymatrixd pose) {
+                check_array(range, self.get_size(), 2, 'C');
+                check_array(key, self.get_size(), 0, 'C');
+                check_array(pose, 16, 2, 'F');
+                viz::mat4d posea;
+                std::copy(pose.data(), pose.data() + 16, posea.data());
+                self.add_scan(range.data(), key.data(), posea);
+            },
+            py::arg("range"), py::arg("key"), py::arg("pose"),
+            R"(
+                Add a scan, replacing the oldest once n_scans are kept.
+
+                Args:
+                  range: array of at least as many elements as there are points
+                         of a scan, representing the range of the points
+                  key: array of at least as many elements as there are points of
+                       a scan, preferably normalized between 0 and 1
+                  pose: 4x4 column-major homogeneous transformation matrix
+              )")
+        .def("reset", &viz::AccumulatedCloud::reset,
+             "Drop all scans kept, including those already drawn.")
+        .def("set_point_size", &viz::AccumulatedCloud::set_point_size,
+             py::arg("size"),
+             R"(
+            Set point size.
+
+            Args:
+                size: point size
+        )")
+        .def(
+            "set_palette",
+            [](viz::AccumulatedCloud& self, py::array_t<float> buf) {
+                check_array(buf, 0, 2, 'C');
+                if (buf.shape(1) != 3)
+                    throw std::invalid_argument("Expected a N x 3 array");
+                self.set_palette(buf.data(), buf.shape(0));
+            },
+            py::arg("palette"),
+            R"(
+            Set the point cloud color palette.
+
             Args:
                 palette: the new palette to use, must have size 3*palette_size
         )");
@@ -399,6 +593,46 @@ PYBIND11_PLUGIN(_viz) {
                  Args:
                     image: 2D array with image data
              )")
+        .def(
+            "set_field",
+            [](viz::Image& self, py::array_t<uint32_t> field) {
+                check_array(field, 0, 2, 'C');
+                self.set_field(field.shape(1), field.shape(0), field.data());
+            },
+            py::arg("field"), R"(
+                 Set the image data from a raw channel field.
+
+                 The field is scaled for display with auto exposure and
+                 destaggered with the pixel shifts set by set_pixel_shift()
+                 while drawing, replacing the image set by set_image().
+
+                 Args:
+                    field: 2D array, usually a staggered channel field
+             )")
+        .def("set_pixel_shift", &viz::Image::set_pixel_shift,
+             py::arg("pixel_shift_by_row"), R"(
+                 Set the pixel shifts applied to fields set by set_field().
+
+                 Args:
+                    pixel_shift_by_row: offset of each row, usually from the
+                                        sensor metadata; empty to draw fields
+                                        as they are
+             )")
+        .def(
+            "set_palette",
+            [](viz::Image& self, py::array_t<float> buf) {
+                check_array(buf, 0, 2, 'C');
+                if (buf.shape(1) != 3)
+                    throw std::invalid_argument("Expected a N x 3 array");
+                self.set_palette(buf.data(), buf.shape(0));
+            },
+            py::arg("palette"), R"(
+                 Set the image color palette.
+
+                 Args:
+                    palette: N x 3 array of colors; empty to draw the image in
+                             grayscale
+             )")
         .def(
             "set_mask",
             [](viz::Image& self, py::array_t<float> buf) {
@@ -21,12 +21,20 @@ from ._client import SensorConfig
 from ._client import get_config
 from ._client import set_config
 from ._client import LidarScan
+from ._client import ScanSummary
+from ._client import Destaggerer
+from ._client import ScanShmPublisher
+from ._client import ScanShmSubscriber
+from ._client import StreamConfig
+from ._client import ScanStreamServer
+from ._client import ScanStreamClient
 
 from .data import BufferT
 from .data import FieldDType
 from .data import Packet
 from .data import ImuPacket
 from .data import LidarPacket
+from .data import LidarPackets
 from .data import ColHeader
 from .data import XYZLut
 from .data import destagger
@@ -37,5 +45,7 @@ from .core import ClientOverflow
 from .core import PacketSource
 from .core import ScanSource
 from .core import Packets
+from .core import PacketBatch
 from .core import Sensor
 from .core import Scans
+from .core import ScanStream
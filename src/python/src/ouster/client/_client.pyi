@@ -45,12 +45,31 @@ class Client:
     def get_metadata(self, timeout_sec: int = ..., legacy: bool = ...) -> str:
         ...
 
+    def use_packet_ring(self,
+                        interface: str = ...,
+                        ring_size: int = ...) -> bool:
+        ...
+
     def shutdown(self) -> None:
         ...
 
     def consume(self, buf: bytearray, timeout_sec: float) -> ClientState:
         ...
 
+    def consume_batch(
+        self,
+        packet_size: int,
+        max_packets: int = ...,
+        timeout_sec: float = ...
+    ) -> Tuple[ClientState, ndarray, ndarray, ndarray]:
+        ...
+
+    def notify_fd(self) -> int:
+        ...
+
+    def clear_notify(self) -> None:
+        ...
+
     def produce(self, pf: PacketFormat) -> None:
         ...
 
@@ -65,6 +84,10 @@ class Client:
     def size(self) -> int:
         ...
 
+    @property
+    def rx_timestamp(self) -> int:
+        ...
+
     @property
     def lidar_port(self) -> int:
         ...
@@ -74,6 +97,28 @@ class Client:
         ...
 
 
+class ScanSource:
+    def __init__(self,
+                 client: Client,
+                 info: SensorInfo,
+                 prototype: LidarScan,
+                 complete: bool = ...,
+                 timeout: float = ...,
+                 packet_timeout: float = ...,
+                 max_latency: int = ...,
+                 overflow_err: bool = ...) -> None:
+        ...
+
+    def push(self, buf: BufferT, rx_timestamp: int = ...) -> None:
+        ...
+
+    def flush(self, n_frames: int = ..., full: bool = ...) -> ClientState:
+        ...
+
+    def next(self) -> Tuple[ClientState, Optional[LidarScan]]:
+        ...
+
+
 class ClientState:
     ERROR: ClassVar[ClientState]
     EXIT: ClassVar[ClientState]
@@ -182,6 +227,12 @@ class PacketFormat:
     def packet_header(self, header: ColHeader, buf: BufferT) -> ndarray:
         ...
 
+    def packet_fields(self, field: ChanField, bufs: ndarray) -> ndarray:
+        ...
+
+    def packet_headers(self, header: ColHeader, bufs: ndarray) -> ndarray:
+        ...
+
     def imu_sys_ts(self, buf: BufferT) -> int:
         ...
 
@@ -553,10 +604,49 @@ class Version:
         ...
 
 
+class ScanSummary:
+    @property
+    def valid(self) -> bool:
+        ...
+
+    @property
+    def window(self) -> Tuple[int, int]:
+        ...
+
+    @property
+    def cols_received(self) -> int:
+        ...
+
+    @property
+    def window_cols_received(self) -> int:
+        ...
+
+    @property
+    def cols_missing(self) -> int:
+        ...
+
+    @property
+    def first_timestamp(self) -> int:
+        ...
+
+    @property
+    def last_timestamp(self) -> int:
+        ...
+
+    @property
+    def zero_range(self) -> int:
+        ...
+
+    @property
+    def zero_range2(self) -> int:
+        ...
+
+
 class LidarScan:
     N_FIELDS: ClassVar[int]
 
     frame_id: int
+    destaggered: bool
 
     @overload
     def __init__(self, w: int, h: int) -> None:
@@ -597,9 +687,17 @@ class LidarScan:
     def status(self) -> ndarray:
         ...
 
+    @property
+    def rx_timestamp(self) -> ndarray:
+        ...
+
     def complete(self, window: Optional[Tuple[int, int]] = ...) -> bool:
         ...
 
+    @property
+    def summary(self) -> ScanSummary:
+        ...
+
     @property
     def fields(self) -> Iterator[ChanField]:
         ...
@@ -612,6 +710,124 @@ class LidarScan:
         ...
 
 
+class ScanShmPublisher:
+    @overload
+    def __init__(self, name: str, info: SensorInfo,
+                 n_slots: int = ...) -> None:
+        ...
+
+    @overload
+    def __init__(self,
+                 name: str,
+                 info: SensorInfo,
+                 prototype: LidarScan,
+                 n_slots: int = ...) -> None:
+        ...
+
+    def publish(self, scan: LidarScan) -> int:
+        ...
+
+    @property
+    def published(self) -> int:
+        ...
+
+    @property
+    def n_slots(self) -> int:
+        ...
+
+
+class ScanShmSubscriber:
+    def __init__(self, name: str) -> None:
+        ...
+
+    @property
+    def info(self) -> SensorInfo:
+        ...
+
+    def next(self, timeout_sec: float = ...) -> Optional[LidarScan]:
+        ...
+
+    def read(self, scan: LidarScan, timeout_sec: float = ...) -> bool:
+        ...
+
+    def valid(self) -> bool:
+        ...
+
+    @property
+    def seq(self) -> int:
+        ...
+
+    @property
+    def dropped(self) -> int:
+        ...
+
+    @property
+    def closed(self) -> bool:
+        ...
+
+
+class StreamConfig:
+    fields: List[ChanField]
+    rows: List[int]
+    cols: List[int]
+    range_step: int
+    max_pending: int
+
+    def __init__(self) -> None:
+        ...
+
+
+class ScanStreamServer:
+    def __init__(self,
+                 info: SensorInfo,
+                 port: int = ...,
+                 config: StreamConfig = ...) -> None:
+        ...
+
+    @property
+    def port(self) -> int:
+        ...
+
+    def send(self, scan: LidarScan) -> int:
+        ...
+
+    @property
+    def frames(self) -> int:
+        ...
+
+    @property
+    def bytes(self) -> int:
+        ...
+
+    @property
+    def dropped_frames(self) -> int:
+        ...
+
+    @property
+    def clients(self) -> int:
+        ...
+
+
+class ScanStreamClient:
+    def __init__(self, host: str, port: int, timeout_sec: float = ...) -> None:
+        ...
+
+    @property
+    def metadata(self) -> SensorInfo:
+        ...
+
+    @property
+    def rows(self) -> List[int]:
+        ...
+
+    @property
+    def cols(self) -> List[int]:
+        ...
+
+    def read(self, scan: LidarScan, timeout_sec: float = ...) -> bool:
+        ...
+
+
 def destagger_int8(field: ndarray, shifts: List[int],
                    inverse: bool) -> ndarray:
     ...
@@ -662,21 +878,49 @@ def destagger_double(field: ndarray, shifts: List[int],
     ...
 
 
+class Destaggerer:
+    def __init__(self, info: SensorInfo, inverse: bool = ...) -> None:
+        ...
+
+    @overload
+    def __call__(self, img: ndarray, out: ndarray) -> ndarray:
+        ...
+
+    @overload
+    def __call__(self,
+                 scan: LidarScan,
+                 fields: List[ChanField],
+                 dest: LidarScan,
+                 n_threads: int = ...) -> None:
+        ...
+
+    @property
+    def h(self) -> int:
+        ...
+
+    @property
+    def w(self) -> int:
+        ...
+
+
 class ScanBatcher:
     @overload
     def __init__(self, w: int, pf: PacketFormat) -> None:
         ...
 
     @overload
-    def __init__(self, info: SensorInfo) -> None:
+    def __init__(self, info: SensorInfo, destagger: bool = ...) -> None:
         ...
 
-    def __call__(self, buf: BufferT, ls: LidarScan) -> bool:
+    def __call__(self,
+                 buf: BufferT,
+                 ls: LidarScan,
+                 rx_timestamp: int = ...) -> bool:
         ...
 
 
 class XYZLut:
-    def __init__(self, info: SensorInfo) -> None:
+    def __init__(self, info: SensorInfo, destaggered: bool = ...) -> None:
         ...
 
     @overload
@@ -687,6 +931,14 @@ class XYZLut:
     def __call__(self, range: ndarray) -> ndarray:
         ...
 
+    @overload
+    def __call__(self, scan: LidarScan, out: ndarray) -> ndarray:
+        ...
+
+    @overload
+    def __call__(self, range: ndarray, out: ndarray) -> ndarray:
+        ...
+
 
 class AutoExposure:
     @overload
@@ -703,8 +955,14 @@ class AutoExposure:
 
 
 class BeamUniformityCorrector:
+    @overload
     def __init__(self) -> None:
         ...
 
+    @overload
+    def __init__(self, update_every: int, column_stride: int,
+                 n_threads: int = ...) -> None:
+        ...
+
     def __call__(self, image: ndarray) -> None:
         ...
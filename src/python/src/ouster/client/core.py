@@ -6,12 +6,15 @@ All rights reserved.
 This module contains more idiomatic wrappers around the lower-level module
 generated using pybind11.
 """
+import asyncio
 from contextlib import closing
-from typing import cast, Dict, Iterable, Iterator, List, Optional, Tuple, Union
+from typing import (cast, AsyncIterator, Dict, Iterable, Iterator, List,
+                    NamedTuple, Optional, Tuple, Union)
 from threading import Thread
 import time
 
 from more_itertools import take
+import numpy as np
 from typing_extensions import Protocol
 
 from . import _client
@@ -103,6 +106,31 @@ class Packets(PacketSource):
         pass
 
 
+class PacketBatch(NamedTuple):
+    """Packets read from a sensor at once.
+
+    Each row of ``data`` holds one packet. Rows are as long as a lidar packet,
+    so IMU packets are padded; use ``states`` to tell them apart.
+    """
+
+    #: The ClientState of each packet
+    states: np.ndarray
+    #: The packets, one per row of a (N, lidar_packet_size) uint8 array
+    data: np.ndarray
+    #: The receive timestamp of each packet in ns, zero for IMU packets
+    rx_timestamps: np.ndarray
+
+    @property
+    def lidar(self) -> np.ndarray:
+        """Mask of the rows holding lidar packets."""
+        return (self.states & int(_client.ClientState.LIDAR_DATA)) != 0
+
+    @property
+    def imu(self) -> np.ndarray:
+        """Mask of the rows holding IMU packets."""
+        return (self.states & int(_client.ClientState.IMU_DATA)) != 0
+
+
 class Sensor(PacketSource):
     """A packet source listening on local UDP ports.
 
@@ -200,7 +228,8 @@ class Sensor(PacketSource):
         if self._overflow_err and st & _client.ClientState.OVERFLOW:
             raise ClientOverflow()
         if st & _client.ClientState.LIDAR_DATA:
-            return LidarPacket(buf, self._metadata)
+            rx_ts = self._cli.rx_timestamp * 1e-9
+            return LidarPacket(buf, self._metadata, rx_ts)
         elif st & _client.ClientState.IMU_DATA:
             return ImuPacket(buf, self._metadata)
         elif st == _client.ClientState.TIMEOUT:
@@ -254,6 +283,110 @@ class Sensor(PacketSource):
                 # packets are buffered by the OS, not necessarily an error
                 pass
 
+    def _next_batch(self, max_packets: int,
+                    timeout: Optional[float]) -> Optional[PacketBatch]:
+        if self._cache is not None:
+            # hand out a packet peeked by flush() first
+            st, buf = self._cache
+            self._cache = None
+            if (st & _client.ClientState.LIDAR_DATA
+                    or st & _client.ClientState.IMU_DATA):
+                return PacketBatch(
+                    np.array([int(st)], dtype=np.intc),
+                    np.frombuffer(buf, dtype=np.uint8).reshape(1, -1),
+                    np.array([self._cli.rx_timestamp], dtype=np.uint64))
+
+        st, states, data, rx_ts = self._cli.consume_batch(
+            self._pf.lidar_packet_size, max_packets,
+            -1 if timeout is None else timeout)
+
+        if self._overflow_err and st & _client.ClientState.OVERFLOW:
+            raise ClientOverflow()
+        if st & _client.ClientState.ERROR:
+            raise ClientError("Client returned ERROR state")
+        if st == _client.ClientState.TIMEOUT and timeout != 0:
+            raise ClientTimeout(f"No packets received within {self._timeout}s")
+        if st & _client.ClientState.EXIT and len(states) == 0:
+            return None
+        return PacketBatch(states, data, rx_ts)
+
+    def batches(self, max_packets: int = 64) -> Iterator[PacketBatch]:
+        """Access the UDP data stream as batches of packets.
+
+        Each batch holds the packets buffered when it was read, up to
+        max_packets, so that the packets of a frame are handed over with a few
+        calls rather than one per packet. Waiting for packets releases the
+        GIL.
+
+        Args:
+            max_packets: the most packets in a batch
+
+        Raises:
+            ClientTimeout: if no packets are received within the configured
+                timeout
+            ClientError: if the client enters an unspecified error state
+            ValueError: if the packet source has already been closed
+        """
+        if not self._producer.is_alive():
+            raise ValueError("I/O operation on closed packet source")
+
+        if self._flush_before_read:
+            self.flush(full=True)
+
+        while True:
+            batch = self._next_batch(max_packets, self._timeout)
+            if batch is None:
+                break
+            yield batch
+
+    async def abatches(self,
+                       max_packets: int = 64) -> AsyncIterator[PacketBatch]:
+        """Like ``batches()``, waiting for packets on the running event loop.
+
+        Buffered packets are read without blocking, and the loop is free to
+        run other tasks until the producer signals that more have arrived. Must
+        be used from the thread running the event loop; flushing before
+        reading, if enabled, blocks.
+
+        Args:
+            max_packets: the most packets in a batch
+
+        Raises:
+            ClientTimeout: if no packets are received within the configured
+                timeout
+            ClientError: if the client enters an unspecified error state
+            ValueError: if the packet source has already been closed
+        """
+        if not self._producer.is_alive():
+            raise ValueError("I/O operation on closed packet source")
+
+        if self._flush_before_read:
+            self.flush(full=True)
+
+        loop = asyncio.get_running_loop()
+        fd = self._cli.notify_fd()
+        ready = asyncio.Event()
+        loop.add_reader(fd, ready.set)
+        try:
+            while True:
+                # clear before reading so packets arriving after the read
+                # signal again
+                ready.clear()
+                self._cli.clear_notify()
+                batch = self._next_batch(max_packets, 0)
+                if batch is None:
+                    break
+                if len(batch.states):
+                    yield batch
+                    continue
+                try:
+                    await asyncio.wait_for(ready.wait(), self._timeout)
+                except asyncio.TimeoutError:
+                    raise ClientTimeout(
+                        f"No packets received within {self._timeout}s")
+        finally:
+            loop.remove_reader(fd)
+
     def flush(self, n_frames: int = 3, *, full=False) -> int:
         """Drop some data to clear internal buffers.
 
@@ -361,6 +494,11 @@ class Scans:
     def __iter__(self) -> Iterator[LidarScan]:
         """Get an iterator."""
 
+        # batch packets from sensors natively, without the GIL
+        if isinstance(self._source, Sensor):
+            yield from self._sensor_scans(self._source)
+            return
+
         w = self._source.metadata.format.columns_per_frame
         h = self._source.metadata.format.pixels_per_column
         packets_per_frame = w // self._source.metadata.format.columns_per_packet
@@ -371,8 +509,7 @@ class Scans:
             self._source, Sensor) else None
 
         ls_write = None
-        pf = _client.PacketFormat.from_info(self._source.metadata)
-        batch = _client.ScanBatcher(w, pf)
+        batch = _client.ScanBatcher(self._source.metadata)
 
         # Time from which to measure timeout
         start_ts = time.monotonic()
@@ -394,7 +531,9 @@ class Scans:
             if isinstance(packet, LidarPacket):
                 ls_write = ls_write or LidarScan(h, w, self._fields)
 
-                if batch(packet._data, ls_write):
+                rx_ts = packet.capture_timestamp
+                rx_ns = int(rx_ts * 1e9) if rx_ts is not None else 0
+                if batch(packet._data, ls_write, rx_ns):
                     # Got a new frame, return it and start another
                     if not self._complete or ls_write.complete(column_window):
                         yield ls_write
@@ -409,7 +548,59 @@ class Scans:
 
                         if drop_frames > 0:
                             sensor.flush(drop_frames)
-                            batch = _client.ScanBatcher(w, pf)
+                            batch = _client.ScanBatcher(self._source.metadata)
+
+    def _sensor_scans(self, sensor: Sensor) -> Iterator[LidarScan]:
+        """Batch scans from a sensor in the client, returning only scans."""
+
+        if not sensor._producer.is_alive():
+            raise ValueError("I/O operation on closed packet source")
+
+        w = sensor.metadata.format.columns_per_frame
+        h = sensor.metadata.format.pixels_per_column
+        source = _client.ScanSource(
+            sensor._cli,
+            sensor.metadata,
+            LidarScan(h, w, self._fields),
+            complete=self._complete,
+            timeout=-1.0 if self._timeout is None else self._timeout,
+            packet_timeout=-1.0 if sensor._timeout is None else sensor._timeout,
+            max_latency=self._max_latency,
+            overflow_err=sensor._overflow_err)
+
+        def check(st: _client.ClientState, start_ts: float) -> None:
+            if sensor._overflow_err and st & _client.ClientState.OVERFLOW:
+                raise ClientOverflow()
+            elif st == _client.ClientState.TIMEOUT:
+                if self._timeout is not None and (time.monotonic() >=
+                                                  start_ts + self._timeout):
+                    raise ClientTimeout(
+                        f"No lidar scans within {self._timeout}s")
+                raise ClientTimeout(
+                    f"No packets received within {sensor._timeout}s")
+            elif st & _client.ClientState.ERROR:
+                raise ClientError("Client returned ERROR state")
+
+        # a packet may have been taken out of the client by Sensor.flush()
+        cached, sensor._cache = sensor._cache, None
+        if sensor._flush_before_read:
+            st = source.flush(full=True)
+            check(st, time.monotonic())
+            if st & _client.ClientState.EXIT:
+                return
+        elif cached is not None and cached[0] & _client.ClientState.LIDAR_DATA:
+            source.push(cached[1], sensor._cli.rx_timestamp)
+
+        start_ts = time.monotonic()
+        while True:
+            st, scan = source.next()
+            if scan is not None:
+                yield scan
+                start_ts = time.monotonic()
+                continue
+            check(st, start_ts)
+            if st & _client.ClientState.EXIT:
+                return
 
     def close(self) -> None:
         """Close the underlying PacketSource."""
@@ -495,3 +686,65 @@ class Scans:
                    complete=complete,
                    fields=fields,
                    _max_latency=2)
+
+
+class ScanStream(ScanSource):
+    """Scans received from a ScanStreamServer, e.g. running on a vehicle.
+
+    Scans have the dimensions of the region the server sends and only the
+    fields it sends, see ``rows`` and ``cols``.
+    """
+
+    def __init__(self,
+                 hostname: str,
+                 port: int,
+                 *,
+                 timeout: Optional[float] = 1.0) -> None:
+        """
+        Args:
+            hostname: hostname or ip of the server
+            port: TCP port of the server
+            timeout: seconds to wait for a scan before raising ClientTimeout,
+                or None to wait forever
+        """
+        self._client: Optional[_client.ScanStreamClient] = (
+            _client.ScanStreamClient(hostname, port))
+        self._metadata = self._client.metadata
+        self._timeout = timeout
+
+    @property
+    def metadata(self) -> SensorInfo:
+        return self._metadata
+
+    @property
+    def rows(self) -> List[int]:
+        """Rows of the sensor's scans that are sent."""
+        return self._require().rows
+
+    @property
+    def cols(self) -> List[int]:
+        """Columns of the sensor's scans that are sent."""
+        return self._require().cols
+
+    def _require(self) -> _client.ScanStreamClient:
+        if self._client is None:
+            raise ValueError("I/O operation on closed stream")
+        return self._client
+
+    def __iter__(self) -> Iterator[LidarScan]:
+        client = self._require()
+        timeout = -1.0 if self._timeout is None else self._timeout
+        while True:
+            scan = LidarScan(0, 0)
+            try:
+                if not client.read(scan, timeout):
+                    raise ClientTimeout(
+                        f"No scans received within {self._timeout}s")
+            except RuntimeError as e:
+                if self._client is None or "closed" in str(e):
+                    return
+                raise ClientError(str(e))
+            yield scan
+
+    def close(self) -> None:
+        self._client = None
@@ -5,7 +5,7 @@ All rights reserved.
 
 from copy import deepcopy
 from enum import Enum
-from typing import Callable, Iterator, Type, List, Optional, Union
+from typing import Callable, Iterator, Type, Optional, Union
 import warnings
 
 import numpy as np
@@ -250,20 +250,95 @@ class LidarPacket:
         return res
 
 
-def _destagger(field: np.ndarray, shifts: List[int],
-               inverse: bool) -> np.ndarray:
-    return {
-        np.dtype(np.int8): _client.destagger_int8,
-        np.dtype(np.int16): _client.destagger_int16,
-        np.dtype(np.int32): _client.destagger_int32,
-        np.dtype(np.int64): _client.destagger_int64,
-        np.dtype(np.uint8): _client.destagger_uint8,
-        np.dtype(np.uint16): _client.destagger_uint16,
-        np.dtype(np.uint32): _client.destagger_uint32,
-        np.dtype(np.uint64): _client.destagger_uint64,
-        np.dtype(np.single): _client.destagger_float,
-        np.dtype(np.double): _client.destagger_double,
-    }[field.dtype](field, shifts, inverse)
+class LidarPackets:
+    """Read lidar data of many packets at once as numpy arrays.
+
+    Like ``LidarPacket``, but with an additional leading dimension of size
+    ``len(packets)`` in all returned arrays. Each call parses all packets in
+    native code without holding the GIL.
+    """
+    _pf: _client.PacketFormat
+    _data: np.ndarray
+    capture_timestamp: Optional[np.ndarray]
+
+    def __init__(self,
+                 data: BufferT,
+                 info: SensorInfo,
+                 timestamp: Optional[np.ndarray] = None) -> None:
+        """
+        This will always alias the supplied buffer-like object. Pass in a copy
+        to avoid unintentional aliasing.
+
+        Unlike ``LidarPacket``, the init_id of packets is not checked.
+
+        Args:
+            data: Buffer containing packet payloads, one after the other
+            info: Metadata associated with the sensor packet stream
+            timestamp: Capture timestamps of the packets, in seconds
+
+        Raises:
+            ValueError: If the buffer doesn't contain a whole number of packets
+        """
+        self._pf = _client.PacketFormat.from_info(info)
+
+        size = self._pf.lidar_packet_size
+        buf = np.frombuffer(data, dtype=np.uint8)
+        if buf.size % size != 0:
+            raise ValueError(
+                f"Expected a buffer of N packets of size {size}")
+        self._data = buf.reshape(-1, size)
+        self.capture_timestamp = timestamp
+
+    def __len__(self) -> int:
+        return self._data.shape[0]
+
+    @property
+    def fields(self) -> Iterator[ChanField]:
+        """Get available fields of LidarScan as Iterator."""
+        return self._pf.fields
+
+    def field(self, field: ChanField) -> np.ndarray:
+        """Parse the specified channel field of all packets.
+
+        Args:
+            field: The channel field to parse
+
+        Returns:
+            An array of shape (N, pixels_per_column, columns_per_packet)
+            containing a copy of the field values
+        """
+        res = self._pf.packet_fields(field, self._data)
+        res.flags.writeable = False
+        return res
+
+    def header(self, header: ColHeader) -> np.ndarray:
+        """Parse the specified column header of all packets.
+
+        Args:
+            header: The column header to parse
+
+        Returns:
+            An array of shape (N, columns_per_packet) containing a copy of the
+            header values
+        """
+        res = self._pf.packet_headers(header, self._data)
+        res.flags.writeable = False
+        return res
+
+    @property
+    def timestamp(self) -> np.ndarray:
+        """Measurement block timestamps, of shape (N, columns_per_packet)."""
+        return self.header(ColHeader.TIMESTAMP)
+
+    @property
+    def measurement_id(self) -> np.ndarray:
+        """Measurement block ids, of shape (N, columns_per_packet)."""
+        return self.header(ColHeader.MEASUREMENT_ID)
+
+    @property
+    def status(self) -> np.ndarray:
+        """Measurement block statuses, of shape (N, columns_per_packet)."""
+        return self.header(ColHeader.STATUS)
 
 
 def destagger(info: SensorInfo,
@@ -284,56 +359,52 @@ def destagger(info: SensorInfo,
     Returns:
         A destaggered numpy array of the same shape
     """
-    h = info.format.pixels_per_column
-    w = info.format.columns_per_frame
-    shifts = info.format.pixel_shift_by_row
-
-    # remember original shape
-    shape = fields.shape
-    fields = fields.reshape((h, w, -1))
-
-    # apply destagger to each channel
-    # note: astype() needed due to some strange behavior of the pybind11
-    # bindings. The wrong overload is chosen otherwise (due to the indexing?)
-    return np.dstack([
-        _destagger(fields[:, :, i], shifts, inverse)
-        for i in range(fields.shape[2])
-    ]).reshape(shape)
-
-
-def XYZLut(
-        info: SensorInfo
-) -> Callable[[Union[LidarScan, np.ndarray]], np.ndarray]:
+    # all channels of a pixel are moved together
+    fields = np.ascontiguousarray(fields)
+    out = np.empty_like(fields)
+    return _client.Destaggerer(info, inverse)(fields, out)
+
+
+def XYZLut(info: SensorInfo,
+           destaggered: bool = False) -> Callable[..., np.ndarray]:
     """Return a function that can project scans into Cartesian coordinates.
 
     If called with a numpy array representing a range image, the range image
     must be in "staggered" form, where each column corresponds to a single
-    measurement block. LidarScan fields are always staggered.
+    measurement block, unless ``destaggered`` is set. LidarScan fields are
+    staggered unless batched with ``destagger=True``.
 
     Internally, this will pre-compute a lookup table using the supplied
     intrinsic parameters. XYZ points are returned as a H x W x 3 array of
     doubles, where H is the number of beams and W is the horizontal resolution
     of the scan.
 
+    To avoid allocating a new array for every scan, a preallocated, writeable
+    and C-contiguous float32 or float64 array of H x W x 3 elements can be
+    passed as ``out``. The points are written to it and it is returned as is.
+
     The coordinates are reported in meters in the *sensor frame* as
     defined in the sensor documentation.
 
     Args:
         info: sensor metadata
+        destaggered: project destaggered range images and scans
 
     Returns:
         A function that computes a point cloud given a range image
     """
-    lut = _client.XYZLut(info)
+    lut = _client.XYZLut(info, destaggered)
 
-    def res(ls: Union[LidarScan, np.ndarray]) -> np.ndarray:
-        if isinstance(ls, LidarScan):
-            xyz = lut(ls)
-        else:
+    def res(ls: Union[LidarScan, np.ndarray],
+            out: Optional[np.ndarray] = None) -> np.ndarray:
+        if not isinstance(ls, LidarScan):
             # will create a temporary to cast if dtype != uint32
-            xyz = lut(ls.astype(np.uint32, copy=False))
+            ls = ls.astype(np.uint32, copy=False)
+
+        if out is not None:
+            return lut(ls, out)
 
-        return xyz.reshape(info.format.pixels_per_column,
-                           info.format.columns_per_frame, 3)
+        return lut(ls).reshape(info.format.pixels_per_column,
+                               info.format.columns_per_frame, 3)
 
     return res
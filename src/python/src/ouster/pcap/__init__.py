@@ -6,8 +6,12 @@ Pcap tools to record/read/write Ouster sensor data."""
 # flake8: noqa: F401 (unused imports)
 
 from .pcap import Pcap
+from .pcap import ParallelScans
+from .pcap import MultiScans
 from .pcap import record
+from .pcap import to_arrow
 from .pcap import _guess_ports
 from .pcap import _packet_info_stream
 from .pcap import _replay
 from .pcap import _stream_info
+from .pcap import _udp_streams
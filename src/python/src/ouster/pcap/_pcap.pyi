@@ -5,6 +5,11 @@ All rights reserved.
 Type annotations for pcap python bindings.
 """
 
+from typing import List, Optional, Tuple
+
+from numpy import ndarray
+
+from ..client._client import LidarScan, PacketFormat, SensorInfo
 from ..client.data import BufferT
 
 
@@ -81,6 +86,145 @@ def replay_reset(handle: playback_handle) -> None:
     ...
 
 
+def read_lidar_packets(handle: playback_handle,
+                       info: SensorInfo,
+                       lidar_port: int,
+                       max_packets: int = ...) -> Tuple[ndarray, ndarray]:
+    ...
+
+
+class pcap_stream:
+    def __len__(self) -> int:
+        ...
+
+    @property
+    def src_addr(self) -> bytes:
+        ...
+
+    def frame_timestamp(self, frame: int) -> float:
+        ...
+
+
+class pcap_index:
+    @property
+    def file_size(self) -> int:
+        ...
+
+    @property
+    def lidar_port(self) -> int:
+        ...
+
+    @property
+    def streams(self) -> List[pcap_stream]:
+        ...
+
+
+def get_index(file_name: str, lidar_port: int, pf: PacketFormat) -> pcap_index:
+    ...
+
+
+class udp_stream_stats:
+    @property
+    def dst_ip(self) -> str:
+        ...
+
+    @property
+    def src_ip(self) -> str:
+        ...
+
+    @property
+    def dst_port(self) -> int:
+        ...
+
+    @property
+    def src_port(self) -> int:
+        ...
+
+    @property
+    def ip_version(self) -> int:
+        ...
+
+    @property
+    def count(self) -> int:
+        ...
+
+    @property
+    def payload_sizes(self) -> List[int]:
+        ...
+
+    @property
+    def fragments_in_packet(self) -> List[int]:
+        ...
+
+
+def get_stream_stats(file_name: str,
+                     max_packets: int = ...) -> List[udp_stream_stats]:
+    ...
+
+
+def replay_seek(handle: playback_handle, stream: pcap_stream,
+                frame: int) -> bool:
+    ...
+
+
+def replay_seek_time(handle: playback_handle, stream: pcap_stream,
+                     timestamp: float) -> bool:
+    ...
+
+
+class PcapScanReader:
+    def __init__(self,
+                 file_name: str,
+                 info: SensorInfo,
+                 prototype: LidarScan,
+                 n_workers: int = ...,
+                 chunk_frames: int = ...,
+                 complete: bool = ...,
+                 lidar_port: int = ...) -> None:
+        ...
+
+    def next(self) -> Optional[LidarScan]:
+        ...
+
+    @property
+    def frame_count(self) -> int:
+        ...
+
+
+def to_arrow(file_name: str,
+             info: SensorInfo,
+             arrow_file: str,
+             prototype: LidarScan,
+             xyz: bool = ...,
+             batch_frames: int = ...,
+             n_threads: int = ...,
+             n_workers: int = ...,
+             chunk_frames: int = ...,
+             complete: bool = ...,
+             lidar_port: int = ...) -> int:
+    ...
+
+
+class PcapDemux:
+    def __init__(self,
+                 file_name: str,
+                 infos: List[SensorInfo],
+                 prototypes: List[LidarScan],
+                 complete: bool = ...,
+                 lidar_ports: List[int] = ...) -> None:
+        ...
+
+    def next(self) -> Optional[Tuple[int, LidarScan]]:
+        ...
+
+    def reset(self) -> None:
+        ...
+
+    @property
+    def streams(self) -> List[Tuple[int, bytes, int]]:
+        ...
+
+
 def record_initialize(file_name: str,
                       src_ip: str,
                       dst_ip: str,
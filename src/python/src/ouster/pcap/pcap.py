@@ -3,17 +3,19 @@ Copyright (c) 2021, Ouster, Inc.
 All rights reserved.
 """
 from collections import defaultdict
+from contextlib import closing
 from copy import copy
 from dataclasses import dataclass, field
-from itertools import islice
 import os
 import socket
 import time
 from threading import Lock
-from typing import (Dict, Iterable, Iterator, List, Optional, Set, Tuple)
+from typing import (Dict, Iterable, Iterator, List, Optional, Set, Tuple,
+                    Union)
 
-from ouster.client import (LidarPacket, ImuPacket, Packet, PacketSource,
-                           SensorInfo, _client)
+from ouster.client import (ChanField, FieldDType, LidarPacket, LidarPackets,
+                           LidarScan, ImuPacket, Packet, PacketSource,
+                           SensorInfo, UDPProfileLidar, _client)
 from . import _pcap
 
 
@@ -114,6 +116,21 @@ def _guess_ports(udp_streams: Dict[_UDPStreamKey, _UDPStreamInfo],
     return guesses
 
 
+def _udp_streams(path: str,
+                 n_packets: int = 0) -> Dict[_UDPStreamKey, _UDPStreamInfo]:
+    """Get info about the UDP streams of a pcap in native code.
+
+    Uses the info about the whole file saved with its frame index, if any.
+    Otherwise reads up to ``n_packets`` packets, or the whole file if zero.
+    """
+    return {
+        _UDPStreamKey(s.src_ip, s.dst_ip, s.src_port, s.dst_port):
+        _UDPStreamInfo(s.count, set(s.payload_sizes),
+                       set(s.fragments_in_packet), {s.ip_version})
+        for s in _pcap.get_stream_stats(path, n_packets)
+    }
+
+
 def _packet_info_stream(path: str) -> Iterator[_pcap.packet_info]:
     """Read just packet headers without payloads."""
     handle = _pcap.replay_initialize(path)
@@ -133,7 +150,10 @@ class Pcap(PacketSource):
 
     _metadata: SensorInfo
     _rate: float
+    _pcap_path: str
     _handle: Optional[_pcap.playback_handle]
+    _index: Optional[_pcap.pcap_index]
+    _seeks: int
     _lock: Lock
 
     def __init__(self,
@@ -181,8 +201,8 @@ class Pcap(PacketSource):
 
         # sample pcap and attempt to find UDP ports consistent with metadata
         n_packets = 1000
-        stats = _stream_info(islice(_packet_info_stream(pcap_path), n_packets))
-        self._guesses = _guess_ports(stats.udp_streams, self._metadata)
+        self._guesses = _guess_ports(_udp_streams(pcap_path, n_packets),
+                                     self._metadata)
 
         # fill in unspecified (0) ports with inferred values
         if len(self._guesses) > 0:
@@ -192,7 +212,10 @@ class Pcap(PacketSource):
             self._metadata.udp_port_imu = imu_guess or imu_port
 
         self._rate = rate
+        self._pcap_path = pcap_path
         self._handle = _pcap.replay_initialize(pcap_path)
+        self._index = None
+        self._seeks = 0
         self._lock = Lock()
 
     def __iter__(self) -> Iterator[Packet]:
@@ -205,6 +228,7 @@ class Pcap(PacketSource):
 
         real_start_ts = time.monotonic()
         pcap_start_ts = None
+        seeks = self._seeks
         while True:
             with self._lock:
                 if not (self._handle
@@ -212,6 +236,12 @@ class Pcap(PacketSource):
                     break
                 n = _pcap.read_packet(self._handle, buf)
 
+                # restart real time playback after seeking
+                if seeks != self._seeks:
+                    seeks = self._seeks
+                    real_start_ts = time.monotonic()
+                    pcap_start_ts = None
+
             # if rate is set, read in 'real time' simulating UDP stream
             # TODO: factor out into separate packet iterator utility
             timestamp = packet_info.timestamp
@@ -232,6 +262,29 @@ class Pcap(PacketSource):
                 # TODO: bad packet size or init_id here, use specific exceptions
                 pass
 
+    def lidar_packets(self, max_packets: Optional[int] = None) -> LidarPackets:
+        """Read lidar packets in bulk. Thread-safe.
+
+        Continues from the current position, like iterating, but reads all
+        packets into one contiguous array in native code. Imu packets are
+        skipped and the playback rate is ignored.
+
+        Args:
+            max_packets: Stop after this many lidar packets, if positive
+
+        Returns:
+            The packets read, which may be fewer than requested at the end of
+            the file.
+        """
+        with self._lock:
+            if self._handle is None:
+                raise ValueError("I/O operation on closed packet source")
+            data, timestamps = _pcap.read_lidar_packets(
+                self._handle, self._metadata, self._metadata.udp_port_lidar,
+                max_packets or 0)
+
+        return LidarPackets(data, self._metadata, timestamps)
+
     @property
     def metadata(self) -> SensorInfo:
         return self._metadata
@@ -250,6 +303,48 @@ class Pcap(PacketSource):
             if self._handle is not None:
                 _pcap.replay_reset(self._handle)
 
+    def seek(self,
+             frame: int = 0,
+             *,
+             timestamp: Optional[float] = None) -> bool:
+        """Continue playback from the start of a lidar frame. Thread-safe.
+
+        Uses an index of frame offsets, built by reading the whole file on first
+        use and saved next to it as ``<pcap_path>.idx`` so that later seeks,
+        including from other instances, don't need to read the file.
+
+        If several sensors send lidar data to the same port, frames of the
+        sensor with the most frames are used.
+
+        Args:
+            frame: Position of the frame in the file, starting from zero
+            timestamp: Seek to the first frame captured at or after this time
+                instead, in seconds since the epoch
+
+        Returns:
+            False if there is no such frame, leaving the position unchanged.
+        """
+        with self._lock:
+            if self._handle is None:
+                raise ValueError("I/O operation on closed packet source")
+
+            if self._index is None:
+                pf = _client.PacketFormat.from_info(self._metadata)
+                self._index = _pcap.get_index(self._pcap_path,
+                                              self._metadata.udp_port_lidar,
+                                              pf)
+            if not self._index.streams:
+                return False
+            stream = max(self._index.streams, key=len)
+
+            if timestamp is not None:
+                found = _pcap.replay_seek_time(self._handle, stream, timestamp)
+            else:
+                found = _pcap.replay_seek(self._handle, stream, frame)
+            if found:
+                self._seeks += 1
+            return found
+
     @property
     def closed(self) -> bool:
         """Check if source is closed. Thread-safe."""
@@ -264,6 +359,223 @@ class Pcap(PacketSource):
                 self._handle = None
 
 
+class ParallelScans:
+    """An iterable stream of scans decoded from a pcap file on several threads.
+
+    Produces the same scans as ``client.Scans`` over a ``Pcap``, in the same
+    order, but batches packets on worker threads in native code. Workers seek
+    to chunks of consecutive frames using the frame index of the file (see
+    ``Pcap.seek``), which is built by reading the whole file on first use.
+
+    If several sensors send lidar data to the same port, only scans of the
+    sensor with the most frames are returned.
+    """
+
+    def __init__(self,
+                 pcap_path: str,
+                 info: SensorInfo,
+                 *,
+                 workers: int = 0,
+                 complete: bool = False,
+                 fields: Optional[Dict[ChanField, FieldDType]] = None,
+                 lidar_port: Optional[int] = None,
+                 chunk_frames: int = 4) -> None:
+        """
+        Args:
+            pcap_path: File path of recorded pcap
+            info: Sensor metadata
+            workers: number of worker threads, or 0 for one per cpu
+            complete: if True, only return full scans
+            fields: specify which channel fields to populate on LidarScans
+            lidar_port: Specify the destination port of lidar packets
+            chunk_frames: number of frames decoded by a worker at a time
+        """
+        # use the same port inference as Pcap
+        with closing(Pcap(pcap_path, info, lidar_port=lidar_port)) as source:
+            self._metadata = source.metadata
+
+        self._pcap_path = pcap_path
+        self._workers = workers
+        self._complete = complete
+        self._chunk_frames = chunk_frames
+        self._fields: Union[Dict[ChanField, FieldDType], UDPProfileLidar] = (
+            fields if fields is not None else
+            self._metadata.format.udp_profile_lidar)
+
+    def __iter__(self) -> Iterator[LidarScan]:
+        """Get an iterator."""
+        w = self._metadata.format.columns_per_frame
+        h = self._metadata.format.pixels_per_column
+
+        reader = _pcap.PcapScanReader(self._pcap_path,
+                                      self._metadata,
+                                      LidarScan(h, w, self._fields),
+                                      n_workers=self._workers,
+                                      chunk_frames=self._chunk_frames,
+                                      complete=self._complete,
+                                      lidar_port=self._metadata.udp_port_lidar)
+        while True:
+            scan = reader.next()
+            if scan is None:
+                return
+            yield scan
+
+    @property
+    def metadata(self) -> SensorInfo:
+        """Return the metadata of the scans, with the inferred ports."""
+        return self._metadata
+
+
+def to_arrow(pcap_path: str,
+             info: SensorInfo,
+             arrow_path: str,
+             *,
+             fields: Optional[Dict[ChanField, FieldDType]] = None,
+             xyz: bool = False,
+             workers: int = 0,
+             threads: int = 1,
+             batch_frames: int = 8,
+             complete: bool = False,
+             lidar_port: Optional[int] = None,
+             chunk_frames: int = 4) -> int:
+    """Export the scans of a pcap file to an Arrow (Feather V2) file.
+
+    Scans are decoded on worker threads as by ``ParallelScans`` and written in
+    native code without passing through Python. Each row of the table is a
+    scan, with the column headers and each field plane as fixed size lists,
+    and the points of the RANGE field in an interleaved ``xyz`` column if
+    requested. Read the file with ``pyarrow.feather.read_table`` or
+    ``pandas.read_feather``; the sensor metadata is stored in the schema
+    metadata under ``ouster:sensor_info``.
+
+    Args:
+        pcap_path: File path of recorded pcap
+        info: Sensor metadata
+        arrow_path: File path of the Arrow file to create
+        fields: channel fields to decode and write, or the default fields of
+            the lidar profile
+        xyz: if True, add a column of Cartesian points
+        workers: number of decoding threads, or 0 for one per cpu
+        threads: number of threads projecting points
+        batch_frames: number of scans per record batch
+        complete: if True, only write full scans
+        lidar_port: Specify the destination port of lidar packets
+        chunk_frames: number of frames decoded by a worker at a time
+
+    Returns:
+        The number of scans written.
+    """
+    # use the same port inference as Pcap
+    with closing(Pcap(pcap_path, info, lidar_port=lidar_port)) as source:
+        metadata = source.metadata
+
+    w = metadata.format.columns_per_frame
+    h = metadata.format.pixels_per_column
+    prototype = LidarScan(
+        h, w,
+        fields if fields is not None else metadata.format.udp_profile_lidar)
+    return _pcap.to_arrow(pcap_path,
+                          metadata,
+                          arrow_path,
+                          prototype,
+                          xyz=xyz,
+                          batch_frames=batch_frames,
+                          n_threads=threads,
+                          n_workers=workers,
+                          chunk_frames=chunk_frames,
+                          complete=complete,
+                          lidar_port=metadata.udp_port_lidar)
+
+
+class MultiScans:
+    """An iterable stream of scans of several sensors in a pcap file.
+
+    Reads the file once, routing lidar packets by source address and
+    destination port to a batcher per stream in native code. Yields tuples of
+    the position of the sensor in ``infos`` and a scan, in file order.
+
+    Sensors sending to the same port from different addresses are batched
+    separately, but their scans are reported for the same sensor. Packets on a
+    port shared by several sensors go to the first sensor with a matching
+    packet size and init_id.
+    """
+
+    def __init__(self,
+                 pcap_path: str,
+                 infos: List[SensorInfo],
+                 *,
+                 complete: bool = False,
+                 fields: Optional[List[Dict[ChanField, FieldDType]]] = None,
+                 lidar_ports: Optional[List[int]] = None) -> None:
+        """
+        Args:
+            pcap_path: File path of recorded pcap
+            infos: Metadata of each sensor
+            complete: if True, only return full scans
+            fields: specify which channel fields to populate on LidarScans of
+                each sensor
+            lidar_ports: Specify the destination port of lidar packets of each
+                sensor
+
+        Raises:
+            ValueError: If fields or lidar_ports don't have an entry for each
+                sensor
+        """
+        if lidar_ports is not None and len(lidar_ports) != len(infos):
+            raise ValueError("Expected a lidar port for each sensor")
+        if fields is not None and len(fields) != len(infos):
+            raise ValueError("Expected fields for each sensor")
+
+        # infer missing ports like Pcap, one sensor per port pair
+        streams = _udp_streams(pcap_path, 1000)
+        used: Set[int] = set()
+        self._metadata = []
+        for i, info in enumerate(infos):
+            meta = copy(info)
+            if lidar_ports is not None:
+                meta.udp_port_lidar = lidar_ports[i]
+            if meta.udp_port_lidar == 0:
+                guesses = [g for g in _guess_ports(streams, meta)
+                           if g[0] not in used]
+                if guesses:
+                    meta.udp_port_lidar, imu_guess = guesses[0]
+                    meta.udp_port_imu = meta.udp_port_imu or imu_guess
+            used.add(meta.udp_port_lidar)
+            self._metadata.append(meta)
+
+        self._pcap_path = pcap_path
+        self._complete = complete
+        self._fields: List[Union[Dict[ChanField, FieldDType],
+                                 UDPProfileLidar]] = (
+            list(fields) if fields is not None else
+            [m.format.udp_profile_lidar for m in self._metadata])
+
+    def __iter__(self) -> Iterator[Tuple[int, LidarScan]]:
+        """Get an iterator."""
+        prototypes = [
+            LidarScan(m.format.pixels_per_column, m.format.columns_per_frame,
+                      f) for m, f in zip(self._metadata, self._fields)
+        ]
+        demux = _pcap.PcapDemux(self._pcap_path,
+                                self._metadata,
+                                prototypes,
+                                complete=self._complete,
+                                lidar_ports=[
+                                    m.udp_port_lidar for m in self._metadata
+                                ])
+        while True:
+            res = demux.next()
+            if res is None:
+                return
+            stream, scan = res
+            yield demux.streams[stream][0], scan
+
+    @property
+    def metadata(self) -> List[SensorInfo]:
+        """Return the metadata of each sensor, with the inferred ports."""
+        return self._metadata
+
+
 def _replay(pcap_path: str, info: SensorInfo, dst_ip: str, dst_lidar_port: int,
             dst_imu_port: int) -> Iterator[bool]:
     """Replay UDP packets out over the network.
@@ -0,0 +1,9 @@
+"""
+Copyright (c) 2022, Ouster, Inc.
+All rights reserved.
+
+Read and write lidar scans in a compact native file format."""
+# flake8: noqa: F401 (unused imports)
+
+from .scan_file import ScanFile
+from .scan_file import record
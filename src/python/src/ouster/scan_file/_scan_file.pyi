@@ -0,0 +1,112 @@
+"""
+Copyright (c) 2022, Ouster, Inc.
+All rights reserved.
+
+Type annotations for scan file python bindings.
+"""
+
+from typing import Dict, List, Optional
+
+import numpy as np
+
+from ..client._client import ChanField, LidarScan, SensorInfo
+
+
+class ScanFileWriter:
+    def __init__(self,
+                 file_name: str,
+                 info: SensorInfo,
+                 prototype: Optional[LidarScan] = ...,
+                 chunk_frames: int = ...,
+                 compression_level: int = ...) -> None:
+        ...
+
+    def write(self, scan: LidarScan) -> None:
+        ...
+
+    def close(self) -> None:
+        ...
+
+    @property
+    def frame_count(self) -> int:
+        ...
+
+
+class ScanView:
+    @property
+    def w(self) -> int:
+        ...
+
+    @property
+    def h(self) -> int:
+        ...
+
+    @property
+    def frame_id(self) -> int:
+        ...
+
+    @property
+    def timestamp(self) -> np.ndarray:
+        ...
+
+    @property
+    def measurement_id(self) -> np.ndarray:
+        ...
+
+    @property
+    def status(self) -> np.ndarray:
+        ...
+
+    @property
+    def rx_timestamp(self) -> np.ndarray:
+        ...
+
+    @property
+    def fields(self) -> List[ChanField]:
+        ...
+
+    def field(self, field: ChanField) -> np.ndarray:
+        ...
+
+
+class ScanFileReader:
+    def __init__(self, file_name: str) -> None:
+        ...
+
+    @property
+    def info(self) -> SensorInfo:
+        ...
+
+    @property
+    def metadata(self) -> str:
+        ...
+
+    @property
+    def w(self) -> int:
+        ...
+
+    @property
+    def h(self) -> int:
+        ...
+
+    @property
+    def fields(self) -> Dict[ChanField, np.dtype]:
+        ...
+
+    def __len__(self) -> int:
+        ...
+
+    def frame_id(self, frame: int) -> int:
+        ...
+
+    def frame_timestamp(self, frame: int) -> int:
+        ...
+
+    def find_frame(self, timestamp: int) -> int:
+        ...
+
+    def view(self, frame: int) -> ScanView:
+        ...
+
+    def read(self, frame: int) -> LidarScan:
+        ...
@@ -0,0 +1,122 @@
+"""
+Copyright (c) 2022, Ouster, Inc.
+All rights reserved.
+"""
+from itertools import chain
+from typing import Dict, Iterable, Iterator, Optional
+
+import numpy as np
+
+from ouster.client import ChanField, LidarScan, SensorInfo
+from . import _scan_file
+
+
+class ScanFile:
+    """Read the scans stored in a scan file.
+
+    Unlike pcaps, scan files store the fields of each scan rather than packets,
+    so scans are read without any batching. Compressed chunks of frames are
+    decompressed on access and cached, so reading in order is the fastest.
+    """
+
+    _reader: _scan_file.ScanFileReader
+
+    def __init__(self, path: str) -> None:
+        """
+        Args:
+            path: File path of the scan file
+
+        Raises:
+            RuntimeError: if the file can't be read or isn't a scan file
+        """
+        self._reader = _scan_file.ScanFileReader(path)
+
+    @property
+    def metadata(self) -> SensorInfo:
+        """The sensor metadata embedded in the file."""
+        return self._reader.info
+
+    @property
+    def fields(self) -> Dict[ChanField, np.dtype]:
+        """The fields of stored scans and their types."""
+        return self._reader.fields
+
+    def __len__(self) -> int:
+        return len(self._reader)
+
+    def __getitem__(self, frame: int) -> LidarScan:
+        """Decode a scan, given its index in the file."""
+        if frame < 0:
+            frame += len(self)
+        if not 0 <= frame < len(self):
+            raise IndexError("Scan file frame out of range")
+        return self._reader.read(frame)
+
+    def __iter__(self) -> Iterator[LidarScan]:
+        for i in range(len(self)):
+            yield self._reader.read(i)
+
+    def view(self, frame: int) -> _scan_file.ScanView:
+        """Get a stored scan without copying its fields.
+
+        The arrays of the view are read-only and stay valid while any of them
+        is referenced.
+        """
+        return self._reader.view(frame)
+
+    def timestamp(self, frame: int) -> int:
+        """Get the first non-zero column timestamp of a scan in nanoseconds."""
+        return self._reader.frame_timestamp(frame)
+
+    def find(self, timestamp: int) -> Optional[int]:
+        """Get the index of the first scan at or after a timestamp.
+
+        Args:
+            timestamp: time in nanoseconds, as in the scan timestamps
+
+        Returns:
+            The index of the scan, or None if all scans are earlier
+        """
+        frame = self._reader.find_frame(timestamp)
+        return frame if frame < len(self) else None
+
+
+def record(scans: Iterable[LidarScan],
+           path: str,
+           info: SensorInfo,
+           *,
+           chunk_frames: int = 8,
+           compression_level: int = 1) -> int:
+    """Write a sequence of scans to a scan file.
+
+    All scans must have the dimensions and fields of the first one.
+
+    Args:
+        scans: A (finite!) sequence of scans
+        path: Path of the output file
+        info: Sensor metadata to embed in the file
+        chunk_frames: Number of scans compressed together
+        compression_level: zlib level from 1 to 9, or 0 to store scans
+            uncompressed
+
+    Returns:
+        Number of scans written
+    """
+    it = iter(scans)
+    first = next(it, None)
+    if first is None:
+        writer = _scan_file.ScanFileWriter(path, info,
+                                           chunk_frames=chunk_frames,
+                                           compression_level=compression_level)
+    else:
+        writer = _scan_file.ScanFileWriter(path, info, first,
+                                           chunk_frames=chunk_frames,
+                                           compression_level=compression_level)
+        it = chain([first], it)
+
+    try:
+        for scan in it:
+            writer.write(scan)
+    finally:
+        writer.close()
+    return writer.frame_count
@@ -5,7 +5,7 @@ All rights reserved.
 Type annotations for viz python bindings.
 """
 
-from typing import Callable, overload, Tuple
+from typing import Callable, List, overload, Tuple
 
 import numpy as np
 
@@ -94,6 +94,9 @@ class Cloud:
     def set_key(self, key: np.ndarray) -> None:
         ...
 
+    def set_key_field(self, field: np.ndarray) -> None:
+        ...
+
     def set_mask(self, mask: np.ndarray) -> None:
         ...
 
@@ -109,6 +112,31 @@ class Cloud:
     def set_palette(self, palette: np.ndarray) -> None:
         ...
 
+    def set_lod(self,
+                block_cols: int,
+                full_detail_range: float = ...,
+                max_points: int = ...) -> None:
+        ...
+
+
+class AccumulatedCloud:
+
+    def __init__(self, si: SensorInfo, n_scans: int) -> None:
+        ...
+
+    def add_scan(self, range: np.ndarray, key: np.ndarray,
+                 pose: np.ndarray) -> None:
+        ...
+
+    def reset(self) -> None:
+        ...
+
+    def set_point_size(self, size: float) -> None:
+        ...
+
+    def set_palette(self, palette: np.ndarray) -> None:
+        ...
+
 
 class Image:
 
@@ -118,6 +146,15 @@ class Image:
     def set_image(self, image: np.ndarray) -> None:
         ...
 
+    def set_field(self, field: np.ndarray) -> None:
+        ...
+
+    def set_pixel_shift(self, pixel_shift_by_row: List[int]) -> None:
+        ...
+
+    def set_palette(self, palette: np.ndarray) -> None:
+        ...
+
     def set_mask(self, image: np.ndarray) -> None:
         ...
 
@@ -182,7 +219,8 @@ class PointViz:
                  name: str,
                  fix_aspect: bool = ...,
                  window_width: int = ...,
-                 window_height: int = ...) -> None:
+                 window_height: int = ...,
+                 headless: bool = ...) -> None:
         ...
 
     def run(self) -> None:
@@ -206,6 +244,12 @@ class PointViz:
                                            bool]) -> None:
         ...
 
+    def push_frame_handler(self, f: Callable[[np.ndarray], bool]) -> None:
+        ...
+
+    def pop_frame_handler(self) -> None:
+        ...
+
     @property
     def camera(self) -> Camera:
         ...
@@ -218,6 +262,10 @@ class PointViz:
     def add(self, cloud: Cloud) -> None:
         ...
 
+    @overload
+    def add(self, cloud: AccumulatedCloud) -> None:
+        ...
+
     @overload
     def add(self, image: Image) -> None:
         ...
@@ -234,6 +282,10 @@ class PointViz:
     def remove(self, cloud: Cloud) -> bool:
         ...
 
+    @overload
+    def remove(self, cloud: AccumulatedCloud) -> bool:
+        ...
+
     @overload
     def remove(self, image: Image) -> bool:
         ...
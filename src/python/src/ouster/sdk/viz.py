@@ -20,9 +20,9 @@ import numpy as np
 from .. import client
 from ..client import (_utils, ChanField)
 from ..client._client import Version
-from ._viz import (PointViz, Cloud, Image, Cuboid, Label, WindowCtx, Camera,
-                   TargetDisplay, add_default_controls, calref_palette,
-                   spezia_palette)
+from ._viz import (PointViz, Cloud, AccumulatedCloud, Image, Cuboid, Label,
+                   WindowCtx, Camera, TargetDisplay, add_default_controls,
+                   calref_palette, spezia_palette)
 
 T = TypeVar('T')
 
@@ -625,6 +625,7 @@ class SimpleViz:
 
 
 __all__ = [
-    'PointViz', 'Cloud', 'Image', 'Cuboid', 'Label', 'WindowCtx', 'Camera',
-    'TargetDisplay', 'add_default_controls', 'calref_palette', 'spezia_palette'
+    'PointViz', 'Cloud', 'AccumulatedCloud', 'Image', 'Cuboid', 'Label',
+    'WindowCtx', 'Camera', 'TargetDisplay', 'add_default_controls',
+    'calref_palette', 'spezia_palette'
 ]
@@ -5,6 +5,7 @@ All rights reserved.
 
 from contextlib import closing
 import socket
+import time
 
 import numpy as np
 import pytest
@@ -195,6 +196,60 @@ def test_scans_complete(packets: client.PacketSource) -> None:
         next(scans)
 
 
+@pytest.mark.parametrize('test_key', ['legacy-2.0'])
+def test_scans_summary(packets: client.PacketSource) -> None:
+    """Test that batched scans are summarized until modified."""
+    scan = next(iter(client.Scans(packets)))
+    summary = scan.summary
+    assert summary.valid
+    assert summary.window == packets.metadata.format.column_window
+
+    valid = (scan.status & 0x01).astype(bool)
+    assert summary.cols_received == np.count_nonzero(valid)
+    assert summary.cols_missing == scan.w - summary.cols_received
+    assert summary.first_timestamp == scan.timestamp[valid].min()
+    assert summary.last_timestamp == scan.timestamp[valid].max()
+    zero_range = scan.field(client.ChanField.RANGE)[:, valid] == 0
+    assert summary.zero_range == np.count_nonzero(zero_range)
+    assert not scan.summary.valid
+
+
+@pytest.mark.parametrize('test_key', ['legacy-2.0'])
+def test_scans_sensor(packets: client.PacketSource) -> None:
+    """Check that scans batched natively from a sensor match Python batching."""
+    expected = next(iter(client.Scans(packets)))
+    lidar_packets = [
+        p._data for p in packets if isinstance(p, client.LidarPacket)
+    ]
+
+    # a packet from the next frame to end the scan
+    pf = client.PacketFormat.from_info(packets.metadata)
+    col_size = pf.lidar_packet_size // pf.columns_per_packet
+    end = lidar_packets[0].copy()
+    for col in range(pf.columns_per_packet):
+        frame_id = end[col * col_size + 10:col * col_size + 12].view(np.uint16)
+        frame_id += 1
+
+    with closing(
+            client.Sensor("",
+                          0,
+                          0,
+                          metadata=packets.metadata,
+                          buf_size=len(lidar_packets) + 8,
+                          timeout=1.0,
+                          _flush_before_read=False)) as source:
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        for data in lidar_packets + [end]:
+            sock.sendto(data.tobytes(), ("localhost", source._cli.lidar_port))
+            time.sleep(0.001)
+
+        scan = next(iter(client.Scans(source)))
+        assert scan.frame_id == expected.frame_id
+        assert np.array_equal(scan.timestamp, expected.timestamp)
+        assert np.array_equal(scan.field(ChanField.RANGE),
+                              expected.field(ChanField.RANGE))
+
+
 @pytest.mark.parametrize('test_key', ['legacy-2.0'])
 def test_scans_timeout(packets: client.PacketSource) -> None:
     """A zero timeout should deterministically throw.
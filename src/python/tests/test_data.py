@@ -102,6 +102,44 @@ def test_lidar_packet(meta: client.SensorInfo) -> None:
         p.frame_id = 1  # type: ignore
 
 
+def test_lidar_packets(meta: client.SensorInfo) -> None:
+    """Test that batched parsing matches parsing packets one by one."""
+    pf = _client.PacketFormat.from_info(meta)
+    rng = np.random.default_rng(0)
+    data = rng.integers(0, 256, (5, pf.lidar_packet_size), dtype=np.uint8)
+
+    batch = client.LidarPackets(data, meta)
+    assert len(batch) == 5
+
+    for f in batch.fields:
+        fields = batch.field(f)
+        assert fields.shape == (5, pf.pixels_per_column,
+                                pf.columns_per_packet)
+        for i, buf in enumerate(data):
+            assert np.array_equal(fields[i], pf.packet_field(f, buf))
+
+    for h in client.ColHeader:
+        headers = batch.header(h)
+        assert headers.shape == (5, pf.columns_per_packet)
+        for i, buf in enumerate(data):
+            assert np.array_equal(headers[i], pf.packet_header(h, buf))
+
+    # should not be able to modify parsed data
+    with pytest.raises(ValueError):
+        batch.field(client.ChanField.RANGE)[0] = 1
+
+    assert len(client.LidarPackets(bytes(), meta)) == 0
+
+    with pytest.raises(ValueError):
+        client.LidarPackets(bytes(pf.lidar_packet_size + 1), meta)
+
+    # raw packet format entry points require contiguous rows
+    with pytest.raises(ValueError):
+        pf.packet_fields(client.ChanField.RANGE, data[:, :-1])
+    with pytest.raises(ValueError):
+        pf.packet_headers(client.ColHeader.STATUS, data[::2])
+
+
 @pytest.mark.parametrize('test_key', ['legacy-2.0'])
 def test_read_legacy_packet(packet: client.LidarPacket) -> None:
     """Read some arbitrary values from a packet and check header invariants."""
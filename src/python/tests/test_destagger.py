@@ -109,3 +109,22 @@ def test_destagger_correct_multi(meta, scan) -> None:
     assert near_ir_stacked.dtype == np.uint32
     assert destaggered_stacked.dtype == np.uint32
     assert np.array_equal(ref_stacked, destaggered_stacked)
+
+
+@pytest.mark.parametrize('test_key', ['legacy-2.0'])
+def test_destaggerer_scan(meta, scan) -> None:
+    """Check destaggering fields of a scan into another scan."""
+    fields = [client.ChanField.RANGE, client.ChanField.NEAR_IR]
+    dest = client.LidarScan(scan.h, scan.w)
+
+    destaggerer = client.Destaggerer(meta)
+    assert (destaggerer.h, destaggerer.w) == (scan.h, scan.w)
+    destaggerer(scan, fields, dest, n_threads=2)
+
+    for f in fields:
+        assert np.array_equal(dest.field(f),
+                              client.destagger(meta, scan.field(f)))
+
+    # scans missing fields are rejected
+    with pytest.raises(IndexError):
+        destaggerer(scan, [client.ChanField.RANGE2], dest)
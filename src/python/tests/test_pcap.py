@@ -4,12 +4,14 @@ All rights reserved.
 """
 
 from collections import defaultdict
+from contextlib import closing
 from copy import copy
 from os import path
 from random import getrandbits, shuffle, random
 from typing import (Dict, Iterable, Iterator, List)
 from itertools import chain
 
+import numpy as np
 import pytest
 import time
 
@@ -203,6 +205,192 @@ def test_pcap_reset(fake_pcap) -> None:
     assert bufs1 == bufs2
 
 
+@pytest.mark.parametrize('n_packets', [20])
+def test_pcap_lidar_packets(fake_meta, fake_pcap_path) -> None:
+    """Test reading lidar packets in bulk."""
+    with closing(pcap.Pcap(fake_pcap_path, fake_meta)) as source:
+        lidar = [p for p in source if isinstance(p, client.LidarPacket)]
+        source.reset()
+
+        first = source.lidar_packets(3)
+        rest = source.lidar_packets()
+        assert len(first) == 3
+        assert len(rest) == len(lidar) - 3
+        assert len(source.lidar_packets()) == 0
+
+        data = np.concatenate([first._data, rest._data])
+        assert np.array_equal(data, np.stack([p._data for p in lidar]))
+
+        expected_ts = [p.capture_timestamp for p in lidar]
+        ts = np.concatenate([first.capture_timestamp, rest.capture_timestamp])
+        assert np.allclose(ts, expected_ts, rtol=0, atol=1e-6)
+
+        assert np.array_equal(
+            rest.field(client.ChanField.RANGE)[0],
+            lidar[3].field(client.ChanField.RANGE))
+
+
+def test_pcap_seek(fake_meta, tmpdir) -> None:
+    """Test seeking to frames by position and capture time."""
+    in_packets = list(
+        fake_packets(fake_meta, n_lidar=20, n_imu=5, timestamped=True))
+    file_path = path.join(tmpdir, "pcap_test.pcap")
+    pcap.record(in_packets, file_path)
+
+    # a frame starts with each change of the (random) frame id
+    lidar = [p for p in in_packets if isinstance(p, client.LidarPacket)]
+    starts = [
+        p for i, p in enumerate(lidar)
+        if i == 0 or p.frame_id != lidar[i - 1].frame_id
+    ]
+
+    def next_lidar(source: pcap.Pcap) -> client.LidarPacket:
+        return next(p for p in source if isinstance(p, client.LidarPacket))
+
+    source = pcap.Pcap(file_path, fake_meta)
+    for i in [3, 0, len(starts) - 1]:
+        assert source.seek(i)
+        assert bytes(next_lidar(source)._data) == bytes(starts[i]._data)
+
+    assert not source.seek(len(starts))
+
+    assert source.seek(timestamp=starts[2].capture_timestamp)
+    assert bytes(next_lidar(source)._data) == bytes(starts[2]._data)
+
+    # the index is saved and reused by new instances
+    assert path.exists(file_path + ".idx")
+    other = pcap.Pcap(file_path, fake_meta)
+    assert other.seek(1)
+    assert bytes(next_lidar(other)._data) == bytes(starts[1]._data)
+
+
+@pytest.mark.parametrize("workers", [1, 3])
+def test_parallel_scans(fake_meta, tmpdir, workers) -> None:
+    """Check that parallel decoding matches sequential batching."""
+    file_path = path.join(tmpdir, "pcap_test.pcap")
+    pcap.record(
+        fake_packets(fake_meta, n_lidar=30, n_imu=5, timestamped=True),
+        file_path)
+
+    expected = list(client.Scans(pcap.Pcap(file_path, fake_meta)))
+    scans = list(
+        pcap.ParallelScans(file_path,
+                           fake_meta,
+                           workers=workers,
+                           chunk_frames=2))
+
+    # rx timestamps differ by rounding: Scans goes through float seconds
+    assert len(scans) == len(expected)
+    for a, b in zip(scans, expected):
+        assert a.frame_id == b.frame_id
+        assert np.array_equal(a.timestamp, b.timestamp)
+        assert np.array_equal(a.status, b.status)
+        assert list(a.fields) == list(b.fields)
+        for f in a.fields:
+            assert np.array_equal(a.field(f), b.field(f))
+        assert np.allclose(a.rx_timestamp, b.rx_timestamp, rtol=0, atol=1e3)
+
+
+def test_to_arrow(fake_meta, tmpdir) -> None:
+    """Check that exporting writes an Arrow file with a row per scan."""
+    file_path = path.join(tmpdir, "pcap_test.pcap")
+    pcap.record(fake_packets(fake_meta, n_lidar=30, timestamped=True),
+                file_path)
+    n_scans = len(list(client.Scans(pcap.Pcap(file_path, fake_meta))))
+
+    arrow_path = path.join(tmpdir, "pcap_test.arrow")
+    assert pcap.to_arrow(file_path, fake_meta, arrow_path,
+                         batch_frames=2) == n_scans
+    with open(arrow_path, "rb") as f:
+        data = f.read()
+    assert data[:6] == b"ARROW1"
+    assert data[-6:] == b"ARROW1"
+
+
+def test_to_arrow_pyarrow(fake_meta, tmpdir) -> None:
+    """Check exported columns against scans read with pyarrow."""
+    feather = pytest.importorskip("pyarrow.feather")
+    file_path = path.join(tmpdir, "pcap_test.pcap")
+    pcap.record(fake_packets(fake_meta, n_lidar=30, timestamped=True),
+                file_path)
+    expected = list(client.Scans(pcap.Pcap(file_path, fake_meta)))
+
+    arrow_path = path.join(tmpdir, "pcap_test.arrow")
+    fields = {client.ChanField.RANGE: np.uint32}
+    pcap.to_arrow(file_path,
+                  fake_meta,
+                  arrow_path,
+                  fields=fields,
+                  xyz=True,
+                  batch_frames=3,
+                  workers=2,
+                  threads=2)
+
+    table = feather.read_table(arrow_path)
+    assert table.column_names == [
+        "frame_id", "timestamp", "measurement_id", "status", "rx_timestamp",
+        "RANGE", "xyz"
+    ]
+    assert table.num_rows == len(expected)
+    assert b"ouster:sensor_info" in table.schema.metadata
+
+    xyzlut = client.XYZLut(fake_meta)
+    ranges = table.column("RANGE").to_pylist()
+    xyz = table.column("xyz").to_pylist()
+    for i, scan in enumerate(expected):
+        assert table.column("frame_id")[i].as_py() == scan.frame_id
+        assert np.array_equal(
+            np.array(table.column("timestamp")[i].as_py()), scan.timestamp)
+        r = np.array(ranges[i], dtype=np.uint32).reshape(scan.h, scan.w)
+        assert np.array_equal(r, scan.field(client.ChanField.RANGE))
+        points = np.array(xyz[i], dtype=np.float32).reshape(scan.h, scan.w, 3)
+        assert np.allclose(points, xyzlut(scan), atol=1e-3)
+
+
+def test_multi_scans(fake_meta, tmpdir) -> None:
+    """Check that demuxing several sensors matches batching each one."""
+    file_path = path.join(tmpdir, "pcap_test.pcap")
+    meta_b = copy(fake_meta)
+    meta_b.udp_port_lidar = 7504
+    meta_b.udp_port_imu = 7505
+
+    packets_a = list(fake_packets(fake_meta, n_lidar=20, timestamped=True))
+    packets_b = list(fake_packets(meta_b, n_lidar=20, timestamped=True))
+    handle = _pcap.record_initialize(file_path, "127.0.0.1", "127.0.0.1",
+                                     1424)
+    for a, b in zip(packets_a, packets_b):
+        _pcap.record_packet(handle, 7502, 7502, a._data, a.capture_timestamp)
+        _pcap.record_packet(handle, 7504, 7504, b._data, b.capture_timestamp)
+    _pcap.record_uninitialize(handle)
+
+    expected = [
+        list(client.Scans(pcap.Pcap(file_path, fake_meta, lidar_port=7502))),
+        list(client.Scans(pcap.Pcap(file_path, meta_b, lidar_port=7504)))
+    ]
+    multi = pcap.MultiScans(file_path, [fake_meta, meta_b],
+                            lidar_ports=[7502, 7504])
+    scans: List[List[client.LidarScan]] = [[], []]
+    for i, scan in multi:
+        scans[i].append(scan)
+
+    for sensor_scans, sensor_expected in zip(scans, expected):
+        assert len(sensor_scans) == len(sensor_expected)
+        for a, b in zip(sensor_scans, sensor_expected):
+            assert a.frame_id == b.frame_id
+            assert np.array_equal(a.status, b.status)
+            for f in a.fields:
+                assert np.array_equal(a.field(f), b.field(f))
+
+    # info about the streams of the whole file is saved with the index
+    with closing(pcap.Pcap(file_path, fake_meta, lidar_port=7502)) as source:
+        assert source.seek(0)
+    streams = pcap._udp_streams(file_path, 1)
+    assert {k.dst_port: v.count for k, v in streams.items()} == {
+        7502: 20,
+        7504: 20
+    }
+
+
 def test_pcap_read_closed(fake_pcap: pcap.Pcap) -> None:
     """Check that reading from a closed pcap raises an error."""
     fake_pcap.close()
@@ -0,0 +1,79 @@
+"""
+Copyright (c) 2022, Ouster, Inc.
+All rights reserved.
+"""
+
+from os import path
+
+import numpy as np
+import pytest
+
+from ouster import client
+from ouster.client import ChanField
+from ouster.scan_file import ScanFile, record
+
+
+def _assert_scans_equal(a: client.LidarScan, b: client.LidarScan) -> None:
+    assert a.frame_id == b.frame_id
+    assert np.array_equal(a.timestamp, b.timestamp)
+    assert np.array_equal(a.measurement_id, b.measurement_id)
+    assert np.array_equal(a.status, b.status)
+    assert list(a.fields) == list(b.fields)
+    for f in a.fields:
+        assert np.array_equal(a.field(f), b.field(f))
+
+
+@pytest.mark.parametrize("compression_level", [0, 1])
+def test_scan_file_round_trip(scan: client.LidarScan, meta: client.SensorInfo,
+                              tmpdir, compression_level: int) -> None:
+    """Check that scans read back from a scan file are unchanged."""
+    scans = []
+    for i in range(5):
+        ls = client.LidarScan(scan.h, scan.w, meta.format.udp_profile_lidar)
+        for f in scan.fields:
+            ls.field(f)[:] = np.roll(scan.field(f), i, axis=1)
+        ls.timestamp[:] = scan.timestamp + i * 100_000_000
+        ls.frame_id = scan.frame_id + i
+        scans.append(ls)
+
+    file_path = path.join(tmpdir, "scans.bin")
+    n = record(scans,
+               file_path,
+               meta,
+               chunk_frames=2,
+               compression_level=compression_level)
+    assert n == len(scans)
+
+    scan_file = ScanFile(file_path)
+    assert scan_file.metadata.format.udp_profile_lidar == \
+        meta.format.udp_profile_lidar
+    assert list(scan_file.fields) == list(scan.fields)
+    assert len(scan_file) == len(scans)
+
+    for a, b in zip(scan_file, scans):
+        _assert_scans_equal(a, b)
+    _assert_scans_equal(scan_file[-1], scans[-1])
+
+    ts = scan_file.timestamp(3)
+    assert scan_file.find(ts) == 3
+    assert scan_file.find(ts + 1) == 4
+    assert scan_file.find(ts + 10**9) is None
+
+    # views are read-only and outlive the scan file object
+    view = scan_file.view(2)
+    del scan_file
+    rng = view.field(ChanField.RANGE)
+    assert rng.shape == (scan.h, scan.w)
+    assert np.array_equal(rng, scans[2].field(ChanField.RANGE))
+    assert np.array_equal(view.timestamp, scans[2].timestamp)
+    assert not rng.flags.writeable
+    with pytest.raises(KeyError):
+        view.field(ChanField.CUSTOM0)
+
+
+def test_scan_file_record_mismatch(scan: client.LidarScan,
+                                   meta: client.SensorInfo, tmpdir) -> None:
+    """Check that scans with different fields can't be mixed in a file."""
+    other = client.LidarScan(scan.h, scan.w, {ChanField.RANGE: np.uint32})
+    with pytest.raises(ValueError):
+        record([scan, other], path.join(tmpdir, "scans.bin"), meta)
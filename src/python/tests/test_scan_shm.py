@@ -0,0 +1,60 @@
+"""
+Copyright (c) 2022, Ouster, Inc.
+All rights reserved.
+"""
+
+import os
+import sys
+
+import numpy as np
+import pytest
+
+from ouster import client
+
+pytestmark = pytest.mark.skipif(sys.platform == "win32",
+                                reason="shared memory scans need POSIX")
+
+
+@pytest.fixture
+def shm_name(request) -> str:
+    return f"/ouster_test_{os.getpid()}_{request.node.name}"
+
+
+def test_shm_view(shm_name: str, scan: client.LidarScan,
+                  meta: client.SensorInfo) -> None:
+    """Check that subscribers view published scans read-only."""
+    pub = client.ScanShmPublisher(shm_name, meta, scan)
+    sub = client.ScanShmSubscriber(shm_name)
+    assert sub.info.format.columns_per_frame == scan.w
+    assert sub.next(timeout_sec=0.0) is None
+
+    assert pub.publish(scan) == 1
+    view = sub.next()
+    assert view is not None
+    assert sub.seq == 1 and sub.valid()
+    assert view == scan
+    for f in scan.fields:
+        assert np.array_equal(view.field(f), scan.field(f))
+        assert not view.field(f).flags.writeable
+    assert not view.timestamp.flags.writeable
+
+    # copies are reallocated to fit, writeable and outlive the publisher
+    copy = client.LidarScan(0, 0)
+    pub.publish(scan)
+    assert sub.read(copy)
+    assert copy == scan
+    copy.field(client.ChanField.RANGE)[:] = 0
+
+    del pub
+    assert sub.next() is None
+    assert sub.closed
+
+
+def test_shm_mismatch(shm_name: str, scan: client.LidarScan,
+                      meta: client.SensorInfo) -> None:
+    """Check that scans must fit the segment."""
+    pub = client.ScanShmPublisher(shm_name, meta, scan)
+    with pytest.raises(ValueError):
+        pub.publish(client.LidarScan(scan.h, scan.w // 2))
+    with pytest.raises(RuntimeError):
+        client.ScanShmSubscriber(shm_name + "_missing")
@@ -0,0 +1,66 @@
+"""
+Copyright (c) 2022, Ouster, Inc.
+All rights reserved.
+"""
+
+import numpy as np
+import pytest
+
+from ouster import client
+
+
+def test_scan_stream(scan: client.LidarScan, meta: client.SensorInfo) -> None:
+    """Check that streamed scans are decoded with the fields sent."""
+    server = client.ScanStreamServer(meta)
+    stream = client.ScanStream("127.0.0.1", server.port, timeout=0.1)
+    assert stream.metadata.format.columns_per_frame == scan.w
+    assert stream.cols == list(range(scan.w))
+
+    # the connection may not be accepted yet when sending the first scans
+    it = iter(stream)
+    for _ in range(50):
+        server.send(scan)
+        try:
+            received = next(it)
+            break
+        except client.ClientTimeout:
+            it = iter(stream)
+    else:
+        pytest.fail("no scan received")
+
+    assert set(received.fields) == {
+        client.ChanField.RANGE, client.ChanField.REFLECTIVITY
+    }
+    for f in received.fields:
+        assert np.array_equal(received.field(f), scan.field(f))
+    assert np.array_equal(received.timestamp, scan.timestamp)
+    assert server.clients == 1
+    stream.close()
+
+
+def test_scan_stream_region(scan: client.LidarScan,
+                            meta: client.SensorInfo) -> None:
+    """Check that servers send a region with quantized ranges."""
+    config = client.StreamConfig()
+    config.fields = [client.ChanField.RANGE]
+    config.rows = list(range(0, scan.h, 2))
+    config.cols = list(range(0, scan.w, 4))
+    config.range_step = 8
+    server = client.ScanStreamServer(meta, config=config)
+    stream = client.ScanStreamClient("127.0.0.1", server.port)
+    assert stream.rows == config.rows
+
+    received = client.LidarScan(0, 0)
+    for _ in range(50):
+        server.send(scan)
+        if stream.read(received, 0.1):
+            break
+    assert (received.h, received.w) == (len(config.rows), len(config.cols))
+    expected = scan.field(client.ChanField.RANGE)[::2, ::4].astype(np.int64)
+    actual = received.field(client.ChanField.RANGE)
+    assert np.all(actual % 8 == 0)
+    assert np.all(np.abs(actual - expected) <= 4)
+
+    with pytest.raises(ValueError):
+        config.range_step = 0
+        client.ScanStreamServer(meta, config=config)
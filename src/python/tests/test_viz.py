@@ -63,6 +63,24 @@ def test_point_viz_image(point_viz: viz.PointViz) -> None:
     point_viz.run()
 
 
+def test_point_viz_image_field(point_viz: viz.PointViz) -> None:
+    """Test displaying a raw, staggered field scaled and destaggered by viz."""
+    h, w = 64, 1024
+    shifts = [(u % 4) * 16 for u in range(h)]
+    ramp = np.tile(np.arange(w, dtype=np.uint32) * 100, (h, 1))
+    staggered = np.stack([np.roll(ramp[u], -shifts[u]) for u in range(h)])
+
+    img = viz.Image()
+    img.set_position(-4 / 3, 4 / 3, -1, 1)
+    img.set_field(np.ascontiguousarray(staggered))
+    img.set_pixel_shift(shifts)
+    img.set_palette(viz.spezia_palette)
+    point_viz.add(img)
+
+    point_viz.update()
+    point_viz.run()
+
+
 def test_point_viz_image_with_labels_aligned(point_viz: viz.PointViz) -> None:
     """Test displaying a set of images aligned to the corners."""
 
@@ -244,6 +262,54 @@ def test_point_viz_cloud_unstructured(point_viz: viz.PointViz) -> None:
     thread.join()
 
 
+def test_point_viz_headless_frames() -> None:
+    """Check that headless frames are read back with the window size."""
+    point_viz = viz.PointViz("Test Viz",
+                             window_width=320,
+                             window_height=240,
+                             headless=True)
+    img = viz.Image()
+    img.set_position(-1, 1, -1, 1)
+    img.set_image(np.ones((24, 32)))
+    point_viz.add(img)
+    point_viz.update()
+
+    frames = []
+
+    def handle_frame(frame: np.ndarray) -> bool:
+        frames.append(frame)
+        return True
+
+    point_viz.push_frame_handler(handle_frame)
+    for _ in range(5):
+        point_viz.run_once()
+    point_viz.pop_frame_handler()
+
+    assert frames
+    assert frames[0].ndim == 3 and frames[0].shape[2] == 4
+    assert frames[-1][..., :3].max() > 0
+
+
+@pytest.mark.parametrize('test_key', ['legacy-2.0'])
+def test_point_viz_accumulated_cloud(meta: client.SensorInfo,
+                                     point_viz: viz.PointViz) -> None:
+    """Smoke test accumulating more scans than are kept."""
+    h = meta.format.pixels_per_column
+    w = meta.format.columns_per_frame
+    cloud = viz.AccumulatedCloud(meta, 3)
+    point_viz.add(cloud)
+
+    for i in range(5):
+        pose = np.eye(4, order='F')
+        pose[0, 3] = 10.0 * i
+        rng = np.full((h, w), 5000, dtype=np.uint32)
+        key = np.random.rand(h, w).astype(np.float32)
+        cloud.add_scan(rng, key, pose)
+
+    point_viz.update()
+    point_viz.run()
+
+
 def test_point_viz_destruction() -> None:
     """Check that PointViz is destroyed deterministically."""
     point_viz = viz.PointViz("Test Viz")
@@ -145,3 +145,32 @@ def test_xyz_range_dtype(stream_digest: digest.StreamDigest, scan: client.LidarS
     assert np.array_equal(xyz_from_scan, xyz_from_range_16)
     assert np.array_equal(xyz_from_scan, xyz_from_range_32)
     assert np.array_equal(xyz_from_scan, xyz_from_range_64)
+
+
+def test_xyz_out(stream_digest: digest.StreamDigest, scan: client.LidarScan,
+                 meta: client.SensorInfo) -> None:
+    """Test projecting into preallocated arrays."""
+    xyzlut = client.XYZLut(meta)
+    expected = xyzlut(scan)
+
+    out64 = np.empty_like(expected)
+    assert xyzlut(scan, out=out64) is out64
+    assert np.array_equal(out64, expected)
+
+    out32 = np.empty(expected.shape, dtype=np.float32)
+    assert xyzlut(scan, out=out32) is out32
+    assert np.array_equal(out32, expected.astype(np.float32))
+
+    # flat arrays of points work too
+    range = scan.field(client.ChanField.RANGE)
+    flat = np.empty((scan.h * scan.w, 3), dtype=np.float32)
+    xyzlut(range, out=flat)
+    assert np.array_equal(flat.reshape(expected.shape),
+                          xyzlut(range).astype(np.float32))
+
+    with pytest.raises(ValueError):
+        xyzlut(scan, out=np.empty(expected.shape, dtype=np.int32))
+    with pytest.raises(ValueError):
+        xyzlut(scan, out=np.empty((scan.h, scan.w, 4)))
+    with pytest.raises(ValueError):
+        xyzlut(scan, out=np.empty((scan.h, scan.w, 6))[:, :, ::2])
@@ -0,0 +1,422 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/arrow_file.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ouster/impl/lidar_scan_impl.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+using namespace ouster::sensor_utils;
+
+namespace {
+
+struct fill_random {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, ChanField, std::mt19937& gen) {
+        std::uniform_int_distribution<uint64_t> dist(0, 1 << 20);
+        for (int i = 0; i < field.size(); i++)
+            field.data()[i] = static_cast<T>(dist(gen));
+    }
+};
+
+std::vector<LidarScan> make_scans(const LidarScan& prototype, size_t n) {
+    std::mt19937 gen(0);
+    std::vector<LidarScan> scans;
+    for (size_t i = 0; i < n; i++) {
+        LidarScan ls = prototype;
+        impl::foreach_field(ls, fill_random{}, gen);
+        ls.frame_id = static_cast<int32_t>(i + 10);
+        for (int c = 0; c < ls.w; c++) {
+            ls.timestamp()[c] = (i + 1) * 100000000 + c;
+            ls.rx_timestamp()[c] = (i + 1) * 100000000 + c + 50;
+            ls.measurement_id()[c] = static_cast<uint16_t>(c);
+            ls.status()[c] = c % 7 == 0 ? 0 : 1;
+        }
+        scans.push_back(std::move(ls));
+    }
+    return scans;
+}
+
+std::string temp_path(const std::string& name) {
+    return std::string(::testing::TempDir()) + name;
+}
+
+std::vector<uint8_t> read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>()};
+}
+
+template <typename T>
+T load(const uint8_t* p) {
+    T v;
+    std::memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+// just enough of a flatbuffer reader to follow the Arrow metadata
+struct fb_table {
+    const uint8_t* p;
+
+    static fb_table root(const uint8_t* buf) {
+        return {buf + load<uint32_t>(buf)};
+    }
+
+    const uint8_t* field(uint16_t id) const {
+        const uint8_t* vtable = p - load<int32_t>(p);
+        const uint16_t size = load<uint16_t>(vtable);
+        if (4u + 2u * id >= size) return nullptr;
+        const uint16_t o = load<uint16_t>(vtable + 4 + 2 * id);
+        return o ? p + o : nullptr;
+    }
+
+    template <typename T>
+    T scalar(uint16_t id, T def = 0) const {
+        const uint8_t* f = field(id);
+        return f ? load<T>(f) : def;
+    }
+
+    const uint8_t* deref(uint16_t id) const {
+        const uint8_t* f = field(id);
+        if (!f) throw std::runtime_error("missing flatbuffer field");
+        return f + load<uint32_t>(f);
+    }
+
+    fb_table table(uint16_t id) const { return {deref(id)}; }
+
+    std::string string(uint16_t id) const {
+        const uint8_t* s = deref(id);
+        return {reinterpret_cast<const char*>(s + 4), load<uint32_t>(s)};
+    }
+
+    uint32_t length(uint16_t id) const { return load<uint32_t>(deref(id)); }
+
+    fb_table table_at(uint16_t id, size_t i) const {
+        const uint8_t* e = deref(id) + 4 + 4 * i;
+        return {e + load<uint32_t>(e)};
+    }
+
+    template <typename T>
+    T struct_at(uint16_t id, size_t i) const {
+        const uint8_t* v = deref(id) + 4;
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(v) % 8, 0u);
+        return load<T>(v + i * sizeof(T));
+    }
+};
+
+struct node {
+    int64_t length;
+    int64_t null_count;
+};
+
+struct span {
+    int64_t offset;
+    int64_t length;
+};
+
+struct block {
+    int64_t offset;
+    int32_t metadata_length;
+    int32_t reserved;
+    int64_t body_length;
+};
+
+struct arrow_column {
+    std::string name;
+    uint8_t type_type;
+    int bit_width;    // of values
+    bool is_signed;   // of integer values
+    size_t list_size; // 0 if not a list
+};
+
+struct arrow_file {
+    std::vector<uint8_t> bytes;
+    std::vector<arrow_column> columns;
+    std::string metadata;
+    std::vector<block> blocks;
+
+    explicit arrow_file(const std::string& path) : bytes(read_file(path)) {
+        const size_t n = bytes.size();
+        EXPECT_GE(n, 18u);
+        EXPECT_EQ(std::string(bytes.begin(), bytes.begin() + 6), "ARROW1");
+        EXPECT_EQ(std::string(bytes.end() - 6, bytes.end()), "ARROW1");
+        const uint32_t footer_size = load<uint32_t>(&bytes[n - 10]);
+        const size_t footer_at = n - 10 - footer_size;
+        EXPECT_EQ(footer_at % 8, 0u);
+
+        // the stream ends with an end of stream marker before the footer
+        EXPECT_EQ(load<uint32_t>(&bytes[footer_at - 8]), 0xffffffffu);
+        EXPECT_EQ(load<uint32_t>(&bytes[footer_at - 4]), 0u);
+
+        const auto footer = fb_table::root(&bytes[footer_at]);
+        EXPECT_EQ(footer.scalar<int16_t>(0), 4);
+        const auto schema = footer.table(1);
+        EXPECT_EQ(schema.scalar<int16_t>(0), 0);
+        for (size_t i = 0; i < schema.length(1); i++) {
+            const auto f = schema.table_at(1, i);
+            arrow_column c{f.string(0), f.scalar<uint8_t>(2), 0, false, 0};
+            EXPECT_EQ(f.scalar<uint8_t>(1), 0);
+            auto value = f;
+            if (c.type_type == 16) {
+                c.list_size = f.table(3).scalar<int32_t>(0);
+                EXPECT_EQ(f.length(5), 1u);
+                value = f.table_at(5, 0);
+                EXPECT_EQ(value.string(0), "item");
+            }
+            EXPECT_EQ(value.length(5), 0u);
+            const uint8_t t = value.scalar<uint8_t>(2);
+            if (t == 2) {
+                c.bit_width = value.table(3).scalar<int32_t>(0);
+                c.is_signed = value.table(3).scalar<uint8_t>(1);
+            } else {
+                EXPECT_EQ(t, 3);
+                EXPECT_EQ(value.table(3).scalar<int16_t>(0), 1);
+                c.bit_width = 32;
+            }
+            c.type_type = t;
+            columns.push_back(c);
+        }
+        EXPECT_EQ(schema.length(2), 1u);
+        EXPECT_EQ(schema.table_at(2, 0).string(0), "ouster:sensor_info");
+        metadata = schema.table_at(2, 0).string(1);
+
+        EXPECT_EQ(footer.length(2), 0u);
+        for (size_t i = 0; i < footer.length(3); i++)
+            blocks.push_back(footer.struct_at<block>(3, i));
+    }
+
+    // the rows of a record batch and the values of each column
+    size_t batch(size_t b, std::vector<const uint8_t*>& data) const {
+        const auto& blk = blocks.at(b);
+        EXPECT_EQ(blk.offset % 8, 0);
+        EXPECT_EQ(blk.metadata_length % 8, 0);
+        const uint8_t* msg = &bytes[blk.offset];
+        EXPECT_EQ(load<uint32_t>(msg), 0xffffffffu);
+        EXPECT_EQ(load<int32_t>(msg + 4) + 8, blk.metadata_length);
+
+        const auto message = fb_table::root(msg + 8);
+        EXPECT_EQ(message.scalar<int16_t>(0), 4);
+        EXPECT_EQ(message.scalar<uint8_t>(1), 3);
+        EXPECT_EQ(message.scalar<int64_t>(3), blk.body_length);
+        const auto rb = message.table(2);
+        const auto rows = rb.scalar<int64_t>(0);
+
+        const uint8_t* body = msg + blk.metadata_length;
+        size_t n_nodes = 0, buffer = 0;
+        data.clear();
+        for (const auto& c : columns) {
+            const size_t n_values = rows * std::max<size_t>(c.list_size, 1);
+            EXPECT_EQ(rb.struct_at<node>(1, n_nodes).length, rows);
+            EXPECT_EQ(rb.struct_at<node>(1, n_nodes++).null_count, 0);
+            if (c.list_size > 0) {
+                EXPECT_EQ(rb.struct_at<node>(1, n_nodes++).length,
+                          static_cast<int64_t>(n_values));
+                EXPECT_EQ(rb.struct_at<span>(2, buffer++).length, 0);
+            }
+            EXPECT_EQ(rb.struct_at<span>(2, buffer++).length, 0);
+            const auto values = rb.struct_at<span>(2, buffer++);
+            EXPECT_EQ(values.offset % 8, 0);
+            EXPECT_EQ(values.length,
+                      static_cast<int64_t>(n_values * c.bit_width / 8));
+            EXPECT_LE(values.offset + values.length, blk.body_length);
+            data.push_back(body + values.offset);
+        }
+        EXPECT_EQ(rb.length(1), n_nodes);
+        EXPECT_EQ(rb.length(2), buffer);
+        return rows;
+    }
+};
+
+struct plane_equal {
+    template <typename T>
+    void operator()(Eigen::Ref<const img_t<T>> field, const uint8_t* data,
+                    bool& equal) const {
+        equal = std::memcmp(field.data(), data, field.size() * sizeof(T)) == 0;
+    }
+};
+
+}  // namespace
+
+TEST(ArrowFileTest, round_trip) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    const LidarScan prototype(w, h, info.format.udp_profile_lidar);
+    auto scans = make_scans(prototype, 11);
+    scans[7].destaggered = true;
+
+    const auto path = temp_path("round_trip.arrow");
+    arrow_file_options options;
+    options.batch_frames = 4;
+    options.xyz = true;
+    options.n_threads = 3;
+    {
+        ArrowFileWriter writer(path, info, options);
+        for (const auto& s : scans) writer.write(s);
+        EXPECT_EQ(writer.frame_count(), scans.size());
+        writer.close();
+    }
+
+    const arrow_file file(path);
+    EXPECT_EQ(parse_metadata(file.metadata).format.columns_per_frame, w);
+
+    const std::vector<std::string> names{
+        "frame_id",     "timestamp", "measurement_id", "status",
+        "rx_timestamp", "RANGE",     "SIGNAL",         "NEAR_IR",
+        "REFLECTIVITY", "xyz"};
+    const std::vector<ChanField> fields{ChanField::RANGE, ChanField::SIGNAL,
+                                        ChanField::NEAR_IR,
+                                        ChanField::REFLECTIVITY};
+    ASSERT_EQ(file.columns.size(), names.size());
+    for (size_t i = 0; i < names.size(); i++)
+        EXPECT_EQ(file.columns[i].name, names[i]);
+    EXPECT_EQ(file.columns[0].list_size, 0u);
+    EXPECT_EQ(file.columns[0].bit_width, 32);
+    EXPECT_TRUE(file.columns[0].is_signed);
+    EXPECT_EQ(file.columns[1].list_size, w);
+    EXPECT_EQ(file.columns[1].bit_width, 64);
+    EXPECT_EQ(file.columns[2].bit_width, 16);
+    EXPECT_EQ(file.columns[5].list_size, w * h);
+    EXPECT_EQ(file.columns[5].bit_width, 32);
+    EXPECT_FALSE(file.columns[5].is_signed);
+    EXPECT_EQ(file.columns[9].type_type, 3);
+    EXPECT_EQ(file.columns[9].list_size, 3 * w * h);
+
+    // batches of 4, 4 and 3 rows
+    ASSERT_EQ(file.blocks.size(), 3u);
+    const XYZLut lut = make_xyz_lut(info);
+    const XYZLut lut_destaggered = make_xyz_lut(info, true);
+    size_t frame = 0;
+    std::vector<const uint8_t*> data;
+    for (size_t b = 0; b < file.blocks.size(); b++) {
+        const size_t rows = file.batch(b, data);
+        EXPECT_EQ(rows, b < 2 ? 4u : 3u);
+        for (size_t k = 0; k < rows; k++, frame++) {
+            const auto& s = scans[frame];
+            EXPECT_EQ(load<int32_t>(data[0] + 4 * k), s.frame_id);
+            EXPECT_EQ(std::memcmp(data[1] + 8 * w * k, s.timestamp().data(),
+                                  8 * w),
+                      0);
+            EXPECT_EQ(std::memcmp(data[2] + 2 * w * k,
+                                  s.measurement_id().data(), 2 * w),
+                      0);
+            EXPECT_EQ(std::memcmp(data[3] + 4 * w * k, s.status().data(),
+                                  4 * w),
+                      0);
+            EXPECT_EQ(std::memcmp(data[4] + 8 * w * k, s.rx_timestamp().data(),
+                                  8 * w),
+                      0);
+            for (size_t c = 5; c < 9; c++) {
+                const auto f = fields[c - 5];
+                const size_t bytes = file.columns[c].bit_width / 8 * w * h;
+                bool equal = false;
+                impl::visit_field(s, f, plane_equal{}, data[c] + bytes * k,
+                                  equal);
+                EXPECT_TRUE(equal) << names[c];
+            }
+
+            const auto expected =
+                cartesian(s, s.destaggered ? lut_destaggered : lut);
+            const float* xyz =
+                reinterpret_cast<const float*>(data[9]) + 3 * w * h * k;
+            for (size_t i = 0; i < w * h; i++)
+                for (int j = 0; j < 3; j++)
+                    ASSERT_NEAR(xyz[3 * i + j], expected(i, j), 1e-3)
+                        << frame << " " << i;
+        }
+    }
+    EXPECT_EQ(frame, scans.size());
+}
+
+TEST(ArrowFileTest, selected_fields) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const std::vector<std::pair<ChanField, ChanFieldType>> types{
+        {ChanField::RANGE, ChanFieldType::UINT32},
+        {ChanField::REFLECTIVITY, ChanFieldType::UINT8},
+        {ChanField::CUSTOM0, ChanFieldType::UINT64}};
+    const LidarScan prototype(512, 64, types.begin(), types.end());
+    const auto scans = make_scans(prototype, 8);
+
+    const auto path = temp_path("selected_fields.arrow");
+    arrow_file_options options;
+    options.batch_frames = 8;
+    options.fields = {ChanField::CUSTOM0, ChanField::REFLECTIVITY};
+    {
+        // the footer is written on destruction
+        ArrowFileWriter writer(path, info, prototype, options);
+        for (const auto& s : scans) writer.write(s);
+    }
+
+    const arrow_file file(path);
+    ASSERT_EQ(file.columns.size(), 7u);
+    EXPECT_EQ(file.columns[5].name, "CUSTOM0");
+    EXPECT_EQ(file.columns[5].bit_width, 64);
+    EXPECT_EQ(file.columns[6].name, "REFLECTIVITY");
+    EXPECT_EQ(file.columns[6].bit_width, 8);
+    ASSERT_EQ(file.blocks.size(), 1u);
+    std::vector<const uint8_t*> data;
+    ASSERT_EQ(file.batch(0, data), 8u);
+    for (size_t k = 0; k < 8; k++) {
+        bool equal = false;
+        impl::visit_field(scans[k], ChanField::CUSTOM0, plane_equal{},
+                          data[5] + 8 * 512 * 64 * k, equal);
+        EXPECT_TRUE(equal);
+        impl::visit_field(scans[k], ChanField::REFLECTIVITY, plane_equal{},
+                          data[6] + 512 * 64 * k, equal);
+        EXPECT_TRUE(equal);
+    }
+}
+
+TEST(ArrowFileTest, empty_file) {
+    const auto info = default_sensor_info(MODE_1024x10);
+    const auto path = temp_path("empty.arrow");
+    ArrowFileWriter(path, info).close();
+    const arrow_file file(path);
+    EXPECT_EQ(file.columns.size(), 9u);
+    EXPECT_TRUE(file.blocks.empty());
+}
+
+TEST(ArrowFileTest, invalid_arguments) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const auto path = temp_path("invalid.arrow");
+    arrow_file_options options;
+    options.batch_frames = 0;
+    EXPECT_THROW(ArrowFileWriter(path, info, options), std::invalid_argument);
+
+    options = {};
+    options.fields = {ChanField::RANGE2};
+    EXPECT_THROW(ArrowFileWriter(path, info, options), std::invalid_argument);
+
+    options = {};
+    options.xyz = true;
+    const std::vector<std::pair<ChanField, ChanFieldType>> types{
+        {ChanField::SIGNAL, ChanFieldType::UINT16}};
+    const LidarScan no_range(512, 64, types.begin(), types.end());
+    EXPECT_THROW(ArrowFileWriter(path, info, no_range, options),
+                 std::invalid_argument);
+
+    EXPECT_THROW(ArrowFileWriter("/nonexistent/dir/x.arrow", info),
+                 std::runtime_error);
+
+    ArrowFileWriter writer(path, info);
+    EXPECT_THROW(writer.write(no_range), std::invalid_argument);
+    EXPECT_THROW(writer.write(LidarScan(1024, 64)), std::invalid_argument);
+    writer.close();
+    EXPECT_THROW(writer.write(LidarScan(512, 64)), std::runtime_error);
+}
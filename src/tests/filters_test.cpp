@@ -0,0 +1,184 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/filters.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+
+namespace {
+
+// median of the window around each pixel, looking up neighbours by azimuth
+template <typename T>
+img_t<T> reference_median(const img_t<T>& img, int size,
+                          const std::vector<int>& shifts) {
+    const int h = img.rows(), w = img.cols(), r = size / 2;
+    auto shift = [&](int u) { return shifts.empty() ? 0 : shifts[u]; };
+    img_t<T> res(h, w);
+    for (int u = 0; u < h; u++) {
+        for (int v = 0; v < w; v++) {
+            std::vector<T> window;
+            for (int dy = -r; dy <= r; dy++) {
+                const int y = std::min(std::max(u + dy, 0), h - 1);
+                for (int dx = -r; dx <= r; dx++) {
+                    const int x = v + shift(u) - shift(y) + dx;
+                    window.push_back(img(y, ((x % w) + w) % w));
+                }
+            }
+            std::nth_element(window.begin(),
+                             window.begin() + window.size() / 2,
+                             window.end());
+            res(u, v) = window[window.size() / 2];
+        }
+    }
+    return res;
+}
+
+}  // namespace
+
+TEST(FiltersTest, median_matches_reference) {
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<uint32_t> dist(0, 1000);
+    const std::vector<int> shifts{12, -4, 3, 0, 30, 7, -19};
+
+    img_t<uint32_t> img(shifts.size(), 13);
+    for (int i = 0; i < img.size(); i++) img.data()[i] = dist(gen);
+
+    for (int size : {3, 5}) {
+        for (const auto& s : {std::vector<int>{}, shifts}) {
+            img_t<uint32_t> out(img.rows(), img.cols());
+            filters::median<uint32_t>(img, out, size, s);
+            EXPECT_TRUE((out == reference_median(img, size, s)).all())
+                << "size " << size << " shifts " << s.size();
+
+            img_t<uint32_t> threaded(img.rows(), img.cols());
+            filters::median<uint32_t>(img, threaded, size, s, 3);
+            EXPECT_TRUE((threaded == out).all());
+        }
+    }
+
+    img_t<uint32_t> out(img.rows(), img.cols());
+    EXPECT_THROW(filters::median<uint32_t>(img, out, 4), std::invalid_argument);
+    EXPECT_THROW(filters::median<uint32_t>(img, out, 3, {1, 2}),
+                 std::invalid_argument);
+}
+
+TEST(FiltersTest, median_scan_layouts) {
+    auto info = default_sensor_info(MODE_512x10);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+
+    LidarScan ls(w, h, info.format.udp_profile_lidar);
+    std::mt19937 gen(6);
+    std::uniform_int_distribution<uint32_t> dist(0, 100000);
+    auto range = ls.field(ChanField::RANGE);
+    for (int i = 0; i < range.size(); i++) range.data()[i] = dist(gen);
+
+    // filtering a destaggered scan ignores shifts
+    const Destaggerer destagger(info);
+    LidarScan destaggered = ls;
+    destagger(ls, {ChanField::RANGE}, destaggered);
+    destaggered.destaggered = true;
+
+    filters::median(ls, ChanField::RANGE, 5, info.format.pixel_shift_by_row);
+    filters::median(destaggered, ChanField::RANGE, 5,
+                    info.format.pixel_shift_by_row, 2);
+
+    img_t<uint32_t> expected(h, w);
+    destagger(ls.field<uint32_t>(ChanField::RANGE), expected);
+    EXPECT_TRUE((destaggered.field(ChanField::RANGE) == expected).all());
+
+    EXPECT_THROW(filters::median(ls, ChanField::CUSTOM0, 3, {}),
+                 std::out_of_range);
+}
+
+TEST(FiltersTest, masks) {
+    img_t<float> img(2, 4);
+    img << 0, 1, 2, 3, std::numeric_limits<float>::quiet_NaN(), 5, 6, 7;
+
+    img_t<uint8_t> mask = img_t<uint8_t>::Zero(2, 4);
+    filters::invalid_mask<float>(img, mask, 0x01);
+    filters::threshold_mask<float>(img, 2, 5, mask, 0x04);
+
+    img_t<uint8_t> expected(2, 4);
+    expected << 0x05, 0x04, 0x00, 0x00, 0x01, 0x00, 0x04, 0x04;
+    EXPECT_TRUE((mask == expected).all());
+
+    img_t<uint8_t> wrong_mask(4, 2);
+    EXPECT_THROW(filters::invalid_mask<float>(img, wrong_mask),
+                 std::invalid_argument);
+
+    // scan overloads and zeroing selected pixels
+    LidarScan ls(4, 2);
+    ls.field(ChanField::RANGE) << 0, 100, 200, 300, 400, 0, 600, 700;
+    ls.field(ChanField::SIGNAL) << 1, 2, 3, 4, 5, 6, 7, 8;
+    img_t<uint8_t> scan_mask = img_t<uint8_t>::Zero(2, 4);
+    filters::invalid_mask(ls, ChanField::RANGE, scan_mask, 0x01);
+    filters::threshold_mask(ls, ChanField::RANGE, 150, 650, scan_mask, 0x02);
+
+    filters::apply_mask(ls, {ChanField::SIGNAL}, scan_mask, 0x01);
+    img_t<uint32_t> signal(2, 4);
+    signal << 0, 2, 3, 4, 5, 0, 7, 8;
+    EXPECT_TRUE((ls.field(ChanField::SIGNAL) == signal).all());
+
+    filters::apply_mask(ls, {ChanField::SIGNAL}, scan_mask);
+    signal << 0, 0, 3, 4, 5, 0, 7, 0;
+    EXPECT_TRUE((ls.field(ChanField::SIGNAL) == signal).all());
+
+    EXPECT_THROW(
+        filters::invalid_mask(ls, ChanField::CUSTOM1, scan_mask, 0x01),
+        std::out_of_range);
+}
+
+TEST(FiltersTest, edge_mask_marks_background_at_silhouettes) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    const auto lut = make_xyz_lut(info, true);
+
+    // an object at 5 m in front of a wall at 20 m, with a missing return
+    img_t<uint32_t> range(h, w);
+    range.setConstant(20000);
+    range.block(0, 100, h, 50).setConstant(5000);
+    range(10, 300) = 0;
+
+    img_t<uint8_t> mask = img_t<uint8_t>::Zero(h, w);
+    filters::edge_mask(range, lut, 5.0, mask, 0x02);
+
+    for (size_t u = 0; u < h; u++) {
+        EXPECT_EQ(mask(u, 99), 0x02) << "row " << u;
+        EXPECT_EQ(mask(u, 150), 0x02) << "row " << u;
+    }
+    mask.col(99).setZero();
+    mask.col(150).setZero();
+    EXPECT_TRUE((mask == 0).all());
+
+    // the same range image, staggered
+    const Destaggerer stagger(info, true);
+    img_t<uint32_t> staggered(h, w);
+    stagger(range, staggered);
+    img_t<uint8_t> staggered_mask = img_t<uint8_t>::Zero(h, w);
+    filters::edge_mask(staggered, make_xyz_lut(info), 5.0, staggered_mask,
+                       0x02, info.format.pixel_shift_by_row, 2);
+    const Destaggerer destagger(info);
+    img_t<uint8_t> destaggered_mask(h, w);
+    destagger(staggered_mask, destaggered_mask);
+    EXPECT_EQ(destaggered_mask.cast<int>().sum(), 2 * 2 * int(h));
+    EXPECT_TRUE((destaggered_mask.col(99) == 0x02).all());
+    EXPECT_TRUE((destaggered_mask.col(150) == 0x02).all());
+}
@@ -0,0 +1,237 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/fusion.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::fusion;
+
+namespace {
+
+constexpr uint64_t T0 = 10000000000;  // 10s, the start of window 100
+constexpr uint64_t MS = 1000000;
+
+// a scan of the sensor with columns evenly spread from t0 over scan_ns
+LidarScan make_scan(const sensor::sensor_info& info, uint64_t t0,
+                    uint64_t scan_ns, uint32_t range = 10000) {
+    const size_t w = info.format.columns_per_frame;
+    LidarScan ls{w, info.format.pixels_per_column,
+                 info.format.udp_profile_lidar};
+    for (size_t v = 0; v < w; v++) ls.timestamp()[v] = t0 + v * scan_ns / w;
+    ls.status().setConstant(1);
+    ls.field(sensor::RANGE).setConstant(range);
+    return ls;
+}
+
+// collects the clouds handed to the handler
+struct Clouds {
+    std::vector<FusedCloud> clouds;
+
+    ScanFuser::Handler handler() {
+        return [this](const FusedCloud& c) {
+            clouds.push_back(c);
+            clouds.back().points.resize(c.size);
+        };
+    }
+};
+
+FuserConfig config(uint64_t max_delay_ns = 200 * MS, size_t max_windows = 4) {
+    FuserConfig config;
+    config.window_ns = 100 * MS;
+    config.max_delay_ns = max_delay_ns;
+    config.max_windows = max_windows;
+    return config;
+}
+
+}  // namespace
+
+TEST(FusionTest, projects_into_common_frame) {
+    const auto info = sensor::default_sensor_info(sensor::MODE_512x10);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+
+    FusedSensor fs{info, mat4d::Identity()};
+    fs.extrinsic.block<3, 3>(0, 0) << 0, -1, 0, 1, 0, 0, 0, 0, 1;
+    fs.extrinsic.block<3, 1>(0, 3) << 1, 2, 3;
+
+    Clouds out;
+    ScanFuser fuser{{fs, fs}, config(), out.handler()};
+
+    std::mt19937 gen{1};
+    std::uniform_int_distribution<uint32_t> dist{0, 100000};
+    auto ls = make_scan(info, T0, 100 * MS);
+    for (int i = 0; i < ls.field(sensor::RANGE).size(); i++) {
+        // some pixels without returns
+        const uint32_t r = i % 7 ? dist(gen) : 0;
+        ls.field(sensor::RANGE).data()[i] = r;
+        ls.field(sensor::SIGNAL).data()[i] = r;
+        ls.field(sensor::REFLECTIVITY).data()[i] = i % 256;
+    }
+    ls.status()[3] = 0;
+    fuser.add(1, ls);
+    EXPECT_TRUE(out.clouds.empty());
+    fuser.flush();
+    ASSERT_EQ(out.clouds.size(), 1u);
+
+    const auto& c = out.clouds[0];
+    EXPECT_EQ(c.ts, T0);
+    const auto cols = static_cast<uint32_t>(w - 1);
+    EXPECT_EQ(c.columns, (std::vector<uint32_t>{0, cols}));
+
+    const LidarScan::Points expected = cartesian(ls, make_xyz_lut(info));
+    const Eigen::Matrix3d rot = fs.extrinsic.block<3, 3>(0, 0);
+    const Eigen::Vector3d trans = fs.extrinsic.block<3, 1>(0, 3);
+    const auto range = ls.field(sensor::RANGE);
+    size_t k = 0;
+    for (size_t u = 0; u < h; u++) {
+        for (size_t v = 0; v < w; v++) {
+            if (v == 3 || range(u, v) == 0) continue;
+            ASSERT_LT(k, c.size);
+            const auto& p = c.points[k++];
+            const size_t i = u * w + v;
+            const Eigen::Vector3d xyz =
+                rot * expected.row(i).transpose().matrix() + trans;
+            EXPECT_NEAR(p.x, xyz(0), 1e-3);
+            EXPECT_NEAR(p.y, xyz(1), 1e-3);
+            EXPECT_NEAR(p.z, xyz(2), 1e-3);
+            EXPECT_EQ(p.t, ls.timestamp()[v] - T0);
+            EXPECT_EQ(p.range, range(u, v));
+            // signal of the legacy profile is saturated to 16 bits
+            EXPECT_EQ(p.signal, std::min<uint32_t>(range(u, v), 65535));
+            EXPECT_EQ(p.reflectivity, i % 256);
+            EXPECT_EQ(p.ring, u);
+            EXPECT_EQ(p.sensor, 1);
+        }
+    }
+    EXPECT_EQ(k, c.size);
+    EXPECT_EQ(fuser.stats().scans, 1u);
+    EXPECT_EQ(fuser.stats().clouds, 1u);
+}
+
+TEST(FusionTest, windows_by_column_timestamps) {
+    const auto info = sensor::default_sensor_info(sensor::MODE_512x10);
+    const size_t h = info.format.pixels_per_column;
+    Clouds out;
+    ScanFuser fuser{{{info}, {info}}, config(), out.handler()};
+
+    // straddles windows 100 and 101
+    fuser.add(0, make_scan(info, T0 + 50 * MS, 100 * MS));
+    fuser.add(1, make_scan(info, T0, 100 * MS));
+    EXPECT_TRUE(out.clouds.empty());
+
+    // both sensors are past window 100
+    fuser.add(1, make_scan(info, T0 + 100 * MS, 100 * MS));
+    ASSERT_EQ(out.clouds.size(), 1u);
+    EXPECT_EQ(out.clouds[0].ts, T0);
+    EXPECT_EQ(out.clouds[0].columns, (std::vector<uint32_t>{256, 512}));
+    EXPECT_EQ(out.clouds[0].size, (256 + 512) * h);
+    for (const auto& p : out.clouds[0].points) EXPECT_LT(p.t, 100 * MS);
+
+    fuser.flush();
+    ASSERT_EQ(out.clouds.size(), 2u);
+    EXPECT_EQ(out.clouds[1].ts, T0 + 100 * MS);
+    EXPECT_EQ(out.clouds[1].columns, (std::vector<uint32_t>{256, 512}));
+    EXPECT_EQ(fuser.stats().late_columns, 0u);
+}
+
+TEST(FusionTest, lagging_sensors_dont_hold_windows) {
+    const auto info = sensor::default_sensor_info(sensor::MODE_512x10);
+    Clouds out;
+    ScanFuser fuser{{{info}, {info}}, config(100 * MS), out.handler()};
+
+    fuser.add(0, make_scan(info, T0, 100 * MS));
+    fuser.add(1, make_scan(info, T0, 100 * MS));
+    fuser.add(0, make_scan(info, T0 + 100 * MS, 100 * MS));
+    EXPECT_TRUE(out.clouds.empty());
+
+    // sensor 1 is now more than the delay behind
+    fuser.add(0, make_scan(info, T0 + 200 * MS, 100 * MS));
+    ASSERT_EQ(out.clouds.size(), 2u);
+    EXPECT_EQ(out.clouds[0].columns, (std::vector<uint32_t>{512, 512}));
+    EXPECT_EQ(out.clouds[1].columns, (std::vector<uint32_t>{512, 0}));
+
+    // and its data for completed windows is dropped
+    fuser.add(1, make_scan(info, T0 + 100 * MS, 100 * MS));
+    EXPECT_EQ(fuser.stats().late_columns, 512u);
+    EXPECT_EQ(out.clouds.size(), 2u);
+}
+
+TEST(FusionTest, sensors_yet_to_start_lag_behind) {
+    const auto info = sensor::default_sensor_info(sensor::MODE_512x10);
+    Clouds out;
+    ScanFuser fuser{{{info}, {info}}, config(100 * MS), out.handler()};
+
+    fuser.add(0, make_scan(info, T0, 100 * MS));
+    EXPECT_TRUE(out.clouds.empty());
+    fuser.add(0, make_scan(info, T0 + 100 * MS, 100 * MS));
+    ASSERT_EQ(out.clouds.size(), 1u);
+    EXPECT_EQ(out.clouds[0].columns, (std::vector<uint32_t>{512, 0}));
+}
+
+TEST(FusionTest, bounded_windows) {
+    const auto info = sensor::default_sensor_info(sensor::MODE_512x10);
+    Clouds out;
+    ScanFuser fuser{{{info}, {info}}, config(10000 * MS, 2), out.handler()};
+
+    // sensor 1 holds the windows, until there is no room for more
+    fuser.add(0, make_scan(info, T0, 100 * MS));
+    fuser.add(0, make_scan(info, T0 + 100 * MS, 100 * MS));
+    EXPECT_TRUE(out.clouds.empty());
+    fuser.add(0, make_scan(info, T0 + 200 * MS, 100 * MS));
+    ASSERT_EQ(out.clouds.size(), 1u);
+    EXPECT_EQ(out.clouds[0].ts, T0);
+
+    // skips over gaps
+    fuser.add(0, make_scan(info, T0 + 100000 * MS, 100 * MS));
+    ASSERT_EQ(out.clouds.size(), 3u);
+    fuser.flush();
+    ASSERT_EQ(out.clouds.size(), 4u);
+    EXPECT_EQ(out.clouds[3].ts, T0 + 100000 * MS);
+}
+
+TEST(FusionTest, capacity) {
+    auto info = sensor::default_sensor_info(sensor::MODE_512x10);
+    const size_t h = info.format.pixels_per_column;
+    Clouds out;
+    ScanFuser fuser{{{info}}, config(), out.handler()};
+    EXPECT_EQ(fuser.capacity(), 514 * h);
+
+    // twice as many columns as the lidar mode measures in a window
+    fuser.add(0, make_scan(info, T0, 50 * MS));
+    fuser.add(0, make_scan(info, T0 + 50 * MS, 50 * MS));
+    fuser.flush();
+    ASSERT_EQ(out.clouds.size(), 1u);
+    EXPECT_EQ(out.clouds[0].size, fuser.capacity());
+    EXPECT_EQ(fuser.stats().dropped_points, (1024 - 514) * h);
+}
+
+TEST(FusionTest, invalid_arguments) {
+    const auto info = sensor::default_sensor_info(sensor::MODE_512x10);
+    EXPECT_THROW(ScanFuser({}, config(), {}), std::invalid_argument);
+    FuserConfig bad = config();
+    bad.window_ns = 0;
+    EXPECT_THROW(ScanFuser({{info}}, bad, {}), std::invalid_argument);
+    EXPECT_THROW(ScanFuser({{info}}, config(0, 0), {}),
+                 std::invalid_argument);
+
+    ScanFuser fuser{{{info}}, config(), {}};
+    auto ls = make_scan(info, T0, 100 * MS);
+    EXPECT_THROW(fuser.add(1, ls), std::out_of_range);
+    EXPECT_THROW(fuser.add(0, LidarScan{1024, 64}), std::invalid_argument);
+    ls.destaggered = true;
+    EXPECT_THROW(fuser.add(0, ls), std::invalid_argument);
+    EXPECT_EQ(fuser.stats().scans, 0u);
+}
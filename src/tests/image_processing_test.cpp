@@ -0,0 +1,151 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/image_processing.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "ouster/types.h"
+
+using namespace ouster;
+
+namespace {
+
+// the sampled pixels that AutoExposure looks at
+template <typename T>
+std::vector<T> nonzero_samples(const img_t<T>& img) {
+    std::vector<T> res;
+    for (int i = 0; i < img.size(); i += 4)
+        if (img.data()[i] > 0) res.push_back(img.data()[i]);
+    return res;
+}
+
+}  // namespace
+
+template <typename T>
+class ImageProcessingTest : public ::testing::Test {};
+
+using FloatTypes = ::testing::Types<float, double>;
+TYPED_TEST_CASE(ImageProcessingTest, FloatTypes);
+
+TYPED_TEST(ImageProcessingTest, auto_exposure_percentiles) {
+    using T = TypeParam;
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<T> dist(100, 1000);
+    std::uniform_int_distribution<int> dropout(0, 9);
+
+    img_t<T> img(64, 1024);
+    for (int i = 0; i < img.size(); i++)
+        img.data()[i] = dropout(gen) == 0 ? T{0} : dist(gen);
+    const img_t<T> orig = img;
+
+    // reference percentiles by sorting
+    auto samples = nonzero_samples(orig);
+    std::sort(samples.begin(), samples.end());
+    const double lo_p = 0.05, hi_p = 0.1;
+    const double lo = samples[static_cast<size_t>(samples.size() * lo_p)];
+    const double hi =
+        samples[samples.size() - static_cast<size_t>(samples.size() * hi_p) -
+                1];
+
+    viz::AutoExposure ae(lo_p, hi_p, 1);
+    ae(img);
+
+    const double scale = (1.0 - (lo_p + hi_p)) / (hi - lo);
+    for (int i = 0; i < img.size(); i++) {
+        const double x = orig.data()[i];
+        const double expected =
+            std::min(std::max((x - lo) * scale + lo_p, 0.0), 1.0);
+        ASSERT_NEAR(img.data()[i], expected, 1e-5) << "pixel " << i;
+    }
+}
+
+TYPED_TEST(ImageProcessingTest, auto_exposure_too_few_points) {
+    using T = TypeParam;
+    img_t<T> img = img_t<T>::Zero(16, 64);
+    img(0, 0) = 5;
+    const img_t<T> orig = img;
+
+    viz::AutoExposure ae;
+    ae(img);
+    EXPECT_TRUE((img == orig).all());
+}
+
+TYPED_TEST(ImageProcessingTest, auto_exposure_scaling_of_raw_fields) {
+    using T = TypeParam;
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<uint32_t> dist(0, 5000);
+
+    img_t<uint32_t> field(64, 1024);
+    for (int i = 0; i < field.size(); i++) field.data()[i] = dist(gen);
+
+    // scaling raw fields should match scaling them in place, over frames
+    viz::AutoExposure in_place, scaled;
+    for (int frame = 0; frame < 5; frame++) {
+        img_t<T> img = field.cast<T>();
+        in_place(img);
+
+        double scale = 0, offset = 0;
+        ASSERT_TRUE(scaled.scaling(field, scale, offset));
+        for (int i = 0; i < img.size(); i++) {
+            const double x = field.data()[i] * scale + offset;
+            ASSERT_NEAR(img.data()[i], std::min(std::max(x, 0.0), 1.0), 1e-5)
+                << "frame " << frame << " pixel " << i;
+        }
+        field = (field + 97).eval();
+    }
+
+    // nothing to scale with too few nonzero values
+    viz::AutoExposure empty;
+    double scale = 3, offset = 4;
+    EXPECT_FALSE(empty.scaling(img_t<uint32_t>::Zero(16, 64), scale, offset));
+    EXPECT_EQ(scale, 3);
+    EXPECT_EQ(offset, 4);
+}
+
+TYPED_TEST(ImageProcessingTest, beam_uniformity_removes_row_offsets) {
+    using T = TypeParam;
+    const int h = 32, w = 512;
+    std::mt19937 gen(4);
+    std::normal_distribution<T> noise(50, 2);
+
+    // rows with offsets, with masked columns
+    img_t<T> img(h, w);
+    for (int u = 0; u < h; u++)
+        for (int v = 0; v < w; v++)
+            img(u, v) = v < 64 ? T{0} : noise(gen) + 10 * (u % 3);
+    auto row_spread = [&](const img_t<T>& im) {
+        const auto means = im.rightCols(w - 64).rowwise().mean().eval();
+        return means.maxCoeff() - means.minCoeff();
+    };
+    EXPECT_GT(row_spread(img), 15);
+
+    img_t<T> all = img;
+    viz::BeamUniformityCorrector buc;
+    buc(all);
+    EXPECT_LT(row_spread(all), 2);
+    EXPECT_TRUE((all.leftCols(64) == 0).all());
+
+    // subsampling columns is nearly as good, on any number of threads
+    img_t<T> strided = img, threaded = img;
+    viz::BeamUniformityCorrector buc_strided(1, 4);
+    viz::BeamUniformityCorrector buc_threaded(1, 4, 3);
+    for (int i = 0; i < 4; i++) {
+        strided = img;
+        threaded = img;
+        buc_strided(strided);
+        buc_threaded(threaded);
+    }
+    EXPECT_LT(row_spread(strided), 2);
+    EXPECT_TRUE((strided == threaded).all());
+
+    EXPECT_THROW(viz::BeamUniformityCorrector(0, 1), std::invalid_argument);
+    EXPECT_THROW(viz::BeamUniformityCorrector(1, 1, 0), std::invalid_argument);
+}
@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/imu.h"
+
+#include <gtest/gtest.h>
+
+#include <Eigen/Geometry>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+
+namespace {
+
+constexpr uint64_t MS = 1000000;
+constexpr double standard_g = 9.80665;
+
+// an imu packet in the layout of packet_format
+std::array<uint8_t, 48> imu_packet(uint64_t ts, std::array<float, 3> la,
+                                   std::array<float, 3> av) {
+    std::array<uint8_t, 48> buf{};
+    const uint64_t sys_ts = ts + 1, accel_ts = ts - 1;
+    std::memcpy(buf.data(), &sys_ts, 8);
+    std::memcpy(buf.data() + 8, &accel_ts, 8);
+    std::memcpy(buf.data() + 16, &ts, 8);
+    std::memcpy(buf.data() + 24, la.data(), 12);
+    std::memcpy(buf.data() + 36, av.data(), 12);
+    return buf;
+}
+
+// a scan with valid columns evenly spread over [t0, t0 + 100ms)
+LidarScan make_scan(const sensor::sensor_info& info, uint64_t t0) {
+    const size_t w = info.format.columns_per_frame;
+    LidarScan ls{w, info.format.pixels_per_column,
+                 info.format.udp_profile_lidar};
+    for (size_t v = 0; v < w; v++) ls.timestamp()[v] = t0 + v * 100 * MS / w;
+    ls.status().setConstant(1);
+    return ls;
+}
+
+void feed(ImuBatcher& batcher, uint64_t begin, uint64_t end,
+          std::array<float, 3> la, std::array<float, 3> av) {
+    for (uint64_t t = begin; t < end; t += 10 * MS)
+        batcher(imu_packet(t, la, av).data());
+}
+
+}  // namespace
+
+TEST(ImuTest, batches_samples_covering_scans) {
+    const auto info = sensor::default_sensor_info(sensor::MODE_512x10);
+    ImuBatcher batcher{info};
+    ImuSeries series;
+
+    // no samples at or after the end of the first scan yet
+    auto scan = make_scan(info, 1000 * MS);
+    scan.status()[0] = 0;
+    feed(batcher, 985 * MS, 1095 * MS, {0, 0, 1}, {1, 2, 3});
+    EXPECT_FALSE(batcher(scan, series));
+    EXPECT_EQ(series.size(), 0u);
+
+    feed(batcher, 1095 * MS, 1255 * MS, {0, 0, 1}, {1, 2, 3});
+    ASSERT_TRUE(batcher(scan, series));
+    ASSERT_EQ(series.size(), 12u);
+    EXPECT_EQ(series.gyro_ts[0], 995 * MS);
+    EXPECT_EQ(series.gyro_ts[11], 1105 * MS);
+    EXPECT_EQ(series.sys_ts[0], 995 * MS + 1);
+    EXPECT_EQ(series.accel_ts[0], 995 * MS - 1);
+    EXPECT_TRUE((series.acceleration.col(2) == 1).all());
+    EXPECT_TRUE((series.angular_velocity.col(1) == 2).all());
+
+    // the next scan starts from the last sample before its first column
+    ASSERT_TRUE(batcher(make_scan(info, 1100 * MS), series));
+    EXPECT_EQ(series.gyro_ts[0], 1095 * MS);
+    EXPECT_EQ(series.gyro_ts[series.size() - 1], 1205 * MS);
+    EXPECT_EQ(batcher.size(), 6u);
+
+    // scans without valid columns have no samples
+    scan.status().setZero();
+    EXPECT_FALSE(batcher(scan, series));
+    EXPECT_EQ(batcher.dropped(), 0u);
+}
+
+TEST(ImuTest, drops_samples) {
+    const auto info = sensor::default_sensor_info(sensor::MODE_512x10);
+    ImuBatcher batcher{info, 4};
+    EXPECT_TRUE(batcher(imu_packet(10 * MS, {}, {}).data()));
+    EXPECT_FALSE(batcher(imu_packet(10 * MS, {}, {}).data()));
+    EXPECT_FALSE(batcher(imu_packet(5 * MS, {}, {}).data()));
+    feed(batcher, 20 * MS, 70 * MS, {}, {});
+    EXPECT_EQ(batcher.size(), 4u);
+    EXPECT_EQ(batcher.dropped(), 4u);
+    EXPECT_THROW(ImuBatcher(info, 1), std::invalid_argument);
+}
+
+TEST(ImuTest, preintegrates_rotation) {
+    const auto info = sensor::default_sensor_info(sensor::MODE_512x10);
+    const size_t w = info.format.columns_per_frame;
+    ImuBatcher batcher{info};
+    feed(batcher, 990 * MS, 1120 * MS, {0, 0, 0}, {0, 0, 90});
+
+    auto scan = make_scan(info, 1000 * MS);
+    scan.status()[7] = 0;
+    ImuSeries series;
+    ASSERT_TRUE(batcher(scan, series));
+    const uint64_t ref_ts = scan.timestamp()[w / 2];
+    ImuDeltas deltas;
+    preintegrate(scan, series, ref_ts, deltas);
+    ASSERT_EQ(deltas.rotation.rows(), static_cast<int>(w));
+
+    for (size_t v = 0; v < w; v++) {
+        const auto& r = deltas.rotation;
+        const Eigen::Quaterniond q{r(v, 3), r(v, 0), r(v, 1), r(v, 2)};
+        const double dt = (double(scan.timestamp()[v]) - ref_ts) * 1e-9;
+        const Eigen::Quaterniond expected{
+            Eigen::AngleAxisd(v == 7 ? 0 : dt * M_PI / 2,
+                              Eigen::Vector3d::UnitZ())};
+        EXPECT_NEAR(q.angularDistance(expected), 0, 1e-9) << v;
+        EXPECT_TRUE((deltas.velocity.row(v) == 0).all());
+        EXPECT_TRUE((deltas.position.row(v) == 0).all());
+    }
+}
+
+TEST(ImuTest, preintegrates_acceleration) {
+    const auto info = sensor::default_sensor_info(sensor::MODE_512x10);
+    const size_t w = info.format.columns_per_frame;
+    ImuBatcher batcher{info};
+    // at rest, measuring gravity, accelerating forward at half a g
+    feed(batcher, 990 * MS, 1120 * MS, {0.5, 0, 1}, {0, 0, 0});
+
+    const auto scan = make_scan(info, 1000 * MS);
+    ImuSeries series;
+    ASSERT_TRUE(batcher(scan, series));
+    const uint64_t ref_ts = scan.timestamp()[0];
+    ImuDeltas deltas;
+    preintegrate(scan, series, ref_ts, deltas);
+
+    for (size_t v = 0; v < w; v += 17) {
+        const double dt = (double(scan.timestamp()[v]) - ref_ts) * 1e-9;
+        EXPECT_NEAR(deltas.velocity(v, 0), 0.5 * standard_g * dt, 1e-9);
+        EXPECT_NEAR(deltas.velocity(v, 1), 0, 1e-9);
+        EXPECT_NEAR(deltas.velocity(v, 2), standard_g * dt, 1e-9);
+        EXPECT_NEAR(deltas.position(v, 0), 0.25 * standard_g * dt * dt, 1e-9);
+        EXPECT_NEAR(deltas.position(v, 2), 0.5 * standard_g * dt * dt, 1e-9);
+        EXPECT_NEAR(deltas.rotation(v, 3), 1, 1e-12);
+    }
+
+    EXPECT_THROW(preintegrate(scan, ImuSeries{}, ref_ts, deltas),
+                 std::invalid_argument);
+}
@@ -0,0 +1,190 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/ingest.h"
+
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+
+namespace {
+
+/*
+ * Build a legacy lidar packet holding columns starting at m_id_start
+ */
+std::vector<uint8_t> make_packet(const packet_format& pf, uint16_t frame_id,
+                                 uint16_t m_id_start) {
+    std::vector<uint8_t> buf(pf.lidar_packet_size, 0);
+    const size_t col_size =
+        pf.nth_col(1, buf.data()) - pf.nth_col(0, buf.data());
+    for (int icol = 0; icol < pf.columns_per_packet; icol++) {
+        auto col_buf = const_cast<uint8_t*>(pf.nth_col(icol, buf.data()));
+        uint64_t ts = 1000 + m_id_start + icol;
+        uint16_t m_id = m_id_start + icol;
+        uint32_t status = 0xffffffff;
+        std::memcpy(col_buf, &ts, sizeof(ts));
+        std::memcpy(col_buf + 8, &m_id, sizeof(m_id));
+        std::memcpy(col_buf + 10, &frame_id, sizeof(frame_id));
+        std::memcpy(col_buf + col_size - 4, &status, sizeof(status));
+    }
+    return buf;
+}
+
+// send a datagram from src_ip to localhost:port
+void send_from(const char* src_ip, int port, const std::vector<uint8_t>& buf) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(fd, 0);
+
+    sockaddr_in src{};
+    src.sin_family = AF_INET;
+    inet_pton(AF_INET, src_ip, &src.sin_addr);
+    ASSERT_EQ(bind(fd, (sockaddr*)&src, sizeof(src)), 0);
+
+    sockaddr_in dst{};
+    dst.sin_family = AF_INET;
+    dst.sin_port = htons(port);
+    dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    auto sent =
+        sendto(fd, buf.data(), buf.size(), 0, (sockaddr*)&dst, sizeof(dst));
+    close(fd);
+    ASSERT_EQ(sent, (ssize_t)buf.size());
+
+    // don't overrun the socket receive buffer
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+class IngestEngineTest : public ::testing::TestWithParam<int> {
+   protected:
+    // send frames [1, n_frames] followed by the first packet of the next
+    void send_frames(const char* src_ip, int port, int n_frames) {
+        for (uint16_t f_id = 1; f_id <= n_frames + 1; f_id++) {
+            for (size_t m_id = 0; m_id < info.format.columns_per_frame;
+                 m_id += pf.columns_per_packet) {
+                send_from(src_ip, port, make_packet(pf, f_id, m_id));
+                if (f_id > n_frames) break;
+            }
+        }
+    }
+
+    ingest::ScanHandler handler() {
+        return [this](int id, LidarScanPool::Handle scan) {
+            std::lock_guard<std::mutex> lock{mtx};
+            received.emplace_back(id, scan->frame_id);
+        };
+    }
+
+    // wait until n scans were received or time out
+    size_t wait_for(size_t n) {
+        for (int i = 0; i < 200; i++) {
+            {
+                std::lock_guard<std::mutex> lock{mtx};
+                if (received.size() >= n) return received.size();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::lock_guard<std::mutex> lock{mtx};
+        return received.size();
+    }
+
+    const sensor_info info = default_sensor_info(MODE_512x10);
+    const packet_format& pf = get_format(info);
+    std::mutex mtx;
+    std::vector<std::pair<int, int32_t>> received;
+};
+
+}  // namespace
+
+INSTANTIATE_TEST_CASE_P(Threads, IngestEngineTest, ::testing::Values(1, 2));
+
+TEST_P(IngestEngineTest, demux_by_source) {
+    ingest::EngineConfig config;
+    config.n_threads = GetParam();
+    ingest::Engine engine(config);
+
+    int a = engine.add_sensor("127.0.0.1", 0, info, handler());
+    int port = engine.get_port(a);
+    ASSERT_GT(port, 0);
+    int b = engine.add_sensor("127.0.0.2", port, info, handler());
+    EXPECT_EQ(engine.get_port(b), port);
+    engine.start();
+
+    send_frames("127.0.0.1", port, 2);
+    send_frames("127.0.0.2", port, 1);
+    send_from("127.0.0.3", port, make_packet(pf, 1, 0));
+    send_from("127.0.0.2", port, std::vector<uint8_t>(100));
+
+    EXPECT_EQ(wait_for(3), 3u);
+    engine.stop();
+
+    std::vector<int32_t> frames_a, frames_b;
+    for (const auto& r : received)
+        (r.first == a ? frames_a : frames_b).push_back(r.second);
+    EXPECT_EQ(frames_a, (std::vector<int32_t>{1, 2}));
+    EXPECT_EQ(frames_b, (std::vector<int32_t>{1}));
+
+    const size_t packets_per_frame =
+        info.format.columns_per_frame / pf.columns_per_packet;
+    EXPECT_EQ(engine.get_stats(a).packets, 2 * packets_per_frame + 1);
+    EXPECT_EQ(engine.get_stats(a).scans, 2u);
+    EXPECT_EQ(engine.get_stats(b).packets, packets_per_frame + 2);
+    EXPECT_EQ(engine.get_stats(b).bad_packets, 1u);
+    EXPECT_EQ(engine.unknown_packets(), 1u);
+}
+
+TEST_P(IngestEngineTest, any_source_fallback) {
+    ingest::EngineConfig config;
+    config.n_threads = GetParam();
+    ingest::Engine engine(config);
+
+    int a = engine.add_sensor("127.0.0.1", 0, info, handler());
+    int port = engine.get_port(a);
+    int any = engine.add_sensor("", port, info, handler());
+    engine.start();
+
+    send_frames("127.0.0.3", port, 1);
+    EXPECT_EQ(wait_for(1), 1u);
+    engine.stop();
+
+    ASSERT_EQ(received.size(), 1u);
+    EXPECT_EQ(received[0].first, any);
+    EXPECT_EQ(engine.get_stats(a).packets, 0u);
+    EXPECT_EQ(engine.unknown_packets(), 0u);
+}
+
+TEST(IngestEngineConfigTest, duplicate_sensor) {
+    const auto info = default_sensor_info(MODE_512x10);
+    auto noop = [](int, LidarScanPool::Handle) {};
+    ingest::Engine engine;
+
+    int a = engine.add_sensor("127.0.0.1", 0, info, noop);
+    int port = engine.get_port(a);
+    EXPECT_THROW(engine.add_sensor("127.0.0.1", port, info, noop),
+                 std::invalid_argument);
+    engine.add_sensor("", port, info, noop);
+    EXPECT_THROW(engine.add_sensor("", port, info, noop),
+                 std::invalid_argument);
+
+    engine.start();
+    EXPECT_THROW(engine.add_sensor("127.0.0.2", port, info, noop),
+                 std::invalid_argument);
+}
@@ -64,6 +64,14 @@ struct set_field_data {
     }
 };
 
+struct set_random_data {
+    template <typename T>
+    void operator()(Eigen::Ref<ouster::img_t<T>> field) {
+        for (int i = 0; i < field.size(); i++)
+            field.data()[i] = static_cast<T>(rand());
+    }
+};
+
 struct check_field_data {
     template <typename T>
     void operator()(Eigen::Ref<ouster::img_t<T>> field, int data) {
@@ -326,6 +334,104 @@ TEST(LidarScan, DataCheck) {
     }
 }
 
+TEST(LidarScan, Arena) {
+    const size_t w = 512, h = 64;
+    const auto profile = UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL;
+    auto scan1 = ouster::LidarScan(w, h, profile);
+    for (const auto& ft : scan1)
+        ouster::impl::visit_field(scan1, ft.first, set_random_data());
+    scan1.timestamp().setLinSpaced(1, 512);
+    scan1.frame_id = 7;
+
+    const size_t size = ouster::LidarScan::arena_size(w, h, profile);
+    EXPECT_EQ(scan1.arena_size(), size);
+    EXPECT_EQ(ouster::LidarScan::arena_size(w, h, dual_field_slots.begin(),
+                                            dual_field_slots.end()),
+              size);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(scan1.arena()) %
+                  ouster::LidarScan::arena_alignment,
+              0u);
+    for (const auto& ft : scan1) {
+        const uint8_t* data = nullptr;
+        ouster::impl::visit_field(scan1, ft.first, [&](auto f) {
+            data = reinterpret_cast<const uint8_t*>(f.data());
+        });
+        EXPECT_GE(data, scan1.arena());
+        EXPECT_LT(data, scan1.arena() + size);
+    }
+
+    // a caller supplied arena is zeroed, and assigning copies into it
+    std::vector<uint64_t> memory(size / sizeof(uint64_t), ~0ull);
+    auto arena = reinterpret_cast<uint8_t*>(memory.data());
+    auto scan2 = ouster::LidarScan(w, h, profile, arena, size);
+    EXPECT_FALSE(scan2.owns_arena());
+    EXPECT_EQ(scan2.arena(), arena);
+    zero_check_fields(scan2);
+    scan2 = scan1;
+    EXPECT_EQ(scan2.arena(), arena);
+    EXPECT_TRUE(scan2 == scan1);
+
+    // copies own their arena
+    auto scan3 = scan2;
+    EXPECT_TRUE(scan3.owns_arena());
+    EXPECT_NE(scan3.arena(), arena);
+    EXPECT_TRUE(scan3 == scan1);
+
+    // moving leaves an empty scan behind
+    auto scan4 = std::move(scan3);
+    EXPECT_TRUE(scan4 == scan1);
+    EXPECT_EQ(scan3.arena(), nullptr);
+    EXPECT_EQ(scan3.w, 0);
+    EXPECT_EQ(scan3.end() - scan3.begin(), 0);
+    EXPECT_THROW(scan3.field(ChanField::RANGE), std::out_of_range);
+
+    // assigning a scan of another layout replaces the arena
+    scan2 = ouster::LidarScan(w, h);
+    EXPECT_TRUE(scan2.owns_arena());
+    EXPECT_NE(scan2.arena(), arena);
+
+    EXPECT_THROW(ouster::LidarScan(w, h, profile, arena, size - 1),
+                 std::invalid_argument);
+    EXPECT_THROW(ouster::LidarScan(w, h, profile, arena + 1, size),
+                 std::invalid_argument);
+    EXPECT_THROW(scan1.field(ChanField::CUSTOM0), std::out_of_range);
+    EXPECT_THROW(scan1.field<uint16_t>(ChanField::RANGE),
+                 std::invalid_argument);
+}
+
+TEST(LidarScan, ArenaPaddingEquality) {
+    // odd dimensions, so that blocks of the arena are followed by padding
+    const size_t w = 100, h = 3;
+    const auto profile = UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL;
+    const size_t size = ouster::LidarScan::arena_size(w, h, profile);
+    const size_t align = ouster::LidarScan::arena_alignment;
+    std::vector<uint8_t> memory1(size + align, 0x00),
+        memory2(size + align, 0xff);
+    auto aligned = [&](std::vector<uint8_t>& m) {
+        const auto p = reinterpret_cast<uintptr_t>(m.data());
+        return m.data() + (align - p % align) % align;
+    };
+
+    // views of arenas holding different bytes, with the same contents
+    auto scan1 = ouster::LidarScan(w, h, profile, aligned(memory1), size,
+                                   false);
+    auto scan2 = ouster::LidarScan(w, h, profile, aligned(memory2), size,
+                                   false);
+    for (auto* scan : {&scan1, &scan2}) {
+        for (const auto& ft : *scan)
+            ouster::impl::visit_field(*scan, ft.first,
+                                      [](auto f) { f.setConstant(3); });
+        scan->timestamp().setLinSpaced(1, 512);
+        scan->measurement_id().setZero();
+        scan->status().setConstant(1);
+        scan->rx_timestamp().setZero();
+    }
+    EXPECT_TRUE(scan1 == scan2);
+
+    scan2.field<uint8_t>(ChanField::REFLECTIVITY)(h - 1, w - 1) = 4;
+    EXPECT_FALSE(scan1 == scan2);
+}
+
 TEST(LidarScan, CustomUserFields) {
     using LidarScanFieldTypes = std::vector<
         std::pair<ouster::sensor::ChanField, ouster::sensor::ChanFieldType>>;
@@ -341,3 +447,383 @@ TEST(LidarScan, CustomUserFields) {
 
     zero_check_fields(user_scan);
 }
+
+TEST(LidarScan, CartesianInto) {
+    const size_t w = 512;
+    const size_t h = 64;
+    const auto info = default_sensor_info(MODE_512x10);
+    const auto lut = ouster::make_xyz_lut(info);
+    const auto lutf = ouster::make_xyz_lutf(lut);
+
+    ouster::LidarScan scan(w, h);
+    auto range = scan.field(ChanField::RANGE);
+    for (size_t i = 0; i < w * h; i++)
+        range.data()[i] = (i % 7 == 0) ? 0 : rand() % 100000;
+    for (size_t v = 0; v < w; v++) scan.status()[v] = v % 5 ? 0x01 : 0x00;
+
+    // double precision output is exactly the same
+    const auto expected = ouster::cartesian(scan, lut);
+    std::vector<double> xyz(w * h * 3);
+    ouster::cartesian_into(scan, lut, xyz.data());
+    EXPECT_TRUE(
+        (Eigen::Map<const Eigen::Array<double, -1, 3, Eigen::RowMajor>>(
+             xyz.data(), w * h, 3) == expected)
+            .all());
+
+    // single precision output, with components left after xyz untouched
+    std::vector<float> xyzw(w * h * 4, -1.0f);
+    ouster::cartesian_into(scan, lutf, xyzw.data(), 4);
+    for (size_t i = 0; i < w * h; i++) {
+        for (size_t c = 0; c < 3; c++)
+            EXPECT_NEAR(xyzw[i * 4 + c], expected(i, c), 1e-4);
+        EXPECT_EQ(xyzw[i * 4 + 3], -1.0f);
+    }
+
+    EXPECT_THROW(ouster::cartesian_into(scan, lutf, xyzw.data(), 2),
+                 std::invalid_argument);
+    ouster::LidarScan small(w / 2, h);
+    EXPECT_THROW(ouster::cartesian_into(small, lutf, xyzw.data()),
+                 std::invalid_argument);
+}
+
+TEST(LidarScan, CartesianIgnoresStatus) {
+    const size_t w = 512;
+    const size_t h = 64;
+    auto info = default_sensor_info(MODE_512x10);
+    info.format.column_window = {0, 20};
+    const auto lut = ouster::make_xyz_lut(info);
+
+    // filled by hand, without the status of any column set
+    ouster::LidarScan scan(w, h);
+    auto range = scan.field(ChanField::RANGE);
+    for (size_t i = 0; i < w * h; i++) range.data()[i] = 1000 + i % 100000;
+    EXPECT_FALSE(scan.stale_columns());
+
+    const auto expected = ouster::cartesian(range, lut);
+    EXPECT_TRUE((expected != 0).any());
+    EXPECT_TRUE((ouster::cartesian(scan, lut) == expected).all());
+
+    std::vector<double> xyz(w * h * 3);
+    ouster::cartesian_into(scan, lut, xyz.data());
+    EXPECT_TRUE(
+        (Eigen::Map<const Eigen::Array<double, -1, 3, Eigen::RowMajor>>(
+             xyz.data(), w * h, 3) == expected)
+            .all());
+
+    std::vector<float> xyzf(w * h * 3);
+    ouster::cartesian_into(scan, {ChanField::RANGE},
+                           ouster::make_xyz_lutf(lut),
+                           std::vector<float*>{xyzf.data()});
+    for (size_t i = 0; i < w * h; i++)
+        for (size_t c = 0; c < 3; c++)
+            EXPECT_NEAR(xyzf[i * 3 + c], expected(i, c), 1e-3);
+
+    const auto region = ouster::make_scan_region(info);
+    const auto points = ouster::cartesian(
+        scan, region, ouster::slice_xyz_lut(lut, w, region));
+    const size_t nc = region.cols.size();
+    for (size_t j = 0; j < region.rows.size(); j++)
+        for (size_t k = 0; k < nc; k++)
+            EXPECT_TRUE((points.row(j * nc + k) ==
+                         expected.row(region.rows[j] * w + region.cols[k]))
+                            .all());
+}
+
+TEST(LidarScan, CartesianIntoMultipleReturns) {
+    const size_t w = 512;
+    const size_t h = 64;
+    const auto lut = ouster::make_xyz_lut(default_sensor_info(MODE_512x10));
+
+    ouster::LidarScan scan(w, h, PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL);
+    for (auto f : {ChanField::RANGE, ChanField::RANGE2}) {
+        auto range = scan.field(f);
+        for (size_t i = 0; i < w * h; i++) range.data()[i] = rand() % 100000;
+    }
+    for (size_t v = 0; v < w; v++) scan.status()[v] = v % 3 ? 0x01 : 0x00;
+
+    std::vector<double> first(w * h * 4), second(w * h * 4);
+    ouster::cartesian_into(scan, {ChanField::RANGE, ChanField::RANGE2}, lut,
+                           std::vector<double*>{first.data(), second.data()},
+                           4);
+
+    // same as projecting each return on its own
+    std::vector<double> expected(w * h * 4);
+    ouster::cartesian_into(scan, lut, expected.data(), 4);
+    EXPECT_EQ(first, expected);
+
+    ouster::LidarScan scan2(w, h);
+    scan2.field(ChanField::RANGE) = scan.field(ChanField::RANGE2);
+    scan2.status() = scan.status();
+    ouster::cartesian_into(scan2, lut, expected.data(), 4);
+    EXPECT_EQ(second, expected);
+
+    // or row by row
+    std::vector<double> rows(w * h * 4);
+    std::vector<double*> rows_out{rows.data()};
+    for (size_t u = 0; u < h; u++)
+        ouster::cartesian_into(scan, {ChanField::RANGE2}, lut, rows_out, 4, u,
+                               u + 1);
+    EXPECT_EQ(rows, second);
+
+    EXPECT_THROW(ouster::cartesian_into(scan, {ChanField::RANGE}, lut,
+                                        std::vector<double*>{}),
+                 std::invalid_argument);
+    EXPECT_THROW(ouster::cartesian_into(scan, {ChanField::RANGE}, lut,
+                                        rows_out, 4, 0, h + 1),
+                 std::invalid_argument);
+    EXPECT_THROW(ouster::cartesian_into(scan, {ChanField::SIGNAL2}, lut,
+                                        rows_out),
+                 std::invalid_argument);
+    EXPECT_THROW(ouster::cartesian_into(scan, {ChanField::CUSTOM0}, lut,
+                                        rows_out),
+                 std::out_of_range);
+}
+
+TEST(LidarScan, Destaggerer) {
+    const size_t w = 1024;
+    const size_t h = 64;
+    auto info = default_sensor_info(MODE_1024x10);
+    info.format.pixel_shift_by_row.resize(h);
+    for (size_t u = 0; u < h; u++)
+        info.format.pixel_shift_by_row[u] = static_cast<int>(u * 37) - 700;
+
+    ouster::LidarScan scan(w, h, PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL);
+    for (auto it = scan.begin(); it != scan.end(); it++)
+        ouster::impl::visit_field(scan, it->first, set_random_data());
+
+    const auto& shifts = info.format.pixel_shift_by_row;
+    const ouster::Destaggerer destagger(info);
+    const ouster::Destaggerer stagger(info, true);
+    EXPECT_EQ(destagger.h(), h);
+    EXPECT_EQ(destagger.w(), w);
+
+    // images match destagger()
+    const auto range = scan.field(ChanField::RANGE);
+    ouster::img_t<uint32_t> out(h, w), back(h, w);
+    destagger(range, out);
+    EXPECT_TRUE((out == ouster::destagger<uint32_t>(range, shifts)).all());
+    stagger(out, back);
+    EXPECT_TRUE((back == range).all());
+
+    // as do fields of scans, with or without threads
+    ouster::LidarScan dest(w, h, PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL);
+    const std::vector<ChanField> fields{ChanField::RANGE, ChanField::SIGNAL,
+                                        ChanField::REFLECTIVITY2};
+    for (int n_threads : {1, 3}) {
+        dest.field(ChanField::RANGE).setZero();
+        destagger(scan, fields, dest, n_threads);
+        EXPECT_TRUE((dest.field(ChanField::RANGE) == out).all());
+        EXPECT_TRUE(
+            (dest.field<uint16_t>(ChanField::SIGNAL) ==
+             ouster::destagger<uint16_t>(
+                 scan.field<uint16_t>(ChanField::SIGNAL), shifts))
+                .all());
+        EXPECT_TRUE(
+            (dest.field<uint8_t>(ChanField::REFLECTIVITY2) ==
+             ouster::destagger<uint8_t>(
+                 scan.field<uint8_t>(ChanField::REFLECTIVITY2), shifts))
+                .all());
+    }
+
+    // pixels of several channels
+    std::vector<uint32_t> xyz(w * h * 3), xyz_out(w * h * 3);
+    for (size_t i = 0; i < xyz.size(); i++) xyz[i] = rand();
+    destagger(xyz.data(), xyz_out.data(), 3 * sizeof(uint32_t));
+    for (size_t u = 0; u < h; u++)
+        for (size_t v = 0; v < w; v++)
+            for (size_t c = 0; c < 3; c++)
+                EXPECT_EQ(xyz_out[(u * w + (v + destagger.offset(u)) % w) * 3 +
+                                  c],
+                          xyz[(u * w + v) * 3 + c]);
+
+    ouster::LidarScan legacy(w, h);
+    EXPECT_THROW(destagger(scan, {ChanField::SIGNAL}, legacy),
+                 std::invalid_argument);
+    EXPECT_THROW(destagger(scan, {ChanField::CUSTOM0}, dest),
+                 std::out_of_range);
+    ouster::LidarScan small(w / 2, h);
+    EXPECT_THROW(destagger(small, {ChanField::RANGE}, small),
+                 std::invalid_argument);
+    ouster::img_t<uint32_t> small_img(h, w / 2);
+    EXPECT_THROW(destagger(range, small_img), std::invalid_argument);
+}
+
+TEST(LidarScan, SharedXYZLut) {
+    auto info = default_sensor_info(MODE_1024x10);
+
+    // the same metadata get the same tables, matching make_xyz_lut
+    auto lut = ouster::shared_xyz_lut(info);
+    auto copy = info;
+    copy.sn = "another serial number";
+    EXPECT_EQ(ouster::shared_xyz_lut(copy), lut);
+
+    const auto expected = ouster::make_xyz_lut(info);
+    EXPECT_TRUE((lut->direction == expected.direction).all());
+    EXPECT_TRUE((lut->offset == expected.offset).all());
+
+    auto lutf = ouster::shared_xyz_lutf(info);
+    EXPECT_EQ(ouster::shared_xyz_lutf(info), lutf);
+    EXPECT_TRUE((lutf->direction == expected.direction.cast<float>()).all());
+
+    // anything affecting projection doesn't
+    auto moved = info;
+    moved.lidar_to_sensor_transform(2, 3) += 1;
+    auto moved_lut = ouster::shared_xyz_lut(moved);
+    EXPECT_NE(moved_lut, lut);
+    EXPECT_TRUE(
+        (moved_lut->offset == ouster::make_xyz_lut(moved).offset).all());
+    EXPECT_NE(ouster::shared_xyz_lut(info, true), lut);
+    EXPECT_NE(ouster::shared_xyz_lut(default_sensor_info(MODE_512x10)), lut);
+
+    // tables are dropped when no longer used
+    std::weak_ptr<const ouster::XYZLut> weak = moved_lut;
+    moved_lut.reset();
+    EXPECT_TRUE(weak.expired());
+}
+
+TEST(LidarScan, DeskewedCartesian) {
+    const size_t w = 512;
+    const size_t h = 64;
+    const auto info = default_sensor_info(MODE_512x10);
+    const auto lut = ouster::make_xyz_lut(info);
+
+    ouster::LidarScan scan(w, h);
+    auto range = scan.field(ChanField::RANGE);
+    for (size_t i = 0; i < w * h; i++)
+        range.data()[i] = (i % 7 == 0) ? 0 : rand() % 100000;
+    for (size_t v = 0; v < w; v++) {
+        scan.status()[v] = v % 5 ? 0x01 : 0x00;
+        scan.timestamp()[v] = 1000000000 + v * 100000000 / w;
+    }
+
+    // identity poses give the same points as cartesian(), with the columns
+    // not marked valid zeroed
+    auto points = ouster::cartesian(scan, lut);
+    for (size_t i = 0; i < w * h; i++)
+        if (!(scan.status()[i % w] & 0x01)) points.row(i).setZero();
+    const std::vector<ouster::mat4d> identity(w, ouster::mat4d::Identity());
+    EXPECT_TRUE((ouster::deskewed_cartesian(scan, lut, identity) == points)
+                    .all());
+
+    // spinning about z at 90 deg/s, deskewed to the middle of the frame
+    const uint64_t ref_ts = scan.timestamp()[w / 2];
+    std::vector<ouster::ImuSample> imu;
+    for (uint64_t t = 990000000; t < 1110000000; t += 10000000)
+        imu.push_back({t, {0, 0, 90}});
+    const auto poses = ouster::imu_column_poses(
+        scan, imu, ouster::mat4d::Identity(), ref_ts);
+    const auto expected_poses = ouster::column_poses(scan, [&](uint64_t t) {
+        const double angle = (double(t) - double(ref_ts)) * 1e-9 * M_PI / 2;
+        ouster::mat4d pose = ouster::mat4d::Identity();
+        pose.topLeftCorner<3, 3>() =
+            Eigen::AngleAxisd(angle, Eigen::Vector3d::UnitZ())
+                .toRotationMatrix();
+        return pose;
+    });
+    for (size_t v = 0; v < w; v++)
+        EXPECT_TRUE(poses[v].isApprox(expected_poses[v], 1e-9)) << v;
+
+    std::vector<float> xyzw(w * h * 4, -1.0f);
+    ouster::deskewed_cartesian_into(scan, ouster::make_xyz_lutf(lut), poses,
+                                    xyzw.data(), 4);
+    for (size_t u = 0; u < h; u++) {
+        for (size_t v = 0; v < w; v++) {
+            const size_t i = u * w + v;
+            Eigen::Vector3d p = points.row(i).transpose();
+            if (range(u, v) != 0 && (scan.status()[v] & 0x01))
+                p = poses[v].topLeftCorner<3, 3>() * p;
+            for (size_t c = 0; c < 3; c++)
+                EXPECT_NEAR(xyzw[i * 4 + c], p(c), 1e-3);
+            EXPECT_EQ(xyzw[i * 4 + 3], -1.0f);
+        }
+    }
+
+    // translations move returns but not pixels without one
+    std::vector<ouster::mat4d> moved(w, ouster::mat4d::Identity());
+    for (auto& pose : moved) pose(0, 3) = 1000;
+    const auto translated = ouster::deskewed_cartesian(scan, lut, moved);
+    for (size_t i = 0; i < w * h; i++) {
+        const size_t v = i % w;
+        const bool valid = (scan.status()[v] & 0x01) && range.data()[i] != 0;
+        EXPECT_EQ(translated(i, 0), valid ? points(i, 0) + 1000 : 0.0);
+    }
+
+    EXPECT_THROW(ouster::imu_column_poses(scan, {}, ouster::mat4d::Identity(),
+                                          ref_ts),
+                 std::invalid_argument);
+    EXPECT_THROW(ouster::deskewed_cartesian(scan, lut, {}),
+                 std::invalid_argument);
+    scan.destaggered = true;
+    EXPECT_THROW(ouster::deskewed_cartesian(scan, lut, identity),
+                 std::invalid_argument);
+}
+
+TEST(LidarScan, CartesianRegion) {
+    const size_t w = 512;
+    const size_t h = 64;
+    auto info = default_sensor_info(MODE_512x10);
+    info.format.column_window = {500, 20};
+    const auto lut = ouster::make_xyz_lut(info);
+
+    ouster::LidarScan scan(w, h, PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL);
+    for (auto f : {ChanField::RANGE, ChanField::RANGE2}) {
+        auto range = scan.field(f);
+        for (size_t i = 0; i < w * h; i++)
+            range.data()[i] = (i % 7 == 0) ? 0 : rand() % 100000;
+    }
+    for (size_t v = 0; v < w; v++) scan.status()[v] = v % 5 ? 0x01 : 0x00;
+
+    // every other column of the window, wrapping around, and every 4th row
+    const auto region = ouster::make_scan_region(info, 2, 4);
+    EXPECT_EQ(region.rows.size(), h / 4);
+    EXPECT_EQ(region.cols.size(), 17u);
+    EXPECT_EQ(region.cols.front(), 500);
+    EXPECT_EQ(region.cols[5], 510);
+    EXPECT_EQ(region.cols[6], 0);
+    EXPECT_EQ(region.cols.back(), 20);
+
+    // the same points as projecting the whole scan
+    const auto region_lut = ouster::slice_xyz_lut(lut, w, region);
+    const auto points = ouster::cartesian(scan, region, region_lut);
+    const auto all = ouster::cartesian(scan, lut);
+    const size_t nc = region.cols.size();
+    ASSERT_EQ(points.rows(), static_cast<ptrdiff_t>(region.rows.size() * nc));
+    for (size_t j = 0; j < region.rows.size(); j++)
+        for (size_t k = 0; k < nc; k++)
+            EXPECT_TRUE((points.row(j * nc + k) ==
+                         all.row(region.rows[j] * w + region.cols[k]))
+                            .all());
+
+    // of both returns, without touching the rest of the points
+    const auto region_lutf = ouster::make_xyz_lutf(region_lut);
+    std::vector<float> xyz(points.rows() * 4, -1.0f),
+        xyz2(points.rows() * 4, -1.0f);
+    ouster::cartesian_into(scan, region,
+                           {ChanField::RANGE, ChanField::RANGE2}, region_lutf,
+                           std::vector<float*>{xyz.data(), xyz2.data()}, 4);
+    std::vector<float> expected2(w * h * 3);
+    ouster::cartesian_into(scan, {ChanField::RANGE2},
+                           ouster::make_xyz_lutf(lut),
+                           std::vector<float*>{expected2.data()});
+    for (size_t j = 0; j < region.rows.size(); j++) {
+        for (size_t k = 0; k < nc; k++) {
+            const size_t i = j * nc + k;
+            const size_t p = region.rows[j] * w + region.cols[k];
+            for (size_t c = 0; c < 3; c++) {
+                EXPECT_NEAR(xyz[i * 4 + c], points(i, c), 1e-3);
+                EXPECT_EQ(xyz2[i * 4 + c], expected2[p * 3 + c]);
+            }
+            EXPECT_EQ(xyz[i * 4 + 3], -1.0f);
+        }
+    }
+
+    ouster::ScanRegion outside{{0}, {static_cast<int>(w)}};
+    EXPECT_THROW(ouster::slice_xyz_lut(lut, w, outside),
+                 std::invalid_argument);
+    EXPECT_THROW(ouster::cartesian(scan, outside, region_lut),
+                 std::invalid_argument);
+    EXPECT_THROW(ouster::cartesian(scan, region, lut), std::invalid_argument);
+    EXPECT_THROW(ouster::make_scan_region(w, h, {0, int(w)}),
+                 std::invalid_argument);
+    EXPECT_THROW(ouster::make_scan_region(info, 0), std::invalid_argument);
+}
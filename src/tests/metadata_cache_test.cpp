@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/metadata_cache.h"
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+
+namespace {
+
+std::string data_dir() {
+    const char* dir = std::getenv("DATA_DIR");
+    return dir ? dir : ".";
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream in{path, std::ios::binary};
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// a fresh directory for the cache of a test, removed afterwards
+class MetadataCacheTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        char tmpl[] = "/tmp/ouster_metadata_cache_XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+    }
+
+    void TearDown() override {
+        // removes the files of the test, and the directory once empty
+        for (const auto& f : files) std::remove(f.c_str());
+        rmdir((dir + "/sub").c_str());
+        rmdir(dir.c_str());
+    }
+
+    std::string dir;
+    std::vector<std::string> files;
+};
+
+class MetadataBinaryTest : public ::testing::TestWithParam<const char*> {};
+
+}  // namespace
+
+INSTANTIATE_TEST_CASE_P(Metadata, MetadataBinaryTest,
+                        ::testing::Values(
+                            "1_12_os1-991913000010-64",
+                            "2_0_0_os1-992008000494-128_col_win_legacy",
+                            "2_2_os-992119000444-128",
+                            "2_3_1_os-992146000760-128",
+                            "ouster-studio-reduced-config-v1"));
+
+TEST_P(MetadataBinaryTest, round_trip) {
+    const auto info =
+        metadata_from_json(data_dir() + "/" + GetParam() + ".json");
+    const auto bin = to_binary(info);
+    EXPECT_EQ(sensor_info_from_binary(bin.data(), bin.size()), info);
+}
+
+TEST(MetadataBinary, invalid_data) {
+    auto bin = to_binary(default_sensor_info(MODE_1024x10));
+    EXPECT_EQ(sensor_info_from_binary(bin.data(), bin.size()),
+              default_sensor_info(MODE_1024x10));
+
+    // truncated anywhere
+    for (size_t n = 0; n < bin.size(); n += 7)
+        EXPECT_THROW(sensor_info_from_binary(bin.data(), n),
+                     std::runtime_error);
+
+    // another version
+    bin[4]++;
+    EXPECT_THROW(sensor_info_from_binary(bin.data(), bin.size()),
+                 std::runtime_error);
+}
+
+TEST(MetadataBinary, cache_key) {
+    EXPECT_EQ(MetadataCache::key("992146000760", "v2.3.1", "1024x10"),
+              "992146000760_v2.3.1_1024x10");
+    EXPECT_EQ(MetadataCache::key("a/b", "v 2", "..\\x"), "a_b_v_2_.._x");
+    EXPECT_EQ(MetadataCache::hash("config"), MetadataCache::hash("config"));
+    EXPECT_NE(MetadataCache::hash("config"), MetadataCache::hash("config2"));
+}
+
+TEST_F(MetadataCacheTest, store_and_load) {
+    const std::string json =
+        read_file(data_dir() + "/2_3_1_os-992146000760-128.json");
+    MetadataCache::Entry entry;
+    entry.hash = MetadataCache::hash("config");
+    entry.metadata = json;
+    entry.info = parse_metadata(json);
+    entry.lut = make_xyz_lut(entry.info);
+
+    // created with its parents when storing
+    MetadataCache cache{dir + "/sub"};
+    const auto key = MetadataCache::key(entry.info.sn, entry.info.fw_rev,
+                                        to_string(entry.info.mode));
+    EXPECT_FALSE(cache.load(key));
+    cache.store(key, entry);
+    files.push_back(dir + "/sub/" + key + ".bin");
+
+    const auto loaded = cache.load(key);
+    ASSERT_TRUE(loaded);
+    EXPECT_EQ(loaded->hash, entry.hash);
+    EXPECT_EQ(loaded->metadata, json);
+    EXPECT_EQ(loaded->info, entry.info);
+    ASSERT_TRUE(loaded->lut);
+    EXPECT_TRUE((loaded->lut->direction == entry.lut->direction).all());
+    EXPECT_TRUE((loaded->lut->offset == entry.lut->offset).all());
+
+    // replaced without a lookup table
+    entry.lut = nonstd::nullopt;
+    cache.store(key, entry);
+    ASSERT_TRUE(cache.load(key));
+    EXPECT_FALSE(cache.load(key)->lut);
+
+    // corrupt entries are misses
+    {
+        std::ofstream out{files.back(), std::ios::binary | std::ios::trunc};
+        out << "not an entry";
+    }
+    EXPECT_FALSE(cache.load(key));
+}
+
+TEST_F(MetadataCacheTest, load_json) {
+    const std::string json_file =
+        data_dir() + "/2_2_os-992119000444-128.json";
+    MetadataCache cache{dir};
+
+    const auto miss = cache.load_json(json_file, true);
+    const std::string key = "json_" + MetadataCache::hash(read_file(json_file));
+    files.push_back(dir + "/" + key + ".bin");
+    EXPECT_EQ(miss.info, metadata_from_json(json_file));
+    ASSERT_TRUE(miss.lut);
+
+    // served from the cache
+    ASSERT_TRUE(cache.load(key));
+    const auto hit = cache.load_json(json_file);
+    EXPECT_EQ(hit.info, miss.info);
+    EXPECT_TRUE(hit.lut);
+
+    // a cache which can't be written still parses
+    MetadataCache unwritable{"/dev/null/cache"};
+    EXPECT_EQ(unwritable.load_json(json_file).info, miss.info);
+    EXPECT_THROW(unwritable.load_json(dir + "/missing.json"),
+                 std::runtime_error);
+}
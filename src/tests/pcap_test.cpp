@@ -0,0 +1,823 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/os_pcap.h"
+#include "ouster/pcap_demux.h"
+#include "ouster/pcap_scan_reader.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+using namespace ouster::sensor_utils;
+
+namespace {
+
+std::string temp_path(const std::string& name) {
+    return std::string(::testing::TempDir()) + name;
+}
+
+std::vector<uint8_t> random_bytes(size_t n, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<uint8_t> buf(n);
+    for (auto& b : buf) b = static_cast<uint8_t>(byte(gen));
+    return buf;
+}
+
+void put16(std::vector<uint8_t>& buf, size_t at, uint16_t v) {
+    buf[at] = static_cast<uint8_t>(v >> 8);
+    buf[at + 1] = static_cast<uint8_t>(v);
+}
+
+std::array<uint8_t, 16> v4_mapped(const std::array<uint8_t, 4>& a) {
+    std::array<uint8_t, 16> addr{};
+    addr[10] = addr[11] = 0xff;
+    std::copy(a.begin(), a.end(), addr.begin() + 12);
+    return addr;
+}
+
+std::vector<uint8_t> udp_datagram(int src_port, int dst_port,
+                                  const std::vector<uint8_t>& payload) {
+    std::vector<uint8_t> dgram(8, 0);
+    put16(dgram, 0, static_cast<uint16_t>(src_port));
+    put16(dgram, 2, static_cast<uint16_t>(dst_port));
+    put16(dgram, 4, static_cast<uint16_t>(8 + payload.size()));
+    dgram.insert(dgram.end(), payload.begin(), payload.end());
+    return dgram;
+}
+
+// Ethernet header, with a VLAN tag if vlan is set
+std::vector<uint8_t> ethernet(uint16_t ethertype, bool vlan = false) {
+    std::vector<uint8_t> frame(12, 0);
+    frame[0] = frame[6] = 0x02;
+    if (vlan) {
+        frame.resize(16);
+        put16(frame, 12, 0x8100);
+        put16(frame, 14, 5);
+    }
+    frame.resize(frame.size() + 2);
+    put16(frame, frame.size() - 2, ethertype);
+    return frame;
+}
+
+std::vector<uint8_t> ipv4_frame(const std::array<uint8_t, 4>& src,
+                                const std::array<uint8_t, 4>& dst,
+                                uint8_t protocol, uint16_t id,
+                                uint16_t flags_offset,
+                                const std::vector<uint8_t>& body,
+                                bool vlan = false) {
+    auto frame = ethernet(0x0800, vlan);
+    const size_t ip = frame.size();
+    frame.resize(ip + 20, 0);
+    frame[ip] = 0x45;
+    put16(frame, ip + 2, static_cast<uint16_t>(20 + body.size()));
+    put16(frame, ip + 4, id);
+    put16(frame, ip + 6, flags_offset);
+    frame[ip + 8] = 64;
+    frame[ip + 9] = protocol;
+    std::copy(src.begin(), src.end(), frame.begin() + ip + 12);
+    std::copy(dst.begin(), dst.end(), frame.begin() + ip + 16);
+    frame.insert(frame.end(), body.begin(), body.end());
+    return frame;
+}
+
+// split a UDP datagram into IPv4 fragments of frag_size bytes of IP payload
+std::vector<std::vector<uint8_t>> ipv4_fragments(
+    const std::array<uint8_t, 4>& src, const std::array<uint8_t, 4>& dst,
+    uint16_t id, const std::vector<uint8_t>& dgram, size_t frag_size) {
+    std::vector<std::vector<uint8_t>> frames;
+    for (size_t at = 0; at < dgram.size(); at += frag_size) {
+        const size_t end = std::min(at + frag_size, dgram.size());
+        const uint16_t more = end < dgram.size() ? 0x2000 : 0;
+        frames.push_back(ipv4_frame(
+            src, dst, 17, id, static_cast<uint16_t>(more | (at / 8)),
+            {dgram.begin() + at, dgram.begin() + end}));
+    }
+    return frames;
+}
+
+std::vector<uint8_t> ipv6_frame(const std::array<uint8_t, 16>& src,
+                                const std::array<uint8_t, 16>& dst,
+                                const std::vector<uint8_t>& dgram) {
+    auto frame = ethernet(0x86dd);
+    const size_t ip = frame.size();
+    frame.resize(ip + 40, 0);
+    frame[ip] = 0x60;
+    put16(frame, ip + 4, static_cast<uint16_t>(dgram.size()));
+    frame[ip + 6] = 17;
+    frame[ip + 7] = 64;
+    std::copy(src.begin(), src.end(), frame.begin() + ip + 8);
+    std::copy(dst.begin(), dst.end(), frame.begin() + ip + 24);
+    frame.insert(frame.end(), dgram.begin(), dgram.end());
+    return frame;
+}
+
+// a classic pcap file of Ethernet frames with microsecond timestamps
+class PcapBuilder {
+   public:
+    PcapBuilder() {
+        const uint32_t header[6] = {0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1};
+        append(header, sizeof(header));
+    }
+
+    void add(const std::vector<uint8_t>& frame, uint64_t ts_us) {
+        const uint32_t record[4] = {static_cast<uint32_t>(ts_us / 1000000),
+                                    static_cast<uint32_t>(ts_us % 1000000),
+                                    static_cast<uint32_t>(frame.size()),
+                                    static_cast<uint32_t>(frame.size())};
+        append(record, sizeof(record));
+        append(frame.data(), frame.size());
+    }
+
+    void write(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(bytes_.data()), bytes_.size());
+    }
+
+   private:
+    void append(const void* p, size_t n) {
+        const auto* b = static_cast<const uint8_t*>(p);
+        bytes_.insert(bytes_.end(), b, b + n);
+    }
+
+    std::vector<uint8_t> bytes_;
+};
+
+/*
+ * Fill a lidar packet with random channel data and set the frame and column
+ * headers, with columns numbered starting from m_id_start.
+ */
+std::vector<uint8_t> make_lidar_packet(const packet_format& pf,
+                                       uint16_t frame_id, uint16_t m_id_start,
+                                       unsigned seed) {
+    auto buf = random_bytes(pf.lidar_packet_size, seed);
+    const bool legacy =
+        pf.udp_profile_lidar == UDPProfileLidar::PROFILE_LIDAR_LEGACY;
+    if (!legacy) {
+        std::memcpy(buf.data() + 2, &frame_id, sizeof(frame_id));
+        // no init_id, as recorded by older firmware
+        std::memset(buf.data() + 4, 0, 3);
+    }
+
+    for (int icol = 0; icol < pf.columns_per_packet; icol++) {
+        auto col_buf = const_cast<uint8_t*>(pf.nth_col(icol, buf.data()));
+        const uint64_t ts = 1000 + icol;
+        const uint16_t m_id = m_id_start + icol;
+        std::memcpy(col_buf, &ts, sizeof(ts));
+        std::memcpy(col_buf + 8, &m_id, sizeof(m_id));
+        if (legacy) {
+            const uint32_t status = 0xffffffff;
+            const size_t status_offset = pf.nth_col(1, buf.data()) -
+                                         pf.nth_col(0, buf.data()) - 4;
+            std::memcpy(col_buf + 10, &frame_id, sizeof(frame_id));
+            std::memcpy(col_buf + status_offset, &status, sizeof(status));
+        } else {
+            const uint16_t status = 0x01;
+            std::memcpy(col_buf + 10, &status, sizeof(status));
+        }
+    }
+    return buf;
+}
+
+struct udp_packet {
+    std::string src_ip;
+    std::string dst_ip;
+    int src_port;
+    int dst_port;
+    std::vector<uint8_t> payload;
+    uint64_t timestamp_us;
+};
+
+/*
+ * The packets of n_frames complete frames sent by a sensor, each starting
+ * with an IMU packet, with frame ids counting from first_frame_id.
+ */
+std::vector<udp_packet> sensor_packets(const sensor_info& info,
+                                       const std::string& src_ip,
+                                       size_t n_frames,
+                                       uint16_t first_frame_id,
+                                       uint64_t start_us) {
+    const auto& pf = get_format(info);
+    const int cpp = pf.columns_per_packet;
+    const int w = static_cast<int>(info.format.columns_per_frame);
+
+    std::vector<udp_packet> packets;
+    for (size_t f = 0; f < n_frames; f++) {
+        const uint64_t frame_us = start_us + f * 100000;
+        const uint16_t frame_id = static_cast<uint16_t>(first_frame_id + f);
+        packets.push_back({src_ip, "10.0.0.255", 7503, info.udp_port_imu,
+                           random_bytes(pf.imu_packet_size, frame_id),
+                           frame_us});
+        for (int m_id = 0; m_id < w; m_id += cpp) {
+            const unsigned seed = frame_id * 1000u + m_id;
+            packets.push_back(
+                {src_ip, "10.0.0.255", 7502, info.udp_port_lidar,
+                 make_lidar_packet(pf, frame_id, static_cast<uint16_t>(m_id),
+                                   seed),
+                 frame_us + 10 + m_id});
+        }
+    }
+    return packets;
+}
+
+void record(const std::string& file, const std::vector<udp_packet>& packets,
+            const record_options& options = {}, bool use_sll = false) {
+    auto handle = record_initialize(file, 1480, use_sll, options);
+    for (const auto& p : packets)
+        record_packet(*handle, p.src_ip, p.dst_ip, p.src_port, p.dst_port,
+                      p.payload.data(), p.payload.size(), p.timestamp_us);
+    record_uninitialize(*handle);
+}
+
+size_t file_size(const std::string& file) {
+    std::ifstream in(file, std::ios::binary | std::ios::ate);
+    return static_cast<size_t>(in.tellg());
+}
+
+// check the IPv4 header checksum of every frame of a classic pcap file
+void expect_valid_checksums(const std::string& file, size_t link_size) {
+    std::ifstream in(file, std::ios::binary);
+    std::vector<uint8_t> bytes{std::istreambuf_iterator<char>(in),
+                               std::istreambuf_iterator<char>()};
+    size_t frames = 0;
+    for (size_t at = 24; at + 16 <= bytes.size(); frames++) {
+        uint32_t len;
+        std::memcpy(&len, &bytes[at + 8], sizeof(len));
+        const uint8_t* ip = &bytes[at + 16 + link_size];
+        uint32_t sum = 0;
+        for (size_t i = 0; i < 20; i += 2) sum += (ip[i] << 8) | ip[i + 1];
+        while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+        EXPECT_EQ(sum, 0xffffu) << "frame " << frames;
+        at += 16 + len;
+    }
+    EXPECT_GT(frames, 0u);
+}
+
+}  // namespace
+
+TEST(PcapReaderTest, parse_datagrams_and_fragments) {
+    const std::array<uint8_t, 4> sensor{10, 0, 0, 1};
+    const std::array<uint8_t, 4> host{10, 0, 0, 255};
+    const std::array<uint8_t, 16> v6_src{0xfe, 0x80, 0, 0, 0, 0, 0, 0,
+                                         0,    0,    0, 0, 0, 0, 0, 1};
+    const std::array<uint8_t, 16> v6_dst{0xff, 0x02, 0, 0, 0, 0, 0, 0,
+                                         0,    0,    0, 0, 0, 0, 0, 1};
+    const auto small = random_bytes(100, 1);
+    const auto large = random_bytes(4000, 2);
+    const auto tagged = random_bytes(8, 3);
+    const auto v6 = random_bytes(33, 4);
+
+    PcapBuilder pcap;
+    pcap.add(ipv4_frame(sensor, host, 17, 1, 0,
+                        udp_datagram(7502, 7502, small)),
+             1000);
+    const auto frags = ipv4_fragments(
+        sensor, host, 42, udp_datagram(7503, 7502, large), 1480);
+    ASSERT_EQ(frags.size(), 3u);
+    for (size_t i = 0; i < frags.size(); i++) pcap.add(frags[i], 2000 + i);
+    pcap.add(ipv4_frame({10, 0, 0, 3}, {10, 0, 0, 4}, 17, 2, 0,
+                        udp_datagram(1, 2, tagged), true),
+             3000);
+    pcap.add(ipv6_frame(v6_src, v6_dst, udp_datagram(9000, 9001, v6)),
+             4000000);
+    // TCP is skipped
+    pcap.add(ipv4_frame(sensor, host, 6, 3, 0, random_bytes(40, 5)), 5000000);
+    const std::string file = temp_path("pcap_reader_test.pcap");
+    pcap.write(file);
+
+    auto handle = replay_initialize(file);
+    packet_view view;
+
+    ASSERT_TRUE(next_packet(*handle, view));
+    EXPECT_EQ(view.ip_version, 4);
+    EXPECT_EQ(view.src_addr, v4_mapped(sensor));
+    EXPECT_EQ(view.dst_addr, v4_mapped(host));
+    EXPECT_EQ(view.src_port, 7502);
+    EXPECT_EQ(view.dst_port, 7502);
+    EXPECT_EQ(std::vector<uint8_t>(view.payload,
+                                   view.payload + view.payload_size),
+              small);
+    EXPECT_EQ(view.timestamp.count(), 1000);
+    EXPECT_EQ(view.fragments_in_packet, 1);
+    EXPECT_EQ(view.encapsulation_protocol, 1);
+
+    // reassembled, with the capture time of the last fragment
+    ASSERT_TRUE(next_packet(*handle, view));
+    EXPECT_EQ(view.src_port, 7503);
+    EXPECT_EQ(view.dst_port, 7502);
+    EXPECT_EQ(std::vector<uint8_t>(view.payload,
+                                   view.payload + view.payload_size),
+              large);
+    EXPECT_EQ(view.timestamp.count(), 2002);
+    EXPECT_EQ(view.fragments_in_packet, 3);
+
+    ASSERT_TRUE(next_packet(*handle, view));
+    EXPECT_EQ(view.src_addr, v4_mapped({10, 0, 0, 3}));
+    EXPECT_EQ(view.src_port, 1);
+    EXPECT_EQ(view.dst_port, 2);
+    EXPECT_EQ(std::vector<uint8_t>(view.payload,
+                                   view.payload + view.payload_size),
+              tagged);
+
+    ASSERT_TRUE(next_packet(*handle, view));
+    EXPECT_EQ(view.ip_version, 6);
+    EXPECT_EQ(view.src_addr, v6_src);
+    EXPECT_EQ(view.dst_addr, v6_dst);
+    EXPECT_EQ(view.src_port, 9000);
+    EXPECT_EQ(view.dst_port, 9001);
+    EXPECT_EQ(std::vector<uint8_t>(view.payload,
+                                   view.payload + view.payload_size),
+              v6);
+    EXPECT_EQ(view.timestamp.count(), 4000000);
+
+    EXPECT_FALSE(next_packet(*handle, view));
+
+    // the same packets with formatted addresses and copied payloads
+    replay_reset(*handle);
+    packet_info info;
+    std::vector<uint8_t> buf(65536);
+    std::vector<std::vector<uint8_t>> payloads;
+    std::vector<std::string> src_ips, dst_ips;
+    while (next_packet_info(*handle, info)) {
+        src_ips.push_back(info.src_ip);
+        dst_ips.push_back(info.dst_ip);
+        EXPECT_EQ(info.network_protocol, 17);
+        const size_t n = read_packet(*handle, buf.data(), buf.size());
+        EXPECT_EQ(n, info.payload_size);
+        payloads.emplace_back(buf.begin(), buf.begin() + n);
+    }
+    EXPECT_EQ(payloads,
+              (std::vector<std::vector<uint8_t>>{small, large, tagged, v6}));
+    EXPECT_EQ(src_ips, (std::vector<std::string>{"10.0.0.1", "10.0.0.1",
+                                                 "10.0.0.3", "fe80::1"}));
+    EXPECT_EQ(dst_ips, (std::vector<std::string>{"10.0.0.255", "10.0.0.255",
+                                                 "10.0.0.4", "ff02::1"}));
+    replay_uninitialize(*handle);
+}
+
+TEST(PcapReaderTest, incomplete_fragments_are_dropped) {
+    const std::array<uint8_t, 4> src{10, 0, 0, 1};
+    const std::array<uint8_t, 4> dst{10, 0, 0, 2};
+    const auto lost = random_bytes(3000, 1);
+    const auto ok = random_bytes(3000, 2);
+
+    // a datagram missing its middle fragment, then one fragmented in reverse
+    PcapBuilder pcap;
+    auto frags =
+        ipv4_fragments(src, dst, 7, udp_datagram(7502, 7502, lost), 1000);
+    ASSERT_EQ(frags.size(), 4u);
+    pcap.add(frags[0], 1);
+    pcap.add(frags[2], 2);
+    pcap.add(frags[3], 3);
+    frags = ipv4_fragments(src, dst, 8, udp_datagram(7502, 7502, ok), 1000);
+    for (size_t i = frags.size(); i-- > 0;) pcap.add(frags[i], 10 + i);
+    const std::string file = temp_path("pcap_fragments_test.pcap");
+    pcap.write(file);
+
+    auto handle = replay_initialize(file);
+    packet_view view;
+    ASSERT_TRUE(next_packet(*handle, view));
+    EXPECT_EQ(std::vector<uint8_t>(view.payload,
+                                   view.payload + view.payload_size),
+              ok);
+    EXPECT_EQ(view.timestamp.count(), 10);
+    EXPECT_FALSE(next_packet(*handle, view));
+}
+
+TEST(PcapIndexTest, index_and_seek) {
+    auto info = default_sensor_info(MODE_512x10);
+    const auto& pf = get_format(info);
+    const size_t n_frames = 5;
+    const auto packets =
+        sensor_packets(info, "10.0.0.1", n_frames, 1000, 1000000);
+    const size_t packets_per_frame = packets.size() / n_frames;
+
+    const std::string file = temp_path("pcap_index_test.pcap");
+    record(file, packets);
+    std::remove(index_path(file).c_str());
+
+    const auto index = build_index(file, info.udp_port_lidar, pf);
+    EXPECT_EQ(index.file_size, file_size(file));
+    EXPECT_EQ(index.lidar_port, info.udp_port_lidar);
+    EXPECT_EQ(index.lidar_packet_size, pf.lidar_packet_size);
+    ASSERT_EQ(index.streams.size(), 1u);
+    const auto& stream = index.streams[0];
+    EXPECT_EQ(stream.src_addr, v4_mapped({10, 0, 0, 1}));
+    ASSERT_EQ(stream.frames.size(), n_frames);
+    for (size_t f = 0; f < n_frames; f++) {
+        EXPECT_EQ(stream.frames[f].frame_id, 1000 + f);
+        EXPECT_EQ(stream.frames[f].timestamp_us,
+                  packets[f * packets_per_frame + 1].timestamp_us);
+        EXPECT_EQ(stream.frames[f].section_offset, 0u);
+    }
+
+    // lidar and IMU streams, counted over the whole file
+    ASSERT_EQ(index.udp_streams.size(), 2u);
+    EXPECT_EQ(index.udp_streams[0].dst_port, info.udp_port_imu);
+    EXPECT_EQ(index.udp_streams[0].count, n_frames);
+    EXPECT_EQ(index.udp_streams[1].dst_port, info.udp_port_lidar);
+    EXPECT_EQ(index.udp_streams[1].src_ip, "10.0.0.1");
+    EXPECT_EQ(index.udp_streams[1].dst_ip, "10.0.0.255");
+    EXPECT_EQ(index.udp_streams[1].count,
+              n_frames * (packets_per_frame - 1));
+    EXPECT_EQ(index.udp_streams[1].payload_sizes,
+              std::vector<size_t>{pf.lidar_packet_size});
+
+    // persisted next to the file
+    const auto cached = get_index(file, info.udp_port_lidar, pf);
+    pcap_index loaded;
+    ASSERT_TRUE(load_index(index_path(file), loaded));
+    for (const pcap_index* idx :
+         std::vector<const pcap_index*>{&cached, &loaded}) {
+        EXPECT_EQ(idx->file_size, index.file_size);
+        ASSERT_EQ(idx->streams.size(), 1u);
+        ASSERT_EQ(idx->streams[0].frames.size(), n_frames);
+        for (size_t f = 0; f < n_frames; f++) {
+            EXPECT_EQ(idx->streams[0].frames[f].offset,
+                      stream.frames[f].offset);
+            EXPECT_EQ(idx->streams[0].frames[f].timestamp_us,
+                      stream.frames[f].timestamp_us);
+        }
+        EXPECT_EQ(idx->udp_streams.size(), 2u);
+    }
+    EXPECT_EQ(get_stream_stats(file).size(), 2u);
+
+    // seek by frame, backwards and forwards, then by time
+    auto handle = replay_initialize(file);
+    packet_view view;
+    for (size_t f : {3, 0, 4, 1}) {
+        ASSERT_TRUE(replay_seek(*handle, stream, f));
+        ASSERT_TRUE(next_packet(*handle, view));
+        const auto& expected = packets[f * packets_per_frame + 1];
+        EXPECT_EQ(pf.frame_id(view.payload), 1000 + f);
+        EXPECT_EQ(static_cast<uint64_t>(view.timestamp.count()),
+                  expected.timestamp_us);
+        EXPECT_EQ(std::vector<uint8_t>(view.payload,
+                                       view.payload + view.payload_size),
+                  expected.payload);
+    }
+    const uint64_t between = stream.frames[1].timestamp_us + 1;
+    ASSERT_TRUE(
+        replay_seek(*handle, stream, std::chrono::microseconds{between}));
+    ASSERT_TRUE(next_packet(*handle, view));
+    EXPECT_EQ(pf.frame_id(view.payload), 1002);
+
+    // out of range seeks leave the handle where it was
+    EXPECT_FALSE(replay_seek(*handle, stream, n_frames));
+    EXPECT_FALSE(replay_seek(
+        *handle, stream,
+        std::chrono::microseconds{stream.frames.back().timestamp_us + 1}));
+    ASSERT_TRUE(next_packet(*handle, view));
+    EXPECT_EQ(pf.frame_id(view.payload), 1002);
+    EXPECT_EQ(pf.col_measurement_id(pf.nth_col(0, view.payload)),
+              pf.columns_per_packet);
+}
+
+TEST(PcapIndexTest, stale_index_is_rebuilt) {
+    auto info = default_sensor_info(MODE_512x10);
+    const auto& pf = get_format(info);
+    const std::string file = temp_path("pcap_stale_index_test.pcap");
+    record(file, sensor_packets(info, "10.0.0.1", 2, 0, 0));
+
+    // an index of another file at the same path
+    auto index = build_index(file, info.udp_port_lidar, pf);
+    index.file_size += 1;
+    index.streams[0].frames.pop_back();
+    ASSERT_TRUE(save_index(index, index_path(file)));
+
+    EXPECT_EQ(
+        get_index(file, info.udp_port_lidar, pf).streams[0].frames.size(), 2u);
+    pcap_index loaded;
+    ASSERT_TRUE(load_index(index_path(file), loaded));
+    EXPECT_EQ(loaded.file_size, file_size(file));
+
+    // not an index
+    std::ofstream(index_path(file), std::ios::trunc) << "garbage";
+    EXPECT_FALSE(load_index(index_path(file), loaded));
+    EXPECT_EQ(
+        get_index(file, info.udp_port_lidar, pf).streams[0].frames.size(), 2u);
+}
+
+TEST(PcapScanReaderTest, matches_sequential_decode) {
+    auto info = default_sensor_info(MODE_512x10);
+    const auto& pf = get_format(info);
+    const size_t n_frames = 9;
+    // frame ids wrap around, and a frame is missing packets
+    auto packets = sensor_packets(info, "10.0.0.1", n_frames, 65532, 0);
+    const size_t packets_per_frame = packets.size() / n_frames;
+    packets.erase(packets.begin() + 4 * packets_per_frame + 5,
+                  packets.begin() + 4 * packets_per_frame + 8);
+    const std::string file = temp_path("pcap_scan_reader_test.pcap");
+    record(file, packets);
+    std::remove(index_path(file).c_str());
+
+    // one pass over the packets with a single batcher
+    std::vector<LidarScan> expected;
+    {
+        auto handle = replay_initialize(file);
+        ScanBatcher batcher(info);
+        LidarScan ls(info.format.columns_per_frame,
+                     info.format.pixels_per_column,
+                     info.format.udp_profile_lidar);
+        packet_view view;
+        while (next_packet(*handle, view)) {
+            if (view.dst_port != info.udp_port_lidar ||
+                view.payload_size != pf.lidar_packet_size)
+                continue;
+            if (batcher(view.payload, ls, view.timestamp.count() * 1000)) {
+                expected.push_back(ls);
+                ls.frame_id = -1;
+            }
+        }
+        if (ls.frame_id != -1) expected.push_back(ls);
+    }
+    ASSERT_EQ(expected.size(), n_frames);
+    EXPECT_EQ(expected.front().frame_id, 65532);
+    EXPECT_EQ(expected.back().frame_id, 4);
+    EXPECT_EQ(expected.front().rx_timestamp()[0],
+              packets[1].timestamp_us * 1000);
+
+    const std::vector<std::pair<int, size_t>> configs{
+        {1, 1}, {3, 2}, {4, 1}, {2, 100}};
+    for (const auto& config : configs) {
+        PcapScanReader reader(file, info, config.first, config.second);
+        EXPECT_EQ(reader.frame_count(), n_frames);
+        std::vector<LidarScan> scans;
+        LidarScan ls;
+        while (reader.next(ls)) scans.push_back(ls);
+        ASSERT_EQ(scans.size(), expected.size())
+            << config.first << " workers";
+        for (size_t i = 0; i < scans.size(); i++)
+            EXPECT_TRUE(scans[i] == expected[i])
+                << config.first << " workers, scan " << i;
+    }
+
+    // only the incomplete frame is dropped
+    PcapScanReader reader(file, info, 3, 2, true);
+    std::vector<int32_t> frame_ids;
+    LidarScan ls;
+    while (reader.next(ls)) {
+        EXPECT_TRUE(ls.complete(info.format.column_window));
+        frame_ids.push_back(ls.frame_id);
+    }
+    EXPECT_EQ(frame_ids,
+              (std::vector<int32_t>{65532, 65533, 65534, 65535, 1, 2, 3, 4}));
+}
+
+TEST(PcapScanReaderTest, skips_other_frames_after_seek) {
+    auto info = default_sensor_info(MODE_512x10);
+    const auto& pf = get_format(info);
+    const size_t n_frames = 4;
+    auto packets = sensor_packets(info, "10.0.0.1", n_frames, 100, 0);
+    const size_t packets_per_frame = packets.size() / n_frames;
+
+    // the last packet of frame 101 arrives after the IMU packet of frame 102
+    const size_t late = 2 * packets_per_frame;
+    std::swap(packets[late - 1], packets[late]);
+    const std::string file = temp_path("pcap_scan_reader_seek_test.pcap");
+    const std::string prefix = temp_path("pcap_scan_reader_prefix.pcap");
+    record(file, packets);
+    record(prefix, {packets.begin(), packets.begin() + late});
+    std::remove(index_path(file).c_str());
+
+    std::vector<int32_t> expected_ids;
+    std::vector<LidarScan> expected;
+    {
+        PcapScanReader reader(file, info, 1, 100);
+        LidarScan ls;
+        while (reader.next(ls)) {
+            expected_ids.push_back(ls.frame_id);
+            expected.push_back(ls);
+        }
+    }
+    ASSERT_EQ(expected_ids, (std::vector<int32_t>{100, 101, 102, 103}));
+    EXPECT_TRUE(expected[1].complete(info.format.column_window));
+
+    // an index boundary at the late packet, which seeks land on
+    auto index = build_index(file, info.udp_port_lidar, pf);
+    ASSERT_EQ(index.streams.size(), 1u);
+    ASSERT_EQ(index.streams[0].frames.size(), n_frames);
+    index.streams[0].frames[2].offset = file_size(prefix);
+    ASSERT_TRUE(save_index(index, index_path(file)));
+    std::remove(prefix.c_str());
+
+    PcapScanReader reader(file, info, 2, 1);
+    std::vector<LidarScan> scans;
+    LidarScan ls;
+    while (reader.next(ls)) scans.push_back(ls);
+    ASSERT_EQ(scans.size(), expected.size());
+    for (size_t i = 0; i < scans.size(); i++)
+        EXPECT_TRUE(scans[i] == expected[i]) << "scan " << i;
+}
+
+class PcapRecordOptionsTest
+    : public ::testing::TestWithParam<std::pair<bool, bool>> {};
+
+// clang-format off
+INSTANTIATE_TEST_CASE_P(
+    Buffering, PcapRecordOptionsTest,
+    ::testing::Values(std::make_pair(false, false),
+                      std::make_pair(true, false),
+                      std::make_pair(false, true),
+                      std::make_pair(true, true)));
+// clang-format on
+
+TEST_P(PcapRecordOptionsTest, round_trip) {
+    const bool async_write = GetParam().first;
+    const bool use_sll = GetParam().second;
+
+    // interleaved streams, with datagrams fragmented at 1480 bytes of IP
+    // payload and larger than the write buffers
+    std::vector<udp_packet> packets;
+    const std::vector<size_t> sizes{0, 1, 100, 1472, 1473, 5000, 65507};
+    for (size_t i = 0; i < 3 * sizes.size(); i++) {
+        const size_t size = sizes[i % sizes.size()];
+        const uint64_t ts = 1500000000000000 + i * 999999;
+        if (i % 2)
+            packets.push_back({"10.0.0.1", "10.0.0.255", 7502, 7502,
+                               random_bytes(size, i), ts});
+        else
+            packets.push_back({"192.168.1.5", "192.168.1.100", 40000, 7503,
+                               random_bytes(size, i), ts});
+    }
+
+    record_options options;
+    options.async_write = async_write;
+    options.buffer_size = 4096;
+    options.n_buffers = 2;
+    const std::string file = temp_path(
+        std::string("pcap_record_test_") + (async_write ? "async" : "sync") +
+        (use_sll ? "_sll" : "") + ".pcap");
+
+    auto recorder = record_initialize(file, 1480, use_sll, options);
+    for (const auto& p : packets)
+        EXPECT_TRUE(record_packet(*recorder, p.src_ip, p.dst_ip, p.src_port,
+                                  p.dst_port, p.payload.data(),
+                                  p.payload.size(), p.timestamp_us));
+    record_uninitialize(*recorder);
+
+    const auto stats = get_record_stats(*recorder);
+    EXPECT_EQ(stats.packets_recorded, packets.size());
+    EXPECT_EQ(stats.packets_written, packets.size());
+    EXPECT_EQ(stats.packets_dropped, 0u);
+    EXPECT_EQ(stats.bytes_written, file_size(file));
+    expect_valid_checksums(file, use_sll ? 16 : 14);
+
+    auto handle = replay_initialize(file);
+    packet_info info;
+    std::vector<uint8_t> buf(65536);
+    for (const auto& p : packets) {
+        ASSERT_TRUE(next_packet_info(*handle, info));
+        EXPECT_EQ(info.src_ip, p.src_ip);
+        EXPECT_EQ(info.dst_ip, p.dst_ip);
+        EXPECT_EQ(info.src_port, p.src_port);
+        EXPECT_EQ(info.dst_port, p.dst_port);
+        EXPECT_EQ(static_cast<uint64_t>(info.timestamp.count()),
+                  p.timestamp_us);
+        EXPECT_EQ(info.encapsulation_protocol, use_sll ? 113 : 1);
+        EXPECT_EQ(info.fragments_in_packet,
+                  static_cast<int>((p.payload.size() + 8 + 1479) / 1480));
+
+        const size_t n = read_packet(*handle, buf.data(), buf.size());
+        ASSERT_EQ(n, p.payload.size());
+        EXPECT_TRUE(std::equal(p.payload.begin(), p.payload.end(),
+                               buf.begin()));
+    }
+    EXPECT_FALSE(next_packet_info(*handle, info));
+}
+
+TEST(PcapRecordTest, invalid_packets) {
+    const std::string file = temp_path("pcap_record_invalid_test.pcap");
+    auto handle = record_initialize(file, 1480);
+    const std::vector<uint8_t> buf(65508);
+
+    EXPECT_THROW(record_packet(*handle, "10.0.0.1", "not an ip", 1, 2,
+                               buf.data(), 10, 0),
+                 std::invalid_argument);
+    EXPECT_THROW(record_packet(*handle, "", "10.0.0.2", 1, 2, buf.data(), 10,
+                               0),
+                 std::invalid_argument);
+    EXPECT_THROW(record_packet(*handle, "10.0.0.1", "10.0.0.2", 1, 65536,
+                               buf.data(), 10, 0),
+                 std::invalid_argument);
+    EXPECT_THROW(record_packet(*handle, "10.0.0.1", "10.0.0.2", 1, 2,
+                               buf.data(), buf.size(), 0),
+                 std::invalid_argument);
+    EXPECT_TRUE(record_packet(*handle, "10.0.0.1", "10.0.0.2", 1, 2,
+                              buf.data(), 10, 0));
+    record_uninitialize(*handle);
+    EXPECT_EQ(get_record_stats(*handle).packets_written, 1u);
+
+    EXPECT_THROW(record_packet(*handle, "10.0.0.1", "10.0.0.2", 1, 2,
+                               buf.data(), 10, 0),
+                 std::runtime_error);
+    EXPECT_THROW(record_initialize(file, 0), std::invalid_argument);
+}
+
+TEST(PcapDemuxTest, routes_by_source_and_port) {
+    // default metadata leaves the ports unset
+    auto info_a = default_sensor_info(MODE_512x10);
+    info_a.udp_port_lidar = 7502;
+    info_a.udp_port_imu = 7503;
+    auto info_b = default_sensor_info(MODE_1024x10);
+    info_b.format.udp_profile_lidar =
+        UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16;
+    info_b.udp_port_lidar = 7602;
+    info_b.udp_port_imu = 7603;
+    const auto& pf_a = get_format(info_a);
+    const auto& pf_b = get_format(info_b);
+    ASSERT_NE(pf_a.lidar_packet_size, pf_b.lidar_packet_size);
+
+    // two sensors of the first kind sharing a port, and one of the second
+    const std::vector<std::string> sources{"10.0.0.1", "10.0.0.2",
+                                           "10.0.0.3"};
+    const std::vector<const sensor_info*> infos{&info_a, &info_b, &info_a};
+    const std::vector<uint16_t> first_ids{100, 5000, 9000};
+    std::vector<std::vector<udp_packet>> sent;
+    for (size_t i = 0; i < sources.size(); i++)
+        sent.push_back(
+            sensor_packets(*infos[i], sources[i], 3, first_ids[i], 7 * i));
+
+    std::vector<udp_packet> packets;
+    for (const auto& s : sent)
+        packets.insert(packets.end(), s.begin(), s.end());
+    // packets of the wrong size for the sensor on a port are ignored
+    packets.push_back({"10.0.0.2", "10.0.0.255", 7502, info_a.udp_port_lidar,
+                       random_bytes(pf_b.lidar_packet_size, 1), 20});
+    packets.push_back({"10.0.0.1", "10.0.0.255", 7502, 9999,
+                       random_bytes(pf_a.lidar_packet_size, 2), 30});
+    std::stable_sort(packets.begin(), packets.end(),
+                     [](const udp_packet& a, const udp_packet& b) {
+                         return a.timestamp_us < b.timestamp_us;
+                     });
+    const std::string file = temp_path("pcap_demux_test.pcap");
+    record(file, packets);
+
+    // the scans of each source batched on their own
+    std::vector<std::vector<LidarScan>> expected(sources.size());
+    for (size_t i = 0; i < sources.size(); i++) {
+        const auto& info = *infos[i];
+        const auto& pf = get_format(info);
+        ScanBatcher batcher(info);
+        LidarScan ls(info.format.columns_per_frame,
+                     info.format.pixels_per_column,
+                     info.format.udp_profile_lidar);
+        for (const auto& p : sent[i]) {
+            if (p.payload.size() != pf.lidar_packet_size) continue;
+            if (batcher(p.payload.data(), ls, p.timestamp_us * 1000)) {
+                expected[i].push_back(ls);
+                ls.frame_id = -1;
+            }
+        }
+        expected[i].push_back(ls);
+        ASSERT_EQ(expected[i].size(), 3u);
+    }
+
+    PcapDemux demux(file, {info_a, info_b});
+    for (int pass = 0; pass < 2; pass++) {
+        std::vector<std::vector<LidarScan>> scans(sources.size());
+        LidarScan ls;
+        size_t ind;
+        while (demux.next(ls, ind)) {
+            ASSERT_LT(ind, scans.size());
+            scans[ind].push_back(ls);
+        }
+
+        // streams in order of appearance, one per source
+        const auto& streams = demux.streams();
+        ASSERT_EQ(streams.size(), sources.size());
+        for (size_t i = 0; i < streams.size(); i++) {
+            EXPECT_EQ(streams[i].src_addr,
+                      v4_mapped({10, 0, 0, static_cast<uint8_t>(i + 1)}));
+            EXPECT_EQ(streams[i].sensor, i == 1 ? 1u : 0u);
+            EXPECT_EQ(streams[i].dst_port, infos[i]->udp_port_lidar);
+            ASSERT_EQ(scans[i].size(), expected[i].size()) << "stream " << i;
+            for (size_t f = 0; f < scans[i].size(); f++)
+                EXPECT_TRUE(scans[i][f] == expected[i][f])
+                    << "stream " << i << ", scan " << f;
+        }
+        demux.reset();
+    }
+
+    EXPECT_THROW(PcapDemux(file, {info_a, info_b}, false, {7502}),
+                 std::invalid_argument);
+}
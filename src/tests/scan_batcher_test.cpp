@@ -0,0 +1,562 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "ouster/impl/lidar_scan_impl.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+
+namespace {
+
+using FieldTypes = std::vector<std::pair<ChanField, ChanFieldType>>;
+
+sensor_info profile_info(UDPProfileLidar profile) {
+    auto info = default_sensor_info(MODE_1024x10);
+    info.format.udp_profile_lidar = profile;
+    return info;
+}
+
+/*
+ * Fill a lidar packet with random channel data and set frame and column
+ * headers. Columns are numbered starting from m_id_start; the column at
+ * invalid_col (if any) has its status set to invalid.
+ */
+std::vector<uint8_t> make_packet(const packet_format& pf, uint16_t frame_id,
+                                 uint16_t m_id_start, int invalid_col = -1,
+                                 unsigned seed = 0) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<uint8_t> buf(pf.lidar_packet_size);
+    for (auto& b : buf) b = static_cast<uint8_t>(byte(gen));
+
+    const bool legacy =
+        pf.udp_profile_lidar == UDPProfileLidar::PROFILE_LIDAR_LEGACY;
+    if (!legacy) std::memcpy(buf.data() + 2, &frame_id, sizeof(frame_id));
+
+    for (int icol = 0; icol < pf.columns_per_packet; icol++) {
+        auto col_buf = const_cast<uint8_t*>(pf.nth_col(icol, buf.data()));
+        uint64_t ts = 1000 + icol;
+        uint16_t m_id = m_id_start + icol;
+        std::memcpy(col_buf, &ts, sizeof(ts));
+        std::memcpy(col_buf + 8, &m_id, sizeof(m_id));
+
+        const bool valid = icol != invalid_col;
+        if (legacy) {
+            uint32_t status = valid ? 0xffffffff : 0;
+            size_t status_offset = pf.nth_col(1, buf.data()) -
+                                   pf.nth_col(0, buf.data()) - 4;
+            std::memcpy(col_buf + 10, &frame_id, sizeof(frame_id));
+            std::memcpy(col_buf + status_offset, &status, sizeof(status));
+        } else {
+            uint16_t status = valid ? 0x01 : 0;
+            std::memcpy(col_buf + 10, &status, sizeof(status));
+        }
+    }
+    return buf;
+}
+
+/*
+ * Compare a parsed scan column against the generic packet_format parsing path
+ */
+struct check_col_field {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, ChanField f,
+                    const packet_format& pf, const uint8_t* col_buf,
+                    uint16_t m_id) {
+        std::vector<T> expected(pf.pixels_per_column);
+        pf.col_field(col_buf, f, expected.data(), 1);
+        for (int px = 0; px < pf.pixels_per_column; px++)
+            EXPECT_EQ(field(px, m_id), expected[px])
+                << "field " << to_string(f) << " px " << px;
+    }
+};
+
+FieldTypes widened(const packet_format& pf, ChanFieldType ty) {
+    FieldTypes res;
+    for (const auto& ft : pf) res.emplace_back(ft.first, ty);
+    return res;
+}
+
+}  // namespace
+
+class ScanBatcherProfileTest
+    : public ::testing::TestWithParam<UDPProfileLidar> {};
+
+// clang-format off
+INSTANTIATE_TEST_CASE_P(
+    Profiles, ScanBatcherProfileTest,
+    ::testing::Values(UDPProfileLidar::PROFILE_LIDAR_LEGACY,
+                      UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL,
+                      UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16,
+                      UDPProfileLidar::PROFILE_RNG15_RFL8_NIR8));
+// clang-format on
+
+TEST_P(ScanBatcherProfileTest, matches_generic_parsing) {
+    const auto info = profile_info(GetParam());
+    const packet_format pf(info);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+
+    const uint16_t m_id_start = 3 * pf.columns_per_packet;
+    const int invalid_col = 5;
+    auto packet = make_packet(pf, 7, m_id_start, invalid_col, 42);
+
+    // all packet fields at native width and widened to 64 bits
+    for (auto field_types :
+         {FieldTypes{pf.begin(), pf.end()}, widened(pf, UINT64)}) {
+        ScanBatcher batcher(w, pf);
+        LidarScan ls(w, h, field_types.begin(), field_types.end());
+        EXPECT_FALSE(batcher(packet.data(), ls));
+        EXPECT_EQ(ls.frame_id, 7);
+
+        for (int icol = 0; icol < pf.columns_per_packet; icol++) {
+            const uint16_t m_id = m_id_start + icol;
+            const uint8_t* col_buf = pf.nth_col(icol, packet.data());
+            if (icol == invalid_col) {
+                EXPECT_EQ(ls.status()[m_id], 0u);
+                continue;
+            }
+            EXPECT_EQ(ls.timestamp()[m_id], 1000u + icol);
+            EXPECT_EQ(ls.measurement_id()[m_id], m_id);
+            impl::foreach_field(ls, check_col_field(), pf, col_buf, m_id);
+        }
+    }
+}
+
+TEST_P(ScanBatcherProfileTest, dest_type_too_small) {
+    const auto info = profile_info(GetParam());
+    const packet_format pf(info);
+    const size_t w = info.format.columns_per_frame;
+    auto packet = make_packet(pf, 7, 0);
+
+    ScanBatcher batcher(w, pf);
+    FieldTypes field_types{{ChanField::RAW32_WORD1, UINT16}};
+    LidarScan ls(w, info.format.pixels_per_column, field_types.begin(),
+                 field_types.end());
+    EXPECT_THROW(batcher(packet.data(), ls), std::invalid_argument);
+}
+
+TEST_P(ScanBatcherProfileTest, lazy_zero_marks_missing_cols) {
+    const auto info = profile_info(GetParam());
+    const packet_format pf(info);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    const int cpp = pf.columns_per_packet;
+
+    ScanBatcher eager(w, pf);
+    ScanBatcher lazy(w, pf, BATCH_LAZY_ZERO | BATCH_NO_BLOCK_HEADERS);
+    const auto field_types = widened(pf, UINT32);
+    LidarScan ls_eager(w, h, field_types.begin(), field_types.end());
+    LidarScan ls_lazy(w, h, field_types.begin(), field_types.end());
+
+    // frame 1 is complete, frame 2 only has its first packet
+    for (uint16_t m_id = 0; m_id < w; m_id += cpp) {
+        auto packet = make_packet(pf, 1, m_id, -1, m_id);
+        eager(packet.data(), ls_eager);
+        lazy(packet.data(), ls_lazy);
+    }
+    auto last = make_packet(pf, 2, 0, -1, 7);
+    EXPECT_TRUE(eager(last.data(), ls_eager));
+    EXPECT_TRUE(lazy(last.data(), ls_lazy));
+    for (uint16_t m_id = 0; m_id < w; m_id += cpp) {
+        ls_lazy.header(m_id).encoder = 12345;
+        ls_lazy.header(m_id + cpp - 1).encoder = 12345;
+    }
+
+    // next frame ends after the second packet
+    auto packet = make_packet(pf, 2, cpp, -1, 8);
+    eager(packet.data(), ls_eager);
+    lazy(packet.data(), ls_lazy);
+    auto next = make_packet(pf, 3, 0, -1, 9);
+    EXPECT_TRUE(eager(next.data(), ls_eager));
+    EXPECT_TRUE(lazy(next.data(), ls_lazy));
+
+    EXPECT_TRUE((ls_eager.status() == ls_lazy.status()).all());
+    EXPECT_TRUE((ls_eager.timestamp() == ls_lazy.timestamp()).all());
+    EXPECT_TRUE((ls_eager.measurement_id() == ls_lazy.measurement_id()).all());
+
+    // valid columns match, missing columns keep stale data
+    const auto range_eager = ls_eager.field(ChanField::RANGE);
+    const auto range_lazy = ls_lazy.field(ChanField::RANGE);
+    EXPECT_TRUE(
+        (range_eager.leftCols(2 * cpp) == range_lazy.leftCols(2 * cpp)).all());
+    EXPECT_TRUE((range_eager.rightCols(w - 2 * cpp) == 0).all());
+    EXPECT_FALSE((range_lazy.rightCols(w - 2 * cpp) == 0).all());
+    EXPECT_TRUE((ls_lazy.status().tail(w - 2 * cpp) == 0).all());
+
+    // deprecated headers are left alone
+    for (uint16_t m_id = 0; m_id < w; m_id += cpp)
+        EXPECT_EQ(ls_lazy.header(m_id).encoder, 12345u);
+
+    // cartesian output ignores the stale data
+    EXPECT_FALSE(ls_eager.stale_columns());
+    EXPECT_TRUE(ls_lazy.stale_columns());
+    const auto lut = make_xyz_lut(info);
+    EXPECT_TRUE(
+        (cartesian(ls_eager, lut).array() == cartesian(ls_lazy, lut).array())
+            .all());
+}
+
+TEST(LidarScanPoolTest, acquire_release) {
+    LidarScanPool pool(1024, 64, UDPProfileLidar::PROFILE_LIDAR_LEGACY, 2);
+    EXPECT_EQ(pool.available(), 2u);
+
+    auto a = pool.acquire();
+    auto b = pool.acquire();
+    EXPECT_EQ(pool.available(), 0u);
+    EXPECT_EQ(a->w, 1024u);
+    EXPECT_EQ(a->h, 64u);
+    EXPECT_NE(a.get(), b.get());
+
+    // grows when empty
+    auto c = pool.acquire();
+    ASSERT_TRUE(c);
+    EXPECT_TRUE(*c == *a);
+
+    LidarScan* raw = c.get();
+    a.reset();
+    b.reset();
+    c.reset();
+    EXPECT_EQ(pool.available(), 3u);
+
+    // scans are recycled
+    auto d = pool.acquire();
+    EXPECT_EQ(d.get(), raw);
+    EXPECT_EQ(pool.available(), 2u);
+}
+
+TEST(LidarScanPoolTest, handle_outlives_pool) {
+    LidarScanPool::Handle h;
+    {
+        LidarScanPool pool(512, 16, UDPProfileLidar::PROFILE_LIDAR_LEGACY, 1);
+        h = pool.acquire();
+    }
+    ASSERT_TRUE(h);
+    h->field(ChanField::RANGE).setConstant(1);
+    h.reset();
+}
+
+TEST_P(ScanBatcherProfileTest, pooled_matches_single_scan) {
+    const auto info = profile_info(GetParam());
+    const packet_format pf(info);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    const int cpp = pf.columns_per_packet;
+
+    ScanBatcher batcher(w, pf);
+    ScanBatcher pooled_batcher(w, pf);
+    LidarScan ls(w, h, info.format.udp_profile_lidar);
+    LidarScanPool pool(ls, 2);
+
+    // hold on to completed scans to make sure they aren't written to
+    std::vector<LidarScan> expected;
+    std::vector<LidarScanPool::Handle> held;
+    unsigned seed = 0;
+    for (uint16_t f_id = 1; f_id <= 4; f_id++) {
+        // drop a packet in the middle of every other frame
+        for (uint16_t m_id = 0; m_id < w; m_id += cpp, seed++) {
+            if (f_id % 2 && m_id == 4 * cpp) continue;
+            auto packet = make_packet(pf, f_id, m_id, -1, seed);
+            if (batcher(packet.data(), ls)) expected.push_back(ls);
+            auto done = pooled_batcher(packet.data(), pool);
+            EXPECT_EQ(static_cast<bool>(done), expected.size() > held.size());
+            if (done) held.push_back(std::move(done));
+        }
+    }
+
+    ASSERT_EQ(held.size(), 3u);
+    for (size_t i = 0; i < held.size(); i++) {
+        EXPECT_EQ(held[i]->frame_id, i + 1);
+        EXPECT_TRUE(*held[i] == expected[i]);
+    }
+
+    // released scans are reused instead of allocating new ones
+    held.clear();
+    const size_t n_scans = pool.available();
+    for (uint16_t f_id = 5; f_id <= 8; f_id++) {
+        for (uint16_t m_id = 0; m_id < w; m_id += cpp, seed++) {
+            auto packet = make_packet(pf, f_id, m_id, -1, seed);
+            pooled_batcher(packet.data(), pool);
+        }
+    }
+    EXPECT_EQ(pool.available(), n_scans);
+}
+
+TEST_P(ScanBatcherProfileTest, rx_timestamps) {
+    const auto info = profile_info(GetParam());
+    const packet_format pf(info);
+    const size_t w = info.format.columns_per_frame;
+    const int cpp = pf.columns_per_packet;
+
+    ScanBatcher batcher(w, pf);
+    LidarScan ls(w, info.format.pixels_per_column, pf.begin(), pf.end());
+
+    // skip the second packet and invalidate one column of the first
+    for (uint16_t m_id = 0; m_id < w; m_id += cpp) {
+        if (m_id == cpp) continue;
+        auto packet = make_packet(pf, 1, m_id, m_id == 0 ? 2 : -1, m_id);
+        EXPECT_FALSE(batcher(packet.data(), ls, 5000 + m_id));
+    }
+    auto next = make_packet(pf, 2, 0);
+    EXPECT_TRUE(batcher(next.data(), ls, 1));
+
+    for (size_t m_id = 0; m_id < w; m_id++) {
+        const uint64_t expected =
+            (m_id == 2 || m_id / cpp == 1) ? 0 : 5000 + m_id / cpp * cpp;
+        EXPECT_EQ(ls.rx_timestamp()[m_id], expected) << "m_id " << m_id;
+    }
+
+    // the cached first packet of the next frame keeps its timestamp
+    auto last = make_packet(pf, 2, cpp);
+    EXPECT_FALSE(batcher(last.data(), ls, 2));
+    EXPECT_EQ(ls.rx_timestamp()[0], 1u);
+    EXPECT_EQ(ls.rx_timestamp()[cpp], 2u);
+}
+
+TEST_P(ScanBatcherProfileTest, stats) {
+    const auto info = profile_info(GetParam());
+    const packet_format pf(info);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    const int cpp = pf.columns_per_packet;
+
+    ScanBatcher batcher(w, pf);
+    LidarScan ls(w, h, info.format.udp_profile_lidar);
+
+    // frame 1 misses its third packet, frame 2 gets a late packet of frame 1
+    size_t n_packets = 0;
+    for (uint16_t m_id = 0; m_id < w; m_id += cpp) {
+        if (m_id == 2 * cpp) continue;
+        auto packet = make_packet(pf, 1, m_id);
+        EXPECT_FALSE(batcher(packet.data(), ls));
+        n_packets++;
+    }
+    auto first = make_packet(pf, 2, 0);
+    EXPECT_TRUE(batcher(first.data(), ls));
+    auto late = make_packet(pf, 1, 2 * cpp);
+    EXPECT_FALSE(batcher(late.data(), ls));
+
+    const BatcherStats& stats = batcher.stats();
+    EXPECT_EQ(stats.packets, n_packets + 1);
+    EXPECT_EQ(stats.reordered_packets, 1u);
+    EXPECT_EQ(stats.zeroed_cols, static_cast<uint64_t>(cpp));
+    EXPECT_EQ(stats.scans, 1u);
+
+    // frame 2 ends after its first packet; the next one is parsed later
+    auto next = make_packet(pf, 3, 0);
+    EXPECT_TRUE(batcher(next.data(), ls));
+    EXPECT_EQ(stats.packets, n_packets + 1);
+    EXPECT_EQ(stats.zeroed_cols, w);
+    EXPECT_EQ(stats.scans, 2u);
+}
+
+TEST_P(ScanBatcherProfileTest, destagger_on_ingest) {
+    auto info = profile_info(GetParam());
+    const packet_format pf(info);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    const int cpp = pf.columns_per_packet;
+
+    // shifts of either sign that wrap around
+    for (size_t u = 0; u < h; u++)
+        info.format.pixel_shift_by_row[u] =
+            static_cast<int>(u % 4 == 0 ? w - 3 : 7 * u) - 16;
+
+    EXPECT_THROW(ScanBatcher(w, pf, BATCH_DESTAGGER), std::invalid_argument);
+
+    ScanBatcher batcher(info);
+    ScanBatcher destaggering(info, BATCH_DESTAGGER);
+    LidarScan ls(w, h, info.format.udp_profile_lidar);
+    LidarScan ls_destaggered(w, h, info.format.udp_profile_lidar);
+
+    // drop a packet and invalidate a column of another
+    for (uint16_t f_id = 1; f_id <= 3; f_id++) {
+        for (uint16_t m_id = 0; m_id < w; m_id += cpp) {
+            if (m_id == 2 * cpp) continue;
+            auto packet =
+                make_packet(pf, f_id, m_id, m_id == 0 ? 3 : -1, f_id + m_id);
+            const bool done = batcher(packet.data(), ls);
+            EXPECT_EQ(destaggering(packet.data(), ls_destaggered), done);
+        }
+    }
+
+    EXPECT_FALSE(ls.destaggered);
+    EXPECT_TRUE(ls_destaggered.destaggered);
+    EXPECT_TRUE((ls.status() == ls_destaggered.status()).all());
+    EXPECT_TRUE((ls.timestamp() == ls_destaggered.timestamp()).all());
+
+    const Destaggerer destagger(info);
+    LidarScan expected = ls;
+    std::vector<ChanField> fields;
+    for (const auto& ft : ls) fields.push_back(ft.first);
+    destagger(ls, fields, expected);
+    expected.destaggered = true;
+    EXPECT_TRUE(expected == ls_destaggered);
+
+    // points of the destaggered scan are destaggered points of the scan
+    const auto points = cartesian(ls, make_xyz_lut(info));
+    const auto points_destaggered =
+        cartesian(ls_destaggered, make_xyz_lut(info, true));
+    LidarScan::Points expected_points(points.rows(), 3);
+    for (int c = 0; c < 3; c++)
+        destagger(points.col(c).data(), expected_points.col(c).data(),
+                  sizeof(double));
+    EXPECT_TRUE((expected_points == points_destaggered).all());
+}
+
+TEST_P(ScanBatcherProfileTest, reorder_window) {
+    const auto info = profile_info(GetParam());
+    const packet_format pf(info);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    const int cpp = pf.columns_per_packet;
+
+    ScanBatcher batcher(info, ReorderWindow{2, 1000});
+    LidarScanPool pool(w, h, info.format.udp_profile_lidar, 4);
+    const BatcherStats& stats = batcher.stats();
+
+    // the third packet of frame 1 arrives after the first of frame 2
+    for (uint16_t m_id = 0; m_id < w; m_id += cpp) {
+        if (m_id == 2 * cpp) continue;
+        auto packet = make_packet(pf, 1, m_id);
+        EXPECT_FALSE(batcher(packet.data(), pool, m_id));
+    }
+    auto first = make_packet(pf, 2, 0);
+    EXPECT_FALSE(batcher(first.data(), pool, 100));
+    auto late = make_packet(pf, 1, 2 * cpp);
+    auto done = batcher(late.data(), pool, 101);
+    ASSERT_TRUE(done);
+    EXPECT_EQ(done->frame_id, 1);
+    EXPECT_TRUE((done->status() != 0).all());
+    EXPECT_EQ(stats.late_packets, 1u);
+    EXPECT_EQ(stats.zeroed_cols, 0u);
+    EXPECT_EQ(stats.scans, 1u);
+    EXPECT_FALSE(batcher.release(101));
+
+    // frame 2 misses a packet and is released once the delay has passed
+    for (uint16_t m_id = cpp; m_id < w; m_id += cpp) {
+        if (m_id == 4 * cpp) continue;
+        auto packet = make_packet(pf, 2, m_id);
+        EXPECT_FALSE(batcher(packet.data(), pool, 150));
+    }
+    auto next = make_packet(pf, 3, 0);
+    EXPECT_FALSE(batcher(next.data(), pool, 200));
+    EXPECT_FALSE(batcher.release(1199));
+    done = batcher.release(1200);
+    ASSERT_TRUE(done);
+    EXPECT_EQ(done->frame_id, 2);
+    EXPECT_EQ(stats.expired_scans, 1u);
+    EXPECT_EQ(stats.zeroed_cols, static_cast<uint64_t>(cpp));
+    EXPECT_EQ((done->status() == 0).count(), cpp);
+    EXPECT_EQ(done->status()[4 * cpp], 0u);
+
+    // late packets of released frames are dropped
+    EXPECT_FALSE(batcher(late.data(), pool, 1300));
+    EXPECT_EQ(stats.reordered_packets, 1u);
+
+    // a third frame releases the oldest to make room
+    auto fourth = make_packet(pf, 4, 0);
+    EXPECT_FALSE(batcher(fourth.data(), pool, 1400));
+    auto fifth = make_packet(pf, 5, 0);
+    done = batcher(fifth.data(), pool, 1401);
+    ASSERT_TRUE(done);
+    EXPECT_EQ(done->frame_id, 3);
+    EXPECT_EQ(stats.expired_scans, 2u);
+
+    // the rest is flushed in order
+    EXPECT_EQ(batcher.release()->frame_id, 4);
+    EXPECT_EQ(batcher.release()->frame_id, 5);
+    EXPECT_FALSE(batcher.release());
+    EXPECT_EQ(stats.scans, 5u);
+
+    LidarScan ls(w, h, info.format.udp_profile_lidar);
+    EXPECT_THROW(batcher(first.data(), ls), std::invalid_argument);
+    EXPECT_THROW(ScanBatcher(info, ReorderWindow{0, 0}),
+                 std::invalid_argument);
+}
+
+TEST_P(ScanBatcherProfileTest, summary) {
+    auto info = profile_info(GetParam());
+    const packet_format pf(info);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    const int cpp = pf.columns_per_packet;
+    info.format.column_window = {static_cast<int>(w) - 4 * cpp, 4 * cpp - 1};
+    for (size_t u = 0; u < h; u++)
+        info.format.pixel_shift_by_row[u] = static_cast<int>(5 * u) - 12;
+
+    ScanBatcher batcher(info);
+    ScanBatcher destaggering(info, BATCH_DESTAGGER);
+    LidarScan ls(w, h, info.format.udp_profile_lidar);
+    LidarScan ls_destaggered(w, h, info.format.udp_profile_lidar);
+    EXPECT_FALSE(ls.summary().valid);
+
+    // frame 1 misses a packet inside the window, has an invalid column and
+    // a duplicate packet
+    auto add = [&](const std::vector<uint8_t>& packet) {
+        const bool done = batcher(packet.data(), ls);
+        EXPECT_EQ(destaggering(packet.data(), ls_destaggered), done);
+        return done;
+    };
+    for (uint16_t m_id = 0; m_id < w; m_id += cpp) {
+        if (m_id == 2 * cpp) continue;
+        EXPECT_FALSE(add(make_packet(pf, 1, m_id, m_id == 0 ? 3 : -1, m_id)));
+    }
+    EXPECT_FALSE(add(make_packet(pf, 1, 5 * cpp, -1, 5 * cpp)));
+    EXPECT_TRUE(add(make_packet(pf, 2, 0)));
+
+    const ScanSummary& s = ls.summary();
+    ASSERT_TRUE(s.valid);
+    EXPECT_EQ(s.window, info.format.column_window);
+    EXPECT_EQ(s.cols_received, w - cpp - 1);
+    EXPECT_EQ(s.cols_missing, static_cast<uint32_t>(cpp + 1));
+    EXPECT_EQ(s.window_cols_received, static_cast<uint32_t>(7 * cpp - 1));
+    EXPECT_EQ(s.first_timestamp, 1000u);
+    EXPECT_EQ(s.last_timestamp, 1000u + cpp - 1);
+
+    // zero ranges of valid columns, wherever they're stored
+    const LidarScan& cls = ls;
+    const auto range = cls.field<uint32_t>(ChanField::RANGE);
+    uint64_t zero_range = 0;
+    for (size_t v = 0; v < w; v++)
+        if (cls.status()[v] & 0x01) zero_range += (range.col(v) == 0).count();
+    EXPECT_EQ(s.zero_range, zero_range);
+    EXPECT_EQ(ls_destaggered.summary().zero_range, zero_range);
+    EXPECT_EQ(ls_destaggered.summary().cols_received, s.cols_received);
+    if (cls.field_type(ChanField::RANGE2) == ChanFieldType::VOID) {
+        EXPECT_EQ(s.zero_range2, 0u);
+    }
+
+    // incomplete in the window, consistently with the status headers
+    EXPECT_FALSE(ls.complete(info.format.column_window));
+    EXPECT_TRUE(cls.complete({3 * cpp, 4 * cpp - 1}));
+    EXPECT_FALSE(cls.complete({0, static_cast<int>(w) - 1}));
+
+    // copies keep the summary, writes invalidate it
+    LidarScan copy = ls;
+    EXPECT_TRUE(copy.summary().valid);
+    ls.status().setConstant(1);
+    EXPECT_FALSE(ls.summary().valid);
+    EXPECT_TRUE(ls.complete(info.format.column_window));
+
+    // the next scan starts over
+    for (uint16_t m_id = cpp; m_id < w; m_id += cpp)
+        EXPECT_FALSE(add(make_packet(pf, 2, m_id)));
+    EXPECT_TRUE(add(make_packet(pf, 3, 0)));
+    ASSERT_TRUE(ls.summary().valid);
+    EXPECT_EQ(ls.summary().cols_received, w);
+    EXPECT_EQ(ls.summary().cols_missing, 0u);
+    EXPECT_TRUE(ls.complete(info.format.column_window));
+}
@@ -0,0 +1,238 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/scan_codec.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "ouster/impl/lidar_scan_impl.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+
+namespace {
+
+struct fill_random {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, ChanField, std::mt19937& gen) {
+        std::uniform_int_distribution<uint64_t> dist;
+        for (int i = 0; i < field.size(); i++)
+            field.data()[i] = static_cast<T>(dist(gen));
+    }
+};
+
+// smooth in the destaggered image, with some noise and dropouts
+struct fill_smooth {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, ChanField,
+                    const std::vector<int>& shifts, std::mt19937& gen) {
+        std::uniform_int_distribution<int> noise(-2, 2);
+        std::uniform_int_distribution<int> dropout(0, 50);
+        img_t<T> img(field.rows(), field.cols());
+        for (int u = 0; u < img.rows(); u++) {
+            for (int v = 0; v < img.cols(); v++) {
+                const double x = 100 + 80 * std::sin(v * 0.02) + u * 0.5;
+                img(u, v) = dropout(gen) == 0
+                                ? T{0}
+                                : static_cast<T>(x + noise(gen));
+            }
+        }
+        field = stagger<T>(img, shifts);
+    }
+};
+
+std::vector<ChanField> fields_of(const LidarScan& ls) {
+    std::vector<ChanField> fields;
+    for (const auto& ft : ls) fields.push_back(ft.first);
+    return fields;
+}
+
+size_t raw_size(const LidarScan& ls) {
+    size_t size = 0;
+    for (const auto& ft : ls) {
+        const size_t bytes = ft.second == ChanFieldType::UINT8    ? 1
+                             : ft.second == ChanFieldType::UINT16 ? 2
+                             : ft.second == ChanFieldType::UINT32 ? 4
+                                                                  : 8;
+        size += ls.w * ls.h * bytes;
+    }
+    return size;
+}
+
+void fill_headers(LidarScan& ls) {
+    ls.frame_id = 42;
+    for (int c = 0; c < ls.w; c++) {
+        ls.timestamp()[c] = 1000000000 + c * 100000;
+        ls.rx_timestamp()[c] = 1000000050 + c * 100000;
+        ls.measurement_id()[c] = static_cast<uint16_t>(c);
+        ls.status()[c] = 1;
+    }
+}
+
+}  // namespace
+
+class ScanCodecTest : public ::testing::TestWithParam<UDPProfileLidar> {};
+
+INSTANTIATE_TEST_CASE_P(
+    Profiles, ScanCodecTest,
+    ::testing::Values(UDPProfileLidar::PROFILE_LIDAR_LEGACY,
+                      UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL,
+                      UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16,
+                      UDPProfileLidar::PROFILE_RNG15_RFL8_NIR8));
+
+TEST_P(ScanCodecTest, round_trip_random) {
+    auto info = default_sensor_info(MODE_1024x10);
+    info.format.udp_profile_lidar = GetParam();
+    const ScanCodec codec(info);
+
+    LidarScan ls(info.format.columns_per_frame, info.format.pixels_per_column,
+                 GetParam());
+    std::mt19937 gen(0);
+    impl::foreach_field(ls, fill_random{}, gen);
+    fill_headers(ls);
+
+    const auto encoded = codec.encode(ls, fields_of(ls));
+    LidarScan decoded(ls.w, ls.h, GetParam());
+    codec.decode(encoded.data(), encoded.size(), decoded);
+    EXPECT_EQ(decoded, ls);
+    EXPECT_TRUE((decoded.rx_timestamp() == ls.rx_timestamp()).all());
+}
+
+TEST_P(ScanCodecTest, round_trip_smooth) {
+    auto info = default_sensor_info(MODE_1024x10);
+    info.format.udp_profile_lidar = GetParam();
+    const ScanCodec codec(info);
+
+    LidarScan ls(info.format.columns_per_frame, info.format.pixels_per_column,
+                 GetParam());
+    std::mt19937 gen(0);
+    impl::foreach_field(ls, fill_smooth{}, info.format.pixel_shift_by_row, gen);
+    fill_headers(ls);
+
+    const auto encoded = codec.encode(ls, fields_of(ls));
+    LidarScan decoded;
+    codec.decode(encoded.data(), encoded.size(), decoded);
+    EXPECT_EQ(decoded, ls);
+
+    EXPECT_LT(encoded.size() * 2, raw_size(ls));
+}
+
+TEST(ScanCodecTest, odd_dimensions_and_shifts) {
+    const std::vector<std::pair<ChanField, ChanFieldType>> fields{
+        {ChanField::RANGE, ChanFieldType::UINT32},
+        {ChanField::SIGNAL, ChanFieldType::UINT16},
+        {ChanField::REFLECTIVITY, ChanFieldType::UINT8},
+        {ChanField::RAW32_WORD1, ChanFieldType::UINT64}};
+    // shifts larger than the width and negative
+    const std::vector<int> shifts{0, 5, -3, 40, 77, -100, 1};
+    const ScanCodec codec(shifts);
+
+    for (int w : {1, 31, 33, 37}) {
+        LidarScan ls(w, shifts.size(), fields.begin(), fields.end());
+        std::mt19937 gen(w);
+        impl::foreach_field(ls, fill_smooth{}, shifts, gen);
+        fill_headers(ls);
+
+        std::vector<uint8_t> encoded;
+        codec.encode(ls, fields_of(ls), encoded);
+        LidarScan decoded(w, shifts.size(), fields.begin(), fields.end());
+        codec.decode(encoded.data(), encoded.size(), decoded);
+        EXPECT_EQ(decoded, ls) << "w = " << w;
+    }
+}
+
+TEST(ScanCodecTest, round_trip_destaggered) {
+    const auto info = default_sensor_info(MODE_1024x10);
+    const ScanCodec codec(info);
+
+    // fields of destaggered scans are smooth as stored
+    LidarScan ls(1024, 64);
+    std::mt19937 gen(2);
+    impl::foreach_field(ls, fill_smooth{}, std::vector<int>(64, 0), gen);
+    fill_headers(ls);
+    ls.destaggered = true;
+
+    const auto encoded = codec.encode(ls, fields_of(ls));
+    LidarScan decoded;
+    codec.decode(encoded.data(), encoded.size(), decoded);
+    EXPECT_TRUE(decoded.destaggered);
+    EXPECT_EQ(decoded, ls);
+
+    EXPECT_LT(encoded.size() * 2, raw_size(ls));
+}
+
+TEST(ScanCodecTest, subset_of_fields) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const ScanCodec codec(info);
+    LidarScan ls(512, 64);
+    std::mt19937 gen(1);
+    impl::foreach_field(ls, fill_smooth{}, info.format.pixel_shift_by_row, gen);
+
+    const auto encoded = codec.encode(ls, {ChanField::RANGE});
+
+    // scan with the field is kept, other fields are left as is
+    LidarScan same(512, 64);
+    codec.decode(encoded.data(), encoded.size(), same);
+    EXPECT_TRUE((same.field(ChanField::RANGE) == ls.field(ChanField::RANGE))
+                    .all());
+    EXPECT_TRUE((same.field(ChanField::SIGNAL) == 0).all());
+
+    // otherwise the scan is replaced
+    LidarScan other(256, 64);
+    codec.decode(encoded.data(), encoded.size(), other);
+    EXPECT_EQ(other.w, 512);
+    EXPECT_EQ(std::distance(other.begin(), other.end()), 1);
+    EXPECT_EQ(other.field_type(ChanField::RANGE), ChanFieldType::UINT32);
+    EXPECT_TRUE((other.field(ChanField::RANGE) == ls.field(ChanField::RANGE))
+                    .all());
+}
+
+TEST(ScanCodecTest, invalid_input) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const ScanCodec codec(info);
+    LidarScan ls(512, 64);
+    std::mt19937 gen(2);
+    impl::foreach_field(ls, fill_random{}, gen);
+
+    EXPECT_THROW(codec.encode(ls, {ChanField::RANGE2}), std::invalid_argument);
+    EXPECT_THROW(ScanCodec(std::vector<int>(16, 0)).encode(ls, fields_of(ls)),
+                 std::invalid_argument);
+
+    const auto encoded = codec.encode(ls, fields_of(ls));
+    LidarScan decoded;
+    EXPECT_THROW(codec.decode(encoded.data(), 10, decoded),
+                 std::invalid_argument);
+    for (size_t size = 24; size < encoded.size(); size += encoded.size() / 7)
+        EXPECT_THROW(codec.decode(encoded.data(), size, decoded),
+                     std::invalid_argument);
+
+    auto bad = encoded;
+    bad[0] ^= 1;
+    EXPECT_THROW(codec.decode(bad.data(), bad.size(), decoded),
+                 std::invalid_argument);
+    EXPECT_THROW(ScanCodec(std::vector<int>(16, 0))
+                     .decode(encoded.data(), encoded.size(), decoded),
+                 std::invalid_argument);
+
+    // corrupt bit streams must not read out of bounds
+    std::mt19937 flip(3);
+    for (int i = 0; i < 50; i++) {
+        bad = encoded;
+        std::uniform_int_distribution<size_t> pos(200, bad.size() - 1);
+        for (int j = 0; j < 16; j++)
+            bad[pos(flip)] = static_cast<uint8_t>(flip());
+        try {
+            codec.decode(bad.data(), bad.size(), decoded);
+        } catch (const std::invalid_argument&) {
+        }
+    }
+}
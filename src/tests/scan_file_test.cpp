@@ -0,0 +1,233 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/scan_file.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ouster/impl/lidar_scan_impl.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+using namespace ouster::sensor_utils;
+
+namespace {
+
+struct fill_random {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, ChanField, std::mt19937& gen) {
+        std::uniform_int_distribution<uint64_t> dist(0, 1 << 20);
+        for (int i = 0; i < field.size(); i++)
+            field.data()[i] = static_cast<T>(dist(gen));
+    }
+};
+
+std::vector<LidarScan> make_scans(const sensor_info& info, size_t n) {
+    std::mt19937 gen(0);
+    std::vector<LidarScan> scans;
+    for (size_t i = 0; i < n; i++) {
+        LidarScan ls(info.format.columns_per_frame,
+                     info.format.pixels_per_column,
+                     info.format.udp_profile_lidar);
+        impl::foreach_field(ls, fill_random{}, gen);
+        ls.frame_id = static_cast<int32_t>(i);
+        for (int c = 0; c < ls.w; c++) {
+            ls.timestamp()[c] = (i + 1) * 100000000 + c;
+            ls.rx_timestamp()[c] = (i + 1) * 100000000 + c + 50;
+            ls.measurement_id()[c] = static_cast<uint16_t>(c);
+            ls.status()[c] = 1;
+        }
+        // a frame missing its first columns
+        if (i == 1) ls.timestamp().head(8) = 0;
+        scans.push_back(std::move(ls));
+    }
+    return scans;
+}
+
+sensor_info dual_info() {
+    auto info = default_sensor_info(MODE_512x10);
+    info.format.udp_profile_lidar =
+        UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL;
+    return info;
+}
+
+std::string temp_path(const std::string& name) {
+    return std::string(::testing::TempDir()) + name;
+}
+
+}  // namespace
+
+class ScanFileTest : public ::testing::TestWithParam<int> {};
+
+// compression levels
+INSTANTIATE_TEST_CASE_P(Compression, ScanFileTest, ::testing::Values(0, 1, 6));
+
+TEST_P(ScanFileTest, round_trip) {
+    const auto info = dual_info();
+    const auto scans = make_scans(info, 11);
+    const std::string path = temp_path("round_trip.scans");
+
+    scan_file_options opts;
+    opts.chunk_frames = 4;
+    opts.compression_level = GetParam();
+    {
+        ScanFileWriter writer(path, info, opts);
+        for (const auto& ls : scans) writer.write(ls);
+        EXPECT_EQ(writer.frame_count(), scans.size());
+    }
+
+    ScanFileReader reader(path);
+    EXPECT_EQ(reader.metadata(), to_string(info));
+    EXPECT_EQ(reader.info().format.udp_profile_lidar,
+              info.format.udp_profile_lidar);
+    EXPECT_EQ(reader.w(), info.format.columns_per_frame);
+    EXPECT_EQ(reader.h(), info.format.pixels_per_column);
+    EXPECT_TRUE(std::equal(reader.field_types().begin(),
+                           reader.field_types().end(), scans[0].begin(),
+                           scans[0].end()));
+    ASSERT_EQ(reader.frame_count(), scans.size());
+
+    LidarScan ls;
+    for (size_t i = 0; i < scans.size(); i++) {
+        EXPECT_EQ(reader.frame_id(i), scans[i].frame_id);
+        reader.read(i, ls);
+        EXPECT_EQ(ls, scans[i]) << "frame " << i;
+        EXPECT_TRUE((ls.rx_timestamp() == scans[i].rx_timestamp()).all());
+    }
+
+    // random access, going back to earlier chunks
+    reader.read(2, ls);
+    EXPECT_EQ(ls, scans[2]);
+
+    EXPECT_EQ(reader.frame_timestamp(1).count(), 200000008);
+    EXPECT_EQ(reader.find_frame(std::chrono::nanoseconds{0}), 0u);
+    EXPECT_EQ(reader.find_frame(std::chrono::nanoseconds{300000000}), 2u);
+    EXPECT_EQ(reader.find_frame(std::chrono::nanoseconds{300000001}), 3u);
+    EXPECT_EQ(reader.find_frame(std::chrono::nanoseconds{2000000000}),
+              scans.size());
+    EXPECT_THROW(reader.read(scans.size(), ls), std::out_of_range);
+
+    std::remove(path.c_str());
+}
+
+TEST_P(ScanFileTest, views_outlive_reader) {
+    const auto info = dual_info();
+    const auto scans = make_scans(info, 6);
+    const std::string path = temp_path("views.scans");
+
+    scan_file_options opts;
+    opts.chunk_frames = 2;
+    opts.compression_level = GetParam();
+    {
+        ScanFileWriter writer(path, info, opts);
+        for (const auto& ls : scans) writer.write(ls);
+    }
+
+    std::vector<scan_view> views;
+    {
+        ScanFileReader reader(path);
+        for (size_t i = 0; i < scans.size(); i++)
+            views.push_back(reader.view(i));
+    }
+
+    for (size_t i = 0; i < scans.size(); i++) {
+        const auto& v = views[i];
+        EXPECT_EQ(v.frame_id, scans[i].frame_id);
+        EXPECT_EQ(v.timestamp[3], scans[i].timestamp()[3]);
+        const auto* range = v.find(ChanField::RANGE2);
+        ASSERT_NE(range, nullptr);
+        EXPECT_EQ(range->type, ChanFieldType::UINT32);
+        const auto* data = static_cast<const uint32_t*>(range->data);
+        const auto expected = scans[i].field<uint32_t>(ChanField::RANGE2);
+        EXPECT_TRUE(std::equal(data, data + expected.size(), expected.data()));
+        EXPECT_EQ(v.find(ChanField::RAW32_WORD1), nullptr);
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(ScanFileWriterTest, custom_fields_and_mismatch) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const std::vector<std::pair<ChanField, ChanFieldType>> fields{
+        {ChanField::RANGE, ChanFieldType::UINT32},
+        {ChanField::REFLECTIVITY, ChanFieldType::UINT8}};
+    LidarScan prototype(512, 64, fields.begin(), fields.end());
+    const std::string path = temp_path("custom.scans");
+
+    ScanFileWriter writer(path, info, prototype);
+    prototype.field(ChanField::RANGE)(3, 5) = 1234;
+    prototype.frame_id = 7;
+    writer.write(prototype);
+    EXPECT_THROW(writer.write(LidarScan(512, 64)), std::invalid_argument);
+    writer.close();
+    EXPECT_THROW(writer.write(prototype), std::runtime_error);
+
+    ScanFileReader reader(path);
+    ASSERT_EQ(reader.frame_count(), 1u);
+    LidarScan ls;
+    reader.read(0, ls);
+    EXPECT_EQ(ls, prototype);
+
+    std::remove(path.c_str());
+}
+
+TEST(ScanFileReaderTest, recovers_unclosed_file) {
+    const auto info = dual_info();
+    const auto scans = make_scans(info, 5);
+    const std::string path = temp_path("unclosed.scans");
+    const std::string truncated = temp_path("truncated.scans");
+
+    scan_file_options opts;
+    opts.chunk_frames = 2;
+    {
+        ScanFileWriter writer(path, info, opts);
+        for (const auto& ls : scans) writer.write(ls);
+    }
+
+    // drop the index, the trailer and part of the last chunk
+    std::vector<char> bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+    }
+    {
+        std::ofstream out(truncated, std::ios::binary);
+        out.write(bytes.data(), bytes.size() - 200);
+    }
+
+    ScanFileReader reader(truncated);
+    ASSERT_EQ(reader.frame_count(), 4u);
+    LidarScan ls;
+    for (size_t i = 0; i < reader.frame_count(); i++) {
+        reader.read(i, ls);
+        EXPECT_EQ(ls, scans[i]);
+    }
+
+    std::remove(path.c_str());
+    std::remove(truncated.c_str());
+}
+
+TEST(ScanFileReaderTest, rejects_other_files) {
+    const std::string path = temp_path("not_scans.bin");
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << "definitely not a scan file, but long enough to have a header";
+    }
+    EXPECT_THROW(ScanFileReader{path}, std::runtime_error);
+    EXPECT_THROW(ScanFileReader{temp_path("missing.scans")},
+                 std::runtime_error);
+    std::remove(path.c_str());
+}
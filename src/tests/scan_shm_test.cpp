@@ -0,0 +1,209 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/scan_shm.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ouster/impl/lidar_scan_impl.h"
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+
+namespace {
+
+struct fill_random {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, ChanField, std::mt19937& gen) {
+        std::uniform_int_distribution<uint64_t> dist;
+        for (int i = 0; i < field.size(); i++)
+            field.data()[i] = static_cast<T>(dist(gen));
+    }
+};
+
+// unique per test process, so that tests may run in parallel
+std::string segment_name(const std::string& test) {
+    return "/ouster_scan_shm_test_" + std::to_string(getpid()) + "_" + test;
+}
+
+LidarScan random_scan(const sensor_info& info, std::mt19937& gen,
+                      int32_t frame_id) {
+    LidarScan ls{info.format.columns_per_frame, info.format.pixels_per_column,
+                 info.format.udp_profile_lidar};
+    impl::foreach_field(ls, fill_random{}, gen);
+    ls.frame_id = frame_id;
+    ls.timestamp().setLinSpaced(frame_id, frame_id + ls.w);
+    ls.status().setConstant(1);
+    return ls;
+}
+
+}  // namespace
+
+TEST(ScanShmTest, view_published_scans) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const auto name = segment_name("view");
+    std::mt19937 gen{1};
+
+    ScanShmPublisher pub{name, info};
+    ScanShmSubscriber sub{name};
+    // published as json, which doesn't round trip the name
+    EXPECT_EQ(sub.info().sn, info.sn);
+    EXPECT_EQ(sub.info().mode, info.mode);
+    EXPECT_EQ(sub.info().format, info.format);
+    EXPECT_EQ(sub.info().beam_altitude_angles, info.beam_altitude_angles);
+    EXPECT_EQ(sub.seq(), 0u);
+    EXPECT_FALSE(sub.valid());
+
+    for (int32_t i = 1; i <= 3; i++) {
+        const auto ls = random_scan(info, gen, i);
+        EXPECT_EQ(pub.publish(ls), static_cast<uint64_t>(i));
+
+        const LidarScan* view = sub.next();
+        ASSERT_NE(view, nullptr);
+        EXPECT_FALSE(view->owns_arena());
+        EXPECT_EQ(*view, ls);
+        EXPECT_TRUE(sub.valid());
+        EXPECT_EQ(sub.seq(), static_cast<uint64_t>(i));
+    }
+    EXPECT_EQ(pub.published(), 3u);
+    EXPECT_EQ(sub.dropped(), 0u);
+    EXPECT_FALSE(sub.closed());
+
+    // nothing new to read
+    EXPECT_EQ(sub.next(0.01f), nullptr);
+}
+
+TEST(ScanShmTest, lagging_subscriber_skips_ahead) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const auto name = segment_name("lagging");
+    std::mt19937 gen{2};
+
+    ScanShmPublisher pub{name, info, 4};
+    ScanShmSubscriber sub{name};
+    std::vector<LidarScan> scans;
+    for (int32_t i = 1; i <= 10; i++) {
+        scans.push_back(random_scan(info, gen, i));
+        pub.publish(scans.back());
+    }
+
+    // keeps a slot of margin to the one written next
+    const LidarScan* view = sub.next();
+    ASSERT_NE(view, nullptr);
+    EXPECT_EQ(sub.seq(), 8u);
+    EXPECT_EQ(sub.dropped(), 7u);
+    EXPECT_EQ(*view, scans[7]);
+
+    // overwritten once the publisher wraps around
+    for (int32_t i = 11; i <= 14; i++) pub.publish(random_scan(info, gen, i));
+    EXPECT_FALSE(sub.valid());
+}
+
+TEST(ScanShmTest, read_copies) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const auto name = segment_name("read");
+    std::mt19937 gen{3};
+
+    ScanShmPublisher pub{name, info, 2};
+    ScanShmSubscriber sub{name};
+    const auto ls = random_scan(info, gen, 1);
+    pub.publish(ls);
+
+    LidarScan copy;
+    ASSERT_TRUE(sub.read(copy));
+    EXPECT_TRUE(copy.owns_arena());
+    EXPECT_EQ(copy, ls);
+
+    // the copy survives the slot being overwritten
+    for (int32_t i = 2; i <= 4; i++) pub.publish(random_scan(info, gen, i));
+    EXPECT_EQ(copy, ls);
+
+    // skips to the latest scan, the other slot is written next
+    ASSERT_TRUE(sub.read(copy));
+    EXPECT_EQ(sub.seq(), 4u);
+    EXPECT_EQ(sub.dropped(), 2u);
+    EXPECT_EQ(copy.frame_id, 4);
+}
+
+TEST(ScanShmTest, custom_fields) {
+    const auto info = default_sensor_info(MODE_1024x10);
+    const auto name = segment_name("custom");
+    std::mt19937 gen{4};
+
+    const std::vector<std::pair<ChanField, ChanFieldType>> fields{
+        {ChanField::RANGE, ChanFieldType::UINT32},
+        {ChanField::FLAGS, ChanFieldType::UINT8}};
+    LidarScan ls{64, 16, fields.begin(), fields.end()};
+    impl::foreach_field(ls, fill_random{}, gen);
+    ls.destaggered = true;
+
+    ScanShmPublisher pub{name, info, ls};
+    ScanShmSubscriber sub{name};
+    pub.publish(ls);
+    const LidarScan* view = sub.next();
+    ASSERT_NE(view, nullptr);
+    EXPECT_EQ(view->w, 64);
+    EXPECT_EQ(view->h, 16);
+    EXPECT_TRUE(view->destaggered);
+    EXPECT_EQ(*view, ls);
+
+    // scans with other fields or dimensions don't fit the slots
+    EXPECT_THROW(pub.publish(random_scan(info, gen, 1)), std::invalid_argument);
+    LidarScan other{64, 16, fields.begin(), fields.begin() + 1};
+    EXPECT_THROW(pub.publish(other), std::invalid_argument);
+}
+
+TEST(ScanShmTest, wake_up_and_close) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const auto name = segment_name("wake");
+    std::mt19937 gen{5};
+
+    auto pub = std::unique_ptr<ScanShmPublisher>{
+        new ScanShmPublisher{name, info}};
+    ScanShmSubscriber sub{name};
+    const auto ls = random_scan(info, gen, 1);
+
+    std::thread publisher{[&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        pub->publish(ls);
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        pub.reset();
+    }};
+
+    const LidarScan* view = sub.next(10.0f);
+    ASSERT_NE(view, nullptr);
+    EXPECT_EQ(*view, ls);
+
+    // wakes up as the publisher goes away
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(sub.next(10.0f), nullptr);
+    EXPECT_LT(std::chrono::steady_clock::now() - start,
+              std::chrono::seconds{5});
+    EXPECT_TRUE(sub.closed());
+    publisher.join();
+
+    // the segment was removed
+    EXPECT_THROW(ScanShmSubscriber{name}, std::runtime_error);
+}
+
+TEST(ScanShmTest, invalid_segments) {
+    const auto info = default_sensor_info(MODE_512x10);
+    EXPECT_THROW(ScanShmSubscriber{segment_name("missing")},
+                 std::runtime_error);
+    EXPECT_THROW(ScanShmPublisher(segment_name("slots"), info, 1),
+                 std::invalid_argument);
+    EXPECT_THROW(ScanShmPublisher("", info), std::invalid_argument);
+}
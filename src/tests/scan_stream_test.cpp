@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/scan_stream.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+
+namespace {
+
+LidarScan make_scan(const sensor_info& info, uint16_t frame_id) {
+    LidarScan ls{info.format.columns_per_frame, info.format.pixels_per_column,
+                 info.format.udp_profile_lidar};
+    std::mt19937 gen{frame_id};
+    std::uniform_int_distribution<uint32_t> range(0, 100000);
+    auto r = ls.field<uint32_t>(ChanField::RANGE);
+    for (int i = 0; i < r.size(); i++) r.data()[i] = range(gen);
+    ls.field<uint32_t>(ChanField::REFLECTIVITY).setConstant(frame_id);
+    for (int v = 0; v < ls.w; v++) ls.timestamp()[v] = 1000 * v + frame_id;
+    ls.status().setConstant(1);
+    ls.frame_id = frame_id;
+    return ls;
+}
+
+// send scans until the client gets one, as it may not be accepted yet
+bool send_until_read(ScanStreamServer& server, ScanStreamClient& client,
+                     const LidarScan& scan, LidarScan& out) {
+    for (int i = 0; i < 50; i++) {
+        server.send(scan);
+        if (client.read(out, 0.1f)) return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+TEST(ScanStreamTest, round_trip) {
+    const auto info = default_sensor_info(MODE_512x10);
+    ScanStreamServer server{info};
+    ASSERT_GT(server.port(), 0);
+
+    ScanStreamClient client{"127.0.0.1", server.port()};
+    EXPECT_EQ(client.metadata().format.columns_per_frame, 512u);
+    EXPECT_EQ(client.region().cols.size(), 512u);
+    EXPECT_EQ(client.region().rows.size(), info.format.pixels_per_column);
+
+    const auto scan = make_scan(info, 7);
+    LidarScan out;
+    ASSERT_TRUE(send_until_read(server, client, scan, out));
+    EXPECT_EQ(out.frame_id, 7);
+    EXPECT_TRUE((out.field<uint32_t>(ChanField::RANGE) ==
+                 scan.field<uint32_t>(ChanField::RANGE))
+                    .all());
+    EXPECT_TRUE((out.field<uint32_t>(ChanField::REFLECTIVITY) == 7).all());
+    EXPECT_TRUE((out.timestamp() == scan.timestamp()).all());
+    EXPECT_EQ(out.field_type(ChanField::SIGNAL), ChanFieldType::VOID);
+
+    // frames keep coming in order, and nothing waits once all are read
+    for (uint16_t id = 8; id < 12; id++) {
+        server.send(make_scan(info, id));
+        ASSERT_TRUE(client.read(out));
+        EXPECT_EQ(out.frame_id, id);
+    }
+    EXPECT_FALSE(client.read(out, 0.05f));
+    const auto stats = server.stats();
+    EXPECT_EQ(stats.clients, 1u);
+    EXPECT_GE(stats.frames, 5u);
+    EXPECT_GT(stats.bytes, 0u);
+}
+
+TEST(ScanStreamTest, region_and_range_step) {
+    const auto info = default_sensor_info(MODE_1024x10);
+    StreamConfig config;
+    config.fields = {ChanField::RANGE};
+    config.region = make_scan_region(info, 4, 2);
+    config.range_step = 10;
+    ScanStreamServer server{info, 0, config};
+    ScanStreamClient client{"localhost", server.port()};
+    EXPECT_EQ(client.region().rows, config.region.rows);
+    EXPECT_EQ(client.region().cols, config.region.cols);
+
+    const auto scan = make_scan(info, 3);
+    LidarScan out;
+    ASSERT_TRUE(send_until_read(server, client, scan, out));
+    const auto& region = client.region();
+    ASSERT_EQ(out.w, static_cast<ptrdiff_t>(region.cols.size()));
+    ASSERT_EQ(out.h, static_cast<ptrdiff_t>(region.rows.size()));
+    EXPECT_EQ(out.field_type(ChanField::REFLECTIVITY), ChanFieldType::VOID);
+
+    const auto r = scan.field<uint32_t>(ChanField::RANGE);
+    const auto r_out = out.field<uint32_t>(ChanField::RANGE);
+    for (size_t j = 0; j < region.rows.size(); j++) {
+        for (size_t k = 0; k < region.cols.size(); k++) {
+            const int64_t x = r(region.rows[j], region.cols[k]);
+            const int64_t y = r_out(j, k);
+            EXPECT_EQ(y % 10, 0);
+            EXPECT_LE(std::abs(x - y), 5);
+        }
+    }
+    for (size_t k = 0; k < region.cols.size(); k++)
+        EXPECT_EQ(out.timestamp()[k], scan.timestamp()[region.cols[k]]);
+}
+
+TEST(ScanStreamTest, clients_join_and_fall_behind) {
+    const auto info = default_sensor_info(MODE_512x10);
+    StreamConfig config;
+    config.max_pending = 1;
+    ScanStreamServer server{info, 0, config};
+    ScanStreamClient first{"127.0.0.1", server.port()};
+    LidarScan out;
+    ASSERT_TRUE(send_until_read(server, first, make_scan(info, 1), out));
+
+    // a late client starts with the next frame
+    ScanStreamClient second{"127.0.0.1", server.port()};
+    ASSERT_TRUE(send_until_read(server, second, make_scan(info, 2), out));
+    EXPECT_EQ(out.frame_id, 2);
+    EXPECT_EQ(server.stats().clients, 2u);
+
+    // frames queued past the limit are dropped, not buffered
+    for (uint16_t id = 3; id < 200; id++) server.send(make_scan(info, id));
+    EXPECT_GT(server.stats().dropped_frames, 0u);
+    uint16_t last = 0;
+    while (second.read(out, 0.2f)) {
+        EXPECT_GE(out.frame_id, last);
+        last = out.frame_id;
+    }
+    EXPECT_EQ(out.field<uint32_t>(ChanField::REFLECTIVITY)(0, 0), last);
+}
+
+TEST(ScanStreamTest, invalid_arguments) {
+    const auto info = default_sensor_info(MODE_512x10);
+    StreamConfig config;
+    config.range_step = 0;
+    EXPECT_THROW(ScanStreamServer(info, 0, config), std::invalid_argument);
+    config = {};
+    config.fields.clear();
+    EXPECT_THROW(ScanStreamServer(info, 0, config), std::invalid_argument);
+    config = {};
+    config.region.rows = {0, 64};
+    config.region.cols = {0};
+    EXPECT_THROW(ScanStreamServer(info, 0, config), std::invalid_argument);
+
+    ScanStreamServer server{info};
+    EXPECT_THROW(server.send(LidarScan{1024, 64}), std::invalid_argument);
+    config = {};
+    config.fields = {ChanField::SIGNAL2};
+    ScanStreamServer dual{info, 0, config};
+    EXPECT_THROW(dual.send(make_scan(info, 0)), std::invalid_argument);
+
+    // nothing listens on the port of a closed server
+    int port = 0;
+    {
+        ScanStreamServer closed{info};
+        port = closed.port();
+    }
+    EXPECT_THROW(ScanStreamClient("127.0.0.1", port, 0.1f),
+                 std::runtime_error);
+}
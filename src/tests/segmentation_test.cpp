@@ -0,0 +1,193 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/segmentation.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include "ouster/lidar_scan.h"
+#include "ouster/types.h"
+
+using namespace ouster;
+using namespace ouster::sensor;
+
+namespace {
+
+constexpr double ground_z = -1.5;
+
+struct Object {
+    int begin, end;  // destaggered columns, wrapping around
+    uint32_t range;  // mm
+};
+
+// a destaggered range image of flat ground and upright objects standing
+// clear of it, e.g. the bodies of vehicles
+struct Scene {
+    img_t<uint32_t> range;
+    img_t<uint8_t> ground;
+    img_t<int> object;  // index of the object of each pixel, or -1
+
+    Scene(const XYZLut& lut, size_t h, size_t w,
+          const std::vector<Object>& objects)
+        : range(img_t<uint32_t>::Zero(h, w)),
+          ground(img_t<uint8_t>::Zero(h, w)),
+          object(img_t<int>::Constant(h, w, -1)) {
+        for (size_t u = 0; u < h; u++) {
+            for (size_t v = 0; v < w; v++) {
+                const size_t i = u * w + v;
+                const double dz = lut.direction(i, 2);
+                const double oz = lut.offset(i, 2);
+                if (dz < 0) {
+                    const double r = (ground_z - oz) / dz;
+                    if (r < 60000) {
+                        range(u, v) = static_cast<uint32_t>(std::round(r));
+                        ground(u, v) = 1;
+                    }
+                }
+                for (size_t k = 0; k < objects.size(); k++) {
+                    const auto& o = objects[k];
+                    const int c = static_cast<int>(v);
+                    const bool in = o.begin <= o.end
+                                        ? c >= o.begin && c < o.end
+                                        : c >= o.begin || c < o.end;
+                    const double z = dz * o.range + oz;
+                    if (!in || z < ground_z + 0.5 || z > 1.0) continue;
+                    if (range(u, v) != 0 && range(u, v) < o.range) continue;
+                    range(u, v) = o.range;
+                    ground(u, v) = 0;
+                    object(u, v) = static_cast<int>(k);
+                }
+            }
+        }
+    }
+};
+
+}  // namespace
+
+TEST(SegmentationTest, ground_and_clusters) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    const auto lut = make_xyz_lut(info, true);
+
+    // the first object wraps around, the last two are adjacent in depth
+    const Scene scene(
+        lut, h, w, {{500, 12, 15000}, {300, 312, 15000}, {312, 320, 25000}});
+    img_t<uint8_t> mask = img_t<uint8_t>::Zero(h, w);
+    segmentation::ground_mask(scene.range, lut, {}, mask, 0x04);
+    EXPECT_TRUE(((mask == 0x04) == (scene.ground == 1)).all());
+    EXPECT_GT(scene.ground.cast<int>().sum(), 0);
+
+    img_t<uint32_t> labels(h, w);
+    EXPECT_EQ(segmentation::cluster(scene.range, lut, {}, labels, mask), 3u);
+
+    // one label per object, largest first
+    std::vector<std::set<uint32_t>> found(3);
+    std::vector<int> sizes(3, 0);
+    for (size_t u = 0; u < h; u++) {
+        for (size_t v = 0; v < w; v++) {
+            const int k = scene.object(u, v);
+            if (k < 0) {
+                EXPECT_EQ(labels(u, v), 0u);
+                continue;
+            }
+            found[k].insert(labels(u, v));
+            sizes[k]++;
+        }
+    }
+    for (size_t k = 0; k < 3; k++) ASSERT_EQ(found[k].size(), 1u) << k;
+    EXPECT_EQ(*found[0].begin(), 1u);
+    EXPECT_EQ(*found[1].begin(), sizes[1] > sizes[2] ? 2u : 3u);
+    EXPECT_EQ(*found[2].begin(), sizes[1] > sizes[2] ? 3u : 2u);
+
+    // small clusters are left out
+    segmentation::ClusterParams params;
+    params.min_points = sizes[0] + 1;
+    EXPECT_EQ(segmentation::cluster(scene.range, lut, params, labels, mask),
+              0u);
+    EXPECT_TRUE((labels == 0).all());
+}
+
+TEST(SegmentationTest, staggered_and_threads_agree) {
+    const auto info = default_sensor_info(MODE_1024x10);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    const auto lut = make_xyz_lut(info, true);
+    const Scene scene(
+        lut, h, w, {{1000, 30, 12000}, {400, 440, 20000}, {600, 603, 8000}});
+
+    img_t<uint8_t> mask = img_t<uint8_t>::Zero(h, w);
+    segmentation::ground_mask(scene.range, lut, {}, mask);
+    img_t<uint32_t> labels(h, w);
+    const size_t n = segmentation::cluster(scene.range, lut, {}, labels, mask);
+    EXPECT_EQ(n, 3u);
+
+    // the same scene, staggered, with blocks of columns across objects
+    const Destaggerer stagger(info, true);
+    const Destaggerer destagger(info);
+    const auto& shifts = info.format.pixel_shift_by_row;
+    img_t<uint32_t> staggered(h, w);
+    stagger(scene.range, staggered);
+    const auto staggered_lut = make_xyz_lut(info);
+    for (int n_threads : {1, 3, 7}) {
+        img_t<uint8_t> smask = img_t<uint8_t>::Zero(h, w);
+        segmentation::ground_mask(staggered, staggered_lut, {}, smask, 1,
+                                  shifts, n_threads);
+        img_t<uint8_t> dmask(h, w);
+        destagger(smask, dmask);
+        EXPECT_TRUE((dmask == mask).all()) << n_threads;
+
+        img_t<uint32_t> slabels(h, w);
+        EXPECT_EQ(segmentation::cluster(staggered, staggered_lut, {}, slabels,
+                                        smask, 0xff, shifts, n_threads),
+                  n);
+        img_t<uint32_t> dlabels(h, w);
+        destagger(slabels, dlabels);
+        EXPECT_TRUE((dlabels == labels).all()) << n_threads;
+    }
+}
+
+TEST(SegmentationTest, segment_scan) {
+    const auto info = default_sensor_info(MODE_512x10);
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    const auto lut = make_xyz_lut(info, true);
+    const Scene scene(lut, h, w, {{100, 120, 10000}, {200, 204, 10000}});
+
+    const std::vector<std::pair<ChanField, ChanFieldType>> fields{
+        {ChanField::RANGE, ChanFieldType::UINT32},
+        {ChanField::CUSTOM0, ChanFieldType::UINT8},
+        {ChanField::CUSTOM1, ChanFieldType::UINT8}};
+    LidarScan scan(w, h, fields.begin(), fields.end());
+    scan.destaggered = true;
+    scan.field<uint32_t>(ChanField::RANGE) = scene.range;
+
+    EXPECT_EQ(segmentation::segment(scan, lut, {}, {}, ChanField::CUSTOM0,
+                                    ChanField::CUSTOM1,
+                                    info.format.pixel_shift_by_row, 2),
+              2u);
+    EXPECT_TRUE(
+        (scan.field<uint8_t>(ChanField::CUSTOM0) == scene.ground).all());
+    const auto labels = scan.field<uint8_t>(ChanField::CUSTOM1);
+    EXPECT_TRUE(((labels == 1) == (scene.object == 0)).all());
+    EXPECT_TRUE(((labels == 2) == (scene.object == 1)).all());
+
+    EXPECT_THROW(segmentation::segment(scan, lut, {}, {}, ChanField::RANGE,
+                                       ChanField::CUSTOM1, {}),
+                 std::invalid_argument);
+    EXPECT_THROW(segmentation::segment(scan, lut, {}, {}, ChanField::CUSTOM0,
+                                       ChanField::CUSTOM2, {}),
+                 std::out_of_range);
+    const auto other = make_xyz_lut(default_sensor_info(MODE_1024x10));
+    EXPECT_THROW(segmentation::segment(scan, other, {}, {}, ChanField::CUSTOM0,
+                                       ChanField::CUSTOM1, {}),
+                 std::invalid_argument);
+}
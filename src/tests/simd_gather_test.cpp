@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "simd_gather.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace ouster::sensor::impl;
+
+namespace {
+
+// decode one field byte by byte, independently of the gather implementations
+uint32_t decode(const uint8_t* p, size_t size, uint32_t mask, int shift) {
+    uint32_t v = 0;
+    for (size_t k = 0; k < size; k++) v |= uint32_t{p[k]} << (8 * k);
+    if (mask) v &= mask;
+    return shift >= 0 ? v >> shift : v << -shift;
+}
+
+/*
+ * A buffer of size bytes ending right before an unreadable page, where the
+ * platform allows it, so that reading past the end faults.
+ */
+class GuardedBuffer {
+   public:
+    explicit GuardedBuffer(size_t size) : size_{size} {
+#if !defined(_WIN32)
+        const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        mapped_ = (size + page - 1) / page * page + page;
+        void* m = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED) throw std::runtime_error("mmap failed");
+        base_ = static_cast<uint8_t*>(m);
+        mprotect(base_ + mapped_ - page, page, PROT_NONE);
+        data_ = base_ + mapped_ - page - size;
+#else
+        fallback_.resize(size);
+        data_ = fallback_.data();
+#endif
+    }
+
+    ~GuardedBuffer() {
+#if !defined(_WIN32)
+        munmap(base_, mapped_);
+#endif
+    }
+
+    GuardedBuffer(const GuardedBuffer&) = delete;
+    GuardedBuffer& operator=(const GuardedBuffer&) = delete;
+
+    uint8_t* data() { return data_; }
+    size_t size() const { return size_; }
+
+   private:
+    size_t size_;
+    uint8_t* data_{nullptr};
+#if !defined(_WIN32)
+    uint8_t* base_{nullptr};
+    size_t mapped_{0};
+#else
+    std::vector<uint8_t> fallback_;
+#endif
+};
+
+}  // namespace
+
+TEST(SimdGatherTest, supported_combinations) {
+    EXPECT_TRUE(gather_field_u32_supported(1, -24));
+    EXPECT_FALSE(gather_field_u32_supported(1, -25));
+    EXPECT_TRUE(gather_field_u32_supported(2, -16));
+    EXPECT_FALSE(gather_field_u32_supported(2, -17));
+    EXPECT_TRUE(gather_field_u32_supported(4, 0));
+    EXPECT_FALSE(gather_field_u32_supported(4, -1));
+    EXPECT_FALSE(gather_field_u32_supported(8, 0));
+}
+
+TEST(SimdGatherTest, matches_scalar_decode) {
+    std::mt19937 gen(0);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    // channel data sizes of the lidar profiles, and odd ones
+    const std::vector<size_t> strides{3, 4, 5, 8, 12, 16, 24};
+    const std::vector<uint32_t> masks{0,          0xff,       0xff00,
+                                      0x0007ffff, 0xfffffff0, 0xffffffff};
+    const std::vector<int> counts{1, 7, 8, 9, 16, 17, 64, 129};
+
+    size_t checked = 0;
+    for (size_t size : {1, 2, 4}) {
+        for (int shift = -24; shift < 32; shift++) {
+            if (!gather_field_u32_supported(size, shift)) continue;
+            for (size_t stride : strides) {
+                if (stride < size) continue;
+                // at the start of the pixel, and at the end where the last
+                // field ends the buffer
+                for (size_t offset : {size_t{0}, stride - size}) {
+                    for (int n : counts) {
+                        const size_t bytes = (n - 1) * stride + offset + size;
+                        GuardedBuffer buf(bytes);
+                        for (size_t k = 0; k < bytes; k++)
+                            buf.data()[k] = static_cast<uint8_t>(byte(gen));
+
+                        for (uint32_t mask : masks) {
+                            std::vector<uint32_t> out(n + 1, 0xdeadbeef);
+                            gather_field_u32(buf.data() + offset, stride, size,
+                                             mask, shift, n, out.data());
+                            for (int i = 0; i < n; i++) {
+                                const uint8_t* p =
+                                    buf.data() + offset + i * stride;
+                                ASSERT_EQ(out[i], decode(p, size, mask, shift))
+                                    << "size " << size << " shift " << shift
+                                    << " stride " << stride << " offset "
+                                    << offset << " n " << n << " mask "
+                                    << mask << " at " << i;
+                            }
+                            // nothing written past n values
+                            ASSERT_EQ(out[n], 0xdeadbeefu);
+                            checked++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    EXPECT_GT(checked, 0u);
+}
+
+TEST(SimdGatherTest, empty) {
+    uint8_t src[4] = {1, 2, 3, 4};
+    uint32_t out = 0xdeadbeef;
+    gather_field_u32(src, 4, 4, 0, 0, 0, &out);
+    EXPECT_EQ(out, 0xdeadbeefu);
+}
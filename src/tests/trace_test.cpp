@@ -0,0 +1,154 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster/trace.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ouster;
+
+namespace {
+
+// installs a sink for the duration of a test
+struct SinkGuard {
+    explicit SinkGuard(trace::Sink* s) { trace::set_sink(s); }
+    ~SinkGuard() { trace::set_sink(nullptr); }
+};
+
+}  // namespace
+
+TEST(TraceTest, no_sink_by_default) {
+    EXPECT_EQ(trace::sink(), nullptr);
+    // nothing to report to
+    trace::Scope scope{"unused"};
+    trace::count("unused", 1);
+}
+
+TEST(TraceTest, ring_sink_stats) {
+    trace::RingSink sink{16};
+    SinkGuard guard{&sink};
+
+    for (int i = 0; i < 3; i++) trace::Scope scope{"span"};
+    trace::count("counter", 5);
+    trace::count("counter", 7);
+
+    auto stats = sink.stats();
+    ASSERT_EQ(stats.size(), 2u);
+    EXPECT_EQ(stats["span"].count, 3u);
+    EXPECT_GE(stats["span"].total_ns, stats["span"].max_ns);
+    EXPECT_EQ(stats["counter"].count, 2u);
+    EXPECT_EQ(stats["counter"].last_value, 7);
+    EXPECT_EQ(stats["counter"].total_ns, 0u);
+
+    auto events = sink.events();
+    ASSERT_EQ(events.size(), 5u);
+    EXPECT_FALSE(events[0].is_counter);
+    EXPECT_LE(events[0].start_ns, events[0].end_ns);
+    EXPECT_TRUE(events[4].is_counter);
+    EXPECT_EQ(events[4].value, 7);
+
+    sink.clear();
+    EXPECT_TRUE(sink.stats().empty());
+    EXPECT_TRUE(sink.events().empty());
+}
+
+TEST(TraceTest, ring_sink_keeps_last_events) {
+    trace::RingSink sink{4};
+    for (int i = 0; i < 10; i++) sink.counter("counter", i, i, 0);
+
+    auto events = sink.events();
+    ASSERT_EQ(events.size(), 4u);
+    for (int i = 0; i < 4; i++) EXPECT_EQ(events[i].value, 6 + i);
+
+    // statistics cover events dropped from the ring
+    EXPECT_EQ(sink.stats()["counter"].count, 10u);
+}
+
+TEST(TraceTest, ring_sink_threads) {
+    trace::RingSink sink{1024};
+    SinkGuard guard{&sink};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+        threads.emplace_back([] {
+            for (int i = 0; i < 100; i++) trace::Scope scope{"span"};
+        });
+    for (auto& t : threads) t.join();
+
+    EXPECT_EQ(sink.stats()["span"].count, 400u);
+    std::vector<uint32_t> ids;
+    for (const auto& e : sink.events()) ids.push_back(e.thread);
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    EXPECT_EQ(ids.size(), 4u);
+}
+
+TEST(TraceTest, scope_reports_to_sink_of_start) {
+    trace::RingSink first, second;
+    SinkGuard guard{&first};
+    {
+        trace::Scope scope{"span"};
+        trace::set_sink(&second);
+    }
+    EXPECT_EQ(first.stats()["span"].count, 1u);
+    EXPECT_TRUE(second.stats().empty());
+}
+
+TEST(TraceTest, chrome_trace_sink) {
+    const std::string path = "trace_test.json";
+    {
+        trace::ChromeTraceSink sink{path};
+        sink.span("span", 1000, 3500, 1);
+        sink.counter("counter", 42, 2000, 2);
+    }
+
+    std::ifstream in{path};
+    std::stringstream ss;
+    ss << in.rdbuf();
+    const std::string json = ss.str();
+    std::remove(path.c_str());
+
+    EXPECT_EQ(json.front(), '[');
+    EXPECT_NE(json.find("{\"name\":\"span\",\"ph\":\"X\",\"pid\":0,\"tid\":1,"
+                        "\"ts\":1.0,\"dur\":2.5}"),
+              std::string::npos);
+    EXPECT_NE(json.find("{\"name\":\"counter\",\"ph\":\"C\",\"pid\":0,"
+                        "\"tid\":2,\"ts\":2.0,\"args\":{\"value\":42}}"),
+              std::string::npos);
+    EXPECT_EQ(json.substr(json.size() - 3), "\n]\n");
+}
+
+TEST(TraceTest, chrome_trace_sink_bad_path) {
+    EXPECT_THROW(trace::ChromeTraceSink{"/nonexistent/trace.json"},
+                 std::runtime_error);
+}
+
+TEST(TraceTest, macros) {
+    trace::RingSink sink;
+    SinkGuard guard{&sink};
+    {
+        OUSTER_TRACE_SCOPE("macro_span");
+        OUSTER_TRACE_SCOPE("nested_span");
+        OUSTER_TRACE_COUNTER("macro_counter", 3u);
+    }
+
+#ifdef OUSTER_TRACING
+    auto stats = sink.stats();
+    EXPECT_EQ(stats["macro_span"].count, 1u);
+    EXPECT_EQ(stats["nested_span"].count, 1u);
+    EXPECT_EQ(stats["macro_counter"].last_value, 3);
+#else
+    EXPECT_TRUE(sink.stats().empty());
+#endif
+}
@@ -0,0 +1,444 @@
+/**
+ * Copyright (c) 2022, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ouster/buffered_udp_source.h"
+#include "ouster/client.h"
+#include "ouster/packet_fanout.h"
+#include "ouster/types.h"
+
+using namespace ouster::sensor;
+
+namespace ouster {
+namespace sensor {
+// defined in client.cpp, but not declared in a public header
+extern int get_lidar_socket_fd(client& cli);
+}  // namespace sensor
+}  // namespace ouster
+
+namespace {
+
+uint64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(system_clock::now().time_since_epoch())
+        .count();
+}
+
+// send a datagram of size len filled with fill to localhost:port
+void send_packet(int port, size_t len, uint8_t fill) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(fd, 0);
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    std::vector<uint8_t> buf(len, fill);
+    auto sent = sendto(fd, buf.data(), buf.size(), 0, (sockaddr*)&addr,
+                       sizeof(addr));
+    close(fd);
+    ASSERT_EQ(sent, (ssize_t)len);
+}
+
+// wait up to a second for the buffer to hold n packets
+bool wait_for_size(impl::BufferedUDPSource& src, size_t n) {
+    for (int i = 0; i < 100 && src.size() != n; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return src.size() == n;
+}
+
+class UDPClientTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        cli = init_client("", 0, 0);
+        ASSERT_TRUE(cli);
+        lidar_port = get_lidar_port(*cli);
+        ASSERT_GT(lidar_port, 0);
+    }
+
+    // allocate n buffers large enough for a lidar packet
+    void alloc_bufs(size_t n) {
+        storage.assign(n, std::vector<uint8_t>(pf.lidar_packet_size + 1));
+        bufs.clear();
+        for (auto& b : storage) bufs.push_back(b.data());
+    }
+
+    const packet_format& pf = get_format(default_sensor_info(MODE_1024x10));
+    std::shared_ptr<client> cli;
+    int lidar_port = 0;
+    std::vector<std::vector<uint8_t>> storage;
+    std::vector<uint8_t*> bufs;
+};
+
+}  // namespace
+
+TEST_F(UDPClientTest, read_lidar_packets_empty_socket) {
+    alloc_bufs(8);
+    EXPECT_EQ(read_lidar_packets(*cli, bufs.data(), 8, pf), 0);
+}
+
+TEST_F(UDPClientTest, read_lidar_packets_drains_queue) {
+    // stay well within the default socket receive buffer
+    const int n_sent = 12;
+    for (int i = 0; i < n_sent; i++)
+        send_packet(lidar_port, pf.lidar_packet_size, (uint8_t)i);
+
+    ASSERT_EQ(poll_client(*cli) & LIDAR_DATA, LIDAR_DATA);
+
+    alloc_bufs(n_sent + 10);
+    EXPECT_EQ(read_lidar_packets(*cli, bufs.data(), n_sent + 10, pf), n_sent);
+    for (int i = 0; i < n_sent; i++) {
+        EXPECT_EQ(storage[i].front(), (uint8_t)i);
+        EXPECT_EQ(storage[i][pf.lidar_packet_size - 1], (uint8_t)i);
+    }
+
+    EXPECT_EQ(read_lidar_packets(*cli, bufs.data(), n_sent, pf), 0);
+}
+
+TEST_F(UDPClientTest, read_lidar_packets_respects_max_n) {
+    for (int i = 0; i < 10; i++)
+        send_packet(lidar_port, pf.lidar_packet_size, (uint8_t)i);
+
+    ASSERT_EQ(poll_client(*cli) & LIDAR_DATA, LIDAR_DATA);
+
+    alloc_bufs(4);
+    EXPECT_EQ(read_lidar_packets(*cli, bufs.data(), 4, pf), 4);
+    EXPECT_EQ(storage[3].front(), 3);
+
+    alloc_bufs(10);
+    EXPECT_EQ(read_lidar_packets(*cli, bufs.data(), 10, pf), 6);
+    EXPECT_EQ(storage[0].front(), 4);
+    EXPECT_EQ(storage[5].front(), 9);
+}
+
+TEST_F(UDPClientTest, read_lidar_packets_drops_bad_sizes) {
+    send_packet(lidar_port, pf.lidar_packet_size, 1);
+    send_packet(lidar_port, pf.lidar_packet_size - 1, 2);
+    send_packet(lidar_port, pf.lidar_packet_size + 1, 3);
+    send_packet(lidar_port, pf.lidar_packet_size, 4);
+
+    ASSERT_EQ(poll_client(*cli) & LIDAR_DATA, LIDAR_DATA);
+
+    alloc_bufs(8);
+    EXPECT_EQ(read_lidar_packets(*cli, bufs.data(), 8, pf), 2);
+    EXPECT_EQ(storage[0].front(), 1);
+    EXPECT_EQ(storage[1].front(), 4);
+    EXPECT_EQ(storage[1][pf.lidar_packet_size - 1], 4);
+}
+
+TEST_F(UDPClientTest, read_lidar_packets_rx_timestamps) {
+    const uint64_t before = now_ns();
+    send_packet(lidar_port, pf.lidar_packet_size, 1);
+    send_packet(lidar_port, pf.lidar_packet_size - 1, 2);
+    send_packet(lidar_port, pf.lidar_packet_size, 3);
+    send_packet(lidar_port, pf.lidar_packet_size, 4);
+
+    ASSERT_EQ(poll_client(*cli) & LIDAR_DATA, LIDAR_DATA);
+
+    // single read
+    alloc_bufs(4);
+    uint64_t rx_ts = 0;
+    ASSERT_TRUE(read_lidar_packet(*cli, bufs[0], rx_ts, pf));
+    EXPECT_EQ(storage[0].front(), 1);
+    EXPECT_GE(rx_ts, before);
+
+    // batched reads keep timestamps aligned with compacted packets
+    std::vector<uint64_t> rx_tss(4, 0);
+    EXPECT_EQ(read_lidar_packets(*cli, bufs.data(), 4, pf, rx_tss.data()), 2);
+    EXPECT_EQ(storage[0].front(), 3);
+    EXPECT_EQ(storage[1].front(), 4);
+    EXPECT_GE(rx_tss[0], rx_ts);
+    EXPECT_GE(rx_tss[1], rx_tss[0]);
+    EXPECT_LE(rx_tss[1], now_ns());
+    EXPECT_EQ(rx_tss[2], 0u);
+}
+
+TEST_F(UDPClientTest, packet_ring_reads_lidar_port) {
+    if (!use_packet_ring(*cli, "lo"))
+        GTEST_SKIP() << "packet ring unavailable (needs CAP_NET_RAW)";
+
+    const uint64_t before = now_ns();
+    send_packet(lidar_port, pf.lidar_packet_size, 1);
+    send_packet(lidar_port, pf.lidar_packet_size - 1, 2);
+    send_packet(lidar_port + 1, pf.lidar_packet_size, 3);
+    send_packet(lidar_port, pf.lidar_packet_size, 4);
+
+    ASSERT_EQ(poll_client(*cli) & LIDAR_DATA, LIDAR_DATA);
+
+    // looped back packets are captured once, and other ports are filtered
+    alloc_bufs(8);
+    std::vector<uint64_t> rx_tss(8, 0);
+    EXPECT_EQ(read_lidar_packets(*cli, bufs.data(), 8, pf, rx_tss.data()), 2);
+    EXPECT_EQ(storage[0].front(), 1);
+    EXPECT_EQ(storage[1].front(), 4);
+    EXPECT_EQ(storage[1][pf.lidar_packet_size - 1], 4);
+    EXPECT_GE(rx_tss[0], before);
+    EXPECT_GE(rx_tss[1], rx_tss[0]);
+    EXPECT_EQ(read_lidar_packets(*cli, bufs.data(), 8, pf), 0);
+}
+
+TEST_F(UDPClientTest, lidar_drops_count_overflows) {
+#ifdef __linux__
+    ASSERT_EQ(get_lidar_drops(*cli), 0);
+
+    // shrink the socket buffer so that it overflows before being read
+    const int rcvbuf = 1;
+    ASSERT_EQ(setsockopt(get_lidar_socket_fd(*cli), SOL_SOCKET, SO_RCVBUF,
+                         &rcvbuf, sizeof(rcvbuf)),
+              0);
+    const int n_sent = 64;
+    for (int i = 0; i < n_sent; i++)
+        send_packet(lidar_port, pf.lidar_packet_size, 1);
+
+    alloc_bufs(n_sent);
+    const int n_read = read_lidar_packets(*cli, bufs.data(), n_sent, pf);
+    EXPECT_GT(n_read, 0);
+    EXPECT_EQ(get_lidar_drops(*cli), n_sent - n_read);
+#else
+    EXPECT_EQ(get_lidar_drops(*cli), -1);
+#endif
+}
+
+TEST(BufferedUDPSourceTest, consume_batch_and_notify_fd) {
+    using impl::BufferedUDPSource;
+    const auto& pf = get_format(default_sensor_info(MODE_1024x10));
+    const size_t packet_size = pf.lidar_packet_size;
+    BufferedUDPSource src{"", 0, 0, 16};
+    const int port = src.get_lidar_port();
+
+    pollfd pfd{src.notify_fd(), POLLIN, 0};
+    EXPECT_EQ(pfd.fd, src.notify_fd());
+    EXPECT_EQ(poll(&pfd, 1, 0), 0);
+
+    std::thread producer{[&] { src.produce(pf); }};
+    const uint64_t before = now_ns();
+    for (int i = 0; i < 5; i++) send_packet(port, packet_size, (uint8_t)i);
+    EXPECT_EQ(poll(&pfd, 1, 1000), 1);
+    for (int i = 0; i < 100 && src.size() < 5; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_EQ(src.size(), 5u);
+    src.clear_notify();
+    EXPECT_EQ(poll(&pfd, 1, 0), 0);
+
+    // all buffered packets in one call, without waiting for more
+    std::vector<uint8_t> buf(16 * packet_size);
+    std::vector<client_state> states(16);
+    std::vector<uint64_t> rx_ts(16);
+    size_t n = 0;
+    auto st = src.consume_batch(buf.data(), packet_size, 16, 1.0, n,
+                                states.data(), rx_ts.data());
+    EXPECT_EQ(st, LIDAR_DATA);
+    ASSERT_EQ(n, 5u);
+    for (size_t i = 0; i < n; i++) {
+        EXPECT_EQ(states[i], LIDAR_DATA);
+        EXPECT_EQ(buf[i * packet_size], i);
+        EXPECT_EQ(buf[i * packet_size + packet_size - 1], i);
+        EXPECT_GE(rx_ts[i], before);
+    }
+    EXPECT_EQ(src.last_rx_timestamp(), rx_ts[4]);
+    EXPECT_EQ(src.size(), 0u);
+    EXPECT_EQ(src.consume_batch(buf.data(), packet_size, 16, 0.0, n,
+                                states.data(), rx_ts.data()),
+              TIMEOUT);
+    EXPECT_EQ(n, 0u);
+
+    // signaled again once caught up
+    send_packet(port, packet_size, 9);
+    EXPECT_EQ(poll(&pfd, 1, 1000), 1);
+    src.clear_notify();
+    st = src.consume_batch(buf.data(), packet_size, 1, 1.0, n, states.data(),
+                           rx_ts.data());
+    EXPECT_EQ(n, 1u);
+    EXPECT_EQ(buf[0], 9);
+
+    // and on shutdown
+    src.shutdown();
+    producer.join();
+    EXPECT_EQ(poll(&pfd, 1, 0), 1);
+    EXPECT_EQ(src.consume_batch(buf.data(), packet_size, 16, 1.0, n,
+                                states.data(), rx_ts.data()),
+              EXIT);
+    EXPECT_EQ(n, 0u);
+}
+
+TEST(BufferedUDPSourceTest, ring_round_trip_wraparound_and_full) {
+    using impl::BufferedUDPSource;
+    const auto& pf = get_format(default_sensor_info(MODE_1024x10));
+    const size_t packet_size = pf.lidar_packet_size;
+    BufferedUDPSource src{"", 0, 0, 4};
+    const int port = src.get_lidar_port();
+    ASSERT_EQ(src.capacity(), 4u);
+
+    // nothing to peek at yet
+    const uint8_t* data = nullptr;
+    EXPECT_EQ(src.peek(data, 0.05f), TIMEOUT);
+    EXPECT_EQ(data, nullptr);
+
+    std::thread producer{[&] { src.produce(pf); }};
+    std::vector<uint8_t> buf(packet_size);
+
+    // peek borrows the oldest packet until advance() releases it
+    const uint64_t before = now_ns();
+    for (int i = 0; i < 2; i++) send_packet(port, packet_size, (uint8_t)i);
+    ASSERT_TRUE(wait_for_size(src, 2));
+    uint64_t rx_ts = 0;
+    EXPECT_EQ(src.peek(data, 1.0f, &rx_ts), LIDAR_DATA);
+    ASSERT_NE(data, nullptr);
+    EXPECT_EQ(data[0], 0);
+    EXPECT_EQ(data[packet_size - 1], 0);
+    EXPECT_GE(rx_ts, before);
+    const uint8_t* again = nullptr;
+    EXPECT_EQ(src.peek(again, 1.0f), LIDAR_DATA);
+    EXPECT_EQ(again, data);
+    EXPECT_EQ(src.size(), 2u);
+    src.advance();
+    EXPECT_EQ(src.size(), 1u);
+    EXPECT_EQ(src.consume(buf.data(), packet_size, 1.0f), LIDAR_DATA);
+    EXPECT_EQ(buf[0], 1);
+    EXPECT_EQ(src.size(), 0u);
+
+    // packets come out in order as the indices wrap around several times
+    uint8_t next = 2;
+    for (int round = 0; round < 6; round++) {
+        for (int i = 0; i < 3; i++)
+            send_packet(port, packet_size, (uint8_t)(next + i));
+        ASSERT_TRUE(wait_for_size(src, 3)) << "round " << round;
+        for (int i = 0; i < 3; i++) {
+            ASSERT_EQ(src.consume(buf.data(), packet_size, 1.0f), LIDAR_DATA);
+            EXPECT_EQ(buf[0], next++);
+        }
+    }
+
+    // when the ring is full, the producer waits and leaves packets queued
+    // on the socket, then flags the first packet it writes once woken up.
+    // Later packets are flagged too if it catches up with the consumer again
+    const int n_sent = 7;
+    for (int i = 0; i < n_sent; i++)
+        send_packet(port, packet_size, (uint8_t)(next + i));
+    ASSERT_TRUE(wait_for_size(src, 4));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(src.size(), 4u);
+    for (int i = 0; i < n_sent; i++) {
+        const auto st = src.consume(buf.data(), packet_size, 1.0f);
+        ASSERT_NE(st, TIMEOUT) << "packet " << i;
+        const int overflow = st & BufferedUDPSource::CLIENT_OVERFLOW;
+        EXPECT_EQ(st & ~overflow, LIDAR_DATA) << "packet " << i;
+        if (i <= 4) {
+            EXPECT_EQ(overflow != 0, i == 4) << "packet " << i;
+        }
+        EXPECT_EQ(buf[0], next++);
+    }
+    EXPECT_EQ(src.consume(buf.data(), packet_size, 0.05f), TIMEOUT);
+
+    src.shutdown();
+    producer.join();
+}
+
+TEST(MulticastTest, clients_share_group) {
+    const char* group = "239.255.42.99";
+    auto a = init_client("", 0, 0);
+    ASSERT_TRUE(a);
+    const int port = get_lidar_port(*a);
+    auto b = init_client("", port, get_imu_port(*a));
+    ASSERT_TRUE(b);
+    EXPECT_FALSE(join_multicast(*a, "127.0.0.1"));
+    EXPECT_FALSE(join_multicast(*a, group, "no-such-interface"));
+    if (!join_multicast(*a, group, "lo") || !join_multicast(*b, group, "lo"))
+        GTEST_SKIP() << "no multicast on loopback";
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(fd, 0);
+    in_addr lo{};
+    lo.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &lo, sizeof(lo)), 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, group, &addr.sin_addr);
+    const auto& pf = get_format(default_sensor_info(MODE_1024x10));
+    std::vector<uint8_t> packet(pf.lidar_packet_size, 7);
+    ASSERT_EQ(sendto(fd, packet.data(), packet.size(), 0, (sockaddr*)&addr,
+                     sizeof(addr)),
+              (ssize_t)packet.size());
+    close(fd);
+
+    // every member of the group gets its own copy
+    std::vector<uint8_t> buf(pf.lidar_packet_size + 1);
+    for (auto* cli : {a.get(), b.get()}) {
+        ASSERT_EQ(poll_client(*cli), LIDAR_DATA);
+        ASSERT_TRUE(read_lidar_packet(*cli, buf.data(), pf));
+        EXPECT_EQ(buf[0], 7);
+    }
+}
+
+TEST(PacketFanoutTest, handlers_share_packets) {
+    const auto& pf = get_format(default_sensor_info(MODE_1024x10));
+    auto cli = init_client("", 0, 0);
+    ASSERT_TRUE(cli);
+    const int port = get_lidar_port(*cli);
+    EXPECT_THROW(PacketFanout(nullptr, pf), std::invalid_argument);
+
+    PacketFanout fanout{cli, pf};
+    std::atomic<int> n_a{0}, n_b{0};
+    std::vector<const uint8_t*> seen_a, seen_b;
+    EXPECT_EQ(fanout.add_handler([&](client_state st, const uint8_t* buf,
+                                     uint64_t rx_ts) {
+        EXPECT_EQ(st, LIDAR_DATA);
+        EXPECT_GT(rx_ts, 0u);
+        EXPECT_EQ(buf[0], n_a);
+        seen_a.push_back(buf);
+        n_a++;
+    }),
+              1u);
+    fanout.add_handler([&](client_state, const uint8_t* buf, uint64_t) {
+        seen_b.push_back(buf);
+        n_b++;
+    });
+    EXPECT_THROW(fanout.add_handler({}), std::invalid_argument);
+
+    fanout.start();
+    EXPECT_THROW(fanout.add_handler([](client_state, const uint8_t*,
+                                       uint64_t) {}),
+                 std::invalid_argument);
+    for (int i = 0; i < 5; i++)
+        send_packet(port, pf.lidar_packet_size, (uint8_t)i);
+    for (int i = 0; i < 100 && n_b < 5; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    fanout.stop();
+
+    // both handlers see each packet in the same receive buffer
+    ASSERT_EQ(n_a, 5);
+    ASSERT_EQ(n_b, 5);
+    EXPECT_EQ(seen_a, seen_b);
+    EXPECT_EQ(fanout.stats().lidar_packets, 5u);
+    EXPECT_EQ(fanout.stats().imu_packets, 0u);
+}
+
+TEST(InitClientsTest, unreachable_sensors_fail_concurrently) {
+    // nothing listens on port 1, so each sensor fails on the first request
+    const std::vector<std::string> hostnames(4, "127.0.0.1:1");
+    auto fut = init_client_async(hostnames[0], "");
+    const auto clients = init_clients(hostnames);
+    ASSERT_EQ(clients.size(), hostnames.size());
+    for (const auto& c : clients) EXPECT_FALSE(c);
+    EXPECT_FALSE(fut.get());
+    EXPECT_TRUE(init_clients({}).empty());
+}